@@ -0,0 +1,435 @@
+//--------------------------------------------------------------------------------------
+// File: AssetCooker.cpp
+//
+// Offline conversion of the demo's source assets into the formats loaded at startup.
+//
+// Usage: AssetCooker textures [-o <container>] [<name>=[normals:]<image>[:<format>] ...]
+//        <format>: rgba8 (default), r8, rg8, bc1, bc4, bc5
+//        AssetCooker heightmap [-o <file>] [-tile <samples>] [-float] [<image>]
+//        AssetCooker bake [-o <file>] [-chunks <n>] [-lods <n>] [-factor <n>] [<image>]
+//        AssetCooker shaders [-debug]
+//
+// normals: derives the texture from the red channel of a heightmap instead of loading
+// it, as the x and y of the tangent-space normals with every mip derived from the
+// filtered heights (see NormalMap.h).
+//
+// Without texture arguments the demo's diffuse and displacement maps are cooked into
+// Textures/Textures.pack as BC1 and BC4 (red only, as sampled by the domain shader), and
+// the normal map derived from the displacement map as BC5 (x and y, the pixel shader
+// derives z). The heightmap of the quadtree terrain and its normal map are cooked the
+// same way.
+//
+// The heightmap command cooks the red channel of an image into a tiled heightmap with
+// per-tile mips for streaming (see TiledHeightmap.h), 16-bit unless -float is given.
+//
+// The bake command bakes the static LOD meshes drawn without tessellation (see
+// TerrainBaker.h) from the red channel of an image. Without one it bakes both terrains
+// of the demo from the texels it displaces by, the decoded blocks of the texture
+// container if there is one, so that the demo finds them up to date.
+//
+// The shaders command fills the demo's shader cache with the release (or -debug) build
+// of every shader it creates, so the first launch does not compile them. It needs the
+// D3D compiler and is only available on Windows.
+//--------------------------------------------------------------------------------------
+#include "TextureContainer.h"
+#include "TiledHeightmap.h"
+#include "NormalMap.h"
+#include "HeightPyramid.h"
+#include "TerrainBaker.h"
+#include "BlockCompression.h"
+#include "ImageIO.h"
+#include "ShaderCache.h"
+#include "DemoShaders.h"
+#include "Timer.h"
+#ifdef _WIN32
+#include "D3DShaderCompiler.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define DEFAULT_TEXTURE_CONTAINER "Textures/Textures.pack"
+#define DERIVED_NORMALS_PREFIX "normals:"
+#define DEFAULT_TILED_HEIGHTMAP "Textures/Terrain.tiles"
+#define DEFAULT_HEIGHTMAP_SOURCE "Textures/Displacement/mountaindispmap.png"
+#define DEFAULT_HEIGHTMAP_TILE_SIZE 256
+#define DEFAULT_BAKED_TERRAIN "Textures/Terrain.blod"
+
+static const char* s_DefaultTextures[] =
+{
+	"diffuse=Textures/Diffuse/rock_diffuse.jpg:bc1",
+	"displacement=Textures/Displacement/rock_displacement.jpg:bc4",
+	"normal=normals:Textures/Displacement/rock_displacement.jpg:bc5",
+	"terrain_displacement=Textures/Displacement/mountaindispmap.png:bc4",
+	"terrain_normal=normals:Textures/Displacement/mountaindispmap.png:bc5",
+};
+
+// The terrains baked by default, from the container entry or the image the demo loads
+struct BakedTerrainSource
+{
+	const char* pOutput;
+	const char* pTextureName;
+	const char* pImage;
+	int ChunksPerSide;
+};
+
+static const BakedTerrainSource s_DefaultBakedTerrains[] =
+{
+	{ DEFAULT_BAKED_TERRAIN, "displacement", "Textures/Displacement/rock_displacement.jpg", 8 },
+	{ "Textures/QuadtreeTerrain.blod", "terrain_displacement", DEFAULT_HEIGHTMAP_SOURCE, 16 },
+};
+
+struct FormatSuffix
+{
+	const char* Suffix;
+	const char* Name;
+	TEXTURE_FORMAT Format;
+};
+
+static const FormatSuffix s_FormatSuffixes[] =
+{
+	{ ":rgba8", "RGBA8", TEXTURE_FORMAT_R8G8B8A8_UNORM },
+	{ ":r8", "R8", TEXTURE_FORMAT_R8_UNORM },
+	{ ":rg8", "RG8", TEXTURE_FORMAT_R8G8_UNORM },
+	{ ":bc1", "BC1", TEXTURE_FORMAT_BC1_UNORM },
+	{ ":bc4", "BC4", TEXTURE_FORMAT_BC4_UNORM },
+	{ ":bc5", "BC5", TEXTURE_FORMAT_BC5_UNORM },
+};
+
+#define FORMAT_SUFFIX_COUNT (sizeof(s_FormatSuffixes) / sizeof(s_FormatSuffixes[0]))
+
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+static bool EndsWith(const std::string& text, const char* pSuffix)
+{
+	size_t length = strlen(pSuffix);
+	return text.size() >= length && text.compare(text.size() - length, length, pSuffix) == 0;
+}
+
+// Parses name=[normals:]path[:format], the suffix is optional so Windows drive letters
+// still work
+static bool ParseTextureArgument(const char* pArg, TextureSource& source, std::string& path, bool& deriveNormals)
+{
+	const char* pSeparator = strchr(pArg, '=');
+	if (!pSeparator || pSeparator == pArg)
+		return false;
+
+	source.Name.assign(pArg, pSeparator - pArg);
+	path = pSeparator + 1;
+	source.Format = TEXTURE_FORMAT_R8G8B8A8_UNORM;
+	for (size_t i = 0; i < FORMAT_SUFFIX_COUNT; i++)
+	{
+		if (EndsWith(path, s_FormatSuffixes[i].Suffix))
+		{
+			source.Format = s_FormatSuffixes[i].Format;
+			path.resize(path.size() - strlen(s_FormatSuffixes[i].Suffix));
+			break;
+		}
+	}
+	deriveNormals = path.compare(0, strlen(DERIVED_NORMALS_PREFIX), DERIVED_NORMALS_PREFIX) == 0;
+	if (deriveNormals)
+		path.erase(0, strlen(DERIVED_NORMALS_PREFIX));
+	return !path.empty();
+}
+
+static int CookTextures(int argc, char** argv)
+{
+	const char* pOutput = DEFAULT_TEXTURE_CONTAINER;
+	std::vector<const char*> arguments;
+	for (int i = 0; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			pOutput = argv[++i];
+		else
+			arguments.push_back(argv[i]);
+	}
+	if (arguments.empty())
+		arguments.assign(s_DefaultTextures, s_DefaultTextures + sizeof(s_DefaultTextures) / sizeof(s_DefaultTextures[0]));
+
+	double start = GetTimeSeconds();
+	std::vector<TextureSource> textures(arguments.size());
+	for (size_t i = 0; i < arguments.size(); i++)
+	{
+		std::string path;
+		bool deriveNormals;
+		if (!ParseTextureArgument(arguments[i], textures[i], path, deriveNormals))
+		{
+			printf("Invalid texture argument %s, expected <name>=[normals:]<image>[:rgba8|:r8|:rg8|:bc1|:bc4|:bc5]\n", arguments[i]);
+			return 2;
+		}
+		if (!LoadImageFile(path.c_str(), textures[i].Texels))
+		{
+#ifdef _WIN32
+			printf("Failed to load %s\n", path.c_str());
+#else
+			printf("Failed to load %s, only binary PGM/PPM images are supported on this platform\n", path.c_str());
+#endif
+			return 1;
+		}
+		if (deriveNormals)
+		{
+			std::vector<Image> mips;
+			if (!DeriveNormalMapMips(textures[i].Texels, NORMAL_MAP_SLOPE_SCALE, mips))
+			{
+				printf("Failed to derive the normal map of %s\n", path.c_str());
+				return 1;
+			}
+			textures[i].Texels = mips[0];
+			textures[i].Mips.assign(mips.begin() + 1, mips.end());
+		}
+		if (IsBlockCompressed(textures[i].Format) &&
+			(textures[i].Texels.Width % BC_BLOCK_DIMENSION != 0 || textures[i].Texels.Height % BC_BLOCK_DIMENSION != 0))
+		{
+			printf("%s is %dx%d, block compression needs dimensions divisible by %d\n", path.c_str(),
+				textures[i].Texels.Width, textures[i].Texels.Height, BC_BLOCK_DIMENSION);
+			return 1;
+		}
+		printf("%-16s %s%s %dx%d\n", textures[i].Name.c_str(), deriveNormals ? DERIVED_NORMALS_PREFIX : "", path.c_str(),
+			textures[i].Texels.Width, textures[i].Texels.Height);
+	}
+
+	std::vector<TextureCookStats> stats;
+	if (!WriteTextureContainer(pOutput, textures, &stats))
+	{
+		printf("Failed to write %s\n", pOutput);
+		return 1;
+	}
+	printf("Wrote %s in %.1f ms\n", pOutput, (GetTimeSeconds() - start) * 1000.0);
+
+	// Sizes include the mip chains, the baseline is what the demo uploaded before: RGBA8
+	unsigned long long totalSize = 0, totalUncompressed = 0;
+	printf("%-16s %-6s %10s %12s %12s %8s\n", "texture", "format", "PSNR (dB)", "size (KB)", "RGBA8 (KB)", "saved");
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const char* pFormatName = "";
+		for (size_t f = 0; f < FORMAT_SUFFIX_COUNT; f++)
+		{
+			if (s_FormatSuffixes[f].Format == textures[i].Format)
+				pFormatName = s_FormatSuffixes[f].Name;
+		}
+		printf("%-16s %-6s %10.2f %12.1f %12.1f %7.1fx\n", textures[i].Name.c_str(), pFormatName, stats[i].Psnr,
+			stats[i].Size / 1024.0, stats[i].UncompressedSize / 1024.0, (double)stats[i].UncompressedSize / stats[i].Size);
+		totalSize += stats[i].Size;
+		totalUncompressed += stats[i].UncompressedSize;
+	}
+	if (totalSize > 0)
+	{
+		printf("%-16s %-6s %10s %12.1f %12.1f %7.1fx\n", "total", "", "", totalSize / 1024.0, totalUncompressed / 1024.0,
+			(double)totalUncompressed / totalSize);
+	}
+	return 0;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Heightmaps
+//--------------------------------------------------------------------------------------
+static int CookHeightmap(int argc, char** argv)
+{
+	const char* pOutput = DEFAULT_TILED_HEIGHTMAP;
+	const char* pSource = DEFAULT_HEIGHTMAP_SOURCE;
+	unsigned int tileSize = DEFAULT_HEIGHTMAP_TILE_SIZE;
+	HEIGHT_FORMAT format = HEIGHT_FORMAT_R16_UNORM;
+	for (int i = 0; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			pOutput = argv[++i];
+		else if (strcmp(argv[i], "-tile") == 0 && i + 1 < argc)
+			tileSize = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-float") == 0)
+			format = HEIGHT_FORMAT_R32_FLOAT;
+		else
+			pSource = argv[i];
+	}
+
+	double start = GetTimeSeconds();
+	Image image;
+	if (!LoadImageFile(pSource, image))
+	{
+		printf("Failed to load %s\n", pSource);
+		return 1;
+	}
+
+	const Image* pImage = &image;
+	HeightRowFunction rowFunction = [pImage](unsigned int y, float* pRow)
+	{
+		const unsigned char* pTexels = &pImage->Texels[(size_t)y * pImage->Width * pImage->Channels];
+		for (int x = 0; x < pImage->Width; x++)
+			pRow[x] = pTexels[x * pImage->Channels] / 255.0f;
+	};
+	if (!WriteTiledHeightmap(pOutput, image.Width, image.Height, format, tileSize, rowFunction))
+	{
+		printf("Failed to write %s, the tile size has to be a power of two in [%d, %d]\n", pOutput,
+			TILED_HEIGHTMAP_MIN_TILE_SIZE, TILED_HEIGHTMAP_MAX_TILE_SIZE);
+		return 1;
+	}
+	printf("Wrote %s: %dx%d %s in %ux%u tiles in %.1f ms\n", pOutput, image.Width, image.Height,
+		format == HEIGHT_FORMAT_R16_UNORM ? "r16" : "r32f", tileSize, tileSize, (GetTimeSeconds() - start) * 1000.0);
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Baked terrains
+//--------------------------------------------------------------------------------------
+// Builds the pyramid of the heights the demo displaces by: the decoded blocks or texels
+// of the container entry if there is one, otherwise the red channel of the image
+static bool BuildBakeSource(const TextureContainerReader* pContainer, const char* pTextureName, const char* pImage,
+	HeightPyramid& pyramid)
+{
+	const TextureContainerEntry* pEntry = (pContainer && pTextureName) ? pContainer->FindTexture(pTextureName) : NULL;
+	if (pEntry && pEntry->Format == TEXTURE_FORMAT_BC4_UNORM)
+	{
+		Image decoded;
+		DecompressImage((const unsigned char*)pContainer->GetMipData(*pEntry, 0), BC_FORMAT_BC4, pEntry->Width, pEntry->Height, decoded);
+		return pyramid.Build(decoded.Texels.data(), decoded.Width, decoded.Height, decoded.Width, 1);
+	}
+	if (pEntry)
+	{
+		int texelStride = (pEntry->Format == TEXTURE_FORMAT_R8_UNORM) ? 1 : 4;
+		return pyramid.Build((const unsigned char*)pContainer->GetMipData(*pEntry, 0), pEntry->Width, pEntry->Height,
+			pEntry->Mips[0].RowPitch, texelStride);
+	}
+
+	Image image;
+	if (!LoadImageFile(pImage, image))
+	{
+		printf("Failed to load %s\n", pImage);
+		return false;
+	}
+	return pyramid.Build(image.Texels.data(), image.Width, image.Height, image.Width * image.Channels, image.Channels);
+}
+
+static int BakeTerrains(int argc, char** argv)
+{
+	const char* pOutput = NULL;
+	const char* pSource = NULL;
+	TerrainBakeDesc desc;
+	int chunksPerSide = 0;
+	for (int i = 0; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			pOutput = argv[++i];
+		else if (strcmp(argv[i], "-chunks") == 0 && i + 1 < argc)
+			chunksPerSide = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-lods") == 0 && i + 1 < argc)
+			desc.LodCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-factor") == 0 && i + 1 < argc)
+			desc.MaxFactor = atoi(argv[++i]);
+		else
+			pSource = argv[i];
+	}
+
+	std::vector<BakedTerrainSource> terrains;
+	if (pSource)
+	{
+		BakedTerrainSource source = { pOutput ? pOutput : DEFAULT_BAKED_TERRAIN, NULL, pSource, desc.ChunksPerSide };
+		terrains.push_back(source);
+	}
+	else
+	{
+		terrains.assign(s_DefaultBakedTerrains, s_DefaultBakedTerrains + sizeof(s_DefaultBakedTerrains) / sizeof(s_DefaultBakedTerrains[0]));
+		if (pOutput)
+		{
+			terrains.resize(1);
+			terrains[0].pOutput = pOutput;
+		}
+	}
+
+	TextureContainerReader container;
+	const TextureContainerReader* pContainer = (!pSource && container.Open(DEFAULT_TEXTURE_CONTAINER)) ? &container : NULL;
+	for (size_t i = 0; i < terrains.size(); i++)
+	{
+		const BakedTerrainSource& source = terrains[i];
+		HeightPyramid pyramid;
+		if (!BuildBakeSource(pContainer, source.pTextureName, source.pImage, pyramid))
+			return 1;
+
+		TerrainBakeDesc terrainDesc = desc;
+		terrainDesc.ChunksPerSide = chunksPerSide > 0 ? chunksPerSide : source.ChunksPerSide;
+		TerrainBakeStats stats;
+		if (!BakeTerrain(source.pOutput, pyramid, terrainDesc, &stats))
+		{
+			printf("Failed to bake %s: the chunks, LODs or factor are out of range, a chunk needs more than %d vertices or writing failed\n",
+				source.pOutput, BAKED_TERRAIN_MAX_CHUNK_VERTICES);
+			return 1;
+		}
+
+		long long triangles = 0;
+		for (int lod = 0; lod < terrainDesc.LodCount; lod++)
+			triangles += stats.SimplifiedTriangles[lod];
+		printf("Wrote %s: %dx%d chunks, %d LODs from factor %d, %lld triangles, error %.4f at LOD 0, %.1f KB in %.1f s\n",
+			source.pOutput, terrainDesc.ChunksPerSide, terrainDesc.ChunksPerSide, terrainDesc.LodCount, terrainDesc.MaxFactor,
+			triangles, stats.MaxError[0], stats.FileSize / 1024.0, stats.Seconds);
+	}
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shaders
+//--------------------------------------------------------------------------------------
+static int PrecompileShaders(int argc, char** argv)
+{
+	bool debug = (argc >= 1 && strcmp(argv[0], "-debug") == 0);
+#ifdef _WIN32
+	D3DShaderCompiler compiler;
+	ShaderCache cache(&compiler, SHADER_CACHE_DIRECTORY);
+	for (int i = 0; i < DEMO_SHADER_COUNT; i++)
+	{
+		ShaderCompileRequest request;
+		request.FileName = g_DemoShaders[i].FileName;
+		request.EntryPoint = g_DemoShaders[i].EntryPoint;
+		request.Profile = g_DemoShaders[i].Profile;
+		request.Flags = D3DShaderCompiler::GetFlags(debug);
+
+		std::vector<unsigned char> bytecode;
+		std::string errors;
+		if (!cache.GetShader(request, bytecode, &errors))
+		{
+			printf("%s(%s): failed\n%s", request.FileName.c_str(), request.EntryPoint.c_str(), errors.c_str());
+			return 1;
+		}
+		printf("%-40s %-8s %-7s %6d bytes\n", request.FileName.c_str(), request.EntryPoint.c_str(), request.Profile.c_str(), (int)bytecode.size());
+	}
+
+	const ShaderCacheStats& stats = cache.GetStats();
+	printf("%s: %d up to date, %d compiled in %.1f ms\n", SHADER_CACHE_DIRECTORY, stats.Hits, stats.Misses, stats.CompileSeconds * 1000.0);
+	return 0;
+#else
+	(void)debug;
+	printf("Compiling shaders needs the D3D compiler, which is only available on Windows\n");
+	return 1;
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "textures") == 0)
+		return CookTextures(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "heightmap") == 0)
+		return CookHeightmap(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "bake") == 0)
+		return BakeTerrains(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "shaders") == 0)
+		return PrecompileShaders(argc - 2, argv + 2);
+
+	printf("Usage: AssetCooker textures [-o <container>] [<name>=<image>[:rgba8|:r8|:bc1|:bc4|:bc5] ...]\n");
+	printf("       AssetCooker heightmap [-o <file>] [-tile <samples>] [-float] [<image>]\n");
+	printf("       AssetCooker bake [-o <file>] [-chunks <n>] [-lods <n>] [-factor <n>] [<image>]\n");
+	printf("       AssetCooker shaders [-debug]\n");
+	return 2;
+}
@@ -0,0 +1,137 @@
+//--------------------------------------------------------------------------------------
+// File: BakedTerrain.cpp
+//--------------------------------------------------------------------------------------
+#include "BakedTerrain.h"
+#include "FrustumCulling.h"
+#include <math.h>
+
+
+//--------------------------------------------------------------------------------------
+// Reading
+//--------------------------------------------------------------------------------------
+bool BakedTerrain::Open(const char* pFileName)
+{
+	Close();
+	if (!m_File.Open(pFileName))
+		return false;
+
+	size_t size = m_File.GetSize();
+	const BakedTerrainHeader* pHeader = (const BakedTerrainHeader*)m_File.GetData();
+	bool valid = size >= sizeof(BakedTerrainHeader) && pHeader->Magic == BAKED_TERRAIN_MAGIC &&
+		pHeader->Version == BAKED_TERRAIN_VERSION && pHeader->FileSize == size &&
+		pHeader->ChunksPerSide >= 1 && pHeader->ChunksPerSide <= BAKED_TERRAIN_MAX_CHUNKS &&
+		pHeader->LodCount >= 1 && pHeader->LodCount <= BAKED_TERRAIN_MAX_LODS;
+	unsigned long long chunkCount = valid ? (unsigned long long)pHeader->ChunksPerSide * pHeader->ChunksPerSide : 0;
+	unsigned long long tableSize = chunkCount * (valid ? pHeader->LodCount : 0) * sizeof(BakedChunkLod);
+	valid = valid && pHeader->ChunkTableOffset % sizeof(unsigned long long) == 0 && pHeader->ChunkTableOffset <= size &&
+		tableSize <= size - pHeader->ChunkTableOffset;
+
+	const BakedChunkLod* pChunkLods = valid ? (const BakedChunkLod*)(m_File.GetData() + pHeader->ChunkTableOffset) : NULL;
+	for (unsigned int lod = 0; valid && lod < pHeader->LodCount; lod++)
+	{
+		const BakedLodBlock& block = pHeader->Lods[lod];
+		unsigned long long blockSize = (unsigned long long)block.VertexCount * sizeof(BakedVertex) +
+			(unsigned long long)block.IndexCount * sizeof(unsigned short);
+		valid = block.Offset % BAKED_TERRAIN_ALIGNMENT == 0 && block.Offset <= size && blockSize <= size - block.Offset;
+		for (unsigned long long chunk = 0; valid && chunk < chunkCount; chunk++)
+		{
+			const BakedChunkLod& chunkLod = pChunkLods[lod * chunkCount + chunk];
+			valid = chunkLod.VertexCount <= BAKED_TERRAIN_MAX_CHUNK_VERTICES && chunkLod.IndexCount % 3 == 0 &&
+				chunkLod.FirstVertex <= block.VertexCount && chunkLod.VertexCount <= block.VertexCount - chunkLod.FirstVertex &&
+				chunkLod.FirstIndex <= block.IndexCount && chunkLod.IndexCount <= block.IndexCount - chunkLod.FirstIndex;
+		}
+	}
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	m_pHeader = pHeader;
+	m_pChunkLods = pChunkLods;
+	return true;
+}
+
+void BakedTerrain::Close()
+{
+	m_File.Close();
+	m_pHeader = NULL;
+	m_pChunkLods = NULL;
+}
+
+bool BakedTerrain::DecodeVertex(const BakedVertex& vertex, float position[3]) const
+{
+	position[0] = vertex.Position[0] / 65535.0f * 2.0f - 1.0f;
+	position[1] = m_pHeader->HeightMin + vertex.Position[1] / 65535.0f * m_pHeader->HeightRange;
+	position[2] = vertex.Position[2] / 65535.0f * 2.0f - 1.0f;
+	return vertex.Position[3] != 0;
+}
+
+void BakedTerrain::GetChunkRect(int chunk, float& x0, float& z0, float& x1, float& z1) const
+{
+	int chunksPerSide = GetChunksPerSide();
+	int x = chunk % chunksPerSide, z = chunk / chunksPerSide;
+	x0 = (float)x / chunksPerSide * 2.0f - 1.0f;
+	x1 = (float)(x + 1) / chunksPerSide * 2.0f - 1.0f;
+	z0 = (float)z / chunksPerSide * 2.0f - 1.0f;
+	z1 = (float)(z + 1) / chunksPerSide * 2.0f - 1.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Selection
+//--------------------------------------------------------------------------------------
+int BakedTerrain::Select(const BakedSelectParams& params, BakedDraw* pDraws, int maxDraws) const
+{
+	int count = 0;
+	int lodCount = GetLodCount();
+	for (int chunk = 0; chunk < GetChunkCount() && count < maxDraws; chunk++)
+	{
+		// The skirts hang down to the lowest vertex of the terrain, the finest LOD reaches
+		// the highest texel of the chunk
+		float rect[4];
+		GetChunkRect(chunk, rect[0], rect[1], rect[2], rect[3]);
+		const BakedChunkLod& finest = GetChunkLod(chunk, 0);
+		float minimum[3] = { rect[0] * params.WorldScale[0], m_pHeader->HeightMin * params.HeightScale, rect[1] * params.WorldScale[2] };
+		float maximum[3] = { rect[2] * params.WorldScale[0], finest.MaxHeight * params.HeightScale, rect[3] * params.WorldScale[2] };
+		if (params.pFrustum)
+		{
+			float center[3], extent[3];
+			for (int c = 0; c < 3; c++)
+			{
+				center[c] = 0.5f * (minimum[c] + maximum[c]);
+				extent[c] = 0.5f * fabsf(maximum[c] - minimum[c]);
+			}
+			if (!IsBoxVisible(*params.pFrustum, center, extent))
+				continue;
+		}
+
+		// Distance from the eye to the surface of the chunk, without the skirts
+		minimum[1] = finest.MinHeight * params.HeightScale;
+		float squaredDistance = 0.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			float low = minimum[c] < maximum[c] ? minimum[c] : maximum[c];
+			float high = minimum[c] < maximum[c] ? maximum[c] : minimum[c];
+			float d = params.Eye[c] < low ? low - params.Eye[c] : (params.Eye[c] > high ? params.Eye[c] - high : 0.0f);
+			squaredDistance += d * d;
+		}
+		float distance = sqrtf(squaredDistance);
+
+		int lod = lodCount - 1;
+		while (lod > 0 && GetChunkLod(chunk, lod).Error * params.HeightScale * params.PixelsPerUnit > params.MaxPixelError * distance)
+			lod--;
+		pDraws[count].Chunk = chunk;
+		pDraws[count].Lod = lod;
+		count++;
+	}
+	return count;
+}
+
+long long BakedTerrain::CountTriangles(const BakedDraw* pDraws, int count) const
+{
+	long long triangles = 0;
+	for (int i = 0; i < count; i++)
+		triangles += GetChunkLod(pDraws[i].Chunk, pDraws[i].Lod).IndexCount / 3;
+	return triangles;
+}
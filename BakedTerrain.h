@@ -0,0 +1,152 @@
+//--------------------------------------------------------------------------------------
+// File: BakedTerrain.h
+//
+// Static LOD meshes of the displaced terrain, baked offline by TerrainBaker.h for
+// devices that cannot run the hull and domain shaders (feature level 10_x) or when
+// tessellating is too expensive. The [-1, 1] quad is split into ChunksPerSide^2 chunks,
+// chunk x + z * ChunksPerSide covering the grid cell of TerrainGrid with the same index
+// when both have the same size, and every chunk has LodCount meshes from the finest to
+// the coarsest. Each mesh records its error, the largest vertical distance from the
+// terrain tessellated at the finest factor, so the LOD of a chunk can be chosen by the
+// size of that error on screen. Skirts hanging from the chunk borders hide the cracks
+// between neighbouring chunks at different LODs.
+//
+// Layout: BakedTerrainHeader, the BakedChunkLod table (LodCount rows of ChunkCount
+// entries), then one block per LOD with the vertices and then the 16-bit indices of all
+// its chunks. The blocks are stored coarsest first and start on a page, so a streamer
+// can map the coarse LODs first and each finer one later with a single
+// FileMapping::MapRange. BakedTerrain maps the whole file.
+//
+// Vertices are four 16-bit UNORM values: x and z over the quad, y over [HeightMin,
+// HeightMin + HeightRange] in displacement units (the sampled texel value, before
+// Scaling * DisplacementLevel), and w 1 on skirt vertices. The pixel shader lights the
+// terrain from the normal map, so no normals are stored. Indices are relative to the
+// first vertex of their chunk, which is the base vertex of its draw.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "MappedFile.h"
+#include <stddef.h>
+
+struct Frustum;
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define BAKED_TERRAIN_MAGIC             0x444f4c42      // "BLOD"
+#define BAKED_TERRAIN_VERSION           1
+#define BAKED_TERRAIN_ALIGNMENT         4096
+#define BAKED_TERRAIN_MAX_LODS          8
+#define BAKED_TERRAIN_MAX_CHUNKS        256             // per side
+#define BAKED_TERRAIN_MAX_CHUNK_VERTICES 65536          // 16-bit indices
+
+
+//--------------------------------------------------------------------------------------
+// File structures
+//--------------------------------------------------------------------------------------
+struct BakedVertex
+{
+	unsigned short Position[4];
+};
+
+struct BakedLodBlock
+{
+	unsigned long long Offset;          // of the block, the indices follow the vertices
+	unsigned int VertexCount;           // of all chunks
+	unsigned int IndexCount;
+	unsigned int Factor;                // tessellation factor the LOD was baked from
+	float MaxError;                     // largest error of its chunks
+};
+
+struct BakedChunkLod
+{
+	unsigned int FirstVertex;           // within the vertices of the LOD block
+	unsigned int VertexCount;
+	unsigned int FirstIndex;            // within the indices of the LOD block
+	unsigned int IndexCount;
+	float Error;                        // largest vertical distance from the finest tessellation, in displacement units
+	float MinHeight;                    // of the surface without the skirts
+	float MaxHeight;
+	unsigned int Reserved;
+};
+
+struct BakedTerrainHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int ChunksPerSide;
+	unsigned int LodCount;
+	unsigned long long SourceHash;      // HashBytes of the heightmap texels the terrain was baked from
+	float HeightMin;                    // of every vertex, skirts included
+	float HeightRange;
+	unsigned long long ChunkTableOffset;
+	unsigned long long FileSize;
+	BakedLodBlock Lods[BAKED_TERRAIN_MAX_LODS];  // LOD 0 is the finest
+};
+
+
+//--------------------------------------------------------------------------------------
+// Selection
+//--------------------------------------------------------------------------------------
+struct BakedSelectParams
+{
+	float Eye[3];
+	const Frustum* pFrustum = NULL;     // NULL selects without culling
+	float WorldScale[3];                // the World matrix is a pure scale
+	float HeightScale;                  // world height of a displacement unit, Scaling * DisplacementLevel
+	float PixelsPerUnit;                // pixels of a world unit at distance 1, Projection._22 * viewport height / 2
+	float MaxPixelError = 1.0f;
+};
+
+// One chunk of a selection and the LOD it is drawn with
+struct BakedDraw
+{
+	int Chunk;
+	int Lod;
+};
+
+
+//--------------------------------------------------------------------------------------
+// BakedTerrain
+//--------------------------------------------------------------------------------------
+class BakedTerrain
+{
+public:
+	// Maps the file and validates the table and the blocks against its size
+	bool Open(const char* pFileName);
+	void Close();
+
+	bool IsOpen() const { return m_pHeader != NULL; }
+	const BakedTerrainHeader& GetHeader() const { return *m_pHeader; }
+	int GetChunksPerSide() const { return (int)m_pHeader->ChunksPerSide; }
+	int GetChunkCount() const { return (int)(m_pHeader->ChunksPerSide * m_pHeader->ChunksPerSide); }
+	int GetLodCount() const { return (int)m_pHeader->LodCount; }
+	const BakedChunkLod& GetChunkLod(int chunk, int lod) const { return m_pChunkLods[lod * GetChunkCount() + chunk]; }
+
+	const BakedVertex* GetLodVertices(int lod) const
+	{
+		return (const BakedVertex*)(m_File.GetData() + m_pHeader->Lods[lod].Offset);
+	}
+	const unsigned short* GetLodIndices(int lod) const
+	{
+		return (const unsigned short*)(GetLodVertices(lod) + m_pHeader->Lods[lod].VertexCount);
+	}
+
+	// Object space position of a vertex, y in displacement units. Returns whether it is a
+	// skirt vertex.
+	bool DecodeVertex(const BakedVertex& vertex, float position[3]) const;
+
+	// Object space rectangle of a chunk
+	void GetChunkRect(int chunk, float& x0, float& z0, float& x1, float& z1) const;
+
+	// Culls the chunks and picks the coarsest LOD of each whose error covers at most
+	// MaxPixelError pixels at its distance. Returns the number of draws, at most maxDraws.
+	int Select(const BakedSelectParams& params, BakedDraw* pDraws, int maxDraws) const;
+
+	long long CountTriangles(const BakedDraw* pDraws, int count) const;
+
+private:
+	MappedFile m_File;
+	const BakedTerrainHeader* m_pHeader = NULL;
+	const BakedChunkLod* m_pChunkLods = NULL;
+};
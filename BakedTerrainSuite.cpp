@@ -0,0 +1,419 @@
+//--------------------------------------------------------------------------------------
+// File: BakedTerrainSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "BakedTerrain.h"
+#include "TerrainBaker.h"
+#include "HeightPyramid.h"
+#include "SceneUpdate.h"
+#include "TerrainHeightField.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Baked static LOD terrain. A small bake of the density heightmap is read back and
+// checked against the heights the domain shader displaces by: the vertices, the stored
+// errors recomputed at every point of the finest tessellation, watertight chunks with
+// skirts on every border and the selection.
+//--------------------------------------------------------------------------------------
+#define BAKED_MAP_SIZE          256
+#define BAKED_CHUNKS            4
+#define BAKED_LODS              4
+#define BAKED_FACTOR            32
+#define BAKED_FILE              "BakedVerify.blod"
+#define BAKED_SERIAL_FILE       "BakedVerifySerial.blod"
+#define BAKED_CORRUPT_FILE      "BakedVerifyCorrupt.blod"
+
+static bool ReadFileBytes(const char* pFileName, std::vector<unsigned char>& bytes)
+{
+	FILE* pFile = fopen(pFileName, "rb");
+	if (!pFile)
+		return false;
+	fseek(pFile, 0, SEEK_END);
+	long size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	bytes.resize(size > 0 ? (size_t)size : 0);
+	bool success = size > 0 && fread(&bytes[0], 1, bytes.size(), pFile) == bytes.size();
+	fclose(pFile);
+	return success;
+}
+
+// Whether Open rejects the file with its bytes changed by modify
+template<typename Modify>
+static bool RejectsCorruption(const std::vector<unsigned char>& bytes, Modify modify)
+{
+	std::vector<unsigned char> corrupt(bytes);
+	modify(corrupt);
+	FILE* pFile = fopen(BAKED_CORRUPT_FILE, "wb");
+	if (!pFile)
+		return false;
+	fwrite(corrupt.data(), 1, corrupt.size(), pFile);
+	fclose(pFile);
+	BakedTerrain terrain;
+	bool opened = terrain.Open(BAKED_CORRUPT_FILE);
+	terrain.Close();
+	remove(BAKED_CORRUPT_FILE);
+	return !opened;
+}
+
+// Object space coordinate of a point of the finest tessellation, the way the baker
+// computes it from the chunk the point belongs to
+static float BakedGridCoordinate(int point, int factor, int chunksPerSide)
+{
+	int chunk = std::min(point / factor, chunksPerSide - 1);
+	return ((float)chunk + (float)(point - chunk * factor) / factor) / chunksPerSide * 2.0f - 1.0f;
+}
+
+// Checks one chunk LOD. The error is recomputed by interpolating the decoded triangles at
+// every point of the finest tessellation.
+static void CheckBakedChunkLod(const BakedTerrain& terrain, const TerrainHeightField& field, int chunk, int lod,
+	int factor, float quantization, long long& skirtEdges, SuiteCheck& check)
+{
+	int chunksPerSide = terrain.GetChunksPerSide();
+	const BakedChunkLod& chunkLod = terrain.GetChunkLod(chunk, lod);
+	const BakedVertex* pVertices = terrain.GetLodVertices(lod) + chunkLod.FirstVertex;
+	const unsigned short* pIndices = terrain.GetLodIndices(lod) + chunkLod.FirstIndex;
+	int gridX0 = (chunk % chunksPerSide) * factor, gridZ0 = (chunk / chunksPerSide) * factor;
+
+	// Vertices on the grid at the height of their point, skirts below
+	std::vector<float> positions(chunkLod.VertexCount * 3);
+	std::vector<int> gridPoints(chunkLod.VertexCount * 2);
+	std::vector<char> skirt(chunkLod.VertexCount);
+	int vertexErrors = 0;
+	float gridScale = 0.5f * chunksPerSide * factor;
+	for (unsigned int v = 0; v < chunkLod.VertexCount; v++)
+	{
+		float* p = &positions[v * 3];
+		skirt[v] = terrain.DecodeVertex(pVertices[v], p) ? 1 : 0;
+		int x = (int)floorf((p[0] + 1.0f) * gridScale + 0.5f), z = (int)floorf((p[2] + 1.0f) * gridScale + 0.5f);
+		gridPoints[v * 2] = x;
+		gridPoints[v * 2 + 1] = z;
+		float height = field.SampleHeight(BakedGridCoordinate(x, factor, chunksPerSide), BakedGridCoordinate(z, factor, chunksPerSide));
+		bool inside = x >= gridX0 && x <= gridX0 + factor && z >= gridZ0 && z <= gridZ0 + factor;
+		if (!inside || fabsf(p[0] + 1.0f - x / gridScale) > 1e-4f || fabsf(p[2] + 1.0f - z / gridScale) > 1e-4f ||
+			(skirt[v] ? p[1] >= height - quantization : fabsf(p[1] - height) > quantization))
+			vertexErrors++;
+	}
+	check.FailIf(vertexErrors > 0, "chunk %d LOD %d has %d vertices off the grid or its heights", chunk, lod, vertexErrors);
+
+	// Front faces from above, every edge between surface vertices shared or on the chunk
+	// border with a skirt below it
+	std::vector<unsigned long long> edges, skirtSides;
+	int indexErrors = 0, windingErrors = 0;
+	for (unsigned int i = 0; i < chunkLod.IndexCount; i += 3)
+	{
+		bool valid = pIndices[i] < chunkLod.VertexCount && pIndices[i + 1] < chunkLod.VertexCount && pIndices[i + 2] < chunkLod.VertexCount;
+		if (!valid)
+		{
+			indexErrors++;
+			continue;
+		}
+		bool hasSkirt = skirt[pIndices[i]] || skirt[pIndices[i + 1]] || skirt[pIndices[i + 2]];
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned long long edge = ((unsigned long long)pIndices[i + c] << 32) | pIndices[i + (c + 1) % 3];
+			edges.push_back(edge);
+			if (hasSkirt)
+				skirtSides.push_back(edge);
+		}
+		const float* p0 = &positions[pIndices[i] * 3];
+		const float* p1 = &positions[pIndices[i + 1] * 3];
+		const float* p2 = &positions[pIndices[i + 2] * 3];
+		float crossY = (p1[2] - p0[2]) * (p2[0] - p0[0]) - (p1[0] - p0[0]) * (p2[2] - p0[2]);
+		if (!hasSkirt && crossY <= 0.0f)
+			windingErrors++;
+	}
+	std::sort(edges.begin(), edges.end());
+	std::sort(skirtSides.begin(), skirtSides.end());
+	int openEdges = 0, borderErrors = 0;
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		int a = (int)(edges[e] >> 32), b = (int)(edges[e] & 0xffffffffu);
+		if (skirt[a] || skirt[b])
+			continue;
+		unsigned long long reverse = ((unsigned long long)b << 32) | (unsigned int)a;
+		if (!std::binary_search(edges.begin(), edges.end(), reverse))
+			openEdges++;
+
+		// A surface edge continued by a skirt ends the surface, which only happens on the border
+		if (std::binary_search(skirtSides.begin(), skirtSides.end(), reverse))
+		{
+			const int* pa = &gridPoints[a * 2];
+			const int* pb = &gridPoints[b * 2];
+			bool onBorder = (pa[0] == pb[0] && (pa[0] == gridX0 || pa[0] == gridX0 + factor)) ||
+				(pa[1] == pb[1] && (pa[1] == gridZ0 || pa[1] == gridZ0 + factor));
+			borderErrors += onBorder ? 0 : 1;
+			skirtEdges++;
+		}
+	}
+	check.FailIf(indexErrors > 0 || windingErrors > 0 || openEdges > 0 || borderErrors > 0,
+		"chunk %d LOD %d has %d indices out of range, %d back faces, %d open edges, %d skirts off the border",
+		chunk, lod, indexErrors, windingErrors, openEdges, borderErrors);
+
+	// The largest vertical distance from the finest tessellation over the surface triangles
+	std::vector<char> covered((size_t)(factor + 1) * (factor + 1), 0);
+	float error = 0.0f, minHeight = 1e30f, maxHeight = -1e30f;
+	for (unsigned int i = 0; i + 2 < chunkLod.IndexCount && indexErrors == 0; i += 3)
+	{
+		const unsigned short* t = pIndices + i;
+		if (skirt[t[0]] || skirt[t[1]] || skirt[t[2]])
+			continue;
+		const int* g[3] = { &gridPoints[t[0] * 2], &gridPoints[t[1] * 2], &gridPoints[t[2] * 2] };
+		float area = (float)((g[1][0] - g[0][0]) * (g[2][1] - g[0][1]) - (g[1][1] - g[0][1]) * (g[2][0] - g[0][0]));
+		if (area == 0.0f)
+			continue;
+		for (int c = 0; c < 3; c++)
+		{
+			minHeight = std::min(minHeight, positions[t[c] * 3 + 1]);
+			maxHeight = std::max(maxHeight, positions[t[c] * 3 + 1]);
+		}
+		for (int z = gridZ0; z <= gridZ0 + factor; z++)
+		{
+			for (int x = gridX0; x <= gridX0 + factor; x++)
+			{
+				float w[3];
+				for (int c = 0; c < 3; c++)
+				{
+					const int* q0 = g[(c + 1) % 3];
+					const int* q1 = g[(c + 2) % 3];
+					w[c] = (float)((q1[0] - q0[0]) * (z - q0[1]) - (q1[1] - q0[1]) * (x - q0[0])) / area;
+				}
+				if (w[0] < 0.0f || w[1] < 0.0f || w[2] < 0.0f)
+					continue;
+				float interpolated = w[0] * positions[t[0] * 3 + 1] + w[1] * positions[t[1] * 3 + 1] + w[2] * positions[t[2] * 3 + 1];
+				float height = field.SampleHeight(BakedGridCoordinate(x, factor, chunksPerSide), BakedGridCoordinate(z, factor, chunksPerSide));
+				error = std::max(error, fabsf(interpolated - height));
+				covered[(size_t)(z - gridZ0) * (factor + 1) + (x - gridX0)] = 1;
+			}
+		}
+	}
+	int uncovered = (int)std::count(covered.begin(), covered.end(), 0);
+	check.FailIf(uncovered > 0 || fabsf(error - chunkLod.Error) > 2.0f * quantization + 1e-5f ||
+		fabsf(minHeight - chunkLod.MinHeight) > quantization || fabsf(maxHeight - chunkLod.MaxHeight) > quantization,
+		"chunk %d LOD %d leaves %d points uncovered, error %g stored as %g, heights [%g, %g] stored as [%g, %g]",
+		chunk, lod, uncovered, error, chunkLod.Error, minHeight, maxHeight, chunkLod.MinHeight, chunkLod.MaxHeight);
+}
+
+int VerifyBakedTerrain()
+{
+	SuiteCheck check("baked");
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(BAKED_MAP_SIZE, BAKED_MAP_SIZE, texels);
+	HeightPyramid pyramid;
+	pyramid.Build(&texels[0], BAKED_MAP_SIZE, BAKED_MAP_SIZE, BAKED_MAP_SIZE, 1);
+
+	TerrainBakeDesc desc;
+	desc.ChunksPerSide = BAKED_CHUNKS;
+	desc.LodCount = BAKED_LODS;
+	desc.MaxFactor = BAKED_FACTOR;
+	TerrainBakeDesc badFactor = desc, tooManyLods = desc, tooManyChunks = desc;
+	badFactor.MaxFactor = 24;
+	tooManyLods.LodCount = 7;
+	tooManyChunks.ChunksPerSide = BAKED_TERRAIN_MAX_CHUNKS + 1;
+	check.FailIf(BakeTerrain(BAKED_FILE, pyramid, badFactor) || BakeTerrain(BAKED_FILE, pyramid, tooManyLods) ||
+		BakeTerrain(BAKED_FILE, pyramid, tooManyChunks),
+		"BakeTerrain accepts a factor that is not a power of two or more LODs or chunks than it supports");
+
+	// Threads only split the chunks, the files match byte for byte
+	TerrainBakeStats stats;
+	TerrainBakeDesc serial = desc;
+	serial.Threads = 1;
+	desc.Threads = 3;
+	std::vector<unsigned char> bytes, serialBytes;
+	if (!BakeTerrain(BAKED_FILE, pyramid, desc, &stats) || !BakeTerrain(BAKED_SERIAL_FILE, pyramid, serial) ||
+		!ReadFileBytes(BAKED_FILE, bytes) || !ReadFileBytes(BAKED_SERIAL_FILE, serialBytes))
+	{
+		check.Fail("cannot bake %s", BAKED_FILE);
+		remove(BAKED_FILE);
+		remove(BAKED_SERIAL_FILE);
+		return check.Finish();
+	}
+	remove(BAKED_SERIAL_FILE);
+	check.FailIf(bytes != serialBytes, "baking on 3 threads and on 1 thread gives different files");
+
+	BakedTerrain terrain;
+	if (!terrain.Open(BAKED_FILE))
+	{
+		check.Fail("Open rejects the baked file");
+		remove(BAKED_FILE);
+		return check.Finish();
+	}
+	const BakedTerrainHeader& header = terrain.GetHeader();
+	check.FailIf(terrain.GetChunksPerSide() != BAKED_CHUNKS || terrain.GetLodCount() != BAKED_LODS ||
+		header.SourceHash != GetTerrainBakeHash(pyramid) || header.FileSize != bytes.size() ||
+		stats.FileSize != bytes.size(), "the header has %d chunks per side, %d LODs, hash %llx and size %llu",
+		terrain.GetChunksPerSide(), terrain.GetLodCount(), header.SourceHash, header.FileSize);
+	for (int lod = 0; lod < BAKED_LODS; lod++)
+	{
+		bool aligned = header.Lods[lod].Offset % BAKED_TERRAIN_ALIGNMENT == 0;
+		bool coarsestFirst = lod == 0 || header.Lods[lod].Offset < header.Lods[lod - 1].Offset;
+		check.FailIf(!aligned || !coarsestFirst || header.Lods[lod].Factor != (unsigned int)(BAKED_FACTOR >> lod),
+			"LOD %d block at %llu, factor %u", lod, header.Lods[lod].Offset, header.Lods[lod].Factor);
+	}
+
+	// Every chunk LOD against the heights DS displaces by in object space
+	TerrainHeightField field;
+	float objectScale[3] = { 1.0f, 1.0f, 1.0f };
+	field.Init(&pyramid, objectScale, 1.0f, 1.0f);
+	float quantization = header.HeightRange / 65535.0f + 1e-6f;
+	long long skirtEdges = 0;
+	for (int lod = 0; lod < terrain.GetLodCount(); lod++)
+	{
+		for (int chunk = 0; chunk < terrain.GetChunkCount(); chunk++)
+			CheckBakedChunkLod(terrain, field, chunk, lod, BAKED_FACTOR, quantization, skirtEdges, check);
+	}
+
+	// Simplification only removes triangles and the cache order only helps
+	for (int lod = 0; lod < BAKED_LODS; lod++)
+	{
+		check.FailIf(stats.SimplifiedTriangles[lod] > stats.TessellatedTriangles[lod] ||
+			stats.SimplifiedTriangles[lod] <= 0 || stats.AcmrAfter[lod] > stats.AcmrBefore[lod] + 1e-6f ||
+			(lod > 0 && stats.SimplifiedTriangles[lod] > stats.SimplifiedTriangles[lod - 1]),
+			"LOD %d has %d of %d triangles, ACMR %.3f after %.3f before", lod, stats.SimplifiedTriangles[lod],
+			stats.TessellatedTriangles[lod], stats.AcmrAfter[lod], stats.AcmrBefore[lod]);
+	}
+
+	// LOD 0 is tessellated at the reference factor, so only the simplification adds error
+	check.FailIf(stats.MaxError[0] > desc.BaseError * 1.0001f, "LOD 0 error %.5f above the limit %.5f",
+		stats.MaxError[0], desc.BaseError);
+
+	// Moving away never selects a finer LOD, far away every chunk is at the coarsest LOD
+	// and a chunk under the eye at a LOD with no visible error
+	BakedSelectParams params;
+	for (int c = 0; c < 3; c++)
+		params.WorldScale[c] = 3.0f;
+	params.HeightScale = 0.3f;
+	params.PixelsPerUnit = 1000.0f;
+	std::vector<BakedDraw> draws(terrain.GetChunkCount());
+	std::vector<int> previous(terrain.GetChunkCount(), 0);
+	int selectionErrors = 0;
+	for (int step = 0; step <= 64; step++)
+	{
+		params.Eye[0] = -0.5f;
+		params.Eye[1] = 1.0f + step * step * 0.5f;
+		params.Eye[2] = 0.25f;
+		int count = terrain.Select(params, &draws[0], (int)draws.size());
+		selectionErrors += (count == terrain.GetChunkCount()) ? 0 : 1;
+		for (int i = 0; i < count; i++)
+		{
+			const BakedDraw& draw = draws[i];
+			selectionErrors += (draw.Lod < previous[draw.Chunk]) ? 1 : 0;
+			previous[draw.Chunk] = draw.Lod;
+			if (step == 64)
+				selectionErrors += (draw.Lod == BAKED_LODS - 1) ? 0 : 1;
+		}
+	}
+	const int eyeChunk = BAKED_CHUNKS + 1;
+	float x0, z0, x1, z1;
+	terrain.GetChunkRect(eyeChunk, x0, z0, x1, z1);
+	const BakedChunkLod& finest = terrain.GetChunkLod(eyeChunk, 0);
+	params.Eye[0] = 1.5f * (x0 + x1);
+	params.Eye[1] = 0.15f * (finest.MinHeight + finest.MaxHeight);
+	params.Eye[2] = 1.5f * (z0 + z1);
+	int count = terrain.Select(params, &draws[0], (int)draws.size());
+	for (int i = 0; i < count; i++)
+	{
+		if (draws[i].Chunk == eyeChunk && draws[i].Lod > 0 && terrain.GetChunkLod(eyeChunk, draws[i].Lod).Error > 0.0f)
+			selectionErrors++;
+	}
+
+	// A frustum behind the terrain culls every chunk
+	Frustum frustum;
+	float view[4][4], projection[4][4], viewProjection[4][4];
+	float eye[3] = { 0.0f, 1.0f, -20.0f }, at[3] = { 0.0f, 1.0f, -40.0f }, up[3] = { 0.0f, 1.0f, 0.0f };
+	BuildLookAtLH(eye, at, up, view);
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, 16.0f / 9.0f, 0.01f, 100.0f, projection);
+	MultiplyMatrices(view, projection, viewProjection);
+	ExtractFrustumPlanes(viewProjection, frustum);
+	params.pFrustum = &frustum;
+	selectionErrors += (terrain.Select(params, &draws[0], (int)draws.size()) == 0) ? 0 : 1;
+	check.FailIf(selectionErrors > 0, "%d selection errors", selectionErrors);
+	terrain.Close();
+
+	// Truncated files, wrong magic, versions and tables out of the file
+	bool rejected = RejectsCorruption(bytes, [](std::vector<unsigned char>& b) { b.resize(b.size() - 1); }) &&
+		RejectsCorruption(bytes, [](std::vector<unsigned char>& b) { ((BakedTerrainHeader*)&b[0])->Magic ^= 1; }) &&
+		RejectsCorruption(bytes, [](std::vector<unsigned char>& b) { ((BakedTerrainHeader*)&b[0])->Version++; }) &&
+		RejectsCorruption(bytes, [](std::vector<unsigned char>& b) { ((BakedTerrainHeader*)&b[0])->LodCount = BAKED_TERRAIN_MAX_LODS + 1; }) &&
+		RejectsCorruption(bytes, [](std::vector<unsigned char>& b) { ((BakedTerrainHeader*)&b[0])->Lods[0].VertexCount = 0x10000000; }) &&
+		RejectsCorruption(bytes, [](std::vector<unsigned char>& b) { ((BakedTerrainHeader*)&b[0])->Lods[1].Offset += 16; }) &&
+		RejectsCorruption(bytes, [](std::vector<unsigned char>& b)
+		{
+			BakedTerrainHeader* pHeader = (BakedTerrainHeader*)&b[0];
+			((BakedChunkLod*)&b[(size_t)pHeader->ChunkTableOffset])[0].IndexCount = pHeader->Lods[0].IndexCount + 3;
+		});
+	check.FailIf(!rejected, "Open accepts a corrupted file");
+	remove(BAKED_FILE);
+
+	return check.Finish("%d chunks x %d LODs, %lld skirt edges", BAKED_CHUNKS * BAKED_CHUNKS, BAKED_LODS, skirtEdges);
+}
+
+void RunBakedTerrainSuite()
+{
+	const int size = 1024;
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(size, size, texels);
+	HeightPyramid pyramid;
+	pyramid.Build(&texels[0], size, size, size, 1);
+
+	const char* pFileName = BAKED_FILE;
+	TerrainBakeDesc desc;
+	desc.ChunksPerSide = 8;
+	TerrainBakeStats stats;
+	if (!BakeTerrain(pFileName, pyramid, desc, &stats))
+	{
+		printf("baked: cannot bake %s\n", pFileName);
+		return;
+	}
+	printf("baked %dx%d  %dx%d chunks  %d LODs from factor %d  %.2f s  %.1f MB\n", size, size, desc.ChunksPerSide,
+		desc.ChunksPerSide, desc.LodCount, desc.MaxFactor, stats.Seconds, stats.FileSize / (1024.0 * 1024.0));
+	for (int lod = 0; lod < desc.LodCount; lod++)
+	{
+		printf("baked LOD %d  factor %2d  %8d tessellated  %8d simplified (%5.1f%%)  %6d skirt triangles  "
+			"ACMR %.3f -> %.3f  error %.4f\n", lod, desc.MaxFactor >> lod, stats.TessellatedTriangles[lod],
+			stats.SimplifiedTriangles[lod], 100.0 * stats.SimplifiedTriangles[lod] / stats.TessellatedTriangles[lod],
+			stats.SkirtTriangles[lod], stats.AcmrBefore[lod], stats.AcmrAfter[lod], stats.MaxError[lod]);
+	}
+
+	// The default camera flying over the terrain, the cost of a selection and what it draws
+	BakedTerrain terrain;
+	if (!terrain.Open(pFileName))
+	{
+		printf("baked: cannot open %s\n", pFileName);
+		remove(pFileName);
+		return;
+	}
+	SceneCamera camera;
+	SceneSettings settings;
+	settings.BakedLod = true;
+	SceneFrame scene;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, 16.0f / 9.0f, 0.01f, 100.0f, projection);
+	std::vector<BakedDraw> draws(terrain.GetChunkCount());
+	const int frames = 1000;
+	long long triangles = 0, drawn = 0;
+	double selectSeconds = 0.0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		float t = (float)frame / frames * 6.2831853f;
+		camera.Eye[0] = 6.0f * cosf(t);
+		camera.Eye[1] = 1.0f + 2.0f * (1.0f + sinf(3.0f * t));
+		camera.Eye[2] = 6.0f * sinf(t);
+		UpdateScene(camera, settings, projection, 0.0f, scene);
+		double start = GetTimeSeconds();
+		int count = SelectBakedTerrainChunks(terrain, camera, settings, projection[1][1], 1080.0f, scene, &draws[0], (int)draws.size());
+		selectSeconds += GetTimeSeconds() - start;
+		drawn += count;
+		triangles += terrain.CountTriangles(&draws[0], count);
+	}
+	long long finest = 0;
+	for (int chunk = 0; chunk < terrain.GetChunkCount(); chunk++)
+		finest += terrain.GetChunkLod(chunk, 0).IndexCount / 3;
+	printf("baked flight  %d frames  select %6.2f us  %5.1f chunks  %8.0f triangles (%.1f%% of LOD 0 everywhere)\n", frames,
+		selectSeconds / frames * 1e6, (double)drawn / frames, (double)triangles / frames, 100.0 * triangles / frames / finest);
+	terrain.Close();
+	remove(pFileName);
+}
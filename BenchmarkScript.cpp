@@ -0,0 +1,288 @@
+//--------------------------------------------------------------------------------------
+// File: BenchmarkScript.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkScript.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// Parsing
+//--------------------------------------------------------------------------------------
+// Reads the numbers of the rest of a line, returns false if anything else follows
+static bool ParseNumbers(const char* pText, std::vector<float>& values)
+{
+	values.clear();
+	for (;;)
+	{
+		while (*pText == ' ' || *pText == '\t')
+			pText++;
+		if (*pText == 0)
+			return true;
+		char* pEnd;
+		double value = strtod(pText, &pEnd);
+		if (pEnd == pText || (*pEnd != 0 && *pEnd != ' ' && *pEnd != '\t'))
+			return false;
+		values.push_back((float)value);
+		pText = pEnd;
+	}
+}
+
+static bool SetError(std::string& error, int line, const char* pMessage)
+{
+	char text[256];
+	sprintf(text, "line %d: %s", line, pMessage);
+	error = text;
+	return false;
+}
+
+bool ParseBenchmarkScript(const char* pText, BenchmarkScript& script, std::string& error)
+{
+	script = BenchmarkScript();
+	error.clear();
+
+	int lineNumber = 0;
+	while (*pText)
+	{
+		lineNumber++;
+		const char* pLineEnd = strchr(pText, '\n');
+		size_t length = pLineEnd ? (size_t)(pLineEnd - pText) : strlen(pText);
+		std::string line(pText, length);
+		pText += length + (pLineEnd ? 1 : 0);
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.resize(comment);
+		while (!line.empty() && (line[line.size() - 1] == '\r' || line[line.size() - 1] == ' ' || line[line.size() - 1] == '\t'))
+			line.resize(line.size() - 1);
+		size_t keywordStart = line.find_first_not_of(" \t");
+		if (keywordStart == std::string::npos)
+			continue;
+		size_t keywordEnd = line.find_first_of(" \t", keywordStart);
+		if (keywordEnd == std::string::npos)
+			keywordEnd = line.size();
+		std::string keyword = line.substr(keywordStart, keywordEnd - keywordStart);
+
+		std::vector<float> values;
+		if (!ParseNumbers(line.c_str() + keywordEnd, values) || values.empty())
+			return SetError(error, lineNumber, "expected numbers after the keyword");
+
+		if (keyword == "frames" || keyword == "warmup")
+		{
+			if (values.size() != 1 || values[0] < (keyword == "frames" ? 1.0f : 0.0f) || values[0] != (float)(int)values[0])
+				return SetError(error, lineNumber, "expected one frame count");
+			(keyword == "frames" ? script.Frames : script.WarmupFrames) = (int)values[0];
+		}
+		else if (keyword == "timestep")
+		{
+			if (values.size() != 1 || !(values[0] > 0.0f))
+				return SetError(error, lineNumber, "expected one positive time step");
+			script.TimeStep = values[0];
+		}
+		else if (keyword == "adaptive")
+		{
+			if (values.size() != 1 || (values[0] != 0.0f && values[0] != 1.0f))
+				return SetError(error, lineNumber, "expected 0 or 1");
+			script.AdaptiveTessellation = values[0] != 0.0f;
+		}
+		else if (keyword == "quads")
+		{
+			if (values.size() != 1 || (values[0] != 0.0f && values[0] != 1.0f))
+				return SetError(error, lineNumber, "expected 0 or 1");
+			script.QuadPatches = values[0] != 0.0f;
+		}
+		else if (keyword == "target_triangle_size")
+		{
+			if (values.size() != 1 || !(values[0] > 0.0f))
+				return SetError(error, lineNumber, "expected one positive size in pixels");
+			script.TargetTriangleSize = values[0];
+		}
+		else if (keyword == "factors")
+		{
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				if (!(values[i] >= 1.0f && values[i] <= 64.0f))
+					return SetError(error, lineNumber, "tessellation factors have to be in [1, 64]");
+			}
+			script.TessellationFactors = values;
+		}
+		else if (keyword == "scalings")
+		{
+			script.Scalings = values;
+		}
+		else if (keyword == "displacements")
+		{
+			script.DisplacementLevels = values;
+		}
+		else if (keyword == "camera")
+		{
+			if (values.size() != 7)
+				return SetError(error, lineNumber, "expected a time, an eye position and a look-at point");
+			if (!script.CameraPath.empty() && !(values[0] > script.CameraPath.back().Time))
+				return SetError(error, lineNumber, "camera key times have to increase");
+			CameraKey key;
+			key.Time = values[0];
+			for (int c = 0; c < 3; c++)
+			{
+				key.Eye[c] = values[1 + c];
+				key.At[c] = values[4 + c];
+			}
+			script.CameraPath.push_back(key);
+		}
+		else
+		{
+			return SetError(error, lineNumber, ("unknown keyword " + keyword).c_str());
+		}
+	}
+
+	// Whatever is not swept keeps the demo's startup value
+	SceneSettings defaults;
+	SceneCamera camera;
+	if (script.TessellationFactors.empty())
+		script.TessellationFactors.push_back(defaults.TessellationFactor);
+	if (script.Scalings.empty())
+		script.Scalings.push_back(defaults.Scaling);
+	if (script.DisplacementLevels.empty())
+		script.DisplacementLevels.push_back(defaults.DisplacementLevel);
+	if (script.CameraPath.empty())
+	{
+		CameraKey key;
+		key.Time = 0.0f;
+		memcpy(key.Eye, camera.Eye, sizeof(key.Eye));
+		memcpy(key.At, camera.At, sizeof(key.At));
+		script.CameraPath.push_back(key);
+	}
+	return true;
+}
+
+bool LoadBenchmarkScript(const char* pFileName, BenchmarkScript& script, std::string& error)
+{
+	FILE* pFile = fopen(pFileName, "rb");
+	if (!pFile)
+	{
+		error = std::string("cannot open ") + pFileName;
+		return false;
+	}
+	std::string text;
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+		text.append(buffer, read);
+	fclose(pFile);
+	return ParseBenchmarkScript(text.c_str(), script, error);
+}
+
+void SampleCameraPath(const std::vector<CameraKey>& path, float time, float eye[3], float at[3])
+{
+	size_t next = 0;
+	while (next < path.size() && path[next].Time <= time)
+		next++;
+	if (next == 0 || next == path.size())
+	{
+		const CameraKey& key = path[next == 0 ? 0 : path.size() - 1];
+		memcpy(eye, key.Eye, sizeof(key.Eye));
+		memcpy(at, key.At, sizeof(key.At));
+		return;
+	}
+
+	const CameraKey& a = path[next - 1];
+	const CameraKey& b = path[next];
+	float t = (time - a.Time) / (b.Time - a.Time);
+	for (int c = 0; c < 3; c++)
+	{
+		eye[c] = a.Eye[c] + (b.Eye[c] - a.Eye[c]) * t;
+		at[c] = a.At[c] + (b.At[c] - a.At[c]) * t;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// ScriptedBenchmark
+//--------------------------------------------------------------------------------------
+ScriptedBenchmark::ScriptedBenchmark(const BenchmarkScript& script)
+	: m_Script(script)
+	, m_RecordCount(0)
+{
+	// Factors change slowest, so the report reads as one factor sweep per scene setup
+	for (size_t f = 0; f < script.TessellationFactors.size(); f++)
+	{
+		for (size_t s = 0; s < script.Scalings.size(); s++)
+		{
+			for (size_t d = 0; d < script.DisplacementLevels.size(); d++)
+			{
+				SceneSettings settings;
+				settings.TessellationFactor = script.TessellationFactors[f];
+				settings.Scaling = script.Scalings[s];
+				settings.DisplacementLevel = script.DisplacementLevels[d];
+				settings.AdaptiveTessellation = script.AdaptiveTessellation;
+				settings.TargetTriangleSize = script.TargetTriangleSize;
+				settings.QuadPatches = script.QuadPatches;
+				m_Steps.push_back(settings);
+			}
+		}
+	}
+	m_StepRecords.resize(m_Steps.size(), std::vector<FrameRecord>(script.Frames));
+}
+
+void ScriptedBenchmark::GetFrame(int frame, SceneCamera& camera, SceneSettings& settings) const
+{
+	frame = (frame < 0) ? 0 : (frame >= GetFrameCount() ? GetFrameCount() - 1 : frame);
+	int step = frame / GetFramesPerStep();
+	int stepFrame = frame % GetFramesPerStep();
+
+	// Every step flies the path from its start, warmup frames included
+	camera = SceneCamera();
+	SampleCameraPath(m_Script.CameraPath, stepFrame * m_Script.TimeStep, camera.Eye, camera.At);
+	settings = m_Steps[step];
+}
+
+void ScriptedBenchmark::AddRecord(int frame, const FrameRecord& record)
+{
+	if (frame < 0 || frame >= GetFrameCount())
+		return;
+	int step = frame / GetFramesPerStep();
+	int measuredFrame = frame % GetFramesPerStep() - m_Script.WarmupFrames;
+	if (measuredFrame < 0)
+		return;
+
+	FrameRecord& stored = m_StepRecords[step][measuredFrame];
+	if (stored.Frame < 0)
+		m_RecordCount++;
+	stored = record;
+	stored.Frame = frame;
+}
+
+bool ScriptedBenchmark::WriteReport(const char* pFileName, const char* pSource) const
+{
+	FILE* pFile = fopen(pFileName, "w");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "{\n  \"script\": \"");
+	for (const char* p = pSource; *p; p++)
+		fprintf(pFile, (*p == '"' || *p == '\\') ? "\\%c" : "%c", *p);
+	fprintf(pFile, "\",\n  \"frames_per_step\": %d,\n  \"warmup_frames\": %d,\n  \"timestep\": %.6g,\n"
+		"  \"adaptive_tessellation\": %s,\n  \"target_triangle_size\": %.6g,\n  \"quad_patches\": %s,\n  \"steps\": [",
+		m_Script.Frames, m_Script.WarmupFrames, m_Script.TimeStep, m_Script.AdaptiveTessellation ? "true" : "false",
+		m_Script.TargetTriangleSize, m_Script.QuadPatches ? "true" : "false");
+
+	for (size_t step = 0; step < m_Steps.size(); step++)
+	{
+		std::vector<FrameRecord> records;
+		for (size_t r = 0; r < m_StepRecords[step].size(); r++)
+		{
+			if (m_StepRecords[step][r].Frame >= 0)
+				records.push_back(m_StepRecords[step][r]);
+		}
+		const SceneSettings& settings = m_Steps[step];
+		fprintf(pFile, "%s\n    {\n      \"tessellation_factor\": %.6g,\n      \"scaling\": %.6g,\n"
+			"      \"displacement_level\": %.6g,\n      \"frames\": %d,\n      \"metrics\": %s\n    }", step > 0 ? "," : "",
+			settings.TessellationFactor, settings.Scaling, settings.DisplacementLevel, (int)records.size(),
+			FormatFrameSummaryJson(records, "      ").c_str());
+	}
+	fprintf(pFile, "\n  ]\n}\n");
+
+	bool succeeded = !ferror(pFile);
+	return fclose(pFile) == 0 && succeeded;
+}
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------
+// File: BenchmarkScript.h
+//
+// Scripted, deterministic benchmark runs. A script is a text file with a camera path
+// and lists of tessellation factors, scalings and displacement levels. Every
+// combination of the lists is one step that flies the whole path on a fixed time step,
+// so the frames of a run do not depend on the frame rate. The demo renders the frames
+// with -benchmark, TessellationBenchmark -suite script updates them headlessly, and
+// both write the same JSON report.
+//
+//     # comment
+//     frames 300                  measured frames per step
+//     warmup 30                   frames per step rendered before measuring
+//     timestep 0.0166667          seconds of camera path per frame
+//     adaptive 0                  screen-space adaptive factors (1) or uniform ones (0)
+//     target_triangle_size 8
+//     quads 0                     one quad patch per grid cell (1) or two tri patches (0)
+//     factors 1 8 32 64
+//     scalings 3
+//     displacements 0.1
+//     camera 0   0 4 -10   1.5 0 0   time, eye and look-at point, times increasing
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "FrameProfiler.h"
+#include "SceneUpdate.h"
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct CameraKey
+{
+	float Time;
+	float Eye[3];
+	float At[3];
+};
+
+struct BenchmarkScript
+{
+	int Frames = 300;
+	int WarmupFrames = 30;
+	float TimeStep = 1.0f / 60.0f;
+	bool AdaptiveTessellation = false;
+	float TargetTriangleSize = 8.0f;
+	bool QuadPatches = false;
+	std::vector<float> TessellationFactors;
+	std::vector<float> Scalings;
+	std::vector<float> DisplacementLevels;
+	std::vector<CameraKey> CameraPath;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Returns false with a message naming the line on errors. Lists that are not given
+// get the demo's default setting.
+bool ParseBenchmarkScript(const char* pText, BenchmarkScript& script, std::string& error);
+bool LoadBenchmarkScript(const char* pFileName, BenchmarkScript& script, std::string& error);
+
+// Linear interpolation between the keys, clamped to the first and last one
+void SampleCameraPath(const std::vector<CameraKey>& path, float time, float eye[3], float at[3]);
+
+
+//--------------------------------------------------------------------------------------
+// ScriptedBenchmark
+//--------------------------------------------------------------------------------------
+class ScriptedBenchmark
+{
+public:
+	ScriptedBenchmark(const BenchmarkScript& script);
+
+	int GetStepCount() const { return (int)m_Steps.size(); }
+	int GetFramesPerStep() const { return m_Script.WarmupFrames + m_Script.Frames; }
+	int GetFrameCount() const { return GetStepCount() * GetFramesPerStep(); }
+	float GetTimeStep() const { return m_Script.TimeStep; }
+	const SceneSettings& GetStepSettings(int step) const { return m_Steps[step]; }
+
+	// Camera position and settings of a frame of the run. Frames past the end repeat the
+	// last one, the demo renders them while it waits for the last GPU results.
+	void GetFrame(int frame, SceneCamera& camera, SceneSettings& settings) const;
+
+	// Records of warmup frames and frames outside the run are ignored, a repeated frame
+	// replaces the earlier record
+	void AddRecord(int frame, const FrameRecord& record);
+
+	// True once every measured frame has a record
+	bool IsComplete() const { return m_RecordCount == m_Script.Frames * GetStepCount(); }
+
+	const std::vector<FrameRecord>& GetStepRecords(int step) const { return m_StepRecords[step]; }
+
+	// Settings and metric summaries of every step, pSource names the script
+	bool WriteReport(const char* pFileName, const char* pSource) const;
+
+private:
+	BenchmarkScript m_Script;
+	std::vector<SceneSettings> m_Steps;
+	std::vector<std::vector<FrameRecord> > m_StepRecords;
+	int m_RecordCount;
+};
@@ -0,0 +1,256 @@
+//--------------------------------------------------------------------------------------
+// File: BenchmarkScriptSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "BenchmarkScript.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+
+//--------------------------------------------------------------------------------------
+// Scripted benchmark
+//--------------------------------------------------------------------------------------
+const char* g_DefaultScript =
+	"# Short flight with a factor and displacement sweep\r\n"
+	"frames 120\n"
+	"warmup 10   # not measured\n"
+	"timestep 0.02\n"
+	"factors 1 7 64\n"
+	"displacements 0.1 0.3\n"
+	"camera 0.0  0.0 4.0 -10.0  1.5 0.0 0.0\n"
+	"camera 1.2  1.0 1.5 -3.0   1.5 0.0 0.0\n"
+	"camera 2.4  0.0 6.0 -6.0   0.0 0.0 0.0\n";
+
+// Updates the frames of a script the way Render does, but counts the tessellated
+// triangles on the CPU instead of drawing. Culling uses the full displacement range
+// since the pyramid of the displacement map is not loaded.
+static void RunScriptHeadless(ScriptedBenchmark& benchmark)
+{
+	TerrainGrid grid;
+	grid.Build(SCRIPT_PATCHES_X, SCRIPT_PATCHES_Z);
+	std::vector<int> visible(grid.GetPatchCount());
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+
+	TerrainTriangleCounter counter;
+	FrameRecordRing ring;
+	FrameProfiler profiler(&ring);
+	FrameClock clock;
+	for (int frame = 0; frame < benchmark.GetFrameCount(); frame++)
+	{
+		profiler.BeginFrame(clock.Tick());
+		SceneCamera camera;
+		SceneSettings settings;
+		benchmark.GetFrame(frame, camera, settings);
+
+		SceneFrame scene;
+		{
+			ScopedCpuTimer timer(profiler, FRAME_STAGE_CAMERA);
+			UpdateScene(camera, settings, projection, 0.0f, scene);
+		}
+		int visibleCount;
+		{
+			ScopedCpuTimer timer(profiler, FRAME_STAGE_CULL);
+			grid.UpdateBounds(scene.WorldScale, settings.Scaling * settings.DisplacementLevel);
+			visibleCount = grid.Cull(scene.ViewFrustum, &visible[0]);
+		}
+		profiler.SetTriangleCount(counter.Count(grid, &visible[0], visibleCount, camera, settings, scene, projection[1][1],
+			SCRIPT_VIEWPORT_HEIGHT));
+		profiler.EndFrame();
+
+		// Nothing waits for GPU results
+		profiler.Flush();
+		FrameRecord record;
+		while (ring.Pop(record))
+			benchmark.AddRecord(record.Frame, record);
+	}
+}
+
+int VerifyBenchmarkScript()
+{
+	const char* pReportFile = "ScriptBenchmark.json";
+	SuiteCheck check("script");
+
+	// Parsing with comments, CR LF line ends and defaults for what is not given
+	BenchmarkScript script;
+	std::string error;
+	check.FailIf(!ParseBenchmarkScript(g_DefaultScript, script, error) || script.Frames != 120 ||
+		script.WarmupFrames != 10 || script.TimeStep != 0.02f || script.TessellationFactors.size() != 3 ||
+		script.TessellationFactors[1] != 7.0f || script.Scalings.size() != 1 || script.Scalings[0] != 3.0f ||
+		script.DisplacementLevels.size() != 2 || script.CameraPath.size() != 3 ||
+		script.CameraPath[1].Eye[2] != -3.0f || script.AdaptiveTessellation, "default script parsed wrongly (%s)",
+		error.c_str());
+	static const char* s_BadScripts[] =
+	{
+		"frames 10\nframes 0\n",
+		"factors 1 65\n",
+		"camera 0 1 2 3 4 5\n",
+		"camera 1 0 0 0 0 0 1\ncamera 1 0 0 0 0 0 1\n",
+		"frames 10\n\nspeed 2\n",
+		"timestep 0.1x\n",
+	};
+	static const int s_BadLines[] = { 2, 1, 1, 2, 3, 1 };
+	for (int i = 0; i < (int)(sizeof(s_BadScripts) / sizeof(s_BadScripts[0])); i++)
+	{
+		BenchmarkScript bad;
+		char expected[32];
+		sprintf(expected, "line %d:", s_BadLines[i]);
+		check.FailIf(ParseBenchmarkScript(s_BadScripts[i], bad, error) || error.compare(0, strlen(expected),
+			expected) != 0, "bad script %d was accepted or reported as \"%s\"", i, error.c_str());
+	}
+
+	// The path is interpolated linearly and clamped at its ends
+	float eye[3], at[3];
+	SampleCameraPath(script.CameraPath, 0.6f, eye, at);
+	bool pathOk = fabsf(eye[0] - 0.5f) < 1e-5f && fabsf(eye[1] - 2.75f) < 1e-5f && fabsf(eye[2] + 6.5f) < 1e-5f && at[0] == 1.5f;
+	SampleCameraPath(script.CameraPath, -1.0f, eye, at);
+	pathOk = pathOk && eye[2] == -10.0f;
+	SampleCameraPath(script.CameraPath, 100.0f, eye, at);
+	pathOk = pathOk && eye[1] == 6.0f && at[0] == 0.0f;
+	check.FailIf(!pathOk, "camera path sampling");
+
+	// Steps sweep the displacement fastest, every step flies the path from its start
+	ScriptedBenchmark benchmark(script);
+	SceneCamera camera;
+	SceneSettings settings;
+	benchmark.GetFrame(3 * 130 + 10, camera, settings);
+	bool stepsOk = benchmark.GetStepCount() == 6 && benchmark.GetFrameCount() == 6 * 130 && settings.TessellationFactor == 7.0f &&
+		settings.DisplacementLevel == 0.3f && fabsf(camera.Eye[2] + (10.0f - 7.0f * 10 * 0.02f / 1.2f)) < 1e-4f;
+	benchmark.GetFrame(100000, camera, settings);
+	stepsOk = stepsOk && settings.TessellationFactor == 64.0f && settings.DisplacementLevel == 0.3f;
+	check.FailIf(!stepsOk, "step settings or camera of a frame");
+
+	// The camera moves by speed * dt and the view matrix puts the eye at the origin
+	SceneCamera moved;
+	float distanceBefore = sqrtf(powf(moved.At[0] - moved.Eye[0], 2) + powf(moved.At[1] - moved.Eye[1], 2) + powf(moved.At[2] - moved.Eye[2], 2));
+	moved.isMovingForward = true;
+	MoveCamera(moved, 0.05f);
+	float distanceAfter = sqrtf(powf(moved.At[0] - moved.Eye[0], 2) + powf(moved.At[1] - moved.Eye[1], 2) + powf(moved.At[2] - moved.Eye[2], 2));
+	moved.isMovingForward = false;
+	moved.isMovingUp = true;
+	float heightBefore = moved.Eye[1];
+	MoveCamera(moved, 0.1f);
+	float view[4][4];
+	BuildLookAtLH(moved.Eye, moved.At, moved.Up, view);
+	float viewEye[3], viewAt[3];
+	for (int c = 0; c < 3; c++)
+	{
+		viewEye[c] = moved.Eye[0] * view[0][c] + moved.Eye[1] * view[1][c] + moved.Eye[2] * view[2][c] + view[3][c];
+		viewAt[c] = moved.At[0] * view[0][c] + moved.At[1] * view[1][c] + moved.At[2] * view[2][c] + view[3][c];
+	}
+	check.FailIf(fabsf(distanceBefore - distanceAfter - 0.5f) > 1e-4f ||
+		fabsf(moved.Eye[1] - heightBefore - 1.0f) > 1e-5f ||
+		fabsf(viewEye[0]) + fabsf(viewEye[1]) + fabsf(viewEye[2]) > 1e-4f ||
+		fabsf(viewAt[0]) + fabsf(viewAt[1]) > 1e-4f || viewAt[2] <= 0.0f, "camera movement or view matrix");
+
+	// Two headless runs count the same triangles, factor 1 gives one triangle per tri
+	// patch and higher factors never fewer on the same frame
+	ScriptedBenchmark second(script);
+	RunScriptHeadless(benchmark);
+	RunScriptHeadless(second);
+	int countErrors = 0;
+	for (int step = 0; step < benchmark.GetStepCount(); step++)
+	{
+		const std::vector<FrameRecord>& records = benchmark.GetStepRecords(step);
+		const std::vector<FrameRecord>& secondRecords = second.GetStepRecords(step);
+		const std::vector<FrameRecord>& factor1Records = benchmark.GetStepRecords(step % 2);
+		for (size_t r = 0; r < records.size(); r++)
+		{
+			if (records[r].Triangles != secondRecords[r].Triangles || records[r].Triangles < factor1Records[r].Triangles ||
+				records[r].Frame != step * 130 + 10 + (int)r)
+				countErrors++;
+		}
+	}
+	const std::vector<FrameRecord>& firstStep = benchmark.GetStepRecords(0);
+	check.FailIf(!benchmark.IsComplete() || countErrors != 0 || firstStep[0].Triangles <= 0 ||
+		firstStep[0].Triangles % 2 != 0 || firstStep[0].Triangles > 2 * SCRIPT_PATCHES_X * SCRIPT_PATCHES_Z,
+		"headless runs differ or count wrongly (%d errors)", countErrors);
+
+	// Adaptive factors count between the factor 1 and the maximum factor triangles
+	script.AdaptiveTessellation = true;
+	ScriptedBenchmark adaptive(script);
+	RunScriptHeadless(adaptive);
+	int adaptiveErrors = 0;
+	for (int step = 0; step < adaptive.GetStepCount(); step++)
+	{
+		for (size_t r = 0; r < adaptive.GetStepRecords(step).size(); r++)
+		{
+			long long triangles = adaptive.GetStepRecords(step)[r].Triangles;
+			if (triangles < benchmark.GetStepRecords(step % 2)[r].Triangles || triangles > benchmark.GetStepRecords(step)[r].Triangles)
+				adaptiveErrors++;
+		}
+	}
+	check.FailIf(adaptiveErrors != 0, "%d adaptive triangle counts out of range", adaptiveErrors);
+
+	// Warmup frames and frames past the end are ignored, the run is complete once every
+	// measured frame arrived
+	ScriptedBenchmark partial(script);
+	FrameRecord record;
+	for (int frame = -5; frame < partial.GetFrameCount() + 5; frame++)
+	{
+		if (frame != 200)
+			partial.AddRecord(frame, record);
+	}
+	bool completeTooEarly = partial.IsComplete();
+	partial.AddRecord(5, record);
+	partial.AddRecord(200, record);
+	partial.AddRecord(200, record);
+	check.FailIf(completeTooEarly || !partial.IsComplete(), "completion with missing, warmup or repeated frames");
+
+	// The report lists every step with its settings and metric summaries
+	std::vector<std::string> lines;
+	std::string report;
+	if (benchmark.WriteReport(pReportFile, "default \"script\"") && ReadTextLines(pReportFile, lines))
+	{
+		for (size_t i = 0; i < lines.size(); i++)
+			report += lines[i] + "\n";
+	}
+	size_t steps = 0;
+	for (size_t at = report.find("\"tessellation_factor\""); at != std::string::npos; at = report.find("\"tessellation_factor\"", at + 1))
+		steps++;
+	FrameMetricSummary summary;
+	SummarizeFrameMetric(firstStep, FRAME_METRIC_TRIANGLES, summary);
+	char triangles[128];
+	sprintf(triangles, "\"triangles\": { \"count\": 120, \"mean\": %.6g, \"min\": %.6g,", summary.Mean, summary.Min);
+	check.FailIf(steps != 6 || report.find("\"script\": \"default \\\"script\\\"\"") == std::string::npos ||
+		report.find("\"frames\": 120") == std::string::npos || report.find(triangles) == std::string::npos ||
+		report.find("gpu_frame_ms") != std::string::npos, "report\n%s", report.c_str());
+	remove(pReportFile);
+
+	return check.Finish("%d steps", benchmark.GetStepCount());
+}
+
+void RunScriptSuite(const BenchmarkOptions& options)
+{
+	BenchmarkScript script;
+	std::string error;
+	bool loaded = options.Script ? LoadBenchmarkScript(options.Script, script, error) :
+		ParseBenchmarkScript(g_DefaultScript, script, error);
+	if (!loaded)
+	{
+		printf("script %s: %s\n", options.Script ? options.Script : "default", error.c_str());
+		return;
+	}
+
+	ScriptedBenchmark benchmark(script);
+	double start = GetTimeSeconds();
+	RunScriptHeadless(benchmark);
+	double seconds = GetTimeSeconds() - start;
+	for (int step = 0; step < benchmark.GetStepCount(); step++)
+	{
+		const SceneSettings& settings = benchmark.GetStepSettings(step);
+		FrameMetricSummary triangles, cpu;
+		SummarizeFrameMetric(benchmark.GetStepRecords(step), FRAME_METRIC_TRIANGLES, triangles);
+		SummarizeFrameMetric(benchmark.GetStepRecords(step), FRAME_METRIC_CPU_TOTAL, cpu);
+		printf("script factor %5.1f  scaling %4.1f  displacement %5.2f  %10.0f triangles  p99 %10.0f  cpu p50 %7.4f ms  p99 %7.4f ms\n",
+			settings.TessellationFactor, settings.Scaling, settings.DisplacementLevel, triangles.Mean, triangles.P99, cpu.P50, cpu.P99);
+	}
+	printf("script %d frames in %.1f ms\n", benchmark.GetFrameCount(), seconds * 1000.0);
+	if (options.Report && !benchmark.WriteReport(options.Report, options.Script ? options.Script : "default"))
+		printf("script: writing %s failed\n", options.Report);
+}
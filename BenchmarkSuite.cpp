@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// File: BenchmarkSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include <stdio.h>
+
+
+//--------------------------------------------------------------------------------------
+// SuiteCheck
+//--------------------------------------------------------------------------------------
+void SuiteCheck::Fail(const char* pFormat, ...)
+{
+	va_list args;
+	va_start(args, pFormat);
+	PrintFailure(pFormat, args);
+	va_end(args);
+}
+
+bool SuiteCheck::FailIf(bool failed, const char* pFormat, ...)
+{
+	if (!failed)
+		return false;
+	va_list args;
+	va_start(args, pFormat);
+	PrintFailure(pFormat, args);
+	va_end(args);
+	return true;
+}
+
+int SuiteCheck::Finish()
+{
+	printf("verify %s: %d failures\n", m_pSuite, m_Failures);
+	return m_Failures;
+}
+
+int SuiteCheck::Finish(const char* pFormat, ...)
+{
+	printf("verify %s: ", m_pSuite);
+	va_list args;
+	va_start(args, pFormat);
+	vprintf(pFormat, args);
+	va_end(args);
+	printf(", %d failures\n", m_Failures);
+	return m_Failures;
+}
+
+void SuiteCheck::PrintFailure(const char* pFormat, va_list args)
+{
+	printf("FAIL %s: ", m_pSuite);
+	vprintf(pFormat, args);
+	printf("\n");
+	m_Failures++;
+}
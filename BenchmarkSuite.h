@@ -0,0 +1,241 @@
+//--------------------------------------------------------------------------------------
+// File: BenchmarkSuite.h
+//
+// Shared parts of the headless benchmark. Every suite lives in a <Module>Suite.cpp next
+// to the module it covers, with a Verify function that checks the module and returns
+// its failures and a Run function that times it. TessellationBenchmark.cpp parses the
+// options and calls the suites they select.
+//
+// SuiteCheck prints and counts the failures of a Verify function, the fixtures are the
+// synthetic data more than one suite builds.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "TessFactors.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class HeightPyramid;
+struct Image;
+struct SceneCamera;
+struct SceneFrame;
+struct SceneSettings;
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct BenchmarkOptions
+{
+	const char* Suite = "all";
+	bool Verify = false;
+	int Domain = -1;            // -1 runs both domains
+	int Partitioning = -1;      // -1 runs all partitionings
+	float Factor = 0.0f;        // 0 runs the default factor sweep
+	int Patches = 20000;
+	const char* Script = NULL;  // benchmark script of the script suite, a built-in one if NULL
+	const char* Report = NULL;  // JSON report of the script suite
+	unsigned int HeightmapSize = 8192;  // samples per side of the streaming suite's heightmap
+	const char* Image = NULL;   // frame of the raster suite
+};
+
+
+//--------------------------------------------------------------------------------------
+// SuiteCheck
+//--------------------------------------------------------------------------------------
+// The failures of one Verify function. Every failure prints a "FAIL <suite>: " line with
+// a printf formatted message, Finish prints the "verify <suite>: " summary line.
+class SuiteCheck
+{
+public:
+	explicit SuiteCheck(const char* pSuite) : m_pSuite(pSuite), m_Failures(0) {}
+
+	void Fail(const char* pFormat, ...);
+
+	// Fails with the message if failed is true, returns failed
+	bool FailIf(bool failed, const char* pFormat, ...);
+
+	// Print the summary, the details if any and the failure count, and return the count
+	int Finish();
+	int Finish(const char* pFormat, ...);
+
+	int GetFailures() const { return m_Failures; }
+
+private:
+	void PrintFailure(const char* pFormat, va_list args);
+
+	const char* m_pSuite;
+	int m_Failures;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Suites
+//--------------------------------------------------------------------------------------
+// TessellatorSuite.cpp
+int VerifyTessellator();
+void RunTessellatorSuite(const BenchmarkOptions& options);
+
+// TessFactorsSuite.cpp
+int VerifyFactors();
+void RunFactorThroughput(int numPatches);
+
+// Tri patches of a grid of quads of the given size around the origin, two per quad, and
+// their factors
+struct TriPatchGrid
+{
+	std::vector<float> X[3], Y[3], Z[3];
+	std::vector<float> Edges[3], Inside;
+	int Count;
+};
+
+void BuildTriPatchGrid(int quadsPerSide, float size, TriPatchGrid& grid);
+void ComputeGridFactors(TriPatchGrid& grid, const AdaptiveTessParams& params);
+
+// Eye 10 units behind and 4 above the origin, a 900 pixel high viewport, 8 pixel triangles
+AdaptiveTessParams DefaultAdaptiveParams();
+
+// FrustumCullingSuite.cpp
+int VerifyCulling();
+void RunCullingThroughput(int numPatches);
+
+// HeightPyramidSuite.cpp
+int VerifyPyramid();
+void RunPyramidThroughput();
+
+// Smoothed value noise, neighbouring texels correlated like in a real displacement map
+void BuildNoiseHeightmap(int width, int height, unsigned int seed, std::vector<unsigned char>& texels);
+
+// TextureContainerSuite.cpp
+int VerifyTextures();
+void RunTextureThroughput();
+
+// A noise heightmap with channel and texel offsets, see BuildNoiseHeightmap
+void BuildNoiseImage(int width, int height, int channels, unsigned int seed, Image& image);
+
+// BlockCompressionSuite.cpp
+int VerifyCompression();
+void RunCompressionThroughput();
+
+// Smooth images with a little texel noise like the demo's textures: a displacement field,
+// a diffuse map coloured by height and the matching tangent space normal map
+void BuildCompressionImages(int width, int height, Image& diffuse, Image& displacement, Image& normal);
+
+// ShaderCacheSuite.cpp
+int VerifyShaderCache();
+void RunShaderCacheThroughput();
+
+// TaskGraphSuite.cpp
+int VerifyTaskGraph();
+void RunTaskGraphThroughput();
+
+void SleepMilliseconds(int milliseconds);
+
+// StateTrackerSuite.cpp
+int VerifyStateTracker();
+void RunStateTrackerThroughput();
+
+// RingAllocatorSuite.cpp
+int VerifyRingAllocator();
+void RunRingAllocatorThroughput();
+
+// FrameProfilerSuite.cpp
+int VerifyFrameProfiler();
+void RunFrameProfilerThroughput();
+
+bool ReadTextLines(const char* pFileName, std::vector<std::string>& lines);
+
+// BenchmarkScriptSuite.cpp
+int VerifyBenchmarkScript();
+void RunScriptSuite(const BenchmarkOptions& options);
+
+// Demo terrain grid and window size
+#define SCRIPT_PATCHES_X        8
+#define SCRIPT_PATCHES_Z        8
+#define SCRIPT_VIEWPORT_WIDTH   1600.0f
+#define SCRIPT_VIEWPORT_HEIGHT  900.0f
+
+// Short flight with a factor and displacement sweep
+extern const char* g_DefaultScript;
+
+// TessBudgetSuite.cpp
+int VerifyTessBudget();
+void RunTessBudgetSuite();
+
+// TessDensitySuite.cpp
+int VerifyTessDensity();
+void RunTessDensitySuite();
+
+// Side of the density heightmap
+#define DENSITY_MAP_SIZE        512
+
+// Long smooth waves on the left and short ones on the right, blended in the middle
+void BuildDensityHeightmap(int width, int height, std::vector<unsigned char>& texels);
+
+// NormalMapSuite.cpp
+int VerifyNormalMap();
+void RunNormalMapSuite();
+
+// TerrainGridSuite.cpp
+int VerifyQuadPatches();
+void RunQuadPatchSuite();
+
+// TerrainQuadtreeSuite.cpp
+int VerifyQuadtree();
+void RunQuadtreeSuite();
+
+// Patches of a quadtree selection
+#define QUADTREE_MAX_PATCHES    1024
+
+// Height of a texel as sampled by QuadtreeDS: point sampling with wrap addressing
+float SampleHeightPoint(const std::vector<unsigned char>& texels, int width, int height, float u, float v);
+
+// A random view over the terrain, looking at a point on it
+void RandomQuadtreeView(const SceneSettings& settings, SceneCamera& camera);
+
+// HeightStreamerSuite.cpp
+int VerifyStreaming();
+void RunStreamingSuite(const BenchmarkOptions& options);
+
+// TerrainHeightFieldSuite.cpp
+int VerifyHeightField();
+void RunHeightFieldSuite();
+
+// Uniform in [low, high) from a linear congruential state
+float RandomFloat(unsigned int& state, float low, float high);
+
+// BakedTerrainSuite.cpp
+int VerifyBakedTerrain();
+void RunBakedTerrainSuite();
+
+// SoftwareRendererSuite.cpp
+int VerifySoftwareRenderer();
+void RunSoftwareRendererSuite(const BenchmarkOptions& options);
+
+// Render target and texture sizes of the raster checks
+#define RASTER_WIDTH            200
+#define RASTER_HEIGHT           150
+#define RASTER_TEXTURE_SIZE     256
+
+// Diffuse and normal mips and the displacement pyramid of the synthetic textures
+void BuildRasterTextures(int size, std::vector<Image>& diffuseMips, std::vector<Image>& normalMips, HeightPyramid& pyramid);
+
+// JobSystemSuite.cpp
+int VerifyJobSystem();
+void RunJobSystemSuite();
+
+// Frame of the synthetic patch set: the camera circling the terrain at time t
+void JobsSceneFrame(float t, const SceneSettings& settings, SceneCamera& camera, SceneFrame& scene, float projection[4][4]);
+
+// TessellationCacheSuite.cpp
+int VerifyTessellationCache();
+void RunTessellationCacheSuite(const BenchmarkOptions& options);
+
+// ControlPointFormatSuite.cpp
+int VerifyControlPointFormat();
+void RunControlPointFormatSuite();
+
+// PatchInstancesSuite.cpp
+int VerifyPatchInstances();
+void RunPatchInstancesSuite();
@@ -0,0 +1,536 @@
+//--------------------------------------------------------------------------------------
+// File: BlockCompression.cpp
+//--------------------------------------------------------------------------------------
+#include "BlockCompression.h"
+#include "SimdUtil.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Common
+//--------------------------------------------------------------------------------------
+int GetBCBlockSize(BC_FORMAT format)
+{
+	return (format == BC_FORMAT_BC5) ? 16 : 8;
+}
+
+int GetBCSourceChannels(BC_FORMAT format)
+{
+	return (format == BC_FORMAT_BC4) ? 1 : 4;
+}
+
+// Maps the rank of a palette entry along the endpoint line (0 at endpoint 1) to its index.
+// Both formats put endpoint 0 at index 0 and endpoint 1 at index 1, followed by the
+// interpolated entries from endpoint 0 towards endpoint 1: (steps - rank) mod steps,
+// with the two endpoint indices swapped.
+#if !TESS_USE_SSE2
+static int RankToIndex(int rank, int steps)
+{
+	int index = (steps - rank) & (steps - 1);
+	return index ^ (index < 2 ? 1 : 0);
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// BC1
+//--------------------------------------------------------------------------------------
+static unsigned short PackColor565(const float color[3])
+{
+	int r = std::min(std::max((int)(color[0] * (31.0f / 255.0f) + 0.5f), 0), 31);
+	int g = std::min(std::max((int)(color[1] * (63.0f / 255.0f) + 0.5f), 0), 63);
+	int b = std::min(std::max((int)(color[2] * (31.0f / 255.0f) + 0.5f), 0), 31);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackColor565(unsigned short packed, int color[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// Palette of the four color mode (c0 > c1), or of the three color mode with black
+static void BuildBC1Palette(unsigned short c0, unsigned short c1, int palette[4][3])
+{
+	UnpackColor565(c0, palette[0]);
+	UnpackColor565(c1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		if (c0 > c1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+// Orders the endpoints for the four color mode and picks the nearest palette entry of
+// every texel by projecting it onto the endpoint line. Returns the squared error.
+static int FitBC1Indices(const unsigned char* pRgba, unsigned short& c0, unsigned short& c1, unsigned int& indices)
+{
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	int palette[4][3];
+	BuildBC1Palette(c0, c1, palette);
+
+	int codes[16];
+	if (c0 == c1)
+	{
+		// Every texel takes endpoint 0, which the three color mode decodes the same
+		for (int i = 0; i < 16; i++)
+			codes[i] = 0;
+	}
+	else
+	{
+		float axis[3], base = 0.0f, lengthSq = 0.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			axis[c] = (float)(palette[0][c] - palette[1][c]);
+			base += axis[c] * palette[1][c];
+			lengthSq += axis[c] * axis[c];
+		}
+		float scale = 3.0f / lengthSq;
+
+#if TESS_USE_SSE2
+		const __m128i byteMask = _mm_set1_epi32(0xff);
+		const __m128 axisR = _mm_set1_ps(axis[0]), axisG = _mm_set1_ps(axis[1]), axisB = _mm_set1_ps(axis[2]);
+		const __m128 baseV = _mm_set1_ps(base), scaleV = _mm_set1_ps(scale);
+		const __m128 zero = _mm_setzero_ps(), three = _mm_set1_ps(3.0f);
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128i texels = _mm_loadu_si128((const __m128i*)(pRgba + i * 4));
+			__m128 r = _mm_cvtepi32_ps(_mm_and_si128(texels, byteMask));
+			__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, 8), byteMask));
+			__m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, 16), byteMask));
+			__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, axisR), _mm_mul_ps(g, axisG)), _mm_mul_ps(b, axisB));
+			t = _mm_mul_ps(_mm_sub_ps(t, baseV), scaleV);
+			__m128i rank = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(t, zero), three));
+
+			// RankToIndex for four texels
+			__m128i index = _mm_and_si128(_mm_sub_epi32(_mm_set1_epi32(4), rank), _mm_set1_epi32(3));
+			index = _mm_xor_si128(index, _mm_and_si128(_mm_cmplt_epi32(index, _mm_set1_epi32(2)), _mm_set1_epi32(1)));
+			_mm_storeu_si128((__m128i*)&codes[i], index);
+		}
+#else
+		for (int i = 0; i < 16; i++)
+		{
+			const unsigned char* pTexel = pRgba + i * 4;
+			float t = (pTexel[0] * axis[0] + pTexel[1] * axis[1] + pTexel[2] * axis[2] - base) * scale;
+			int rank = (int)floorf(std::min(std::max(t, 0.0f), 3.0f) + 0.5f);
+			codes[i] = RankToIndex(rank, 4);
+		}
+#endif
+	}
+
+	int error = 0;
+	indices = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		const int* pColor = palette[codes[i]];
+		for (int c = 0; c < 3; c++)
+		{
+			int difference = pRgba[i * 4 + c] - pColor[c];
+			error += difference * difference;
+		}
+		indices |= (unsigned int)codes[i] << (2 * i);
+	}
+	return error;
+}
+
+// Least squares endpoints for the given indices of the four color mode
+static bool RefineBC1Endpoints(const unsigned char* pRgba, unsigned int indices, float endpoint0[3], float endpoint1[3])
+{
+	static const float s_Weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float a = s_Weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < 3; c++)
+		{
+			ax[c] += a * pRgba[i * 4 + c];
+			bx[c] += b * pRgba[i * 4 + c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f)
+		return false;
+	for (int c = 0; c < 3; c++)
+	{
+		endpoint0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+		endpoint1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+	}
+	return true;
+}
+
+void EncodeBC1Block(const unsigned char* pRgba, unsigned char* pBlock)
+{
+	// Principal axis of the colors by power iteration on their covariance
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += pRgba[i * 4 + c];
+	for (int c = 0; c < 3; c++)
+		mean[c] /= 16.0f;
+
+	float covariance[3][3] = { { 0.0f } };
+	for (int i = 0; i < 16; i++)
+	{
+		float d[3] = { pRgba[i * 4] - mean[0], pRgba[i * 4 + 1] - mean[1], pRgba[i * 4 + 2] - mean[2] };
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				covariance[r][c] += d[r] * d[c];
+	}
+
+	// Start from the covariance row of the channel with the largest variance, a fixed start
+	// vector fails for blocks whose colours only vary orthogonally to it
+	int start = 0;
+	for (int c = 1; c < 3; c++)
+	{
+		if (covariance[c][c] > covariance[start][start])
+			start = c;
+	}
+	float axis[3] = { covariance[start][0], covariance[start][1], covariance[start][2] };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[3];
+		for (int r = 0; r < 3; r++)
+			next[r] = covariance[r][0] * axis[0] + covariance[r][1] * axis[1] + covariance[r][2] * axis[2];
+		float length = std::max(fabsf(next[0]), std::max(fabsf(next[1]), fabsf(next[2])));
+		if (length < 1e-6f)
+			break;
+		for (int c = 0; c < 3; c++)
+			axis[c] = next[c] / length;
+	}
+
+	// The extreme texels along the axis are the initial endpoints
+	int minTexel = 0, maxTexel = 0;
+	float minDot = 0.0f, maxDot = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float dot = pRgba[i * 4] * axis[0] + pRgba[i * 4 + 1] * axis[1] + pRgba[i * 4 + 2] * axis[2];
+		if (i == 0 || dot < minDot)
+		{
+			minDot = dot;
+			minTexel = i;
+		}
+		if (i == 0 || dot > maxDot)
+		{
+			maxDot = dot;
+			maxTexel = i;
+		}
+	}
+	float endpoint0[3], endpoint1[3];
+	for (int c = 0; c < 3; c++)
+	{
+		endpoint0[c] = pRgba[maxTexel * 4 + c];
+		endpoint1[c] = pRgba[minTexel * 4 + c];
+	}
+
+	unsigned short c0 = PackColor565(endpoint0), c1 = PackColor565(endpoint1);
+	unsigned int indices;
+	int error = FitBC1Indices(pRgba, c0, c1, indices);
+
+	// One refinement pass, kept only if it lowers the error
+	if (error > 0 && c0 != c1 && RefineBC1Endpoints(pRgba, indices, endpoint0, endpoint1))
+	{
+		unsigned short refined0 = PackColor565(endpoint0), refined1 = PackColor565(endpoint1);
+		unsigned int refinedIndices;
+		int refinedError = FitBC1Indices(pRgba, refined0, refined1, refinedIndices);
+		if (refinedError < error)
+		{
+			c0 = refined0;
+			c1 = refined1;
+			indices = refinedIndices;
+		}
+	}
+
+	pBlock[0] = (unsigned char)(c0 & 0xff);
+	pBlock[1] = (unsigned char)(c0 >> 8);
+	pBlock[2] = (unsigned char)(c1 & 0xff);
+	pBlock[3] = (unsigned char)(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		pBlock[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+void DecodeBC1Block(const unsigned char* pBlock, unsigned char* pRgba)
+{
+	unsigned short c0 = (unsigned short)(pBlock[0] | (pBlock[1] << 8));
+	unsigned short c1 = (unsigned short)(pBlock[2] | (pBlock[3] << 8));
+	unsigned int indices = pBlock[4] | (pBlock[5] << 8) | (pBlock[6] << 16) | ((unsigned int)pBlock[7] << 24);
+
+	int palette[4][3];
+	BuildBC1Palette(c0, c1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		int code = (indices >> (2 * i)) & 3;
+		for (int c = 0; c < 3; c++)
+			pRgba[i * 4 + c] = (unsigned char)palette[code][c];
+		pRgba[i * 4 + 3] = (c0 <= c1 && code == 3) ? 0 : 255;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// BC4
+//--------------------------------------------------------------------------------------
+void EncodeBC4Block(const unsigned char* pValues, unsigned char* pBlock)
+{
+	int codes[16];
+#if TESS_USE_SSE2
+	__m128i values = _mm_loadu_si128((const __m128i*)pValues);
+	__m128i minimum = _mm_min_epu8(values, _mm_srli_si128(values, 8));
+	__m128i maximum = _mm_max_epu8(values, _mm_srli_si128(values, 8));
+	minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 4));
+	maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 4));
+	minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 2));
+	maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 2));
+	minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 1));
+	maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 1));
+	int minValue = _mm_cvtsi128_si32(minimum) & 0xff;
+	int maxValue = _mm_cvtsi128_si32(maximum) & 0xff;
+#else
+	int minValue = pValues[0], maxValue = pValues[0];
+	for (int i = 1; i < 16; i++)
+	{
+		minValue = std::min(minValue, (int)pValues[i]);
+		maxValue = std::max(maxValue, (int)pValues[i]);
+	}
+#endif
+
+	pBlock[0] = (unsigned char)maxValue;
+	pBlock[1] = (unsigned char)minValue;
+	if (minValue == maxValue)
+	{
+		memset(pBlock + 2, 0, 6);
+		return;
+	}
+
+	// Rank of the nearest of the eight evenly spaced palette entries
+	float scale = 7.0f / (maxValue - minValue);
+#if TESS_USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 minV = _mm_set1_ps((float)minValue), scaleV = _mm_set1_ps(scale);
+	__m128i words[2] = { _mm_unpacklo_epi8(values, zero), _mm_unpackhi_epi8(values, zero) };
+	for (int half = 0; half < 2; half++)
+	{
+		__m128i dwords[2] = { _mm_unpacklo_epi16(words[half], zero), _mm_unpackhi_epi16(words[half], zero) };
+		for (int quarter = 0; quarter < 2; quarter++)
+		{
+			__m128 t = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(dwords[quarter]), minV), scaleV);
+			__m128i rank = _mm_cvtps_epi32(t);
+
+			// RankToIndex for four texels
+			__m128i index = _mm_and_si128(_mm_sub_epi32(_mm_set1_epi32(8), rank), _mm_set1_epi32(7));
+			index = _mm_xor_si128(index, _mm_and_si128(_mm_cmplt_epi32(index, _mm_set1_epi32(2)), _mm_set1_epi32(1)));
+			_mm_storeu_si128((__m128i*)&codes[half * 8 + quarter * 4], index);
+		}
+	}
+#else
+	for (int i = 0; i < 16; i++)
+	{
+		int rank = (int)floorf((pValues[i] - minValue) * scale + 0.5f);
+		codes[i] = RankToIndex(rank, 8);
+	}
+#endif
+
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned long long)codes[i] << (3 * i);
+	for (int i = 0; i < 6; i++)
+		pBlock[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+void DecodeBC4Block(const unsigned char* pBlock, unsigned char* pValues)
+{
+	int palette[8];
+	palette[0] = pBlock[0];
+	palette[1] = pBlock[1];
+	if (palette[0] > palette[1])
+	{
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1] + 3) / 7;
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+			palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1] + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= (unsigned long long)pBlock[2 + i] << (8 * i);
+	for (int i = 0; i < 16; i++)
+		pValues[i] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Images
+//--------------------------------------------------------------------------------------
+static void CompressBlockRows(const Image* pSource, BC_FORMAT format, unsigned char* pBlocks, int rowBegin, int rowEnd)
+{
+	const Image& source = *pSource;
+	int channels = source.Channels;
+	int blockSize = GetBCBlockSize(format);
+	int blocksX = (source.Width + BC_BLOCK_DIMENSION - 1) / BC_BLOCK_DIMENSION;
+	unsigned char texels[16 * 4];
+	for (int by = rowBegin; by < rowEnd; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			for (int y = 0; y < BC_BLOCK_DIMENSION; y++)
+			{
+				int sy = std::min(by * BC_BLOCK_DIMENSION + y, source.Height - 1);
+				for (int x = 0; x < BC_BLOCK_DIMENSION; x++)
+				{
+					int sx = std::min(bx * BC_BLOCK_DIMENSION + x, source.Width - 1);
+					memcpy(&texels[(y * BC_BLOCK_DIMENSION + x) * channels], &source.Texels[((size_t)sy * source.Width + sx) * channels], channels);
+				}
+			}
+
+			unsigned char* pBlock = pBlocks + ((size_t)by * blocksX + bx) * blockSize;
+			if (format == BC_FORMAT_BC1)
+			{
+				EncodeBC1Block(texels, pBlock);
+			}
+			else if (format == BC_FORMAT_BC4)
+			{
+				EncodeBC4Block(texels, pBlock);
+			}
+			else
+			{
+				unsigned char red[16], green[16];
+				for (int i = 0; i < 16; i++)
+				{
+					red[i] = texels[i * 4];
+					green[i] = texels[i * 4 + 1];
+				}
+				EncodeBC4Block(red, pBlock);
+				EncodeBC4Block(green, pBlock + 8);
+			}
+		}
+	}
+}
+
+bool CompressImage(const Image& source, BC_FORMAT format, std::vector<unsigned char>& blocks, int numThreads)
+{
+	if (source.Width < 1 || source.Height < 1 || source.Channels != GetBCSourceChannels(format) ||
+		source.Texels.size() != (size_t)source.Width * source.Height * source.Channels)
+		return false;
+
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	int blocksX = (source.Width + BC_BLOCK_DIMENSION - 1) / BC_BLOCK_DIMENSION;
+	int blocksY = (source.Height + BC_BLOCK_DIMENSION - 1) / BC_BLOCK_DIMENSION;
+	blocks.resize((size_t)blocksX * blocksY * GetBCBlockSize(format));
+
+	// Block rows are independent. Small mips are not worth a thread.
+	const int minBlockRowsPerThread = 16;
+	int threads = std::min(numThreads, std::max(1, blocksY / minBlockRowsPerThread));
+	if (threads == 1)
+	{
+		CompressBlockRows(&source, format, blocks.data(), 0, blocksY);
+		return true;
+	}
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		int rowBegin = blocksY * t / threads;
+		int rowEnd = blocksY * (t + 1) / threads;
+		workers.push_back(std::thread(CompressBlockRows, &source, format, blocks.data(), rowBegin, rowEnd));
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	return true;
+}
+
+void DecompressImage(const unsigned char* pBlocks, BC_FORMAT format, int width, int height, Image& image)
+{
+	image.Width = width;
+	image.Height = height;
+	image.Channels = (format == BC_FORMAT_BC4) ? 1 : 4;
+	image.Texels.resize((size_t)width * height * image.Channels);
+
+	int blockSize = GetBCBlockSize(format);
+	int blocksX = (width + BC_BLOCK_DIMENSION - 1) / BC_BLOCK_DIMENSION;
+	int blocksY = (height + BC_BLOCK_DIMENSION - 1) / BC_BLOCK_DIMENSION;
+	unsigned char texels[16 * 4];
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			const unsigned char* pBlock = pBlocks + ((size_t)by * blocksX + bx) * blockSize;
+			if (format == BC_FORMAT_BC1)
+			{
+				DecodeBC1Block(pBlock, texels);
+			}
+			else if (format == BC_FORMAT_BC4)
+			{
+				DecodeBC4Block(pBlock, texels);
+			}
+			else
+			{
+				unsigned char red[16], green[16];
+				DecodeBC4Block(pBlock, red);
+				DecodeBC4Block(pBlock + 8, green);
+				for (int i = 0; i < 16; i++)
+				{
+					texels[i * 4 + 0] = red[i];
+					texels[i * 4 + 1] = green[i];
+					texels[i * 4 + 2] = 0;
+					texels[i * 4 + 3] = 255;
+				}
+			}
+
+			int columns = std::min(BC_BLOCK_DIMENSION, width - bx * BC_BLOCK_DIMENSION);
+			int rows = std::min(BC_BLOCK_DIMENSION, height - by * BC_BLOCK_DIMENSION);
+			for (int y = 0; y < rows; y++)
+			{
+				size_t offset = ((size_t)(by * BC_BLOCK_DIMENSION + y) * width + bx * BC_BLOCK_DIMENSION) * image.Channels;
+				memcpy(&image.Texels[offset], &texels[y * BC_BLOCK_DIMENSION * image.Channels], columns * image.Channels);
+			}
+		}
+	}
+}
+
+double ComputePsnr(const Image& a, const Image& b, int channels)
+{
+	if (a.Width != b.Width || a.Height != b.Height || channels > a.Channels || channels > b.Channels)
+		return 0.0;
+
+	double sum = 0.0;
+	size_t count = (size_t)a.Width * a.Height;
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int c = 0; c < channels; c++)
+		{
+			double difference = (double)a.Texels[i * a.Channels + c] - b.Texels[i * b.Channels + c];
+			sum += difference * difference;
+		}
+	}
+	if (sum == 0.0)
+		return std::numeric_limits<double>::infinity();
+	double mse = sum / ((double)count * channels);
+	return 10.0 * log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// File: BlockCompression.h
+//
+// BC1, BC4 and BC5 encoders for the offline texture cooker, and the matching decoders
+// to measure their error. Blocks are fitted with SSE2 and images are split into block
+// rows across threads.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "ImageIO.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define BC_BLOCK_DIMENSION      4       // texels per block side
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum BC_FORMAT
+{
+	BC_FORMAT_BC1,      // RGB endpoints and 2-bit indices, 8 bytes per block
+	BC_FORMAT_BC4,      // one channel, 3-bit indices, 8 bytes per block
+	BC_FORMAT_BC5,      // two BC4 blocks for red and green, 16 bytes per block
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+int GetBCBlockSize(BC_FORMAT format);
+
+// Channels CompressImage expects: RGBA for BC1 and BC5, gray for BC4
+int GetBCSourceChannels(BC_FORMAT format);
+
+// Single blocks of 16 texels in row order, RGBA for BC1 and one byte each for BC4
+void EncodeBC1Block(const unsigned char* pRgba, unsigned char* pBlock);
+void EncodeBC4Block(const unsigned char* pValues, unsigned char* pBlock);
+void DecodeBC1Block(const unsigned char* pBlock, unsigned char* pRgba);
+void DecodeBC4Block(const unsigned char* pBlock, unsigned char* pValues);
+
+// Encodes every block of the image, partial blocks at the edges replicate the last texel.
+// numThreads = 0 uses every hardware thread, the output does not depend on it.
+bool CompressImage(const Image& source, BC_FORMAT format, std::vector<unsigned char>& blocks, int numThreads = 0);
+
+// BC1 and BC5 decode to RGBA (BC5 with zero blue), BC4 to gray
+void DecompressImage(const unsigned char* pBlocks, BC_FORMAT format, int width, int height, Image& image);
+
+// Peak signal to noise ratio in dB over the first channels of two equally sized images,
+// infinity when they are identical
+double ComputePsnr(const Image& a, const Image& b, int channels);
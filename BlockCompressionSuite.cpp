@@ -0,0 +1,228 @@
+//--------------------------------------------------------------------------------------
+// File: BlockCompressionSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "BlockCompression.h"
+#include "ImageIO.h"
+#include "TextureContainer.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Block compression. The test images are smooth like the demo's textures with a little
+// texel noise: a displacement field, a diffuse map coloured by height and the matching
+// tangent space normal map.
+//--------------------------------------------------------------------------------------
+void BuildCompressionImages(int width, int height, Image& diffuse, Image& displacement, Image& normal)
+{
+	diffuse.Width = displacement.Width = normal.Width = width;
+	diffuse.Height = displacement.Height = normal.Height = height;
+	diffuse.Channels = normal.Channels = 4;
+	displacement.Channels = 1;
+	diffuse.Texels.resize((size_t)width * height * 4);
+	displacement.Texels.resize((size_t)width * height);
+	normal.Texels.resize((size_t)width * height * 4);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			size_t i = (size_t)y * width + x;
+			unsigned int hash = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+			hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+			float noise = (float)((hash ^ (hash >> 15)) & 7) - 3.5f;
+
+			float value = 128.0f + 60.0f * sinf(x * 0.05f) * cosf(y * 0.07f) + 30.0f * sinf((x + y) * 0.13f);
+			float dx = 3.0f * cosf(x * 0.05f) * cosf(y * 0.07f) + 3.9f * cosf((x + y) * 0.13f);
+			float dy = -4.2f * sinf(x * 0.05f) * sinf(y * 0.07f) + 3.9f * cosf((x + y) * 0.13f);
+			displacement.Texels[i] = (unsigned char)std::min(std::max(value + noise, 0.0f), 255.0f);
+
+			float t = value / 255.0f;
+			diffuse.Texels[i * 4 + 0] = (unsigned char)std::min(std::max(90.0f + 120.0f * t + noise, 0.0f), 255.0f);
+			diffuse.Texels[i * 4 + 1] = (unsigned char)std::min(std::max(70.0f + 90.0f * t - noise, 0.0f), 255.0f);
+			diffuse.Texels[i * 4 + 2] = (unsigned char)std::min(std::max(50.0f + 40.0f * t + noise, 0.0f), 255.0f);
+			diffuse.Texels[i * 4 + 3] = 255;
+
+			float length = sqrtf(dx * dx + dy * dy + 16.0f);
+			normal.Texels[i * 4 + 0] = (unsigned char)(127.5f - 127.5f * dx / length);
+			normal.Texels[i * 4 + 1] = (unsigned char)(127.5f - 127.5f * dy / length);
+			normal.Texels[i * 4 + 2] = (unsigned char)(127.5f + 127.5f * 4.0f / length);
+			normal.Texels[i * 4 + 3] = 255;
+		}
+	}
+}
+
+int VerifyCompression()
+{
+	SuiteCheck check("compression");
+	unsigned int seed = 12345;
+
+	// Solid and two colour blocks of representable colours decode exactly, any BC4 block
+	// is within half a palette step
+	int bc1Errors = 0, bc4Errors = 0;
+	for (int block = 0; block < 2000; block++)
+	{
+		unsigned char rgba[64], decoded[64], values[16], decodedValues[16], encoded[8];
+		int colors[2][3];
+		for (int e = 0; e < 2; e++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			int r = (seed >> 8) & 31, g = (seed >> 13) & 63, b = (seed >> 19) & 31;
+			colors[e][0] = (r << 3) | (r >> 2);
+			colors[e][1] = (g << 2) | (g >> 4);
+			colors[e][2] = (b << 3) | (b >> 2);
+		}
+		bool solid = (block % 4) == 0;
+		for (int i = 0; i < 16; i++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const int* pColor = colors[solid ? 0 : (seed >> 16) & 1];
+			for (int c = 0; c < 3; c++)
+				rgba[i * 4 + c] = (unsigned char)pColor[c];
+			rgba[i * 4 + 3] = 255;
+			values[i] = (unsigned char)(seed >> 24);
+		}
+		EncodeBC1Block(rgba, encoded);
+		DecodeBC1Block(encoded, decoded);
+		if (memcmp(rgba, decoded, sizeof(rgba)) != 0 && bc1Errors++ == 0)
+			check.Fail("BC1 %s block %d is not exact", solid ? "solid" : "two colour", block);
+
+		EncodeBC4Block(values, encoded);
+		DecodeBC4Block(encoded, decodedValues);
+		int minValue = *std::min_element(values, values + 16), maxValue = *std::max_element(values, values + 16);
+		for (int i = 0; i < 16; i++)
+		{
+			if (abs(values[i] - decodedValues[i]) * 14 > (maxValue - minValue) + 14)
+			{
+				if (bc4Errors++ == 0)
+					check.Fail("BC4 block %d texel %d %d -> %d", block, i, values[i], decodedValues[i]);
+				break;
+			}
+		}
+	}
+	check.FailIf(bc1Errors > 1 || bc4Errors > 1, "%d BC1 and %d BC4 blocks failed in all", bc1Errors, bc4Errors);
+
+	// Quality on smooth images, odd sizes exercise the partial edge blocks
+	Image diffuse, displacement, normal;
+	BuildCompressionImages(203, 98, diffuse, displacement, normal);
+	const Image* s_Images[3] = { &diffuse, &displacement, &normal };
+	static const BC_FORMAT s_Formats[3] = { BC_FORMAT_BC1, BC_FORMAT_BC4, BC_FORMAT_BC5 };
+	static const int s_Channels[3] = { 3, 1, 2 };
+	static const double s_MinPsnr[3] = { 36.0, 40.0, 38.0 };
+	static const char* s_FormatNames[3] = { "BC1", "BC4", "BC5" };
+	for (int f = 0; f < 3; f++)
+	{
+		std::vector<unsigned char> blocks, threaded;
+		Image decoded;
+		if (!CompressImage(*s_Images[f], s_Formats[f], blocks, 1) || blocks.size() != 51 * 25 * (size_t)GetBCBlockSize(s_Formats[f]))
+		{
+			check.Fail("%s encode failed", s_FormatNames[f]);
+			continue;
+		}
+		DecompressImage(blocks.data(), s_Formats[f], 203, 98, decoded);
+		double psnr = ComputePsnr(*s_Images[f], decoded, s_Channels[f]);
+		check.FailIf(!(psnr >= s_MinPsnr[f]), "%s PSNR %.2f dB below %.0f dB", s_FormatNames[f], psnr, s_MinPsnr[f]);
+
+		// Threads split the image by block rows and must not change the result
+		Image large = *s_Images[f];
+		BuildCompressionImages(400, 300, diffuse, displacement, normal);
+		CompressImage(*s_Images[f], s_Formats[f], blocks, 1);
+		CompressImage(*s_Images[f], s_Formats[f], threaded, 3);
+		check.FailIf(blocks != threaded, "%s differs between 1 and 3 threads", s_FormatNames[f]);
+		BuildCompressionImages(203, 98, diffuse, displacement, normal);
+	}
+
+	// Wrong channel counts are rejected
+	std::vector<unsigned char> blocks;
+	check.FailIf(CompressImage(diffuse, BC_FORMAT_BC4, blocks) || CompressImage(displacement, BC_FORMAT_BC1, blocks),
+		"mismatched channel count was accepted");
+
+	// Container: BC mips are laid out as rows of blocks and match the encoder, sizes that
+	// D3D11 can not create are rejected
+	const char* pContainerFile = "CompressionBenchmark.pack";
+	BuildCompressionImages(64, 40, diffuse, displacement, normal);
+	std::vector<TextureSource> sources(3);
+	static const TEXTURE_FORMAT s_TextureFormats[3] = { TEXTURE_FORMAT_BC1_UNORM, TEXTURE_FORMAT_BC4_UNORM, TEXTURE_FORMAT_BC5_UNORM };
+	for (int f = 0; f < 3; f++)
+	{
+		sources[f].Name = s_FormatNames[f];
+		sources[f].Format = s_TextureFormats[f];
+		sources[f].Texels = *s_Images[f];
+	}
+	std::vector<TextureCookStats> stats;
+	TextureContainerReader reader;
+	check.FailIf(!WriteTextureContainer(pContainerFile, sources, &stats) || !reader.Open(pContainerFile) ||
+		stats.size() != 3, "container round trip failed");
+	for (int t = 0; t < reader.GetTextureCount(); t++)
+	{
+		const TextureContainerEntry* pEntry = reader.GetTexture(t);
+		int blockSize = GetBCBlockSize(s_Formats[t]);
+		Image level;
+		ConvertImage(*s_Images[t], GetBCSourceChannels(s_Formats[t]), level);
+		for (unsigned int m = 0; m < pEntry->MipCount; m++)
+		{
+			const TextureContainerMip& mip = pEntry->Mips[m];
+			unsigned int blocksX = (mip.Width + 3) / 4, blocksY = (mip.Height + 3) / 4;
+			CompressImage(level, s_Formats[t], blocks);
+			if (mip.RowPitch != blocksX * blockSize || mip.Size != blocksX * blocksY * blockSize ||
+				mip.Size != blocks.size() || memcmp(reader.GetMipData(*pEntry, m), blocks.data(), blocks.size()) != 0)
+			{
+				check.Fail("%s mip %u differs from the encoder", pEntry->Name, m);
+				break;
+			}
+			Image next;
+			DownsampleImage(level, next);
+			level = next;
+		}
+
+		// 8x smaller than RGBA8 for BC1 and BC4, 4x for BC5, less the padded tail mips
+		double ratio = (double)stats[t].UncompressedSize / stats[t].Size;
+		double expectedRatio = (t == 2) ? 4.0 : 8.0;
+		check.FailIf(ratio > expectedRatio || ratio < expectedRatio * 0.95 || !(stats[t].Psnr >= s_MinPsnr[t]),
+			"%s stats %.2fx %.2f dB", pEntry->Name, ratio, stats[t].Psnr);
+	}
+	reader.Close();
+
+	sources.resize(1);
+	BuildCompressionImages(66, 40, diffuse, displacement, normal);
+	sources[0].Texels = diffuse;
+	check.FailIf(WriteTextureContainer(pContainerFile, sources), "BC texture of 66x40 was accepted");
+	remove(pContainerFile);
+
+	return check.Finish("2000 blocks, 3 formats");
+}
+
+void RunCompressionThroughput()
+{
+	// Same size as the demo's textures
+	Image diffuse, displacement, normal;
+	BuildCompressionImages(1500, 1000, diffuse, displacement, normal);
+	const Image* s_Images[3] = { &diffuse, &displacement, &normal };
+	static const BC_FORMAT s_Formats[3] = { BC_FORMAT_BC1, BC_FORMAT_BC4, BC_FORMAT_BC5 };
+	static const int s_Channels[3] = { 3, 1, 2 };
+	static const char* s_Names[3] = { "diffuse BC1", "displacement BC4", "normal BC5" };
+
+	int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int f = 0; f < 3; f++)
+	{
+		std::vector<unsigned char> blocks;
+		double start = GetTimeSeconds();
+		CompressImage(*s_Images[f], s_Formats[f], blocks, 1);
+		double singleSeconds = GetTimeSeconds() - start;
+		start = GetTimeSeconds();
+		CompressImage(*s_Images[f], s_Formats[f], blocks, hardwareThreads);
+		double threadedSeconds = GetTimeSeconds() - start;
+
+		Image decoded;
+		DecompressImage(blocks.data(), s_Formats[f], 1500, 1000, decoded);
+		double texels = 1500.0 * 1000.0;
+		printf("compression %-16s 1 thread %8.2f ms  %d threads %8.2f ms  %7.1f Mtexels/s  PSNR %6.2f dB  %7.1f KB vs RGBA8 %7.1f KB\n",
+			s_Names[f], singleSeconds * 1000.0, hardwareThreads, threadedSeconds * 1000.0, texels / threadedSeconds / 1e6,
+			ComputePsnr(*s_Images[f], decoded, s_Channels[f]), blocks.size() / 1024.0, texels * 4.0 / 1024.0);
+	}
+}
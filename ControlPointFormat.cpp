@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// File: ControlPointFormat.cpp
+//--------------------------------------------------------------------------------------
+#include "ControlPointFormat.h"
+#include <math.h>
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+static float SignNotZero(float value)
+{
+	return (value >= 0.0f) ? 1.0f : -1.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+short EncodeSnorm16(float value)
+{
+	value = (value < -1.0f) ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (short)floorf(value * 32767.0f + 0.5f);
+}
+
+float DecodeSnorm16(short value)
+{
+	float decoded = (float)value / 32767.0f;
+	return (decoded < -1.0f) ? -1.0f : decoded;
+}
+
+void EncodeOctahedralNormal(const float normal[3], short encoded[2])
+{
+	float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	if (length <= 0.0f)
+	{
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+
+	float u = normal[0] / length, v = normal[1] / length;
+	if (normal[2] < 0.0f)
+	{
+		float foldedU = (1.0f - fabsf(v)) * SignNotZero(u);
+		float foldedV = (1.0f - fabsf(u)) * SignNotZero(v);
+		u = foldedU;
+		v = foldedV;
+	}
+	encoded[0] = EncodeSnorm16(u);
+	encoded[1] = EncodeSnorm16(v);
+}
+
+void DecodeOctahedralNormal(const short encoded[2], float normal[3])
+{
+	float u = DecodeSnorm16(encoded[0]), v = DecodeSnorm16(encoded[1]);
+	float z = 1.0f - fabsf(u) - fabsf(v);
+	if (z < 0.0f)
+	{
+		float unfoldedU = (1.0f - fabsf(v)) * SignNotZero(u);
+		float unfoldedV = (1.0f - fabsf(u)) * SignNotZero(v);
+		u = unfoldedU;
+		v = unfoldedV;
+	}
+	float length = sqrtf(u * u + v * v + z * z);
+	normal[0] = u / length;
+	normal[1] = v / length;
+	normal[2] = z / length;
+}
+
+void DecodeGridControlPoint(const GridControlPoint& point, unsigned int vertexId, const float gridPatches[2],
+	float position[3], float texCoord[2], float normal[3])
+{
+	unsigned int columns = (unsigned int)gridPatches[0] + 1;
+	texCoord[0] = (float)(vertexId % columns) / gridPatches[0];
+	texCoord[1] = (float)(vertexId / columns) / gridPatches[1];
+	position[0] = texCoord[0] * 2.0f - 1.0f;
+	position[1] = 0.0f;
+	position[2] = texCoord[1] * 2.0f - 1.0f;
+	DecodeOctahedralNormal(point.Normal, normal);
+}
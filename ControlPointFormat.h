@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// File: ControlPointFormat.h
+//
+// Compact control points of the terrain grids. A float position, texture coordinate and
+// normal take 32 bytes, most of it what the grid already knows: x and z and the texture
+// coordinate of a vertex follow from its index, row by row over (patchesX + 1) x
+// (patchesZ + 1) vertices, so VS derives them from SV_VertexID and
+// DrawConstants::GridPatches the same way TerrainGrid::GetVertex does. Only the normal
+// is stored, octahedral encoded in two SNORM16 values (DXGI_FORMAT_R16G16_SNORM), which
+// leaves 4 bytes per control point.
+//
+// The octahedral encoding projects the unit sphere onto the octahedron |x|+|y|+|z| = 1
+// and unfolds its lower half over the corners of the upper one, so the whole sphere maps
+// onto the square [-1, 1]^2 with nearly uniform error. The decoder here is the one VS runs.
+//
+// Indexed draws reach 65536 vertices with 16-bit indices, larger grids take 32-bit ones.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define CONTROL_POINT_MAX_16BIT_VERTICES 65536
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Input of VS, "NORMAL" as DXGI_FORMAT_R16G16_SNORM
+struct GridControlPoint
+{
+	short Normal[2];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// SNORM16 the way the input assembler converts it: -32768 and -32767 both decode to -1
+short EncodeSnorm16(float value);
+float DecodeSnorm16(short value);
+
+// normal does not have to be normalized, a zero vector encodes +Z. The decoded normal
+// is normalized; keep in sync with DecodeOctahedralNormal in DisplacedAndShaded.hlsl.
+void EncodeOctahedralNormal(const float normal[3], short encoded[2]);
+void DecodeOctahedralNormal(const short encoded[2], float normal[3]);
+
+// What VS reads for vertex vertexId of a grid of gridPatches[0] x gridPatches[1] patches:
+// the position in object space, the texture coordinate and the normal
+void DecodeGridControlPoint(const GridControlPoint& point, unsigned int vertexId, const float gridPatches[2],
+	float position[3], float texCoord[2], float normal[3]);
+
+// Bytes per index of a mesh with vertexCount vertices, 2 or 4
+inline int GetControlPointIndexSize(int vertexCount)
+{
+	return (vertexCount > CONTROL_POINT_MAX_16BIT_VERTICES) ? 4 : 2;
+}
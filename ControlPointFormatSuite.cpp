@@ -0,0 +1,229 @@
+//--------------------------------------------------------------------------------------
+// File: ControlPointFormatSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "ControlPointFormat.h"
+#include "TerrainGrid.h"
+#include "TerrainQuadtree.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Control point format. SNORM16 and octahedral normals have to round trip within their
+// quantization, the compact grid control points have to decode to the vertices of
+// TerrainGrid and 32-bit indices have to reach grids beyond 65536 vertices.
+//--------------------------------------------------------------------------------------
+#define CONTROL_POINT_NORMALS       200000
+#define CONTROL_POINT_MAX_ANGLE     1e-4    // radians, a step of 1/32767 bends by about 3e-5
+
+static void RandomUnitVector(unsigned int& state, float normal[3])
+{
+	float length;
+	do
+	{
+		for (int c = 0; c < 3; c++)
+			normal[c] = RandomFloat(state, -1.0f, 1.0f);
+		length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	} while (length < 0.1f || length > 1.0f);
+	for (int c = 0; c < 3; c++)
+		normal[c] /= length;
+}
+
+// acos of the dot product loses the small angles in its rounding, so from the cross product
+static double NormalAngle(const float a[3], const float b[3])
+{
+	double cross[3] =
+	{
+		(double)a[1] * b[2] - (double)a[2] * b[1],
+		(double)a[2] * b[0] - (double)a[0] * b[2],
+		(double)a[0] * b[1] - (double)a[1] * b[0],
+	};
+	double dot = (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2];
+	return atan2(sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot);
+}
+
+int VerifyControlPointFormat()
+{
+	SuiteCheck check("controlpoints");
+
+	// SNORM16 like the input assembler
+	double snormError = 0.0;
+	for (int i = 0; i <= 100000; i++)
+	{
+		float value = -1.0f + 2.0f * i / 100000.0f;
+		snormError = std::max(snormError, fabs((double)DecodeSnorm16(EncodeSnorm16(value)) - value));
+	}
+	check.FailIf(EncodeSnorm16(-1.0f) != -32767 || EncodeSnorm16(1.0f) != 32767 || EncodeSnorm16(0.0f) != 0 ||
+		DecodeSnorm16(-32768) != -1.0f || DecodeSnorm16(32767) != 1.0f || EncodeSnorm16(2.0f) != 32767 ||
+		snormError > 0.5 / 32767.0 + 1e-7, "SNORM16 ends or clamping wrong, round trip error %g", snormError);
+
+	// The axes and the octant borders decode exactly, random directions within the bound
+	static const float s_Exact[][3] =
+	{
+		{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+	};
+	int exactErrors = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		short encoded[2];
+		float decoded[3];
+		EncodeOctahedralNormal(s_Exact[i], encoded);
+		DecodeOctahedralNormal(encoded, decoded);
+		exactErrors += (decoded[0] != s_Exact[i][0] || decoded[1] != s_Exact[i][1] || decoded[2] != s_Exact[i][2]) ? 1 : 0;
+	}
+	static const float s_Zero[3] = { 0.0f, 0.0f, 0.0f };
+	static const float s_Scaled[3] = { 0.0f, 5.0f, 0.0f };
+	short zero[2], scaled[2], up[2];
+	EncodeOctahedralNormal(s_Zero, zero);
+	EncodeOctahedralNormal(s_Scaled, scaled);
+	EncodeOctahedralNormal(s_Exact[2], up);
+	exactErrors += (zero[0] != 0 || zero[1] != 0 || scaled[0] != up[0] || scaled[1] != up[1]) ? 1 : 0;
+
+	unsigned int state = 4711;
+	double maxAngle = 0.0, sumAngle = 0.0, maxLengthError = 0.0;
+	for (int i = 0; i < CONTROL_POINT_NORMALS; i++)
+	{
+		float normal[3], decoded[3];
+		short encoded[2];
+		RandomUnitVector(state, normal);
+		// A quarter of the directions on the border of the folded half
+		if (i % 4 == 0)
+			normal[2] = 0.0f;
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (int c = 0; c < 3; c++)
+			normal[c] /= length;
+		EncodeOctahedralNormal(normal, encoded);
+		DecodeOctahedralNormal(encoded, decoded);
+		double angle = NormalAngle(normal, decoded);
+		maxAngle = std::max(maxAngle, angle);
+		sumAngle += angle;
+		double decodedLength = sqrt((double)decoded[0] * decoded[0] + (double)decoded[1] * decoded[1] +
+			(double)decoded[2] * decoded[2]);
+		maxLengthError = std::max(maxLengthError, fabs(decodedLength - 1.0));
+	}
+	check.FailIf(exactErrors > 0 || maxAngle > CONTROL_POINT_MAX_ANGLE || maxLengthError > 1e-6,
+		"%d axes or special normals wrong, largest error %g rad, length error %g", exactErrors, maxAngle,
+		maxLengthError);
+
+	// The compact control points of grids up to 300x300 patches, beyond 16-bit indices,
+	// against TerrainGrid::GetVertex
+	static const int s_GridSizes[][2] = { { 1, 1 }, { 8, 8 }, { 7, 5 }, { 128, 128 }, { 300, 300 } };
+	int gridErrors = 0, indexErrors = 0;
+	for (int g = 0; g < 5; g++)
+	{
+		TerrainGrid grid;
+		grid.Build(s_GridSizes[g][0], s_GridSizes[g][1]);
+		float gridPatches[2] = { (float)grid.GetPatchesX(), (float)grid.GetPatchesZ() };
+		GridControlPoint point;
+		EncodeOctahedralNormal(s_Exact[2], point.Normal);
+		for (int v = 0; v < grid.GetVertexCount(); v++)
+		{
+			float position[3], texCoord[2], decodedPosition[3], decodedTexCoord[2], normal[3];
+			grid.GetVertex(v, position, texCoord);
+			DecodeGridControlPoint(point, v, gridPatches, decodedPosition, decodedTexCoord, normal);
+			bool same = memcmp(position, decodedPosition, sizeof(position)) == 0 &&
+				memcmp(texCoord, decodedTexCoord, sizeof(texCoord)) == 0 && normal[0] == 0.0f && normal[1] == 1.0f &&
+				normal[2] == 0.0f;
+			gridErrors += same ? 0 : 1;
+		}
+
+		// Every patch in both index sizes where they fit, the largest index of the last grid
+		// only fits 32 bits
+		int indexSize = GetControlPointIndexSize(grid.GetVertexCount());
+		std::vector<int> patches(grid.GetPatchCount());
+		for (int p = 0; p < grid.GetPatchCount(); p++)
+			patches[p] = p;
+		std::vector<unsigned int> wide(grid.GetPatchCount() * TERRAIN_INDICES_PER_PATCH);
+		std::vector<unsigned short> narrow(wide.size());
+		for (int quads = 0; quads < 2; quads++)
+		{
+			int count = quads ? grid.WriteQuadPatchIndices(&patches[0], grid.GetPatchCount(), &wide[0]) :
+				grid.WritePatchIndices(&patches[0], grid.GetPatchCount(), &wide[0]);
+			if (indexSize == 2)
+			{
+				if (quads)
+					grid.WriteQuadPatchIndices(&patches[0], grid.GetPatchCount(), &narrow[0]);
+				else
+					grid.WritePatchIndices(&patches[0], grid.GetPatchCount(), &narrow[0]);
+			}
+			unsigned int largest = 0;
+			int perPatch = quads ? TERRAIN_QUAD_INDICES_PER_PATCH : TERRAIN_INDICES_PER_PATCH;
+			for (int p = 0; p < grid.GetPatchCount(); p++)
+			{
+				unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+				if (quads)
+					grid.GetQuadPatchIndices(p, indices);
+				else
+					grid.GetPatchIndices(p, indices);
+				for (int i = 0; i < perPatch; i++)
+				{
+					unsigned int index = wide[p * perPatch + i];
+					indexErrors += (index != indices[i] || (indexSize == 2 && narrow[p * perPatch + i] != index)) ? 1 : 0;
+					largest = std::max(largest, index);
+				}
+			}
+			indexErrors += (count != grid.GetPatchCount() * perPatch) ? 1 : 0;
+			indexErrors += (largest + 1 != (unsigned int)grid.GetVertexCount()) ? 1 : 0;
+			indexErrors += ((indexSize == 4) != (largest >= CONTROL_POINT_MAX_16BIT_VERTICES)) ? 1 : 0;
+		}
+	}
+
+	// The quadtree of 256 leaves per side needs 32-bit indices for its last corner
+	TerrainQuadtree quadtree;
+	quadtree.Build(9);
+	int leaves = quadtree.GetLeavesPerSide();
+	QuadtreePatch corners[2] = { { 0, 0, 1, 0 }, { (unsigned short)(leaves - 1), (unsigned short)(leaves - 1), 1, 0 } };
+	unsigned int quadtreeIndices[8];
+	quadtree.WritePatchIndices(corners, 2, quadtreeIndices);
+	TerrainGrid leafGrid;
+	leafGrid.Build(leaves, leaves);
+	unsigned int cornerIndices[TERRAIN_QUAD_INDICES_PER_PATCH];
+	leafGrid.GetQuadPatchIndices(leaves * leaves - 1, cornerIndices);
+	indexErrors += (GetControlPointIndexSize(leafGrid.GetVertexCount()) != 4 || quadtreeIndices[0] != 0 ||
+		memcmp(quadtreeIndices + 4, cornerIndices, sizeof(cornerIndices)) != 0) ? 1 : 0;
+	check.FailIf(gridErrors > 0 || indexErrors > 0, "%d grid control points decode wrong, %d index errors", gridErrors,
+		indexErrors);
+
+	return check.Finish("%d normals, largest error %.2g rad, mean %.2g rad", CONTROL_POINT_NORMALS, maxAngle,
+		sumAngle / CONTROL_POINT_NORMALS);
+}
+
+void RunControlPointFormatSuite()
+{
+	const int count = 1000000;
+	std::vector<float> normals(count * 3), decoded(count * 3);
+	std::vector<GridControlPoint> points(count);
+	unsigned int state = 99;
+	for (int i = 0; i < count; i++)
+		RandomUnitVector(state, &normals[i * 3]);
+
+	double start = GetTimeSeconds();
+	for (int i = 0; i < count; i++)
+		EncodeOctahedralNormal(&normals[i * 3], points[i].Normal);
+	double encodeSeconds = GetTimeSeconds() - start;
+	start = GetTimeSeconds();
+	for (int i = 0; i < count; i++)
+		DecodeOctahedralNormal(points[i].Normal, &decoded[i * 3]);
+	double decodeSeconds = GetTimeSeconds() - start;
+	printf("controlpoints octahedral normals  encode %6.1f M/s  decode %6.1f M/s\n", count / encodeSeconds * 1e-6,
+		count / decodeSeconds * 1e-6);
+
+	// Input assembler bytes of a frame drawing every patch once, against float position,
+	// texture coordinate and normal
+	static const int s_Grids[] = { 8, 128, 256 };
+	for (int g = 0; g < 3; g++)
+	{
+		TerrainGrid grid;
+		grid.Build(s_Grids[g], s_Grids[g]);
+		int vertices = grid.GetVertexCount();
+		int indexSize = GetControlPointIndexSize(vertices);
+		double indexBytes = (double)grid.GetPatchCount() * TERRAIN_QUAD_INDICES_PER_PATCH * indexSize;
+		printf("controlpoints %3dx%-3d grid  %7d control points  %8.1f KB float  %7.1f KB compact  %d-bit indices "
+			"%8.1f KB per frame of quad patches\n", s_Grids[g], s_Grids[g], vertices, vertices * 32.0 / 1024.0,
+			vertices * sizeof(GridControlPoint) / 1024.0, indexSize * 8, indexBytes / 1024.0);
+	}
+}
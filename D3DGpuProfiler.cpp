@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------------
+// File: D3DGpuProfiler.cpp
+//--------------------------------------------------------------------------------------
+#include "D3DGpuProfiler.h"
+#include <d3d11.h>
+
+
+//--------------------------------------------------------------------------------------
+// D3DGpuProfiler
+//--------------------------------------------------------------------------------------
+D3DGpuProfiler::D3DGpuProfiler()
+	: m_pCurrent(NULL)
+	, m_Created(false)
+{
+	ZeroMemory(m_QuerySets, sizeof(m_QuerySets));
+	for (int s = 0; s < FRAME_PROFILER_LATENCY; s++)
+		m_QuerySets[s].Frame = -1;
+}
+
+HRESULT D3DGpuProfiler::Create(ID3D11Device* pDevice)
+{
+	Release();
+
+	D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+	D3D11_QUERY_DESC statisticsDesc = { D3D11_QUERY_PIPELINE_STATISTICS, 0 };
+	D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+	HRESULT hr = S_OK;
+	for (int s = 0; s < FRAME_PROFILER_LATENCY && SUCCEEDED(hr); s++)
+	{
+		QuerySet& querySet = m_QuerySets[s];
+		hr = pDevice->CreateQuery(&disjointDesc, &querySet.pDisjoint);
+		if (SUCCEEDED(hr))
+			hr = pDevice->CreateQuery(&statisticsDesc, &querySet.pPipelineStatistics);
+		for (int t = 0; t < TIMESTAMP_COUNT && SUCCEEDED(hr); t++)
+			hr = pDevice->CreateQuery(&timestampDesc, &querySet.pTimestamps[t]);
+	}
+	if (FAILED(hr))
+	{
+		Release();
+		return hr;
+	}
+
+	m_Created = true;
+	return S_OK;
+}
+
+void D3DGpuProfiler::Release()
+{
+	for (int s = 0; s < FRAME_PROFILER_LATENCY; s++)
+	{
+		QuerySet& querySet = m_QuerySets[s];
+		if (querySet.pDisjoint) querySet.pDisjoint->Release();
+		if (querySet.pPipelineStatistics) querySet.pPipelineStatistics->Release();
+		for (int t = 0; t < TIMESTAMP_COUNT; t++)
+		{
+			if (querySet.pTimestamps[t]) querySet.pTimestamps[t]->Release();
+		}
+	}
+	ZeroMemory(m_QuerySets, sizeof(m_QuerySets));
+	for (int s = 0; s < FRAME_PROFILER_LATENCY; s++)
+		m_QuerySets[s].Frame = -1;
+	m_pCurrent = NULL;
+	m_Created = false;
+}
+
+void D3DGpuProfiler::BeginFrame(ID3D11DeviceContext* pContext, int frame)
+{
+	if (!m_Created)
+		return;
+
+	// A set whose results never arrived is reused, the profiler already recorded that
+	// frame without GPU data
+	m_pCurrent = &m_QuerySets[frame % FRAME_PROFILER_LATENCY];
+	m_pCurrent->Frame = frame;
+	pContext->Begin(m_pCurrent->pDisjoint);
+	pContext->End(m_pCurrent->pTimestamps[TIMESTAMP_FRAME_BEGIN]);
+}
+
+void D3DGpuProfiler::BeginDraw(ID3D11DeviceContext* pContext)
+{
+	if (!m_pCurrent)
+		return;
+	pContext->End(m_pCurrent->pTimestamps[TIMESTAMP_DRAW_BEGIN]);
+	pContext->Begin(m_pCurrent->pPipelineStatistics);
+}
+
+void D3DGpuProfiler::EndDraw(ID3D11DeviceContext* pContext)
+{
+	if (!m_pCurrent)
+		return;
+	pContext->End(m_pCurrent->pPipelineStatistics);
+	pContext->End(m_pCurrent->pTimestamps[TIMESTAMP_DRAW_END]);
+}
+
+void D3DGpuProfiler::EndFrame(ID3D11DeviceContext* pContext)
+{
+	if (!m_pCurrent)
+		return;
+	pContext->End(m_pCurrent->pTimestamps[TIMESTAMP_FRAME_END]);
+	pContext->End(m_pCurrent->pDisjoint);
+	m_pCurrent = NULL;
+}
+
+void D3DGpuProfiler::CollectResults(ID3D11DeviceContext* pContext, FrameProfiler& profiler)
+{
+	if (!m_Created)
+		return;
+
+	for (;;)
+	{
+		// Oldest set with outstanding results
+		QuerySet* pQuerySet = NULL;
+		for (int s = 0; s < FRAME_PROFILER_LATENCY; s++)
+		{
+			QuerySet& querySet = m_QuerySets[s];
+			if (querySet.Frame >= 0 && &querySet != m_pCurrent && (!pQuerySet || querySet.Frame < pQuerySet->Frame))
+				pQuerySet = &querySet;
+		}
+		if (!pQuerySet)
+			return;
+
+		// The disjoint query ends last, once it is done the others are too
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+		if (pContext->GetData(pQuerySet->pDisjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			return;
+
+		FrameGpuData data;
+		D3D11_QUERY_DATA_PIPELINE_STATISTICS statistics;
+		if (pContext->GetData(pQuerySet->pPipelineStatistics, &statistics, sizeof(statistics), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		{
+			data.HullInvocations = (long long)statistics.HSInvocations;
+			data.DomainInvocations = (long long)statistics.DSInvocations;
+			data.Primitives = (long long)statistics.CInvocations;
+		}
+
+		UINT64 timestamps[TIMESTAMP_COUNT];
+		bool timestampsValid = !disjoint.Disjoint && disjoint.Frequency > 0;
+		for (int t = 0; t < TIMESTAMP_COUNT && timestampsValid; t++)
+		{
+			timestampsValid = pContext->GetData(pQuerySet->pTimestamps[t], &timestamps[t], sizeof(UINT64),
+				D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+		}
+		if (timestampsValid)
+		{
+			double frequency = (double)disjoint.Frequency;
+			data.FrameSeconds = (double)(timestamps[TIMESTAMP_FRAME_END] - timestamps[TIMESTAMP_FRAME_BEGIN]) / frequency;
+			data.DrawSeconds = (double)(timestamps[TIMESTAMP_DRAW_END] - timestamps[TIMESTAMP_DRAW_BEGIN]) / frequency;
+		}
+
+		profiler.SetGpuData(pQuerySet->Frame, data);
+		pQuerySet->Frame = -1;
+	}
+}
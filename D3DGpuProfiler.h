@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// File: D3DGpuProfiler.h
+//
+// GPU side of the frame profiler. Every frame issues a disjoint query, timestamps at
+// the frame and draw boundaries and a pipeline statistics query around the draw, in
+// one of FRAME_PROFILER_LATENCY query sets. The results are read back a few frames
+// later without flushing or waiting and handed to FrameProfiler::SetGpuData.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "FrameProfiler.h"
+#include <windows.h>
+
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+struct ID3D11Query;
+
+
+//--------------------------------------------------------------------------------------
+// D3DGpuProfiler
+//--------------------------------------------------------------------------------------
+class D3DGpuProfiler
+{
+public:
+	D3DGpuProfiler();
+	~D3DGpuProfiler() { Release(); }
+
+	HRESULT Create(ID3D11Device* pDevice);
+	void Release();
+
+	// Frame numbers come from FrameProfiler::GetCurrentFrame. Calls are ignored until
+	// Create succeeded.
+	void BeginFrame(ID3D11DeviceContext* pContext, int frame);
+	void BeginDraw(ID3D11DeviceContext* pContext);
+	void EndDraw(ID3D11DeviceContext* pContext);
+	void EndFrame(ID3D11DeviceContext* pContext);
+
+	// Passes the results of the finished frames to the profiler, stops at the first
+	// frame the GPU has not finished yet
+	void CollectResults(ID3D11DeviceContext* pContext, FrameProfiler& profiler);
+
+private:
+	enum TIMESTAMP
+	{
+		TIMESTAMP_FRAME_BEGIN,
+		TIMESTAMP_DRAW_BEGIN,
+		TIMESTAMP_DRAW_END,
+		TIMESTAMP_FRAME_END,
+		TIMESTAMP_COUNT,
+	};
+
+	struct QuerySet
+	{
+		ID3D11Query* pDisjoint;
+		ID3D11Query* pPipelineStatistics;
+		ID3D11Query* pTimestamps[TIMESTAMP_COUNT];
+		int Frame;              // -1 if no results are outstanding
+	};
+
+	D3DGpuProfiler(const D3DGpuProfiler&);
+	D3DGpuProfiler& operator=(const D3DGpuProfiler&);
+
+	QuerySet m_QuerySets[FRAME_PROFILER_LATENCY];
+	QuerySet* m_pCurrent;
+	bool m_Created;
+};
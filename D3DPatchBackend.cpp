@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// File: D3DPatchBackend.cpp
+//--------------------------------------------------------------------------------------
+#include "D3DPatchBackend.h"
+#include <windows.h>
+#include <d3d11.h>
+
+
+//--------------------------------------------------------------------------------------
+// D3DPatchBackend
+//--------------------------------------------------------------------------------------
+void* D3DPatchBackend::MapInstances(unsigned int bytes)
+{
+	if (!m_pInstanceBuffer || bytes > m_InstanceBufferBytes)
+		return NULL;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(m_pContext->Map(m_pInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return NULL;
+	return mapped.pData;
+}
+
+void D3DPatchBackend::UnmapInstances()
+{
+	m_pContext->Unmap(m_pInstanceBuffer, 0);
+}
+
+void D3DPatchBackend::DrawIndexedInstanced(unsigned int indexCountPerInstance, unsigned int instanceCount)
+{
+	m_pContext->DrawIndexedInstanced(indexCountPerInstance, instanceCount, 0, 0, 0);
+}
@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// File: D3DPatchBackend.h
+//
+// PatchDrawBackend mapping a dynamic D3D11 instance buffer with discard and drawing
+// with DrawIndexedInstanced on a device context. The shared patch's vertex and index
+// buffers and the instance buffer are bound by the caller.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "PatchInstances.h"
+#include <stddef.h>
+
+struct ID3D11Buffer;
+struct ID3D11DeviceContext;
+
+
+//--------------------------------------------------------------------------------------
+// D3DPatchBackend
+//--------------------------------------------------------------------------------------
+class D3DPatchBackend : public PatchDrawBackend
+{
+public:
+	D3DPatchBackend() : m_pContext(NULL), m_pInstanceBuffer(NULL), m_InstanceBufferBytes(0) {}
+
+	// Neither is referenced
+	void SetContext(ID3D11DeviceContext* pContext) { m_pContext = pContext; }
+	void SetInstanceBuffer(ID3D11Buffer* pInstanceBuffer, unsigned int bytes)
+	{
+		m_pInstanceBuffer = pInstanceBuffer;
+		m_InstanceBufferBytes = bytes;
+	}
+
+	virtual void* MapInstances(unsigned int bytes);
+	virtual void UnmapInstances();
+	virtual void DrawIndexedInstanced(unsigned int indexCountPerInstance, unsigned int instanceCount);
+
+private:
+	ID3D11DeviceContext* m_pContext;
+	ID3D11Buffer* m_pInstanceBuffer;
+	unsigned int m_InstanceBufferBytes;
+};
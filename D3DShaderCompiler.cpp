@@ -0,0 +1,163 @@
+//--------------------------------------------------------------------------------------
+// File: D3DShaderCompiler.cpp
+//--------------------------------------------------------------------------------------
+#include "D3DShaderCompiler.h"
+#include <windows.h>
+#include <d3dcompiler.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#pragma comment(lib, "d3dcompiler.lib")
+
+#define D3D_SHADER_COMPILER_NAME_(version)  "D3DCompiler_" #version
+#define D3D_SHADER_COMPILER_NAME(version)   D3D_SHADER_COMPILER_NAME_(version)
+
+
+//--------------------------------------------------------------------------------------
+// Include handler
+//--------------------------------------------------------------------------------------
+// Whole file, with a terminator so an empty file still has a data pointer
+static bool ReadFileContent(const std::string& fileName, std::vector<char>& content)
+{
+	FILE* pFile = fopen(fileName.c_str(), "rb");
+	if (!pFile)
+		return false;
+
+	content.clear();
+	char buffer[16 * 1024];
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+		content.insert(content.end(), buffer, buffer + size);
+	bool success = ferror(pFile) == 0;
+	fclose(pFile);
+	content.push_back('\0');
+	return success;
+}
+
+static std::string GetDirectory(const std::string& path)
+{
+	size_t separator = path.find_last_of("/\\");
+	return (separator == std::string::npos) ? std::string() : path.substr(0, separator + 1);
+}
+
+// Resolves "" includes relative to the including file and <> includes relative to the
+// root source, and records the path of every opened file
+class RecordingInclude : public ID3DInclude
+{
+public:
+	RecordingInclude(const std::string& rootFileName, const void* pRootData, std::vector<std::string>& includes)
+		: m_RootDirectory(GetDirectory(rootFileName)), m_pIncludes(&includes)
+	{
+		m_Paths[pRootData] = rootFileName;
+	}
+
+	~RecordingInclude()
+	{
+		for (std::map<const void*, std::vector<char>*>::iterator it = m_Buffers.begin(); it != m_Buffers.end(); ++it)
+			delete it->second;
+	}
+
+	STDMETHOD(Open)(D3D_INCLUDE_TYPE includeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes)
+	{
+		std::map<const void*, std::string>::const_iterator parent = m_Paths.find(pParentData);
+		std::string directory = (includeType == D3D_INCLUDE_LOCAL && parent != m_Paths.end()) ? GetDirectory(parent->second) : m_RootDirectory;
+		std::string path = directory + pFileName;
+
+		std::vector<char>* pContent = new std::vector<char>();
+		if (!ReadFileContent(path, *pContent))
+		{
+			delete pContent;
+			return E_FAIL;
+		}
+
+		m_Buffers[pContent->data()] = pContent;
+		m_Paths[pContent->data()] = path;
+		m_pIncludes->push_back(path);
+		*ppData = pContent->data();
+		*pBytes = (UINT)pContent->size() - 1;
+		return S_OK;
+	}
+
+	STDMETHOD(Close)(LPCVOID pData)
+	{
+		std::map<const void*, std::vector<char>*>::iterator it = m_Buffers.find(pData);
+		if (it != m_Buffers.end())
+		{
+			delete it->second;
+			m_Buffers.erase(it);
+		}
+		m_Paths.erase(pData);
+		return S_OK;
+	}
+
+private:
+	std::string m_RootDirectory;
+	std::vector<std::string>* m_pIncludes;
+	std::map<const void*, std::string> m_Paths;
+	std::map<const void*, std::vector<char>*> m_Buffers;
+};
+
+
+//--------------------------------------------------------------------------------------
+// D3DShaderCompiler
+//--------------------------------------------------------------------------------------
+unsigned int D3DShaderCompiler::GetFlags(bool debug)
+{
+	unsigned int flags = D3DCOMPILE_ENABLE_STRICTNESS;
+	if (debug)
+		flags |= D3DCOMPILE_DEBUG;
+	return flags;
+}
+
+const char* D3DShaderCompiler::GetName() const
+{
+	return D3D_SHADER_COMPILER_NAME(D3D_COMPILER_VERSION);
+}
+
+bool D3DShaderCompiler::Compile(const ShaderCompileRequest& request, std::vector<unsigned char>& bytecode,
+	std::vector<std::string>& includes, std::string& errors)
+{
+	std::vector<char> source;
+	if (!ReadFileContent(request.FileName, source))
+	{
+		errors = "Cannot read " + request.FileName + "\n";
+		return false;
+	}
+
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (size_t i = 0; i < request.Defines.size(); i++)
+	{
+		D3D_SHADER_MACRO macro = { request.Defines[i].Name.c_str(), request.Defines[i].Value.c_str() };
+		macros.push_back(macro);
+	}
+	D3D_SHADER_MACRO terminator = { NULL, NULL };
+	macros.push_back(terminator);
+
+	includes.clear();
+	RecordingInclude include(request.FileName, source.data(), includes);
+	ID3DBlob* pCode = NULL;
+	ID3DBlob* pErrors = NULL;
+	HRESULT hr = D3DCompile(source.data(), source.size() - 1, request.FileName.c_str(), macros.data(), &include,
+		request.EntryPoint.c_str(), request.Profile.c_str(), request.Flags, 0, &pCode, &pErrors);
+
+	errors.clear();
+	if (pErrors)
+	{
+		errors = (const char*)pErrors->GetBufferPointer();
+		pErrors->Release();
+	}
+	if (FAILED(hr))
+	{
+		if (pCode) pCode->Release();
+		return false;
+	}
+
+	const unsigned char* pBytes = (const unsigned char*)pCode->GetBufferPointer();
+	bytecode.assign(pBytes, pBytes + pCode->GetBufferSize());
+	pCode->Release();
+
+	// A header included twice only needs to be checked once
+	std::sort(includes.begin(), includes.end());
+	includes.erase(std::unique(includes.begin(), includes.end()), includes.end());
+	return true;
+}
@@ -0,0 +1,24 @@
+//--------------------------------------------------------------------------------------
+// File: D3DShaderCompiler.h
+//
+// ShaderCompiler on top of D3DCompile. Local includes are resolved relative to the
+// including file like the standard file include handler, and every opened file is
+// reported to the shader cache.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "ShaderCache.h"
+
+
+//--------------------------------------------------------------------------------------
+// D3DShaderCompiler
+//--------------------------------------------------------------------------------------
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	// D3DCOMPILE_ENABLE_STRICTNESS, with D3DCOMPILE_DEBUG embedding debug information
+	static unsigned int GetFlags(bool debug);
+
+	virtual const char* GetName() const;
+	virtual bool Compile(const ShaderCompileRequest& request, std::vector<unsigned char>& bytecode,
+		std::vector<std::string>& includes, std::string& errors);
+};
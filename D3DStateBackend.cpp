@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: D3DStateBackend.cpp
+//--------------------------------------------------------------------------------------
+#include "D3DStateBackend.h"
+#include <windows.h>
+#include <d3d11.h>
+
+
+//--------------------------------------------------------------------------------------
+// D3DStateBackend
+//--------------------------------------------------------------------------------------
+void D3DStateBackend::SetShader(SHADER_STAGE stage, void* pShader)
+{
+	switch (stage)
+	{
+	case SHADER_STAGE_VERTEX: m_pContext->VSSetShader((ID3D11VertexShader*)pShader, NULL, 0); break;
+	case SHADER_STAGE_HULL: m_pContext->HSSetShader((ID3D11HullShader*)pShader, NULL, 0); break;
+	case SHADER_STAGE_DOMAIN: m_pContext->DSSetShader((ID3D11DomainShader*)pShader, NULL, 0); break;
+	case SHADER_STAGE_PIXEL: m_pContext->PSSetShader((ID3D11PixelShader*)pShader, NULL, 0); break;
+	default: break;
+	}
+}
+
+void D3DStateBackend::SetConstantBuffers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppBuffers)
+{
+	ID3D11Buffer* const* ppD3DBuffers = (ID3D11Buffer* const*)ppBuffers;
+	switch (stage)
+	{
+	case SHADER_STAGE_VERTEX: m_pContext->VSSetConstantBuffers(startSlot, count, ppD3DBuffers); break;
+	case SHADER_STAGE_HULL: m_pContext->HSSetConstantBuffers(startSlot, count, ppD3DBuffers); break;
+	case SHADER_STAGE_DOMAIN: m_pContext->DSSetConstantBuffers(startSlot, count, ppD3DBuffers); break;
+	case SHADER_STAGE_PIXEL: m_pContext->PSSetConstantBuffers(startSlot, count, ppD3DBuffers); break;
+	default: break;
+	}
+}
+
+void D3DStateBackend::SetShaderResources(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppViews)
+{
+	ID3D11ShaderResourceView* const* ppD3DViews = (ID3D11ShaderResourceView* const*)ppViews;
+	switch (stage)
+	{
+	case SHADER_STAGE_VERTEX: m_pContext->VSSetShaderResources(startSlot, count, ppD3DViews); break;
+	case SHADER_STAGE_HULL: m_pContext->HSSetShaderResources(startSlot, count, ppD3DViews); break;
+	case SHADER_STAGE_DOMAIN: m_pContext->DSSetShaderResources(startSlot, count, ppD3DViews); break;
+	case SHADER_STAGE_PIXEL: m_pContext->PSSetShaderResources(startSlot, count, ppD3DViews); break;
+	default: break;
+	}
+}
+
+void D3DStateBackend::SetSamplers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppSamplers)
+{
+	ID3D11SamplerState* const* ppD3DSamplers = (ID3D11SamplerState* const*)ppSamplers;
+	switch (stage)
+	{
+	case SHADER_STAGE_VERTEX: m_pContext->VSSetSamplers(startSlot, count, ppD3DSamplers); break;
+	case SHADER_STAGE_HULL: m_pContext->HSSetSamplers(startSlot, count, ppD3DSamplers); break;
+	case SHADER_STAGE_DOMAIN: m_pContext->DSSetSamplers(startSlot, count, ppD3DSamplers); break;
+	case SHADER_STAGE_PIXEL: m_pContext->PSSetSamplers(startSlot, count, ppD3DSamplers); break;
+	default: break;
+	}
+}
@@ -0,0 +1,32 @@
+//--------------------------------------------------------------------------------------
+// File: D3DStateBackend.h
+//
+// StateBackend forwarding to the *SetShader, *SetConstantBuffers, *SetShaderResources
+// and *SetSamplers calls of a D3D11 device context.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "StateTracker.h"
+#include <stddef.h>
+
+struct ID3D11DeviceContext;
+
+
+//--------------------------------------------------------------------------------------
+// D3DStateBackend
+//--------------------------------------------------------------------------------------
+class D3DStateBackend : public StateBackend
+{
+public:
+	D3DStateBackend() : m_pContext(NULL) {}
+
+	// The context is not referenced
+	void SetContext(ID3D11DeviceContext* pContext) { m_pContext = pContext; }
+
+	virtual void SetShader(SHADER_STAGE stage, void* pShader);
+	virtual void SetConstantBuffers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppBuffers);
+	virtual void SetShaderResources(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppViews);
+	virtual void SetSamplers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppSamplers);
+
+private:
+	ID3D11DeviceContext* m_pContext;
+};
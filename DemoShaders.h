@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// File: DemoShaders.h
+//
+// The shaders InitDevice creates, shared with the precompile step of AssetCooker so both
+// produce the same shader cache keys.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define SHADER_CACHE_DIRECTORY  "Shaders/Cache"
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum DEMO_SHADER
+{
+	DEMO_SHADER_VS,
+	DEMO_SHADER_HS,
+	DEMO_SHADER_DS,
+	DEMO_SHADER_PS,
+	DEMO_SHADER_SOLID_PS,
+	DEMO_SHADER_QUAD_HS,
+	DEMO_SHADER_QUAD_DS,
+	DEMO_SHADER_QUADTREE_VS,
+	DEMO_SHADER_QUADTREE_HS,
+	DEMO_SHADER_QUADTREE_DS,
+	DEMO_SHADER_BAKED_VS,
+	DEMO_SHADER_CACHE_VS,
+	DEMO_SHADER_CACHE_HS,
+	DEMO_SHADER_CACHE_QUAD_HS,
+	DEMO_SHADER_CACHE_DS,
+	DEMO_SHADER_CACHE_QUAD_DS,
+	DEMO_SHADER_CACHE_GS,
+	DEMO_SHADER_CACHED_VS,
+	DEMO_SHADER_COUNT,
+};
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct DemoShaderDesc
+{
+	const char* FileName;
+	const char* EntryPoint;
+	const char* Profile;
+};
+
+static const DemoShaderDesc g_DemoShaders[DEMO_SHADER_COUNT] =
+{
+	{ "Shaders/DisplacedAndShaded.hlsl", "VS", "vs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "HS", "hs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "DS", "ds_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "PS", "ps_4_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "SolidPS", "ps_4_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "QuadHS", "hs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "QuadDS", "ds_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "QuadtreeVS", "vs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "QuadtreeHS", "hs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "QuadtreeDS", "ds_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "BakedVS", "vs_4_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "CacheVS", "vs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "CacheHS", "hs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "CacheQuadHS", "hs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "CacheDS", "ds_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "CacheQuadDS", "ds_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "CacheGS", "gs_5_0" },
+	{ "Shaders/DisplacedAndShaded.hlsl", "CachedVS", "vs_5_0" },
+};
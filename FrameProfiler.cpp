@@ -0,0 +1,303 @@
+//--------------------------------------------------------------------------------------
+// File: FrameProfiler.cpp
+//--------------------------------------------------------------------------------------
+#include "FrameProfiler.h"
+#include <stdio.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+static const char* s_FrameMetricNames[FRAME_METRIC_COUNT] =
+{
+	"frame_ms",
+	"cpu_total_ms",
+	"cpu_camera_ms",
+	"cpu_cull_ms",
+	"cpu_constants_ms",
+	"cpu_bind_ms",
+	"cpu_draw_ms",
+	"cpu_present_ms",
+	"triangles",
+	"gpu_frame_ms",
+	"gpu_draw_ms",
+	"hs_invocations",
+	"ds_invocations",
+	"primitives",
+};
+
+
+//--------------------------------------------------------------------------------------
+// FrameRecord
+//--------------------------------------------------------------------------------------
+FrameRecord::FrameRecord()
+	: Frame(-1)
+	, FrameSeconds(0.0)
+	, Triangles(-1)
+{
+	for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+		CpuSeconds[stage] = 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// FrameRecordRing
+//--------------------------------------------------------------------------------------
+FrameRecordRing::FrameRecordRing(unsigned int capacity)
+	: m_Tail(0)
+	, m_Head(0)
+	, m_Dropped(0)
+{
+	unsigned int size = 1;
+	while (size < capacity)
+		size *= 2;
+	m_Records.resize(size);
+	m_Mask = size - 1;
+}
+
+bool FrameRecordRing::Push(const FrameRecord& record)
+{
+	unsigned int tail = m_Tail.load(std::memory_order_relaxed);
+	unsigned int head = m_Head.load(std::memory_order_acquire);
+	if (tail - head == (unsigned int)m_Records.size())
+	{
+		m_Dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	m_Records[tail & m_Mask] = record;
+	m_Tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool FrameRecordRing::Pop(FrameRecord& record)
+{
+	unsigned int head = m_Head.load(std::memory_order_relaxed);
+	unsigned int tail = m_Tail.load(std::memory_order_acquire);
+	if (head == tail)
+		return false;
+	record = m_Records[head & m_Mask];
+	m_Head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// FrameProfiler
+//--------------------------------------------------------------------------------------
+FrameProfiler::FrameProfiler(FrameRecordRing* pRing)
+	: m_pRing(pRing)
+	, m_OldestWaiting(0)
+	, m_NextFrame(0)
+{
+}
+
+void FrameProfiler::BeginFrame(double frameSeconds)
+{
+	m_Current = FrameRecord();
+	m_Current.Frame = m_NextFrame;
+	m_Current.FrameSeconds = frameSeconds;
+}
+
+void FrameProfiler::AddCpuTime(FRAME_STAGE stage, double seconds)
+{
+	m_Current.CpuSeconds[stage] += seconds;
+}
+
+int FrameProfiler::EndFrame()
+{
+	if (m_NextFrame - m_OldestWaiting == FRAME_PROFILER_LATENCY)
+	{
+		m_pRing->Push(m_Waiting[m_OldestWaiting % FRAME_PROFILER_LATENCY]);
+		m_OldestWaiting++;
+	}
+	m_Waiting[m_NextFrame % FRAME_PROFILER_LATENCY] = m_Current;
+	return m_NextFrame++;
+}
+
+bool FrameProfiler::SetGpuData(int frame, const FrameGpuData& data)
+{
+	if (frame < m_OldestWaiting || frame >= m_NextFrame)
+		return false;
+
+	for (; m_OldestWaiting < frame; m_OldestWaiting++)
+		m_pRing->Push(m_Waiting[m_OldestWaiting % FRAME_PROFILER_LATENCY]);
+
+	FrameRecord& record = m_Waiting[frame % FRAME_PROFILER_LATENCY];
+	record.Gpu = data;
+	m_pRing->Push(record);
+	m_OldestWaiting = frame + 1;
+	return true;
+}
+
+void FrameProfiler::Flush()
+{
+	for (; m_OldestWaiting < m_NextFrame; m_OldestWaiting++)
+		m_pRing->Push(m_Waiting[m_OldestWaiting % FRAME_PROFILER_LATENCY]);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Statistics and export
+//--------------------------------------------------------------------------------------
+const char* GetFrameMetricName(FRAME_METRIC metric)
+{
+	return (metric >= 0 && metric < FRAME_METRIC_COUNT) ? s_FrameMetricNames[metric] : "unknown";
+}
+
+bool GetFrameMetric(const FrameRecord& record, FRAME_METRIC metric, double& value)
+{
+	switch (metric)
+	{
+	case FRAME_METRIC_FRAME_TIME:
+		value = record.FrameSeconds * 1000.0;
+		return true;
+	case FRAME_METRIC_CPU_TOTAL:
+		value = 0.0;
+		for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+			value += record.CpuSeconds[stage] * 1000.0;
+		return true;
+	case FRAME_METRIC_CPU_CAMERA:
+	case FRAME_METRIC_CPU_CULL:
+	case FRAME_METRIC_CPU_CONSTANTS:
+	case FRAME_METRIC_CPU_BIND:
+	case FRAME_METRIC_CPU_DRAW:
+	case FRAME_METRIC_CPU_PRESENT:
+		value = record.CpuSeconds[FRAME_STAGE_CAMERA + (metric - FRAME_METRIC_CPU_CAMERA)] * 1000.0;
+		return true;
+	case FRAME_METRIC_TRIANGLES:
+		value = (double)record.Triangles;
+		return record.Triangles >= 0;
+	case FRAME_METRIC_GPU_FRAME:
+		value = record.Gpu.FrameSeconds * 1000.0;
+		return record.Gpu.FrameSeconds >= 0.0;
+	case FRAME_METRIC_GPU_DRAW:
+		value = record.Gpu.DrawSeconds * 1000.0;
+		return record.Gpu.DrawSeconds >= 0.0;
+	case FRAME_METRIC_HULL_INVOCATIONS:
+		value = (double)record.Gpu.HullInvocations;
+		return record.Gpu.HullInvocations >= 0;
+	case FRAME_METRIC_DOMAIN_INVOCATIONS:
+		value = (double)record.Gpu.DomainInvocations;
+		return record.Gpu.DomainInvocations >= 0;
+	case FRAME_METRIC_PRIMITIVES:
+		value = (double)record.Gpu.Primitives;
+		return record.Gpu.Primitives >= 0;
+	default:
+		return false;
+	}
+}
+
+// Smallest value with at least percent of the values at or below it
+static double NearestRank(const std::vector<double>& sortedValues, int percent)
+{
+	size_t rank = (percent * sortedValues.size() + 99) / 100;
+	return sortedValues[std::max(rank, (size_t)1) - 1];
+}
+
+bool SummarizeFrameMetric(const std::vector<FrameRecord>& records, FRAME_METRIC metric, FrameMetricSummary& summary)
+{
+	std::vector<double> values;
+	values.reserve(records.size());
+	double sum = 0.0;
+	for (size_t r = 0; r < records.size(); r++)
+	{
+		double value;
+		if (!GetFrameMetric(records[r], metric, value))
+			continue;
+		values.push_back(value);
+		sum += value;
+	}
+
+	summary = FrameMetricSummary();
+	if (values.empty())
+		return false;
+
+	std::sort(values.begin(), values.end());
+	summary.Count = (int)values.size();
+	summary.Mean = sum / values.size();
+	summary.Min = values.front();
+	summary.Max = values.back();
+	summary.P50 = NearestRank(values, 50);
+	summary.P95 = NearestRank(values, 95);
+	summary.P99 = NearestRank(values, 99);
+	return true;
+}
+
+std::string FormatFrameSummary(const std::vector<FrameRecord>& records)
+{
+	std::string report;
+	char line[256];
+	for (int metric = 0; metric < FRAME_METRIC_COUNT; metric++)
+	{
+		FrameMetricSummary summary;
+		if (!SummarizeFrameMetric(records, (FRAME_METRIC)metric, summary))
+			continue;
+		sprintf(line, "  %-18s %6d frames  mean %12.3f  p50 %12.3f  p95 %12.3f  p99 %12.3f\n", s_FrameMetricNames[metric],
+			summary.Count, summary.Mean, summary.P50, summary.P95, summary.P99);
+		report += line;
+	}
+	return report;
+}
+
+bool WriteFrameRecordsCsv(const char* pFileName, const std::vector<FrameRecord>& records)
+{
+	FILE* pFile = fopen(pFileName, "w");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "frame");
+	for (int metric = 0; metric < FRAME_METRIC_COUNT; metric++)
+		fprintf(pFile, ",%s", s_FrameMetricNames[metric]);
+	fprintf(pFile, "\n");
+
+	for (size_t r = 0; r < records.size(); r++)
+	{
+		fprintf(pFile, "%d", records[r].Frame);
+		for (int metric = 0; metric < FRAME_METRIC_COUNT; metric++)
+		{
+			double value;
+			if (GetFrameMetric(records[r], (FRAME_METRIC)metric, value))
+				fprintf(pFile, ",%.6g", value);
+			else
+				fprintf(pFile, ",");
+		}
+		fprintf(pFile, "\n");
+	}
+
+	bool succeeded = !ferror(pFile);
+	return fclose(pFile) == 0 && succeeded;
+}
+
+std::string FormatFrameSummaryJson(const std::vector<FrameRecord>& records, const char* pIndent)
+{
+	std::string json = "{";
+	char line[512];
+	for (int metric = 0; metric < FRAME_METRIC_COUNT; metric++)
+	{
+		FrameMetricSummary summary;
+		if (!SummarizeFrameMetric(records, (FRAME_METRIC)metric, summary))
+			continue;
+		sprintf(line, "%s\n%s  \"%s\": { \"count\": %d, \"mean\": %.6g, \"min\": %.6g, \"max\": %.6g, "
+			"\"p50\": %.6g, \"p95\": %.6g, \"p99\": %.6g }", json.size() > 1 ? "," : "", pIndent, s_FrameMetricNames[metric],
+			summary.Count, summary.Mean, summary.Min, summary.Max, summary.P50, summary.P95, summary.P99);
+		json += line;
+	}
+	json += "\n";
+	json += pIndent;
+	json += "}";
+	return json;
+}
+
+bool WriteFrameSummaryJson(const char* pFileName, const std::vector<FrameRecord>& records)
+{
+	FILE* pFile = fopen(pFileName, "w");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "{\n  \"frames\": %d,\n  \"metrics\": %s\n}\n", (int)records.size(),
+		FormatFrameSummaryJson(records, "  ").c_str());
+
+	bool succeeded = !ferror(pFile);
+	return fclose(pFile) == 0 && succeeded;
+}
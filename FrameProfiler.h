@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------------------
+// File: FrameProfiler.h
+//
+// Per-frame CPU and GPU timings. Render measures its stages with scoped CPU timers,
+// D3DGpuProfiler delivers the GPU timestamps and pipeline statistics of a frame a few
+// frames later, and the profiler merges both into one FrameRecord. Finished records go
+// into a lock-free single producer, single consumer ring, so they can be drained by a
+// different thread than the one rendering. Summaries and the CSV/JSON export work on
+// plain record arrays and need no device.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "Timer.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Frames that can wait for their GPU data. Older frames are recorded without it.
+#define FRAME_PROFILER_LATENCY 4
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum FRAME_STAGE
+{
+	FRAME_STAGE_CAMERA,         // camera update
+	FRAME_STAGE_CULL,           // patch culling and index upload
+	FRAME_STAGE_CONSTANTS,      // constant buffer upload
+	FRAME_STAGE_BIND,           // shader and resource binds
+	FRAME_STAGE_DRAW,           // draw submission
+	FRAME_STAGE_PRESENT,
+	FRAME_STAGE_COUNT,
+};
+
+// Values summarized and exported per frame, times are in milliseconds
+enum FRAME_METRIC
+{
+	FRAME_METRIC_FRAME_TIME,
+	FRAME_METRIC_CPU_TOTAL,
+	FRAME_METRIC_CPU_CAMERA,
+	FRAME_METRIC_CPU_CULL,
+	FRAME_METRIC_CPU_CONSTANTS,
+	FRAME_METRIC_CPU_BIND,
+	FRAME_METRIC_CPU_DRAW,
+	FRAME_METRIC_CPU_PRESENT,
+	FRAME_METRIC_TRIANGLES,
+	FRAME_METRIC_GPU_FRAME,
+	FRAME_METRIC_GPU_DRAW,
+	FRAME_METRIC_HULL_INVOCATIONS,
+	FRAME_METRIC_DOMAIN_INVOCATIONS,
+	FRAME_METRIC_PRIMITIVES,
+	FRAME_METRIC_COUNT,
+};
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Negative values are not available, e.g. timestamps of a disjoint frame
+struct FrameGpuData
+{
+	double FrameSeconds = -1.0;
+	double DrawSeconds = -1.0;
+	long long HullInvocations = -1;
+	long long DomainInvocations = -1;
+	long long Primitives = -1;      // primitives sent to the rasterizer
+};
+
+struct FrameRecord
+{
+	FrameRecord();
+
+	int Frame;
+	double FrameSeconds;            // time since the previous frame started
+	double CpuSeconds[FRAME_STAGE_COUNT];
+	long long Triangles;            // counted on the CPU, negative if not counted
+	FrameGpuData Gpu;
+};
+
+// Nearest-rank percentiles of the frames the metric is available for
+struct FrameMetricSummary
+{
+	int Count = 0;
+	double Mean = 0.0;
+	double Min = 0.0;
+	double Max = 0.0;
+	double P50 = 0.0;
+	double P95 = 0.0;
+	double P99 = 0.0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// FrameRecordRing
+//--------------------------------------------------------------------------------------
+class FrameRecordRing
+{
+public:
+	// The capacity is rounded up to a power of two
+	FrameRecordRing(unsigned int capacity = 1024);
+
+	// Producer side, returns false and counts the record as dropped if the ring is full
+	bool Push(const FrameRecord& record);
+
+	// Consumer side, returns false if the ring is empty
+	bool Pop(FrameRecord& record);
+
+	unsigned int GetCapacity() const { return (unsigned int)m_Records.size(); }
+	unsigned int GetDroppedCount() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+private:
+	FrameRecordRing(const FrameRecordRing&);
+	FrameRecordRing& operator=(const FrameRecordRing&);
+
+	std::vector<FrameRecord> m_Records;
+	unsigned int m_Mask;
+	// Free-running counts of pushed and popped records, on separate cache lines since
+	// each one is written by a different thread
+	char m_Padding0[64];
+	std::atomic<unsigned int> m_Tail;
+	char m_Padding1[64];
+	std::atomic<unsigned int> m_Head;
+	char m_Padding2[64];
+	std::atomic<unsigned int> m_Dropped;
+};
+
+
+//--------------------------------------------------------------------------------------
+// FrameProfiler
+//--------------------------------------------------------------------------------------
+class FrameProfiler
+{
+public:
+	// Finished frames are pushed to the ring, which has to outlive the profiler
+	FrameProfiler(FrameRecordRing* pRing);
+
+	// Starts a frame, frameSeconds is the clock delta since the previous one
+	void BeginFrame(double frameSeconds);
+	void AddCpuTime(FRAME_STAGE stage, double seconds);
+	void SetTriangleCount(long long triangles) { m_Current.Triangles = triangles; }
+	int GetCurrentFrame() const { return m_Current.Frame; }
+
+	// Ends the frame and returns its number for SetGpuData. If FRAME_PROFILER_LATENCY
+	// frames are waiting for GPU data, the oldest is recorded without it.
+	int EndFrame();
+
+	// GPU results arrive in frame order, so frames older than the given one that are
+	// still waiting are recorded without GPU data. Returns false if the frame was
+	// already recorded.
+	bool SetGpuData(int frame, const FrameGpuData& data);
+
+	// Records every waiting frame without GPU data
+	void Flush();
+
+private:
+	FrameRecordRing* m_pRing;
+	FrameRecord m_Current;
+	FrameRecord m_Waiting[FRAME_PROFILER_LATENCY];
+	int m_OldestWaiting;        // waiting frames are m_OldestWaiting to m_NextFrame - 1
+	int m_NextFrame;
+};
+
+
+//--------------------------------------------------------------------------------------
+// ScopedCpuTimer, adds the time until it goes out of scope to a stage
+//--------------------------------------------------------------------------------------
+class ScopedCpuTimer
+{
+public:
+	ScopedCpuTimer(FrameProfiler& profiler, FRAME_STAGE stage)
+		: m_Profiler(profiler), m_Stage(stage), m_Start(GetTimeSeconds()) {}
+	~ScopedCpuTimer() { m_Profiler.AddCpuTime(m_Stage, GetTimeSeconds() - m_Start); }
+
+private:
+	ScopedCpuTimer(const ScopedCpuTimer&);
+	ScopedCpuTimer& operator=(const ScopedCpuTimer&);
+
+	FrameProfiler& m_Profiler;
+	FRAME_STAGE m_Stage;
+	double m_Start;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Statistics and export
+//--------------------------------------------------------------------------------------
+// Column name in the CSV and key in the JSON, e.g. "frame_ms"
+const char* GetFrameMetricName(FRAME_METRIC metric);
+
+// Returns false if the value is not available for the frame
+bool GetFrameMetric(const FrameRecord& record, FRAME_METRIC metric, double& value);
+
+// Returns false if no frame has the metric
+bool SummarizeFrameMetric(const std::vector<FrameRecord>& records, FRAME_METRIC metric, FrameMetricSummary& summary);
+
+// One line per metric with frames, mean and p50/p95/p99, for logs
+std::string FormatFrameSummary(const std::vector<FrameRecord>& records);
+
+// One row per frame, unavailable values are left empty
+bool WriteFrameRecordsCsv(const char* pFileName, const std::vector<FrameRecord>& records);
+
+// JSON object with the summary of every available metric, nested lines start with pIndent
+std::string FormatFrameSummaryJson(const std::vector<FrameRecord>& records, const char* pIndent);
+
+// Frame count and the summary of every metric
+bool WriteFrameSummaryJson(const char* pFileName, const std::vector<FrameRecord>& records);
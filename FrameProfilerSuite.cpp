@@ -0,0 +1,223 @@
+//--------------------------------------------------------------------------------------
+// File: FrameProfilerSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "FrameProfiler.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Frame profiler
+//--------------------------------------------------------------------------------------
+bool ReadTextLines(const char* pFileName, std::vector<std::string>& lines)
+{
+	FILE* pFile = fopen(pFileName, "r");
+	if (!pFile)
+		return false;
+	lines.clear();
+	char line[1024];
+	while (fgets(line, sizeof(line), pFile))
+	{
+		size_t length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+			line[--length] = 0;
+		lines.push_back(line);
+	}
+	fclose(pFile);
+	return true;
+}
+
+int VerifyFrameProfiler()
+{
+	const char* pCsvFile = "ProfilerBenchmark.csv";
+	const char* pJsonFile = "ProfilerBenchmark.json";
+	SuiteCheck check("profiler");
+
+	// A producer and a consumer thread on a small ring, every record arrives in order or
+	// is counted as dropped
+	{
+		FrameRecordRing ring(60);
+		const int records = 200000;
+		std::atomic<bool> producerDone(false);
+		std::thread producer([&]()
+		{
+			for (int i = 0; i < records; i++)
+			{
+				FrameRecord record;
+				record.Frame = i;
+				record.FrameSeconds = i * 0.5;
+				ring.Push(record);
+			}
+			producerDone = true;
+		});
+		int popped = 0, lastFrame = -1, orderErrors = 0;
+		for (;;)
+		{
+			bool done = producerDone;
+			FrameRecord record;
+			while (ring.Pop(record))
+			{
+				if (record.Frame <= lastFrame || record.FrameSeconds != record.Frame * 0.5)
+					orderErrors++;
+				lastFrame = record.Frame;
+				popped++;
+			}
+			if (done)
+				break;
+		}
+		producer.join();
+		check.FailIf(ring.GetCapacity() != 64 || orderErrors != 0 || popped + (int)ring.GetDroppedCount() != records,
+			"ring popped %d and dropped %u of %d records, %d out of order", popped, ring.GetDroppedCount(), records,
+			orderErrors);
+	}
+
+	// GPU data two frames late, never for every 7th frame and too late for frame 50. Every
+	// frame is recorded once, in order, with GPU data exactly when it arrived in time.
+	{
+		FrameRecordRing ring(256);
+		FrameProfiler profiler(&ring);
+		const int frames = 100;
+		bool lateAccepted = false;
+		for (int f = 0; f < frames; f++)
+		{
+			profiler.BeginFrame(0.016);
+			{
+				ScopedCpuTimer timer(profiler, FRAME_STAGE_BIND);
+			}
+			profiler.AddCpuTime(FRAME_STAGE_DRAW, 0.001);
+			profiler.AddCpuTime(FRAME_STAGE_DRAW, 0.002);
+			if (profiler.EndFrame() != f)
+				lateAccepted = true;
+
+			int gpuFrame = f - 2;
+			if (gpuFrame >= 0 && gpuFrame % 7 != 0 && gpuFrame != 50)
+			{
+				FrameGpuData data;
+				data.FrameSeconds = 0.010;
+				data.HullInvocations = gpuFrame;
+				lateAccepted = !profiler.SetGpuData(gpuFrame, data) || lateAccepted;
+			}
+			if (f == 50 + FRAME_PROFILER_LATENCY + 1)
+				lateAccepted = profiler.SetGpuData(50, FrameGpuData()) || lateAccepted;
+		}
+		profiler.Flush();
+
+		int recorded = 0, errors = 0;
+		FrameRecord record;
+		while (ring.Pop(record))
+		{
+			bool expectGpu = record.Frame < frames - 2 && record.Frame % 7 != 0 && record.Frame != 50;
+			bool hasGpu = record.Gpu.FrameSeconds >= 0.0;
+			if (record.Frame != recorded || hasGpu != expectGpu || (hasGpu && record.Gpu.HullInvocations != record.Frame) ||
+				fabs(record.CpuSeconds[FRAME_STAGE_DRAW] - 0.003) > 1e-12 || record.FrameSeconds != 0.016)
+				errors++;
+			recorded++;
+		}
+		check.FailIf(lateAccepted || recorded != frames || errors != 0, "%d of %d frames recorded, %d wrong%s",
+			recorded, frames, errors, lateAccepted ? ", GPU data was accepted or rejected wrongly" : "");
+	}
+
+	// Nearest-rank percentiles of 1..100 in shuffled order, metrics missing on some
+	// frames are left out
+	std::vector<FrameRecord> records(100);
+	unsigned int seed = 11;
+	for (int i = 0; i < 100; i++)
+	{
+		records[i].Frame = i;
+		records[i].FrameSeconds = (i + 1) / 1000.0;
+		if (i % 4 == 0)
+			records[i].Gpu.Primitives = i;
+	}
+	for (int i = 99; i > 0; i--)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		std::swap(records[i].FrameSeconds, records[(seed >> 8) % (i + 1)].FrameSeconds);
+	}
+	FrameMetricSummary summary;
+	check.FailIf(!SummarizeFrameMetric(records, FRAME_METRIC_FRAME_TIME, summary) || summary.Count != 100 ||
+		fabs(summary.Mean - 50.5) > 1e-9 || fabs(summary.Min - 1.0) > 1e-9 || fabs(summary.Max - 100.0) > 1e-9 ||
+		fabs(summary.P50 - 50.0) > 1e-9 || fabs(summary.P95 - 95.0) > 1e-9 || fabs(summary.P99 - 99.0) > 1e-9,
+		"frame time p50 %.3f p95 %.3f p99 %.3f mean %.3f", summary.P50, summary.P95, summary.P99, summary.Mean);
+	check.FailIf(!SummarizeFrameMetric(records, FRAME_METRIC_PRIMITIVES, summary) || summary.Count != 25 ||
+		summary.Max != 96.0 || summary.P50 != 48.0 || SummarizeFrameMetric(records, FRAME_METRIC_GPU_DRAW, summary) ||
+		summary.Count != 0, "summary of partially available metrics");
+
+	// CSV has a header and one row per frame with empty unavailable values, the JSON
+	// summary only lists the available metrics
+	std::vector<std::string> lines;
+	check.FailIf(!WriteFrameRecordsCsv(pCsvFile, records) || !ReadTextLines(pCsvFile, lines) || lines.size() != 101 ||
+		lines[0].compare(0, 15, "frame,frame_ms,") != 0 || lines[2].compare(0, 2, "1,") != 0 ||
+		lines[2].substr(lines[2].size() - 3) != ",,," || lines[1].substr(lines[1].size() - 4) != ",,,0", "CSV export");
+	std::string json;
+	if (WriteFrameSummaryJson(pJsonFile, records) && ReadTextLines(pJsonFile, lines))
+	{
+		for (size_t i = 0; i < lines.size(); i++)
+			json += lines[i];
+	}
+	check.FailIf(json.find("\"frames\": 100") == std::string::npos ||
+		json.find("\"frame_ms\": { \"count\": 100, \"mean\": 50.5, \"min\": 1, \"max\": 100, \"p50\": 50, \"p95\": 95, \"p99\": 99 }") == std::string::npos ||
+		json.find("\"primitives\": { \"count\": 25") == std::string::npos ||
+		json.find("gpu_draw_ms") != std::string::npos, "JSON export");
+	remove(pCsvFile);
+	remove(pJsonFile);
+
+	// The scoped timer and the frame clock measure a sleep
+	FrameRecordRing timerRing;
+	FrameProfiler timerProfiler(&timerRing);
+	FrameClock clock;
+	double firstTick = clock.Tick();
+	timerProfiler.BeginFrame(firstTick);
+	{
+		ScopedCpuTimer timer(timerProfiler, FRAME_STAGE_PRESENT);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	double tick = clock.Tick();
+	timerProfiler.EndFrame();
+	timerProfiler.Flush();
+	FrameRecord timed;
+	check.FailIf(firstTick != 0.0 || !timerRing.Pop(timed) || timed.CpuSeconds[FRAME_STAGE_PRESENT] < 0.019 ||
+		timed.CpuSeconds[FRAME_STAGE_PRESENT] > 1.0 || tick < timed.CpuSeconds[FRAME_STAGE_PRESENT],
+		"timed a 20 ms sleep as %.3f ms, clock %.3f ms", timed.CpuSeconds[FRAME_STAGE_PRESENT] * 1000.0, tick * 1000.0);
+
+	return check.Finish();
+}
+
+void RunFrameProfilerThroughput()
+{
+	FrameRecordRing ring(1024);
+	FrameProfiler profiler(&ring);
+	const int frames = 1000000;
+	std::vector<FrameRecord> records;
+	records.reserve(frames);
+	double start = GetTimeSeconds();
+	for (int f = 0; f < frames; f++)
+	{
+		profiler.BeginFrame(0.016);
+		for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+			profiler.AddCpuTime((FRAME_STAGE)stage, (f % 97) * 1e-5);
+		profiler.EndFrame();
+		FrameGpuData data;
+		data.FrameSeconds = (f % 89) * 1e-4;
+		if (f >= 2)
+			profiler.SetGpuData(f - 2, data);
+		FrameRecord record;
+		while (ring.Pop(record))
+			records.push_back(record);
+	}
+	double seconds = GetTimeSeconds() - start;
+	printf("profiler record  %8.1f ns per frame\n", seconds * 1e9 / frames);
+
+	start = GetTimeSeconds();
+	FrameMetricSummary summary;
+	SummarizeFrameMetric(records, FRAME_METRIC_CPU_TOTAL, summary);
+	seconds = GetTimeSeconds() - start;
+	printf("profiler summary %8.1f ms for %d frames  (p99 %.3f ms)\n", seconds * 1000.0, summary.Count, summary.P99);
+}
@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------------
+// File: FrustumCulling.cpp
+//--------------------------------------------------------------------------------------
+#include "FrustumCulling.h"
+#include "SimdUtil.h"
+#include <math.h>
+
+
+//--------------------------------------------------------------------------------------
+// Plane extraction (Gribb/Hartmann)
+//--------------------------------------------------------------------------------------
+void ExtractFrustumPlanes(const float m[4][4], Frustum& frustum)
+{
+	for (int r = 0; r < 4; r++)
+	{
+		float col0 = m[r][0], col1 = m[r][1], col2 = m[r][2], col3 = m[r][3];
+		frustum.Planes[0][r] = col3 + col0;     // left
+		frustum.Planes[1][r] = col3 - col0;     // right
+		frustum.Planes[2][r] = col3 + col1;     // bottom
+		frustum.Planes[3][r] = col3 - col1;     // top
+		frustum.Planes[4][r] = col2;            // near
+		frustum.Planes[5][r] = col3 - col2;     // far
+	}
+
+	for (int p = 0; p < 6; p++)
+	{
+		float* plane = frustum.Planes[p];
+		float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f)
+		{
+			float invLength = 1.0f / length;
+			for (int c = 0; c < 4; c++)
+				plane[c] *= invLength;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Box tests. A box is outside if it is completely behind any plane:
+// dot(n, center) + d + dot(|n|, extent) < 0
+//--------------------------------------------------------------------------------------
+bool IsBoxVisible(const Frustum& frustum, const float center[3], const float extent[3])
+{
+	for (int p = 0; p < 6; p++)
+	{
+		const float* plane = frustum.Planes[p];
+		float distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+		float radius = fabsf(plane[0]) * extent[0] + fabsf(plane[1]) * extent[1] + fabsf(plane[2]) * extent[2];
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+int CullBoxes(const Frustum& frustum, const BoundsSoA& bounds, int count, int* pVisibleIndices)
+{
+	int numVisible = 0;
+	int i = 0;
+#if TESS_USE_SSE2
+	__m128 planeN[6][3], planeAbsN[6][3], planeD[6];
+	for (int p = 0; p < 6; p++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			planeN[p][c] = _mm_set1_ps(frustum.Planes[p][c]);
+			planeAbsN[p][c] = _mm_set1_ps(fabsf(frustum.Planes[p][c]));
+		}
+		planeD[p] = _mm_set1_ps(frustum.Planes[p][3]);
+	}
+
+	const __m128 vZero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&bounds.CenterX[i]);
+		__m128 cy = _mm_loadu_ps(&bounds.CenterY[i]);
+		__m128 cz = _mm_loadu_ps(&bounds.CenterZ[i]);
+		__m128 ex = _mm_loadu_ps(&bounds.ExtentX[i]);
+		__m128 ey = _mm_loadu_ps(&bounds.ExtentY[i]);
+		__m128 ez = _mm_loadu_ps(&bounds.ExtentZ[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeN[p][0], cx), _mm_mul_ps(planeN[p][1], cy)),
+				_mm_add_ps(_mm_mul_ps(planeN[p][2], cz), planeD[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeAbsN[p][0], ex), _mm_mul_ps(planeAbsN[p][1], ey)),
+				_mm_mul_ps(planeAbsN[p][2], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), vZero));
+		}
+
+		// Compact the visible lanes into the output list
+		int mask = ~_mm_movemask_ps(outside) & 0xf;
+		while (mask)
+		{
+			int lane = (mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3;
+			pVisibleIndices[numVisible++] = i + lane;
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float center[3] = { bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i] };
+		float extent[3] = { bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i] };
+		if (IsBoxVisible(frustum, center, extent))
+			pVisibleIndices[numVisible++] = i;
+	}
+	return numVisible;
+}
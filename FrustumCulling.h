@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// File: FrustumCulling.h
+//
+// View frustum culling of axis aligned bounding boxes. Boxes are stored in SoA layout
+// so four of them are tested against a plane per SSE2 instruction.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Planes are (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside, normalized
+struct Frustum
+{
+	float Planes[6][4];
+};
+
+struct BoundsSoA
+{
+	const float* CenterX;
+	const float* CenterY;
+	const float* CenterZ;
+	const float* ExtentX;
+	const float* ExtentY;
+	const float* ExtentZ;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Extracts the planes from a row-vector view-projection matrix (XMFLOAT4X4 layout,
+// D3D clip space with 0 <= z <= w)
+void ExtractFrustumPlanes(const float viewProjection[4][4], Frustum& frustum);
+
+// Writes the indices of the boxes intersecting the frustum and returns their count
+int CullBoxes(const Frustum& frustum, const BoundsSoA& bounds, int count, int* pVisibleIndices);
+
+// Scalar reference of CullBoxes for one box
+bool IsBoxVisible(const Frustum& frustum, const float center[3], const float extent[3]);
@@ -0,0 +1,137 @@
+//--------------------------------------------------------------------------------------
+// File: FrustumCullingSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "FrustumCulling.h"
+#include "TerrainGrid.h"
+#include "SceneUpdate.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Frustum culling. Matrices are built by SceneUpdate like the demo builds them.
+//--------------------------------------------------------------------------------------
+static void BuildViewProjection(const float eye[3], const float at[3], float viewProjection[4][4])
+{
+	float view[4][4], projection[4][4];
+	static const float s_Up[3] = { 0.0f, 1.0f, 0.0f };
+	BuildLookAtLH(eye, at, s_Up, view);
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, 16.0f / 9.0f, 0.01f, 100.0f, projection);
+	MultiplyMatrices(view, projection, viewProjection);
+}
+
+static bool IsPointInsideClipVolume(const float viewProjection[4][4], const float p[3])
+{
+	float clip[4];
+	for (int c = 0; c < 4; c++)
+		clip[c] = p[0] * viewProjection[0][c] + p[1] * viewProjection[1][c] + p[2] * viewProjection[2][c] + viewProjection[3][c];
+	return clip[3] > 0.0f && fabsf(clip[0]) < clip[3] && fabsf(clip[1]) < clip[3] && clip[2] > 0.0f && clip[2] < clip[3];
+}
+
+int VerifyCulling()
+{
+	static const float s_Cameras[][2][3] =
+	{
+		{ { 0.0f, 4.0f, -10.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ { 3.0f, 0.5f, 0.0f }, { -5.0f, 0.2f, 2.0f } },
+		{ { -40.0f, 30.0f, 40.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.9f, 0.0f } },
+	};
+
+	// Same layout as the demo, a bit larger and with strong displacement
+	TerrainGrid grid;
+	grid.Build(123, 77);
+	float worldScale[3] = { 45.0f, 30.0f, 30.0f };
+	grid.UpdateBounds(worldScale, 3.0f);
+	BoundsSoA bounds = grid.GetBounds();
+	std::vector<int> visible(grid.GetPatchCount());
+
+	SuiteCheck check("culling");
+	srand(1);
+	for (int camera = 0; camera < (int)(sizeof(s_Cameras) / sizeof(s_Cameras[0])); camera++)
+	{
+		float viewProjection[4][4];
+		BuildViewProjection(s_Cameras[camera][0], s_Cameras[camera][1], viewProjection);
+		Frustum frustum;
+		ExtractFrustumPlanes(viewProjection, frustum);
+		int numVisible = grid.Cull(frustum, &visible[0]);
+
+		// The SIMD path must return the same list as the scalar reference
+		std::vector<char> isVisible(grid.GetPatchCount(), 0);
+		int numReference = 0, listErrors = 0;
+		for (int patch = 0; patch < grid.GetPatchCount(); patch++)
+		{
+			float center[3] = { bounds.CenterX[patch], bounds.CenterY[patch], bounds.CenterZ[patch] };
+			float extent[3] = { bounds.ExtentX[patch], bounds.ExtentY[patch], bounds.ExtentZ[patch] };
+			if (IsBoxVisible(frustum, center, extent))
+			{
+				if (numReference >= numVisible || visible[numReference] != patch)
+					listErrors++;
+				numReference++;
+				isVisible[patch] = 1;
+			}
+		}
+		check.FailIf(listErrors != 0 || numReference != numVisible, "camera %d culled %d patches, the reference %d, %d differ",
+			camera, numVisible, numReference, listErrors);
+
+		// Culling must be conservative, no point of a culled box may be inside the clip volume
+		for (int patch = 0; patch < grid.GetPatchCount(); patch++)
+		{
+			if (isVisible[patch])
+				continue;
+			for (int sample = 0; sample < 16; sample++)
+			{
+				float p[3] =
+				{
+					bounds.CenterX[patch] + bounds.ExtentX[patch] * (2.0f * rand() / RAND_MAX - 1.0f),
+					bounds.CenterY[patch] + bounds.ExtentY[patch] * (2.0f * rand() / RAND_MAX - 1.0f),
+					bounds.CenterZ[patch] + bounds.ExtentZ[patch] * (2.0f * rand() / RAND_MAX - 1.0f)
+				};
+				if (IsPointInsideClipVolume(viewProjection, p))
+				{
+					check.Fail("camera %d culled patch %d that is in view", camera, patch);
+					break;
+				}
+			}
+		}
+
+		// Every camera looks at part of the terrain and away from another part
+		check.FailIf(numVisible == 0 || numVisible == grid.GetPatchCount(), "camera %d sees %d of %d patches", camera,
+			numVisible, grid.GetPatchCount());
+	}
+
+	return check.Finish("%d patches", grid.GetPatchCount());
+}
+
+void RunCullingThroughput(int numPatches)
+{
+	int patchesPerSide = std::max(1, (int)sqrtf((float)numPatches));
+	TerrainGrid grid;
+	grid.Build(patchesPerSide, patchesPerSide);
+	float worldScale[3] = { 150.0f, 100.0f, 100.0f };
+	grid.UpdateBounds(worldScale, 10.0f);
+	std::vector<int> visible(grid.GetPatchCount());
+
+	static const float s_Eye[3] = { 0.0f, 20.0f, -60.0f };
+	static const float s_At[3] = { 0.0f, 0.0f, 0.0f };
+	float viewProjection[4][4];
+	BuildViewProjection(s_Eye, s_At, viewProjection);
+
+	const int iterations = 20;
+	int numVisible = 0;
+	double start = GetTimeSeconds();
+	for (int i = 0; i < iterations; i++)
+	{
+		Frustum frustum;
+		ExtractFrustumPlanes(viewProjection, frustum);
+		numVisible = grid.Cull(frustum, &visible[0]);
+	}
+	double seconds = (GetTimeSeconds() - start) / iterations;
+
+	printf("culling %8d patches  %10.3f ms  %8.2f Mpatches/s  (%d visible)\n",
+		grid.GetPatchCount(), seconds * 1000.0, (double)grid.GetPatchCount() / seconds * 1e-6, numVisible);
+}
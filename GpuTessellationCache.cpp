@@ -0,0 +1,268 @@
+//--------------------------------------------------------------------------------------
+// File: GpuTessellationCache.cpp
+//--------------------------------------------------------------------------------------
+#include "GpuTessellationCache.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "Tessellator.h"
+#include <string.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+void BuildGridCachePatches(const TerrainGrid& grid, const int* pPatches, int count, bool quads,
+	const TerrainTriangleCounter& counter, GpuTessCachePatch* pOut)
+{
+	// Edge e of a tri patch is the one opposite control point e, the quad edges are in the
+	// order of ConstQuadHS
+	static const int s_QuadEdgePoints[4][2] = { { 0, 1 }, { 3, 0 }, { 3, 2 }, { 1, 2 } };
+	int controlPoints = quads ? 4 : 3;
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+		if (quads)
+			grid.GetQuadPatchIndices(pPatches[i], indices);
+		else
+			grid.GetPatchIndices(pPatches[i], indices);
+		for (int half = 0; half < (quads ? 1 : 2); half++)
+		{
+			int p = quads ? i : i * 2 + half;
+			GpuTessCachePatch& patch = pOut[p];
+			const unsigned int* pIndices = indices + half * controlPoints;
+			patch.Id = quads ? (unsigned int)pPatches[i] : (unsigned int)pPatches[i] * 2 + half;
+			for (int e = 0; e < 4; e++)
+			{
+				if (e < controlPoints)
+				{
+					patch.EdgeKeys[e] = quads ?
+						TessFactorStabilizer::GetEdgeKey(pIndices[s_QuadEdgePoints[e][0]], pIndices[s_QuadEdgePoints[e][1]]) :
+						TessFactorStabilizer::GetEdgeKey(pIndices[(e + 1) % 3], pIndices[(e + 2) % 3]);
+				}
+				else
+				{
+					patch.EdgeKeys[e] = 0;
+				}
+			}
+			counter.GetFactors(p, patch.Factors);
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// GpuTessellationCache
+//--------------------------------------------------------------------------------------
+void GpuTessellationCache::Init(const TessellationCacheDesc& desc)
+{
+	m_Desc = desc;
+	unsigned long long capacity = desc.BudgetBytes / sizeof(GpuTessCacheVertex);
+	m_Capacity = (capacity < 0xffffffffull) ? (unsigned int)capacity : 0xffffffffu;
+	m_Stabilizer.Init(desc.Hysteresis, desc.FactorStep);
+	m_ContentKey = 0;
+	m_Stats = TessellationCacheStats();
+	Clear();
+}
+
+void GpuTessellationCache::Clear()
+{
+	m_Slots.clear();
+	m_Lru.clear();
+	m_Free.clear();
+	if (m_Capacity > 0)
+		m_Free[0] = m_Capacity;
+	m_Stabilizer.Clear();
+	m_Fills.clear();
+	m_Draws.clear();
+	m_Uncached.clear();
+	m_Stats.Entries = 0;
+	m_Stats.Bytes = 0;
+}
+
+void GpuTessellationCache::SetContentKey(unsigned long long key)
+{
+	if (key == m_ContentKey)
+		return;
+	Clear();
+	m_ContentKey = key;
+}
+
+void GpuTessellationCache::Update(GpuTessCachePatch* pPatches, int count, int numEdges)
+{
+	m_DrawIndex++;
+	m_Fills.clear();
+	m_Draws.clear();
+	m_Uncached.clear();
+	m_Misses.clear();
+
+	// Hits first, so a miss never evicts the slot of a patch drawn later in the frame. A
+	// slot of other factors is released before the misses allocate theirs.
+	for (int p = 0; p < count; p++)
+	{
+		GpuTessCachePatch& patch = pPatches[p];
+		m_Stabilizer.StabilizeFactors(patch.Id, patch.EdgeKeys, numEdges, patch.Factors);
+		SlotMap::iterator it = m_Slots.find(patch.Id);
+		if (it != m_Slots.end())
+		{
+			Slot& slot = it->second;
+			if (slot.DrawIndex == m_DrawIndex)
+			{
+				m_Uncached.push_back(p);
+				continue;
+			}
+			if (memcmp(slot.Factors, patch.Factors, sizeof(slot.Factors)) == 0)
+			{
+				slot.DrawIndex = m_DrawIndex;
+				m_Lru.splice(m_Lru.begin(), m_Lru, slot.LruPosition);
+				GpuTessCacheDraw draw = { slot.FirstVertex, slot.VertexCount };
+				m_Draws.push_back(draw);
+				m_Stats.Hits++;
+				continue;
+			}
+			Release(it);
+		}
+		m_Misses.push_back(p);
+	}
+
+	// A slot of 3 vertices per triangle for every miss, evicting as far as it takes
+	for (size_t m = 0; m < m_Misses.size(); m++)
+	{
+		int p = m_Misses[m];
+		const GpuTessCachePatch& patch = pPatches[p];
+		const float* pFactors = patch.Factors;
+		int triangles = (numEdges == 4) ?
+			CountFractionalOddQuadTriangles(pFactors[0], pFactors[1], pFactors[2], pFactors[3], pFactors[4], pFactors[5]) :
+			CountFractionalOddTriTriangles(pFactors[0], pFactors[1], pFactors[2], pFactors[4]);
+		unsigned int vertexCount = (unsigned int)triangles * 3;
+		m_Stats.Misses++;
+
+		unsigned int first = 0;
+		bool allocated = vertexCount > 0 && vertexCount <= m_Capacity && Allocate(vertexCount, first);
+		unsigned int freed;
+		while (!allocated && vertexCount > 0 && vertexCount <= m_Capacity && EvictLeastRecent(freed))
+			allocated = freed >= vertexCount && Allocate(vertexCount, first);
+		if (!allocated)
+		{
+			m_Uncached.push_back(p);
+			continue;
+		}
+
+		Slot& slot = m_Slots[patch.Id];
+		memcpy(slot.Factors, pFactors, sizeof(slot.Factors));
+		slot.FirstVertex = first;
+		slot.VertexCount = vertexCount;
+		slot.DrawIndex = m_DrawIndex;
+		m_Lru.push_front(patch.Id);
+		slot.LruPosition = m_Lru.begin();
+		m_Stats.Entries++;
+		m_Stats.Bytes += (unsigned long long)vertexCount * sizeof(GpuTessCacheVertex);
+
+		GpuTessCacheFill fill = { p, first, vertexCount };
+		m_Fills.push_back(fill);
+		GpuTessCacheDraw draw = { first, vertexCount };
+		m_Draws.push_back(draw);
+	}
+
+	// Fills in buffer order, so adjoining ones stream out one after the other, and the
+	// drawn slots merged where they touch
+	std::sort(m_Fills.begin(), m_Fills.end(), [](const GpuTessCacheFill& a, const GpuTessCacheFill& b)
+	{
+		return a.FirstVertex < b.FirstVertex;
+	});
+	std::sort(m_Draws.begin(), m_Draws.end(), [](const GpuTessCacheDraw& a, const GpuTessCacheDraw& b)
+	{
+		return a.FirstVertex < b.FirstVertex;
+	});
+	size_t merged = 0;
+	for (size_t d = 0; d < m_Draws.size(); d++)
+	{
+		if (merged > 0 && m_Draws[merged - 1].FirstVertex + m_Draws[merged - 1].VertexCount == m_Draws[d].FirstVertex)
+			m_Draws[merged - 1].VertexCount += m_Draws[d].VertexCount;
+		else
+			m_Draws[merged++] = m_Draws[d];
+	}
+	m_Draws.resize(merged);
+}
+
+bool GpuTessellationCache::FindSlot(unsigned int patch, unsigned int& firstVertex, unsigned int& vertexCount) const
+{
+	SlotMap::const_iterator it = m_Slots.find(patch);
+	if (it == m_Slots.end())
+		return false;
+	firstVertex = it->second.FirstVertex;
+	vertexCount = it->second.VertexCount;
+	return true;
+}
+
+void GpuTessellationCache::ResetCounters()
+{
+	m_Stats.Hits = 0;
+	m_Stats.Misses = 0;
+	m_Stats.Evictions = 0;
+}
+
+// First fit, from the front of the free range
+bool GpuTessellationCache::Allocate(unsigned int count, unsigned int& first)
+{
+	for (std::map<unsigned int, unsigned int>::iterator it = m_Free.begin(); it != m_Free.end(); ++it)
+	{
+		if (it->second < count)
+			continue;
+		first = it->first;
+		unsigned int rest = it->second - count;
+		m_Free.erase(it);
+		if (rest > 0)
+			m_Free[first + count] = rest;
+		return true;
+	}
+	return false;
+}
+
+// Returns the vertices of the free range the freed one was merged into
+unsigned int GpuTessellationCache::Free(unsigned int first, unsigned int count)
+{
+	std::map<unsigned int, unsigned int>::iterator next = m_Free.lower_bound(first);
+	if (next != m_Free.end() && first + count == next->first)
+	{
+		count += next->second;
+		next = m_Free.erase(next);
+	}
+	if (next != m_Free.begin())
+	{
+		std::map<unsigned int, unsigned int>::iterator previous = next;
+		--previous;
+		if (previous->first + previous->second == first)
+		{
+			previous->second += count;
+			return previous->second;
+		}
+	}
+	m_Free[first] = count;
+	return count;
+}
+
+// Returns the vertices of the free range the slot was merged into
+unsigned int GpuTessellationCache::Release(SlotMap::iterator it)
+{
+	const Slot& slot = it->second;
+	unsigned int freed = Free(slot.FirstVertex, slot.VertexCount);
+	m_Stats.Entries--;
+	m_Stats.Bytes -= (unsigned long long)slot.VertexCount * sizeof(GpuTessCacheVertex);
+	m_Lru.erase(slot.LruPosition);
+	m_Slots.erase(it);
+	return freed;
+}
+
+// The slots drawn in this Update are at the front of the LRU list and stay
+bool GpuTessellationCache::EvictLeastRecent(unsigned int& freed)
+{
+	if (m_Lru.empty())
+		return false;
+	SlotMap::iterator it = m_Slots.find(m_Lru.back());
+	if (it->second.DrawIndex == m_DrawIndex)
+		return false;
+	freed = Release(it);
+	m_Stats.Evictions++;
+	return true;
+}
@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// File: GpuTessellationCache.h
+//
+// The retessellation cache of the D3D11 grid path. The displaced domain points of the
+// drawn patches live in one stream-out buffer: a patch without a slot, or whose
+// stabilized factors changed, is drawn through the hull and domain shaders once with its
+// DS output streamed into a slot, then every drawn patch is replayed from its slot as a
+// plain triangle list, so unchanged patches skip the tessellator, HS and DS.
+//
+// The cache only plans a frame, Render issues the draws. The factors are stabilized by
+// the TessFactorStabilizer of TessellationCache.h, and a slot is reused while its patch
+// is drawn with the same stabilized factors. A slot holds the 3 vertices of every
+// triangle the tessellator generates for them, counted on the CPU with Tessellator.h.
+// The slots of the misses are allocated first fit; when none fits, the least recently
+// used slots of patches not drawn in the frame are evicted until one does. Patches that
+// still do not fit are drawn without the cache. The slots of the drawn patches are
+// sorted and merged into as few replay draws as possible.
+//
+// The positions also depend on the grid, the world scale and the displacement; callers
+// pass a key of those to SetContentKey, and a new key drops every slot.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "TessellationCache.h"
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+class TerrainGrid;
+class TerrainTriangleCounter;
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// A vertex of the stream-out buffer, a domain point after DS before the projection. Keep
+// in sync with CACHE_VERTEX in DisplacedAndShaded.hlsl.
+struct GpuTessCacheVertex
+{
+	float Position[3];                  // world space, displaced
+	float TexCoord[2];
+};
+
+// A patch of the frame
+struct GpuTessCachePatch
+{
+	unsigned int Id;
+	unsigned long long EdgeKeys[4];     // TessFactorStabilizer::GetEdgeKey of the control points of each edge
+	float Factors[6];                   // in the order of TessFactors.h, stabilized in place by Update
+};
+
+// A miss, drawn with its DS output streamed into its slot
+struct GpuTessCacheFill
+{
+	int Patch;                          // index into the patches of Update
+	unsigned int FirstVertex;           // of the slot in the stream-out buffer
+	unsigned int VertexCount;
+};
+
+// A replay draw of one or more adjoining slots
+struct GpuTessCacheDraw
+{
+	unsigned int FirstVertex;
+	unsigned int VertexCount;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// The cache patches of count visible grid patches with the factors of the counter's last
+// ComputeFactors for them. Tri patch t of grid patch pPatches[i] is pOut[2 * i + t] with
+// the Id 2 * pPatches[i] + t, like in SoftwareRenderer; a quad patch has the grid
+// patch's index. Edge keys are of the grid vertices.
+void BuildGridCachePatches(const TerrainGrid& grid, const int* pPatches, int count, bool quads,
+	const TerrainTriangleCounter& counter, GpuTessCachePatch* pOut);
+
+
+//--------------------------------------------------------------------------------------
+// GpuTessellationCache
+//--------------------------------------------------------------------------------------
+class GpuTessellationCache
+{
+public:
+	GpuTessellationCache() {}
+
+	// Drops every slot and starts over with desc, BudgetBytes is the size of the
+	// stream-out buffer
+	void Init(const TessellationCacheDesc& desc);
+	void Clear();
+
+	// Drops every slot and stabilized factor if key differs from the last one
+	void SetContentKey(unsigned long long key);
+
+	// Plans the draw of count patches of numEdges edges, with fractional_odd partitioning.
+	// Every Id may appear once.
+	void Update(GpuTessCachePatch* pPatches, int count, int numEdges);
+
+	// The plan of the last Update: the fills sorted by their slots, the replay draws and
+	// the patches drawn without the cache
+	const std::vector<GpuTessCacheFill>& GetFills() const { return m_Fills; }
+	const std::vector<GpuTessCacheDraw>& GetDraws() const { return m_Draws; }
+	const std::vector<int>& GetUncached() const { return m_Uncached; }
+
+	// Vertices of the stream-out buffer
+	unsigned int GetCapacity() const { return m_Capacity; }
+
+	// The slot of a patch, false if it has none
+	bool FindSlot(unsigned int patch, unsigned int& firstVertex, unsigned int& vertexCount) const;
+
+	const TessellationCacheStats& GetStats() const { return m_Stats; }
+	void ResetCounters();
+
+private:
+	struct Slot
+	{
+		float Factors[6];
+		unsigned int FirstVertex;
+		unsigned int VertexCount;
+		unsigned int DrawIndex;         // of the last Update that drew it
+		std::list<unsigned int>::iterator LruPosition;
+	};
+	typedef std::unordered_map<unsigned int, Slot> SlotMap;
+
+	bool Allocate(unsigned int count, unsigned int& first);
+	unsigned int Free(unsigned int first, unsigned int count);
+	unsigned int Release(SlotMap::iterator it);
+	bool EvictLeastRecent(unsigned int& freed);
+
+	TessellationCacheDesc m_Desc;
+	unsigned int m_Capacity = 0;
+	unsigned long long m_ContentKey = 0;
+	unsigned int m_DrawIndex = 0;
+	TessFactorStabilizer m_Stabilizer;
+	SlotMap m_Slots;
+	std::list<unsigned int> m_Lru;                          // most recently drawn first
+	std::map<unsigned int, unsigned int> m_Free;            // first vertex to vertex count, never adjoining
+	std::vector<GpuTessCacheFill> m_Fills;
+	std::vector<GpuTessCacheDraw> m_Draws;
+	std::vector<int> m_Uncached;
+	std::vector<int> m_Misses;
+	TessellationCacheStats m_Stats;
+};
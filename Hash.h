@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// File: Hash.h
+//
+// 64-bit FNV-1a hash, used to key the on-disk caches to the content of their sources.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <stdio.h>
+#include <stddef.h>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define HASH_FNV_OFFSET_BASIS   0xcbf29ce484222325ULL
+#define HASH_FNV_PRIME          0x100000001b3ULL
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Pass the previous result as hash to continue hashing over several buffers
+inline unsigned long long HashBytes(const void* pData, size_t size, unsigned long long hash = HASH_FNV_OFFSET_BASIS)
+{
+	const unsigned char* pBytes = (const unsigned char*)pData;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= pBytes[i];
+		hash *= HASH_FNV_PRIME;
+	}
+	return hash;
+}
+
+// Hash of the whole content of a file, returns false if it cannot be read
+inline bool HashFile(const char* pFileName, unsigned long long& hash)
+{
+	FILE* pFile = fopen(pFileName, "rb");
+	if (!pFile)
+		return false;
+
+	hash = HASH_FNV_OFFSET_BASIS;
+	unsigned char buffer[64 * 1024];
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+		hash = HashBytes(buffer, size, hash);
+
+	bool success = ferror(pFile) == 0;
+	fclose(pFile);
+	return success;
+}
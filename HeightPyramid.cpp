@@ -0,0 +1,308 @@
+//--------------------------------------------------------------------------------------
+// File: HeightPyramid.cpp
+//--------------------------------------------------------------------------------------
+#include "HeightPyramid.h"
+#include "SimdUtil.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Sidecar file layout: header, level 0 heights, then min and max of every other level
+//--------------------------------------------------------------------------------------
+#define HEIGHT_PYRAMID_MAGIC 0x52595048     // "HPYR"
+
+struct HeightPyramidFileHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned long long SourceHash;
+	int Width;
+	int Height;
+	int LevelCount;
+	int Reserved;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Build
+//--------------------------------------------------------------------------------------
+void HeightPyramid::AllocateLevels(int width, int height)
+{
+	m_Levels.clear();
+	for (;;)
+	{
+		Level level;
+		level.Width = width;
+		level.Height = height;
+		level.Min.resize((size_t)width * height);
+		// Level 0 is a single texel per range, its Max aliases Min
+		if (!m_Levels.empty())
+			level.Max.resize((size_t)width * height);
+		m_Levels.push_back(level);
+		if (width == 1 && height == 1)
+			break;
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+}
+
+// Each output texel combines the 2x2 source block, or the 1x2/2x1/1x1 remainder on odd edges
+static void ReduceRows(const unsigned char* pSrcMin, const unsigned char* pSrcMax, int srcWidth, int srcHeight,
+	unsigned char* pDstMin, unsigned char* pDstMax, int dstWidth, int rowBegin, int rowEnd)
+{
+	for (int y = rowBegin; y < rowEnd; y++)
+	{
+		const unsigned char* pMinA = pSrcMin + (size_t)(2 * y) * srcWidth;
+		const unsigned char* pMaxA = pSrcMax + (size_t)(2 * y) * srcWidth;
+		int rowB = std::min(2 * y + 1, srcHeight - 1);
+		const unsigned char* pMinB = pSrcMin + (size_t)rowB * srcWidth;
+		const unsigned char* pMaxB = pSrcMax + (size_t)rowB * srcWidth;
+		unsigned char* pOutMin = pDstMin + (size_t)y * dstWidth;
+		unsigned char* pOutMax = pDstMax + (size_t)y * dstWidth;
+
+		int x = 0;
+#if TESS_USE_SSE2
+		// 16 output texels from 32 source texels of both rows. Horizontal pairs are split
+		// into the low and high byte of 16-bit lanes and packed back after the min/max.
+		const __m128i vLowBytes = _mm_set1_epi16(0x00ff);
+		for (; x + 16 <= srcWidth / 2; x += 16)
+		{
+			__m128i min0 = _mm_min_epu8(_mm_loadu_si128((const __m128i*)(pMinA + 2 * x)), _mm_loadu_si128((const __m128i*)(pMinB + 2 * x)));
+			__m128i min1 = _mm_min_epu8(_mm_loadu_si128((const __m128i*)(pMinA + 2 * x + 16)), _mm_loadu_si128((const __m128i*)(pMinB + 2 * x + 16)));
+			min0 = _mm_min_epi16(_mm_and_si128(min0, vLowBytes), _mm_srli_epi16(min0, 8));
+			min1 = _mm_min_epi16(_mm_and_si128(min1, vLowBytes), _mm_srli_epi16(min1, 8));
+			_mm_storeu_si128((__m128i*)(pOutMin + x), _mm_packus_epi16(min0, min1));
+
+			__m128i max0 = _mm_max_epu8(_mm_loadu_si128((const __m128i*)(pMaxA + 2 * x)), _mm_loadu_si128((const __m128i*)(pMaxB + 2 * x)));
+			__m128i max1 = _mm_max_epu8(_mm_loadu_si128((const __m128i*)(pMaxA + 2 * x + 16)), _mm_loadu_si128((const __m128i*)(pMaxB + 2 * x + 16)));
+			max0 = _mm_max_epi16(_mm_and_si128(max0, vLowBytes), _mm_srli_epi16(max0, 8));
+			max1 = _mm_max_epi16(_mm_and_si128(max1, vLowBytes), _mm_srli_epi16(max1, 8));
+			_mm_storeu_si128((__m128i*)(pOutMax + x), _mm_packus_epi16(max0, max1));
+		}
+#endif
+		for (; x < dstWidth; x++)
+		{
+			int x0 = 2 * x;
+			int x1 = std::min(2 * x + 1, srcWidth - 1);
+			pOutMin[x] = std::min(std::min(pMinA[x0], pMinA[x1]), std::min(pMinB[x0], pMinB[x1]));
+			pOutMax[x] = std::max(std::max(pMaxA[x0], pMaxA[x1]), std::max(pMaxB[x0], pMaxB[x1]));
+		}
+	}
+}
+
+bool HeightPyramid::Build(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride, int numThreads)
+{
+	if (!pTexels || width < 1 || height < 1 || texelStride < 1 || rowPitch < width * texelStride)
+		return false;
+
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	AllocateLevels(width, height);
+
+	Level& base = m_Levels[0];
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* pRow = pTexels + (size_t)y * rowPitch;
+		unsigned char* pOut = &base.Min[(size_t)y * width];
+		if (texelStride == 1)
+		{
+			memcpy(pOut, pRow, width);
+			continue;
+		}
+		for (int x = 0; x < width; x++)
+			pOut[x] = pRow[x * texelStride];
+	}
+
+	// Rows of a level are independent. Small levels are not worth a thread.
+	const int minRowsPerThread = 32;
+	for (size_t l = 1; l < m_Levels.size(); l++)
+	{
+		const Level& src = m_Levels[l - 1];
+		Level& dst = m_Levels[l];
+		int threads = std::min(numThreads, std::max(1, dst.Height / minRowsPerThread));
+		const unsigned char* pSrcMax = GetLevelMax((int)l - 1);
+		if (threads == 1)
+		{
+			ReduceRows(src.Min.data(), pSrcMax, src.Width, src.Height, dst.Min.data(), dst.Max.data(), dst.Width, 0, dst.Height);
+			continue;
+		}
+
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+		{
+			int rowBegin = dst.Height * t / threads;
+			int rowEnd = dst.Height * (t + 1) / threads;
+			workers.push_back(std::thread(ReduceRows, src.Min.data(), pSrcMax, src.Width, src.Height,
+				dst.Min.data(), dst.Max.data(), dst.Width, rowBegin, rowEnd));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Queries
+//--------------------------------------------------------------------------------------
+static int HighestBit(unsigned int value)
+{
+	int bit = 0;
+	if (value >= 1u << 16) { value >>= 16; bit += 16; }
+	if (value >= 1u << 8) { value >>= 8; bit += 8; }
+	if (value >= 1u << 4) { value >>= 4; bit += 4; }
+	if (value >= 1u << 2) { value >>= 2; bit += 2; }
+	if (value >= 1u << 1) { bit += 1; }
+	return bit;
+}
+
+void HeightPyramid::QueryTexels(int x0, int y0, int x1, int y1, unsigned char& minHeight, unsigned char& maxHeight) const
+{
+	const Level& base = m_Levels[0];
+	x0 = std::min(std::max(x0, 0), base.Width - 1);
+	x1 = std::min(std::max(x1, x0), base.Width - 1);
+	y0 = std::min(std::max(y0, 0), base.Height - 1);
+	y1 = std::min(std::max(y1, y0), base.Height - 1);
+
+	// Below the highest differing bit the corners fall into adjacent texels
+	unsigned int difference = (unsigned int)((x0 ^ x1) | (y0 ^ y1));
+	int l = difference ? std::min(HighestBit(difference), (int)m_Levels.size() - 1) : 0;
+	const Level& level = m_Levels[l];
+	const unsigned char* pMax = GetLevelMax(l);
+	int cx0 = x0 >> l, cx1 = x1 >> l;
+	int cy0 = y0 >> l, cy1 = y1 >> l;
+
+	minHeight = 255;
+	maxHeight = 0;
+	for (int cy = cy0; cy <= cy1; cy++)
+	{
+		for (int cx = cx0; cx <= cx1; cx++)
+		{
+			size_t texel = (size_t)cy * level.Width + cx;
+			minHeight = std::min(minHeight, level.Min[texel]);
+			maxHeight = std::max(maxHeight, pMax[texel]);
+		}
+	}
+}
+
+// Splits the padded texel range [begin, end] of a wrapped axis into at most two ranges
+static int WrapRange(int begin, int end, int size, int ranges[2][2])
+{
+	if (end - begin + 1 >= size)
+	{
+		ranges[0][0] = 0;
+		ranges[0][1] = size - 1;
+		return 1;
+	}
+	int wrappedBegin = ((begin % size) + size) % size;
+	int wrappedEnd = wrappedBegin + (end - begin);
+	if (wrappedEnd < size)
+	{
+		ranges[0][0] = wrappedBegin;
+		ranges[0][1] = wrappedEnd;
+		return 1;
+	}
+	ranges[0][0] = wrappedBegin;
+	ranges[0][1] = size - 1;
+	ranges[1][0] = 0;
+	ranges[1][1] = wrappedEnd - size;
+	return 2;
+}
+
+void HeightPyramid::QueryUV(float u0, float v0, float u1, float v1, float& minHeight, float& maxHeight) const
+{
+	int width = GetWidth();
+	int height = GetHeight();
+	int rangesX[2][2], rangesY[2][2];
+	int numX = WrapRange((int)floorf(u0 * width) - 1, (int)floorf(u1 * width) + 1, width, rangesX);
+	int numY = WrapRange((int)floorf(v0 * height) - 1, (int)floorf(v1 * height) + 1, height, rangesY);
+
+	unsigned char rangeMin = 255, rangeMax = 0;
+	for (int y = 0; y < numY; y++)
+	{
+		for (int x = 0; x < numX; x++)
+		{
+			unsigned char partMin, partMax;
+			QueryTexels(rangesX[x][0], rangesY[y][0], rangesX[x][1], rangesY[y][1], partMin, partMax);
+			rangeMin = std::min(rangeMin, partMin);
+			rangeMax = std::max(rangeMax, partMax);
+		}
+	}
+	minHeight = rangeMin / 255.0f;
+	maxHeight = rangeMax / 255.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sidecar file
+//--------------------------------------------------------------------------------------
+bool HeightPyramid::Save(const char* pFileName, unsigned long long sourceHash) const
+{
+	if (!IsValid())
+		return false;
+
+	FILE* pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	HeightPyramidFileHeader header;
+	header.Magic = HEIGHT_PYRAMID_MAGIC;
+	header.Version = HEIGHT_PYRAMID_VERSION;
+	header.SourceHash = sourceHash;
+	header.Width = GetWidth();
+	header.Height = GetHeight();
+	header.LevelCount = GetLevelCount();
+	header.Reserved = 0;
+
+	bool success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+	success = success && fwrite(m_Levels[0].Min.data(), 1, m_Levels[0].Min.size(), pFile) == m_Levels[0].Min.size();
+	for (size_t l = 1; l < m_Levels.size() && success; l++)
+	{
+		const Level& level = m_Levels[l];
+		success = fwrite(level.Min.data(), 1, level.Min.size(), pFile) == level.Min.size() &&
+			fwrite(level.Max.data(), 1, level.Max.size(), pFile) == level.Max.size();
+	}
+	success = (fclose(pFile) == 0) && success;
+	if (!success)
+		remove(pFileName);
+	return success;
+}
+
+bool HeightPyramid::Load(const char* pFileName, unsigned long long sourceHash)
+{
+	FILE* pFile = fopen(pFileName, "rb");
+	if (!pFile)
+		return false;
+
+	HeightPyramidFileHeader header;
+	bool success = fread(&header, sizeof(header), 1, pFile) == 1 &&
+		header.Magic == HEIGHT_PYRAMID_MAGIC && header.Version == HEIGHT_PYRAMID_VERSION &&
+		header.SourceHash == sourceHash && header.Width > 0 && header.Height > 0 &&
+		header.Width <= 65536 && header.Height <= 65536;
+	if (success)
+	{
+		AllocateLevels(header.Width, header.Height);
+		success = header.LevelCount == GetLevelCount() &&
+			fread(m_Levels[0].Min.data(), 1, m_Levels[0].Min.size(), pFile) == m_Levels[0].Min.size();
+		for (size_t l = 1; l < m_Levels.size() && success; l++)
+		{
+			Level& level = m_Levels[l];
+			success = fread(level.Min.data(), 1, level.Min.size(), pFile) == level.Min.size() &&
+				fread(level.Max.data(), 1, level.Max.size(), pFile) == level.Max.size();
+		}
+		success = success && fgetc(pFile) == EOF;
+	}
+	fclose(pFile);
+
+	if (!success)
+	{
+		m_Levels.clear();
+		return false;
+	}
+	return true;
+}
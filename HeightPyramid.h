@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// File: HeightPyramid.h
+//
+// Min/max mip pyramid of an 8-bit heightmap. Texel i of level k holds the range of the
+// 2^k x 2^k block of level 0 texels it covers, so the height range of any rectangle is
+// bounded by at most 2x2 texels of a single level. The pyramid can be saved to a
+// sidecar file keyed by the hash of the source image and loaded on later startups.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define HEIGHT_PYRAMID_VERSION 1
+
+
+//--------------------------------------------------------------------------------------
+// HeightPyramid
+//--------------------------------------------------------------------------------------
+class HeightPyramid
+{
+public:
+	// Builds from one 8-bit channel: texel (x, y) is pTexels[y * rowPitch + x * texelStride].
+	// numThreads 0 uses every hardware thread.
+	bool Build(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride, int numThreads = 0);
+
+	// The load fails if the file is missing, corrupt or was built from another source
+	bool Save(const char* pFileName, unsigned long long sourceHash) const;
+	bool Load(const char* pFileName, unsigned long long sourceHash);
+
+	// Conservative range of the inclusive texel rectangle, clamped to the image. Constant
+	// time: reads at most four texels of the first level where the rectangle spans 2x2.
+	void QueryTexels(int x0, int y0, int x1, int y1, unsigned char& minHeight, unsigned char& maxHeight) const;
+
+	// Range in [0, 1] of what a point sampler with wrap addressing can return for texture
+	// coordinates in [u0, u1] x [v0, v1], padded by one texel for interpolation error
+	void QueryUV(float u0, float v0, float u1, float v1, float& minHeight, float& maxHeight) const;
+
+	bool IsValid() const { return !m_Levels.empty(); }
+	int GetWidth() const { return IsValid() ? m_Levels[0].Width : 0; }
+	int GetHeight() const { return IsValid() ? m_Levels[0].Height : 0; }
+	int GetLevelCount() const { return (int)m_Levels.size(); }
+	int GetLevelWidth(int level) const { return m_Levels[level].Width; }
+	int GetLevelHeight(int level) const { return m_Levels[level].Height; }
+	const unsigned char* GetLevelMin(int level) const { return m_Levels[level].Min.data(); }
+	const unsigned char* GetLevelMax(int level) const { return level == 0 ? m_Levels[0].Min.data() : m_Levels[level].Max.data(); }
+
+private:
+	struct Level
+	{
+		int Width;
+		int Height;
+		std::vector<unsigned char> Min;
+		std::vector<unsigned char> Max;
+	};
+
+	void AllocateLevels(int width, int height);
+
+	std::vector<Level> m_Levels;
+};
@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// File: HeightPyramidSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "HeightPyramid.h"
+#include "Hash.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Min/max displacement pyramid. Uses a synthetic heightmap of smoothed value noise so
+// neighbouring texels are correlated like in a real displacement map.
+//--------------------------------------------------------------------------------------
+void BuildNoiseHeightmap(int width, int height, unsigned int seed, std::vector<unsigned char>& texels)
+{
+	texels.resize((size_t)width * height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float value = 0.0f, amplitude = 0.5f;
+			for (int octave = 0; octave < 4; octave++)
+			{
+				int cell = 64 >> (octave * 2 / 2);
+				unsigned int h = (unsigned int)((x / cell) * 73856093) ^ (unsigned int)((y / cell) * 19349663) ^ (seed + octave * 83492791);
+				h = (h ^ (h >> 13)) * 0x5bd1e995;
+				value += amplitude * (float)((h ^ (h >> 15)) & 0xff) / 255.0f;
+				amplitude *= 0.5f;
+			}
+			texels[(size_t)y * width + x] = (unsigned char)std::min(255.0f, value * 255.0f);
+		}
+	}
+}
+
+static void BruteForceRange(const std::vector<unsigned char>& texels, int width, int x0, int y0, int x1, int y1,
+	unsigned char& minHeight, unsigned char& maxHeight)
+{
+	minHeight = 255;
+	maxHeight = 0;
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			minHeight = std::min(minHeight, texels[(size_t)y * width + x]);
+			maxHeight = std::max(maxHeight, texels[(size_t)y * width + x]);
+		}
+	}
+}
+
+int VerifyPyramid()
+{
+	static const int s_Sizes[][2] = { { 1500, 1000 }, { 333, 517 }, { 1, 7 }, { 64, 64 } };
+	const char* pCacheFile = "HeightPyramidBenchmark.minmax";
+
+	SuiteCheck check("pyramid");
+	srand(2);
+	for (int size = 0; size < (int)(sizeof(s_Sizes) / sizeof(s_Sizes[0])); size++)
+	{
+		int width = s_Sizes[size][0], height = s_Sizes[size][1];
+		std::vector<unsigned char> texels;
+		BuildNoiseHeightmap(width, height, size, texels);
+
+		// The multithreaded build has to match the single threaded one
+		HeightPyramid pyramid, reference;
+		pyramid.Build(&texels[0], width, height, width, 1, 4);
+		reference.Build(&texels[0], width, height, width, 1, 1);
+		for (int l = 0; l < pyramid.GetLevelCount(); l++)
+		{
+			size_t levelSize = (size_t)pyramid.GetLevelWidth(l) * pyramid.GetLevelHeight(l);
+			check.FailIf(memcmp(pyramid.GetLevelMin(l), reference.GetLevelMin(l), levelSize) != 0 ||
+				memcmp(pyramid.GetLevelMax(l), reference.GetLevelMax(l), levelSize) != 0,
+				"%dx%d: level %d differs between thread counts", width, height, l);
+		}
+		int top = pyramid.GetLevelCount() - 1;
+		check.FailIf(pyramid.GetLevelWidth(top) != 1 || pyramid.GetLevelHeight(top) != 1, "%dx%d: top level is %dx%d",
+			width, height, pyramid.GetLevelWidth(top), pyramid.GetLevelHeight(top));
+
+		// Every texel of every level is the exact range of the block it covers
+		for (int l = 1; l < pyramid.GetLevelCount(); l++)
+		{
+			for (int sample = 0; sample < 64; sample++)
+			{
+				int cx = rand() % pyramid.GetLevelWidth(l), cy = rand() % pyramid.GetLevelHeight(l);
+				int x0 = cx << l, y0 = cy << l;
+				int x1 = std::min(((cx + 1) << l) - 1, width - 1), y1 = std::min(((cy + 1) << l) - 1, height - 1);
+				unsigned char minHeight, maxHeight;
+				BruteForceRange(texels, width, x0, y0, x1, y1, minHeight, maxHeight);
+				size_t texel = (size_t)cy * pyramid.GetLevelWidth(l) + cx;
+				if (pyramid.GetLevelMin(l)[texel] != minHeight || pyramid.GetLevelMax(l)[texel] != maxHeight)
+				{
+					check.Fail("%dx%d: level %d texel %d,%d is not the range of its block", width, height, l, cx, cy);
+					break;
+				}
+			}
+		}
+
+		// Queries bound the exact range, and are exact for single texels
+		for (int query = 0; query < 2000; query++)
+		{
+			int x0 = rand() % width, y0 = rand() % height;
+			int x1 = std::min(width - 1, x0 + rand() % 300), y1 = std::min(height - 1, y0 + rand() % 300);
+			if (query % 4 == 0)
+			{
+				x1 = x0;
+				y1 = y0;
+			}
+			unsigned char minHeight, maxHeight, exactMin, exactMax;
+			pyramid.QueryTexels(x0, y0, x1, y1, minHeight, maxHeight);
+			BruteForceRange(texels, width, x0, y0, x1, y1, exactMin, exactMax);
+			bool exact = (x0 == x1 && y0 == y1);
+			if (minHeight > exactMin || maxHeight < exactMax || (exact && (minHeight != exactMin || maxHeight != exactMax)))
+			{
+				check.Fail("%dx%d: query %d,%d-%d,%d returned %d..%d, exact range %d..%d", width, height, x0, y0, x1,
+					y1, minHeight, maxHeight, exactMin, exactMax);
+				break;
+			}
+		}
+
+		// A UV range crossing u = 1 wraps around to the first column
+		float wrapMin, wrapMax;
+		unsigned char columnMin, columnMax;
+		pyramid.QueryUV(0.99f, 0.0f, 1.01f, 1.0f, wrapMin, wrapMax);
+		BruteForceRange(texels, width, 0, 0, 0, height - 1, columnMin, columnMax);
+		check.FailIf(wrapMin > columnMin / 255.0f || wrapMax < columnMax / 255.0f,
+			"%dx%d: wrapped UV query misses the first column", width, height);
+
+		// The sidecar file round trips and is rejected for another source
+		unsigned long long sourceHash = HashBytes(&texels[0], texels.size());
+		HeightPyramid loaded;
+		if (!pyramid.Save(pCacheFile, sourceHash) || !loaded.Load(pCacheFile, sourceHash))
+		{
+			check.Fail("%dx%d: sidecar file round trip failed", width, height);
+		}
+		else
+		{
+			for (int l = 0; l < pyramid.GetLevelCount(); l++)
+			{
+				size_t levelSize = (size_t)pyramid.GetLevelWidth(l) * pyramid.GetLevelHeight(l);
+				check.FailIf(memcmp(pyramid.GetLevelMin(l), loaded.GetLevelMin(l), levelSize) != 0 ||
+					memcmp(pyramid.GetLevelMax(l), loaded.GetLevelMax(l), levelSize) != 0,
+					"%dx%d: level %d differs after the sidecar file round trip", width, height, l);
+			}
+		}
+		check.FailIf(loaded.Load(pCacheFile, sourceHash + 1) || loaded.IsValid(),
+			"%dx%d: sidecar file of another source was accepted", width, height);
+		remove(pCacheFile);
+	}
+
+	return check.Finish("%d heightmaps", (int)(sizeof(s_Sizes) / sizeof(s_Sizes[0])));
+}
+
+void RunPyramidThroughput()
+{
+	const int size = 4096;
+	const char* pCacheFile = "HeightPyramidBenchmark.minmax";
+	std::vector<unsigned char> texels;
+	BuildNoiseHeightmap(size, size, 7, texels);
+	unsigned long long sourceHash = HashBytes(&texels[0], texels.size());
+
+	HeightPyramid pyramid;
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		double start = GetTimeSeconds();
+		pyramid.Build(&texels[0], size, size, size, 1, threads);
+		double seconds = GetTimeSeconds() - start;
+		printf("pyramid build %dx%d  %2d threads  %10.3f ms  %8.2f Mtexels/s\n",
+			size, size, threads, seconds * 1000.0, (double)size * size / seconds * 1e-6);
+	}
+
+	pyramid.Save(pCacheFile, sourceHash);
+	HeightPyramid loaded;
+	double start = GetTimeSeconds();
+	bool success = loaded.Load(pCacheFile, sourceHash);
+	double seconds = GetTimeSeconds() - start;
+	remove(pCacheFile);
+	printf("pyramid load  %dx%d  %10.3f ms  (%s)\n", size, size, seconds * 1000.0, success ? "ok" : "failed");
+
+	const int queries = 1000000;
+	unsigned int range = 0;
+	start = GetTimeSeconds();
+	for (int i = 0; i < queries; i++)
+	{
+		int x0 = (int)(((unsigned int)i * 7919u) % size), y0 = (int)(((unsigned int)i * 104729u) % size);
+		unsigned char minHeight, maxHeight;
+		pyramid.QueryTexels(x0, y0, x0 + (i & 1023), y0 + ((i >> 3) & 1023), minHeight, maxHeight);
+		range += maxHeight - minHeight;
+	}
+	seconds = GetTimeSeconds() - start;
+	printf("pyramid query %8d rects  %10.3f ms  %8.2f Mqueries/s  (average range %.1f)\n",
+		queries, seconds * 1000.0, (double)queries / seconds * 1e-6, (double)range / queries);
+}
@@ -0,0 +1,368 @@
+//--------------------------------------------------------------------------------------
+// File: HeightStreamer.cpp
+//--------------------------------------------------------------------------------------
+#include "HeightStreamer.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Stride of the reads that fault the pages of a new view in on the worker
+#define HEIGHT_STREAMER_PAGE_SIZE 4096
+
+
+//--------------------------------------------------------------------------------------
+// HeightStreamer
+//--------------------------------------------------------------------------------------
+bool HeightStreamer::Open(const char* pFileName, const HeightStreamerDesc& desc)
+{
+	Close();
+	if (!m_File.Open(pFileName))
+		return false;
+
+	MappedRange range;
+	if (!m_File.MapRange(0, sizeof(TiledHeightmapHeader), range))
+	{
+		Close();
+		return false;
+	}
+	memcpy(&m_Header, range.pData, sizeof(m_Header));
+	FileMapping::UnmapRange(range);
+	if (!ValidateTiledHeightmapHeader(m_Header, m_File.GetSize()))
+	{
+		Close();
+		return false;
+	}
+
+	m_Desc = desc;
+	m_Stats = HeightStreamerStats();
+	m_HasRequests = false;
+	m_Stop = false;
+	for (int t = 0; t < desc.Threads; t++)
+		m_Workers.push_back(std::thread(&HeightStreamer::WorkerLoop, this));
+	return true;
+}
+
+void HeightStreamer::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_WorkCondition.notify_all();
+	for (size_t t = 0; t < m_Workers.size(); t++)
+		m_Workers[t].join();
+	m_Workers.clear();
+
+	for (size_t c = 0; c < m_Completed.size(); c++)
+		FileMapping::UnmapRange(m_Completed[c].Range);
+	for (size_t e = 0; e < m_Evicted.size(); e++)
+		FileMapping::UnmapRange(m_Evicted[e]);
+	for (std::unordered_map<TileKey, Tile>::iterator it = m_Tiles.begin(); it != m_Tiles.end(); ++it)
+		FileMapping::UnmapRange(it->second.Range);
+	m_Completed.clear();
+	m_Evicted.clear();
+	m_Queue.clear();
+	m_InFlight.clear();
+	m_Tiles.clear();
+	m_Lru.clear();
+	m_ReservedBytes = 0;
+	m_Busy = 0;
+	m_File.Close();
+}
+
+HeightStreamer::TileKey HeightStreamer::MakeKey(unsigned int tileX, unsigned int tileY, int mip)
+{
+	// At most 2^28 tiles per side with the smallest tile size
+	return ((TileKey)mip << 56) | ((TileKey)tileY << 28) | tileX;
+}
+
+int HeightStreamer::GetRequestMip(float distance) const
+{
+	int mip = 0;
+	float limit = m_Desc.MipDistance;
+	while (distance > limit && mip < (int)m_Header.MipCount - 1)
+	{
+		mip++;
+		limit *= 2.0f;
+	}
+	return mip;
+}
+
+void HeightStreamer::MapTile(const Request& request, Completion& completion) const
+{
+	unsigned int tileX = (unsigned int)(request.Key & 0xfffffff);
+	unsigned int tileY = (unsigned int)((request.Key >> 28) & 0xfffffff);
+	int mip = (int)(request.Key >> 56);
+	unsigned int offset, size;
+	GetHeightTileMipLayout(m_Header, mip, offset, size);
+
+	completion.Key = request.Key;
+	completion.Bytes = request.Bytes;
+	if (!m_File.MapRange(GetHeightTileOffset(m_Header, tileX, tileY) + offset, size, completion.Range))
+		return;
+
+	// Mapping only reserves the addresses, reading a byte of every page loads it here
+	// instead of on the first sample
+	volatile unsigned char sink = 0;
+	for (unsigned int i = 0; i < size; i += HEIGHT_STREAMER_PAGE_SIZE)
+		sink += completion.Range.pData[i];
+	sink += completion.Range.pData[size - 1];
+	(void)sink;
+}
+
+void HeightStreamer::Integrate(const Completion& completion)
+{
+	m_ReservedBytes -= completion.Bytes;
+	if (!completion.Range.pData)
+	{
+		m_Stats.FailedTiles++;
+		return;
+	}
+
+	m_Lru.push_front(completion.Key);
+	Tile& tile = m_Tiles[completion.Key];
+	tile.Range = completion.Range;
+	tile.Bytes = completion.Bytes;
+	tile.LastUpdate = m_UpdateIndex - 1;
+	tile.LruPosition = m_Lru.begin();
+	m_Stats.ResidentBytes += completion.Bytes;
+	m_Stats.MappedTiles++;
+	m_Stats.MappedBytes += completion.Bytes;
+}
+
+void HeightStreamer::Touch(Tile& tile)
+{
+	tile.LastUpdate = m_UpdateIndex;
+	m_Lru.splice(m_Lru.begin(), m_Lru, tile.LruPosition);
+}
+
+bool HeightStreamer::EvictLeastRecent()
+{
+	if (m_Lru.empty())
+		return false;
+	TileKey key = m_Lru.back();
+	std::unordered_map<TileKey, Tile>::iterator it = m_Tiles.find(key);
+	if (it->second.LastUpdate == m_UpdateIndex)
+		return false;
+
+	// Unmapping is as slow as mapping, leave it to the workers. Called with the mutex held.
+	m_Stats.ResidentBytes -= it->second.Bytes;
+	m_Stats.EvictedTiles++;
+	if (m_Workers.empty())
+		FileMapping::UnmapRange(it->second.Range);
+	else
+		m_Evicted.push_back(it->second.Range);
+	m_Tiles.erase(it);
+	m_Lru.pop_back();
+	return true;
+}
+
+void HeightStreamer::Update(float x, float y)
+{
+	if (!IsOpen())
+		return;
+	m_UpdateIndex++;
+
+	// Tiles the workers mapped since the last update
+	std::vector<Completion> completed;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		completed.swap(m_Completed);
+		for (size_t c = 0; c < completed.size(); c++)
+			m_InFlight.erase(completed[c].Key);
+	}
+	for (size_t c = 0; c < completed.size(); c++)
+		Integrate(completed[c]);
+
+	float moveThreshold = m_Header.TileSize * HEIGHT_STREAMER_MOVE_THRESHOLD;
+	if (!m_HasRequests || fabsf(x - m_RequestX) >= moveThreshold || fabsf(y - m_RequestY) >= moveThreshold)
+		RequestTiles(x, y);
+
+	if (m_Desc.Threads == 0)
+	{
+		for (int i = 0; i < m_Desc.MaxMapsPerUpdate && !m_Queue.empty(); i++)
+		{
+			Completion completion;
+			MapTile(m_Queue.front(), completion);
+			m_Queue.pop_front();
+			Integrate(completion);
+			std::unordered_map<TileKey, Tile>::iterator it = m_Tiles.find(completion.Key);
+			if (it != m_Tiles.end())
+				Touch(it->second);
+		}
+	}
+	m_Stats.QueuedRequests = (int)m_Queue.size();
+	m_Stats.ResidentTiles = (int)m_Tiles.size();
+}
+
+void HeightStreamer::RequestTiles(float x, float y)
+{
+	m_RequestX = x;
+	m_RequestY = y;
+	m_HasRequests = true;
+
+	// Tiles within the radius, nearest first
+	m_Candidates.clear();
+	float tileSize = (float)m_Header.TileSize;
+	float radius = m_Desc.Radius;
+	int tileX0 = std::max((int)floorf((x - radius) / tileSize), 0);
+	int tileY0 = std::max((int)floorf((y - radius) / tileSize), 0);
+	int tileX1 = std::min((int)floorf((x + radius) / tileSize), (int)m_Header.TilesX - 1);
+	int tileY1 = std::min((int)floorf((y + radius) / tileSize), (int)m_Header.TilesY - 1);
+	for (int tileY = tileY0; tileY <= tileY1; tileY++)
+	{
+		for (int tileX = tileX0; tileX <= tileX1; tileX++)
+		{
+			float dx = std::max(std::max(tileX * tileSize - x, x - (tileX + 1) * tileSize), 0.0f);
+			float dy = std::max(std::max(tileY * tileSize - y, y - (tileY + 1) * tileSize), 0.0f);
+			float distance = sqrtf(dx * dx + dy * dy);
+			if (distance > radius)
+				continue;
+
+			int mip = GetRequestMip(distance);
+			unsigned int offset, size;
+			GetHeightTileMipLayout(m_Header, mip, offset, size);
+			Request request = { MakeKey(tileX, tileY, mip), distance, size };
+			m_Candidates.push_back(request);
+		}
+	}
+	struct NearerRequest
+	{
+		bool operator()(const Request& a, const Request& b) const
+		{
+			return a.Distance < b.Distance || (a.Distance == b.Distance && a.Key < b.Key);
+		}
+	};
+	std::sort(m_Candidates.begin(), m_Candidates.end(), NearerRequest());
+
+	// The nearest tiles that fit the budget together, resident or not
+	unsigned long long wanted = 0;
+	size_t count = 0;
+	while (count < m_Candidates.size() && wanted + m_Candidates[count].Bytes <= m_Desc.BudgetBytes)
+		wanted += m_Candidates[count++].Bytes;
+	m_Stats.DroppedRequests = (int)(m_Candidates.size() - count);
+	m_Candidates.resize(count);
+
+	// Touch the resident ones first so that the requests cannot evict them
+	for (size_t c = 0; c < m_Candidates.size(); c++)
+	{
+		std::unordered_map<TileKey, Tile>::iterator it = m_Tiles.find(m_Candidates[c].Key);
+		if (it != m_Tiles.end())
+			Touch(it->second);
+	}
+
+	// Requests of the last update that were not taken yet are replaced by this one's
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (size_t q = 0; q < m_Queue.size(); q++)
+			m_ReservedBytes -= m_Queue[q].Bytes;
+		m_Queue.clear();
+		for (size_t c = 0; c < m_Candidates.size(); c++)
+		{
+			const Request& request = m_Candidates[c];
+			if (m_Tiles.count(request.Key) || m_InFlight.count(request.Key))
+				continue;
+			while (m_Stats.ResidentBytes + m_ReservedBytes + request.Bytes > m_Desc.BudgetBytes && EvictLeastRecent())
+				;
+			if (m_Stats.ResidentBytes + m_ReservedBytes + request.Bytes > m_Desc.BudgetBytes)
+				break;
+			m_Queue.push_back(request);
+			m_ReservedBytes += request.Bytes;
+		}
+		m_Stats.PeakBytes = std::max(m_Stats.PeakBytes, m_Stats.ResidentBytes + m_ReservedBytes);
+	}
+	m_WorkCondition.notify_all();
+}
+
+void HeightStreamer::WaitIdle()
+{
+	if (m_Workers.empty())
+		return;
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (!m_Queue.empty() || m_Busy > 0)
+		m_IdleCondition.wait(lock);
+}
+
+void HeightStreamer::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	for (;;)
+	{
+		while (m_Queue.empty() && m_Evicted.empty() && !m_Stop)
+			m_WorkCondition.wait(lock);
+		if (m_Stop)
+			return;
+
+		if (!m_Evicted.empty())
+		{
+			std::vector<MappedRange> evicted;
+			evicted.swap(m_Evicted);
+			lock.unlock();
+			for (size_t e = 0; e < evicted.size(); e++)
+				FileMapping::UnmapRange(evicted[e]);
+			lock.lock();
+			continue;
+		}
+
+		Request request = m_Queue.front();
+		m_Queue.pop_front();
+		m_InFlight.insert(request.Key);
+		m_Busy++;
+		lock.unlock();
+
+		Completion completion;
+		MapTile(request, completion);
+
+		lock.lock();
+		m_Completed.push_back(completion);
+		m_Busy--;
+		if (m_Queue.empty() && m_Busy == 0)
+			m_IdleCondition.notify_all();
+	}
+}
+
+const unsigned char* HeightStreamer::GetTile(unsigned int tileX, unsigned int tileY, int mip)
+{
+	TileKey key = MakeKey(tileX, tileY, mip);
+	std::unordered_map<TileKey, Tile>::iterator it = m_Tiles.find(key);
+	if (it == m_Tiles.end())
+		return NULL;
+	Touch(it->second);
+	return it->second.Range.pData;
+}
+
+const unsigned char* HeightStreamer::FindTile(unsigned int tileX, unsigned int tileY, int mip, int& residentMip)
+{
+	for (int m = mip; m < (int)m_Header.MipCount; m++)
+	{
+		const unsigned char* pData = GetTile(tileX, tileY, m);
+		if (pData)
+		{
+			residentMip = m;
+			return pData;
+		}
+	}
+	return NULL;
+}
+
+bool HeightStreamer::SampleHeight(float x, float y, float& height)
+{
+	if (!IsOpen())
+		return false;
+	unsigned int sampleX = (unsigned int)std::min(std::max(x, 0.0f), (float)(m_Header.Width - 1));
+	unsigned int sampleY = (unsigned int)std::min(std::max(y, 0.0f), (float)(m_Header.Height - 1));
+	int mip;
+	const unsigned char* pData = FindTile(sampleX / m_Header.TileSize, sampleY / m_Header.TileSize, 0, mip);
+	if (!pData)
+		return false;
+
+	unsigned int side = m_Header.TileSize >> mip;
+	unsigned int localX = (sampleX % m_Header.TileSize) >> mip;
+	unsigned int localY = (sampleY % m_Header.TileSize) >> mip;
+	height = ReadHeightSample((HEIGHT_FORMAT)m_Header.Format, pData, localY * side + localX);
+	return true;
+}
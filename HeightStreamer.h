@@ -0,0 +1,162 @@
+//--------------------------------------------------------------------------------------
+// File: HeightStreamer.h
+//
+// Streams the tiles of a TiledHeightmap around a point. Every Update requests the
+// tiles within a radius, each at the mip its distance needs, nearest first, and cuts
+// the request list where it would exceed the memory budget. Worker threads map the
+// requested tile mips and touch their pages, so using a tile never waits for the disk.
+// The tiles stay mapped in an LRU cache: a request that does not fit evicts the tiles
+// used least recently, never one requested in the same Update. The workers also unmap
+// the evicted views, and the requests are only rebuilt once the point moved by a
+// quarter tile, so an Update without new tiles costs next to nothing.
+//
+// Only Update changes what is resident, so the data returned by GetTile stays valid
+// until the next Update. Positions and distances are in samples of mip 0.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "MappedFile.h"
+#include "TiledHeightmap.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Movement in tiles along x or y that rebuilds the requests. The tiles an Update asks
+// for are those around the point of the last rebuild.
+#define HEIGHT_STREAMER_MOVE_THRESHOLD 0.25f
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct HeightStreamerDesc
+{
+	unsigned long long BudgetBytes = 256ull << 20;  // mapped sample bytes of all tiles, in flight included
+	float Radius = 4096.0f;             // tiles closer than this are requested
+	float MipDistance = 512.0f;         // mip m is requested up to MipDistance * 2^m
+	int Threads = 1;                    // 0 maps requests in Update, for tests
+	int MaxMapsPerUpdate = 64;          // with Threads 0
+};
+
+struct HeightStreamerStats
+{
+	int ResidentTiles = 0;
+	unsigned long long ResidentBytes = 0;
+	unsigned long long PeakBytes = 0;   // largest resident and in flight bytes so far
+	int QueuedRequests = 0;             // requested in the last Update and not mapped yet
+	int DroppedRequests = 0;            // tiles of the last Update beyond the budget
+	long long MappedTiles = 0;
+	unsigned long long MappedBytes = 0;
+	long long EvictedTiles = 0;
+	long long FailedTiles = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// HeightStreamer
+//--------------------------------------------------------------------------------------
+class HeightStreamer
+{
+public:
+	HeightStreamer() : m_Header() {}
+	~HeightStreamer() { Close(); }
+
+	// Opens and validates the file and starts the workers
+	bool Open(const char* pFileName, const HeightStreamerDesc& desc);
+	void Close();
+
+	// Integrates the tiles mapped since the last call and requests the tiles around
+	// (x, y), evicting what the requests need room for
+	void Update(float x, float y);
+
+	// Blocks until every queued request is mapped. The tiles become resident in the
+	// next Update.
+	void WaitIdle();
+
+	// Samples of a tile mip, NULL unless resident. Marks the tile as used.
+	const unsigned char* GetTile(unsigned int tileX, unsigned int tileY, int mip);
+
+	// Finest resident mip of a tile at or above mip, NULL if there is none
+	const unsigned char* FindTile(unsigned int tileX, unsigned int tileY, int mip, int& residentMip);
+
+	// Nearest sample of the finest resident mip at (x, y), false if no mip of its tile is
+	// resident
+	bool SampleHeight(float x, float y, float& height);
+
+	// Mip an Update at distance from a tile requests
+	int GetRequestMip(float distance) const;
+
+	bool IsOpen() const { return m_File.IsOpen(); }
+	const TiledHeightmapHeader& GetHeader() const { return m_Header; }
+	const HeightStreamerStats& GetStats() const { return m_Stats; }
+
+private:
+	HeightStreamer(const HeightStreamer&);
+	HeightStreamer& operator=(const HeightStreamer&);
+
+	typedef unsigned long long TileKey;
+
+	struct Request
+	{
+		TileKey Key;
+		float Distance;
+		unsigned int Bytes;
+	};
+
+	struct Completion
+	{
+		TileKey Key;
+		unsigned int Bytes;
+		MappedRange Range;                  // empty if the mapping failed
+	};
+
+	struct Tile
+	{
+		MappedRange Range;
+		unsigned int Bytes;
+		unsigned long long LastUpdate;
+		std::list<TileKey>::iterator LruPosition;
+	};
+
+	static TileKey MakeKey(unsigned int tileX, unsigned int tileY, int mip);
+	void MapTile(const Request& request, Completion& completion) const;
+	void Integrate(const Completion& completion);
+	void Touch(Tile& tile);
+	bool EvictLeastRecent();
+	void RequestTiles(float x, float y);
+	void WorkerLoop();
+
+	FileMapping m_File;
+	TiledHeightmapHeader m_Header;
+	HeightStreamerDesc m_Desc;
+	HeightStreamerStats m_Stats;
+
+	// Update thread only
+	std::unordered_map<TileKey, Tile> m_Tiles;
+	std::list<TileKey> m_Lru;                   // most recently used first
+	unsigned long long m_UpdateIndex = 0;
+	unsigned long long m_ReservedBytes = 0;     // queued, mapping and mapped but not integrated
+	std::vector<Request> m_Candidates;
+	float m_RequestX = 0.0f, m_RequestY = 0.0f; // where the requests were built
+	bool m_HasRequests = false;
+
+	// Shared with the workers
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkCondition;
+	std::condition_variable m_IdleCondition;
+	std::deque<Request> m_Queue;
+	std::unordered_set<TileKey> m_InFlight;     // taken by a worker and not integrated yet
+	std::vector<Completion> m_Completed;
+	std::vector<MappedRange> m_Evicted;         // views left to unmap
+	int m_Busy = 0;
+	bool m_Stop = false;
+	std::vector<std::thread> m_Workers;
+};
@@ -0,0 +1,342 @@
+//--------------------------------------------------------------------------------------
+// File: HeightStreamerSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "HeightStreamer.h"
+#include "TiledHeightmap.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Tiled heightmap streaming. Synthetic heightmaps are written with the streaming writer,
+// read back through the mapped tile mips, and streamed along camera paths under small
+// budgets so that eviction runs constantly.
+//--------------------------------------------------------------------------------------
+#define STREAMING_FILE              "StreamingBenchmark.tiles"
+#define STREAMING_TILE_SIZE         64
+#define STREAMING_MAP_SIZE          1024
+#define STREAMING_BUDGET_TILES      40
+#define STREAMING_PATH_STEPS        200
+
+// Smooth waves with hashed noise on top, in [0.1, 0.9]
+static float SyntheticHeight(unsigned int x, unsigned int y)
+{
+	unsigned int h = (x * 73856093u) ^ (y * 19349663u);
+	h = (h ^ (h >> 13)) * 0x5bd1e995;
+	float noise = (float)((h ^ (h >> 15)) & 0xffff) / 65535.0f;
+	return 0.5f + 0.3f * sinf(x * 0.011f) * cosf(y * 0.007f) + 0.1f * (noise - 0.5f);
+}
+
+static void SyntheticHeightRow(unsigned int width, unsigned int y, float* pRow)
+{
+	for (unsigned int x = 0; x < width; x++)
+		pRow[x] = SyntheticHeight(x, y);
+}
+
+// What a sample of the synthetic heightmap reads back as in a format
+static float QuantizeHeight(HEIGHT_FORMAT format, float value)
+{
+	if (format == HEIGHT_FORMAT_R32_FLOAT)
+		return value;
+	return (unsigned short)(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f) / 65535.0f;
+}
+
+// Compares every mip of every tile of a written file with the tile built here: clamped
+// to the heightmap and box filtered in float. Fails the first difference.
+static bool CheckTiledHeightmapFile(const char* pFileName, HEIGHT_FORMAT format, const char* pLabel, SuiteCheck& check)
+{
+	FileMapping file;
+	MappedRange range;
+	if (!file.Open(pFileName) || !file.MapRange(0, (size_t)file.GetSize(), range))
+	{
+		check.Fail("%s: cannot map the file", pLabel);
+		return false;
+	}
+
+	TiledHeightmapHeader header;
+	memcpy(&header, range.pData, sizeof(header));
+	bool valid = !check.FailIf(!ValidateTiledHeightmapHeader(header, file.GetSize()) ||
+		header.Format != (unsigned int)format, "%s: invalid header", pLabel);
+
+	unsigned int size = header.TileSize;
+	std::vector<float> tile((size_t)size * size);
+	for (unsigned int tileY = 0; tileY < header.TilesY && valid; tileY++)
+	{
+		for (unsigned int tileX = 0; tileX < header.TilesX && valid; tileX++)
+		{
+			for (unsigned int y = 0; y < size; y++)
+			{
+				for (unsigned int x = 0; x < size; x++)
+				{
+					unsigned int sampleX = std::min(tileX * size + x, header.Width - 1);
+					unsigned int sampleY = std::min(tileY * size + y, header.Height - 1);
+					tile[y * size + x] = SyntheticHeight(sampleX, sampleY);
+				}
+			}
+			for (int mip = 0; mip < (int)header.MipCount && valid; mip++)
+			{
+				unsigned int side = size >> mip;
+				if (mip > 0)
+				{
+					unsigned int previous = side * 2;
+					std::vector<float> filtered((size_t)side * side);
+					for (unsigned int y = 0; y < side; y++)
+					{
+						for (unsigned int x = 0; x < side; x++)
+						{
+							const float* p = &tile[(2 * y) * previous + 2 * x];
+							filtered[y * side + x] = (p[0] + p[1] + p[previous] + p[previous + 1]) * 0.25f;
+						}
+					}
+					std::copy(filtered.begin(), filtered.end(), tile.begin());
+				}
+
+				unsigned int offset, mipSize;
+				GetHeightTileMipLayout(header, mip, offset, mipSize);
+				const unsigned char* pMip = range.pData + GetHeightTileOffset(header, tileX, tileY) + offset;
+				for (unsigned int i = 0; i < side * side; i++)
+				{
+					if (ReadHeightSample(format, pMip, i) != QuantizeHeight(format, tile[i]))
+					{
+						check.Fail("%s: tile (%u, %u) mip %d sample %u is %f, expected %f", pLabel, tileX, tileY, mip,
+							i, ReadHeightSample(format, pMip, i), QuantizeHeight(format, tile[i]));
+						valid = false;
+						break;
+					}
+				}
+			}
+		}
+	}
+	FileMapping::UnmapRange(range);
+	return valid;
+}
+
+// Streams along a path from one corner to the other and back. Every step the budget has
+// to hold, the tiles within MipDistance of where the requests were built have to be
+// resident at mip 0 once they are mapped, and the sample under the camera has to be the
+// written one. Fails the first problem found.
+static bool CheckStreamingPath(HeightStreamer& streamer, const HeightStreamerDesc& desc, bool wait, const char* pLabel,
+	SuiteCheck& check)
+{
+	const TiledHeightmapHeader& header = streamer.GetHeader();
+	bool valid = true;
+	for (int step = 0; step <= 2 * STREAMING_PATH_STEPS && valid; step++)
+	{
+		float t = (float)(step <= STREAMING_PATH_STEPS ? step : 2 * STREAMING_PATH_STEPS - step) / STREAMING_PATH_STEPS;
+		float x = 40.0f + t * (header.Width - 80.0f);
+		float y = 40.0f + t * t * (header.Height - 80.0f);
+		streamer.Update(x, y);
+		if (wait)
+		{
+			streamer.WaitIdle();
+			streamer.Update(x, y);
+		}
+
+		const HeightStreamerStats& stats = streamer.GetStats();
+		if (stats.ResidentBytes > desc.BudgetBytes || stats.PeakBytes > desc.BudgetBytes || stats.FailedTiles > 0)
+		{
+			check.Fail("%s: step %d has %llu bytes resident, peak %llu, budget %llu, %lld failed", pLabel, step,
+				stats.ResidentBytes, stats.PeakBytes, desc.BudgetBytes, stats.FailedTiles);
+			valid = false;
+			break;
+		}
+
+		unsigned int size = header.TileSize;
+		// The requests were built within a quarter tile along x and y
+		float distance = desc.MipDistance - size * HEIGHT_STREAMER_MOVE_THRESHOLD * sqrtf(2.0f);
+		int tileX0 = std::max((int)floorf((x - distance) / size), 0);
+		int tileY0 = std::max((int)floorf((y - distance) / size), 0);
+		int tileX1 = std::min((int)floorf((x + distance) / size), (int)header.TilesX - 1);
+		int tileY1 = std::min((int)floorf((y + distance) / size), (int)header.TilesY - 1);
+		for (int tileY = tileY0; tileY <= tileY1 && valid; tileY++)
+		{
+			for (int tileX = tileX0; tileX <= tileX1 && valid; tileX++)
+			{
+				float dx = std::max(std::max(tileX * (float)size - x, x - (tileX + 1) * (float)size), 0.0f);
+				float dy = std::max(std::max(tileY * (float)size - y, y - (tileY + 1) * (float)size), 0.0f);
+				valid = !check.FailIf(dx * dx + dy * dy <= distance * distance && !streamer.GetTile(tileX, tileY, 0),
+					"%s: step %d tile (%d, %d) is not resident", pLabel, step, tileX, tileY);
+			}
+		}
+
+		float height;
+		float expected = QuantizeHeight((HEIGHT_FORMAT)header.Format, SyntheticHeight((unsigned int)x, (unsigned int)y));
+		valid = valid && !check.FailIf(!streamer.SampleHeight(x, y, height) || height != expected,
+			"%s: step %d samples the wrong height at (%.1f, %.1f)", pLabel, step, x, y);
+	}
+	return valid;
+}
+
+int VerifyStreaming()
+{
+	SuiteCheck check("streaming");
+	HeightRowFunction rowFunction = [](unsigned int y, float* pRow) { SyntheticHeightRow(300, y, pRow); };
+	check.FailIf(WriteTiledHeightmap(STREAMING_FILE, 300, 170, HEIGHT_FORMAT_R16_UNORM, 48, rowFunction) ||
+		WriteTiledHeightmap(STREAMING_FILE, 300, 170, HEIGHT_FORMAT_R16_UNORM, 8, rowFunction) ||
+		WriteTiledHeightmap(STREAMING_FILE, 0, 170, HEIGHT_FORMAT_R16_UNORM, STREAMING_TILE_SIZE, rowFunction),
+		"invalid heightmaps were written");
+
+	// Both formats with partial tiles at the right and bottom edges
+	static const HEIGHT_FORMAT s_Formats[] = { HEIGHT_FORMAT_R16_UNORM, HEIGHT_FORMAT_R32_FLOAT };
+	for (int f = 0; f < 2; f++)
+	{
+		const char* pLabel = (f == 0) ? "r16" : "r32f";
+		if (!WriteTiledHeightmap(STREAMING_FILE, 300, 170, s_Formats[f], STREAMING_TILE_SIZE, rowFunction))
+		{
+			check.Fail("%s: write failed", pLabel);
+			continue;
+		}
+		CheckTiledHeightmapFile(STREAMING_FILE, s_Formats[f], pLabel, check);
+	}
+
+	// Truncated and corrupt files are rejected
+	std::vector<unsigned char> bytes;
+	FILE* pFile = fopen(STREAMING_FILE, "rb");
+	if (pFile)
+	{
+		fseek(pFile, 0, SEEK_END);
+		bytes.resize((size_t)ftell(pFile));
+		fseek(pFile, 0, SEEK_SET);
+		if (fread(&bytes[0], 1, bytes.size(), pFile) != bytes.size())
+			bytes.clear();
+		fclose(pFile);
+	}
+	for (int corruption = 0; corruption < 2 && !bytes.empty(); corruption++)
+	{
+		std::vector<unsigned char> corrupt = bytes;
+		if (corruption == 0)
+			corrupt.resize(corrupt.size() - TILED_HEIGHTMAP_ALIGNMENT);
+		else
+			corrupt[offsetof(TiledHeightmapHeader, TilesX)]++;
+		pFile = fopen(STREAMING_FILE, "wb");
+		if (pFile)
+		{
+			fwrite(&corrupt[0], 1, corrupt.size(), pFile);
+			fclose(pFile);
+		}
+		HeightStreamer streamer;
+		check.FailIf(streamer.Open(STREAMING_FILE, HeightStreamerDesc()), "%s file was opened",
+			corruption == 0 ? "truncated" : "corrupt");
+	}
+
+	HeightRowFunction mapFunction = [](unsigned int y, float* pRow) { SyntheticHeightRow(STREAMING_MAP_SIZE, y, pRow); };
+	if (!WriteTiledHeightmap(STREAMING_FILE, STREAMING_MAP_SIZE, STREAMING_MAP_SIZE, HEIGHT_FORMAT_R16_UNORM,
+		STREAMING_TILE_SIZE, mapFunction))
+	{
+		check.Fail("write of the %d map failed", STREAMING_MAP_SIZE);
+		remove(STREAMING_FILE);
+		return check.Finish();
+	}
+	unsigned int tileBytes = STREAMING_TILE_SIZE * STREAMING_TILE_SIZE * 2;
+
+	// Nearest first: with one map per update the tile under the point comes first
+	HeightStreamerDesc desc;
+	desc.BudgetBytes = STREAMING_BUDGET_TILES * tileBytes;
+	desc.Radius = 256.0f;
+	desc.MipDistance = 64.0f;
+	desc.Threads = 0;
+	desc.MaxMapsPerUpdate = 1;
+	HeightStreamer streamer;
+	if (!streamer.Open(STREAMING_FILE, desc))
+	{
+		check.Fail("cannot open the streamed map");
+		remove(STREAMING_FILE);
+		return check.Finish();
+	}
+	streamer.Update(500.0f, 300.0f);
+	check.FailIf(streamer.GetStats().ResidentTiles != 1 ||
+		!streamer.GetTile(500 / STREAMING_TILE_SIZE, 300 / STREAMING_TILE_SIZE, 0),
+		"the first tile mapped is not the one under the point");
+
+	// LRU: with room for three tiles, the one not used for longest goes first
+	desc.BudgetBytes = 3 * tileBytes;
+	desc.Radius = 0.0f;
+	desc.MaxMapsPerUpdate = 64;
+	streamer.Open(STREAMING_FILE, desc);
+	static const int s_Tiles[4][2] = { { 1, 1 }, { 5, 1 }, { 9, 1 }, { 13, 1 } };
+	for (int i = 0; i < 3; i++)
+		streamer.Update((s_Tiles[i][0] + 0.5f) * STREAMING_TILE_SIZE, (s_Tiles[i][1] + 0.5f) * STREAMING_TILE_SIZE);
+	streamer.GetTile(s_Tiles[0][0], s_Tiles[0][1], 0);
+	streamer.Update((s_Tiles[3][0] + 0.5f) * STREAMING_TILE_SIZE, (s_Tiles[3][1] + 0.5f) * STREAMING_TILE_SIZE);
+	check.FailIf(streamer.GetStats().EvictedTiles != 1 || streamer.GetTile(s_Tiles[1][0], s_Tiles[1][1], 0) ||
+		!streamer.GetTile(s_Tiles[0][0], s_Tiles[0][1], 0) || !streamer.GetTile(s_Tiles[2][0], s_Tiles[2][1], 0) ||
+		!streamer.GetTile(s_Tiles[3][0], s_Tiles[3][1], 0), "LRU evicted %lld tiles, not the least recently used one",
+		streamer.GetStats().EvictedTiles);
+
+	// Paths under a budget of a fraction of the map, mapped in Update and by workers
+	desc.BudgetBytes = STREAMING_BUDGET_TILES * tileBytes;
+	desc.Radius = 256.0f;
+	streamer.Open(STREAMING_FILE, desc);
+	CheckStreamingPath(streamer, desc, false, "synchronous", check);
+	long long evicted = streamer.GetStats().EvictedTiles;
+	int dropped = streamer.GetStats().DroppedRequests;
+
+	desc.Threads = 2;
+	streamer.Open(STREAMING_FILE, desc);
+	CheckStreamingPath(streamer, desc, true, "workers", check);
+	check.FailIf(evicted == 0 || streamer.GetStats().EvictedTiles == 0, "the paths did not evict any tile");
+	HeightStreamerStats stats = streamer.GetStats();
+	streamer.Close();
+	remove(STREAMING_FILE);
+	return check.Finish("%lld tiles mapped, %lld evicted, peak %.0f KB of %.0f KB, %d requests dropped", stats.MappedTiles,
+		stats.EvictedTiles, stats.PeakBytes / 1024.0, desc.BudgetBytes / 1024.0, dropped);
+}
+
+void RunStreamingSuite(const BenchmarkOptions& options)
+{
+	unsigned int size = options.HeightmapSize;
+	double start = GetTimeSeconds();
+	HeightRowFunction rowFunction = [size](unsigned int y, float* pRow) { SyntheticHeightRow(size, y, pRow); };
+	if (!WriteTiledHeightmap(STREAMING_FILE, size, size, HEIGHT_FORMAT_R16_UNORM, 256, rowFunction))
+	{
+		printf("streaming: cannot write a %ux%u heightmap\n", size, size);
+		remove(STREAMING_FILE);
+		return;
+	}
+	double writeSeconds = GetTimeSeconds() - start;
+
+	HeightStreamerDesc desc;
+	desc.BudgetBytes = 64ull << 20;
+	desc.Threads = 2;
+	HeightStreamer streamer;
+	if (!streamer.Open(STREAMING_FILE, desc))
+	{
+		printf("streaming: cannot open %s\n", STREAMING_FILE);
+		remove(STREAMING_FILE);
+		return;
+	}
+	const TiledHeightmapHeader& header = streamer.GetHeader();
+	double fileMB = header.FileSize / (1024.0 * 1024.0);
+	printf("streaming %ux%u r16  %.1f MB written in %.2f s  %.1f MB/s\n", size, size, fileMB, writeSeconds,
+		fileMB / writeSeconds);
+
+	// Five seconds of a 60 Hz flight across the map, without waiting for the workers
+	const int frames = 300;
+	double updateSeconds = 0.0;
+	int hits = 0;
+	unsigned long long residentBytes = 0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		float t = (float)frame / frames;
+		float x = t * size, y = (0.5f + 0.4f * sinf(t * 6.2831853f)) * size;
+		start = GetTimeSeconds();
+		streamer.Update(x, y);
+		updateSeconds += GetTimeSeconds() - start;
+		int mip;
+		if (streamer.FindTile((unsigned int)x / header.TileSize, (unsigned int)y / header.TileSize, 0, mip) && mip == 0)
+			hits++;
+		residentBytes += streamer.GetStats().ResidentBytes;
+		std::this_thread::sleep_for(std::chrono::microseconds(16667));
+	}
+	const HeightStreamerStats& stats = streamer.GetStats();
+	printf("streaming flight  %d frames  update %7.2f us  mip 0 under the camera %5.1f%%  resident %.1f MB (peak %.1f of %.0f MB)  "
+		"%lld tiles mapped (%.1f MB)  %lld evicted\n", frames, updateSeconds / frames * 1e6, 100.0 * hits / frames,
+		residentBytes / (double)frames / (1024.0 * 1024.0), stats.PeakBytes / (1024.0 * 1024.0),
+		desc.BudgetBytes / (1024.0 * 1024.0), stats.MappedTiles, stats.MappedBytes / (1024.0 * 1024.0), stats.EvictedTiles);
+	streamer.Close();
+	remove(STREAMING_FILE);
+}
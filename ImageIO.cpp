@@ -0,0 +1,226 @@
+//--------------------------------------------------------------------------------------
+// File: ImageIO.cpp
+//--------------------------------------------------------------------------------------
+#include "ImageIO.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <wincodec.h>
+#pragma comment(lib, "windowscodecs.lib")
+#pragma comment(lib, "ole32.lib")
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Netpbm
+//--------------------------------------------------------------------------------------
+static bool ReadNetpbmValue(FILE* pFile, int& value)
+{
+	int c = fgetc(pFile);
+	for (;;)
+	{
+		if (c == '#')
+		{
+			while (c != '\n' && c != EOF)
+				c = fgetc(pFile);
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+		{
+			c = fgetc(pFile);
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (c < '0' || c > '9')
+		return false;
+	value = 0;
+	while (c >= '0' && c <= '9')
+	{
+		value = value * 10 + (c - '0');
+		if (value > 65535)
+			return false;
+		c = fgetc(pFile);
+	}
+	// Exactly one whitespace character separates the header from the texels
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool LoadNetpbm(FILE* pFile, Image& image)
+{
+	char magic[2];
+	if (fread(magic, 1, 2, pFile) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6'))
+		return false;
+
+	int width, height, maxValue;
+	if (!ReadNetpbmValue(pFile, width) || !ReadNetpbmValue(pFile, height) || !ReadNetpbmValue(pFile, maxValue) ||
+		width < 1 || height < 1 || maxValue != 255)
+		return false;
+
+	int sourceChannels = (magic[1] == '5') ? 1 : 3;
+	std::vector<unsigned char> texels((size_t)width * height * sourceChannels);
+	if (fread(texels.data(), 1, texels.size(), pFile) != texels.size())
+		return false;
+
+	image.Width = width;
+	image.Height = height;
+	if (sourceChannels == 1)
+	{
+		image.Channels = 1;
+		image.Texels.swap(texels);
+		return true;
+	}
+
+	image.Channels = 4;
+	image.Texels.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		image.Texels[i * 4 + 0] = texels[i * 3 + 0];
+		image.Texels[i * 4 + 1] = texels[i * 3 + 1];
+		image.Texels[i * 4 + 2] = texels[i * 3 + 2];
+		image.Texels[i * 4 + 3] = 255;
+	}
+	return true;
+}
+
+bool SaveImageFile(const char* pFileName, const Image& image)
+{
+	if (image.Channels != 1 && image.Channels != 2 && image.Channels != 4)
+		return false;
+
+	FILE* pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "P%c\n%d %d\n255\n", image.Channels == 1 ? '5' : '6', image.Width, image.Height);
+	bool success = true;
+	if (image.Channels == 1)
+	{
+		success = fwrite(image.Texels.data(), 1, image.Texels.size(), pFile) == image.Texels.size();
+	}
+	else
+	{
+		std::vector<unsigned char> row((size_t)image.Width * 3);
+		for (int y = 0; y < image.Height && success; y++)
+		{
+			const unsigned char* pSource = &image.Texels[(size_t)y * image.Width * image.Channels];
+			for (int x = 0; x < image.Width; x++)
+			{
+				for (int c = 0; c < 3; c++)
+					row[(size_t)x * 3 + c] = (c < image.Channels) ? pSource[(size_t)x * image.Channels + c] : 0;
+			}
+			success = fwrite(row.data(), 1, row.size(), pFile) == row.size();
+		}
+	}
+	success = (fclose(pFile) == 0) && success;
+	return success;
+}
+
+
+//--------------------------------------------------------------------------------------
+// WIC
+//--------------------------------------------------------------------------------------
+#ifdef _WIN32
+static bool LoadWic(const char* pFileName, Image& image)
+{
+	HRESULT hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	WCHAR wFileName[MAX_PATH];
+	if (MultiByteToWideChar(CP_UTF8, 0, pFileName, -1, wFileName, MAX_PATH) == 0)
+		return false;
+
+	IWICImagingFactory* pFactory = NULL;
+	IWICBitmapDecoder* pDecoder = NULL;
+	IWICBitmapFrameDecode* pFrame = NULL;
+	IWICBitmapSource* pConverted = NULL;
+	HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&pFactory));
+	if (SUCCEEDED(hr))
+		hr = pFactory->CreateDecoderFromFilename(wFileName, NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &pDecoder);
+	if (SUCCEEDED(hr))
+		hr = pDecoder->GetFrame(0, &pFrame);
+	if (SUCCEEDED(hr))
+		hr = WICConvertBitmapSource(GUID_WICPixelFormat32bppRGBA, pFrame, &pConverted);
+
+	UINT width = 0, height = 0;
+	if (SUCCEEDED(hr))
+		hr = pConverted->GetSize(&width, &height);
+	if (SUCCEEDED(hr))
+	{
+		image.Width = (int)width;
+		image.Height = (int)height;
+		image.Channels = 4;
+		image.Texels.resize((size_t)width * height * 4);
+		hr = pConverted->CopyPixels(NULL, width * 4, (UINT)image.Texels.size(), image.Texels.data());
+	}
+
+	if (pConverted) pConverted->Release();
+	if (pFrame) pFrame->Release();
+	if (pDecoder) pDecoder->Release();
+	if (pFactory) pFactory->Release();
+	if (SUCCEEDED(hrInit))
+		CoUninitialize();
+	return SUCCEEDED(hr);
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Common
+//--------------------------------------------------------------------------------------
+bool LoadImageFile(const char* pFileName, Image& image)
+{
+	FILE* pFile = fopen(pFileName, "rb");
+	if (!pFile)
+		return false;
+	int first = fgetc(pFile);
+	bool isNetpbm = (first == 'P');
+	bool success = false;
+	if (isNetpbm)
+	{
+		rewind(pFile);
+		success = LoadNetpbm(pFile, image);
+	}
+	fclose(pFile);
+
+#ifdef _WIN32
+	if (!isNetpbm)
+		success = LoadWic(pFileName, image);
+#endif
+	return success;
+}
+
+void ConvertImage(const Image& source, int channels, Image& destination)
+{
+	destination.Width = source.Width;
+	destination.Height = source.Height;
+	destination.Channels = channels;
+	size_t count = (size_t)source.Width * source.Height;
+	if (source.Channels == channels)
+	{
+		destination.Texels = source.Texels;
+		return;
+	}
+
+	destination.Texels.resize(count * channels);
+	for (size_t i = 0; i < count; i++)
+	{
+		const unsigned char* pSource = &source.Texels[i * source.Channels];
+		unsigned char* pDestination = &destination.Texels[i * channels];
+		for (int c = 0; c < channels; c++)
+		{
+			if (c == 3)
+				pDestination[c] = (source.Channels == 4) ? pSource[3] : 255;
+			else if (source.Channels == 1)
+				pDestination[c] = pSource[0];
+			else
+				pDestination[c] = (c < source.Channels) ? pSource[c] : 0;
+		}
+	}
+}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// File: ImageIO.h
+//
+// 8-bit image loading and saving for the offline tools. Binary Netpbm (PGM/PPM) is
+// supported everywhere; on Windows every other format (JPEG, PNG, ...) is decoded with
+// WIC.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Tightly packed rows of 1 (gray), 2 (normal map x and y) or 4 (RGBA) channels
+struct Image
+{
+	int Width = 0;
+	int Height = 0;
+	int Channels = 0;
+	std::vector<unsigned char> Texels;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// PGM loads as 1 channel, everything else as RGBA with opaque alpha for RGB sources
+bool LoadImageFile(const char* pFileName, Image& image);
+
+// Writes a PGM for 1 channel and a PPM for 2 (blue 0) or 4 (dropping alpha) channels
+bool SaveImageFile(const char* pFileName, const Image& image);
+
+// Gray expands to every color channel, otherwise the channels are copied in order:
+// RGBA reduces to red (1) or red and green (2), x and y expand to RGBA with blue 0.
+// Missing alpha is opaque.
+void ConvertImage(const Image& source, int channels, Image& destination);
@@ -0,0 +1,341 @@
+//--------------------------------------------------------------------------------------
+// File: JobSystem.cpp
+//--------------------------------------------------------------------------------------
+#include "JobSystem.h"
+#include "Timer.h"
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// LinearArena
+//--------------------------------------------------------------------------------------
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	for (;;)
+	{
+		if (m_Block < m_Blocks.size())
+		{
+			std::vector<unsigned char>& block = m_Blocks[m_Block];
+			size_t base = (size_t)block.data();
+			size_t start = ((base + m_Offset + alignment - 1) & ~(alignment - 1)) - base;
+			if (start + size <= block.size())
+			{
+				m_Offset = start + size;
+				return block.data() + start;
+			}
+			m_Used += m_Offset;
+			m_Block++;
+			m_Offset = 0;
+			continue;
+		}
+		m_Blocks.push_back(std::vector<unsigned char>(std::max(m_BlockSize, size + alignment)));
+	}
+}
+
+void LinearArena::Reset()
+{
+	if (m_Blocks.size() > 1)
+	{
+		size_t capacity = GetCapacity();
+		m_Blocks.clear();
+		m_Blocks.push_back(std::vector<unsigned char>(capacity));
+	}
+	m_Block = 0;
+	m_Offset = 0;
+	m_Used = 0;
+}
+
+size_t LinearArena::GetUsedBytes() const
+{
+	return m_Used + m_Offset;
+}
+
+size_t LinearArena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (size_t b = 0; b < m_Blocks.size(); b++)
+		capacity += m_Blocks[b].size();
+	return capacity;
+}
+
+
+//--------------------------------------------------------------------------------------
+// JobSystem
+//--------------------------------------------------------------------------------------
+bool JobSystem::Init(int numThreads)
+{
+	Shutdown();
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	m_Quit = false;
+	m_QueuedJobs = 0;
+	m_SleepingWorkers = 0;
+	for (int w = 0; w < numThreads; w++)
+		m_Workers.push_back(new Worker());
+	for (int w = 1; w < numThreads; w++)
+		m_Threads.push_back(std::thread(&JobSystem::WorkerLoop, this, w));
+	return true;
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Quit = true;
+	}
+	m_WorkAvailable.notify_all();
+	for (size_t t = 0; t < m_Threads.size(); t++)
+		m_Threads[t].join();
+	m_Threads.clear();
+	for (size_t w = 0; w < m_Workers.size(); w++)
+		delete m_Workers[w];
+	m_Workers.clear();
+}
+
+void JobSystem::ParallelFor(int count, int grainSize, const JobRangeFunction& function, int worker)
+{
+	if (count <= 0)
+		return;
+	if (m_Workers.empty())
+		Init(1);
+
+	std::atomic<int> pending(1);
+	Job job;
+	job.pFunction = &function;
+	job.Begin = 0;
+	job.End = count;
+	job.Grain = std::max(grainSize, 1);
+	job.pPending = &pending;
+	job.pCompletion = NULL;
+	job.pContext = NULL;
+	RunJob(worker, job);
+	Wait(worker, pending);
+}
+
+void JobSystem::BeginFrame()
+{
+	for (size_t w = 0; w < m_Workers.size(); w++)
+	{
+		m_Workers[w]->Arena.Reset();
+		m_Workers[w]->Executed = 0;
+		m_Workers[w]->Stolen = 0;
+	}
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+	JobSystemStats stats = { 0, 0 };
+	for (size_t w = 0; w < m_Workers.size(); w++)
+	{
+		stats.Jobs += m_Workers[w]->Executed;
+		stats.Steals += m_Workers[w]->Stolen;
+	}
+	return stats;
+}
+
+// Only a worker that finds no job sleeps, and it counts itself as sleeping before it
+// checks the queued jobs one last time, so a push that sees no sleeper cannot be missed
+void JobSystem::Push(int worker, const Job& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Workers[worker]->Mutex);
+		m_Workers[worker]->Jobs.push_back(job);
+	}
+	m_QueuedJobs++;
+	if (m_SleepingWorkers > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_WorkAvailable.notify_one();
+	}
+}
+
+// Pops the newest job of the worker or steals the oldest of another
+bool JobSystem::TryRunJob(int worker)
+{
+	if (m_QueuedJobs == 0)
+		return false;
+
+	int count = (int)m_Workers.size();
+	for (int i = 0; i < count; i++)
+	{
+		int victim = (worker + i) % count;
+		Worker& queue = *m_Workers[victim];
+		Job job;
+		{
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (queue.Jobs.empty())
+				continue;
+			if (i == 0)
+			{
+				job = queue.Jobs.back();
+				queue.Jobs.pop_back();
+			}
+			else
+			{
+				job = queue.Jobs.front();
+				queue.Jobs.pop_front();
+			}
+		}
+		m_QueuedJobs--;
+		m_Workers[worker]->Stolen += (i == 0) ? 0 : 1;
+		RunJob(worker, job);
+		return true;
+	}
+	return false;
+}
+
+// Pushes the upper halves until the job is small enough, then runs what is left
+void JobSystem::RunJob(int worker, Job job)
+{
+	while (job.End - job.Begin > job.Grain)
+	{
+		Job upper = job;
+		upper.Begin = job.Begin + (job.End - job.Begin) / 2;
+		job.End = upper.Begin;
+		(*job.pPending)++;
+		Push(worker, upper);
+	}
+
+	(*job.pFunction)(job.Begin, job.End, worker);
+	m_Workers[worker]->Executed++;
+	if (--(*job.pPending) == 0 && job.pCompletion)
+		job.pCompletion(job.pContext, worker);
+}
+
+void JobSystem::Wait(int worker, const std::atomic<int>& pending)
+{
+	while (pending > 0)
+	{
+		if (!TryRunJob(worker))
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerLoop(int worker)
+{
+	for (;;)
+	{
+		if (TryRunJob(worker))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_SleepingWorkers++;
+		while (m_QueuedJobs == 0 && !m_Quit)
+			m_WorkAvailable.wait(lock);
+		m_SleepingWorkers--;
+		if (m_Quit)
+			return;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// JobGraph
+//--------------------------------------------------------------------------------------
+JobGraph::~JobGraph()
+{
+	for (size_t p = 0; p < m_Passes.size(); p++)
+		delete m_Passes[p];
+}
+
+JobGraph::Pass& JobGraph::AddPassEntry(const char* pName, const std::vector<JobPassId>& dependencies)
+{
+	if (m_PassCount == (int)m_Passes.size())
+		m_Passes.push_back(new Pass());
+	JobPassId id = m_PassCount++;
+	Pass& pass = *m_Passes[id];
+	pass.Name = pName;
+	pass.Dependents.clear();
+	pass.DependencyCount = 0;
+	pass.StartSeconds = 0.0;
+	pass.EndSeconds = 0.0;
+	pass.pGraph = this;
+	pass.Id = id;
+	for (size_t i = 0; i < dependencies.size(); i++)
+	{
+		if (dependencies[i] < 0 || dependencies[i] >= id)
+			continue;
+		pass.DependencyCount++;
+		m_Passes[dependencies[i]]->Dependents.push_back(id);
+	}
+	return pass;
+}
+
+JobPassId JobGraph::AddPass(const char* pName, const std::function<void(int worker)>& function,
+	const std::vector<JobPassId>& dependencies)
+{
+	Pass& pass = AddPassEntry(pName, dependencies);
+	std::function<void(int worker)> single = function;
+	pass.Function = [single](int, int, int worker) { single(worker); };
+	pass.Count = 1;
+	pass.Grain = 1;
+	return pass.Id;
+}
+
+JobPassId JobGraph::AddParallelPass(const char* pName, int count, int grainSize, const JobRangeFunction& function,
+	const std::vector<JobPassId>& dependencies)
+{
+	Pass& pass = AddPassEntry(pName, dependencies);
+	pass.Function = function;
+	pass.Count = std::max(count, 0);
+	pass.Grain = std::max(grainSize, 1);
+	return pass.Id;
+}
+
+void JobGraph::Execute(JobSystem& jobs, int worker)
+{
+	if (m_PassCount == 0)
+		return;
+	if (jobs.GetThreadCount() == 0)
+		jobs.Init(1);
+
+	m_pJobs = &jobs;
+	m_StartTime = GetTimeSeconds();
+	m_PendingPasses = m_PassCount;
+	for (int p = 0; p < m_PassCount; p++)
+		m_Passes[p]->PendingDependencies = m_Passes[p]->DependencyCount;
+	for (int p = 0; p < m_PassCount; p++)
+	{
+		if (m_Passes[p]->DependencyCount == 0)
+			StartPass(p, worker);
+	}
+	jobs.Wait(worker, m_PendingPasses);
+}
+
+void JobGraph::StartPass(JobPassId id, int worker)
+{
+	Pass& pass = *m_Passes[id];
+	pass.StartSeconds = GetTimeSeconds() - m_StartTime;
+	if (pass.Count == 0)
+	{
+		CompletePass(&pass, worker);
+		return;
+	}
+
+	pass.PendingJobs = 1;
+	JobSystem::Job job;
+	job.pFunction = &pass.Function;
+	job.Begin = 0;
+	job.End = pass.Count;
+	job.Grain = pass.Grain;
+	job.pPending = &pass.PendingJobs;
+	job.pCompletion = &JobGraph::CompletePass;
+	job.pContext = &pass;
+	m_pJobs->Push(worker, job);
+}
+
+// Starts the dependents whose last dependency this was. The graph is only done once
+// they are queued, so Execute cannot return in between.
+void JobGraph::CompletePass(void* pContext, int worker)
+{
+	Pass& pass = *(Pass*)pContext;
+	JobGraph& graph = *pass.pGraph;
+	pass.EndSeconds = GetTimeSeconds() - graph.m_StartTime;
+	for (size_t i = 0; i < pass.Dependents.size(); i++)
+	{
+		if (--graph.m_Passes[pass.Dependents[i]]->PendingDependencies == 0)
+			graph.StartPass(pass.Dependents[i], worker);
+	}
+	graph.m_PendingPasses--;
+}
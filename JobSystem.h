@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------------------
+// File: JobSystem.h
+//
+// Work-stealing job system for the per-frame CPU work, e.g. culling the terrain patches
+// and computing their factors. Unlike TaskGraph, which starts threads for one run of
+// startup tasks, the workers live as long as the system and a job costs a lock and a
+// few words, so a frame can be split into many small jobs.
+//
+// Every worker has its own deque of jobs. It pushes and pops at the back, so the work
+// it split last stays in its cache, and idle workers steal from the front of another
+// deque, where the largest pieces are. ParallelFor splits its range in halves on
+// demand: a worker keeps the lower half and pushes the upper one, down to the grain
+// size, so a range is only cut as finely as stealing needs. The calling thread is
+// worker 0 and runs jobs while it waits. Idle workers sleep until jobs are pushed.
+//
+// Each worker also owns a linear arena for allocations that only live for a frame.
+// JobGraph builds a frame as passes with dependencies, the way a frame graph does:
+// passes whose dependencies completed run at once and independent passes overlap.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Runs the items [begin, end) on the given worker
+typedef std::function<void(int begin, int end, int worker)> JobRangeFunction;
+
+struct JobSystemStats
+{
+	long long Jobs;             // ranges run, one per call of a range function
+	long long Steals;           // jobs taken from the deque of another worker
+};
+
+
+//--------------------------------------------------------------------------------------
+// LinearArena
+//
+// Bump allocator reset as a whole. Memory comes in blocks that are kept across resets;
+// a reset after a frame that needed several merges them into one, so a steady frame
+// allocates nothing.
+//--------------------------------------------------------------------------------------
+class LinearArena
+{
+public:
+	explicit LinearArena(size_t blockSize = 64 * 1024) : m_BlockSize(blockSize) {}
+
+	// alignment has to be a power of two. Never returns NULL.
+	void* Allocate(size_t size, size_t alignment = 16);
+
+	template <class T>
+	T* AllocateArray(size_t count) { return (T*)Allocate(count * sizeof(T)); }
+
+	void Reset();
+
+	size_t GetUsedBytes() const;
+	size_t GetCapacity() const;
+
+private:
+	size_t m_BlockSize;
+	std::vector<std::vector<unsigned char> > m_Blocks;
+	size_t m_Block = 0;         // block allocations come from
+	size_t m_Offset = 0;        // used bytes of that block
+	size_t m_Used = 0;          // of the blocks before it
+};
+
+
+//--------------------------------------------------------------------------------------
+// JobSystem
+//--------------------------------------------------------------------------------------
+class JobSystem
+{
+public:
+	JobSystem() : m_QueuedJobs(0), m_SleepingWorkers(0) {}
+	~JobSystem() { Shutdown(); }
+
+	// Starts numThreads - 1 workers, the calling thread is worker 0 (0 uses every
+	// hardware thread). Init again restarts the workers with the new count.
+	bool Init(int numThreads = 0);
+	void Shutdown();
+
+	int GetThreadCount() const { return (int)m_Workers.size(); }
+
+	// Runs function over [0, count) in ranges of at most grainSize items, on every worker,
+	// and returns when all ranges are done. worker is the worker of the calling thread,
+	// 0 outside of jobs; jobs may start parallel loops of their own.
+	void ParallelFor(int count, int grainSize, const JobRangeFunction& function, int worker = 0);
+
+	// Arena of a worker, only to be used by that worker while jobs run
+	LinearArena& GetFrameArena(int worker) { return m_Workers[worker]->Arena; }
+
+	// Resets the frame arenas and the statistics. No jobs may be running.
+	void BeginFrame();
+
+	JobSystemStats GetStats() const;
+
+private:
+	friend class JobGraph;
+
+	// Called by the worker that completes the last job of a group
+	typedef void (*CompletionFunction)(void* pContext, int worker);
+
+	// The items [Begin, End) of a group, split while larger than Grain
+	struct Job
+	{
+		const JobRangeFunction* pFunction;
+		int Begin;
+		int End;
+		int Grain;
+		std::atomic<int>* pPending;         // jobs of the group not done yet
+		CompletionFunction pCompletion;
+		void* pContext;
+	};
+
+	struct Worker
+	{
+		std::mutex Mutex;
+		std::deque<Job> Jobs;
+		LinearArena Arena;
+		long long Executed = 0;
+		long long Stolen = 0;
+	};
+
+	void Push(int worker, const Job& job);
+	bool TryRunJob(int worker);
+	void RunJob(int worker, Job job);
+	void Wait(int worker, const std::atomic<int>& pending);
+	void WorkerLoop(int worker);
+
+	std::vector<Worker*> m_Workers;
+	std::vector<std::thread> m_Threads;
+	std::atomic<int> m_QueuedJobs;
+	std::atomic<int> m_SleepingWorkers;
+	bool m_Quit = false;
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WorkAvailable;
+};
+
+
+//--------------------------------------------------------------------------------------
+// JobGraph
+//
+// Passes of a frame with their dependencies. Build it every frame, or keep it and run
+// it again; Clear keeps the allocations. A pass runs once all the passes it depends on
+// completed, a parallel pass as a ParallelFor split across the workers.
+//--------------------------------------------------------------------------------------
+typedef int JobPassId;
+
+class JobGraph
+{
+public:
+	JobGraph() : m_PendingPasses(0) {}
+	~JobGraph();
+
+	// Dependencies have to be added before the passes that depend on them, other ids are
+	// ignored
+	JobPassId AddPass(const char* pName, const std::function<void(int worker)>& function,
+		const std::vector<JobPassId>& dependencies = std::vector<JobPassId>());
+	JobPassId AddParallelPass(const char* pName, int count, int grainSize, const JobRangeFunction& function,
+		const std::vector<JobPassId>& dependencies = std::vector<JobPassId>());
+
+	// Runs every pass and returns when all are done. worker is the worker of the calling
+	// thread.
+	void Execute(JobSystem& jobs, int worker = 0);
+
+	void Clear() { m_PassCount = 0; }
+
+	int GetPassCount() const { return m_PassCount; }
+	const std::string& GetName(JobPassId pass) const { return m_Passes[pass]->Name; }
+
+	// Seconds from the start of Execute to when the pass started and completed
+	double GetStartSeconds(JobPassId pass) const { return m_Passes[pass]->StartSeconds; }
+	double GetEndSeconds(JobPassId pass) const { return m_Passes[pass]->EndSeconds; }
+
+private:
+	struct Pass
+	{
+		std::string Name;
+		JobRangeFunction Function;
+		int Count;
+		int Grain;
+		std::vector<JobPassId> Dependents;
+		int DependencyCount;
+		std::atomic<int> PendingDependencies;
+		std::atomic<int> PendingJobs;
+		double StartSeconds;
+		double EndSeconds;
+		JobGraph* pGraph;
+		JobPassId Id;
+	};
+
+	Pass& AddPassEntry(const char* pName, const std::vector<JobPassId>& dependencies);
+	void StartPass(JobPassId pass, int worker);
+	static void CompletePass(void* pContext, int worker);
+
+	std::vector<Pass*> m_Passes;        // kept across Clear for their allocations
+	int m_PassCount = 0;
+	JobSystem* m_pJobs = NULL;
+	std::atomic<int> m_PendingPasses;
+	double m_StartTime = 0.0;
+};
@@ -0,0 +1,277 @@
+//--------------------------------------------------------------------------------------
+// File: JobSystemSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "JobSystem.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "TerrainPatchJobs.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+
+
+//--------------------------------------------------------------------------------------
+// Job system. Parallel loops have to run every item once in ranges within the grain
+// size, also when nested and when workers steal, graph passes have to wait for their
+// dependencies, and the terrain patch jobs have to match the serial culling and count.
+//--------------------------------------------------------------------------------------
+#define JOBS_VERIFY_THREADS     4
+#define JOBS_VERIFY_ITEMS       100000
+#define JOBS_GRID_SIZE          256
+
+void JobsSceneFrame(float t, const SceneSettings& settings, SceneCamera& camera, SceneFrame& scene,
+	float projection[4][4])
+{
+	camera.Eye[0] = 6.0f * cosf(t);
+	camera.Eye[1] = 2.0f + sinf(3.0f * t);
+	camera.Eye[2] = 6.0f * sinf(t);
+	camera.At[0] = 0.5f * cosf(2.0f * t);
+	camera.At[1] = 0.0f;
+	camera.At[2] = 0.0f;
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	UpdateScene(camera, settings, projection, 0.0f, scene);
+}
+
+int VerifyJobSystem()
+{
+	SuiteCheck check("jobs");
+	JobSystem jobs;
+	jobs.Init(JOBS_VERIFY_THREADS);
+
+	// Every item once, in ranges within the grain size, with uneven work so that idle
+	// workers steal
+	const int grain = 37;
+	std::vector<unsigned char> visits(JOBS_VERIFY_ITEMS, 0);
+	std::atomic<int> badRanges(0);
+	jobs.BeginFrame();
+	jobs.ParallelFor(JOBS_VERIFY_ITEMS, grain, [&](int begin, int end, int worker)
+	{
+		if (end - begin > grain || begin >= end || worker < 0 || worker >= JOBS_VERIFY_THREADS)
+			badRanges++;
+		if (begin == 0)
+			SleepMilliseconds(20);
+		for (int i = begin; i < end; i++)
+			visits[i]++;
+	});
+	int wrongVisits = 0;
+	for (int i = 0; i < JOBS_VERIFY_ITEMS; i++)
+		wrongVisits += (visits[i] == 1) ? 0 : 1;
+	JobSystemStats stats = jobs.GetStats();
+	check.FailIf(badRanges > 0 || wrongVisits > 0 || stats.Steals == 0,
+		"%d ranges out of the grain size, %d items not run once, %lld steals", (int)badRanges, wrongVisits,
+		stats.Steals);
+
+	// Loops started from jobs, and arena allocations of the worker running them
+	std::vector<long long> sums(16, 0);
+	std::atomic<int> misaligned(0);
+	jobs.ParallelFor((int)sums.size(), 1, [&](int begin, int end, int worker)
+	{
+		for (int outer = begin; outer < end; outer++)
+		{
+			std::atomic<long long> sum(0);
+			jobs.ParallelFor(1000, 16, [&](int innerBegin, int innerEnd, int innerWorker)
+			{
+				long long* pValues = jobs.GetFrameArena(innerWorker).AllocateArray<long long>(innerEnd - innerBegin);
+				misaligned += ((size_t)pValues % 16 == 0) ? 0 : 1;
+				long long local = 0;
+				for (int i = innerBegin; i < innerEnd; i++)
+				{
+					pValues[i - innerBegin] = (long long)i * (outer + 1);
+					local += pValues[i - innerBegin];
+				}
+				sum += local;
+			}, worker);
+			sums[outer] = sum;
+		}
+	});
+	int wrongSums = 0;
+	for (size_t outer = 0; outer < sums.size(); outer++)
+		wrongSums += (sums[outer] == 999LL * 1000 / 2 * (long long)(outer + 1)) ? 0 : 1;
+	check.FailIf(wrongSums > 0 || misaligned > 0, "%d nested loops with the wrong sum, %d misaligned arena allocations",
+		wrongSums, (int)misaligned);
+
+	// Arenas keep one block of the largest frame
+	LinearArena arena(1024);
+	for (int frame = 0; frame < 3; frame++)
+	{
+		arena.Reset();
+		for (int i = 0; i < 20; i++)
+		{
+			void* p = arena.Allocate(300, 64);
+			misaligned += ((size_t)p % 64 == 0) ? 0 : 1;
+		}
+		arena.Allocate(5000);
+	}
+	size_t capacity = arena.GetCapacity();
+	arena.Reset();
+	arena.Allocate(capacity - 64);
+	check.FailIf(misaligned > 0 || arena.GetCapacity() != capacity || arena.GetUsedBytes() < capacity - 64,
+		"the arena grows after a reset or misaligns allocations");
+
+	// A diamond of passes with a parallel one and an empty one, run twice: every pass
+	// starts after the passes it depends on ended
+	JobGraph graph;
+	std::atomic<int> sequence(0);
+	int order[6][2];
+	std::atomic<int> parallelItems(0);
+	JobPassId a = graph.AddPass("a", [&](int) { order[0][0] = sequence++; SleepMilliseconds(5); order[0][1] = sequence++; });
+	JobPassId b = graph.AddParallelPass("b", 500, 10, [&](int begin, int end, int)
+	{
+		if (begin == 0)
+			order[1][0] = sequence++;
+		parallelItems += end - begin;
+		if (end == 500)
+			order[1][1] = sequence++;
+	}, std::vector<JobPassId>(1, a));
+	JobPassId c = graph.AddPass("c", [&](int) { order[2][0] = sequence++; order[2][1] = sequence++; }, std::vector<JobPassId>(1, a));
+	JobPassId empty = graph.AddParallelPass("empty", 0, 1, [&](int, int, int) { parallelItems += 1000000; },
+		std::vector<JobPassId>(1, c));
+	std::vector<JobPassId> joins;
+	joins.push_back(b);
+	joins.push_back(empty);
+	JobPassId d = graph.AddPass("d", [&](int) { order[4][0] = sequence++; order[4][1] = sequence++; }, joins);
+	int graphErrors = 0;
+	for (int run = 0; run < 2; run++)
+	{
+		parallelItems = 0;
+		graph.Execute(jobs);
+		graphErrors += (parallelItems == 500) ? 0 : 1;
+		graphErrors += (order[1][0] > order[0][1] && order[2][0] > order[0][1]) ? 0 : 1;
+		graphErrors += (order[4][0] > order[1][1] && order[4][0] > order[2][1]) ? 0 : 1;
+		graphErrors += (graph.GetEndSeconds(d) >= graph.GetStartSeconds(a)) ? 0 : 1;
+	}
+	check.FailIf(graphErrors > 0 || graph.GetPassCount() != 5, "%d pass ordering errors", graphErrors);
+
+	// The terrain patch jobs on one and several threads against the serial culling and
+	// counter, with adaptive factors scaled by the density map
+	TerrainGrid grid;
+	grid.Build(JOBS_GRID_SIZE, JOBS_GRID_SIZE);
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, texels);
+	TessDensityMap densityMap;
+	densityMap.Build(&texels[0], DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, 1, TessDensityParams());
+	TerrainTriangleCounter counter;
+	counter.SetDensityMap(&densityMap);
+	TerrainPatchJobs patchJobs;
+	patchJobs.SetDensityMap(&densityMap);
+	JobSystem serialJobs;
+	serialJobs.Init(1);
+	std::vector<int> expected(grid.GetPatchCount()), visible(grid.GetPatchCount());
+	int patchErrors = 0;
+	long long visibleTotal = 0;
+	for (int view = 0; view < 8; view++)
+	{
+		SceneSettings settings;
+		settings.AdaptiveTessellation = (view % 4) != 0;
+		settings.ContentDensity = (view % 2) != 0;
+		settings.QuadPatches = (view % 3) == 0;
+		SceneCamera camera;
+		SceneFrame scene;
+		float projection[4][4];
+		JobsSceneFrame(view * 0.8f, settings, camera, scene, projection);
+		grid.UpdateBounds(scene.WorldScale, settings.Scaling * settings.DisplacementLevel);
+		int expectedCount = grid.Cull(scene.ViewFrustum, &expected[0]);
+		long long expectedTriangles = counter.Count(grid, &expected[0], expectedCount, camera, settings, scene,
+			projection[1][1], SCRIPT_VIEWPORT_HEIGHT);
+		JobSystem* pSystems[2] = { &serialJobs, &jobs };
+		for (int s = 0; s < 2; s++)
+		{
+			pSystems[s]->BeginFrame();
+			long long triangles = -1;
+			int count = patchJobs.Run(*pSystems[s], grid, camera, settings, scene, projection[1][1], SCRIPT_VIEWPORT_HEIGHT,
+				&visible[0], &triangles);
+			if (count != expectedCount || triangles != expectedTriangles ||
+				(count > 0 && memcmp(&visible[0], &expected[0], count * sizeof(int)) != 0))
+			{
+				if (patchErrors++ == 0)
+				{
+					check.Fail("view %d on %d threads has %d patches and %lld triangles, serially %d and %lld", view,
+						pSystems[s]->GetThreadCount(), count, triangles, expectedCount, expectedTriangles);
+				}
+			}
+		}
+		visibleTotal += expectedCount;
+	}
+	return check.Finish("%d items, %lld steals, %lld visible patches in 8 views", JOBS_VERIFY_ITEMS, stats.Steals,
+		visibleTotal);
+}
+
+void RunJobSystemSuite()
+{
+	int maxThreads = std::max(4, (int)std::thread::hardware_concurrency());
+	const int gridSize = 512, frames = 20;
+	TerrainGrid grid;
+	grid.Build(gridSize, gridSize);
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, texels);
+	TessDensityMap densityMap;
+	densityMap.Build(&texels[0], DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, 1, TessDensityParams());
+	SceneSettings settings;
+	settings.AdaptiveTessellation = true;
+	settings.ContentDensity = true;
+	std::vector<int> visible(grid.GetPatchCount());
+
+	// The serial path of Render: TerrainGrid::Cull and TerrainTriangleCounter::Count
+	TerrainTriangleCounter counter;
+	counter.SetDensityMap(&densityMap);
+	double serialSeconds = 0.0;
+	long long patches = 0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		SceneCamera camera;
+		SceneFrame scene;
+		float projection[4][4];
+		JobsSceneFrame(frame * 0.3f, settings, camera, scene, projection);
+		grid.UpdateBounds(scene.WorldScale, settings.Scaling * settings.DisplacementLevel);
+		double start = GetTimeSeconds();
+		int count = grid.Cull(scene.ViewFrustum, &visible[0]);
+		counter.Count(grid, &visible[0], count, camera, settings, scene, projection[1][1], SCRIPT_VIEWPORT_HEIGHT);
+		serialSeconds += GetTimeSeconds() - start;
+		patches += count;
+	}
+	printf("jobs %dx%d patches  serial cull + count %8.3f ms  %8.0f visible\n", gridSize, gridSize,
+		serialSeconds / frames * 1000.0, (double)patches / frames);
+
+	double oneThreadSeconds = 0.0;
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		JobSystem jobs;
+		jobs.Init(threads);
+		TerrainPatchJobs patchJobs;
+		patchJobs.SetDensityMap(&densityMap);
+		double seconds = 0.0;
+		long long steals = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			SceneCamera camera;
+			SceneFrame scene;
+			float projection[4][4];
+			JobsSceneFrame(frame * 0.3f, settings, camera, scene, projection);
+			grid.UpdateBounds(scene.WorldScale, settings.Scaling * settings.DisplacementLevel);
+			jobs.BeginFrame();
+			double start = GetTimeSeconds();
+			long long triangles;
+			patchJobs.Run(jobs, grid, camera, settings, scene, projection[1][1], SCRIPT_VIEWPORT_HEIGHT, &visible[0], &triangles);
+			seconds += GetTimeSeconds() - start;
+			steals += jobs.GetStats().Steals;
+		}
+		if (threads == 1)
+			oneThreadSeconds = seconds;
+		printf("jobs %dx%d patches  %2d threads  %8.3f ms  speedup %5.2f  %6.1f steals per frame\n", gridSize, gridSize,
+			threads, seconds / frames * 1000.0, oneThreadSeconds / seconds, (double)steals / frames);
+	}
+
+	// Cost of a job: empty ranges of one item
+	JobSystem jobs;
+	jobs.Init(maxThreads);
+	const int items = 200000;
+	double start = GetTimeSeconds();
+	jobs.ParallelFor(items, 1, [](int, int, int) {});
+	double seconds = GetTimeSeconds() - start;
+	printf("jobs %d empty jobs on %d threads  %8.3f ms  %6.0f ns per job\n", items, maxThreads, seconds * 1000.0,
+		seconds / items * 1e9);
+}
@@ -0,0 +1,235 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.cpp
+//--------------------------------------------------------------------------------------
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// MappedFile
+//--------------------------------------------------------------------------------------
+#ifdef _WIN32
+bool MappedFile::Open(const char* pFileName)
+{
+	Close();
+
+	HANDLE hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	m_hFile = hFile;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1)
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_hMapping)
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = (const unsigned char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_pData)
+	{
+		Close();
+		return false;
+	}
+	m_Size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hFile)
+		CloseHandle(m_hFile);
+	m_pData = NULL;
+	m_Size = 0;
+	m_hMapping = NULL;
+	m_hFile = NULL;
+}
+#else
+bool MappedFile::Open(const char* pFileName)
+{
+	Close();
+
+	m_File = open(pFileName, O_RDONLY);
+	if (m_File < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(m_File, &status) != 0 || status.st_size <= 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* pData = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, m_File, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_pData = (const unsigned char*)pData;
+	m_Size = (size_t)status.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData)
+		munmap((void*)m_pData, m_Size);
+	if (m_File >= 0)
+		close(m_File);
+	m_pData = NULL;
+	m_Size = 0;
+	m_File = -1;
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// FileMapping
+//--------------------------------------------------------------------------------------
+#ifdef _WIN32
+bool FileMapping::Open(const char* pFileName)
+{
+	Close();
+
+	HANDLE hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	m_hFile = hFile;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_hMapping)
+	{
+		Close();
+		return false;
+	}
+
+	// Views have to start at a multiple of the allocation granularity, not of the page size
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	m_Granularity = info.dwAllocationGranularity;
+	m_Size = (unsigned long long)size.QuadPart;
+	return true;
+}
+
+void FileMapping::Close()
+{
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hFile)
+		CloseHandle(m_hFile);
+	m_hMapping = NULL;
+	m_hFile = NULL;
+	m_Size = 0;
+}
+
+bool FileMapping::MapRange(unsigned long long offset, size_t size, MappedRange& range) const
+{
+	range = MappedRange();
+	if (!m_hMapping || size == 0 || offset > m_Size || size > m_Size - offset)
+		return false;
+
+	unsigned long long viewOffset = offset - offset % m_Granularity;
+	unsigned long long viewSize = offset - viewOffset + size;
+	if (viewSize > (size_t)-1)
+		return false;
+	void* pView = MapViewOfFile(m_hMapping, FILE_MAP_READ, (DWORD)(viewOffset >> 32), (DWORD)viewOffset, (SIZE_T)viewSize);
+	if (!pView)
+		return false;
+	range.pView = pView;
+	range.ViewSize = (size_t)viewSize;
+	range.pData = (const unsigned char*)pView + (offset - viewOffset);
+	return true;
+}
+
+void FileMapping::UnmapRange(MappedRange& range)
+{
+	if (range.pView)
+		UnmapViewOfFile(range.pView);
+	range = MappedRange();
+}
+#else
+bool FileMapping::Open(const char* pFileName)
+{
+	Close();
+
+	m_File = open(pFileName, O_RDONLY);
+	if (m_File < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(m_File, &status) != 0 || status.st_size <= 0)
+	{
+		Close();
+		return false;
+	}
+	m_Granularity = (unsigned long long)sysconf(_SC_PAGESIZE);
+	m_Size = (unsigned long long)status.st_size;
+	return true;
+}
+
+void FileMapping::Close()
+{
+	if (m_File >= 0)
+		close(m_File);
+	m_File = -1;
+	m_Size = 0;
+}
+
+bool FileMapping::MapRange(unsigned long long offset, size_t size, MappedRange& range) const
+{
+	range = MappedRange();
+	if (m_File < 0 || size == 0 || offset > m_Size || size > m_Size - offset)
+		return false;
+
+	unsigned long long viewOffset = offset - offset % m_Granularity;
+	unsigned long long viewSize = offset - viewOffset + size;
+	if (viewSize > (size_t)-1)
+		return false;
+	void* pView = mmap(NULL, (size_t)viewSize, PROT_READ, MAP_PRIVATE, m_File, (off_t)viewOffset);
+	if (pView == MAP_FAILED)
+		return false;
+	range.pView = pView;
+	range.ViewSize = (size_t)viewSize;
+	range.pData = (const unsigned char*)pView + (offset - viewOffset);
+	return true;
+}
+
+void FileMapping::UnmapRange(MappedRange& range)
+{
+	if (range.pView)
+		munmap(range.pView, range.ViewSize);
+	range = MappedRange();
+}
+#endif
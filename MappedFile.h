@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.h
+//
+// Read-only memory mapping of a whole file. Uses file mappings on Windows and mmap
+// elsewhere, so the data can be handed to the GPU upload without an intermediate copy.
+// FileMapping maps ranges of a file on demand instead, for files larger than the
+// address space or the memory that should be spent on them.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <stddef.h>
+
+
+//--------------------------------------------------------------------------------------
+// MappedFile
+//--------------------------------------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { Close(); }
+
+	bool Open(const char* pFileName);
+	void Close();
+
+	bool IsOpen() const { return m_pData != NULL; }
+	const unsigned char* GetData() const { return m_pData; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const unsigned char* m_pData = NULL;
+	size_t m_Size = 0;
+#ifdef _WIN32
+	void* m_hFile = NULL;
+	void* m_hMapping = NULL;
+#else
+	int m_File = -1;
+#endif
+};
+
+
+//--------------------------------------------------------------------------------------
+// FileMapping
+//--------------------------------------------------------------------------------------
+// A view of part of a file. The view starts at the offset rounded down to the mapping
+// granularity, pData points at the requested offset.
+struct MappedRange
+{
+	const unsigned char* pData = NULL;
+	void* pView = NULL;
+	size_t ViewSize = 0;
+};
+
+class FileMapping
+{
+public:
+	FileMapping() {}
+	~FileMapping() { Close(); }
+
+	// Every view has to be unmapped before Close
+	bool Open(const char* pFileName);
+	void Close();
+
+	bool IsOpen() const { return m_Size > 0; }
+	unsigned long long GetSize() const { return m_Size; }
+
+	// Maps [offset, offset + size) of the file, false if the range is outside it. Views
+	// are independent, so ranges can be mapped and unmapped from any thread.
+	bool MapRange(unsigned long long offset, size_t size, MappedRange& range) const;
+	static void UnmapRange(MappedRange& range);
+
+private:
+	FileMapping(const FileMapping&);
+	FileMapping& operator=(const FileMapping&);
+
+	unsigned long long m_Size = 0;
+	unsigned long long m_Granularity = 0;
+#ifdef _WIN32
+	void* m_hFile = NULL;
+	void* m_hMapping = NULL;
+#else
+	int m_File = -1;
+#endif
+};
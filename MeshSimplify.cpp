@@ -0,0 +1,307 @@
+//--------------------------------------------------------------------------------------
+// File: MeshSimplify.cpp
+//--------------------------------------------------------------------------------------
+#include "MeshSimplify.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Quadrics
+//--------------------------------------------------------------------------------------
+// Sum of weighted planes n.p + d = 0 as the symmetric A = n n^T, b = d n and c = d^2, in
+// double as the sums of many nearly parallel planes cancel
+struct Quadric
+{
+	double A00, A01, A02, A11, A12, A22;
+	double B0, B1, B2;
+	double C;
+	double Weight;
+};
+
+static void AddPlane(Quadric& q, const double n[3], double d, double weight)
+{
+	q.A00 += weight * n[0] * n[0];
+	q.A01 += weight * n[0] * n[1];
+	q.A02 += weight * n[0] * n[2];
+	q.A11 += weight * n[1] * n[1];
+	q.A12 += weight * n[1] * n[2];
+	q.A22 += weight * n[2] * n[2];
+	q.B0 += weight * d * n[0];
+	q.B1 += weight * d * n[1];
+	q.B2 += weight * d * n[2];
+	q.C += weight * d * d;
+	q.Weight += weight;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+	q.A00 += other.A00;
+	q.A01 += other.A01;
+	q.A02 += other.A02;
+	q.A11 += other.A11;
+	q.A12 += other.A12;
+	q.A22 += other.A22;
+	q.B0 += other.B0;
+	q.B1 += other.B1;
+	q.B2 += other.B2;
+	q.C += other.C;
+	q.Weight += other.Weight;
+}
+
+// Mean squared distance of p from the planes of a and b together
+static double CollapseError(const Quadric& a, const Quadric& b, const float* p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	double A00 = a.A00 + b.A00, A01 = a.A01 + b.A01, A02 = a.A02 + b.A02;
+	double A11 = a.A11 + b.A11, A12 = a.A12 + b.A12, A22 = a.A22 + b.A22;
+	double error = x * (A00 * x + 2.0 * (A01 * y + A02 * z)) + y * (A11 * y + 2.0 * A12 * z) + A22 * z * z +
+		2.0 * ((a.B0 + b.B0) * x + (a.B1 + b.B1) * y + (a.B2 + b.B2) * z) + a.C + b.C;
+	double weight = a.Weight + b.Weight;
+	return (weight > 0.0 && error > 0.0) ? error / weight : 0.0;
+}
+
+static void TriangleNormal(const float* p0, const float* p1, const float* p2, double n[3])
+{
+	double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+	double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Collapses
+//--------------------------------------------------------------------------------------
+struct Collapse
+{
+	double Error;
+	int From;
+	int To;
+
+	bool operator<(const Collapse& other) const { return Error < other.Error; }
+};
+
+// Whether moving from onto to keeps every other triangle around from facing the way it
+// did, with some margin so that no sliver is left behind
+static bool PreservesOrientation(const float* pPositions, const int* pIndices, const std::vector<int>& offsets,
+	const std::vector<int>& adjacency, int from, int to)
+{
+	const float* pTo = pPositions + to * 3;
+	for (int a = offsets[from]; a < offsets[from + 1]; a++)
+	{
+		const int* pTriangle = pIndices + adjacency[a] * 3;
+		if (pTriangle[0] == to || pTriangle[1] == to || pTriangle[2] == to)
+			continue;
+
+		const float* p[3];
+		const float* q[3];
+		for (int c = 0; c < 3; c++)
+		{
+			p[c] = pPositions + pTriangle[c] * 3;
+			q[c] = (pTriangle[c] == from) ? pTo : p[c];
+		}
+		double before[3], after[3];
+		TriangleNormal(p[0], p[1], p[2], before);
+		TriangleNormal(q[0], q[1], q[2], after);
+		double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+		double lengths = sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+			(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+		if (dot <= 1e-2 * lengths)
+			return false;
+	}
+	return true;
+}
+
+// The triangles around from with from moved onto to, without the ones that collapse
+static void MovedTriangles(const int* pIndices, const std::vector<int>& offsets, const std::vector<int>& adjacency,
+	int from, int to, std::vector<int>& triangles)
+{
+	triangles.clear();
+	for (int a = offsets[from]; a < offsets[from + 1]; a++)
+	{
+		const int* pTriangle = pIndices + adjacency[a] * 3;
+		if (pTriangle[0] == to || pTriangle[1] == to || pTriangle[2] == to)
+			continue;
+		for (int c = 0; c < 3; c++)
+			triangles.push_back(pTriangle[c] == from ? to : pTriangle[c]);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Simplification
+//--------------------------------------------------------------------------------------
+int SimplifyMesh(const float* pPositions, int vertexCount, const int* pIndices, int indexCount, int targetIndexCount,
+	float maxError, int* pResult, float* pError, const CollapseFilterFunction& filter)
+{
+	int currentCount = indexCount - indexCount % 3;
+	std::copy(pIndices, pIndices + currentCount, pResult);
+	if (pError)
+		*pError = 0.0f;
+	if (vertexCount <= 0 || currentCount <= targetIndexCount)
+		return currentCount;
+
+	// Planes of the input triangles, weighted by area
+	std::vector<Quadric> quadrics(vertexCount);
+	memset(&quadrics[0], 0, quadrics.size() * sizeof(Quadric));
+	for (int i = 0; i < currentCount; i += 3)
+	{
+		const float* p0 = pPositions + pResult[i] * 3;
+		double n[3];
+		TriangleNormal(p0, pPositions + pResult[i + 1] * 3, pPositions + pResult[i + 2] * 3, n);
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0)
+			continue;
+		for (int c = 0; c < 3; c++)
+			n[c] /= length;
+		double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		for (int c = 0; c < 3; c++)
+			AddPlane(quadrics[pResult[i + c]], n, d, length * 0.5);
+	}
+
+	// Edges as (smaller, larger) keys sorted so that an edge of a single triangle shows
+	// up once. Their vertices are locked.
+	std::vector<unsigned long long> edges;
+	edges.reserve(currentCount);
+	for (int i = 0; i < currentCount; i += 3)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned long long a = (unsigned int)pResult[i + c], b = (unsigned int)pResult[i + (c + 1) % 3];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	std::vector<char> locked(vertexCount, 0);
+	for (size_t e = 0; e < edges.size(); )
+	{
+		size_t next = e + 1;
+		while (next < edges.size() && edges[next] == edges[e])
+			next++;
+		if (next - e == 1)
+		{
+			locked[(int)(edges[e] >> 32)] = 1;
+			locked[(int)(edges[e] & 0xffffffffu)] = 1;
+		}
+		e = next;
+	}
+
+	double maxSquaredError = (double)maxError * maxError;
+	double largestError = 0.0;
+	std::vector<int> offsets(vertexCount + 1), adjacency, remap(vertexCount);
+	std::vector<char> touched(vertexCount);
+	std::vector<Collapse> collapses;
+	std::vector<int> moved;
+	for (;;)
+	{
+		// Triangles of every vertex
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (int i = 0; i < currentCount; i++)
+			offsets[pResult[i] + 1]++;
+		for (int v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		adjacency.resize(currentCount);
+		std::vector<int> filled(offsets.begin(), offsets.end() - 1);
+		for (int i = 0; i < currentCount; i++)
+			adjacency[filled[pResult[i]]++] = i / 3;
+
+		// The cheaper direction of every edge that has an unlocked end
+		edges.clear();
+		for (int i = 0; i < currentCount; i += 3)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned long long a = (unsigned int)pResult[i + c], b = (unsigned int)pResult[i + (c + 1) % 3];
+				edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		collapses.clear();
+		for (size_t e = 0; e < edges.size(); e++)
+		{
+			int a = (int)(edges[e] >> 32), b = (int)(edges[e] & 0xffffffffu);
+			if (locked[a] && locked[b])
+				continue;
+			Collapse collapse;
+			collapse.Error = -1.0;
+			if (!locked[a])
+			{
+				collapse.Error = CollapseError(quadrics[a], quadrics[b], pPositions + b * 3);
+				collapse.From = a;
+				collapse.To = b;
+			}
+			if (!locked[b])
+			{
+				double error = CollapseError(quadrics[a], quadrics[b], pPositions + a * 3);
+				if (collapse.Error < 0.0 || error < collapse.Error)
+				{
+					collapse.Error = error;
+					collapse.From = b;
+					collapse.To = a;
+				}
+			}
+			if (collapse.Error <= maxSquaredError)
+				collapses.push_back(collapse);
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		// A collapse changes the triangles around its source, so their vertices wait for
+		// the next pass and every orientation check sees the current triangles
+		for (int v = 0; v < vertexCount; v++)
+			remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+		int removedIndices = 0, collapseCount = 0;
+		for (size_t c = 0; c < collapses.size() && currentCount - removedIndices > targetIndexCount; c++)
+		{
+			const Collapse& collapse = collapses[c];
+			if (touched[collapse.From] || touched[collapse.To] ||
+				!PreservesOrientation(pPositions, pResult, offsets, adjacency, collapse.From, collapse.To))
+				continue;
+			if (filter)
+			{
+				MovedTriangles(pResult, offsets, adjacency, collapse.From, collapse.To, moved);
+				if (!filter(moved.data(), (int)moved.size() / 3))
+					continue;
+			}
+
+			for (int a = offsets[collapse.From]; a < offsets[collapse.From + 1]; a++)
+			{
+				const int* pTriangle = pResult + adjacency[a] * 3;
+				bool shared = pTriangle[0] == collapse.To || pTriangle[1] == collapse.To || pTriangle[2] == collapse.To;
+				removedIndices += shared ? 3 : 0;
+				for (int k = 0; k < 3; k++)
+					touched[pTriangle[k]] = 1;
+			}
+			remap[collapse.From] = collapse.To;
+			AddQuadric(quadrics[collapse.To], quadrics[collapse.From]);
+			largestError = std::max(largestError, collapse.Error);
+			collapseCount++;
+		}
+		if (collapseCount == 0)
+			break;
+
+		// Drop the triangles that lost an edge
+		int written = 0;
+		for (int i = 0; i < currentCount; i += 3)
+		{
+			int a = remap[pResult[i]], b = remap[pResult[i + 1]], c = remap[pResult[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			pResult[written++] = a;
+			pResult[written++] = b;
+			pResult[written++] = c;
+		}
+		currentCount = written;
+		if (currentCount <= targetIndexCount)
+			break;
+	}
+
+	if (pError)
+		*pError = (float)sqrt(largestError);
+	return currentCount;
+}
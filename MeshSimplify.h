@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// File: MeshSimplify.h
+//
+// Triangle list simplification with quadric error metrics (Garland and Heckbert). Every
+// vertex accumulates the area-weighted planes of its triangles, and collapsing an edge
+// costs the mean squared distance of the kept vertex from the planes of both ends.
+// Collapses move one end onto the other, so the result only references input vertices
+// and keeps their attributes exact. Each pass sorts the edges by cost and collapses the
+// cheapest ones whose neighbourhoods do not overlap, skipping collapses that would flip
+// or degenerate a triangle, until the target triangle count or the error limit is
+// reached.
+//
+// Vertices on border edges, edges of a single triangle, never move, so meshes that
+// share a border, like the chunks of a terrain, keep matching along it. A caller with a
+// stricter measure, like the exact error of a height field, can veto collapses.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <stddef.h>
+#include <functional>
+
+
+//--------------------------------------------------------------------------------------
+// Types
+//--------------------------------------------------------------------------------------
+// Whether a collapse may be made, given the triangles around the moved vertex as they
+// would be after it, 3 indices each
+typedef std::function<bool(const int* pTriangles, int triangleCount)> CollapseFilterFunction;
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Simplifies the triangle list pIndices over the vertices pPositions (3 floats each)
+// into pResult, which needs room for indexCount indices. Stops at targetIndexCount
+// indices or before a collapse would cost more than maxError, a distance. Returns the
+// number of indices written; pError receives the largest error of a collapse made, as
+// a distance, if not NULL. Collapses that pass the error limit and the orientation
+// check are also skipped when filter returns false.
+int SimplifyMesh(const float* pPositions, int vertexCount, const int* pIndices, int indexCount, int targetIndexCount,
+	float maxError, int* pResult, float* pError = NULL, const CollapseFilterFunction& filter = CollapseFilterFunction());
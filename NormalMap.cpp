@@ -0,0 +1,218 @@
+//--------------------------------------------------------------------------------------
+// File: NormalMap.cpp
+//--------------------------------------------------------------------------------------
+#include "NormalMap.h"
+#include "TextureContainer.h"
+#include "SimdUtil.h"
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Sobel filter
+//--------------------------------------------------------------------------------------
+// Widens row y to 16 bits with one texel added on both sides, so pRow[1 + x] is texel x.
+// The added texels continue the slope of the edge, so border texels get the gradient of
+// the surface instead of half of it.
+static void GatherRow(const unsigned char* pTexels, int width, int rowPitch, int texelStride, int y, short* pRow)
+{
+	const unsigned char* pSrc = pTexels + (size_t)y * rowPitch;
+	for (int x = 0; x < width; x++)
+		pRow[1 + x] = pSrc[x * texelStride];
+	pRow[0] = (short)(2 * pRow[1] - pRow[std::min(2, width)]);
+	pRow[width + 1] = (short)(2 * pRow[width] - pRow[std::max(width - 1, 1)]);
+}
+
+// Row beyond the top or bottom edge, continuing the slope from pInner to pEdge
+static void ExtrapolateRow(const short* pEdge, const short* pInner, int width, short* pRow)
+{
+	for (int x = 0; x < width + 2; x++)
+		pRow[x] = (short)(2 * pEdge[x] - pInner[x]);
+}
+
+// UNORM of one normal component, n is in (-1, 1) so the result is in [0, 255]
+static inline unsigned char EncodeComponent(float n)
+{
+	return (unsigned char)(int)(n * 127.5f + 128.0f);
+}
+
+// Normals of every texel of a row from the padded rows above, at and below it. The
+// Sobel sums are 8 times the gradient and at most 4 * 510 in size, so they fit 16 bits.
+// scaleX and scaleY turn them into slopes. The SIMD path computes exactly what the
+// scalar one does.
+static void NormalRow(const short* pUp, const short* pRow, const short* pDown, int width, float scaleX, float scaleY,
+	unsigned char* pOut)
+{
+	int x = 0;
+#if TESS_USE_SSE2
+	// 8 texels per iteration, the x and y bytes are interleaved at the end
+	const __m128 vScaleX = _mm_set1_ps(-scaleX);
+	const __m128 vScaleY = _mm_set1_ps(-scaleY);
+	const __m128 vOne = _mm_set1_ps(1.0f);
+	const __m128 vHalfRange = _mm_set1_ps(127.5f);
+	const __m128 vOffset = _mm_set1_ps(128.0f);
+	for (; x + 8 <= width; x += 8)
+	{
+		__m128i upLeft = _mm_loadu_si128((const __m128i*)(pUp + x));
+		__m128i upCenter = _mm_loadu_si128((const __m128i*)(pUp + x + 1));
+		__m128i upRight = _mm_loadu_si128((const __m128i*)(pUp + x + 2));
+		__m128i left = _mm_loadu_si128((const __m128i*)(pRow + x));
+		__m128i right = _mm_loadu_si128((const __m128i*)(pRow + x + 2));
+		__m128i downLeft = _mm_loadu_si128((const __m128i*)(pDown + x));
+		__m128i downCenter = _mm_loadu_si128((const __m128i*)(pDown + x + 1));
+		__m128i downRight = _mm_loadu_si128((const __m128i*)(pDown + x + 2));
+
+		__m128i columnLeft = _mm_add_epi16(_mm_add_epi16(upLeft, downLeft), _mm_add_epi16(left, left));
+		__m128i columnRight = _mm_add_epi16(_mm_add_epi16(upRight, downRight), _mm_add_epi16(right, right));
+		__m128i rowUp = _mm_add_epi16(_mm_add_epi16(upLeft, upRight), _mm_add_epi16(upCenter, upCenter));
+		__m128i rowDown = _mm_add_epi16(_mm_add_epi16(downLeft, downRight), _mm_add_epi16(downCenter, downCenter));
+		__m128i gradientX = _mm_sub_epi16(columnRight, columnLeft);
+		__m128i gradientY = _mm_sub_epi16(rowDown, rowUp);
+
+		__m128i encoded[2][2];
+		for (int half = 0; half < 2; half++)
+		{
+			// Sign extension to 32 bits by shifting the high half of the duplicated words
+			__m128i wideX = half ? _mm_unpackhi_epi16(gradientX, gradientX) : _mm_unpacklo_epi16(gradientX, gradientX);
+			__m128i wideY = half ? _mm_unpackhi_epi16(gradientY, gradientY) : _mm_unpacklo_epi16(gradientY, gradientY);
+			__m128 slopeX = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(wideX, 16)), vScaleX);
+			__m128 slopeY = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(wideY, 16)), vScaleY);
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeY, slopeY)), vOne));
+			encoded[0][half] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_div_ps(slopeX, length), vHalfRange), vOffset));
+			encoded[1][half] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_div_ps(slopeY, length), vHalfRange), vOffset));
+		}
+		__m128i bytesX = _mm_packus_epi16(_mm_packs_epi32(encoded[0][0], encoded[0][1]), _mm_setzero_si128());
+		__m128i bytesY = _mm_packus_epi16(_mm_packs_epi32(encoded[1][0], encoded[1][1]), _mm_setzero_si128());
+		_mm_storeu_si128((__m128i*)(pOut + x * 2), _mm_unpacklo_epi8(bytesX, bytesY));
+	}
+#endif
+	for (; x < width; x++)
+	{
+		int gradientX = (pUp[x + 2] + pDown[x + 2] + 2 * pRow[x + 2]) - (pUp[x] + pDown[x] + 2 * pRow[x]);
+		int gradientY = (pDown[x] + pDown[x + 2] + 2 * pDown[x + 1]) - (pUp[x] + pUp[x + 2] + 2 * pUp[x + 1]);
+		float slopeX = (float)gradientX * -scaleX;
+		float slopeY = (float)gradientY * -scaleY;
+		float length = sqrtf(slopeX * slopeX + slopeY * slopeY + 1.0f);
+		pOut[x * 2 + 0] = EncodeComponent(slopeX / length);
+		pOut[x * 2 + 1] = EncodeComponent(slopeY / length);
+	}
+}
+
+// Normals of the texel rows [rowBegin, rowEnd)
+static void NormalRows(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride,
+	float scaleX, float scaleY, int rowBegin, int rowEnd, unsigned char* pNormals)
+{
+	std::vector<short> rows[3];
+	for (int r = 0; r < 3; r++)
+		rows[r].resize(width + 2);
+
+	short* pUp = &rows[0][0];
+	short* pRow = &rows[1][0];
+	short* pDown = &rows[2][0];
+	GatherRow(pTexels, width, rowPitch, texelStride, rowBegin, pRow);
+	if (rowBegin > 0)
+	{
+		GatherRow(pTexels, width, rowPitch, texelStride, rowBegin - 1, pUp);
+	}
+	else
+	{
+		GatherRow(pTexels, width, rowPitch, texelStride, std::min(1, height - 1), pDown);
+		ExtrapolateRow(pRow, pDown, width, pUp);
+	}
+
+	for (int y = rowBegin; y < rowEnd; y++)
+	{
+		if (y + 1 < height)
+			GatherRow(pTexels, width, rowPitch, texelStride, y + 1, pDown);
+		else
+			ExtrapolateRow(pRow, pUp, width, pDown);
+		NormalRow(pUp, pRow, pDown, width, scaleX, scaleY, pNormals + (size_t)y * width * 2);
+
+		short* pFree = pUp;
+		pUp = pRow;
+		pRow = pDown;
+		pDown = pFree;
+	}
+}
+
+// scaleX and scaleY are the slope scales per Sobel sum along x and y
+static bool DeriveNormals(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride,
+	float scaleX, float scaleY, Image& normals, int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	normals.Width = width;
+	normals.Height = height;
+	normals.Channels = 2;
+	normals.Texels.resize((size_t)width * height * 2);
+
+	// Bands of rows are independent, each thread reads one row above and below its band
+	const int minRowsPerThread = 64;
+	int threads = std::min(numThreads, std::max(1, height / minRowsPerThread));
+	if (threads == 1)
+	{
+		NormalRows(pTexels, width, height, rowPitch, texelStride, scaleX, scaleY, 0, height, &normals.Texels[0]);
+	}
+	else
+	{
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+		{
+			int rowBegin = height * t / threads;
+			int rowEnd = height * (t + 1) / threads;
+			workers.push_back(std::thread(NormalRows, pTexels, width, height, rowPitch, texelStride,
+				scaleX, scaleY, rowBegin, rowEnd, &normals.Texels[0]));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+bool DeriveNormalMap(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride,
+	float slopeScale, Image& normals, int numThreads)
+{
+	if (!pTexels || width < 1 || height < 1 || texelStride < 1 || rowPitch < width * texelStride || !(slopeScale > 0.0f))
+		return false;
+
+	// The Sobel sums are 8 times the gradient in 0-255 units per texel
+	float scale = slopeScale / (8.0f * 255.0f);
+	return DeriveNormals(pTexels, width, height, rowPitch, texelStride, scale, scale, normals, numThreads);
+}
+
+bool DeriveNormalMapMips(const Image& heights, float slopeScale, std::vector<Image>& mips, int numThreads)
+{
+	if (heights.Width < 1 || heights.Height < 1 || heights.Channels < 1 ||
+		heights.Texels.size() != (size_t)heights.Width * heights.Height * heights.Channels || !(slopeScale > 0.0f))
+		return false;
+
+	Image level;
+	ConvertImage(heights, 1, level);
+	mips.clear();
+	for (;;)
+	{
+		// A texel of this level spans width / level.Width texels of level 0, rounding down
+		// the odd sizes makes that differ between the axes
+		float scale = slopeScale / (8.0f * 255.0f);
+		float scaleX = scale * level.Width / heights.Width;
+		float scaleY = scale * level.Height / heights.Height;
+		mips.push_back(Image());
+		if (!DeriveNormals(level.Texels.data(), level.Width, level.Height, level.Width, 1, scaleX, scaleY, mips.back(), numThreads))
+			return false;
+		if (level.Width == 1 && level.Height == 1)
+			break;
+
+		Image next;
+		DownsampleImage(level, next);
+		level.Texels.swap(next.Texels);
+		level.Width = next.Width;
+		level.Height = next.Height;
+	}
+	return true;
+}
@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// File: NormalMap.h
+//
+// Tangent-space normal maps derived from a heightmap, so the shading always matches the
+// displacement instead of an authored normal map of a different surface. The gradient
+// of every texel comes from a 3x3 Sobel filter, the texel stores x and y of
+// normalize(-dh/du, -dh/dv, 1) as UNORM (n * 0.5 + 0.5) and the pixel shader derives z.
+// Heights are in units of the 0-255 range scaled by slopeScale: the surface rises by
+// slopeScale texels over the full range.
+//
+// Tangent space follows the texture coordinates: x along +u, y along +v and z along the
+// displaced direction. The terrain maps u to +X and v to +Z, see TerrainGrid.h.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "ImageIO.h"
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Slope scale of the demo's normal maps, keep in sync with NORMAL_MAP_SLOPE_SCALE in
+// DisplacedAndShaded.hlsl
+#define NORMAL_MAP_SLOPE_SCALE 64.0f
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Derives a 2 channel normal map of the same size from one 8-bit channel: texel (x, y)
+// is pTexels[y * rowPitch + x * texelStride]. The heightmap continues its slope beyond
+// the border. numThreads 0 uses every hardware thread.
+bool DeriveNormalMap(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride,
+	float slopeScale, Image& normals, int numThreads = 0);
+
+// Derives a full mip chain from the first channel of heights. Every level is derived
+// from the box filtered heights of that level (DownsampleImage) with the slopes measured
+// in texels of level 0, so it describes the same surface as the filtered heights instead
+// of averaging the normals of level 0.
+bool DeriveNormalMapMips(const Image& heights, float slopeScale, std::vector<Image>& mips, int numThreads = 0);
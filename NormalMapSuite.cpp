@@ -0,0 +1,271 @@
+//--------------------------------------------------------------------------------------
+// File: NormalMapSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "NormalMap.h"
+#include "ImageIO.h"
+#include "TextureContainer.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Normal maps. Sobel normals of synthetic heightmaps against a straightforward
+// reference and against the analytic normals of ramps and waves.
+//--------------------------------------------------------------------------------------
+#define NORMAL_MAP_SIZE         256
+
+// Height with the border continued like DeriveNormalMap: columns first, then rows
+static int ExtrapolatedHeight(const std::vector<unsigned char>& heights, int width, int height, int x, int y)
+{
+	if (y < 0)
+		return 2 * ExtrapolatedHeight(heights, width, height, x, 0) - ExtrapolatedHeight(heights, width, height, x, std::min(1, height - 1));
+	if (y >= height)
+		return 2 * ExtrapolatedHeight(heights, width, height, x, height - 1) - ExtrapolatedHeight(heights, width, height, x, std::max(height - 2, 0));
+	if (x < 0)
+		return 2 * heights[(size_t)y * width] - heights[(size_t)y * width + std::min(1, width - 1)];
+	if (x >= width)
+		return 2 * heights[(size_t)y * width + width - 1] - heights[(size_t)y * width + std::max(width - 2, 0)];
+	return heights[(size_t)y * width + x];
+}
+
+// scaleX and scaleY per Sobel sum like in NormalMap.cpp
+static void ReferenceNormals(const std::vector<unsigned char>& heights, int width, int height, float scaleX, float scaleY,
+	std::vector<unsigned char>& normals)
+{
+	normals.resize((size_t)width * height * 2);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int gradientX = 0, gradientY = 0;
+			for (int i = -1; i <= 1; i++)
+			{
+				int weight = (i == 0) ? 2 : 1;
+				gradientX += weight * (ExtrapolatedHeight(heights, width, height, x + 1, y + i) - ExtrapolatedHeight(heights, width, height, x - 1, y + i));
+				gradientY += weight * (ExtrapolatedHeight(heights, width, height, x + i, y + 1) - ExtrapolatedHeight(heights, width, height, x + i, y - 1));
+			}
+			float slopeX = (float)gradientX * -scaleX;
+			float slopeY = (float)gradientY * -scaleY;
+			float length = sqrtf(slopeX * slopeX + slopeY * slopeY + 1.0f);
+			normals[((size_t)y * width + x) * 2 + 0] = (unsigned char)(int)(slopeX / length * 127.5f + 128.0f);
+			normals[((size_t)y * width + x) * 2 + 1] = (unsigned char)(int)(slopeY / length * 127.5f + 128.0f);
+		}
+	}
+}
+
+// Largest and mean angle in degrees between the decoded normals and
+// normalize(-slopeX, -slopeY, 1) of every texel, the slopes in units of the normal map
+static void MeasureNormalAngles(const Image& normals, const std::vector<float>& slopesX, const std::vector<float>& slopesY,
+	double& maxAngle, double& meanAngle)
+{
+	maxAngle = 0.0;
+	meanAngle = 0.0;
+	for (size_t i = 0; i < slopesX.size(); i++)
+	{
+		double x = normals.Texels[i * 2 + 0] / 255.0 * 2.0 - 1.0;
+		double y = normals.Texels[i * 2 + 1] / 255.0 * 2.0 - 1.0;
+		double z = sqrt(std::max(1.0 - x * x - y * y, 0.0));
+		double length = sqrt((double)slopesX[i] * slopesX[i] + (double)slopesY[i] * slopesY[i] + 1.0);
+		double cosine = (-x * slopesX[i] - y * slopesY[i] + z) / length / sqrt(x * x + y * y + z * z);
+		double angle = acos(std::min(cosine, 1.0)) * 180.0 / 3.14159265358979;
+		maxAngle = std::max(maxAngle, angle);
+		meanAngle += angle / slopesX.size();
+	}
+}
+
+int VerifyNormalMap()
+{
+	const char* pContainerFile = "NormalBenchmark.pack";
+	SuiteCheck check("normals");
+	const float scale = NORMAL_MAP_SLOPE_SCALE / (8.0f * 255.0f);
+
+	// The SIMD kernel matches the reference on sizes that are no multiple of the SIMD
+	// width, for every thread count and with interleaved channels
+	static const int s_Sizes[][2] = { { NORMAL_MAP_SIZE, NORMAL_MAP_SIZE }, { 333, 517 }, { 7, 3 }, { 1, 1 } };
+	for (int i = 0; i < (int)(sizeof(s_Sizes) / sizeof(s_Sizes[0])); i++)
+	{
+		int width = s_Sizes[i][0], height = s_Sizes[i][1];
+		std::vector<unsigned char> heights, reference;
+		BuildNoiseHeightmap(width, height, 100 + i, heights);
+		for (size_t t = 0; t < heights.size(); t++)
+			heights[t] = (unsigned char)(heights[t] + (t * 7919 % 13));
+		ReferenceNormals(heights, width, height, scale, scale, reference);
+
+		std::vector<unsigned char> rgba((size_t)(width * 4 + 12) * height, 0);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+				rgba[(size_t)y * (width * 4 + 12) + x * 4] = heights[(size_t)y * width + x];
+		}
+		static const int s_Threads[] = { 1, 3, 8 };
+		for (int t = 0; t < 3; t++)
+		{
+			Image normals, interleaved;
+			bool derived = DeriveNormalMap(&heights[0], width, height, width, 1, NORMAL_MAP_SLOPE_SCALE, normals, s_Threads[t]) &&
+				DeriveNormalMap(&rgba[0], width, height, width * 4 + 12, 4, NORMAL_MAP_SLOPE_SCALE, interleaved, s_Threads[t]);
+			check.FailIf(!derived || normals.Channels != 2 || normals.Width != width || normals.Height != height ||
+				normals.Texels != reference || interleaved.Texels != reference,
+				"%dx%d, %d threads: normals differ from the reference", width, height, s_Threads[t]);
+		}
+	}
+
+	// Ramps, the border included, and a flat map give their exact normal up to the UNORM
+	// rounding
+	static const int s_Ramps[][2] = { { 0, 0 }, { 1, 0 }, { 0, -1 }, { 1, 2 } };
+	for (int r = 0; r < 4; r++)
+	{
+		const int width = 96, height = 48;
+		int rampX = s_Ramps[r][0], rampY = s_Ramps[r][1];
+		std::vector<unsigned char> heights((size_t)width * height);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+				heights[(size_t)y * width + x] = (unsigned char)(rampX * x + rampY * y + 64);
+		}
+		std::vector<float> slopesX(heights.size(), rampX * NORMAL_MAP_SLOPE_SCALE / 255.0f);
+		std::vector<float> slopesY(heights.size(), rampY * NORMAL_MAP_SLOPE_SCALE / 255.0f);
+		Image normals;
+		double maxAngle = 180.0, meanAngle;
+		if (DeriveNormalMap(&heights[0], width, height, width, 1, NORMAL_MAP_SLOPE_SCALE, normals))
+			MeasureNormalAngles(normals, slopesX, slopesY, maxAngle, meanAngle);
+		check.FailIf(maxAngle > 0.5 || (r == 0 && (normals.Texels[0] != 128 || normals.Texels[1] != 128)),
+			"ramp (%d, %d) is off by %.2f degrees", rampX, rampY, maxAngle);
+	}
+
+	// Waves follow their analytic normals up to the rounding of the heights to 8 bits. The
+	// border is where their curvature is 0, so continuing the slope beyond it is exact.
+	const int size = NORMAL_MAP_SIZE + 1;
+	const float twoPi = 6.2831853f;
+	std::vector<unsigned char> waves((size_t)size * size);
+	std::vector<float> slopesX(waves.size()), slopesY(waves.size());
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			size_t i = (size_t)y * size + x;
+			float u = twoPi * x / 64.0f, v = twoPi * y / 32.0f;
+			waves[i] = (unsigned char)(128.0f + 100.0f * sinf(u) * sinf(v) + 0.5f);
+			slopesX[i] = 100.0f * twoPi / 64.0f * cosf(u) * sinf(v) * NORMAL_MAP_SLOPE_SCALE / 255.0f;
+			slopesY[i] = 100.0f * twoPi / 32.0f * sinf(u) * cosf(v) * NORMAL_MAP_SLOPE_SCALE / 255.0f;
+		}
+	}
+	Image waveNormals;
+	double waveMaxAngle = 180.0, waveMeanAngle = 180.0;
+	if (DeriveNormalMap(&waves[0], size, size, size, 1, NORMAL_MAP_SLOPE_SCALE, waveNormals))
+		MeasureNormalAngles(waveNormals, slopesX, slopesY, waveMaxAngle, waveMeanAngle);
+	check.FailIf(waveMaxAngle > 4.0 || waveMeanAngle > 1.5, "waves are off by %.2f degrees, %.2f on average",
+		waveMaxAngle, waveMeanAngle);
+
+	// Every mip level is derived from the downsampled heights with slopes per texel of
+	// level 0, gray and RGBA heights give the same chain
+	Image heights, rgbaHeights;
+	BuildNoiseImage(333, 517, 1, 7, heights);
+	ConvertImage(heights, 4, rgbaHeights);
+	std::vector<Image> mips, rgbaMips;
+	if (!DeriveNormalMapMips(heights, NORMAL_MAP_SLOPE_SCALE, mips) || !DeriveNormalMapMips(rgbaHeights, NORMAL_MAP_SLOPE_SCALE, rgbaMips) ||
+		mips.size() != 10 || rgbaMips.size() != mips.size())
+	{
+		check.Fail("%d mips derived, expected 10", (int)mips.size());
+	}
+	else
+	{
+		Image level = heights;
+		for (size_t m = 0; m < mips.size(); m++)
+		{
+			std::vector<unsigned char> reference;
+			ReferenceNormals(level.Texels, level.Width, level.Height, scale * level.Width / heights.Width,
+				scale * level.Height / heights.Height, reference);
+			check.FailIf(mips[m].Width != level.Width || mips[m].Height != level.Height ||
+				mips[m].Texels != reference || rgbaMips[m].Texels != reference, "mip %d differs from the reference",
+				(int)m);
+			Image next;
+			DownsampleImage(level, next);
+			level = next;
+		}
+	}
+
+	// A ramp keeps its slope on every level
+	Image ramp;
+	ramp.Width = 256;
+	ramp.Height = 16;
+	ramp.Channels = 1;
+	ramp.Texels.resize(256 * 16);
+	for (size_t i = 0; i < ramp.Texels.size(); i++)
+		ramp.Texels[i] = (unsigned char)(i % 256);
+	std::vector<Image> rampMips;
+	DeriveNormalMapMips(ramp, NORMAL_MAP_SLOPE_SCALE, rampMips);
+	for (size_t m = 0; m < rampMips.size() && rampMips[m].Width > 1; m++)
+	{
+		size_t count = (size_t)rampMips[m].Width * rampMips[m].Height;
+		std::vector<float> rampSlopesX(count, NORMAL_MAP_SLOPE_SCALE / 255.0f), rampSlopesY(count, 0.0f);
+		double maxAngle, meanAngle;
+		MeasureNormalAngles(rampMips[m], rampSlopesX, rampSlopesY, maxAngle, meanAngle);
+		check.FailIf(maxAngle > 0.5, "the ramp's mip %d is off by %.2f degrees", (int)m, maxAngle);
+	}
+
+	// Two channels convert to RGBA with blue 0 and back
+	Image expanded, reduced;
+	ConvertImage(mips[0], 4, expanded);
+	ConvertImage(expanded, 2, reduced);
+	check.FailIf(reduced.Texels != mips[0].Texels || expanded.Texels[2] != 0 || expanded.Texels[3] != 255 ||
+		expanded.Texels[4] != mips[0].Texels[2] || expanded.Texels[5] != mips[0].Texels[3], "two channel conversion");
+
+	// The derived chain is stored as given, uncompressed or as BC5
+	std::vector<TextureSource> sources(2);
+	sources[0].Name = "normal";
+	sources[0].Format = TEXTURE_FORMAT_R8G8_UNORM;
+	sources[0].Texels = mips[0];
+	sources[0].Mips.assign(mips.begin() + 1, mips.end());
+	sources[1] = sources[0];
+	sources[1].Name = "compressed";
+	sources[1].Format = TEXTURE_FORMAT_BC5_UNORM;
+	sources[1].Texels = rampMips[0];
+	sources[1].Mips.assign(rampMips.begin() + 1, rampMips.end());
+	TextureContainerReader reader;
+	const TextureContainerEntry* pEntry = NULL;
+	if (WriteTextureContainer(pContainerFile, sources) && reader.Open(pContainerFile))
+		pEntry = reader.FindTexture("normal");
+	bool stored = pEntry && pEntry->MipCount == mips.size() && reader.FindTexture("compressed") &&
+		reader.FindTexture("compressed")->MipCount == rampMips.size();
+	for (size_t m = 0; stored && m < mips.size(); m++)
+		stored = memcmp(reader.GetMipData(*pEntry, (int)m), mips[m].Texels.data(), mips[m].Texels.size()) == 0;
+	reader.Close();
+	sources[0].Mips.pop_back();
+	check.FailIf(!stored || WriteTextureContainer(pContainerFile, sources), "derived mips in the texture container");
+	remove(pContainerFile);
+
+	return check.Finish("waves off by %.2f degrees at most, %.2f on average", waveMaxAngle, waveMeanAngle);
+}
+
+void RunNormalMapSuite()
+{
+	const int size = 4096;
+	std::vector<unsigned char> texels;
+	BuildNoiseHeightmap(size, size, 13, texels);
+	Image normals;
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		double start = GetTimeSeconds();
+		DeriveNormalMap(&texels[0], size, size, size, 1, NORMAL_MAP_SLOPE_SCALE, normals, threads);
+		double seconds = GetTimeSeconds() - start;
+		printf("normal map %dx%d  %2d threads  %10.3f ms  %8.2f Mtexels/s\n",
+			size, size, threads, seconds * 1000.0, (double)size * size / seconds * 1e-6);
+	}
+
+	Image heights;
+	heights.Width = size;
+	heights.Height = size;
+	heights.Channels = 1;
+	heights.Texels.swap(texels);
+	std::vector<Image> mips;
+	double start = GetTimeSeconds();
+	DeriveNormalMapMips(heights, NORMAL_MAP_SLOPE_SCALE, mips);
+	double seconds = GetTimeSeconds() - start;
+	printf("normal map mips %dx%d  %d levels  %10.3f ms\n", size, size, (int)mips.size(), seconds * 1000.0);
+}
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// File: PatchInstances.cpp
+//--------------------------------------------------------------------------------------
+#include "PatchInstances.h"
+#include "SimdUtil.h"
+#include "TerrainQuadtree.h"
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+void PackPatchInstances(const PatchInstancesSoA& streams, int count, PatchInstance* pInstances)
+{
+	int i = 0;
+#if TESS_USE_SSE2
+	// Four instances per step: each transpose turns four field vectors into the first or
+	// the second half of four instances
+	float* pOut = (float*)pInstances;
+	for (; i + 4 <= count; i += 4, pOut += 4 * PATCH_INSTANCE_FIELDS)
+	{
+		__m128 originX = _mm_loadu_ps(&streams.OriginX[i]);
+		__m128 originZ = _mm_loadu_ps(&streams.OriginZ[i]);
+		__m128 size = _mm_loadu_ps(&streams.Size[i]);
+		__m128 level = _mm_loadu_ps(&streams.Level[i]);
+		_MM_TRANSPOSE4_PS(originX, originZ, size, level);
+		__m128 edge0 = _mm_loadu_ps(&streams.EdgeFactors[0][i]);
+		__m128 edge1 = _mm_loadu_ps(&streams.EdgeFactors[1][i]);
+		__m128 edge2 = _mm_loadu_ps(&streams.EdgeFactors[2][i]);
+		__m128 edge3 = _mm_loadu_ps(&streams.EdgeFactors[3][i]);
+		_MM_TRANSPOSE4_PS(edge0, edge1, edge2, edge3);
+
+		_mm_storeu_ps(pOut, originX);
+		_mm_storeu_ps(pOut + 4, edge0);
+		_mm_storeu_ps(pOut + 8, originZ);
+		_mm_storeu_ps(pOut + 12, edge1);
+		_mm_storeu_ps(pOut + 16, size);
+		_mm_storeu_ps(pOut + 20, edge2);
+		_mm_storeu_ps(pOut + 24, level);
+		_mm_storeu_ps(pOut + 28, edge3);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		PatchInstance& instance = pInstances[i];
+		instance.Origin[0] = streams.OriginX[i];
+		instance.Origin[1] = streams.OriginZ[i];
+		instance.Size = streams.Size[i];
+		instance.Level = streams.Level[i];
+		for (int e = 0; e < 4; e++)
+			instance.EdgeFactors[e] = streams.EdgeFactors[e][i];
+	}
+}
+
+void GetPatchInstanceCorner(const PatchInstance& instance, int corner, float position[3], float texCoord[2])
+{
+	float cornerX = (corner == 1 || corner == 2) ? 1.0f : 0.0f;
+	float cornerZ = (corner >= 2) ? 1.0f : 0.0f;
+	position[0] = instance.Origin[0] + cornerX * instance.Size;
+	position[1] = 0.0f;
+	position[2] = instance.Origin[1] + cornerZ * instance.Size;
+	texCoord[0] = position[0] * 0.5f + 0.5f;
+	texCoord[1] = position[2] * 0.5f + 0.5f;
+}
+
+int SubmitPatchInstances(PatchDrawBackend& backend, const PatchInstancesSoA& streams, int count, int maxInstances)
+{
+	count = (count < maxInstances) ? count : maxInstances;
+	if (count <= 0)
+		return 0;
+
+	PatchInstance* pInstances = (PatchInstance*)backend.MapInstances(count * sizeof(PatchInstance));
+	if (!pInstances)
+		return 0;
+	PackPatchInstances(streams, count, pInstances);
+	backend.UnmapInstances();
+	backend.DrawIndexedInstanced(PATCH_INSTANCE_CONTROL_POINTS, count);
+	return count;
+}
+
+
+//--------------------------------------------------------------------------------------
+// PatchInstanceStreams
+//--------------------------------------------------------------------------------------
+void PatchInstanceStreams::SetQuadtreePatches(const QuadtreePatch* pPatches, int count, int leavesPerSide,
+	int subdivisions)
+{
+	if ((int)m_Fields[0].size() < count)
+	{
+		for (int f = 0; f < PATCH_INSTANCE_FIELDS; f++)
+			m_Fields[f].resize(count);
+	}
+	m_Count = count;
+
+	// Leaf cells to object space like TerrainGrid::GetVertex, exact for power of two sides
+	float cellSize = 2.0f / leavesPerSide;
+	float* pOriginX = m_Fields[0].data();
+	float* pOriginZ = m_Fields[1].data();
+	float* pSize = m_Fields[2].data();
+	float* pLevel = m_Fields[3].data();
+	for (int i = 0; i < count; i++)
+	{
+		const QuadtreePatch& patch = pPatches[i];
+		pOriginX[i] = (float)patch.X * cellSize - 1.0f;
+		pOriginZ[i] = (float)patch.Z * cellSize - 1.0f;
+		pSize[i] = (float)patch.Size * cellSize;
+		pLevel[i] = (float)patch.Level;
+		float segments = (float)GetQuadtreePatchSegments(patch, subdivisions);
+		for (int e = 0; e < 4; e++)
+			m_Fields[4 + e][i] = segments;
+	}
+}
+
+PatchInstancesSoA PatchInstanceStreams::GetSoA() const
+{
+	PatchInstancesSoA streams;
+	streams.OriginX = m_Fields[0].data();
+	streams.OriginZ = m_Fields[1].data();
+	streams.Size = m_Fields[2].data();
+	streams.Level = m_Fields[3].data();
+	for (int e = 0; e < 4; e++)
+		streams.EdgeFactors[e] = m_Fields[4 + e].data();
+	return streams;
+}
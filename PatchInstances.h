@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------------------
+// File: PatchInstances.h
+//
+// Instanced submission of the quadtree terrain. Every visible patch is one instance of
+// a shared 4 control point patch: the instance buffer holds its origin and size in
+// object space, its level and the tessellation factors of its edges, QuadtreeVS places
+// the shared corners with them and ConstQuadtreeHS reads the factors, so a selection is
+// a single DrawIndexedInstanced whatever its size.
+//
+// The fields are built as SoA streams, one array per field, and packed into the 32 byte
+// instances of the mapped buffer four at a time with SSE2 transposes, which write every
+// instance with two full 16 byte stores. Draws go to a PatchDrawBackend, a D3D11 context
+// in the demo and a recording mock in the headless benchmark.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <vector>
+
+struct QuadtreePatch;
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Control points and indices of the shared patch, in the corner order of
+// TerrainGrid::GetQuadPatchIndices
+#define PATCH_INSTANCE_CONTROL_POINTS   4
+
+// Floats per instance, the streams of PatchInstanceStreams
+#define PATCH_INSTANCE_FIELDS           8
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// One instance, "PATCH" and "EDGEFACTORS" as DXGI_FORMAT_R32G32B32A32_FLOAT. Keep in
+// sync with VS_QUADTREE_INPUT in DisplacedAndShaded.hlsl.
+struct PatchInstance
+{
+	float Origin[2];                    // object space x and z of the (-x, -z) corner
+	float Size;                         // object space side length
+	float Level;                        // quadtree level, selects the morph range
+	float EdgeFactors[4];               // SV_TessFactor order: U == 0, V == 0, U == 1, V == 1
+};
+
+// The fields of count instances, one array each
+struct PatchInstancesSoA
+{
+	const float* OriginX;
+	const float* OriginZ;
+	const float* Size;
+	const float* Level;
+	const float* EdgeFactors[4];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Interleaves count instances into pInstances, which may be a mapped write-combined
+// buffer: it is only written, front to back
+void PackPatchInstances(const PatchInstancesSoA& streams, int count, PatchInstance* pInstances);
+
+// Object space position and texture coordinate of corner 0-3 of an instance, what
+// QuadtreeVS computes. Keep in sync with it.
+void GetPatchInstanceCorner(const PatchInstance& instance, int corner, float position[3], float texCoord[2]);
+
+
+//--------------------------------------------------------------------------------------
+// PatchInstanceStreams
+//--------------------------------------------------------------------------------------
+class PatchInstanceStreams
+{
+public:
+	PatchInstanceStreams() : m_Count(0) {}
+
+	// The instances of a quadtree selection of a quadtree with leavesPerSide leaf cells per
+	// side. Every edge takes the patch's own segments: at a coarser neighbour the patch
+	// has fully morphed onto the neighbour's grid, so the integer factors already match.
+	void SetQuadtreePatches(const QuadtreePatch* pPatches, int count, int leavesPerSide, int subdivisions);
+
+	int GetCount() const { return m_Count; }
+	PatchInstancesSoA GetSoA() const;
+
+private:
+	int m_Count;
+	std::vector<float> m_Fields[PATCH_INSTANCE_FIELDS];
+};
+
+
+//--------------------------------------------------------------------------------------
+// PatchDrawBackend
+//--------------------------------------------------------------------------------------
+class PatchDrawBackend
+{
+public:
+	virtual ~PatchDrawBackend() {}
+
+	// Maps the instance buffer with discard for bytes bytes, NULL on failure
+	virtual void* MapInstances(unsigned int bytes) = 0;
+	virtual void UnmapInstances() = 0;
+
+	// Draws instanceCount instances of the shared patch from the first instance
+	virtual void DrawIndexedInstanced(unsigned int indexCountPerInstance, unsigned int instanceCount) = 0;
+};
+
+// Uploads the first count instances of streams, at most maxInstances, and draws them
+// with one DrawIndexedInstanced. Returns the instances drawn, 0 if the map failed.
+int SubmitPatchInstances(PatchDrawBackend& backend, const PatchInstancesSoA& streams, int count, int maxInstances);
@@ -0,0 +1,299 @@
+//--------------------------------------------------------------------------------------
+// File: PatchInstancesSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "PatchInstances.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "TerrainQuadtree.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Instanced patches. The packer has to interleave the SoA streams exactly and write
+// nothing beyond the instances, the instances of a quadtree selection have to place the
+// shared patch on the leaf grid vertices the indexed draw used, and a frame has to be
+// one map and one draw on a recording backend.
+//--------------------------------------------------------------------------------------
+#define INSTANCES_LEVELS        8
+#define INSTANCES_VIEWS         24
+#define INSTANCES_PACK_COUNT    1024
+#define INSTANCES_SENTINEL      0xCD
+
+class RecordingPatchBackend : public PatchDrawBackend
+{
+public:
+	RecordingPatchBackend(int maxInstances) : m_Buffer(maxInstances * sizeof(PatchInstance), INSTANCES_SENTINEL),
+		m_FailMaps(false), m_Mapped(false), m_MapCount(0), m_DrawCount(0), m_BytesUploaded(0), m_LastIndexCount(0),
+		m_LastInstanceCount(0), m_Errors(0)
+	{
+	}
+
+	virtual void* MapInstances(unsigned int bytes)
+	{
+		m_Errors += (m_Mapped || bytes > m_Buffer.size()) ? 1 : 0;
+		if (m_FailMaps || bytes > m_Buffer.size())
+			return NULL;
+		m_Buffer.assign(m_Buffer.size(), INSTANCES_SENTINEL);
+		m_Mapped = true;
+		m_MapCount++;
+		m_BytesUploaded += bytes;
+		return &m_Buffer[0];
+	}
+	virtual void UnmapInstances()
+	{
+		m_Errors += m_Mapped ? 0 : 1;
+		m_Mapped = false;
+	}
+	virtual void DrawIndexedInstanced(unsigned int indexCountPerInstance, unsigned int instanceCount)
+	{
+		m_Errors += m_Mapped ? 1 : 0;
+		m_DrawCount++;
+		m_LastIndexCount = indexCountPerInstance;
+		m_LastInstanceCount = instanceCount;
+	}
+
+	void SetFailMaps(bool failMaps) { m_FailMaps = failMaps; }
+	void ResetCounters() { m_MapCount = m_DrawCount = 0; m_BytesUploaded = 0; }
+	const PatchInstance* GetInstances() const { return (const PatchInstance*)&m_Buffer[0]; }
+	// Bytes after the first count instances that still hold the sentinel
+	bool IsUntouchedAfter(int count) const
+	{
+		for (size_t i = count * sizeof(PatchInstance); i < m_Buffer.size(); i++)
+		{
+			if (m_Buffer[i] != INSTANCES_SENTINEL)
+				return false;
+		}
+		return true;
+	}
+	int GetMapCount() const { return m_MapCount; }
+	int GetDrawCount() const { return m_DrawCount; }
+	long long GetBytesUploaded() const { return m_BytesUploaded; }
+	unsigned int GetLastIndexCount() const { return m_LastIndexCount; }
+	unsigned int GetLastInstanceCount() const { return m_LastInstanceCount; }
+	int GetErrors() const { return m_Errors; }
+
+private:
+	std::vector<unsigned char> m_Buffer;
+	bool m_FailMaps;
+	bool m_Mapped;
+	int m_MapCount;
+	int m_DrawCount;
+	long long m_BytesUploaded;
+	unsigned int m_LastIndexCount;
+	unsigned int m_LastInstanceCount;
+	int m_Errors;                       // nested maps, unmaps without a map, draws while mapped
+};
+
+// The instance the packer has to write, field by field
+static void PackPatchInstanceReference(const PatchInstancesSoA& streams, int i, PatchInstance& instance)
+{
+	instance.Origin[0] = streams.OriginX[i];
+	instance.Origin[1] = streams.OriginZ[i];
+	instance.Size = streams.Size[i];
+	instance.Level = streams.Level[i];
+	for (int e = 0; e < 4; e++)
+		instance.EdgeFactors[e] = streams.EdgeFactors[e][i];
+}
+
+static void RandomInstanceStreams(unsigned int& state, int count, std::vector<float>& fields, PatchInstancesSoA& streams)
+{
+	// One float of padding in front of every field, so the streams start unaligned
+	fields.resize(PATCH_INSTANCE_FIELDS * (count + 1));
+	for (size_t i = 0; i < fields.size(); i++)
+		fields[i] = RandomFloat(state, -100.0f, 100.0f);
+	const float* pField[PATCH_INSTANCE_FIELDS];
+	for (int f = 0; f < PATCH_INSTANCE_FIELDS; f++)
+		pField[f] = &fields[f * (count + 1) + 1];
+	streams.OriginX = pField[0];
+	streams.OriginZ = pField[1];
+	streams.Size = pField[2];
+	streams.Level = pField[3];
+	for (int e = 0; e < 4; e++)
+		streams.EdgeFactors[e] = pField[4 + e];
+}
+
+static int SelectInstanceView(const TerrainQuadtree& quadtree, const float projection[4][4], SceneSettings& settings,
+	std::vector<QuadtreePatch>& patches, SceneFrame& scene)
+{
+	SceneCamera camera;
+	RandomQuadtreeView(settings, camera);
+	settings.TessellationFactor = 4.0f + 60.0f * rand() / RAND_MAX;
+	UpdateScene(camera, settings, projection, 0.0f, scene);
+	return SelectQuadtreePatches(quadtree, camera, settings, projection[1][1], SCRIPT_VIEWPORT_HEIGHT, scene, &patches[0],
+		QUADTREE_MAX_PATCHES);
+}
+
+int VerifyPatchInstances()
+{
+	SuiteCheck check("instances");
+
+	// Every count around the four instance steps, and the bytes beyond them untouched
+	unsigned int state = 321;
+	int packErrors = 0;
+	std::vector<float> fields;
+	std::vector<PatchInstance> packed(40);
+	for (int count = 0; count <= 37; count++)
+	{
+		PatchInstancesSoA streams;
+		RandomInstanceStreams(state, count, fields, streams);
+		memset(&packed[0], INSTANCES_SENTINEL, packed.size() * sizeof(PatchInstance));
+		PackPatchInstances(streams, count, &packed[0]);
+		for (int i = 0; i < count; i++)
+		{
+			PatchInstance expected;
+			PackPatchInstanceReference(streams, i, expected);
+			packErrors += memcmp(&expected, &packed[i], sizeof(PatchInstance)) != 0 ? 1 : 0;
+		}
+		const unsigned char* pAfter = (const unsigned char*)&packed[count];
+		for (size_t b = 0; b < (packed.size() - count) * sizeof(PatchInstance); b++)
+			packErrors += pAfter[b] != INSTANCES_SENTINEL ? 1 : 0;
+	}
+	check.FailIf(sizeof(PatchInstance) != PATCH_INSTANCE_FIELDS * sizeof(float) || packErrors > 0,
+		"%d instances packed wrong or bytes written beyond them", packErrors);
+
+	// The shared patch of every instance lands on the leaf grid vertices of the indexed
+	// quadtree draw, its factors are the patch's segments and count its triangles
+	TerrainQuadtree quadtree;
+	quadtree.Build(INSTANCES_LEVELS);
+	int leaves = quadtree.GetLeavesPerSide();
+	TerrainGrid leafGrid;
+	leafGrid.Build(leaves, leaves);
+	SceneSettings settings;
+	settings.QuadtreeLod = true;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	std::vector<QuadtreePatch> patches(QUADTREE_MAX_PATCHES);
+	std::vector<unsigned int> indices(QUADTREE_MAX_PATCHES * TERRAIN_QUAD_INDICES_PER_PATCH);
+	PatchInstanceStreams instanceStreams;
+	RecordingPatchBackend backend(QUADTREE_MAX_PATCHES);
+	int cornerErrors = 0, factorErrors = 0, submitErrors = 0, totalPatches = 0;
+	srand(29);
+	for (int view = 0; view < INSTANCES_VIEWS; view++)
+	{
+		SceneFrame scene;
+		int count = SelectInstanceView(quadtree, projection, settings, patches, scene);
+		int subdivisions = (int)scene.Frame.QuadtreeSubdivisions;
+		instanceStreams.SetQuadtreePatches(&patches[0], count, leaves, subdivisions);
+		quadtree.WritePatchIndices(&patches[0], count, &indices[0]);
+		totalPatches += count;
+
+		backend.ResetCounters();
+		PatchInstancesSoA streams = instanceStreams.GetSoA();
+		int drawn = SubmitPatchInstances(backend, streams, instanceStreams.GetCount(), QUADTREE_MAX_PATCHES);
+		bool oneDraw = count == 0 ? (backend.GetMapCount() == 0 && backend.GetDrawCount() == 0) :
+			(backend.GetMapCount() == 1 && backend.GetDrawCount() == 1 &&
+			backend.GetLastIndexCount() == PATCH_INSTANCE_CONTROL_POINTS && backend.GetLastInstanceCount() == (unsigned int)count);
+		submitErrors += (drawn != count || !oneDraw || backend.GetBytesUploaded() != (long long)(count * sizeof(PatchInstance)) ||
+			!backend.IsUntouchedAfter(count)) ? 1 : 0;
+
+		long long instanceTriangles = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const PatchInstance& instance = backend.GetInstances()[i];
+			for (int corner = 0; corner < PATCH_INSTANCE_CONTROL_POINTS; corner++)
+			{
+				float position[3], texCoord[2], expectedPosition[3], expectedTexCoord[2];
+				GetPatchInstanceCorner(instance, corner, position, texCoord);
+				leafGrid.GetVertex(indices[i * TERRAIN_QUAD_INDICES_PER_PATCH + corner], expectedPosition, expectedTexCoord);
+				cornerErrors += (memcmp(position, expectedPosition, sizeof(position)) != 0 ||
+					memcmp(texCoord, expectedTexCoord, sizeof(texCoord)) != 0) ? 1 : 0;
+			}
+			float segments = (float)GetQuadtreePatchSegments(patches[i], subdivisions);
+			for (int e = 0; e < 4; e++)
+				factorErrors += (instance.EdgeFactors[e] != segments) ? 1 : 0;
+			factorErrors += (instance.Level != (float)patches[i].Level) ? 1 : 0;
+			instanceTriangles += 2 * (long long)instance.EdgeFactors[0] * (long long)instance.EdgeFactors[1];
+		}
+		factorErrors += (instanceTriangles != CountQuadtreeTriangles(&patches[0], count, subdivisions)) ? 1 : 0;
+	}
+	check.FailIf(cornerErrors > 0 || factorErrors > 0,
+		"%d corners off the leaf grid, %d wrong levels, factors or triangle counts", cornerErrors, factorErrors);
+
+	// Empty frames draw nothing, long lists are clipped to the buffer and a failed map
+	// skips the draw
+	PatchInstancesSoA streams;
+	RandomInstanceStreams(state, QUADTREE_MAX_PATCHES + 5, fields, streams);
+	backend.ResetCounters();
+	submitErrors += (SubmitPatchInstances(backend, streams, 0, QUADTREE_MAX_PATCHES) != 0 || backend.GetMapCount() != 0 ||
+		backend.GetDrawCount() != 0) ? 1 : 0;
+	int clipped = SubmitPatchInstances(backend, streams, QUADTREE_MAX_PATCHES + 5, QUADTREE_MAX_PATCHES);
+	submitErrors += (clipped != QUADTREE_MAX_PATCHES || backend.GetLastInstanceCount() != QUADTREE_MAX_PATCHES ||
+		backend.GetBytesUploaded() != (long long)(QUADTREE_MAX_PATCHES * sizeof(PatchInstance))) ? 1 : 0;
+	backend.SetFailMaps(true);
+	backend.ResetCounters();
+	submitErrors += (SubmitPatchInstances(backend, streams, 10, QUADTREE_MAX_PATCHES) != 0 || backend.GetDrawCount() != 0) ? 1 : 0;
+	check.FailIf(submitErrors > 0 || backend.GetErrors() > 0,
+		"%d submissions with the wrong maps, draws or bytes, %d backend call errors", submitErrors,
+		backend.GetErrors());
+
+	return check.Finish("%d views, %d patches", INSTANCES_VIEWS, totalPatches);
+}
+
+void RunPatchInstancesSuite()
+{
+	// Packing into a buffer of the size the demo maps, and into one beyond the caches
+	static const int s_Counts[] = { INSTANCES_PACK_COUNT, 1 << 20 };
+	unsigned int state = 5;
+	std::vector<float> fields;
+	for (int c = 0; c < 2; c++)
+	{
+		int count = s_Counts[c];
+		int repeats = std::max(1, (1 << 24) / count);
+		PatchInstancesSoA streams;
+		RandomInstanceStreams(state, count, fields, streams);
+		std::vector<PatchInstance> instances(count);
+
+		double start = GetTimeSeconds();
+		for (int r = 0; r < repeats; r++)
+			PackPatchInstances(streams, count, &instances[0]);
+		double packSeconds = GetTimeSeconds() - start;
+		start = GetTimeSeconds();
+		for (int r = 0; r < repeats; r++)
+		{
+			for (int i = 0; i < count; i++)
+				PackPatchInstanceReference(streams, i, instances[i]);
+		}
+		double referenceSeconds = GetTimeSeconds() - start;
+		double instancesPacked = (double)count * repeats;
+		printf("instances pack %7d  %7.1f M instances/s  %5.2f GB/s  field by field %7.1f M instances/s\n", count,
+			instancesPacked / packSeconds * 1e-6, instancesPacked * sizeof(PatchInstance) / packSeconds * 1e-9,
+			instancesPacked / referenceSeconds * 1e-6);
+	}
+
+	// Calls and bytes per frame: one draw per patch with its constants, the indexed draw
+	// with four indices and the level and segments per patch, and one instanced draw
+	TerrainQuadtree quadtree;
+	quadtree.Build(INSTANCES_LEVELS);
+	SceneSettings settings;
+	settings.QuadtreeLod = true;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	std::vector<QuadtreePatch> patches(QUADTREE_MAX_PATCHES);
+	PatchInstanceStreams instanceStreams;
+	RecordingPatchBackend backend(QUADTREE_MAX_PATCHES);
+	long long totalPatches = 0;
+	double submitSeconds = 0.0;
+	srand(31);
+	for (int view = 0; view < INSTANCES_VIEWS; view++)
+	{
+		SceneFrame scene;
+		int count = SelectInstanceView(quadtree, projection, settings, patches, scene);
+		double start = GetTimeSeconds();
+		instanceStreams.SetQuadtreePatches(&patches[0], count, quadtree.GetLeavesPerSide(), (int)scene.Frame.QuadtreeSubdivisions);
+		SubmitPatchInstances(backend, instanceStreams.GetSoA(), instanceStreams.GetCount(), QUADTREE_MAX_PATCHES);
+		submitSeconds += GetTimeSeconds() - start;
+		totalPatches += count;
+	}
+	double patchesPerFrame = (double)totalPatches / INSTANCES_VIEWS;
+	printf("instances %d views, %.1f patches per frame\n", INSTANCES_VIEWS, patchesPerFrame);
+	printf("instances per-patch draws  %7.1f draw calls  and as many constant buffer updates\n", patchesPerFrame);
+	printf("instances indexed          %7.1f draw calls  %7.1f bytes per frame in 2 maps\n", 1.0,
+		patchesPerFrame * (TERRAIN_QUAD_INDICES_PER_PATCH * sizeof(unsigned short) + 2 * sizeof(unsigned int)));
+	printf("instances instanced        %7.1f draw calls  %7.1f bytes per frame in %.1f maps, %.2f us to build and pack\n",
+		(double)backend.GetDrawCount() / INSTANCES_VIEWS, (double)backend.GetBytesUploaded() / INSTANCES_VIEWS,
+		(double)backend.GetMapCount() / INSTANCES_VIEWS, submitSeconds / INSTANCES_VIEWS * 1e6);
+}
@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// File: RingAllocator.cpp
+//--------------------------------------------------------------------------------------
+#include "RingAllocator.h"
+
+
+//--------------------------------------------------------------------------------------
+// RingAllocator
+//--------------------------------------------------------------------------------------
+void RingAllocator::Reset(unsigned int capacity)
+{
+	m_Capacity = capacity;
+	m_Head = 0;
+	m_Mapped = false;
+	m_DiscardCount = 0;
+}
+
+bool RingAllocator::Allocate(unsigned int size, unsigned int alignment, unsigned int& offset, RING_MAP& map)
+{
+	if (size > m_Capacity || alignment == 0 || (alignment & (alignment - 1)) != 0)
+		return false;
+
+	// The first map of the buffer discards too, nothing has been written that could be kept
+	unsigned long long aligned = ((unsigned long long)m_Head + alignment - 1) & ~(unsigned long long)(alignment - 1);
+	if (!m_Mapped || aligned + size > m_Capacity)
+	{
+		aligned = 0;
+		map = RING_MAP_DISCARD;
+		m_Mapped = true;
+		m_DiscardCount++;
+	}
+	else
+	{
+		map = RING_MAP_NO_OVERWRITE;
+	}
+
+	offset = (unsigned int)aligned;
+	m_Head = offset + size;
+	return true;
+}
@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// File: RingAllocator.h
+//
+// Sub-allocates per-draw data from a dynamic buffer. Allocations are appended behind
+// the previous ones and mapped with no-overwrite, so the GPU can keep reading what was
+// written before. When an allocation no longer fits, the ring starts over at offset 0
+// and asks for a discard map, which hands the old contents to the driver instead of
+// waiting for the GPU.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+// D3D11_MAP_WRITE_NO_OVERWRITE and D3D11_MAP_WRITE_DISCARD
+enum RING_MAP
+{
+	RING_MAP_NO_OVERWRITE,
+	RING_MAP_DISCARD,
+};
+
+
+//--------------------------------------------------------------------------------------
+// RingAllocator
+//--------------------------------------------------------------------------------------
+class RingAllocator
+{
+public:
+	RingAllocator(unsigned int capacity = 0) { Reset(capacity); }
+
+	// Forgets every allocation, the next one is mapped with discard
+	void Reset(unsigned int capacity);
+
+	// Reserves size bytes at an offset that is a multiple of alignment (a power of two).
+	// Returns false if the allocation is larger than the buffer.
+	bool Allocate(unsigned int size, unsigned int alignment, unsigned int& offset, RING_MAP& map);
+
+	unsigned int GetCapacity() const { return m_Capacity; }
+	unsigned int GetHead() const { return m_Head; }
+	int GetDiscardCount() const { return m_DiscardCount; }
+
+private:
+	unsigned int m_Capacity;
+	unsigned int m_Head;
+	bool m_Mapped;
+	int m_DiscardCount;
+};
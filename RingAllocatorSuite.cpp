@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// File: RingAllocatorSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "RingAllocator.h"
+#include "Timer.h"
+#include <stdio.h>
+
+
+//--------------------------------------------------------------------------------------
+// Ring allocator
+//--------------------------------------------------------------------------------------
+int VerifyRingAllocator()
+{
+	SuiteCheck check("ring");
+	RingAllocator ring(1024);
+	unsigned int offsets[3];
+	RING_MAP maps[3];
+	bool allocated = ring.Allocate(100, 4, offsets[0], maps[0]) && ring.Allocate(10, 16, offsets[1], maps[1]) &&
+		ring.Allocate(1000, 4, offsets[2], maps[2]);
+	check.FailIf(!allocated || offsets[0] != 0 || maps[0] != RING_MAP_DISCARD || offsets[1] != 112 ||
+		maps[1] != RING_MAP_NO_OVERWRITE || offsets[2] != 0 || maps[2] != RING_MAP_DISCARD ||
+		ring.GetDiscardCount() != 2, "offsets %u %u %u", offsets[0], offsets[1], offsets[2]);
+	check.FailIf(ring.Allocate(1025, 4, offsets[0], maps[0]) || ring.Allocate(16, 3, offsets[0], maps[0]) ||
+		ring.GetHead() != 1000, "invalid allocation was accepted");
+
+	// Random allocations never overlap the ones since the last discard, and only discard
+	// when the allocation does not fit behind them
+	static const unsigned int s_Alignments[] = { 1, 2, 4, 16, 256 };
+	const unsigned int capacity = 4096;
+	ring.Reset(capacity);
+	unsigned int seed = 7, end = capacity;
+	int discards = 0, errors = 0;
+	for (int i = 0; i < 100000; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		unsigned int size = (seed >> 8) % 301;
+		unsigned int alignment = s_Alignments[(seed >> 20) % 5];
+		unsigned int offset;
+		RING_MAP map;
+		if (!ring.Allocate(size, alignment, offset, map))
+		{
+			errors++;
+			continue;
+		}
+		unsigned int alignedEnd = (end + alignment - 1) & ~(alignment - 1);
+		bool fits = (i > 0) && alignedEnd + size <= capacity;
+		if (offset % alignment != 0 || offset + size > capacity || (map == RING_MAP_DISCARD) == fits ||
+			(map == RING_MAP_DISCARD && offset != 0) || (map == RING_MAP_NO_OVERWRITE && offset != alignedEnd))
+			errors++;
+		discards += (map == RING_MAP_DISCARD) ? 1 : 0;
+		end = offset + size;
+	}
+	check.FailIf(errors != 0 || discards != ring.GetDiscardCount(), "%d errors in random allocations", errors);
+
+	// Sized for four frames of the largest draw, the demo discards once every four frames
+	const unsigned int frameSize = 64 * 24 * 2;
+	ring.Reset(frameSize * 4);
+	for (int frame = 0; frame < 400; frame++)
+	{
+		unsigned int offset;
+		RING_MAP map;
+		ring.Allocate(frameSize, 2, offset, map);
+	}
+	check.FailIf(ring.GetDiscardCount() != 100, "%d discards in 400 frames", ring.GetDiscardCount());
+
+	return check.Finish("%d discards", discards);
+}
+
+void RunRingAllocatorThroughput()
+{
+	RingAllocator ring(1 << 20);
+	const int allocations = 10000000;
+	unsigned int seed = 3, checksum = 0;
+	double start = GetTimeSeconds();
+	for (int i = 0; i < allocations; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		unsigned int offset;
+		RING_MAP map;
+		ring.Allocate(16 + ((seed >> 8) & 1023), 16, offset, map);
+		checksum += offset;
+	}
+	double seconds = GetTimeSeconds() - start;
+	printf("ring allocate %10.2f ns per allocation  (%d discards, checksum %u)\n", seconds * 1e9 / allocations,
+		ring.GetDiscardCount(), checksum);
+}
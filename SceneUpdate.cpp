@@ -0,0 +1,399 @@
+//--------------------------------------------------------------------------------------
+// File: SceneUpdate.cpp
+//--------------------------------------------------------------------------------------
+#include "SceneUpdate.h"
+#include "TessFactors.h"
+#include "Tessellator.h"
+#include <math.h>
+#include <algorithm>
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// Vector helpers
+//--------------------------------------------------------------------------------------
+static void Cross(const float a[3], const float b[3], float result[3])
+{
+	result[0] = a[1] * b[2] - a[2] * b[1];
+	result[1] = a[2] * b[0] - a[0] * b[2];
+	result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float Dot(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Leaves zero vectors unchanged
+static void Normalize(float v[3])
+{
+	float length = sqrtf(Dot(v, v));
+	if (length <= 0.0f)
+		return;
+	for (int c = 0; c < 3; c++)
+		v[c] /= length;
+}
+
+static float* GetForward(const SceneCamera& camera, float direction[3])
+{
+	for (int c = 0; c < 3; c++)
+		direction[c] = camera.At[c] - camera.Eye[c];
+	return direction;
+}
+
+// cross(Up, forward), points to the right of the view direction
+static float* GetSide(const SceneCamera& camera, float direction[3])
+{
+	float forward[3];
+	Cross(camera.Up, GetForward(camera, forward), direction);
+	return direction;
+}
+
+static float* GetUp(const SceneCamera& camera, float direction[3])
+{
+	for (int c = 0; c < 3; c++)
+		direction[c] = camera.Up[c];
+	return direction;
+}
+
+static void MoveEye(SceneCamera& camera, float direction[3], float distance)
+{
+	Normalize(direction);
+	for (int c = 0; c < 3; c++)
+		camera.Eye[c] += direction[c] * distance;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Matrices, the same results as XMMatrixLookAtLH, XMMatrixPerspectiveFovLH,
+// XMMatrixMultiply and XMMatrixTranspose
+//--------------------------------------------------------------------------------------
+void BuildLookAtLH(const float eye[3], const float at[3], const float up[3], float m[4][4])
+{
+	float z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+	Normalize(z);
+	float x[3];
+	Cross(up, z, x);
+	Normalize(x);
+	float y[3];
+	Cross(z, x, y);
+
+	for (int r = 0; r < 3; r++)
+	{
+		m[r][0] = x[r];
+		m[r][1] = y[r];
+		m[r][2] = z[r];
+		m[r][3] = 0.0f;
+	}
+	m[3][0] = -Dot(x, eye);
+	m[3][1] = -Dot(y, eye);
+	m[3][2] = -Dot(z, eye);
+	m[3][3] = 1.0f;
+}
+
+void BuildPerspectiveFovLH(float fovY, float aspect, float zNear, float zFar, float m[4][4])
+{
+	memset(m, 0, sizeof(float) * 16);
+	float yScale = 1.0f / tanf(fovY * 0.5f);
+	m[0][0] = yScale / aspect;
+	m[1][1] = yScale;
+	m[2][2] = zFar / (zFar - zNear);
+	m[2][3] = 1.0f;
+	m[3][2] = -zNear * zFar / (zFar - zNear);
+}
+
+void MultiplyMatrices(const float a[4][4], const float b[4][4], float m[4][4])
+{
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++)
+			m[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] + a[r][3] * b[3][c];
+	}
+}
+
+void TransposeMatrix(const float m[4][4], float transposed[4][4])
+{
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++)
+			transposed[c][r] = m[r][c];
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Frame update
+//--------------------------------------------------------------------------------------
+void MoveCamera(SceneCamera& camera, float dt)
+{
+	// Applied one after the other like the demo always did, each step sees the eye
+	// position the previous one left
+	float distance = camera.Speed * dt;
+	float direction[3];
+	if (camera.isMovingForward)
+		MoveEye(camera, GetForward(camera, direction), distance);
+	if (camera.isMovingBackward)
+		MoveEye(camera, GetForward(camera, direction), -distance);
+	if (camera.isMovingLeft)
+		MoveEye(camera, GetSide(camera, direction), -distance);
+	if (camera.isMovingRight)
+		MoveEye(camera, GetSide(camera, direction), distance);
+	if (camera.isMovingUp)
+		MoveEye(camera, GetUp(camera, direction), distance);
+	if (camera.isMovingDown)
+		MoveEye(camera, GetUp(camera, direction), -distance);
+}
+
+void BuildStaticConstants(const float projection[4][4], float viewportWidth, float viewportHeight,
+	StaticConstants& constants)
+{
+	memset(&constants, 0, sizeof(constants));
+	TransposeMatrix(projection, constants.Projection);
+	constants.LightPos[0] = -10.0f;
+	constants.LightPos[1] = 10.0f;
+	constants.LightPos[2] = 10.0f;
+	constants.LightPos[3] = 1.0f;
+	for (int c = 0; c < 4; c++)
+		constants.LightColor[c] = 1.0f;
+	constants.ViewportSize[0] = viewportWidth;
+	constants.ViewportSize[1] = viewportHeight;
+}
+
+void FollowGround(SceneCamera& camera, const TerrainHeightField& field)
+{
+	if (!field.IsValid() || !field.IsInside(camera.Eye[0], camera.Eye[2]))
+		return;
+	float ground = field.SampleBilinear(camera.Eye[0], camera.Eye[2]) + camera.GroundClearance;
+	if (camera.Eye[1] < ground)
+		camera.Eye[1] = ground;
+}
+
+void UpdateScene(SceneCamera& camera, const SceneSettings& settings, const float projection[4][4], float dt,
+	SceneFrame& frame, const HeightPyramid* pGroundHeights)
+{
+	float terrainScale = settings.QuadtreeLod ? QUADTREE_TERRAIN_SCALE : 1.0f;
+	frame.WorldScale[0] = settings.Scaling * terrainScale * 1.5f;
+	frame.WorldScale[1] = settings.Scaling * terrainScale;
+	frame.WorldScale[2] = settings.Scaling * terrainScale;
+
+	MoveCamera(camera, dt);
+	if (settings.GroundFollow && pGroundHeights)
+	{
+		TerrainHeightField field;
+		field.Init(pGroundHeights, frame.WorldScale, settings.Scaling * terrainScale, settings.DisplacementLevel);
+		FollowGround(camera, field);
+	}
+	BuildLookAtLH(camera.Eye, camera.At, camera.Up, frame.View);
+	MultiplyMatrices(frame.View, projection, frame.ViewProjection);
+	ExtractFrustumPlanes(frame.ViewProjection, frame.ViewFrustum);
+
+	memset(&frame.Frame, 0, sizeof(frame.Frame));
+	TransposeMatrix(frame.View, frame.Frame.View);
+	for (int c = 0; c < 3; c++)
+		frame.Frame.Eye[c] = camera.Eye[c];
+	frame.Frame.TessellationFactor = settings.TessellationFactor;
+	frame.Frame.TargetTriangleSize = settings.TargetTriangleSize / settings.TessellationScale;
+	frame.Frame.AdaptiveTessellation = settings.AdaptiveTessellation ? 1.0f : 0.0f;
+	frame.Frame.ContentDensity = settings.ContentDensity ? 1.0f : 0.0f;
+
+	memset(&frame.Draw, 0, sizeof(frame.Draw));
+	for (int c = 0; c < 3; c++)
+		frame.Draw.World[c][c] = frame.WorldScale[c];
+	frame.Draw.World[3][3] = 1.0f;
+	frame.Draw.Scaling = settings.Scaling * terrainScale;
+	frame.Draw.DisplacementLevel = settings.DisplacementLevel;
+}
+
+int SelectQuadtreePatches(const TerrainQuadtree& quadtree, const SceneCamera& camera, const SceneSettings& settings,
+	float projScale, float viewportHeight, SceneFrame& frame, QuadtreePatch* pPatches, int maxPatches)
+{
+	QuadtreeSelectParams params;
+	for (int c = 0; c < 3; c++)
+	{
+		params.Eye[c] = camera.Eye[c];
+		params.WorldScale[c] = frame.WorldScale[c];
+	}
+	params.pFrustum = &frame.ViewFrustum;
+	params.DisplacementScale = frame.Draw.Scaling * frame.Draw.DisplacementLevel;
+
+	// The longer side of a leaf cell sets the distance where its triangles reach the target size
+	int subdivisions = GetQuadtreeSubdivisions(settings.TessellationFactor);
+	float side = fabsf(frame.WorldScale[0]) > fabsf(frame.WorldScale[2]) ? fabsf(frame.WorldScale[0]) : fabsf(frame.WorldScale[2]);
+	float leafSize = 2.0f * side / quadtree.GetLeavesPerSide();
+	params.LeafRange = ComputeQuadtreeLeafRange(leafSize, subdivisions, projScale, viewportHeight,
+		frame.Frame.TargetTriangleSize);
+
+	QuadtreeLodRanges ranges;
+	int count = quadtree.Select(params, pPatches, maxPatches, ranges);
+	frame.Frame.QuadtreeSubdivisions = (float)subdivisions;
+	frame.Frame.QuadtreeMorphHeight = ranges.MorphHeight;
+	for (int level = 0; level < ranges.LevelCount; level++)
+	{
+		frame.Frame.QuadtreeMorphStart[level] = ranges.MorphStart[level];
+		frame.Frame.QuadtreeRange[level] = ranges.Range[level];
+	}
+	return count;
+}
+
+int SelectBakedTerrainChunks(const BakedTerrain& terrain, const SceneCamera& camera, const SceneSettings& settings,
+	float projScale, float viewportHeight, const SceneFrame& frame, BakedDraw* pDraws, int maxDraws)
+{
+	BakedSelectParams params;
+	for (int c = 0; c < 3; c++)
+	{
+		params.Eye[c] = camera.Eye[c];
+		params.WorldScale[c] = frame.WorldScale[c];
+	}
+	params.pFrustum = &frame.ViewFrustum;
+	params.HeightScale = frame.Draw.Scaling * frame.Draw.DisplacementLevel;
+	params.PixelsPerUnit = projScale * viewportHeight * 0.5f;
+	params.MaxPixelError = settings.BakedPixelError;
+	return terrain.Select(params, pDraws, maxDraws);
+}
+
+
+//--------------------------------------------------------------------------------------
+// TerrainTriangleCounter
+//--------------------------------------------------------------------------------------
+long long CountUniformTerrainTriangles(int count, float factor, bool quadPatches)
+{
+	if (quadPatches)
+		return (long long)count * CountFractionalOddQuadTriangles(factor, factor, factor, factor, factor, factor);
+	return (long long)count * 2 * CountFractionalOddTriTriangles(factor, factor, factor, factor);
+}
+
+void TerrainTriangleCounter::ComputeFactors(const TerrainGrid& grid, const int* pPatches, int count,
+	const SceneCamera& camera, const SceneSettings& settings, const SceneFrame& frame, float projScale,
+	float viewportHeight)
+{
+	// Every grid patch is two tri patches or one quad patch
+	bool useDensity = settings.ContentDensity && m_pDensityMap && m_pDensityMap->IsValid();
+	bool quads = settings.QuadPatches;
+	int controlPoints = quads ? 4 : 3;
+	int numEdges = quads ? 4 : 3;
+	int numPatches = quads ? count : count * 2;
+	m_Quads = quads;
+	m_PatchCount = (count > 0) ? numPatches : 0;
+	if (count <= 0)
+		return;
+
+	for (int f = 0; f < 6; f++)
+		m_Factors[f].resize(numPatches);
+	if (!settings.AdaptiveTessellation && !useDensity)
+	{
+		for (int f = 0; f < 6; f++)
+			std::fill(m_Factors[f].begin(), m_Factors[f].end(), settings.TessellationFactor);
+		return;
+	}
+
+	// World space control points as written by VS, the factors as computed by ConstHS
+	for (int p = 0; p < controlPoints; p++)
+	{
+		for (int c = 0; c < 3; c++)
+			m_Positions[p][c].resize(numPatches);
+	}
+	for (int e = 0; e < numEdges; e++)
+		m_Density[e].resize(numPatches);
+
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+		int numIndices = quads ? TERRAIN_QUAD_INDICES_PER_PATCH : TERRAIN_INDICES_PER_PATCH;
+		if (quads)
+			grid.GetQuadPatchIndices(pPatches[i], indices);
+		else
+			grid.GetPatchIndices(pPatches[i], indices);
+		float texCoords[TERRAIN_INDICES_PER_PATCH][2];
+		for (int v = 0; v < numIndices; v++)
+		{
+			float position[3];
+			grid.GetVertex(indices[v], position, texCoords[v]);
+			int patch = quads ? i : i * 2 + v / 3;
+			for (int c = 0; c < 3; c++)
+				m_Positions[v % controlPoints][c][patch] = position[c] * frame.WorldScale[c];
+		}
+		if (!useDensity)
+			continue;
+
+		if (quads)
+		{
+			// Edge order of ConstQuadHS
+			static const int s_EdgePoints[4][2] = { { 0, 1 }, { 3, 0 }, { 3, 2 }, { 1, 2 } };
+			for (int e = 0; e < 4; e++)
+			{
+				const float* pA = texCoords[s_EdgePoints[e][0]];
+				const float* pB = texCoords[s_EdgePoints[e][1]];
+				m_Density[e][i] = m_pDensityMap->SampleEdge(pA[0], pA[1], pB[0], pB[1]);
+			}
+			continue;
+		}
+
+		// Edge e is the one opposite control point e, like in ConstHS
+		for (int t = 0; t < 2; t++)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				const float* pA = texCoords[t * 3 + (e + 1) % 3];
+				const float* pB = texCoords[t * 3 + (e + 2) % 3];
+				m_Density[e][i * 2 + t] = m_pDensityMap->SampleEdge(pA[0], pA[1], pB[0], pB[1]);
+			}
+		}
+	}
+
+	AdaptiveTessParams params;
+	for (int c = 0; c < 3; c++)
+		params.Eye[c] = camera.Eye[c];
+	params.ProjScale = projScale;
+	params.ViewportHeight = viewportHeight;
+	params.TargetTriangleSize = frame.Frame.TargetTriangleSize;
+	params.MaxTessFactor = settings.TessellationFactor;
+
+	PatchPositionsSoA positions;
+	PatchFactorsSoA factors;
+	PatchDensitySoA density;
+	for (int p = 0; p < 4; p++)
+	{
+		bool used = p < controlPoints;
+		positions.X[p] = used ? &m_Positions[p][0][0] : NULL;
+		positions.Y[p] = used ? &m_Positions[p][1][0] : NULL;
+		positions.Z[p] = used ? &m_Positions[p][2][0] : NULL;
+		factors.Edges[p] = p < numEdges ? &m_Factors[p][0] : NULL;
+		density.Edges[p] = p < numEdges ? &m_Density[p][0] : NULL;
+	}
+	factors.Inside[0] = &m_Factors[4][0];
+	factors.Inside[1] = quads ? &m_Factors[5][0] : NULL;
+
+	if (quads && !settings.AdaptiveTessellation)
+		ComputeUniformQuadPatchTessFactors(density, numPatches, settings.TessellationFactor, factors);
+	else if (quads)
+		ComputeQuadPatchTessFactors(positions, numPatches, params, factors, useDensity ? &density : NULL);
+	else if (!settings.AdaptiveTessellation)
+		ComputeUniformTriPatchTessFactors(density, numPatches, settings.TessellationFactor, factors);
+	else
+		ComputeTriPatchTessFactors(positions, numPatches, params, factors, useDensity ? &density : NULL);
+}
+
+void TerrainTriangleCounter::GetFactors(int patch, float factors[6]) const
+{
+	for (int f = 0; f < 6; f++)
+		factors[f] = (m_Quads || (f != 3 && f != 5)) ? m_Factors[f][patch] : 0.0f;
+}
+
+long long TerrainTriangleCounter::Count(const TerrainGrid& grid, const int* pPatches, int count, const SceneCamera& camera,
+	const SceneSettings& settings, const SceneFrame& frame, float projScale, float viewportHeight)
+{
+	bool useDensity = settings.ContentDensity && m_pDensityMap && m_pDensityMap->IsValid();
+	if (!settings.AdaptiveTessellation && !useDensity)
+		return CountUniformTerrainTriangles(count, settings.TessellationFactor, settings.QuadPatches);
+
+	ComputeFactors(grid, pPatches, count, camera, settings, frame, projScale, viewportHeight);
+	long long triangles = 0;
+	for (int p = 0; p < m_PatchCount; p++)
+	{
+		triangles += m_Quads ?
+			CountFractionalOddQuadTriangles(m_Factors[0][p], m_Factors[1][p], m_Factors[2][p], m_Factors[3][p],
+				m_Factors[4][p], m_Factors[5][p]) :
+			CountFractionalOddTriTriangles(m_Factors[0][p], m_Factors[1][p], m_Factors[2][p], m_Factors[4][p]);
+	}
+	return triangles;
+}
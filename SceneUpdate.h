@@ -0,0 +1,193 @@
+//--------------------------------------------------------------------------------------
+// File: SceneUpdate.h
+//
+// The part of a frame that does not need the device: camera movement, the view and
+// projection matrices, the constant buffer contents and the number of triangles the
+// tessellator will generate for the visible patches. Render and the headless scripted
+// benchmark share it, so a benchmark script produces the same frames on Windows and
+// Linux. Matrices are row-major with row vectors, like XMMATRIX.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "BakedTerrain.h"
+#include "TerrainGrid.h"
+#include "TerrainHeightField.h"
+#include "TerrainQuadtree.h"
+#include "TessDensity.h"
+#include <stddef.h>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// The quadtree terrain is this many times larger and taller than the grid terrain
+#define QUADTREE_TERRAIN_SCALE 8.0f
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Camera looking at a fixed point, moved by the keys of the demo
+struct SceneCamera
+{
+	float Eye[3] = { 0.0f, 4.0f, -10.0f };
+	float At[3] = { 1.5f, 0.0f, 0.0f };
+	float Up[3] = { 0.0f, 1.0f, 0.0f };
+	float Speed = 10.0f;
+	float GroundClearance = 0.05f;      // least height of the eye above the terrain while following the ground
+
+	bool isMovingForward = false;
+	bool isMovingBackward = false;
+	bool isMovingLeft = false;
+	bool isMovingRight = false;
+	bool isMovingUp = false;
+	bool isMovingDown = false;
+};
+
+// Settings changed by the keys of the demo and swept by benchmark scripts
+struct SceneSettings
+{
+	float TessellationFactor = 64.0f;
+	float Scaling = 3.0f;
+	float DisplacementLevel = 0.1f;
+	bool AdaptiveTessellation = false;
+	float TargetTriangleSize = 8.0f;
+	float TessellationScale = 1.0f;     // multiplies the adaptive factors, set by TessBudgetController
+	bool ContentDensity = false;        // scale the factors by the density map, see TessDensity.h
+	bool QuadPatches = false;           // one 4 control point quad patch per grid cell instead of two tri patches
+	bool QuadtreeLod = false;           // the large terrain with quadtree LOD instead of the grid, see TerrainQuadtree.h
+	bool GroundFollow = true;           // keep the eye above the terrain, see TerrainHeightField.h
+	bool BakedLod = false;              // static LOD meshes without the hull and domain shaders, see BakedTerrain.h
+	float BakedPixelError = 1.0f;       // largest screen space error of a baked chunk
+	bool RetessellationCache = false;   // replay unchanged grid patches from a stream-out buffer, see GpuTessellationCache.h
+};
+
+// Constant buffers split by how often they change, see Shaders/DisplacedAndShaded.hlsl.
+// Matrices are stored transposed, the way the shaders read them.
+struct StaticConstants
+{
+	float Projection[4][4];
+	float LightPos[4];
+	float LightColor[4];
+	float ViewportSize[2];
+	float Padding[2];
+};
+
+struct FrameConstants
+{
+	float View[4][4];
+	float Eye[4];
+	float TessellationFactor;
+	float TargetTriangleSize;         // divided by TessellationScale
+	float AdaptiveTessellation;
+	float ContentDensity;
+	float QuadtreeSubdivisions;       // grid segments of a full quadtree node patch
+	float QuadtreeMorphHeight;        // world height the quadtree LOD distances are measured at
+	float Padding[2];
+	float QuadtreeMorphStart[QUADTREE_MAX_LEVELS];
+	float QuadtreeRange[QUADTREE_MAX_LEVELS];
+};
+
+struct DrawConstants
+{
+	float World[4][4];
+	float Scaling;
+	float DisplacementLevel;
+	float BakedHeightMin;               // BakedTerrainHeader::HeightMin and HeightRange of the drawn baked terrain
+	float BakedHeightRange;
+	float GridPatches[2];               // patches per side of the drawn grid, VS derives its control points from them
+	float Padding[2];
+};
+
+// Everything Render computes for a frame before it touches the device
+struct SceneFrame
+{
+	float View[4][4];
+	float ViewProjection[4][4];
+	float WorldScale[3];        // the World matrix is a pure scale
+	Frustum ViewFrustum;
+	FrameConstants Frame;
+	DrawConstants Draw;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+void BuildLookAtLH(const float eye[3], const float at[3], const float up[3], float m[4][4]);
+void BuildPerspectiveFovLH(float fovY, float aspect, float zNear, float zFar, float m[4][4]);
+void MultiplyMatrices(const float a[4][4], const float b[4][4], float m[4][4]);
+void TransposeMatrix(const float m[4][4], float transposed[4][4]);
+
+// Moves the eye along the view direction, the side vector or the up vector for the
+// movement flags that are set. At stays where it is.
+void MoveCamera(SceneCamera& camera, float dt);
+
+void BuildStaticConstants(const float projection[4][4], float viewportWidth, float viewportHeight,
+	StaticConstants& constants);
+
+// Raises the eye to GroundClearance above the bilinear height of the terrain under it.
+// Outside the terrain quad the eye is left alone.
+void FollowGround(SceneCamera& camera, const TerrainHeightField& field);
+
+// Moves the camera by dt and builds the matrices and constants of the frame. With
+// GroundFollow set and the pyramid of the drawn displacement map in pGroundHeights, the
+// moved eye follows the ground before the matrices are built.
+void UpdateScene(SceneCamera& camera, const SceneSettings& settings, const float projection[4][4], float dt,
+	SceneFrame& frame, const HeightPyramid* pGroundHeights = NULL);
+
+// Selects the quadtree patches of a frame, at most maxPatches, and writes the
+// subdivisions and the morph ranges of the levels to the frame constants. The LOD ranges
+// follow the tessellation factor and the target triangle size. projScale is
+// Projection._22.
+int SelectQuadtreePatches(const TerrainQuadtree& quadtree, const SceneCamera& camera, const SceneSettings& settings,
+	float projScale, float viewportHeight, SceneFrame& frame, QuadtreePatch* pPatches, int maxPatches);
+
+// Selects the chunks of a baked terrain and their LODs, at most maxDraws, within
+// BakedPixelError pixels. projScale is Projection._22.
+int SelectBakedTerrainChunks(const BakedTerrain& terrain, const SceneCamera& camera, const SceneSettings& settings,
+	float projScale, float viewportHeight, const SceneFrame& frame, BakedDraw* pDraws, int maxDraws);
+
+// Triangles of count grid patches with the same factor on every edge, drawn as tri or
+// quad patches
+long long CountUniformTerrainTriangles(int count, float factor, bool quadPatches = false);
+
+
+//--------------------------------------------------------------------------------------
+// TerrainTriangleCounter
+//
+// Counts the triangles the tessellator generates for a list of visible patches, with
+// the factors ConstHS or ConstQuadHS computes (fractional_odd partitioning). The counts
+// are computed from the factors, nothing is tessellated.
+//--------------------------------------------------------------------------------------
+class TerrainTriangleCounter
+{
+public:
+	TerrainTriangleCounter() : m_pDensityMap(NULL) {}
+
+	// The map bound as texDensity, used while SceneSettings::ContentDensity is set
+	void SetDensityMap(const TessDensityMap* pDensityMap) { m_pDensityMap = pDensityMap; }
+
+	// projScale is Projection._22
+	long long Count(const TerrainGrid& grid, const int* pPatches, int count, const SceneCamera& camera,
+		const SceneSettings& settings, const SceneFrame& frame, float projScale, float viewportHeight);
+
+	// Computes the factors of the patches without counting, the global factor on every
+	// edge without adaptive tessellation or density
+	void ComputeFactors(const TerrainGrid& grid, const int* pPatches, int count, const SceneCamera& camera,
+		const SceneSettings& settings, const SceneFrame& frame, float projScale, float viewportHeight);
+
+	// Factors of a patch of the last ComputeFactors in the order of TessFactors.h, 0 for
+	// the fourth edge and the second inside factor of tri patches. Grid patch i is the tri
+	// patches 2 * i and 2 * i + 1 or quad patch i.
+	int GetPatchCount() const { return m_PatchCount; }
+	void GetFactors(int patch, float factors[6]) const;
+
+private:
+	const TessDensityMap* m_pDensityMap;
+	bool m_Quads = false;
+	int m_PatchCount = 0;
+	std::vector<float> m_Positions[4][3];
+	std::vector<float> m_Density[4];
+	std::vector<float> m_Factors[6];
+};
@@ -0,0 +1,201 @@
+//--------------------------------------------------------------------------------------
+// File: ShaderCache.cpp
+//--------------------------------------------------------------------------------------
+#include "ShaderCache.h"
+#include "Hash.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// File structures
+//--------------------------------------------------------------------------------------
+// Followed by IncludeCount records of { unsigned long long Hash, unsigned int PathLength,
+// PathLength characters } and BytecodeSize bytes of bytecode
+struct ShaderCacheHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned long long Key;
+	unsigned int IncludeCount;
+	unsigned int BytecodeSize;
+};
+
+#define SHADER_CACHE_MAX_INCLUDES       1024
+#define SHADER_CACHE_MAX_PATH_LENGTH    4096
+
+
+//--------------------------------------------------------------------------------------
+// ShaderCache
+//--------------------------------------------------------------------------------------
+// The terminator keeps ("ab", "c") and ("a", "bc") apart
+static unsigned long long HashString(const std::string& text, unsigned long long hash)
+{
+	return HashBytes(text.c_str(), text.size() + 1, hash);
+}
+
+ShaderCache::ShaderCache(ShaderCompiler* pCompiler, const char* pDirectory)
+	: m_pCompiler(pCompiler), m_Directory(pDirectory)
+{
+}
+
+unsigned long long ShaderCache::ComputeKey(const ShaderCompileRequest& request, unsigned long long sourceHash) const
+{
+	unsigned long long hash = HashBytes(&sourceHash, sizeof(sourceHash));
+	hash = HashString(m_pCompiler->GetName(), hash);
+	hash = HashString(request.FileName, hash);
+	unsigned int defineCount = (unsigned int)request.Defines.size();
+	hash = HashBytes(&defineCount, sizeof(defineCount), hash);
+	for (size_t i = 0; i < request.Defines.size(); i++)
+	{
+		hash = HashString(request.Defines[i].Name, hash);
+		hash = HashString(request.Defines[i].Value, hash);
+	}
+	hash = HashString(request.EntryPoint, hash);
+	hash = HashString(request.Profile, hash);
+	return HashBytes(&request.Flags, sizeof(request.Flags), hash);
+}
+
+std::string ShaderCache::GetEntryFileName(unsigned long long key) const
+{
+	char name[32];
+	sprintf(name, "/%016llx.shc", key);
+	return m_Directory + name;
+}
+
+bool ShaderCache::GetShader(const ShaderCompileRequest& request, std::vector<unsigned char>& bytecode, std::string* pErrors)
+{
+	double start = GetTimeSeconds();
+	unsigned long long sourceHash;
+	if (!HashFile(request.FileName.c_str(), sourceHash))
+	{
+		if (pErrors)
+			*pErrors = "Cannot read " + request.FileName + "\n";
+		return false;
+	}
+
+	unsigned long long key = ComputeKey(request, sourceHash);
+	std::string fileName = GetEntryFileName(key);
+	bool hit = LoadEntry(fileName, key, bytecode);
+	{
+		std::lock_guard<std::mutex> lock(m_StatsMutex);
+		m_Stats.LoadSeconds += GetTimeSeconds() - start;
+		if (hit)
+			m_Stats.Hits++;
+		else
+			m_Stats.Misses++;
+	}
+	if (hit)
+		return true;
+
+	start = GetTimeSeconds();
+	std::vector<std::string> includes;
+	std::string errors;
+	bool compiled = m_pCompiler->Compile(request, bytecode, includes, errors);
+	if (pErrors)
+		*pErrors = errors;
+
+	// A failed store only costs the next launch another compile
+	if (compiled)
+		StoreEntry(fileName, key, includes, bytecode);
+	std::lock_guard<std::mutex> lock(m_StatsMutex);
+	m_Stats.CompileSeconds += GetTimeSeconds() - start;
+	return compiled;
+}
+
+ShaderCacheStats ShaderCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_StatsMutex);
+	return m_Stats;
+}
+
+bool ShaderCache::LoadEntry(const std::string& fileName, unsigned long long key, std::vector<unsigned char>& bytecode) const
+{
+	FILE* pFile = fopen(fileName.c_str(), "rb");
+	if (!pFile)
+		return false;
+
+	ShaderCacheHeader header;
+	bool valid = fread(&header, sizeof(header), 1, pFile) == 1 && header.Magic == SHADER_CACHE_MAGIC &&
+		header.Version == SHADER_CACHE_VERSION && header.Key == key &&
+		header.IncludeCount <= SHADER_CACHE_MAX_INCLUDES && header.BytecodeSize > 0;
+
+	// Every included file must still have the content the bytecode was compiled from
+	for (unsigned int i = 0; i < header.IncludeCount && valid; i++)
+	{
+		unsigned long long includeHash, currentHash;
+		unsigned int pathLength;
+		valid = fread(&includeHash, sizeof(includeHash), 1, pFile) == 1 && fread(&pathLength, sizeof(pathLength), 1, pFile) == 1 &&
+			pathLength > 0 && pathLength <= SHADER_CACHE_MAX_PATH_LENGTH;
+		if (!valid)
+			break;
+		std::string path(pathLength, '\0');
+		valid = fread(&path[0], 1, pathLength, pFile) == pathLength &&
+			HashFile(path.c_str(), currentHash) && currentHash == includeHash;
+	}
+
+	if (valid)
+	{
+		bytecode.resize(header.BytecodeSize);
+		valid = fread(bytecode.data(), 1, bytecode.size(), pFile) == bytecode.size() && fgetc(pFile) == EOF;
+	}
+	fclose(pFile);
+	return valid;
+}
+
+bool ShaderCache::StoreEntry(const std::string& fileName, unsigned long long key, const std::vector<std::string>& includes,
+	const std::vector<unsigned char>& bytecode) const
+{
+	std::vector<unsigned long long> includeHashes(includes.size());
+	for (size_t i = 0; i < includes.size(); i++)
+	{
+		if (!HashFile(includes[i].c_str(), includeHashes[i]))
+			return false;
+	}
+
+#ifdef _WIN32
+	_mkdir(m_Directory.c_str());
+#else
+	mkdir(m_Directory.c_str(), 0755);
+#endif
+
+	// Written under a temporary name so an interrupted write never leaves a valid looking entry
+	std::string tempFileName = fileName + ".tmp";
+	FILE* pFile = fopen(tempFileName.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	ShaderCacheHeader header;
+	header.Magic = SHADER_CACHE_MAGIC;
+	header.Version = SHADER_CACHE_VERSION;
+	header.Key = key;
+	header.IncludeCount = (unsigned int)includes.size();
+	header.BytecodeSize = (unsigned int)bytecode.size();
+	bool success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+	for (size_t i = 0; i < includes.size() && success; i++)
+	{
+		unsigned int pathLength = (unsigned int)includes[i].size();
+		success = fwrite(&includeHashes[i], sizeof(includeHashes[i]), 1, pFile) == 1 &&
+			fwrite(&pathLength, sizeof(pathLength), 1, pFile) == 1 &&
+			fwrite(includes[i].c_str(), 1, pathLength, pFile) == pathLength;
+	}
+	if (success)
+		success = fwrite(bytecode.data(), 1, bytecode.size(), pFile) == bytecode.size();
+	success = (fclose(pFile) == 0) && success;
+
+	if (success)
+	{
+		remove(fileName.c_str());
+		success = rename(tempFileName.c_str(), fileName.c_str()) == 0;
+	}
+	if (!success)
+		remove(tempFileName.c_str());
+	return success;
+}
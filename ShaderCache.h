@@ -0,0 +1,100 @@
+//--------------------------------------------------------------------------------------
+// File: ShaderCache.h
+//
+// Persistent cache of compiled shader bytecode. An entry is keyed by the hash of the
+// source file, the defines, the entry point, the profile, the compile flags and the
+// compiler, and it records the hash of every file the source included. An entry is
+// only used while all of those files are unchanged, otherwise the shader is compiled
+// again and the entry replaced.
+//
+// Compilation goes through ShaderCompiler, D3DShaderCompiler in the demo and the
+// offline precompile step, and a stub in the headless benchmark.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define SHADER_CACHE_MAGIC      0x43485348      // "HSHC"
+#define SHADER_CACHE_VERSION    1
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct ShaderDefine
+{
+	std::string Name;
+	std::string Value;
+};
+
+struct ShaderCompileRequest
+{
+	std::string FileName;
+	std::vector<ShaderDefine> Defines;
+	std::string EntryPoint;
+	std::string Profile;
+	unsigned int Flags = 0;
+};
+
+struct ShaderCacheStats
+{
+	int Hits = 0;
+	int Misses = 0;
+	double LoadSeconds = 0.0;       // hashing the sources and reading hits
+	double CompileSeconds = 0.0;    // compiling and storing misses
+};
+
+
+//--------------------------------------------------------------------------------------
+// ShaderCompiler
+//--------------------------------------------------------------------------------------
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() {}
+
+	// Identifies the compiler build, cached bytecode of another compiler is not reused
+	virtual const char* GetName() const = 0;
+
+	// Compiles the request. includes receives the path of every file opened through
+	// #include, resolved so that it can be opened from the working directory.
+	virtual bool Compile(const ShaderCompileRequest& request, std::vector<unsigned char>& bytecode,
+		std::vector<std::string>& includes, std::string& errors) = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// ShaderCache
+//--------------------------------------------------------------------------------------
+class ShaderCache
+{
+public:
+	// Entries are stored in pDirectory, which is created with the first entry
+	ShaderCache(ShaderCompiler* pCompiler, const char* pDirectory);
+
+	// Reads the bytecode from the cache or compiles and stores it. Returns false if the
+	// source cannot be read or does not compile, with the compiler output in pErrors.
+	// Different requests can be loaded from several threads at once.
+	bool GetShader(const ShaderCompileRequest& request, std::vector<unsigned char>& bytecode, std::string* pErrors = NULL);
+
+	// Key of the request for a source file with the given content hash
+	unsigned long long ComputeKey(const ShaderCompileRequest& request, unsigned long long sourceHash) const;
+	std::string GetEntryFileName(unsigned long long key) const;
+
+	ShaderCacheStats GetStats() const;
+
+private:
+	bool LoadEntry(const std::string& fileName, unsigned long long key, std::vector<unsigned char>& bytecode) const;
+	bool StoreEntry(const std::string& fileName, unsigned long long key, const std::vector<std::string>& includes,
+		const std::vector<unsigned char>& bytecode) const;
+
+	ShaderCompiler* m_pCompiler;
+	std::string m_Directory;
+	ShaderCacheStats m_Stats;
+	mutable std::mutex m_StatsMutex;
+};
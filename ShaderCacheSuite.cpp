@@ -0,0 +1,276 @@
+//--------------------------------------------------------------------------------------
+// File: ShaderCacheSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "ShaderCache.h"
+#include "Hash.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+
+//--------------------------------------------------------------------------------------
+// Shader cache. The stub compiler follows #include "file" lines like the D3D compiler
+// and derives the bytecode from the preprocessed text and the request, so changes that
+// would change the real bytecode change the stub's too.
+//--------------------------------------------------------------------------------------
+class StubShaderCompiler : public ShaderCompiler
+{
+public:
+	StubShaderCompiler(const char* pName) : m_pName(pName), m_CompileCount(0) {}
+
+	virtual const char* GetName() const { return m_pName; }
+
+	virtual bool Compile(const ShaderCompileRequest& request, std::vector<unsigned char>& bytecode,
+		std::vector<std::string>& includes, std::string& errors)
+	{
+		m_CompileCount++;
+		std::string text;
+		includes.clear();
+		if (!Preprocess(request.FileName, text, includes, errors))
+			return false;
+		if (text.find(request.EntryPoint + "(") == std::string::npos)
+		{
+			errors = request.FileName + ": entry point " + request.EntryPoint + " not found\n";
+			return false;
+		}
+
+		unsigned long long hash = HashBytes(text.c_str(), text.size());
+		for (size_t i = 0; i < request.Defines.size(); i++)
+		{
+			hash = HashBytes(request.Defines[i].Name.c_str(), request.Defines[i].Name.size() + 1, hash);
+			hash = HashBytes(request.Defines[i].Value.c_str(), request.Defines[i].Value.size() + 1, hash);
+		}
+		hash = HashBytes(request.EntryPoint.c_str(), request.EntryPoint.size() + 1, hash);
+		hash = HashBytes(request.Profile.c_str(), request.Profile.size() + 1, hash);
+		hash = HashBytes(&request.Flags, sizeof(request.Flags), hash);
+		bytecode.assign((const unsigned char*)"DXBC", (const unsigned char*)"DXBC" + 4);
+		bytecode.insert(bytecode.end(), (const unsigned char*)&hash, (const unsigned char*)&hash + sizeof(hash));
+		return true;
+	}
+
+	int GetCompileCount() const { return m_CompileCount; }
+
+private:
+	static bool Preprocess(const std::string& fileName, std::string& text, std::vector<std::string>& includes, std::string& errors)
+	{
+		FILE* pFile = fopen(fileName.c_str(), "rb");
+		if (!pFile)
+		{
+			errors = "Cannot open " + fileName + "\n";
+			return false;
+		}
+
+		size_t separator = fileName.find_last_of("/\\");
+		std::string directory = (separator == std::string::npos) ? std::string() : fileName.substr(0, separator + 1);
+		char line[1024];
+		bool success = true;
+		while (success && fgets(line, sizeof(line), pFile))
+		{
+			const char* pQuote = strchr(line, '"');
+			if (strncmp(line, "#include", 8) != 0 || !pQuote || !strchr(pQuote + 1, '"') || includes.size() > 64)
+			{
+				text += line;
+				continue;
+			}
+			std::string path = directory + std::string(pQuote + 1, strchr(pQuote + 1, '"'));
+			includes.push_back(path);
+			success = Preprocess(path, text, includes, errors);
+		}
+		fclose(pFile);
+		return success;
+	}
+
+	const char* m_pName;
+	int m_CompileCount;
+};
+
+static bool WriteTextFile(const char* pFileName, const char* pText)
+{
+	FILE* pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+	bool success = fputs(pText, pFile) >= 0;
+	return (fclose(pFile) == 0) && success;
+}
+
+static bool ShaderCacheEntryExists(const ShaderCache& cache, const ShaderCompileRequest& request)
+{
+	unsigned long long sourceHash;
+	if (!HashFile(request.FileName.c_str(), sourceHash))
+		return false;
+	FILE* pFile = fopen(cache.GetEntryFileName(cache.ComputeKey(request, sourceHash)).c_str(), "rb");
+	if (pFile)
+		fclose(pFile);
+	return pFile != NULL;
+}
+
+// Runs the request through a fresh cache like a new launch, expecting a hit or a miss
+static bool RunShaderLookup(ShaderCompiler& compiler, const char* pCacheDirectory, const ShaderCompileRequest& request, bool expectHit,
+	std::vector<unsigned char>& bytecode, std::vector<std::string>& entryFiles)
+{
+	ShaderCache cache(&compiler, pCacheDirectory);
+	bool success = cache.GetShader(request, bytecode);
+	unsigned long long sourceHash;
+	if (HashFile(request.FileName.c_str(), sourceHash))
+		entryFiles.push_back(cache.GetEntryFileName(cache.ComputeKey(request, sourceHash)));
+	return success && cache.GetStats().Hits == (expectHit ? 1 : 0) && cache.GetStats().Misses == (expectHit ? 0 : 1);
+}
+
+int VerifyShaderCache()
+{
+	const char* pSourceFile = "ShaderCacheBenchmark.hlsl";
+	const char* pIncludeFile = "ShaderCacheBenchmark.hlsli";
+	const char* pCacheDirectory = ".";
+	const char* pInclude = "float4 Shade(float3 n) { return float4(n, 1); }\n";
+	WriteTextFile(pSourceFile, "#include \"ShaderCacheBenchmark.hlsli\"\nfloat4 PS(float3 n : NORMAL) : SV_Target { return Shade(n); }\n"
+		"float4 VS(float4 p : POSITION) : SV_Position { return p; }\n");
+	WriteTextFile(pIncludeFile, pInclude);
+
+	SuiteCheck check("shaders");
+	StubShaderCompiler compiler("stub 1");
+	std::vector<std::string> entryFiles;
+
+	ShaderCompileRequest request;
+	request.FileName = pSourceFile;
+	request.EntryPoint = "PS";
+	request.Profile = "ps_5_0";
+	request.Flags = 1;
+	std::vector<unsigned char> cold, warm;
+	check.FailIf(!RunShaderLookup(compiler, pCacheDirectory, request, false, cold, entryFiles) ||
+		!RunShaderLookup(compiler, pCacheDirectory, request, true, warm, entryFiles) || cold != warm ||
+		compiler.GetCompileCount() != 1, "unchanged shader was not served from the cache");
+
+	// Every part of the key misses on its own
+	for (int variant = 0; variant < 4; variant++)
+	{
+		ShaderCompileRequest changed = request;
+		if (variant == 0)
+		{
+			ShaderDefine define;
+			define.Name = "ADAPTIVE";
+			define.Value = "1";
+			changed.Defines.push_back(define);
+		}
+		else if (variant == 1)
+		{
+			changed.Flags = 2;
+		}
+		else if (variant == 2)
+		{
+			changed.EntryPoint = "VS";
+			changed.Profile = "vs_5_0";
+		}
+		else
+		{
+			changed.Profile = "ps_4_0";
+		}
+		std::vector<unsigned char> bytecode;
+		check.FailIf(!RunShaderLookup(compiler, pCacheDirectory, changed, false, bytecode, entryFiles) ||
+			!RunShaderLookup(compiler, pCacheDirectory, changed, true, bytecode, entryFiles) || bytecode == cold,
+			"key variant %d was not cached separately", variant);
+	}
+	StubShaderCompiler otherCompiler("stub 2");
+	std::vector<unsigned char> bytecode;
+	check.FailIf(!RunShaderLookup(otherCompiler, pCacheDirectory, request, false, bytecode, entryFiles),
+		"bytecode of another compiler was reused");
+
+	// Editing an included file invalidates the entry, restoring it compiles again
+	WriteTextFile(pIncludeFile, "float4 Shade(float3 n) { return float4(n * 0.5 + 0.5, 1); }\n");
+	check.FailIf(!RunShaderLookup(compiler, pCacheDirectory, request, false, bytecode, entryFiles) ||
+		bytecode == cold || !RunShaderLookup(compiler, pCacheDirectory, request, true, bytecode, entryFiles),
+		"edited include did not invalidate the entry");
+	WriteTextFile(pIncludeFile, pInclude);
+	check.FailIf(!RunShaderLookup(compiler, pCacheDirectory, request, false, bytecode, entryFiles) || bytecode != cold,
+		"restored include did not recompile");
+
+	// A truncated entry is a miss and gets replaced
+	FILE* pFile = fopen(entryFiles[0].c_str(), "r+b");
+	if (pFile)
+	{
+		fseek(pFile, 0, SEEK_END);
+		long size = ftell(pFile);
+		fclose(pFile);
+		std::vector<char> content(size);
+		pFile = fopen(entryFiles[0].c_str(), "rb");
+		if (pFile && fread(content.data(), 1, size, pFile) == (size_t)size)
+		{
+			fclose(pFile);
+			pFile = fopen(entryFiles[0].c_str(), "wb");
+			fwrite(content.data(), 1, size - 3, pFile);
+		}
+		if (pFile)
+			fclose(pFile);
+	}
+	check.FailIf(!RunShaderLookup(compiler, pCacheDirectory, request, false, bytecode, entryFiles) ||
+		bytecode != cold || !RunShaderLookup(compiler, pCacheDirectory, request, true, bytecode, entryFiles),
+		"truncated entry was not replaced");
+
+	// Errors are reported and never cached, missing sources fail before the compiler runs
+	ShaderCompileRequest broken = request;
+	broken.EntryPoint = "Missing";
+	ShaderCache cache(&compiler, pCacheDirectory);
+	std::string errors;
+	int compileCount = compiler.GetCompileCount();
+	check.FailIf(cache.GetShader(broken, bytecode, &errors) || errors.find("Missing") == std::string::npos ||
+		ShaderCacheEntryExists(cache, broken) || compiler.GetCompileCount() != compileCount + 1,
+		"compile error was not reported");
+	broken.FileName = "ShaderCacheMissing.hlsl";
+	check.FailIf(cache.GetShader(broken, bytecode, &errors) || compiler.GetCompileCount() != compileCount + 1,
+		"missing source was not reported");
+
+	for (size_t i = 0; i < entryFiles.size(); i++)
+		remove(entryFiles[i].c_str());
+	remove(pSourceFile);
+	remove(pIncludeFile);
+
+	return check.Finish("%d compiles", compiler.GetCompileCount() + otherCompiler.GetCompileCount());
+}
+
+void RunShaderCacheThroughput()
+{
+	// The cost of a warm launch: hash the sources and read the entries of the demo's five shaders
+	const char* pSourceFile = "ShaderCacheBenchmark.hlsl";
+	const char* pIncludeFile = "ShaderCacheBenchmark.hlsli";
+	std::string source = "#include \"ShaderCacheBenchmark.hlsli\"\n";
+	static const char* s_EntryPoints[] = { "VS", "HS", "DS", "PS", "SolidPS" };
+	for (int i = 0; i < 5; i++)
+		source += std::string("float4 ") + s_EntryPoints[i] + "(float4 p : POSITION) : SV_Target { return Shade(p); }\n";
+	source.append(16 * 1024, ' ');
+	WriteTextFile(pSourceFile, source.c_str());
+	WriteTextFile(pIncludeFile, "float4 Shade(float4 p) { return p; }\n");
+
+	StubShaderCompiler compiler("stub");
+	std::vector<std::string> entryFiles;
+	std::vector<unsigned char> bytecode;
+	const int iterations = 200;
+	double start = GetTimeSeconds();
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		ShaderCache cache(&compiler, ".");
+		for (int i = 0; i < 5; i++)
+		{
+			ShaderCompileRequest request;
+			request.FileName = pSourceFile;
+			request.EntryPoint = s_EntryPoints[i];
+			request.Profile = "vs_5_0";
+			cache.GetShader(request, bytecode);
+			if (iteration == 0)
+			{
+				unsigned long long sourceHash;
+				HashFile(pSourceFile, sourceHash);
+				entryFiles.push_back(cache.GetEntryFileName(cache.ComputeKey(request, sourceHash)));
+			}
+		}
+	}
+	double seconds = GetTimeSeconds() - start;
+
+	for (size_t i = 0; i < entryFiles.size(); i++)
+		remove(entryFiles[i].c_str());
+	remove(pSourceFile);
+	remove(pIncludeFile);
+	printf("shaders warm lookup %10.3f us per shader  (%d compiles for %d lookups)\n",
+		seconds * 1e6 / (iterations * 5), compiler.GetCompileCount(), iterations * 5);
+}
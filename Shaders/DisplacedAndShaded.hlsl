@@ -4,12 +4,24 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 //--------------------------------------------------------------------------------------
 
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Height of the full displacement range in texels that the slopes of the normal map are
+// stored with, keep in sync with NORMAL_MAP_SLOPE_SCALE in NormalMap.h
+#define NORMAL_MAP_SLOPE_SCALE 64.0f
+
+// Levels of the terrain quadtree, keep in sync with QUADTREE_MAX_LEVELS in TerrainQuadtree.h
+#define QUADTREE_MAX_LEVELS 12
+
+
 //--------------------------------------------------------------------------------------
 // Textures
 //--------------------------------------------------------------------------------------
 Texture2D texDiffuse : register(t[0]);
 Texture2D texDisplacement : register(t[1]);
 Texture2D texNormal : register(t[2]);
+Texture2D texDensity : register(t[3]);
 
 //--------------------------------------------------------------------------------------
 // Samplers
@@ -19,31 +31,53 @@ SamplerState samLinear : register(s[1]);
 
 
 //--------------------------------------------------------------------------------------
-// Constant Buffer Variables
+// Constant Buffer Variables, split by how often they change. Keep in sync with the
+// structures in SceneUpdate.h.
 //--------------------------------------------------------------------------------------
-cbuffer ConstantBuffer : register(b0)
+// Written once at startup
+cbuffer StaticConstants : register(b0)
 {
-	matrix World;
-	matrix View;
 	matrix Projection;
-	float4 Pos;
 	float4 LightPos;
 	float4 LightColor;
+	float2 ViewportSize;
+}
+
+// Uploaded in frames where the camera or a tessellation setting changed
+cbuffer FrameConstants : register(b1)
+{
+	matrix View;
 	float4 Eye;
 	float TessellationFactor;
+	float TargetTriangleSize;
+	float AdaptiveTessellation;
+	float ContentDensity;
+	float QuadtreeSubdivisions;
+	float QuadtreeMorphHeight;
+	float4 QuadtreeMorphStart[QUADTREE_MAX_LEVELS / 4];
+	float4 QuadtreeRange[QUADTREE_MAX_LEVELS / 4];
+}
+
+// Mapped with discard before the draws of an object when its transform changed
+cbuffer DrawConstants : register(b2)
+{
+	matrix World;
 	float Scaling;
 	float DisplacementLevel;
+	float BakedHeightMin;
+	float BakedHeightRange;
+	float2 GridPatches;
 }
 
 
 //--------------------------------------------------------------------------------------
 // Structures
 //--------------------------------------------------------------------------------------
+// The control points of the grids only store an octahedral normal, see ControlPointFormat.h
 struct VS_CP_INPUT
 {
-	float3 PosOS : POSITION;
-	float3 NormOS : NORMAL;
-	float2 TexCoord : TEXCOORD0;
+	float2 NormOct : NORMAL;
+	uint VertexId : SV_VertexID;
 };
 
 struct VS_CP_OUTPUT
@@ -53,12 +87,62 @@ struct VS_CP_OUTPUT
 	float2 TexCoord : TEXCOORD0;
 };
 
+// A corner of the shared patch and the instance of a quadtree patch, see PatchInstances.h
+struct VS_QUADTREE_INPUT
+{
+	float2 NormOct : NORMAL;
+	uint VertexId : SV_VertexID;
+	float4 Patch : PATCH;                   // origin x and z, size, level
+	float4 EdgeFactors : EDGEFACTORS;
+};
+
+struct VS_QUADTREE_OUTPUT
+{
+	float3 PosWS : POSITION;
+	float3 NormWS : NORMAL;
+	float2 TexCoord : TEXCOORD0;
+	float Level : QUADTREELEVEL;
+	float4 EdgeFactors : EDGEFACTORS;
+};
+
+// A grid control point and the stabilized factors of its patch, see GpuTessellationCache.h
+struct VS_CACHE_INPUT
+{
+	float2 NormOct : NORMAL;
+	uint VertexId : SV_VertexID;
+	float4 EdgeFactors : EDGEFACTORS;
+	float2 InsideFactors : INSIDEFACTORS;
+};
+
+struct VS_CACHE_OUTPUT
+{
+	float3 PosWS : POSITION;
+	float3 NormWS : NORMAL;
+	float2 TexCoord : TEXCOORD0;
+	float4 EdgeFactors : EDGEFACTORS;
+	float2 InsideFactors : INSIDEFACTORS;
+};
+
 struct HS_CONST_DATA_OUTPUT
 {
 	float Edges[3] : SV_TessFactor;
 	float Inside[1] : SV_InsideTessFactor;
 };
 
+struct HS_QUAD_CONST_DATA_OUTPUT
+{
+	float Edges[4] : SV_TessFactor;
+	float Inside[2] : SV_InsideTessFactor;
+};
+
+struct HS_QUADTREE_CONST_DATA_OUTPUT
+{
+	float Edges[4] : SV_TessFactor;
+	float Inside[2] : SV_InsideTessFactor;
+	uint Level : QUADTREELEVEL;
+	float Segments : QUADTREESEGMENTS;
+};
+
 struct HS_CP_OUTPUT
 {
 	float3 PosWS : WORLDPOS;
@@ -75,50 +159,109 @@ struct DS_OUTPUT
 	float3 NormWS : NORMAL;
 };
 
+// A vertex of the retessellation cache's stream-out buffer, keep in sync with
+// GpuTessCacheVertex
+struct CACHE_VERTEX
+{
+	float3 PosWS : POSITION;
+	float2 TexCoord : TEXCOORD0;
+};
+
 //--------------------------------------------------------------------------------------
 // Vertex Shader
 //--------------------------------------------------------------------------------------
+// Keep in sync with DecodeOctahedralNormal in ControlPointFormat.cpp
+float3 DecodeOctahedralNormal(float2 encoded)
+{
+	float3 n = float3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	if (n.z < 0.0f)
+		n.xy = (1.0f - abs(n.yx)) * (n.xy >= 0.0f ? 1.0f : -1.0f);
+	return normalize(n);
+}
+
 VS_CP_OUTPUT VS(VS_CP_INPUT input)
 {
 	VS_CP_OUTPUT output;
-	
+
+	// The vertices of a grid go row by row, like TerrainGrid::GetVertex
+	uint columns = (uint)GridPatches.x + 1;
+	float2 texCoord = float2(input.VertexId % columns, input.VertexId / columns) / GridPatches;
+	float3 PosOS = float3(texCoord.x * 2.0f - 1.0f, 0.0f, texCoord.y * 2.0f - 1.0f);
+
 	// Compute position and normal in world space
-	float3 PosWS = mul(input.PosOS, (float3x3) World);
-	float3 NormalWS = mul(input.NormOS, (float3x3) World);
+	float3 PosWS = mul(PosOS, (float3x3) World);
+	float3 NormalWS = mul(DecodeOctahedralNormal(input.NormOct), (float3x3) World);
 	NormalWS = normalize(NormalWS);
 
 	// Output position and normal
 	output.PosWS = PosWS.xyz;
 	output.NormWS = NormalWS;
-	output.TexCoord = input.TexCoord;
+	output.TexCoord = texCoord;
 
 	return output;
 }
 
 
 //--------------------------------------------------------------------------------------
-// Hull Shader constant function
+// Content density of one patch edge: the texel of the density map (one per heightmap
+// cell, see TessDensity.h) under the edge's midpoint. Keep in sync with
+// TessDensityMap::Sample.
 //--------------------------------------------------------------------------------------
-HS_CONST_DATA_OUTPUT ConstHS(InputPatch<VS_CP_OUTPUT, 3> ip, uint PatchID : SV_PrimitiveID)
+float EdgeDensity(float2 uv0, float2 uv1)
 {
-	HS_CONST_DATA_OUTPUT output;
+	uint width, height;
+	texDensity.GetDimensions(width, height);
+	int2 cell = clamp(int2(0.5f * (uv0 + uv1) * float2(width, height)), 0, int2(width, height) - 1);
+	return texDensity.Load(int3(cell, 0)).r;
+}
 
-	// Calculating distance adaptive tessellation factor
-	/*float maxTessellationDistance = 40;
-	float minTessellationDistance = 10;
-	float distance = length(Eye - Pos) - minTessellationDistance;
-	if (distance < 0) distance = 0;
-	float t = distance / maxTessellationDistance;
-	if (t > 1) t = 1;
-	float adaptiveTessFactor = (1 - t) * TessellationFactor + t;*/
 
-	// Setting calculated tessellation factor globally for all tessellation factors
-	/*output.Edges[0] = output.Edges[1] = output.Edges[2] = output.Edges[3] = adaptiveTessFactor;
-	output.Inside[0] = output.Inside[1] = adaptiveTessFactor;*/
+//--------------------------------------------------------------------------------------
+// Tessellation factor of one patch edge. With adaptive tessellation it is the projected
+// size of the edge's bounding sphere in pixels divided by the target triangle size,
+// otherwise the global factor. Content density scales it down where the displacement
+// is smooth. It depends only on the two end points, so patches sharing an edge always
+// agree and no cracks appear. Keep in sync with ComputeEdgeTessFactors in
+// TessFactors.cpp.
+//--------------------------------------------------------------------------------------
+float EdgeTessFactor(float3 p0, float3 p1, float2 uv0, float2 uv1)
+{
+	float factor = TessellationFactor;
+	if (AdaptiveTessellation > 0.5f)
+	{
+		float3 center = 0.5f * (p0 + p1);
+		float diameter = length(p1 - p0);
+		float dist = max(length(center - Eye.xyz), 0.0001f);
+		float projectedPixels = diameter * Projection._22 * 0.5f * ViewportSize.y / dist;
+		factor = projectedPixels / TargetTriangleSize;
+	}
+	if (ContentDensity > 0.5f)
+		factor *= EdgeDensity(uv0, uv1);
+	return min(max(factor, 1.0f), TessellationFactor);
+}
 
-	output.Edges[0] = output.Edges[1] = output.Edges[2] = TessellationFactor;
-	output.Inside[0] = TessellationFactor;
 
+//--------------------------------------------------------------------------------------
+// Hull Shader constant function
+//--------------------------------------------------------------------------------------
+HS_CONST_DATA_OUTPUT ConstHS(InputPatch<VS_CP_OUTPUT, 3> ip, uint PatchID : SV_PrimitiveID)
+{
+	HS_CONST_DATA_OUTPUT output;
+
+	if (AdaptiveTessellation > 0.5f || ContentDensity > 0.5f)
+	{
+		// Edge i is the one opposite control point i (U == 0, V == 0, W == 0)
+		output.Edges[0] = EdgeTessFactor(ip[1].PosWS, ip[2].PosWS, ip[1].TexCoord, ip[2].TexCoord);
+		output.Edges[1] = EdgeTessFactor(ip[2].PosWS, ip[0].PosWS, ip[2].TexCoord, ip[0].TexCoord);
+		output.Edges[2] = EdgeTessFactor(ip[0].PosWS, ip[1].PosWS, ip[0].TexCoord, ip[1].TexCoord);
+		output.Inside[0] = (output.Edges[0] + output.Edges[1] + output.Edges[2]) / 3.0f;
+	}
+	else
+	{
+		// Setting the global tessellation factor for all tessellation factors
+		output.Edges[0] = output.Edges[1] = output.Edges[2] = TessellationFactor;
+		output.Inside[0] = TessellationFactor;
+	}
 
 	return output;
 }
@@ -148,56 +291,424 @@ HS_CP_OUTPUT HS(InputPatch<VS_CP_OUTPUT, 3> p,
 
 
 //--------------------------------------------------------------------------------------
-// Domain Shader
+// Computes the outputs of the domain shaders and BakedVS for a displaced point
 //--------------------------------------------------------------------------------------
-[domain("tri")]
-DS_OUTPUT DS(HS_CONST_DATA_OUTPUT input,
-	float3 BaryCoords : SV_DomainLocation,
-	const OutputPatch<HS_CP_OUTPUT, 3> TriPatch)
+DS_OUTPUT ShadeDisplacedPoint(float3 vWorldPos, float3 vNormal, float2 texCoord)
 {
 	DS_OUTPUT output;
 
+	output.NormWS = normalize(vNormal);
+	output.TexCoord = texCoord;
+	output.Pos = mul(float4(vWorldPos, 1), mul(View, Projection));
+
+	// Calculating light vector
+	output.LightWS = LightPos - vWorldPos;
+
+	// Calculating view vector
+	output.ViewWS = Eye - vWorldPos;	
+
+	return output;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Displaces an interpolated domain point, the position alone for the retessellation
+// cache and with the outputs of DS and QuadDS
+//--------------------------------------------------------------------------------------
+float3 DisplacePosition(float3 vWorldPos, float2 texCoord)
+{
+	// Displacing generated vertexes
+	float4 texSample = texDisplacement.SampleLevel(samPoint, texCoord, 0);
+	return vWorldPos + /*vNormal * */ float3(0,1,0) * texSample.r * Scaling * DisplacementLevel;
+}
+
+DS_OUTPUT DisplaceDomainPoint(float3 vWorldPos, float3 vNormal, float2 texCoord)
+{
+	return ShadeDisplacedPoint(DisplacePosition(vWorldPos, texCoord), vNormal, texCoord);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Domain Shader
+//--------------------------------------------------------------------------------------
+// The control points interpolated at a domain point of a tri patch
+HS_CP_OUTPUT InterpolateTriPatch(const OutputPatch<HS_CP_OUTPUT, 3> TriPatch, float3 BaryCoords)
+{
+	HS_CP_OUTPUT output;
+
 	// Interpolating position
-	float3 vWorldPos = BaryCoords.x * TriPatch[0].PosWS +
-						BaryCoords.y * TriPatch[1].PosWS +
-						BaryCoords.z * TriPatch[2].PosWS;
+	output.PosWS = BaryCoords.x * TriPatch[0].PosWS +
+				   BaryCoords.y * TriPatch[1].PosWS +
+				   BaryCoords.z * TriPatch[2].PosWS;
 
 	// Interpolating normal vector
-	float3 vNormal = BaryCoords.x * TriPatch[0].NormWS +
-					 BaryCoords.y * TriPatch[1].NormWS +
-					 BaryCoords.z * TriPatch[2].NormWS;
-	vNormal = normalize(vNormal);
-	output.NormWS = vNormal;
+	output.NormWS = BaryCoords.x * TriPatch[0].NormWS +
+					BaryCoords.y * TriPatch[1].NormWS +
+					BaryCoords.z * TriPatch[2].NormWS;
 
-	// Interpolating and outputting texture coordinates
+	// Interpolating texture coordinates
 	output.TexCoord = BaryCoords.x * TriPatch[0].TexCoord +
 					  BaryCoords.y * TriPatch[1].TexCoord +
 					  BaryCoords.z * TriPatch[2].TexCoord;
 
-	// Displacing generated vertexes
-	float4 texSample = texDisplacement.SampleLevel(samPoint, output.TexCoord, 0);
-	vWorldPos += /*vNormal * */ float3(0,1,0) * texSample.r * Scaling * DisplacementLevel;
-	output.Pos = mul(float4(vWorldPos, 1), mul(View, Projection));
+	return output;
+}
 
-	// Calculating light vector
-	output.LightWS = LightPos - vWorldPos;
+[domain("tri")]
+DS_OUTPUT DS(HS_CONST_DATA_OUTPUT input,
+	float3 BaryCoords : SV_DomainLocation,
+	const OutputPatch<HS_CP_OUTPUT, 3> TriPatch)
+{
+	HS_CP_OUTPUT domainPoint = InterpolateTriPatch(TriPatch, BaryCoords);
+	return DisplaceDomainPoint(domainPoint.PosWS, domainPoint.NormWS, domainPoint.TexCoord);
+}
 
-	// Calculating view vector
-	output.ViewWS = Eye - vWorldPos;	
+
+//--------------------------------------------------------------------------------------
+// Quad patch path: one 4 control point patch per grid cell instead of two tri patches,
+// see TerrainGrid.h. Control points 0-3 are the cell's corners (-x, -z), (+x, -z),
+// (+x, +z) and (-x, +z). The domain is interpolated like TessEvaluateQuadDomain, v runs
+// from point 0 to point 1 and u from point 0 to point 3. Keep the factors in sync with
+// ComputeQuadPatchTessFactors in TessFactors.cpp.
+//--------------------------------------------------------------------------------------
+HS_QUAD_CONST_DATA_OUTPUT ConstQuadHS(InputPatch<VS_CP_OUTPUT, 4> ip, uint PatchID : SV_PrimitiveID)
+{
+	HS_QUAD_CONST_DATA_OUTPUT output;
+
+	if (AdaptiveTessellation > 0.5f || ContentDensity > 0.5f)
+	{
+		// U == 0, V == 0, U == 1 and V == 1
+		output.Edges[0] = EdgeTessFactor(ip[0].PosWS, ip[1].PosWS, ip[0].TexCoord, ip[1].TexCoord);
+		output.Edges[1] = EdgeTessFactor(ip[3].PosWS, ip[0].PosWS, ip[3].TexCoord, ip[0].TexCoord);
+		output.Edges[2] = EdgeTessFactor(ip[3].PosWS, ip[2].PosWS, ip[3].TexCoord, ip[2].TexCoord);
+		output.Edges[3] = EdgeTessFactor(ip[1].PosWS, ip[2].PosWS, ip[1].TexCoord, ip[2].TexCoord);
+
+		// Inside[0] subdivides along u like the V == 0 and V == 1 edges
+		output.Inside[0] = 0.5f * (output.Edges[1] + output.Edges[3]);
+		output.Inside[1] = 0.5f * (output.Edges[0] + output.Edges[2]);
+	}
+	else
+	{
+		output.Edges[0] = output.Edges[1] = output.Edges[2] = output.Edges[3] = TessellationFactor;
+		output.Inside[0] = output.Inside[1] = TessellationFactor;
+	}
 
 	return output;
 }
 
+[domain("quad")]
+[partitioning("fractional_odd")]
+[outputtopology("triangle_cw")]
+[outputcontrolpoints(4)]
+[patchconstantfunc("ConstQuadHS")]
+HS_CP_OUTPUT QuadHS(InputPatch<VS_CP_OUTPUT, 4> p,
+	uint i : SV_OutputControlPointID,
+	uint PatchID : SV_PrimitiveID)
+{
+	HS_CP_OUTPUT output;
+
+	output.PosWS = p[i].PosWS;
+	output.NormWS = p[i].NormWS;
+	output.TexCoord = p[i].TexCoord;
+
+	return output;
+}
+
+// The control points interpolated at a domain point of a quad patch
+HS_CP_OUTPUT InterpolateQuadPatch(const OutputPatch<HS_CP_OUTPUT, 4> QuadPatch, float2 UV)
+{
+	HS_CP_OUTPUT output;
+
+	output.PosWS = lerp(lerp(QuadPatch[0].PosWS, QuadPatch[1].PosWS, UV.y),
+						lerp(QuadPatch[3].PosWS, QuadPatch[2].PosWS, UV.y), UV.x);
+	output.NormWS = lerp(lerp(QuadPatch[0].NormWS, QuadPatch[1].NormWS, UV.y),
+						 lerp(QuadPatch[3].NormWS, QuadPatch[2].NormWS, UV.y), UV.x);
+	output.TexCoord = lerp(lerp(QuadPatch[0].TexCoord, QuadPatch[1].TexCoord, UV.y),
+						   lerp(QuadPatch[3].TexCoord, QuadPatch[2].TexCoord, UV.y), UV.x);
+
+	return output;
+}
+
+[domain("quad")]
+DS_OUTPUT QuadDS(HS_QUAD_CONST_DATA_OUTPUT input,
+	float2 UV : SV_DomainLocation,
+	const OutputPatch<HS_CP_OUTPUT, 4> QuadPatch)
+{
+	HS_CP_OUTPUT domainPoint = InterpolateQuadPatch(QuadPatch, UV);
+	return DisplaceDomainPoint(domainPoint.PosWS, domainPoint.NormWS, domainPoint.TexCoord);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Retessellation cache of the grid path, see GpuTessellationCache.h. The patches take
+// their stabilized factors from the instance instead of computing them. A patch whose
+// factors changed is drawn with CacheDS or CacheQuadDS, and CacheGS streams its
+// displaced points out to its slot of the cache without rasterizing them; patches that
+// did not fit in the cache are drawn with DS or QuadDS. CachedVS then draws the slots of
+// all cached patches as a triangle list, without the hull and domain shaders.
+//--------------------------------------------------------------------------------------
+VS_CACHE_OUTPUT CacheVS(VS_CACHE_INPUT input)
+{
+	VS_CACHE_OUTPUT output;
+
+	VS_CP_INPUT controlPoint;
+	controlPoint.NormOct = input.NormOct;
+	controlPoint.VertexId = input.VertexId;
+	VS_CP_OUTPUT gridPoint = VS(controlPoint);
+
+	output.PosWS = gridPoint.PosWS;
+	output.NormWS = gridPoint.NormWS;
+	output.TexCoord = gridPoint.TexCoord;
+	output.EdgeFactors = input.EdgeFactors;
+	output.InsideFactors = input.InsideFactors;
+
+	return output;
+}
+
+HS_CONST_DATA_OUTPUT ConstCacheHS(InputPatch<VS_CACHE_OUTPUT, 3> ip)
+{
+	HS_CONST_DATA_OUTPUT output;
+
+	output.Edges[0] = ip[0].EdgeFactors.x;
+	output.Edges[1] = ip[0].EdgeFactors.y;
+	output.Edges[2] = ip[0].EdgeFactors.z;
+	output.Inside[0] = ip[0].InsideFactors.x;
+
+	return output;
+}
+
+[domain("tri")]
+[partitioning("fractional_odd")]
+[outputtopology("triangle_cw")]
+[outputcontrolpoints(3)]
+[patchconstantfunc("ConstCacheHS")]
+HS_CP_OUTPUT CacheHS(InputPatch<VS_CACHE_OUTPUT, 3> p,
+	uint i : SV_OutputControlPointID)
+{
+	HS_CP_OUTPUT output;
+
+	output.PosWS = p[i].PosWS;
+	output.NormWS = p[i].NormWS;
+	output.TexCoord = p[i].TexCoord;
+
+	return output;
+}
+
+HS_QUAD_CONST_DATA_OUTPUT ConstCacheQuadHS(InputPatch<VS_CACHE_OUTPUT, 4> ip)
+{
+	HS_QUAD_CONST_DATA_OUTPUT output;
+
+	output.Edges[0] = ip[0].EdgeFactors.x;
+	output.Edges[1] = ip[0].EdgeFactors.y;
+	output.Edges[2] = ip[0].EdgeFactors.z;
+	output.Edges[3] = ip[0].EdgeFactors.w;
+	output.Inside[0] = ip[0].InsideFactors.x;
+	output.Inside[1] = ip[0].InsideFactors.y;
+
+	return output;
+}
+
+[domain("quad")]
+[partitioning("fractional_odd")]
+[outputtopology("triangle_cw")]
+[outputcontrolpoints(4)]
+[patchconstantfunc("ConstCacheQuadHS")]
+HS_CP_OUTPUT CacheQuadHS(InputPatch<VS_CACHE_OUTPUT, 4> p,
+	uint i : SV_OutputControlPointID)
+{
+	HS_CP_OUTPUT output;
+
+	output.PosWS = p[i].PosWS;
+	output.NormWS = p[i].NormWS;
+	output.TexCoord = p[i].TexCoord;
+
+	return output;
+}
+
+[domain("tri")]
+CACHE_VERTEX CacheDS(HS_CONST_DATA_OUTPUT input,
+	float3 BaryCoords : SV_DomainLocation,
+	const OutputPatch<HS_CP_OUTPUT, 3> TriPatch)
+{
+	HS_CP_OUTPUT domainPoint = InterpolateTriPatch(TriPatch, BaryCoords);
+
+	CACHE_VERTEX output;
+	output.PosWS = DisplacePosition(domainPoint.PosWS, domainPoint.TexCoord);
+	output.TexCoord = domainPoint.TexCoord;
+	return output;
+}
+
+[domain("quad")]
+CACHE_VERTEX CacheQuadDS(HS_QUAD_CONST_DATA_OUTPUT input,
+	float2 UV : SV_DomainLocation,
+	const OutputPatch<HS_CP_OUTPUT, 4> QuadPatch)
+{
+	HS_CP_OUTPUT domainPoint = InterpolateQuadPatch(QuadPatch, UV);
+
+	CACHE_VERTEX output;
+	output.PosWS = DisplacePosition(domainPoint.PosWS, domainPoint.TexCoord);
+	output.TexCoord = domainPoint.TexCoord;
+	return output;
+}
+
+// Every triangle of the tessellator goes to the stream-out buffer as its 3 vertices
+[maxvertexcount(3)]
+void CacheGS(triangle CACHE_VERTEX input[3], inout TriangleStream<CACHE_VERTEX> stream)
+{
+	for (int i = 0; i < 3; i++)
+		stream.Append(input[i]);
+	stream.RestartStrip();
+}
+
+// The cached points are displaced already. PS takes the normal from the normal map, so
+// the interpolated normal of the control points is not kept.
+DS_OUTPUT CachedVS(CACHE_VERTEX input)
+{
+	return ShadeDisplacedPoint(input.PosWS, float3(0,1,0), input.TexCoord);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Quadtree LOD path: the patches of a TerrainQuadtree selection, see TerrainQuadtree.h.
+// Every patch is an integer partitioned grid of its level's segments. Where a patch
+// reaches the end of its level's range the odd grid points move onto the even point
+// before them, so it matches its coarser neighbour, and neighbours of the same level
+// move their shared points alike. Keep in sync with ComputeQuadtreeMorph.
+//--------------------------------------------------------------------------------------
+float QuadtreeMorph(uint level, float dist)
+{
+	float start = QuadtreeMorphStart[level / 4][level % 4];
+	float end = QuadtreeRange[level / 4][level % 4];
+	return saturate((dist - start) / (end - start));
+}
+
+// Every patch is an instance of the shared patch, its corners are placed by the instance
+VS_QUADTREE_OUTPUT QuadtreeVS(VS_QUADTREE_INPUT input)
+{
+	VS_QUADTREE_OUTPUT output;
+
+	// Corners (-x, -z), (+x, -z), (+x, +z) and (-x, +z), like GetPatchInstanceCorner
+	float2 corner = float2((input.VertexId + 1) / 2 % 2, input.VertexId / 2);
+	float2 posXZ = input.Patch.xy + corner * input.Patch.z;
+	float3 PosOS = float3(posXZ.x, 0.0f, posXZ.y);
+
+	output.PosWS = mul(PosOS, (float3x3) World);
+	output.NormWS = normalize(mul(DecodeOctahedralNormal(input.NormOct), (float3x3) World));
+	output.TexCoord = posXZ * 0.5f + 0.5f;
+	output.Level = input.Patch.w;
+	output.EdgeFactors = input.EdgeFactors;
+
+	return output;
+}
+
+// The factors of the instance, the same at every control point
+HS_QUADTREE_CONST_DATA_OUTPUT ConstQuadtreeHS(InputPatch<VS_QUADTREE_OUTPUT, 4> ip)
+{
+	HS_QUADTREE_CONST_DATA_OUTPUT output;
+
+	float4 edges = ip[0].EdgeFactors;
+	output.Level = (uint)ip[0].Level;
+	output.Edges[0] = edges.x;
+	output.Edges[1] = edges.y;
+	output.Edges[2] = edges.z;
+	output.Edges[3] = edges.w;
+	output.Inside[0] = 0.5f * (edges.y + edges.w);
+	output.Inside[1] = 0.5f * (edges.x + edges.z);
+	output.Segments = output.Inside[0];
+
+	return output;
+}
+
+[domain("quad")]
+[partitioning("integer")]
+[outputtopology("triangle_cw")]
+[outputcontrolpoints(4)]
+[patchconstantfunc("ConstQuadtreeHS")]
+HS_CP_OUTPUT QuadtreeHS(InputPatch<VS_QUADTREE_OUTPUT, 4> p,
+	uint i : SV_OutputControlPointID)
+{
+	HS_CP_OUTPUT output;
+
+	output.PosWS = p[i].PosWS;
+	output.NormWS = p[i].NormWS;
+	output.TexCoord = p[i].TexCoord;
+
+	return output;
+}
+
+[domain("quad")]
+DS_OUTPUT QuadtreeDS(HS_QUADTREE_CONST_DATA_OUTPUT input,
+	float2 UV : SV_DomainLocation,
+	const OutputPatch<HS_CP_OUTPUT, 4> QuadPatch)
+{
+	// The morph factor comes from the grid point before morphing at the terrain's mid
+	// height, like the distances of the selection
+	float3 vGridPos = lerp(lerp(QuadPatch[0].PosWS, QuadPatch[1].PosWS, UV.y),
+						   lerp(QuadPatch[3].PosWS, QuadPatch[2].PosWS, UV.y), UV.x);
+	vGridPos.y = QuadtreeMorphHeight;
+	float morph = QuadtreeMorph(input.Level, length(vGridPos - Eye.xyz));
+
+	float2 gridPoint = round(UV * input.Segments);
+	float2 morphedUV = (gridPoint - fmod(gridPoint, 2.0f) * morph) / input.Segments;
+
+	float3 vWorldPos = lerp(lerp(QuadPatch[0].PosWS, QuadPatch[1].PosWS, morphedUV.y),
+							lerp(QuadPatch[3].PosWS, QuadPatch[2].PosWS, morphedUV.y), morphedUV.x);
+	float3 vNormal = lerp(lerp(QuadPatch[0].NormWS, QuadPatch[1].NormWS, morphedUV.y),
+						  lerp(QuadPatch[3].NormWS, QuadPatch[2].NormWS, morphedUV.y), morphedUV.x);
+	float2 texCoord = lerp(lerp(QuadPatch[0].TexCoord, QuadPatch[1].TexCoord, morphedUV.y),
+						   lerp(QuadPatch[3].TexCoord, QuadPatch[2].TexCoord, morphedUV.y), morphedUV.x);
+
+	return DisplaceDomainPoint(vWorldPos, vNormal, texCoord);
+}
+
+//--------------------------------------------------------------------------------------
+// Baked LOD path without hull and domain shaders (vs_4_0), see BakedTerrain.h. The
+// vertices are already displaced: x and z span the quad and y is the sampled texel value
+// over [BakedHeightMin, BakedHeightMin + BakedHeightRange]. w marks skirt vertices,
+// which shade like the border they hang from.
+//--------------------------------------------------------------------------------------
+DS_OUTPUT BakedVS(float4 Pos : POSITION)
+{
+	float2 vPosOS = Pos.xz * 2.0f - 1.0f;
+	float height = BakedHeightMin + Pos.y * BakedHeightRange;
+
+	float3 vWorldPos = mul(float3(vPosOS.x, 0.0f, vPosOS.y), (float3x3) World);
+	vWorldPos += float3(0,1,0) * height * Scaling * DisplacementLevel;
+	float2 texCoord = vPosOS * 0.5f + 0.5f;
+
+	return ShadeDisplacedPoint(vWorldPos, float3(0,1,0), texCoord);
+}
+
+//--------------------------------------------------------------------------------------
+// World space normal of the displaced terrain from the normal map derived from the
+// displacement map (see NormalMap.h). Its slopes are in displacement range per texel
+// times NORMAL_MAP_SLOPE_SCALE and are rescaled to the world height of the range and
+// the world size of a texel: u runs along +X and v along +Z over twice the world scale.
+//--------------------------------------------------------------------------------------
+float3 DisplacedNormalWS(float2 texCoord)
+{
+	// Only x and y are read so the two channel BC5 normal map works too, z is always positive
+	float2 vNormalXY = texNormal.Sample(samLinear, texCoord).rg * 2.0 - 1.0;
+	float normalZ = sqrt(saturate(1.0 - dot(vNormalXY, vNormalXY)));
+
+	uint width, height;
+	texNormal.GetDimensions(width, height);
+	float2 texelSize = 2.0f * float2(World._11, World._33) / float2(width, height);
+	float2 slope = -vNormalXY / max(normalZ, 0.001f) / NORMAL_MAP_SLOPE_SCALE;
+	float2 gradient = slope * Scaling * DisplacementLevel / texelSize;
+	return normalize(float3(-gradient.x, 1.0f, -gradient.y));
+}
+
+
 //--------------------------------------------------------------------------------------
 // Function:    ComputeIllumination
 // 
 // Description: Computes phong illumination for the given pixel using its attribute 
-//              textures and a light vector.
+//              textures and a light vector, both vectors in world space.
 //--------------------------------------------------------------------------------------
-float4 ComputeIllumination(float2 texCoord, float3 vLightTS, float3 vViewTS)
+float4 ComputeIllumination(float2 texCoord, float3 vLightWS, float3 vViewWS)
 {
-	// Sample the normal from the normal map for the given texture sample:
-	float3 vNormalTS = normalize(texNormal.Sample(samLinear, texCoord) * 2.0 - 1.0);
+	float3 vNormalWS = DisplacedNormalWS(texCoord);
 
 	// Setting base color
 	float4 cBaseColor = texDiffuse.Sample(samLinear, texCoord);
@@ -208,13 +719,13 @@ float4 ComputeIllumination(float2 texCoord, float3 vLightTS, float3 vViewTS)
 	float4 cAmbient = ambientColor * ambientPower;
 
 	// Compute diffuse color component:
-	float4 cDiffuse = saturate(dot(vNormalTS, vLightTS));
+	float4 cDiffuse = saturate(dot(vNormalWS, vLightWS));
 
 	// Compute the specular component if desired:  
-	float3 R = normalize (2 * dot(vLightTS, vNormalTS) * vNormalTS - vLightTS);
+	float3 R = normalize (2 * dot(vLightWS, vNormalWS) * vNormalWS - vLightWS);
 	float shininess = 20;
 	float4 specularColor = float4(1, 1, 1, 1);
-	float4 cSpecular = pow(saturate(dot(R, vViewTS)), shininess) * specularColor;
+	float4 cSpecular = pow(saturate(dot(R, vViewWS)), shininess) * specularColor;
 		
 	// Composite the final color:
 	float4 cFinalColor = (cAmbient + cDiffuse) * cBaseColor + cSpecular;
@@ -227,11 +738,10 @@ float4 ComputeIllumination(float2 texCoord, float3 vLightTS, float3 vViewTS)
 //--------------------------------------------------------------------------------------
 float4 PS(DS_OUTPUT input) : SV_Target
 {
-	float3 LightTS = normalize(input.LightWS);
-	float3 ViewTS = normalize(input.ViewWS);
+	float3 LightWS = normalize(input.LightWS);
+	float3 ViewWS = normalize(input.ViewWS);
 
-	//float4 finalColor = ComputeIllumination(input.TexCoord, LightTS, ViewTS);
-	float4 finalColor = float4(input.TexCoord, 0, 1);
+	float4 finalColor = ComputeIllumination(input.TexCoord, LightWS, ViewWS);
 
 	return finalColor;
 }
@@ -0,0 +1,16 @@
+//--------------------------------------------------------------------------------------
+// File: SimdUtil.h
+//
+// Selects the SIMD code paths used by the portable CPU modules. The Visual Studio
+// projects build with /arch:SSE2 (x86) or target x64, and GCC/Clang define __SSE2__ on
+// the Linux build machines, so SSE2 is the baseline. Everything keeps a scalar
+// fallback for other targets.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TESS_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define TESS_USE_SSE2 0
+#endif
@@ -0,0 +1,964 @@
+//--------------------------------------------------------------------------------------
+// File: SoftwareRenderer.cpp
+//--------------------------------------------------------------------------------------
+#include "SoftwareRenderer.h"
+#include "Hash.h"
+#include "HeightPyramid.h"
+#include "NormalMap.h"
+#include "TessDensity.h"
+#include "TessFactors.h"
+#include "TessellationCache.h"
+#include "Tessellator.h"
+#include "SimdUtil.h"
+#include "Timer.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define SUBPIXEL_ONE            (1 << SOFTWARE_SUBPIXEL_BITS)
+#define EMPTY_TRIANGLE_ID       0xffffffffu
+
+// Clip space vertices are kept within this many pixels of the viewport center, so the
+// edge functions of a triangle crossing a tile fit 32 bits
+#define GUARD_BAND_PIXELS       SOFTWARE_MAX_VIEWPORT_SIZE
+
+enum CLIP_PLANE
+{
+	CLIP_PLANE_NEAR,
+	CLIP_PLANE_FAR,
+	CLIP_PLANE_LEFT,
+	CLIP_PLANE_RIGHT,
+	CLIP_PLANE_BOTTOM,
+	CLIP_PLANE_TOP,
+	CLIP_PLANE_COUNT,
+};
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+// Floor of a / b for b > 0
+static int FloorDivide(int a, int b)
+{
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static unsigned char ToUnorm8(float value)
+{
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return (unsigned char)(value * 255.0f + 0.5f);
+}
+
+static void NormalizeVector(float v[3])
+{
+	float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (length <= 0.0f)
+		return;
+	for (int c = 0; c < 3; c++)
+		v[c] /= length;
+}
+
+// Signed distance of a clip space position from a plane, >= 0 inside
+static float ClipDistance(const float position[4], int plane, float guardX, float guardY)
+{
+	switch (plane)
+	{
+	case CLIP_PLANE_NEAR: return position[2];
+	case CLIP_PLANE_FAR: return position[3] - position[2];
+	case CLIP_PLANE_LEFT: return position[0] + guardX * position[3];
+	case CLIP_PLANE_RIGHT: return guardX * position[3] - position[0];
+	case CLIP_PLANE_BOTTOM: return position[1] + guardY * position[3];
+	default: return guardY * position[3] - position[1];
+	}
+}
+
+static int ClipOutcode(const float position[4], float guardX, float guardY)
+{
+	int outcode = 0;
+	for (int plane = 0; plane < CLIP_PLANE_COUNT; plane++)
+		outcode |= (ClipDistance(position, plane, guardX, guardY) < 0.0f) ? (1 << plane) : 0;
+	return outcode;
+}
+
+static void LerpVertex(const SoftwareVertex& a, const SoftwareVertex& b, float t, SoftwareVertex& result)
+{
+	for (int c = 0; c < 4; c++)
+		result.Position[c] = a.Position[c] + t * (b.Position[c] - a.Position[c]);
+	for (int c = 0; c < 2; c++)
+		result.TexCoord[c] = a.TexCoord[c] + t * (b.TexCoord[c] - a.TexCoord[c]);
+	for (int c = 0; c < 3; c++)
+		result.WorldPos[c] = a.WorldPos[c] + t * (b.WorldPos[c] - a.WorldPos[c]);
+}
+
+// The DS output of a displaced domain point
+static void ProjectVertex(const float (*viewProjection)[4], float x, float y, float z, float u, float v,
+	SoftwareVertex& vertex)
+{
+	vertex.WorldPos[0] = x;
+	vertex.WorldPos[1] = y;
+	vertex.WorldPos[2] = z;
+	vertex.TexCoord[0] = u;
+	vertex.TexCoord[1] = v;
+	for (int c = 0; c < 4; c++)
+		vertex.Position[c] = x * viewProjection[0][c] + y * viewProjection[1][c] + z * viewProjection[2][c] + viewProjection[3][c];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Texture sampling, like samLinear: wrap addressing and trilinear filtering
+//--------------------------------------------------------------------------------------
+static void SampleBilinear(const Image& image, float u, float v, float result[4])
+{
+	float x = u * image.Width - 0.5f, y = v * image.Height - 0.5f;
+	float fx = floorf(x), fy = floorf(y);
+	float wx = x - fx, wy = y - fy;
+	int x0 = (int)fx % image.Width, y0 = (int)fy % image.Height;
+	x0 += (x0 < 0) ? image.Width : 0;
+	y0 += (y0 < 0) ? image.Height : 0;
+	int x1 = (x0 + 1 == image.Width) ? 0 : x0 + 1, y1 = (y0 + 1 == image.Height) ? 0 : y0 + 1;
+
+	int channels = image.Channels;
+	const unsigned char* pRow0 = &image.Texels[(size_t)y0 * image.Width * channels];
+	const unsigned char* pRow1 = &image.Texels[(size_t)y1 * image.Width * channels];
+	for (int c = 0; c < channels && c < 4; c++)
+	{
+		float top = pRow0[x0 * channels + c] + wx * (pRow0[x1 * channels + c] - pRow0[x0 * channels + c]);
+		float bottom = pRow1[x0 * channels + c] + wx * (pRow1[x1 * channels + c] - pRow1[x0 * channels + c]);
+		result[c] = (top + wy * (bottom - top)) * (1.0f / 255.0f);
+	}
+}
+
+// lod is log2 of the texels of level 0 per pixel
+static void SampleTrilinear(const std::vector<Image>& mips, float u, float v, float lod, float result[4])
+{
+	result[0] = result[1] = result[2] = 0.0f;
+	result[3] = 1.0f;
+	float maxLevel = (float)(mips.size() - 1);
+	lod = lod < 0.0f ? 0.0f : (lod > maxLevel ? maxLevel : lod);
+	int level = (int)lod;
+	float fraction = lod - (float)level;
+	SampleBilinear(mips[level], u, v, result);
+	if (fraction <= 0.0f || level + 1 >= (int)mips.size())
+		return;
+
+	float next[4];
+	SampleBilinear(mips[level + 1], u, v, next);
+	for (int c = 0; c < mips[level].Channels && c < 4; c++)
+		result[c] += fraction * (next[c] - result[c]);
+}
+
+// Level of detail of a texture of width x height texels from the texture coordinate derivatives
+static float ComputeLod(int width, int height, const float duvdx[2], const float duvdy[2])
+{
+	float x = duvdx[0] * width, y = duvdx[1] * height;
+	float lengthX = x * x + y * y;
+	x = duvdy[0] * width;
+	y = duvdy[1] * height;
+	float lengthY = x * x + y * y;
+	float rho = lengthX > lengthY ? lengthX : lengthY;
+	return rho > 0.0f ? 0.5f * log2f(rho) : 0.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Setup
+//--------------------------------------------------------------------------------------
+SoftwareRenderer::SoftwareRenderer()
+{
+	m_NextTile = 0;
+	memset(&m_Constants, 0, sizeof(m_Constants));
+	memset(m_ClearColor, 0, sizeof(m_ClearColor));
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+	for (size_t b = 0; b < m_Batches.size(); b++)
+	{
+		delete m_Batches[b]->pTessellator;
+		delete m_Batches[b];
+	}
+}
+
+bool SoftwareRenderer::Init(int width, int height, int numThreads)
+{
+	if (width < 1 || height < 1 || width > SOFTWARE_MAX_VIEWPORT_SIZE || height > SOFTWARE_MAX_VIEWPORT_SIZE)
+		return false;
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	m_Width = width;
+	m_Height = height;
+	m_TilesX = (width + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+	m_TilesY = (height + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+	m_Stride = m_TilesX * SOFTWARE_TILE_SIZE;
+	m_Threads = numThreads;
+	m_Color.Width = width;
+	m_Color.Height = height;
+	m_Color.Channels = 4;
+	m_Color.Texels.assign((size_t)width * height * 4, 0);
+	m_Depth.assign((size_t)m_Stride * m_TilesY * SOFTWARE_TILE_SIZE, 1.0f);
+	m_TriangleIds.assign(m_Depth.size(), EMPTY_TRIANGLE_ID);
+	return true;
+}
+
+void SoftwareRenderer::BeginFrame(const StaticConstants& constants, const float clearColor[4])
+{
+	m_Constants = constants;
+	for (int c = 0; c < 4; c++)
+		m_ClearColor[c] = clearColor[c];
+	m_BatchCount = 0;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+SoftwareRenderer::Batch& SoftwareRenderer::AddBatch(const SceneFrame& frame)
+{
+	if (m_BatchCount == (int)m_Batches.size())
+	{
+		Batch* pBatch = new Batch();
+		pBatch->pTessellator = NULL;
+		m_Batches.push_back(pBatch);
+	}
+	Batch& batch = *m_Batches[m_BatchCount++];
+	batch.Vertices.clear();
+	batch.Triangles.clear();
+	batch.Bins.resize(m_TilesX * m_TilesY);
+	for (size_t tile = 0; tile < batch.Bins.size(); tile++)
+		batch.Bins[tile].clear();
+	memcpy(batch.ViewProjection, frame.ViewProjection, sizeof(batch.ViewProjection));
+	batch.Frame = frame.Frame;
+	batch.Draw = frame.Draw;
+	batch.FirstTriangle = 0;
+	batch.TessellatedTriangles = 0;
+	batch.CachedPatches = 0;
+	return batch;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Geometry: VS, HS and DS of the terrain, then clipping, culling and binning
+//--------------------------------------------------------------------------------------
+void SoftwareRenderer::DrawTerrain(const TerrainGrid& grid, const int* pPatches, int count, const SceneSettings& settings,
+	const SceneFrame& frame)
+{
+	double start = GetTimeSeconds();
+	bool quads = settings.QuadPatches;
+	int controlPoints = quads ? 4 : 3;
+	int numEdges = quads ? 4 : 3;
+	int numPatches = quads ? count : count * 2;
+	if (numPatches <= 0)
+		return;
+
+	// VS scales the control points by the World matrix
+	static const int s_QuadEdgePoints[4][2] = { { 0, 1 }, { 3, 0 }, { 3, 2 }, { 1, 2 } };
+	m_Patches.resize(numPatches);
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+		int numIndices = quads ? TERRAIN_QUAD_INDICES_PER_PATCH : TERRAIN_INDICES_PER_PATCH;
+		if (quads)
+			grid.GetQuadPatchIndices(pPatches[i], indices);
+		else
+			grid.GetPatchIndices(pPatches[i], indices);
+		for (int half = 0; half < numIndices / controlPoints; half++)
+		{
+			TerrainPatch& patch = m_Patches[quads ? i : i * 2 + half];
+			const unsigned int* pIndices = indices + half * controlPoints;
+			patch.Id = quads ? (unsigned int)pPatches[i] : (unsigned int)pPatches[i] * 2 + half;
+			patch.pCacheEntry = NULL;
+			for (int e = 0; e < numEdges; e++)
+			{
+				patch.EdgeKeys[e] = quads ?
+					TessellationCache::GetEdgeKey(pIndices[s_QuadEdgePoints[e][0]], pIndices[s_QuadEdgePoints[e][1]]) :
+					TessellationCache::GetEdgeKey(pIndices[(e + 1) % 3], pIndices[(e + 2) % 3]);
+			}
+		}
+		for (int v = 0; v < numIndices; v++)
+		{
+			TerrainPatch& patch = m_Patches[quads ? i : i * 2 + v / 3];
+			float position[3], texCoord[2];
+			grid.GetVertex(indices[v], position, texCoord);
+			for (int c = 0; c < 3; c++)
+				patch.Positions[v % controlPoints][c] = position[c] * frame.WorldScale[c];
+			patch.TexCoords[v % controlPoints][0] = texCoord[0];
+			patch.TexCoords[v % controlPoints][1] = texCoord[1];
+			patch.TexCoords[v % controlPoints][2] = 0.0f;
+		}
+	}
+
+	// The factors of ConstHS or ConstQuadHS, edge e of a tri patch is the one opposite
+	// control point e
+	bool useDensity = settings.ContentDensity && m_Textures.pDensityMap && m_Textures.pDensityMap->IsValid();
+	if (!settings.AdaptiveTessellation && !useDensity)
+	{
+		for (int p = 0; p < numPatches; p++)
+		{
+			for (int f = 0; f < 6; f++)
+				m_Patches[p].Factors[f] = settings.TessellationFactor;
+		}
+	}
+	else
+	{
+		std::vector<float> positions(numPatches * 4 * 3), density(numPatches * 4), factors(numPatches * 6);
+		PatchPositionsSoA positionsSoA;
+		PatchDensitySoA densitySoA;
+		PatchFactorsSoA factorsSoA;
+		for (int p = 0; p < 4; p++)
+		{
+			positionsSoA.X[p] = &positions[(p * 3 + 0) * numPatches];
+			positionsSoA.Y[p] = &positions[(p * 3 + 1) * numPatches];
+			positionsSoA.Z[p] = &positions[(p * 3 + 2) * numPatches];
+			densitySoA.Edges[p] = &density[p * numPatches];
+			factorsSoA.Edges[p] = &factors[p * numPatches];
+		}
+		factorsSoA.Inside[0] = &factors[4 * numPatches];
+		factorsSoA.Inside[1] = &factors[5 * numPatches];
+		for (int p = 0; p < numPatches; p++)
+		{
+			const TerrainPatch& patch = m_Patches[p];
+			for (int v = 0; v < controlPoints; v++)
+			{
+				positions[(v * 3 + 0) * numPatches + p] = patch.Positions[v][0];
+				positions[(v * 3 + 1) * numPatches + p] = patch.Positions[v][1];
+				positions[(v * 3 + 2) * numPatches + p] = patch.Positions[v][2];
+			}
+			for (int e = 0; e < numEdges && useDensity; e++)
+			{
+				const float* pA = patch.TexCoords[quads ? s_QuadEdgePoints[e][0] : (e + 1) % 3];
+				const float* pB = patch.TexCoords[quads ? s_QuadEdgePoints[e][1] : (e + 2) % 3];
+				density[e * numPatches + p] = m_Textures.pDensityMap->SampleEdge(pA[0], pA[1], pB[0], pB[1]);
+			}
+		}
+
+		AdaptiveTessParams params;
+		for (int c = 0; c < 3; c++)
+			params.Eye[c] = frame.Frame.Eye[c];
+		params.ProjScale = m_Constants.Projection[1][1];
+		params.ViewportHeight = m_Constants.ViewportSize[1];
+		params.TargetTriangleSize = frame.Frame.TargetTriangleSize;
+		params.MaxTessFactor = settings.TessellationFactor;
+		if (quads && settings.AdaptiveTessellation)
+			ComputeQuadPatchTessFactors(positionsSoA, numPatches, params, factorsSoA, useDensity ? &densitySoA : NULL);
+		else if (quads)
+			ComputeUniformQuadPatchTessFactors(densitySoA, numPatches, settings.TessellationFactor, factorsSoA);
+		else if (settings.AdaptiveTessellation)
+			ComputeTriPatchTessFactors(positionsSoA, numPatches, params, factorsSoA, useDensity ? &densitySoA : NULL);
+		else
+			ComputeUniformTriPatchTessFactors(densitySoA, numPatches, settings.TessellationFactor, factorsSoA);
+		for (int p = 0; p < numPatches; p++)
+		{
+			for (int f = 0; f < 6; f++)
+				m_Patches[p].Factors[f] = factors[f * numPatches + p];
+		}
+	}
+
+	// Patches whose stabilized factors match their entry skip the tessellator and DS, the
+	// threads fill the entries of the others
+	if (m_pCache)
+	{
+		const DrawConstants& draw = frame.Draw;
+		int patchesX = grid.GetPatchesX(), patchesZ = grid.GetPatchesZ();
+		unsigned long long key = HashBytes(&quads, sizeof(quads));
+		key = HashBytes(&patchesX, sizeof(patchesX), key);
+		key = HashBytes(&patchesZ, sizeof(patchesZ), key);
+		key = HashBytes(frame.WorldScale, sizeof(frame.WorldScale), key);
+		key = HashBytes(&draw.Scaling, sizeof(draw.Scaling), key);
+		key = HashBytes(&draw.DisplacementLevel, sizeof(draw.DisplacementLevel), key);
+		key = HashBytes(&m_Textures.pDisplacement, sizeof(m_Textures.pDisplacement), key);
+		m_pCache->SetContentKey(key);
+		m_pCache->BeginDraw();
+		for (int p = 0; p < numPatches; p++)
+		{
+			TerrainPatch& patch = m_Patches[p];
+			bool hit;
+			m_pCache->StabilizeFactors(patch.Id, patch.EdgeKeys, numEdges, patch.Factors);
+			patch.pCacheEntry = m_pCache->Acquire(patch.Id, patch.Factors, hit);
+		}
+	}
+
+	// One batch per thread, on contiguous ranges so the tiles see the patches in order
+	int threads = std::min(m_Threads, numPatches);
+	std::vector<Batch*> batches(threads);
+	for (int t = 0; t < threads; t++)
+		batches[t] = &AddBatch(frame);
+	if (threads == 1)
+	{
+		RunTerrainPatches(batches[0], 0, numPatches, quads);
+	}
+	else
+	{
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+		{
+			workers.push_back(std::thread(&SoftwareRenderer::RunTerrainPatches, this, batches[t],
+				numPatches * t / threads, numPatches * (t + 1) / threads, quads));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+	if (m_pCache)
+		m_pCache->Trim();
+
+	m_Stats.Patches += numPatches;
+	for (int t = 0; t < threads; t++)
+	{
+		m_Stats.Triangles += batches[t]->TessellatedTriangles;
+		m_Stats.CachedPatches += batches[t]->CachedPatches;
+		m_Stats.BinnedTriangles += (long long)batches[t]->Triangles.size();
+	}
+	m_Stats.GeometrySeconds += GetTimeSeconds() - start;
+}
+
+void SoftwareRenderer::RunTerrainPatches(Batch* pBatch, int begin, int end, bool quads)
+{
+	Batch& batch = *pBatch;
+	if (!batch.pTessellator)
+	{
+		batch.pTessellator = new CpuTessellator();
+		batch.pTessellator->Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+	}
+	CpuTessellator& tessellator = *batch.pTessellator;
+	batch.Domain.resize(6 * TESS_MAX_POINTS);
+	float* pX = &batch.Domain[0];
+	float* pY = pX + TESS_MAX_POINTS;
+	float* pZ = pY + TESS_MAX_POINTS;
+	float* pU = pZ + TESS_MAX_POINTS;
+	float* pV = pU + TESS_MAX_POINTS;
+	float* pW = pV + TESS_MAX_POINTS;
+
+	// World height of every texel value, in the order DS scales it
+	const DrawConstants& draw = batch.Draw;
+	float heights[256];
+	for (int t = 0; t < 256; t++)
+		heights[t] = (float)t / 255.0f * draw.Scaling * draw.DisplacementLevel;
+	const HeightPyramid* pDisplacement = m_Textures.pDisplacement;
+	bool displace = pDisplacement && pDisplacement->IsValid();
+	const unsigned char* pTexels = displace ? pDisplacement->GetLevelMin(0) : NULL;
+	int texWidth = displace ? pDisplacement->GetWidth() : 1, texHeight = displace ? pDisplacement->GetHeight() : 1;
+
+	const float (*viewProjection)[4] = batch.ViewProjection;
+
+	for (int p = begin; p < end; p++)
+	{
+		const TerrainPatch& patch = m_Patches[p];
+		TessCacheEntry* pEntry = patch.pCacheEntry;
+		unsigned int firstVertex = (unsigned int)batch.Vertices.size();
+		if (pEntry && pEntry->Valid)
+		{
+			int pointCount = (int)pEntry->Vertices.size(), indexCount = (int)pEntry->Indices.size();
+			batch.TessellatedTriangles += indexCount / 3;
+			batch.CachedPatches++;
+			batch.Vertices.resize(firstVertex + pointCount);
+			for (int i = 0; i < pointCount; i++)
+			{
+				const TessCacheVertex& cached = pEntry->Vertices[i];
+				ProjectVertex(viewProjection, cached.Position[0], cached.Position[1], cached.Position[2], cached.TexCoord[0],
+					cached.TexCoord[1], batch.Vertices[firstVertex + i]);
+			}
+			const unsigned short* pIndices = pEntry->Indices.data();
+			for (int i = 0; i < indexCount; i += 3)
+				AddTriangle(batch, firstVertex + pIndices[i], firstVertex + pIndices[i + 1], firstVertex + pIndices[i + 2]);
+			continue;
+		}
+
+		const float* pFactors = patch.Factors;
+		if (quads)
+			tessellator.TessellateQuadDomain(pFactors[0], pFactors[1], pFactors[2], pFactors[3], pFactors[4], pFactors[5]);
+		else
+			tessellator.TessellateTriDomain(pFactors[0], pFactors[1], pFactors[2], pFactors[4]);
+		int pointCount = tessellator.GetPointCount();
+		int indexCount = tessellator.GetIndexCount();
+		batch.TessellatedTriangles += indexCount / 3;
+		if (quads)
+		{
+			TessEvaluateQuadDomain(tessellator.GetPointsU(), tessellator.GetPointsV(), pointCount, patch.Positions, pX, pY, pZ);
+			TessEvaluateQuadDomain(tessellator.GetPointsU(), tessellator.GetPointsV(), pointCount, patch.TexCoords, pU, pV, pW);
+		}
+		else
+		{
+			TessEvaluateTriDomain(tessellator.GetPointsU(), tessellator.GetPointsV(), pointCount, patch.Positions, pX, pY, pZ);
+			TessEvaluateTriDomain(tessellator.GetPointsU(), tessellator.GetPointsV(), pointCount, patch.TexCoords, pU, pV, pW);
+		}
+
+		// DS displaces by the point-sampled texel and projects
+		batch.Vertices.resize(firstVertex + pointCount);
+		for (int i = 0; i < pointCount; i++)
+		{
+			float y = pY[i];
+			if (displace)
+			{
+				int texelX = (int)floorf(pU[i] * texWidth) % texWidth, texelY = (int)floorf(pV[i] * texHeight) % texHeight;
+				texelX += (texelX < 0) ? texWidth : 0;
+				texelY += (texelY < 0) ? texHeight : 0;
+				y += heights[pTexels[(size_t)texelY * texWidth + texelX]];
+			}
+			ProjectVertex(viewProjection, pX[i], y, pZ[i], pU[i], pV[i], batch.Vertices[firstVertex + i]);
+		}
+
+		const int* pIndices = tessellator.GetIndices();
+		for (int i = 0; i < indexCount; i += 3)
+			AddTriangle(batch, firstVertex + pIndices[i], firstVertex + pIndices[i + 1], firstVertex + pIndices[i + 2]);
+
+		// The entry keeps the domain points before the projection
+		if (pEntry)
+		{
+			pEntry->Vertices.resize(pointCount);
+			for (int i = 0; i < pointCount; i++)
+			{
+				const SoftwareVertex& vertex = batch.Vertices[firstVertex + i];
+				TessCacheVertex& cached = pEntry->Vertices[i];
+				memcpy(cached.Position, vertex.WorldPos, sizeof(cached.Position));
+				memcpy(cached.TexCoord, vertex.TexCoord, sizeof(cached.TexCoord));
+			}
+			pEntry->Indices.assign(pIndices, pIndices + indexCount);
+			pEntry->Valid = true;
+		}
+	}
+}
+
+void SoftwareRenderer::DrawTriangles(const SoftwareVertex* pVertices, const unsigned int* pIndices, int indexCount,
+	const SceneFrame& frame)
+{
+	double start = GetTimeSeconds();
+	Batch& batch = AddBatch(frame);
+	unsigned int vertexCount = 0;
+	for (int i = 0; i < indexCount; i++)
+		vertexCount = std::max(vertexCount, pIndices[i] + 1);
+	batch.Vertices.assign(pVertices, pVertices + vertexCount);
+	for (int i = 0; i + 3 <= indexCount; i += 3)
+		AddTriangle(batch, pIndices[i], pIndices[i + 1], pIndices[i + 2]);
+	batch.TessellatedTriangles = indexCount / 3;
+
+	m_Stats.Triangles += indexCount / 3;
+	m_Stats.BinnedTriangles += (long long)batch.Triangles.size();
+	m_Stats.GeometrySeconds += GetTimeSeconds() - start;
+}
+
+// Clips against the planes the triangle crosses and sets up the pieces
+void SoftwareRenderer::AddTriangle(Batch& batch, unsigned int v0, unsigned int v1, unsigned int v2)
+{
+	float guardX = 2.0f * GUARD_BAND_PIXELS / m_Width, guardY = 2.0f * GUARD_BAND_PIXELS / m_Height;
+	unsigned int vertices[3] = { v0, v1, v2 };
+	int outcodes[3];
+	for (int v = 0; v < 3; v++)
+		outcodes[v] = ClipOutcode(batch.Vertices[vertices[v]].Position, guardX, guardY);
+	if ((outcodes[0] & outcodes[1] & outcodes[2]) != 0)
+		return;
+	int crossed = outcodes[0] | outcodes[1] | outcodes[2];
+	if (crossed == 0)
+	{
+		SetupTriangle(batch, vertices);
+		return;
+	}
+
+	// Sutherland-Hodgman in clip space, where the attributes are still linear. Each plane
+	// adds at most one vertex.
+	SoftwareVertex polygon[2][3 + CLIP_PLANE_COUNT];
+	int count = 3, current = 0;
+	for (int v = 0; v < 3; v++)
+		polygon[0][v] = batch.Vertices[vertices[v]];
+	for (int plane = 0; plane < CLIP_PLANE_COUNT && count >= 3; plane++)
+	{
+		if ((crossed & (1 << plane)) == 0)
+			continue;
+		const SoftwareVertex* pIn = polygon[current];
+		SoftwareVertex* pOut = polygon[1 - current];
+		int outCount = 0;
+		for (int v = 0; v < count; v++)
+		{
+			const SoftwareVertex& a = pIn[v];
+			const SoftwareVertex& b = pIn[(v + 1) % count];
+			float da = ClipDistance(a.Position, plane, guardX, guardY);
+			float db = ClipDistance(b.Position, plane, guardX, guardY);
+			if (da >= 0.0f)
+				pOut[outCount++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				LerpVertex(a, b, da / (da - db), pOut[outCount++]);
+		}
+		count = outCount;
+		current = 1 - current;
+	}
+	if (count < 3)
+		return;
+
+	unsigned int first = (unsigned int)batch.Vertices.size();
+	batch.Vertices.insert(batch.Vertices.end(), polygon[current], polygon[current] + count);
+	for (int v = 1; v + 1 < count; v++)
+	{
+		unsigned int fan[3] = { first, first + v, first + v + 1 };
+		SetupTriangle(batch, fan);
+	}
+}
+
+// Snaps to the subpixel grid, culls and bins a triangle inside the guard band
+void SoftwareRenderer::SetupTriangle(Batch& batch, const unsigned int vertices[3])
+{
+	Triangle triangle;
+	float screenX[3], screenY[3], z[3];
+	for (int v = 0; v < 3; v++)
+	{
+		const float* pPosition = batch.Vertices[vertices[v]].Position;
+		float invW = 1.0f / pPosition[3];
+		float x = (pPosition[0] * invW * 0.5f + 0.5f) * m_Width;
+		float y = (0.5f - pPosition[1] * invW * 0.5f) * m_Height;
+		triangle.Vertices[v] = vertices[v];
+		triangle.X[v] = (int)floorf(x * SUBPIXEL_ONE + 0.5f);
+		triangle.Y[v] = (int)floorf(y * SUBPIXEL_ONE + 0.5f);
+		screenX[v] = (float)triangle.X[v] / SUBPIXEL_ONE;
+		screenY[v] = (float)triangle.Y[v] / SUBPIXEL_ONE;
+		z[v] = pPosition[2] * invW;
+	}
+
+	// Front faces are clockwise on screen, which has y pointing down
+	long long area = (long long)(triangle.X[1] - triangle.X[0]) * (triangle.Y[2] - triangle.Y[0]) -
+		(long long)(triangle.X[2] - triangle.X[0]) * (triangle.Y[1] - triangle.Y[0]);
+	if (area <= 0)
+		return;
+
+	// Pixels whose centers lie within the bounds
+	int minX = std::min(triangle.X[0], std::min(triangle.X[1], triangle.X[2]));
+	int maxX = std::max(triangle.X[0], std::max(triangle.X[1], triangle.X[2]));
+	int minY = std::min(triangle.Y[0], std::min(triangle.Y[1], triangle.Y[2]));
+	int maxY = std::max(triangle.Y[0], std::max(triangle.Y[1], triangle.Y[2]));
+	int pixelX0 = std::max(-FloorDivide(-(minX - SUBPIXEL_ONE / 2), SUBPIXEL_ONE), 0);
+	int pixelX1 = std::min(FloorDivide(maxX - SUBPIXEL_ONE / 2, SUBPIXEL_ONE), m_Width - 1);
+	int pixelY0 = std::max(-FloorDivide(-(minY - SUBPIXEL_ONE / 2), SUBPIXEL_ONE), 0);
+	int pixelY1 = std::min(FloorDivide(maxY - SUBPIXEL_ONE / 2, SUBPIXEL_ONE), m_Height - 1);
+	if (pixelX0 > pixelX1 || pixelY0 > pixelY1)
+		return;
+	triangle.MinX = (short)pixelX0;
+	triangle.MaxX = (short)pixelX1;
+	triangle.MinY = (short)pixelY0;
+	triangle.MaxY = (short)pixelY1;
+
+	// z / w is linear in screen space
+	float dx1 = screenX[1] - screenX[0], dy1 = screenY[1] - screenY[0];
+	float dx2 = screenX[2] - screenX[0], dy2 = screenY[2] - screenY[0];
+	float invArea = 1.0f / (dx1 * dy2 - dx2 * dy1);
+	triangle.Z0 = z[0];
+	triangle.ZdX = ((z[1] - z[0]) * dy2 - (z[2] - z[0]) * dy1) * invArea;
+	triangle.ZdY = ((z[2] - z[0]) * dx1 - (z[1] - z[0]) * dx2) * invArea;
+
+	unsigned int index = (unsigned int)batch.Triangles.size();
+	batch.Triangles.push_back(triangle);
+	for (int tileY = pixelY0 / SOFTWARE_TILE_SIZE; tileY <= pixelY1 / SOFTWARE_TILE_SIZE; tileY++)
+	{
+		for (int tileX = pixelX0 / SOFTWARE_TILE_SIZE; tileX <= pixelX1 / SOFTWARE_TILE_SIZE; tileX++)
+			batch.Bins[tileY * m_TilesX + tileX].push_back(index);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Tiles: rasterization into the depth and triangle ID buffers, then PS
+//--------------------------------------------------------------------------------------
+void SoftwareRenderer::EndFrame()
+{
+	double start = GetTimeSeconds();
+	unsigned int firstTriangle = 0;
+	for (int b = 0; b < m_BatchCount; b++)
+	{
+		m_Batches[b]->FirstTriangle = firstTriangle;
+		firstTriangle += (unsigned int)m_Batches[b]->Triangles.size();
+	}
+
+	// Tiles are taken one at a time, their cost varies a lot
+	m_NextTile = 0;
+	int threads = std::min(m_Threads, m_TilesX * m_TilesY);
+	std::vector<long long> counters(threads * 2, 0);
+	if (threads == 1)
+	{
+		RenderTiles(&counters[0]);
+	}
+	else
+	{
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+			workers.push_back(std::thread(&SoftwareRenderer::RenderTiles, this, &counters[t * 2]));
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+	for (int t = 0; t < threads; t++)
+	{
+		m_Stats.DepthPassedPixels += counters[t * 2];
+		m_Stats.ShadedPixels += counters[t * 2 + 1];
+	}
+	m_Stats.RasterSeconds += GetTimeSeconds() - start;
+}
+
+void SoftwareRenderer::RenderTiles(long long* pCounters)
+{
+	for (;;)
+	{
+		int tile = m_NextTile++;
+		if (tile >= m_TilesX * m_TilesY)
+			break;
+		int tileX = tile % m_TilesX, tileY = tile / m_TilesX;
+
+		for (int y = 0; y < SOFTWARE_TILE_SIZE; y++)
+		{
+			size_t row = (size_t)(tileY * SOFTWARE_TILE_SIZE + y) * m_Stride + tileX * SOFTWARE_TILE_SIZE;
+			std::fill(&m_Depth[row], &m_Depth[row] + SOFTWARE_TILE_SIZE, 1.0f);
+			std::fill(&m_TriangleIds[row], &m_TriangleIds[row] + SOFTWARE_TILE_SIZE, EMPTY_TRIANGLE_ID);
+		}
+		for (int b = 0; b < m_BatchCount; b++)
+		{
+			const Batch& batch = *m_Batches[b];
+			const std::vector<unsigned int>& bin = batch.Bins[tile];
+			for (size_t i = 0; i < bin.size(); i++)
+				RasterizeTriangle(batch.Triangles[bin[i]], batch.FirstTriangle + bin[i], tileX, tileY, pCounters[0]);
+		}
+		ShadeTile(tileX, tileY, pCounters[1]);
+	}
+}
+
+void SoftwareRenderer::RasterizeTriangle(const Triangle& triangle, unsigned int id, int tileX, int tileY, long long& passed)
+{
+	int tileX0 = tileX * SOFTWARE_TILE_SIZE, tileY0 = tileY * SOFTWARE_TILE_SIZE;
+	int x0 = std::max((int)triangle.MinX, tileX0), x1 = std::min((int)triangle.MaxX, tileX0 + SOFTWARE_TILE_SIZE - 1);
+	int y0 = std::max((int)triangle.MinY, tileY0), y1 = std::min((int)triangle.MaxY, tileY0 + SOFTWARE_TILE_SIZE - 1);
+	if (x0 > x1 || y0 > y1)
+		return;
+	int blockX0 = x0 & ~3;
+
+	// Edge e runs from vertex e to e + 1 and is >= 0 inside. Pixels on an edge belong to
+	// the triangle if it is a top or a left edge. Against the whole tile an edge either
+	// rejects it, accepts it or crosses it, and only then does it need testing, with
+	// values that fit 32 bits.
+	const long long tileSpan = (long long)(SOFTWARE_TILE_SIZE - 1) * SUBPIXEL_ONE;
+	long long centerX = (long long)tileX0 * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+	long long centerY = (long long)tileY0 * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+	int stepX[3], stepY[3], rowStart[3];
+	for (int e = 0; e < 3; e++)
+	{
+		int next = (e + 1) % 3;
+		long long a = (long long)triangle.Y[e] - triangle.Y[next];
+		long long b = (long long)triangle.X[next] - triangle.X[e];
+		long long c = -(a * triangle.X[e] + b * triangle.Y[e]);
+		bool topLeft = a > 0 || (a == 0 && b > 0);
+		if (!topLeft)
+			c -= 1;
+		long long value = a * centerX + b * centerY + c;
+		long long maximum = value + (a > 0 ? a : 0) * tileSpan + (b > 0 ? b : 0) * tileSpan;
+		long long minimum = value + (a < 0 ? a : 0) * tileSpan + (b < 0 ? b : 0) * tileSpan;
+		if (maximum < 0)
+			return;
+		if (minimum >= 0)
+		{
+			stepX[e] = stepY[e] = rowStart[e] = 0;
+			continue;
+		}
+		stepX[e] = (int)(a * SUBPIXEL_ONE);
+		stepY[e] = (int)(b * SUBPIXEL_ONE);
+		rowStart[e] = (int)(value + a * SUBPIXEL_ONE * (blockX0 - tileX0) + b * SUBPIXEL_ONE * (y0 - tileY0));
+	}
+
+	// z / w at the center of the first pixel of the rows
+	float offsetX = (float)blockX0 + 0.5f - (float)triangle.X[0] / SUBPIXEL_ONE;
+	float zStart = triangle.Z0 + triangle.ZdX * offsetX;
+	long long count = 0;
+	for (int y = y0; y <= y1; y++)
+	{
+		float zRow = zStart + triangle.ZdY * ((float)y + 0.5f - (float)triangle.Y[0] / SUBPIXEL_ONE);
+		float* pDepth = &m_Depth[(size_t)y * m_Stride];
+		unsigned int* pIds = &m_TriangleIds[(size_t)y * m_Stride];
+		int x = blockX0;
+#if TESS_USE_SSE2
+		__m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+		__m128i edge[3], edgeStep[3];
+		for (int e = 0; e < 3; e++)
+		{
+			__m128i laneSteps = _mm_setr_epi32(0, stepX[e], stepX[e] * 2, stepX[e] * 3);
+			edge[e] = _mm_add_epi32(_mm_set1_epi32(rowStart[e]), laneSteps);
+			edgeStep[e] = _mm_set1_epi32(stepX[e] * 4);
+		}
+		__m128 zLanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		__m128 zdx = _mm_set1_ps(triangle.ZdX);
+		__m128i first = _mm_set1_epi32(x0 - 1), last = _mm_set1_epi32(x1 + 1);
+		__m128i id4 = _mm_set1_epi32((int)id);
+		for (; x <= x1; x += 4)
+		{
+			// Inside where no edge function is negative, within the bounds
+			__m128i xs = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+			__m128i signs = _mm_or_si128(_mm_or_si128(edge[0], edge[1]), edge[2]);
+			__m128i inside = _mm_and_si128(_mm_cmpgt_epi32(signs, _mm_set1_epi32(-1)),
+				_mm_and_si128(_mm_cmpgt_epi32(xs, first), _mm_cmplt_epi32(xs, last)));
+			for (int e = 0; e < 3; e++)
+				edge[e] = _mm_add_epi32(edge[e], edgeStep[e]);
+			if (_mm_movemask_epi8(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(_mm_set1_ps(zRow), _mm_mul_ps(zdx, _mm_add_ps(zLanes, _mm_set1_ps((float)(x - blockX0)))));
+			__m128 depth = _mm_loadu_ps(&pDepth[x]);
+			__m128 mask = _mm_and_ps(_mm_castsi128_ps(inside), _mm_cmplt_ps(z, depth));
+			int bits = _mm_movemask_ps(mask);
+			if (bits == 0)
+				continue;
+			count += (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+			_mm_storeu_ps(&pDepth[x], _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, depth)));
+			__m128i ids = _mm_loadu_si128((const __m128i*)&pIds[x]);
+			__m128i maskI = _mm_castps_si128(mask);
+			_mm_storeu_si128((__m128i*)&pIds[x], _mm_or_si128(_mm_and_si128(maskI, id4), _mm_andnot_si128(maskI, ids)));
+		}
+#else
+		int edge[3];
+		for (int e = 0; e < 3; e++)
+			edge[e] = rowStart[e];
+		for (; x <= x1; x++)
+		{
+			bool inside = (edge[0] | edge[1] | edge[2]) >= 0 && x >= x0;
+			for (int e = 0; e < 3; e++)
+				edge[e] += stepX[e];
+			if (!inside)
+				continue;
+			float z = zRow + triangle.ZdX * (float)(x - blockX0);
+			if (z < pDepth[x])
+			{
+				pDepth[x] = z;
+				pIds[x] = id;
+				count++;
+			}
+		}
+#endif
+		for (int e = 0; e < 3; e++)
+			rowStart[e] += stepY[e];
+	}
+	passed += count;
+}
+
+// PS of DisplacedAndShaded.hlsl on the nearest triangle of every pixel
+void SoftwareRenderer::ShadeTile(int tileX, int tileY, long long& shaded)
+{
+	unsigned char clear[4];
+	for (int c = 0; c < 4; c++)
+		clear[c] = ToUnorm8(m_ClearColor[c]);
+	const std::vector<Image>* pDiffuse = m_Textures.pDiffuseMips;
+	const std::vector<Image>* pNormals = m_Textures.pNormalMips;
+	bool hasDiffuse = pDiffuse && !pDiffuse->empty(), hasNormals = pNormals && !pNormals->empty();
+
+	int x0 = tileX * SOFTWARE_TILE_SIZE, x1 = std::min(x0 + SOFTWARE_TILE_SIZE, m_Width);
+	int y0 = tileY * SOFTWARE_TILE_SIZE, y1 = std::min(y0 + SOFTWARE_TILE_SIZE, m_Height);
+	int batchIndex = 0;
+	for (int y = y0; y < y1; y++)
+	{
+		const unsigned int* pIds = &m_TriangleIds[(size_t)y * m_Stride];
+		unsigned char* pColor = &m_Color.Texels[(size_t)y * m_Width * 4];
+		for (int x = x0; x < x1; x++)
+		{
+			unsigned int id = pIds[x];
+			if (id == EMPTY_TRIANGLE_ID)
+			{
+				memcpy(&pColor[x * 4], clear, 4);
+				continue;
+			}
+			while (batchIndex > 0 && id < m_Batches[batchIndex]->FirstTriangle)
+				batchIndex--;
+			while (batchIndex + 1 < m_BatchCount && id >= m_Batches[batchIndex + 1]->FirstTriangle)
+				batchIndex++;
+			const Batch& batch = *m_Batches[batchIndex];
+			const Triangle& triangle = batch.Triangles[id - batch.FirstTriangle];
+			const SoftwareVertex* pVertex[3];
+			float sx[3], sy[3], q[3];
+			for (int v = 0; v < 3; v++)
+			{
+				pVertex[v] = &batch.Vertices[triangle.Vertices[v]];
+				sx[v] = (float)triangle.X[v] / SUBPIXEL_ONE;
+				sy[v] = (float)triangle.Y[v] / SUBPIXEL_ONE;
+				q[v] = 1.0f / pVertex[v]->Position[3];
+			}
+
+			// Screen space barycentrics and their slopes, weighted by 1 / w for perspective
+			// correct attributes
+			float px = (float)x + 0.5f, py = (float)y + 0.5f;
+			float invArea = 1.0f / ((sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]));
+			float b[3], bdx[3], bdy[3];
+			b[0] = ((sx[2] - sx[1]) * (py - sy[1]) - (sy[2] - sy[1]) * (px - sx[1])) * invArea;
+			b[1] = ((sx[0] - sx[2]) * (py - sy[2]) - (sy[0] - sy[2]) * (px - sx[2])) * invArea;
+			b[2] = 1.0f - b[0] - b[1];
+			bdx[0] = -(sy[2] - sy[1]) * invArea;
+			bdx[1] = -(sy[0] - sy[2]) * invArea;
+			bdx[2] = -bdx[0] - bdx[1];
+			bdy[0] = (sx[2] - sx[1]) * invArea;
+			bdy[1] = (sx[0] - sx[2]) * invArea;
+			bdy[2] = -bdy[0] - bdy[1];
+
+			float weight = 0.0f, weightDx = 0.0f, weightDy = 0.0f;
+			float uv[2] = { 0.0f, 0.0f }, uvDx[2] = { 0.0f, 0.0f }, uvDy[2] = { 0.0f, 0.0f };
+			float world[3] = { 0.0f, 0.0f, 0.0f };
+			for (int v = 0; v < 3; v++)
+			{
+				float w = b[v] * q[v];
+				weight += w;
+				weightDx += bdx[v] * q[v];
+				weightDy += bdy[v] * q[v];
+				for (int c = 0; c < 2; c++)
+				{
+					uv[c] += w * pVertex[v]->TexCoord[c];
+					uvDx[c] += bdx[v] * q[v] * pVertex[v]->TexCoord[c];
+					uvDy[c] += bdy[v] * q[v] * pVertex[v]->TexCoord[c];
+				}
+				for (int c = 0; c < 3; c++)
+					world[c] += w * pVertex[v]->WorldPos[c];
+			}
+			float invWeight = 1.0f / weight;
+			for (int c = 0; c < 2; c++)
+			{
+				uv[c] *= invWeight;
+				uvDx[c] = (uvDx[c] - uv[c] * weightDx) * invWeight;
+				uvDy[c] = (uvDy[c] - uv[c] * weightDy) * invWeight;
+			}
+			for (int c = 0; c < 3; c++)
+				world[c] *= invWeight;
+
+			// DisplacedNormalWS: the slopes of the normal map rescaled to the world height of
+			// the displacement range and the world size of a texel
+			float normal[3] = { 0.0f, 1.0f, 0.0f };
+			if (hasNormals)
+			{
+				const Image& top = (*pNormals)[0];
+				float texel[4];
+				SampleTrilinear(*pNormals, uv[0], uv[1], ComputeLod(top.Width, top.Height, uvDx, uvDy), texel);
+				float normalX = texel[0] * 2.0f - 1.0f, normalY = texel[1] * 2.0f - 1.0f;
+				float normalZ = sqrtf(std::max(0.0f, std::min(1.0f, 1.0f - (normalX * normalX + normalY * normalY))));
+				float texelSizeX = 2.0f * batch.Draw.World[0][0] / top.Width, texelSizeY = 2.0f * batch.Draw.World[2][2] / top.Height;
+				float scale = batch.Draw.Scaling * batch.Draw.DisplacementLevel / (std::max(normalZ, 0.001f) * NORMAL_MAP_SLOPE_SCALE);
+				normal[0] = normalX * scale / texelSizeX;
+				normal[2] = normalY * scale / texelSizeY;
+				NormalizeVector(normal);
+			}
+
+			float base[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			if (hasDiffuse)
+			{
+				const Image& top = (*pDiffuse)[0];
+				SampleTrilinear(*pDiffuse, uv[0], uv[1], ComputeLod(top.Width, top.Height, uvDx, uvDy), base);
+			}
+
+			// ComputeIllumination
+			float light[3], view[3];
+			for (int c = 0; c < 3; c++)
+			{
+				light[c] = m_Constants.LightPos[c] - world[c];
+				view[c] = batch.Frame.Eye[c] - world[c];
+			}
+			NormalizeVector(light);
+			NormalizeVector(view);
+			float normalDotLight = normal[0] * light[0] + normal[1] * light[1] + normal[2] * light[2];
+			float diffuse = std::max(0.0f, std::min(1.0f, normalDotLight));
+			float reflected[3];
+			for (int c = 0; c < 3; c++)
+				reflected[c] = 2.0f * normalDotLight * normal[c] - light[c];
+			NormalizeVector(reflected);
+			float reflectedDotView = reflected[0] * view[0] + reflected[1] * view[1] + reflected[2] * view[2];
+			float specular = powf(std::max(0.0f, std::min(1.0f, reflectedDotView)), 20.0f);
+			for (int c = 0; c < 4; c++)
+				pColor[x * 4 + c] = ToUnorm8((0.1f + diffuse) * base[c] + specular);
+			shaded++;
+		}
+	}
+}
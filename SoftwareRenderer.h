@@ -0,0 +1,193 @@
+//--------------------------------------------------------------------------------------
+// File: SoftwareRenderer.h
+//
+// CPU backend of the grid terrain draw of Render, for validation frames, image diffs and
+// performance regression tests on machines without a D3D11 driver. The shaders of
+// DisplacedAndShaded.hlsl run as C++: VS and ConstHS or ConstQuadHS on the control
+// points (TessFactors.h), the fixed-function tessellator (Tessellator.h), DS or QuadDS
+// displacing by the point-sampled texel under the interpolated texture coordinate, and
+// PS on every visible pixel.
+//
+// Draws run VS to DS on several threads, each on a contiguous range of patches. The
+// triangles are clipped against the near and far planes and a guard band, back faces
+// and triangles that cover no pixel center are culled, and the rest is binned into
+// 64x64 pixel tiles. EndFrame works through the tiles on every thread: edge functions in
+// 28.4 fixed point with the top-left rule, evaluated for 4 pixels per SSE2 step, a LESS
+// depth test on z / w and the ID of the nearest triangle per pixel. PS then runs once
+// per covered pixel of the tile with perspective correct attributes and trilinear
+// filtering, the mip level taken from analytic derivatives instead of 2x2 quads. Tiles
+// keep the draws in order, so the frame does not depend on the thread count. With a
+// TessellationCache set, terrain draws take the displaced domain points of the patches
+// whose stabilized factors did not change from the cache and only project them.
+//
+// The frame is meant to be compared with frames of this backend: D3D11 filters with
+// fewer bits, snaps to 8 subpixel bits and picks mips per quad, so a GPU frame differs
+// in the low bits. Only solid fill without blending is drawn, which is all Render uses
+// for the terrain.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "ImageIO.h"
+#include "SceneUpdate.h"
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+class HeightPyramid;
+class TessDensityMap;
+class CpuTessellator;
+class TessellationCache;
+struct TessCacheEntry;
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define SOFTWARE_TILE_SIZE              64
+#define SOFTWARE_SUBPIXEL_BITS          4
+#define SOFTWARE_MAX_VIEWPORT_SIZE      4096
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// The textures and buffers the shaders read
+struct SoftwareTextures
+{
+	const std::vector<Image>* pDiffuseMips = NULL;   // texDiffuse, RGBA
+	const std::vector<Image>* pNormalMips = NULL;    // texNormal, x and y in the first two channels
+	const HeightPyramid* pDisplacement = NULL;       // level 0 is texDisplacement
+	const TessDensityMap* pDensityMap = NULL;        // texDensity, used while ContentDensity is set
+};
+
+// A vertex as DS outputs it
+struct SoftwareVertex
+{
+	float Position[4];                  // clip space
+	float TexCoord[2];
+	float WorldPos[3];                  // LightWS and ViewWS are computed from it
+};
+
+struct SoftwareRenderStats
+{
+	long long Patches;
+	long long Triangles;                // tessellated, or drawn by DrawTriangles
+	long long CachedPatches;            // taken from the TessellationCache without tessellating
+	long long BinnedTriangles;          // after clipping and culling, a clipped triangle may count more than once
+	long long DepthPassedPixels;        // pixels that passed the depth test, overdraw included
+	long long ShadedPixels;
+	double GeometrySeconds;             // of the draws
+	double RasterSeconds;               // of EndFrame, rasterizing and shading
+};
+
+
+//--------------------------------------------------------------------------------------
+// SoftwareRenderer
+//--------------------------------------------------------------------------------------
+class SoftwareRenderer
+{
+public:
+	SoftwareRenderer();
+	~SoftwareRenderer();
+
+	// A render target of width x height RGBA8 pixels with a float depth buffer, up to
+	// SOFTWARE_MAX_VIEWPORT_SIZE on each side. numThreads 0 uses every hardware thread.
+	bool Init(int width, int height, int numThreads = 0);
+
+	void SetTextures(const SoftwareTextures& textures) { m_Textures = textures; }
+
+	// Terrain draws stabilize their factors with the cache and reuse its patches, NULL
+	// tessellates every patch. The cache is keyed to the grid, world scale, displacement
+	// and patch type of each draw.
+	void SetTessellationCache(TessellationCache* pCache) { m_pCache = pCache; }
+
+	// Starts a frame cleared to clearColor and depth 1, with the constants of Render
+	void BeginFrame(const StaticConstants& constants, const float clearColor[4]);
+
+	// Draws the listed grid patches like Render: tri or quad patches with the factors of
+	// the settings and the frame's constants
+	void DrawTerrain(const TerrainGrid& grid, const int* pPatches, int count, const SceneSettings& settings,
+		const SceneFrame& frame);
+
+	// Draws a triangle list of DS outputs, shaded with the frame's constants. Runs on the
+	// calling thread, it is meant for tests and small meshes.
+	void DrawTriangles(const SoftwareVertex* pVertices, const unsigned int* pIndices, int indexCount,
+		const SceneFrame& frame);
+
+	// Rasterizes and shades every tile
+	void EndFrame();
+
+	// The render target after EndFrame, RGBA with the saturated PS output
+	const Image& GetColor() const { return m_Color; }
+	float GetDepth(int x, int y) const { return m_Depth[(size_t)y * m_Stride + x]; }
+
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+	const SoftwareRenderStats& GetStats() const { return m_Stats; }
+
+private:
+	// Triangle set up for rasterization, clockwise on screen
+	struct Triangle
+	{
+		unsigned int Vertices[3];
+		int X[3];                       // 28.4 fixed point pixels
+		int Y[3];
+		float Z0;                       // z / w at the first vertex and its screen space slopes
+		float ZdX;
+		float ZdY;
+		short MinX, MinY, MaxX, MaxY;   // pixels whose centers may be covered
+	};
+
+	// Output of one thread of a draw. Triangle IDs count through the batches of a frame.
+	struct Batch
+	{
+		std::vector<SoftwareVertex> Vertices;
+		std::vector<Triangle> Triangles;
+		std::vector<std::vector<unsigned int> > Bins;
+		float ViewProjection[4][4];
+		FrameConstants Frame;
+		DrawConstants Draw;
+		unsigned int FirstTriangle;
+		long long TessellatedTriangles;
+		long long CachedPatches;
+		CpuTessellator* pTessellator;   // created on the first terrain draw
+		std::vector<float> Domain;      // domain points and their positions and texture coordinates
+	};
+
+	// Control points of a tri or quad patch after VS and its factors after ConstHS or ConstQuadHS
+	struct TerrainPatch
+	{
+		float Positions[4][3];
+		float TexCoords[4][3];
+		float Factors[6];
+		unsigned int Id;                // grid patch, times two plus the half for tri patches
+		unsigned long long EdgeKeys[4]; // TessellationCache::GetEdgeKey of the grid vertices
+		TessCacheEntry* pCacheEntry;
+	};
+
+	Batch& AddBatch(const SceneFrame& frame);
+	void RunTerrainPatches(Batch* pBatch, int begin, int end, bool quads);
+	void AddTriangle(Batch& batch, unsigned int v0, unsigned int v1, unsigned int v2);
+	void SetupTriangle(Batch& batch, const unsigned int vertices[3]);
+	void RenderTiles(long long* pCounters);
+	void RasterizeTriangle(const Triangle& triangle, unsigned int id, int tileX, int tileY, long long& passed);
+	void ShadeTile(int tileX, int tileY, long long& shaded);
+
+	int m_Width = 0;
+	int m_Height = 0;
+	int m_Stride = 0;                   // the buffers cover whole tiles
+	int m_TilesX = 0;
+	int m_TilesY = 0;
+	int m_Threads = 1;
+	SoftwareTextures m_Textures;
+	TessellationCache* m_pCache = NULL;
+	StaticConstants m_Constants;
+	float m_ClearColor[4];
+	Image m_Color;
+	std::vector<float> m_Depth;
+	std::vector<unsigned int> m_TriangleIds;
+	std::vector<Batch*> m_Batches;      // kept across frames for their allocations
+	int m_BatchCount = 0;
+	std::vector<TerrainPatch> m_Patches;
+	std::atomic<int> m_NextTile;
+	SoftwareRenderStats m_Stats;
+};
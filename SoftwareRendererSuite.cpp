@@ -0,0 +1,444 @@
+//--------------------------------------------------------------------------------------
+// File: SoftwareRendererSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "SoftwareRenderer.h"
+#include "HeightPyramid.h"
+#include "NormalMap.h"
+#include "TerrainGrid.h"
+#include "TextureContainer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Software rasterizer. Coverage of random triangles against a reference that applies
+// the top-left rule to every pixel center, a watertight mesh that covers every pixel
+// exactly once, frames that do not depend on the thread count, the tessellated
+// triangles against the counter and a flat terrain against ray casts.
+//--------------------------------------------------------------------------------------
+#define RASTER_TRIANGLES        300
+
+// Subpixel position of a clip space x or y the way SetupTriangle snaps it
+static long long RasterSnap(float value, float w, int size, bool flip)
+{
+	float ndc = value * (1.0f / w) * 0.5f;
+	float pixels = (flip ? 0.5f - ndc : ndc + 0.5f) * size;
+	return (long long)floorf(pixels * (1 << SOFTWARE_SUBPIXEL_BITS) + 0.5f);
+}
+
+// Whether the center of pixel (x, y) is inside the triangle, with the top-left rule
+static bool ReferenceCovers(const long long px[3], const long long py[3], int x, int y)
+{
+	long long sampleX = (long long)x * (1 << SOFTWARE_SUBPIXEL_BITS) + (1 << (SOFTWARE_SUBPIXEL_BITS - 1));
+	long long sampleY = (long long)y * (1 << SOFTWARE_SUBPIXEL_BITS) + (1 << (SOFTWARE_SUBPIXEL_BITS - 1));
+	for (int e = 0; e < 3; e++)
+	{
+		int next = (e + 1) % 3;
+		long long a = py[e] - py[next], b = px[next] - px[e];
+		long long value = a * (sampleX - px[e]) + b * (sampleY - py[e]);
+		bool topLeft = a > 0 || (a == 0 && b > 0);
+		if (value < 0 || (value == 0 && !topLeft))
+			return false;
+	}
+	return true;
+}
+
+void BuildRasterTextures(int size, std::vector<Image>& diffuseMips, std::vector<Image>& normalMips,
+	HeightPyramid& pyramid)
+{
+	Image diffuse, displacement, normal;
+	BuildCompressionImages(size, size, diffuse, displacement, normal);
+	diffuseMips.assign(1, diffuse);
+	while (diffuseMips.back().Width > 1 || diffuseMips.back().Height > 1)
+	{
+		Image next;
+		DownsampleImage(diffuseMips.back(), next);
+		diffuseMips.push_back(next);
+	}
+	DeriveNormalMapMips(displacement, NORMAL_MAP_SLOPE_SCALE, normalMips);
+	pyramid.Build(&displacement.Texels[0], size, size, size, 1);
+}
+
+static void SetupRasterFrame(const SceneCamera& camera, const SceneSettings& settings, float width, float height,
+	SceneCamera& movedCamera, SceneFrame& scene, float projection[4][4], StaticConstants& constants)
+{
+	movedCamera = camera;
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, width / height, 0.01f, 100.0f, projection);
+	UpdateScene(movedCamera, settings, projection, 0.0f, scene);
+	BuildStaticConstants(projection, width, height, constants);
+}
+
+int VerifySoftwareRenderer()
+{
+	SuiteCheck check("raster");
+	static const float s_ClearColor[4] = { 0.0f, 0.125f, 0.3f, 1.0f };
+	SoftwareRenderer renderer;
+	if (!renderer.Init(RASTER_WIDTH, RASTER_HEIGHT, 1) || renderer.Init(SOFTWARE_MAX_VIEWPORT_SIZE + 1, 16))
+	{
+		check.Fail("Init accepts the wrong render target sizes");
+		return check.Finish();
+	}
+	renderer.Init(RASTER_WIDTH, RASTER_HEIGHT, 1);
+	SceneCamera camera, movedCamera;
+	SceneSettings settings;
+	SceneFrame scene;
+	float projection[4][4];
+	StaticConstants constants;
+	SetupRasterFrame(camera, settings, RASTER_WIDTH, RASTER_HEIGHT, movedCamera, scene, projection, constants);
+
+	// Random triangles of both windings, some far larger than the render target, one per
+	// frame. Only clockwise ones are drawn and z / w is planar over them.
+	unsigned int state = 12345u;
+	int coverageErrors = 0, depthErrors = 0;
+	long long covered = 0;
+	for (int t = 0; t < RASTER_TRIANGLES; t++)
+	{
+		float extent = (t % 10 == 0) ? 3.0f : 1.2f;
+		SoftwareVertex vertices[3];
+		memset(vertices, 0, sizeof(vertices));
+		for (int v = 0; v < 3; v++)
+		{
+			vertices[v].Position[0] = RandomFloat(state, -extent, extent);
+			vertices[v].Position[1] = RandomFloat(state, -extent, extent);
+			vertices[v].Position[2] = RandomFloat(state, 0.1f, 0.9f);
+			vertices[v].Position[3] = 1.0f;
+		}
+		// Shared vertices and axis-aligned edges hit the tie cases of the rule
+		if (t % 7 == 3)
+			vertices[1].Position[1] = vertices[0].Position[1];
+		if (t % 7 == 5)
+			vertices[2].Position[0] = vertices[1].Position[0];
+		static const unsigned int s_Indices[3] = { 0, 1, 2 };
+		renderer.BeginFrame(constants, s_ClearColor);
+		renderer.DrawTriangles(vertices, s_Indices, 3, scene);
+		renderer.EndFrame();
+
+		long long px[3], py[3];
+		for (int v = 0; v < 3; v++)
+		{
+			px[v] = RasterSnap(vertices[v].Position[0], 1.0f, RASTER_WIDTH, false);
+			py[v] = RasterSnap(vertices[v].Position[1], 1.0f, RASTER_HEIGHT, true);
+		}
+		long long area = (px[1] - px[0]) * (py[2] - py[0]) - (px[2] - px[0]) * (py[1] - py[0]);
+		double sx[3], sy[3];
+		for (int v = 0; v < 3; v++)
+		{
+			sx[v] = (double)px[v] / (1 << SOFTWARE_SUBPIXEL_BITS);
+			sy[v] = (double)py[v] / (1 << SOFTWARE_SUBPIXEL_BITS);
+		}
+		for (int y = 0; y < RASTER_HEIGHT; y++)
+		{
+			for (int x = 0; x < RASTER_WIDTH; x++)
+			{
+				bool expected = area > 0 && ReferenceCovers(px, py, x, y);
+				float depth = renderer.GetDepth(x, y);
+				if ((depth < 1.0f) != expected)
+				{
+					coverageErrors++;
+					continue;
+				}
+				if (!expected)
+					continue;
+				covered++;
+				double fx = x + 0.5, fy = y + 0.5;
+				double b0 = ((sx[2] - sx[1]) * (fy - sy[1]) - (sy[2] - sy[1]) * (fx - sx[1]));
+				double b1 = ((sx[0] - sx[2]) * (fy - sy[2]) - (sy[0] - sy[2]) * (fx - sx[2]));
+				double total = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+				b0 /= total;
+				b1 /= total;
+				double z = b0 * vertices[0].Position[2] + b1 * vertices[1].Position[2] + (1.0 - b0 - b1) * vertices[2].Position[2];
+				depthErrors += (fabs(z - depth) > 1e-4) ? 1 : 0;
+			}
+		}
+	}
+	check.FailIf(coverageErrors > 0 || depthErrors > 0,
+		"%d pixels covered against the top-left rule, %d with the wrong depth", coverageErrors, depthErrors);
+
+	// A jittered grid mesh, larger than the guard band so its outer triangles are clipped,
+	// drawn nearer with every triangle. Each pixel passes the depth test exactly once.
+	const int cells = 24;
+	const float meshExtent = 80.0f;
+	std::vector<SoftwareVertex> mesh((cells + 1) * (cells + 1));
+	for (int y = 0; y <= cells; y++)
+	{
+		for (int x = 0; x <= cells; x++)
+		{
+			SoftwareVertex& vertex = mesh[y * (cells + 1) + x];
+			memset(&vertex, 0, sizeof(vertex));
+			float jitterX = (x > 0 && x < cells) ? RandomFloat(state, -0.3f, 0.3f) : 0.0f;
+			float jitterY = (y > 0 && y < cells) ? RandomFloat(state, -0.3f, 0.3f) : 0.0f;
+			vertex.Position[0] = ((x + jitterX) / cells * 2.0f - 1.0f) * meshExtent * (x == cells / 2 ? 0.0f : 1.0f);
+			vertex.Position[1] = ((y + jitterY) / cells * 2.0f - 1.0f) * meshExtent;
+			vertex.Position[2] = 0.5f;
+			vertex.Position[3] = 1.0f;
+		}
+	}
+	std::vector<SoftwareVertex> ordered;
+	std::vector<unsigned int> meshIndices;
+	for (int y = 0; y < cells; y++)
+	{
+		for (int x = 0; x < cells; x++)
+		{
+			// Clockwise on screen, where y points down
+			int corners[2][3] =
+			{
+				{ (y + 1) * (cells + 1) + x, (y + 1) * (cells + 1) + x + 1, y * (cells + 1) + x },
+				{ y * (cells + 1) + x, (y + 1) * (cells + 1) + x + 1, y * (cells + 1) + x + 1 },
+			};
+			for (int k = 0; k < 2; k++)
+			{
+				float depth = 0.9f - 0.8f * (float)ordered.size() / (cells * cells * 6);
+				for (int c = 0; c < 3; c++)
+				{
+					SoftwareVertex vertex = mesh[corners[k][c]];
+					vertex.Position[2] = depth;
+					meshIndices.push_back((unsigned int)ordered.size());
+					ordered.push_back(vertex);
+				}
+			}
+		}
+	}
+	renderer.BeginFrame(constants, s_ClearColor);
+	renderer.DrawTriangles(&ordered[0], &meshIndices[0], (int)meshIndices.size(), scene);
+	renderer.EndFrame();
+	long long passed = renderer.GetStats().DepthPassedPixels;
+	int uncovered = 0;
+	for (int y = 0; y < RASTER_HEIGHT; y++)
+	{
+		for (int x = 0; x < RASTER_WIDTH; x++)
+			uncovered += (renderer.GetDepth(x, y) < 1.0f) ? 0 : 1;
+	}
+	check.FailIf(passed != (long long)RASTER_WIDTH * RASTER_HEIGHT || uncovered > 0,
+		"the mesh passes the depth test %lld times with %d pixels uncovered, expected %d", passed, uncovered,
+		RASTER_WIDTH * RASTER_HEIGHT);
+
+	// A screen-filling quad crossing the near plane keeps the part in front of it
+	SoftwareVertex quad[4];
+	memset(quad, 0, sizeof(quad));
+	static const float s_QuadCorners[4][2] = { { -1.5f, 1.5f }, { 1.5f, 1.5f }, { 1.5f, -1.5f }, { -1.5f, -1.5f } };
+	for (int v = 0; v < 4; v++)
+	{
+		quad[v].Position[0] = s_QuadCorners[v][0];
+		quad[v].Position[1] = s_QuadCorners[v][1];
+		quad[v].Position[2] = s_QuadCorners[v][0] * 0.5f;
+		quad[v].Position[3] = 1.0f;
+	}
+	static const unsigned int s_QuadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+	renderer.BeginFrame(constants, s_ClearColor);
+	renderer.DrawTriangles(quad, s_QuadIndices, 6, scene);
+	renderer.EndFrame();
+	int clipErrors = 0;
+	for (int y = 0; y < RASTER_HEIGHT; y++)
+	{
+		for (int x = 0; x < RASTER_WIDTH; x++)
+		{
+			float z = ((x + 0.5f) / RASTER_WIDTH * 2.0f - 1.0f) * 0.5f;
+			bool drawn = renderer.GetDepth(x, y) < 1.0f;
+			if ((z > 0.01f && !drawn) || (z < -0.01f && drawn))
+				clipErrors++;
+		}
+	}
+	check.FailIf(clipErrors > 0, "%d pixels on the wrong side of the near plane", clipErrors);
+
+	// The terrain on one and three threads, identical to the byte, and the tessellated
+	// triangles the counter predicts
+	std::vector<Image> diffuseMips, normalMips;
+	HeightPyramid pyramid;
+	BuildRasterTextures(RASTER_TEXTURE_SIZE, diffuseMips, normalMips, pyramid);
+	SoftwareTextures textures;
+	textures.pDiffuseMips = &diffuseMips;
+	textures.pNormalMips = &normalMips;
+	textures.pDisplacement = &pyramid;
+	TerrainGrid grid;
+	grid.Build(8, 8);
+	std::vector<int> patchList(grid.GetPatchCount());
+	for (int i = 0; i < grid.GetPatchCount(); i++)
+		patchList[i] = i;
+	SoftwareRenderer threaded;
+	threaded.Init(RASTER_WIDTH, RASTER_HEIGHT, 3);
+	renderer.SetTextures(textures);
+	threaded.SetTextures(textures);
+	TerrainTriangleCounter counter;
+	for (int mode = 0; mode < 4; mode++)
+	{
+		SceneSettings terrainSettings;
+		terrainSettings.TessellationFactor = 16.0f;
+		terrainSettings.QuadPatches = (mode & 1) != 0;
+		terrainSettings.AdaptiveTessellation = (mode & 2) != 0;
+		SetupRasterFrame(camera, terrainSettings, RASTER_WIDTH, RASTER_HEIGHT, movedCamera, scene, projection, constants);
+		SoftwareRenderer* pRenderers[2] = { &renderer, &threaded };
+		for (int r = 0; r < 2; r++)
+		{
+			pRenderers[r]->BeginFrame(constants, s_ClearColor);
+			pRenderers[r]->DrawTerrain(grid, &patchList[0], (int)patchList.size(), terrainSettings, scene);
+			pRenderers[r]->EndFrame();
+		}
+		bool same = renderer.GetColor().Texels == threaded.GetColor().Texels;
+		for (int y = 0; y < RASTER_HEIGHT && same; y++)
+		{
+			for (int x = 0; x < RASTER_WIDTH && same; x++)
+				same = renderer.GetDepth(x, y) == threaded.GetDepth(x, y);
+		}
+		long long counted = counter.Count(grid, &patchList[0], (int)patchList.size(), movedCamera, terrainSettings, scene,
+			projection[1][1], RASTER_HEIGHT);
+		const SoftwareRenderStats& stats = renderer.GetStats();
+		check.FailIf(!same || stats.Triangles != counted || threaded.GetStats().Triangles != counted || stats.ShadedPixels == 0,
+			"%s %s terrain, %lld and %lld triangles drawn, %lld counted, %lld pixels shaded, the threaded frame %s",
+			terrainSettings.QuadPatches ? "quad" : "tri", terrainSettings.AdaptiveTessellation ? "adaptive" : "uniform",
+			stats.Triangles, threaded.GetStats().Triangles, counted, stats.ShadedPixels, same ? "matches" : "differs");
+	}
+
+	// A flat terrain with constant textures against a ray cast through every pixel center
+	Image constantDiffuse, constantNormal, constantHeight;
+	constantDiffuse.Width = constantDiffuse.Height = constantNormal.Width = constantNormal.Height = 4;
+	constantHeight.Width = constantHeight.Height = 4;
+	constantDiffuse.Channels = constantNormal.Channels = 4;
+	constantHeight.Channels = 1;
+	static const unsigned char s_Diffuse[4] = { 180, 140, 90, 255 };
+	static const unsigned char s_Normal[4] = { 128, 128, 255, 255 };
+	for (int i = 0; i < 16; i++)
+	{
+		constantDiffuse.Texels.insert(constantDiffuse.Texels.end(), s_Diffuse, s_Diffuse + 4);
+		constantNormal.Texels.insert(constantNormal.Texels.end(), s_Normal, s_Normal + 4);
+	}
+	constantHeight.Texels.assign(16, 200);
+	std::vector<Image> flatDiffuse(1, constantDiffuse), flatNormal(1, constantNormal);
+	HeightPyramid flatPyramid;
+	flatPyramid.Build(&constantHeight.Texels[0], 4, 4, 4, 1);
+	textures.pDiffuseMips = &flatDiffuse;
+	textures.pNormalMips = &flatNormal;
+	textures.pDisplacement = &flatPyramid;
+	renderer.SetTextures(textures);
+	SceneSettings flatSettings;
+	flatSettings.TessellationFactor = 5.0f;
+	flatSettings.DisplacementLevel = 0.0f;
+	SetupRasterFrame(camera, flatSettings, RASTER_WIDTH, RASTER_HEIGHT, movedCamera, scene, projection, constants);
+	renderer.BeginFrame(constants, s_ClearColor);
+	renderer.DrawTerrain(grid, &patchList[0], (int)patchList.size(), flatSettings, scene);
+	renderer.EndFrame();
+
+	int flatErrors = 0, checked = 0;
+	const float margin = 0.05f;
+	for (int y = 0; y < RASTER_HEIGHT; y++)
+	{
+		for (int x = 0; x < RASTER_WIDTH; x++)
+		{
+			// The ray through the pixel center in view space, then in world space with the
+			// columns of the view matrix
+			double ndcX = (x + 0.5) / RASTER_WIDTH * 2.0 - 1.0, ndcY = 1.0 - (y + 0.5) / RASTER_HEIGHT * 2.0;
+			double ray[3] = { ndcX / projection[0][0], ndcY / projection[1][1], 1.0 };
+			double direction[3];
+			for (int c = 0; c < 3; c++)
+				direction[c] = ray[0] * scene.View[c][0] + ray[1] * scene.View[c][1] + ray[2] * scene.View[c][2];
+			double distance = (direction[1] < 0.0) ? -movedCamera.Eye[1] / direction[1] : -1.0;
+			double hit[3];
+			for (int c = 0; c < 3; c++)
+				hit[c] = movedCamera.Eye[c] + distance * direction[c];
+			bool inside = distance > 0.0 && fabs(hit[0]) < scene.WorldScale[0] - margin && fabs(hit[2]) < scene.WorldScale[2] - margin;
+			bool outside = distance <= 0.0 || fabs(hit[0]) > scene.WorldScale[0] + margin || fabs(hit[2]) > scene.WorldScale[2] + margin;
+			float depth = renderer.GetDepth(x, y);
+			const unsigned char* pColor = &renderer.GetColor().Texels[((size_t)y * RASTER_WIDTH + x) * 4];
+			if (outside)
+			{
+				flatErrors += (depth < 1.0f || pColor[2] != 77) ? 1 : 0;
+				continue;
+			}
+			if (!inside)
+				continue;
+			checked++;
+			double viewDepth = projection[3][2] / (depth - projection[2][2]);
+			if (depth >= 1.0f || fabs(viewDepth - distance) > 1e-3 * distance)
+			{
+				flatErrors++;
+				continue;
+			}
+
+			// PS with the normal straight up
+			double light[3], view[3];
+			for (int c = 0; c < 3; c++)
+			{
+				light[c] = constants.LightPos[c] - hit[c];
+				view[c] = movedCamera.Eye[c] - hit[c];
+			}
+			double lightLength = sqrt(light[0] * light[0] + light[1] * light[1] + light[2] * light[2]);
+			double viewLength = sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+			double diffuse = std::min(std::max(light[1] / lightLength, 0.0), 1.0);
+			double reflected[3] = { -light[0] / lightLength, light[1] / lightLength, -light[2] / lightLength };
+			double reflectedDotView = (reflected[0] * view[0] + reflected[1] * view[1] + reflected[2] * view[2]) / viewLength;
+			double specular = pow(std::min(std::max(reflectedDotView, 0.0), 1.0), 20.0);
+			for (int c = 0; c < 3; c++)
+			{
+				double expected = std::min(std::max((0.1 + diffuse) * s_Diffuse[c] / 255.0 + specular, 0.0), 1.0) * 255.0;
+				if (fabs(expected - pColor[c]) > 2.0)
+				{
+					flatErrors++;
+					break;
+				}
+			}
+		}
+	}
+	check.FailIf(flatErrors > 0 || checked == 0, "%d of %d pixels of the flat terrain differ from the ray cast",
+		flatErrors, checked);
+
+	return check.Finish("%d triangles covering %lld pixels, %d flat terrain pixels", RASTER_TRIANGLES, covered,
+		checked);
+}
+
+void RunSoftwareRendererSuite(const BenchmarkOptions& options)
+{
+	const int width = 1600, height = 900;
+	static const float s_ClearColor[4] = { 0.0f, 0.125f, 0.3f, 1.0f };
+	std::vector<Image> diffuseMips, normalMips;
+	HeightPyramid pyramid;
+	BuildRasterTextures(1024, diffuseMips, normalMips, pyramid);
+	SoftwareTextures textures;
+	textures.pDiffuseMips = &diffuseMips;
+	textures.pNormalMips = &normalMips;
+	textures.pDisplacement = &pyramid;
+	SoftwareRenderer renderer;
+	renderer.Init(width, height);
+	renderer.SetTextures(textures);
+	TerrainGrid grid;
+	grid.Build(8, 8);
+	std::vector<int> patchList(grid.GetPatchCount());
+	for (int i = 0; i < grid.GetPatchCount(); i++)
+		patchList[i] = i;
+
+	const int frames = 3;
+	for (int mode = 0; mode < 4; mode++)
+	{
+		SceneSettings settings;
+		settings.TessellationFactor = options.Factor > 0.0f ? options.Factor : 64.0f;
+		settings.QuadPatches = (mode & 1) != 0;
+		settings.AdaptiveTessellation = (mode & 2) != 0;
+		SceneCamera camera, movedCamera;
+		SceneFrame scene;
+		float projection[4][4];
+		StaticConstants constants;
+		SetupRasterFrame(camera, settings, (float)width, (float)height, movedCamera, scene, projection, constants);
+		double geometrySeconds = 0.0, rasterSeconds = 0.0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			renderer.BeginFrame(constants, s_ClearColor);
+			renderer.DrawTerrain(grid, &patchList[0], (int)patchList.size(), settings, scene);
+			renderer.EndFrame();
+			geometrySeconds += renderer.GetStats().GeometrySeconds;
+			rasterSeconds += renderer.GetStats().RasterSeconds;
+		}
+		const SoftwareRenderStats& stats = renderer.GetStats();
+		printf("raster %dx%d %s %-8s factor %2.0f  geometry %8.2f ms  raster + shade %8.2f ms  %9lld triangles  "
+			"%9lld binned  %8lld depth passes  %8lld shaded\n", width, height, settings.QuadPatches ? "quad" : "tri ",
+			settings.AdaptiveTessellation ? "adaptive" : "uniform", settings.TessellationFactor, geometrySeconds / frames * 1000.0,
+			rasterSeconds / frames * 1000.0, stats.Triangles, stats.BinnedTriangles, stats.DepthPassedPixels, stats.ShadedPixels);
+		if (mode == 0 && options.Image)
+		{
+			if (SaveImageFile(options.Image, renderer.GetColor()))
+				printf("raster: wrote %s\n", options.Image);
+			else
+				printf("raster: cannot write %s\n", options.Image);
+		}
+	}
+}
@@ -0,0 +1,125 @@
+//--------------------------------------------------------------------------------------
+// File: StateTracker.cpp
+//--------------------------------------------------------------------------------------
+#include "StateTracker.h"
+#include <stddef.h>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Address no bindable object can have, marks slots whose content is not known
+static char s_UnknownObject;
+#define STATE_TRACKER_UNKNOWN   ((void*)&s_UnknownObject)
+
+
+//--------------------------------------------------------------------------------------
+// StateBindCounters
+//--------------------------------------------------------------------------------------
+StateBindCounters::StateBindCounters()
+{
+	for (int bind = 0; bind < STATE_BIND_COUNT; bind++)
+	{
+		Issued[bind] = 0;
+		Filtered[bind] = 0;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// StateTracker
+//--------------------------------------------------------------------------------------
+StateTracker::StateTracker(StateBackend* pBackend)
+	: m_pBackend(pBackend)
+{
+	Invalidate();
+}
+
+void StateTracker::Invalidate()
+{
+	for (int stage = 0; stage < SHADER_STAGE_COUNT; stage++)
+	{
+		m_Shaders[stage] = STATE_TRACKER_UNKNOWN;
+		for (int slot = 0; slot < STATE_TRACKER_CONSTANT_BUFFER_SLOTS; slot++)
+			m_ConstantBuffers[stage][slot] = STATE_TRACKER_UNKNOWN;
+		for (int slot = 0; slot < STATE_TRACKER_SHADER_RESOURCE_SLOTS; slot++)
+			m_ShaderResources[stage][slot] = STATE_TRACKER_UNKNOWN;
+		for (int slot = 0; slot < STATE_TRACKER_SAMPLER_SLOTS; slot++)
+			m_Samplers[stage][slot] = STATE_TRACKER_UNKNOWN;
+	}
+}
+
+void StateTracker::BeginFrame()
+{
+	m_LastFrameCounters = m_Counters;
+	m_Counters = StateBindCounters();
+}
+
+void StateTracker::SetShader(SHADER_STAGE stage, void* pShader)
+{
+	if (m_Shaders[stage] == pShader)
+	{
+		m_Counters.Filtered[STATE_BIND_SHADER]++;
+		return;
+	}
+	m_Shaders[stage] = pShader;
+	m_Counters.Issued[STATE_BIND_SHADER]++;
+	m_pBackend->SetShader(stage, pShader);
+}
+
+void StateTracker::SetConstantBuffers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppBuffers)
+{
+	if (FilterRange(STATE_BIND_CONSTANT_BUFFERS, m_ConstantBuffers[stage], STATE_TRACKER_CONSTANT_BUFFER_SLOTS, startSlot, count, ppBuffers))
+		m_pBackend->SetConstantBuffers(stage, startSlot, count, ppBuffers);
+}
+
+void StateTracker::SetShaderResources(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppViews)
+{
+	if (FilterRange(STATE_BIND_SHADER_RESOURCES, m_ShaderResources[stage], STATE_TRACKER_SHADER_RESOURCE_SLOTS, startSlot, count, ppViews))
+		m_pBackend->SetShaderResources(stage, startSlot, count, ppViews);
+}
+
+void StateTracker::SetSamplers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppSamplers)
+{
+	if (FilterRange(STATE_BIND_SAMPLERS, m_Samplers[stage], STATE_TRACKER_SAMPLER_SLOTS, startSlot, count, ppSamplers))
+		m_pBackend->SetSamplers(stage, startSlot, count, ppSamplers);
+}
+
+// Records the new slot contents and narrows the call to the changed slots. Returns false
+// if nothing changed. Calls reaching past the tracked slots are issued unchanged.
+bool StateTracker::FilterRange(STATE_BIND bind, void** pBound, unsigned int slotCount, unsigned int& startSlot, unsigned int& count,
+	void* const*& ppObjects)
+{
+	if (count == 0)
+		return false;
+
+	if (startSlot >= slotCount || count > slotCount - startSlot)
+	{
+		for (unsigned int i = 0; startSlot + i < slotCount && i < count; i++)
+			pBound[startSlot + i] = ppObjects[i];
+		m_Counters.Issued[bind]++;
+		return true;
+	}
+
+	unsigned int first = count, last = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (pBound[startSlot + i] == ppObjects[i])
+			continue;
+		pBound[startSlot + i] = ppObjects[i];
+		if (first == count)
+			first = i;
+		last = i;
+	}
+	if (first == count)
+	{
+		m_Counters.Filtered[bind]++;
+		return false;
+	}
+
+	startSlot += first;
+	ppObjects += first;
+	count = last - first + 1;
+	m_Counters.Issued[bind]++;
+	return true;
+}
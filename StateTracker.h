@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+// File: StateTracker.h
+//
+// Filters redundant shader, constant buffer, shader resource and sampler binds before
+// they reach the device context. The tracker remembers what every tracked slot holds
+// and only forwards the slots that change, counting issued and filtered calls per
+// frame.
+//
+// Binds go to a StateBackend, D3DStateBackend in the demo and a recording mock in the
+// headless benchmark. Objects are compared by address and not referenced, so after a
+// bound object is released (and its address may be reused) Invalidate has to be called.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT and ..._SAMPLER_SLOT_COUNT. Only the
+// first shader resource slots are tracked, binds beyond them are always issued.
+#define STATE_TRACKER_CONSTANT_BUFFER_SLOTS     14
+#define STATE_TRACKER_SHADER_RESOURCE_SLOTS     32
+#define STATE_TRACKER_SAMPLER_SLOTS             16
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum SHADER_STAGE
+{
+	SHADER_STAGE_VERTEX,
+	SHADER_STAGE_HULL,
+	SHADER_STAGE_DOMAIN,
+	SHADER_STAGE_PIXEL,
+	SHADER_STAGE_COUNT,
+};
+
+enum STATE_BIND
+{
+	STATE_BIND_SHADER,
+	STATE_BIND_CONSTANT_BUFFERS,
+	STATE_BIND_SHADER_RESOURCES,
+	STATE_BIND_SAMPLERS,
+	STATE_BIND_COUNT,
+};
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Calls per bind type. A call with some changed slots is issued for just the range
+// from the first to the last changed slot.
+struct StateBindCounters
+{
+	StateBindCounters();
+
+	int Issued[STATE_BIND_COUNT];
+	int Filtered[STATE_BIND_COUNT];
+};
+
+
+//--------------------------------------------------------------------------------------
+// StateBackend
+//--------------------------------------------------------------------------------------
+class StateBackend
+{
+public:
+	virtual ~StateBackend() {}
+
+	virtual void SetShader(SHADER_STAGE stage, void* pShader) = 0;
+	virtual void SetConstantBuffers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppBuffers) = 0;
+	virtual void SetShaderResources(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppViews) = 0;
+	virtual void SetSamplers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppSamplers) = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// StateTracker
+//--------------------------------------------------------------------------------------
+class StateTracker
+{
+public:
+	// Nothing is assumed about the backend's state, the first bind of every slot is issued
+	StateTracker(StateBackend* pBackend);
+
+	void SetShader(SHADER_STAGE stage, void* pShader);
+	void SetConstantBuffers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppBuffers);
+	void SetShaderResources(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppViews);
+	void SetSamplers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppSamplers);
+
+	// Single slot versions
+	void SetConstantBuffer(SHADER_STAGE stage, unsigned int slot, void* pBuffer) { SetConstantBuffers(stage, slot, 1, &pBuffer); }
+	void SetShaderResource(SHADER_STAGE stage, unsigned int slot, void* pView) { SetShaderResources(stage, slot, 1, &pView); }
+	void SetSampler(SHADER_STAGE stage, unsigned int slot, void* pSampler) { SetSamplers(stage, slot, 1, &pSampler); }
+
+	// Forgets every slot, for when the backend state was changed behind the tracker or a
+	// bound object was released
+	void Invalidate();
+
+	// Starts counting a new frame, the counters of the finished one stay available
+	void BeginFrame();
+	const StateBindCounters& GetFrameCounters() const { return m_Counters; }
+	const StateBindCounters& GetLastFrameCounters() const { return m_LastFrameCounters; }
+
+private:
+	bool FilterRange(STATE_BIND bind, void** pBound, unsigned int slotCount, unsigned int& startSlot, unsigned int& count,
+		void* const*& ppObjects);
+
+	StateBackend* m_pBackend;
+	void* m_Shaders[SHADER_STAGE_COUNT];
+	void* m_ConstantBuffers[SHADER_STAGE_COUNT][STATE_TRACKER_CONSTANT_BUFFER_SLOTS];
+	void* m_ShaderResources[SHADER_STAGE_COUNT][STATE_TRACKER_SHADER_RESOURCE_SLOTS];
+	void* m_Samplers[SHADER_STAGE_COUNT][STATE_TRACKER_SAMPLER_SLOTS];
+	StateBindCounters m_Counters;
+	StateBindCounters m_LastFrameCounters;
+};
@@ -0,0 +1,206 @@
+//--------------------------------------------------------------------------------------
+// File: StateTrackerSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "StateTracker.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// State tracking. The recording backend applies every call to its own copy of the
+// bindings, which start out as a value no bind can produce, and counts the calls that
+// did not change any tracked slot.
+//--------------------------------------------------------------------------------------
+#define RECORDING_BACKEND_SLOTS 128
+
+class RecordingStateBackend : public StateBackend
+{
+public:
+	RecordingStateBackend() : m_CallCount(0), m_RedundantCount(0), m_LastStartSlot(0), m_LastCount(0)
+	{
+		for (int bind = 0; bind < STATE_BIND_COUNT; bind++)
+		{
+			for (int stage = 0; stage < SHADER_STAGE_COUNT; stage++)
+				m_Bound[bind][stage].assign(RECORDING_BACKEND_SLOTS, (void*)&m_Bound);
+		}
+	}
+
+	virtual void SetShader(SHADER_STAGE stage, void* pShader) { Record(STATE_BIND_SHADER, stage, 0, 1, &pShader); }
+	virtual void SetConstantBuffers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppBuffers)
+	{
+		Record(STATE_BIND_CONSTANT_BUFFERS, stage, startSlot, count, ppBuffers);
+	}
+	virtual void SetShaderResources(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppViews)
+	{
+		Record(STATE_BIND_SHADER_RESOURCES, stage, startSlot, count, ppViews);
+	}
+	virtual void SetSamplers(SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppSamplers)
+	{
+		Record(STATE_BIND_SAMPLERS, stage, startSlot, count, ppSamplers);
+	}
+
+	const std::vector<void*>& GetBound(STATE_BIND bind, SHADER_STAGE stage) const { return m_Bound[bind][stage]; }
+	int GetCallCount() const { return m_CallCount; }
+	int GetRedundantCount() const { return m_RedundantCount; }
+	unsigned int GetLastStartSlot() const { return m_LastStartSlot; }
+	unsigned int GetLastCount() const { return m_LastCount; }
+
+private:
+	void Record(STATE_BIND bind, SHADER_STAGE stage, unsigned int startSlot, unsigned int count, void* const* ppObjects)
+	{
+		bool changed = false;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			changed = changed || m_Bound[bind][stage][startSlot + i] != ppObjects[i];
+			m_Bound[bind][stage][startSlot + i] = ppObjects[i];
+		}
+		m_CallCount++;
+		m_RedundantCount += changed ? 0 : 1;
+		m_LastStartSlot = startSlot;
+		m_LastCount = count;
+	}
+
+	std::vector<void*> m_Bound[STATE_BIND_COUNT][SHADER_STAGE_COUNT];
+	int m_CallCount;
+	int m_RedundantCount;
+	unsigned int m_LastStartSlot;
+	unsigned int m_LastCount;
+};
+
+static int s_StateObjects[8];
+
+// The binds of one frame of the demo
+static void BindDemoFrame(StateTracker& tracker, bool wireFrame)
+{
+	void* constants[3] = { &s_StateObjects[0], &s_StateObjects[1], &s_StateObjects[2] };
+	tracker.BeginFrame();
+	tracker.SetShader(SHADER_STAGE_VERTEX, &s_StateObjects[1]);
+	tracker.SetConstantBuffers(SHADER_STAGE_VERTEX, 0, 3, constants);
+	tracker.SetShader(SHADER_STAGE_HULL, &s_StateObjects[2]);
+	tracker.SetConstantBuffers(SHADER_STAGE_HULL, 0, 3, constants);
+	tracker.SetShader(SHADER_STAGE_DOMAIN, &s_StateObjects[3]);
+	tracker.SetConstantBuffers(SHADER_STAGE_DOMAIN, 0, 3, constants);
+	tracker.SetShaderResource(SHADER_STAGE_DOMAIN, 1, &s_StateObjects[4]);
+	tracker.SetSampler(SHADER_STAGE_DOMAIN, 0, &s_StateObjects[5]);
+	if (!wireFrame)
+	{
+		tracker.SetShader(SHADER_STAGE_PIXEL, &s_StateObjects[6]);
+		tracker.SetConstantBuffers(SHADER_STAGE_PIXEL, 0, 3, constants);
+		tracker.SetShaderResource(SHADER_STAGE_PIXEL, 0, &s_StateObjects[4]);
+		tracker.SetShaderResource(SHADER_STAGE_PIXEL, 2, &s_StateObjects[5]);
+		tracker.SetSampler(SHADER_STAGE_PIXEL, 1, &s_StateObjects[6]);
+	}
+	else
+	{
+		tracker.SetShader(SHADER_STAGE_PIXEL, &s_StateObjects[7]);
+	}
+}
+
+static int CountCalls(const int calls[STATE_BIND_COUNT])
+{
+	int total = 0;
+	for (int bind = 0; bind < STATE_BIND_COUNT; bind++)
+		total += calls[bind];
+	return total;
+}
+
+int VerifyStateTracker()
+{
+	SuiteCheck check("state");
+
+	// Only the first frame of an unchanged scene reaches the backend
+	RecordingStateBackend backend;
+	StateTracker tracker(&backend);
+	BindDemoFrame(tracker, false);
+	BindDemoFrame(tracker, false);
+	BindDemoFrame(tracker, false);
+	tracker.BeginFrame();
+	const StateBindCounters& counters = tracker.GetLastFrameCounters();
+	check.FailIf(backend.GetCallCount() != 13 || CountCalls(counters.Issued) != 0 ||
+		CountCalls(counters.Filtered) != 13, "unchanged frames issued %d calls", backend.GetCallCount() - 13);
+
+	// Switching to wireframe rebinds the pixel shader only, Invalidate rebinds everything
+	BindDemoFrame(tracker, true);
+	tracker.BeginFrame();
+	check.FailIf(backend.GetCallCount() != 14 || tracker.GetLastFrameCounters().Issued[STATE_BIND_SHADER] != 1,
+		"wireframe switch issued %d calls", backend.GetCallCount() - 13);
+	tracker.Invalidate();
+	BindDemoFrame(tracker, true);
+	check.FailIf(backend.GetCallCount() != 23 || backend.GetRedundantCount() != 9, "invalidated frame issued %d calls",
+		backend.GetCallCount() - 14);
+
+	// A range bind is narrowed to the slots that changed
+	void* views[4] = { &s_StateObjects[0], &s_StateObjects[1], &s_StateObjects[2], &s_StateObjects[3] };
+	tracker.SetShaderResources(SHADER_STAGE_HULL, 4, 4, views);
+	views[1] = &s_StateObjects[4];
+	views[2] = NULL;
+	tracker.SetShaderResources(SHADER_STAGE_HULL, 4, 4, views);
+	check.FailIf(backend.GetLastStartSlot() != 5 || backend.GetLastCount() != 2 ||
+		backend.GetBound(STATE_BIND_SHADER_RESOURCES, SHADER_STAGE_HULL)[6] != NULL,
+		"range bind was issued for slots %u to %u", backend.GetLastStartSlot(),
+		backend.GetLastStartSlot() + backend.GetLastCount() - 1);
+
+	// Random binds leave the backend with exactly the requested bindings and never issue a
+	// call that changes nothing, except for resource slots past the tracked ones
+	RecordingStateBackend randomBackend;
+	StateTracker randomTracker(&randomBackend);
+	std::vector<void*> expected[STATE_BIND_COUNT][SHADER_STAGE_COUNT];
+	for (int bind = 0; bind < STATE_BIND_COUNT; bind++)
+	{
+		for (int stage = 0; stage < SHADER_STAGE_COUNT; stage++)
+			expected[bind][stage] = randomBackend.GetBound((STATE_BIND)bind, (SHADER_STAGE)stage);
+	}
+	static const unsigned int s_SlotCounts[STATE_BIND_COUNT] = { 1, STATE_TRACKER_CONSTANT_BUFFER_SLOTS, 48, STATE_TRACKER_SAMPLER_SLOTS };
+	unsigned int seed = 99;
+	int untrackedCalls = 0, mismatches = 0;
+	for (int i = 0; i < 50000; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		STATE_BIND bind = (STATE_BIND)((seed >> 8) % STATE_BIND_COUNT);
+		SHADER_STAGE stage = (SHADER_STAGE)((seed >> 12) % SHADER_STAGE_COUNT);
+		unsigned int count = (bind == STATE_BIND_SHADER) ? 1 : 1 + (seed >> 16) % 4;
+		unsigned int startSlot = (bind == STATE_BIND_SHADER) ? 0 : (seed >> 20) % (s_SlotCounts[bind] - count + 1);
+		void* objects[4];
+		for (unsigned int o = 0; o < count; o++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			int index = (int)((seed >> 16) % 4);
+			objects[o] = (index == 3) ? NULL : (void*)&s_StateObjects[index];
+			expected[bind][stage][startSlot + o] = objects[o];
+		}
+		if (bind == STATE_BIND_SHADER_RESOURCES && startSlot + count > STATE_TRACKER_SHADER_RESOURCE_SLOTS)
+			untrackedCalls++;
+
+		switch (bind)
+		{
+		case STATE_BIND_SHADER: randomTracker.SetShader(stage, objects[0]); break;
+		case STATE_BIND_CONSTANT_BUFFERS: randomTracker.SetConstantBuffers(stage, startSlot, count, objects); break;
+		case STATE_BIND_SHADER_RESOURCES: randomTracker.SetShaderResources(stage, startSlot, count, objects); break;
+		default: randomTracker.SetSamplers(stage, startSlot, count, objects); break;
+		}
+		mismatches += (randomBackend.GetBound(bind, stage) == expected[bind][stage]) ? 0 : 1;
+	}
+	const StateBindCounters& randomCounters = randomTracker.GetFrameCounters();
+	check.FailIf(mismatches != 0 || randomBackend.GetRedundantCount() > untrackedCalls ||
+		CountCalls(randomCounters.Issued) != randomBackend.GetCallCount() ||
+		CountCalls(randomCounters.Issued) + CountCalls(randomCounters.Filtered) != 50000,
+		"random binds, %d mismatches, %d redundant calls", mismatches, randomBackend.GetRedundantCount());
+
+	return check.Finish("%d random binds, %d issued", 50000, randomBackend.GetCallCount());
+}
+
+void RunStateTrackerThroughput()
+{
+	// Cost of filtering the demo's frame when nothing changes
+	RecordingStateBackend backend;
+	StateTracker tracker(&backend);
+	const int frames = 1000000;
+	double start = GetTimeSeconds();
+	for (int frame = 0; frame < frames; frame++)
+		BindDemoFrame(tracker, false);
+	double seconds = GetTimeSeconds() - start;
+	printf("state filtered frame %8.1f ns per bind  (%d of %d binds issued)\n", seconds * 1e9 / (frames * 13.0),
+		backend.GetCallCount(), frames * 13);
+}
@@ -0,0 +1,180 @@
+//--------------------------------------------------------------------------------------
+// File: TaskGraph.cpp
+//--------------------------------------------------------------------------------------
+#include "TaskGraph.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// TaskGraph
+//--------------------------------------------------------------------------------------
+TaskId TaskGraph::AddTask(const char* pName, const std::function<bool()>& function, const std::vector<TaskId>& dependencies)
+{
+	TaskId id = (TaskId)m_Tasks.size();
+	m_Tasks.push_back(Task());
+	Task& task = m_Tasks.back();
+	task.Name = pName;
+	task.Function = function;
+	for (size_t i = 0; i < dependencies.size(); i++)
+	{
+		if (dependencies[i] < 0 || dependencies[i] >= id)
+			continue;
+		task.Dependencies.push_back(dependencies[i]);
+		m_Tasks[dependencies[i]].Dependents.push_back(id);
+	}
+	return id;
+}
+
+bool TaskGraph::Run(int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	m_Ready.clear();
+	m_CompletedCount = 0;
+	for (size_t t = 0; t < m_Tasks.size(); t++)
+	{
+		Task& task = m_Tasks[t];
+		task.Status = TASK_STATUS_PENDING;
+		task.Timing = TaskTiming();
+		task.PendingDependencies = (int)task.Dependencies.size();
+		task.DependencyFailed = false;
+		if (task.PendingDependencies == 0)
+			m_Ready.push_back((TaskId)t);
+	}
+
+	// No point in more threads than tasks
+	numThreads = std::min(numThreads, std::max(1, (int)m_Tasks.size()));
+	m_RunStart = GetTimeSeconds();
+	std::vector<std::thread> workers;
+	for (int t = 1; t < numThreads; t++)
+		workers.push_back(std::thread(&TaskGraph::WorkerLoop, this, t));
+	WorkerLoop(0);
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	m_RunSeconds = GetTimeSeconds() - m_RunStart;
+
+	for (size_t t = 0; t < m_Tasks.size(); t++)
+	{
+		if (m_Tasks[t].Status != TASK_STATUS_SUCCEEDED)
+			return false;
+	}
+	return true;
+}
+
+void TaskGraph::WorkerLoop(int thread)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	for (;;)
+	{
+		while (m_Ready.empty() && m_CompletedCount < (int)m_Tasks.size())
+			m_Condition.wait(lock);
+		if (m_Ready.empty())
+			return;
+
+		TaskId id = m_Ready.front();
+		m_Ready.pop_front();
+
+		// m_Tasks is not resized during a run, so the task stays valid without the lock
+		Task& task = m_Tasks[id];
+		lock.unlock();
+		double start = GetTimeSeconds();
+		bool succeeded = task.Function();
+		double end = GetTimeSeconds();
+		lock.lock();
+
+		task.Timing.StartSeconds = start - m_RunStart;
+		task.Timing.EndSeconds = end - m_RunStart;
+		task.Timing.Thread = thread;
+		task.Status = succeeded ? TASK_STATUS_SUCCEEDED : TASK_STATUS_FAILED;
+		CompleteTask(id, succeeded);
+		m_Condition.notify_all();
+	}
+}
+
+// Called with the lock held. Dependents whose last dependency completed become ready,
+// or are skipped right away if any dependency did not succeed. They go ahead of the
+// tasks that were ready from the start so a chain of loads keeps moving.
+void TaskGraph::CompleteTask(TaskId id, bool succeeded)
+{
+	m_CompletedCount++;
+	const std::vector<TaskId>& dependents = m_Tasks[id].Dependents;
+	for (size_t i = dependents.size(); i-- > 0;)
+	{
+		Task& dependent = m_Tasks[dependents[i]];
+		if (!succeeded)
+			dependent.DependencyFailed = true;
+		if (--dependent.PendingDependencies > 0)
+			continue;
+
+		if (dependent.DependencyFailed)
+		{
+			dependent.Status = TASK_STATUS_SKIPPED;
+			CompleteTask(dependents[i], false);
+		}
+		else
+		{
+			m_Ready.push_front(dependents[i]);
+		}
+	}
+}
+
+double TaskGraph::GetCriticalPath(std::vector<TaskId>& path) const
+{
+	// Dependencies always have lower ids, so one pass in id order sees them first
+	std::vector<double> longest(m_Tasks.size(), 0.0);
+	std::vector<TaskId> previous(m_Tasks.size(), -1);
+	TaskId last = -1;
+	for (size_t t = 0; t < m_Tasks.size(); t++)
+	{
+		const Task& task = m_Tasks[t];
+		for (size_t d = 0; d < task.Dependencies.size(); d++)
+		{
+			TaskId dependency = task.Dependencies[d];
+			if (previous[t] < 0 || longest[dependency] > longest[previous[t]])
+				previous[t] = dependency;
+		}
+		longest[t] = task.Timing.EndSeconds - task.Timing.StartSeconds + (previous[t] >= 0 ? longest[previous[t]] : 0.0);
+		if (last < 0 || longest[t] > longest[last])
+			last = (TaskId)t;
+	}
+
+	path.clear();
+	for (TaskId t = last; t >= 0; t = previous[t])
+		path.push_back(t);
+	std::reverse(path.begin(), path.end());
+	return last >= 0 ? longest[last] : 0.0;
+}
+
+std::string TaskGraph::FormatReport() const
+{
+	static const char* s_StatusNames[] = { "pending", "ok", "failed", "skipped" };
+	std::string report;
+	char line[256];
+	double taskSeconds = 0.0;
+	for (size_t t = 0; t < m_Tasks.size(); t++)
+	{
+		const Task& task = m_Tasks[t];
+		double duration = task.Timing.EndSeconds - task.Timing.StartSeconds;
+		taskSeconds += duration;
+		sprintf(line, "  %-32s thread %2d  start %8.2f ms  %8.2f ms  %s\n", task.Name.c_str(), task.Timing.Thread,
+			task.Timing.StartSeconds * 1000.0, duration * 1000.0, s_StatusNames[task.Status]);
+		report += line;
+	}
+
+	std::vector<TaskId> path;
+	double criticalSeconds = GetCriticalPath(path);
+	sprintf(line, "  %d tasks in %.2f ms, %.2f ms of task time, critical path %.2f ms:", (int)m_Tasks.size(),
+		m_RunSeconds * 1000.0, taskSeconds * 1000.0, criticalSeconds * 1000.0);
+	report += line;
+	for (size_t i = 0; i < path.size(); i++)
+	{
+		report += (i == 0) ? " " : " -> ";
+		report += m_Tasks[path[i]].Name;
+	}
+	report += "\n";
+	return report;
+}
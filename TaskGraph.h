@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// File: TaskGraph.h
+//
+// Graph of one-shot tasks with dependencies, run on a pool of worker threads. Startup
+// uses it to overlap the work that does not need the device, e.g. shader compiles and
+// image decoding. Every task records when and where it ran, so the critical path of a
+// run can be reported.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum TASK_STATUS
+{
+	TASK_STATUS_PENDING,
+	TASK_STATUS_SUCCEEDED,
+	TASK_STATUS_FAILED,
+	TASK_STATUS_SKIPPED,        // a dependency failed or was skipped
+};
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+typedef int TaskId;
+
+// Seconds relative to the start of TaskGraph::Run
+struct TaskTiming
+{
+	double StartSeconds = 0.0;
+	double EndSeconds = 0.0;
+	int Thread = -1;            // 0 is the thread that called Run
+};
+
+
+//--------------------------------------------------------------------------------------
+// TaskGraph
+//--------------------------------------------------------------------------------------
+class TaskGraph
+{
+public:
+	// Tasks return false on failure. Dependencies have to be added before the tasks that
+	// depend on them, which keeps the graph acyclic; other ids are ignored.
+	TaskId AddTask(const char* pName, const std::function<bool()>& function,
+		const std::vector<TaskId>& dependencies = std::vector<TaskId>());
+
+	// Runs every task on numThreads threads including the calling one (0 uses every
+	// hardware thread) and returns when all tasks are done, true if all succeeded.
+	// Tasks start in the order they were added, except that tasks whose dependencies
+	// completed during the run go first.
+	bool Run(int numThreads = 0);
+
+	int GetTaskCount() const { return (int)m_Tasks.size(); }
+	const std::string& GetName(TaskId task) const { return m_Tasks[task].Name; }
+	TASK_STATUS GetStatus(TaskId task) const { return m_Tasks[task].Status; }
+	const TaskTiming& GetTiming(TaskId task) const { return m_Tasks[task].Timing; }
+	double GetRunSeconds() const { return m_RunSeconds; }
+
+	// Chain of dependent tasks with the largest summed duration, returns that duration
+	double GetCriticalPath(std::vector<TaskId>& path) const;
+
+	// One line per task followed by the critical path, for logs
+	std::string FormatReport() const;
+
+private:
+	struct Task
+	{
+		std::string Name;
+		std::function<bool()> Function;
+		std::vector<TaskId> Dependents;
+		std::vector<TaskId> Dependencies;
+		TASK_STATUS Status = TASK_STATUS_PENDING;
+		TaskTiming Timing;
+		int PendingDependencies = 0;
+		bool DependencyFailed = false;
+	};
+
+	void WorkerLoop(int thread);
+	void CompleteTask(TaskId task, bool succeeded);
+
+	std::vector<Task> m_Tasks;
+	std::deque<TaskId> m_Ready;
+	int m_CompletedCount = 0;
+	double m_RunStart = 0.0;
+	double m_RunSeconds = 0.0;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+};
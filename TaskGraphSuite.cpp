@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------------------------
+// File: TaskGraphSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TaskGraph.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Task graph. Synthetic tasks record their runs, check that their dependencies finished
+// before they started and sleep to stand in for shader compiles and image decoding.
+//--------------------------------------------------------------------------------------
+void SleepMilliseconds(int milliseconds)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+// Every task depends on up to four random earlier ones. A task only writes its own slots
+// of runs and orderErrors, and reads the slots of its finished dependencies.
+static void BuildRandomTaskGraph(int taskCount, unsigned int seed, TaskGraph& graph, std::vector<int>& runs,
+	std::vector<int>& orderErrors)
+{
+	runs.assign(taskCount, 0);
+	orderErrors.assign(taskCount, 0);
+	for (int t = 0; t < taskCount; t++)
+	{
+		std::vector<TaskId> dependencies;
+		int dependencyCount = (t == 0) ? 0 : (int)((seed >> 16) % 5);
+		for (int d = 0; d < dependencyCount; d++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			dependencies.push_back((TaskId)((seed >> 8) % t));
+		}
+		seed = seed * 1664525u + 1013904223u;
+
+		char name[32];
+		sprintf(name, "task %d", t);
+		graph.AddTask(name, [t, dependencies, &runs, &orderErrors]()
+		{
+			for (size_t d = 0; d < dependencies.size(); d++)
+			{
+				if (runs[dependencies[d]] != runs[t] + 1)
+					orderErrors[t]++;
+			}
+			runs[t]++;
+			return true;
+		}, dependencies);
+	}
+}
+
+int VerifyTaskGraph()
+{
+	SuiteCheck check("tasks");
+
+	// Dependencies finish first and every task runs once per run, on any thread count
+	static const int s_ThreadCounts[] = { 1, 2, 4, 8 };
+	for (int i = 0; i < 4; i++)
+	{
+		int numThreads = s_ThreadCounts[i];
+		TaskGraph graph;
+		std::vector<int> runs, orderErrors;
+		BuildRandomTaskGraph(500, 17 + i, graph, runs, orderErrors);
+		for (int run = 1; run <= 2; run++)
+		{
+			bool success = graph.Run(numThreads);
+			for (TaskId t = 0; t < graph.GetTaskCount(); t++)
+			{
+				const TaskTiming& timing = graph.GetTiming(t);
+				success = success && runs[t] == run && orderErrors[t] == 0 && graph.GetStatus(t) == TASK_STATUS_SUCCEEDED &&
+					timing.Thread >= 0 && timing.Thread < numThreads && timing.StartSeconds <= timing.EndSeconds &&
+					timing.EndSeconds <= graph.GetRunSeconds();
+			}
+			check.FailIf(!success, "random graph on %d threads, run %d", numThreads, run);
+		}
+	}
+
+	// A failed task skips everything that depends on it, directly or not, and nothing else
+	TaskGraph failing;
+	std::vector<int> ran(5, 0);
+	TaskId a = failing.AddTask("a", [&ran]() { ran[0]++; return true; });
+	TaskId b = failing.AddTask("b", [&ran]() { ran[1]++; return false; });
+	TaskId c = failing.AddTask("c", [&ran]() { ran[2]++; return true; }, { b });
+	TaskId d = failing.AddTask("d", [&ran]() { ran[3]++; return true; }, { a, c });
+	TaskId e = failing.AddTask("e", [&ran]() { ran[4]++; return true; }, { a });
+	check.FailIf(failing.Run(2) || failing.GetStatus(a) != TASK_STATUS_SUCCEEDED ||
+		failing.GetStatus(b) != TASK_STATUS_FAILED || failing.GetStatus(c) != TASK_STATUS_SKIPPED ||
+		failing.GetStatus(d) != TASK_STATUS_SKIPPED || failing.GetStatus(e) != TASK_STATUS_SUCCEEDED ||
+		ran != std::vector<int>({ 1, 1, 0, 0, 1 }), "failure was not propagated to the dependents");
+
+	// The critical path follows the longest chain, independent tasks overlap
+	TaskGraph timed;
+	TaskId first = timed.AddTask("first", []() { SleepMilliseconds(20); return true; });
+	TaskId second = timed.AddTask("second", []() { SleepMilliseconds(20); return true; }, { first });
+	TaskId side = timed.AddTask("side", []() { SleepMilliseconds(10); return true; });
+	TaskId last = timed.AddTask("last", []() { SleepMilliseconds(5); return true; }, { second, side });
+	for (int i = 0; i < 4; i++)
+		timed.AddTask("parallel", []() { SleepMilliseconds(20); return true; });
+	std::vector<TaskId> path;
+	bool timedSuccess = timed.Run(8);
+	double criticalSeconds = timed.GetCriticalPath(path);
+	check.FailIf(!timedSuccess || path != std::vector<TaskId>({ first, second, last }) || criticalSeconds < 0.045 ||
+		criticalSeconds > timed.GetRunSeconds() ||
+		timed.GetTiming(second).StartSeconds < timed.GetTiming(first).EndSeconds || timed.GetRunSeconds() > 0.1,
+		"critical path %.1f ms over %d tasks in a %.1f ms run", criticalSeconds * 1000.0, (int)path.size(),
+		timed.GetRunSeconds() * 1000.0);
+
+	TaskGraph empty;
+	check.FailIf(!empty.Run() || empty.GetCriticalPath(path) != 0.0 || !path.empty(), "empty graph");
+
+	return check.Finish();
+}
+
+void RunTaskGraphThroughput()
+{
+	// Scheduling overhead with empty tasks
+	const int taskCount = 20000;
+	int numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; threads <= numThreads; threads = (threads == numThreads) ? threads + 1 : std::min(threads * 2, numThreads))
+	{
+		TaskGraph graph;
+		std::vector<int> runs, orderErrors;
+		BuildRandomTaskGraph(taskCount, 5, graph, runs, orderErrors);
+		graph.Run(threads);
+		printf("tasks %2d threads %10.1f ns per task\n", threads, graph.GetRunSeconds() * 1e9 / taskCount);
+	}
+
+	// The demo's startup with sleeps for the loads, one thread against a pool
+	TaskGraph startup;
+	static const char* s_Shaders[] = { "VS", "HS", "DS", "PS", "SolidPS" };
+	TaskId container = startup.AddTask("container", []() { SleepMilliseconds(1); return true; });
+	for (int i = 0; i < 5; i++)
+		startup.AddTask(s_Shaders[i], []() { SleepMilliseconds(15); return true; });
+	TaskId displacement = startup.AddTask("displacement", []() { SleepMilliseconds(40); return true; }, { container });
+	startup.AddTask("diffuse", []() { SleepMilliseconds(60); return true; }, { container });
+	startup.AddTask("normal", []() { SleepMilliseconds(60); return true; }, { container });
+	startup.AddTask("pyramid", []() { SleepMilliseconds(10); return true; }, { container, displacement });
+	startup.Run(1);
+	double serialSeconds = startup.GetRunSeconds();
+	startup.Run(4);
+	printf("tasks simulated startup %8.1f ms serial, %8.1f ms on 4 threads\n%s", serialSeconds * 1000.0,
+		startup.GetRunSeconds() * 1000.0, startup.FormatReport().c_str());
+}
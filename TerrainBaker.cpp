@@ -0,0 +1,534 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainBaker.cpp
+//--------------------------------------------------------------------------------------
+#include "TerrainBaker.h"
+#include "HeightPyramid.h"
+#include "TerrainHeightField.h"
+#include "Tessellator.h"
+#include "MeshSimplify.h"
+#include "VertexCache.h"
+#include "Hash.h"
+#include "Timer.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// One LOD of one chunk while it is baked
+struct ChunkMesh
+{
+	std::vector<float> Positions;       // x, y and z in object space, y in displacement units
+	std::vector<int> GridPoints;        // x and z of every vertex on the MaxFactor grid of the chunk
+	std::vector<char> Skirt;
+	std::vector<int> Indices;
+	float Error = 0.0f;
+	float MinHeight = 0.0f;
+	float MaxHeight = 0.0f;
+	int TessellatedTriangles = 0;
+	int SimplifiedTriangles = 0;
+	int SkirtTriangles = 0;
+	int MissesBefore = 0;
+	int MissesAfter = 0;
+	bool Valid = false;
+};
+
+struct BakeContext
+{
+	const TerrainHeightField* pField;
+	const TerrainBakeDesc* pDesc;
+	ChunkMesh* pMeshes;                 // LodCount rows of ChunkCount meshes
+	float SkirtDepth;                   // added to the error of a mesh for the depth of its skirts
+};
+
+
+//--------------------------------------------------------------------------------------
+// Tessellation and simplification
+//--------------------------------------------------------------------------------------
+// Object space coordinate of point i of the MaxFactor grid of chunk c, computed the same
+// way for both chunks along a border
+static float GridCoordinate(int chunk, int point, int maxFactor, int chunksPerSide)
+{
+	return ((float)chunk + (float)point / maxFactor) / chunksPerSide * 2.0f - 1.0f;
+}
+
+// Twice the signed area of the triangle a, b, c on the grid, positive if it turns left
+static long long GridOrientation(const int* a, const int* b, const int* c)
+{
+	return (long long)(b[0] - a[0]) * (c[1] - a[1]) - (long long)(b[1] - a[1]) * (c[0] - a[0]);
+}
+
+// Largest vertical distance of a triangle from the reference heights on the MaxFactor
+// grid. The LOD vertices are grid points, so the distance between the two piecewise
+// linear surfaces peaks at a grid point. The points it covers are marked in pCovered if
+// not NULL.
+static double TriangleError(const ChunkMesh& mesh, const int* pTriangle, const std::vector<float>& reference,
+	int maxFactor, char* pCovered)
+{
+	const int* p[3];
+	double y[3];
+	for (int c = 0; c < 3; c++)
+	{
+		p[c] = &mesh.GridPoints[pTriangle[c] * 2];
+		y[c] = mesh.Positions[pTriangle[c] * 3 + 1];
+	}
+	long long area = GridOrientation(p[0], p[1], p[2]);
+	if (area == 0)
+		return 0.0;
+
+	int side = maxFactor + 1;
+	double largest = 0.0;
+	int x0 = std::min(p[0][0], std::min(p[1][0], p[2][0])), x1 = std::max(p[0][0], std::max(p[1][0], p[2][0]));
+	int z0 = std::min(p[0][1], std::min(p[1][1], p[2][1])), z1 = std::max(p[0][1], std::max(p[1][1], p[2][1]));
+	for (int z = z0; z <= z1; z++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			int q[2] = { x, z };
+			long long w0 = GridOrientation(p[1], p[2], q);
+			long long w1 = GridOrientation(p[2], p[0], q);
+			long long w2 = GridOrientation(p[0], p[1], q);
+			bool inside = (area > 0) ? (w0 >= 0 && w1 >= 0 && w2 >= 0) : (w0 <= 0 && w1 <= 0 && w2 <= 0);
+			if (!inside)
+				continue;
+			double height = (w0 * y[0] + w1 * y[1] + w2 * y[2]) / (double)area;
+			largest = std::max(largest, fabs(height - reference[(size_t)z * side + x]));
+			if (pCovered)
+				pCovered[(size_t)z * side + x] = 1;
+		}
+	}
+	return largest;
+}
+
+// Largest error of the triangles of the mesh. false if a grid point is not covered.
+static bool MeasureError(const ChunkMesh& mesh, const std::vector<float>& reference, int maxFactor, float& error)
+{
+	int side = maxFactor + 1;
+	std::vector<char> covered((size_t)side * side, 0);
+	double largest = 0.0;
+	for (size_t t = 0; t < mesh.Indices.size(); t += 3)
+		largest = std::max(largest, TriangleError(mesh, &mesh.Indices[t], reference, maxFactor, &covered[0]));
+	error = (float)largest;
+	return std::find(covered.begin(), covered.end(), 0) == covered.end();
+}
+
+static void TessellateChunks(const BakeContext& context, int chunkBegin, int chunkEnd)
+{
+	const TerrainBakeDesc& desc = *context.pDesc;
+	int chunkCount = desc.ChunksPerSide * desc.ChunksPerSide;
+	int maxFactor = desc.MaxFactor;
+	int side = maxFactor + 1;
+
+	// About 200 KB of points and indices, too much for the stack
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(TESS_PARTITIONING_INTEGER);
+	std::vector<float> reference((size_t)side * side);
+	std::vector<int> indices;
+	for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+	{
+		// Heights of the tessellation at MaxFactor, displaced like DS
+		int chunkX = chunk % desc.ChunksPerSide, chunkZ = chunk / desc.ChunksPerSide;
+		for (int z = 0; z < side; z++)
+		{
+			float positionZ = GridCoordinate(chunkZ, z, maxFactor, desc.ChunksPerSide);
+			for (int x = 0; x < side; x++)
+				reference[(size_t)z * side + x] = context.pField->SampleHeight(GridCoordinate(chunkX, x, maxFactor, desc.ChunksPerSide), positionZ);
+		}
+
+		for (int lod = 0; lod < desc.LodCount; lod++)
+		{
+			ChunkMesh& mesh = context.pMeshes[lod * chunkCount + chunk];
+			float factor = (float)(maxFactor >> lod);
+			pTessellator->TessellateQuadDomain(factor, factor, factor, factor, factor, factor);
+
+			// QuadDS runs v along x and u along z. Every point is a point of the MaxFactor grid.
+			int pointCount = pTessellator->GetPointCount();
+			mesh.Positions.resize(pointCount * 3);
+			mesh.GridPoints.resize(pointCount * 2);
+			mesh.Skirt.assign(pointCount, 0);
+			bool onGrid = true;
+			for (int p = 0; p < pointCount; p++)
+			{
+				float gridX = pTessellator->GetPointsV()[p] * maxFactor, gridZ = pTessellator->GetPointsU()[p] * maxFactor;
+				int x = (int)floorf(gridX + 0.5f), z = (int)floorf(gridZ + 0.5f);
+				onGrid = onGrid && fabsf(gridX - x) < 1e-3f && fabsf(gridZ - z) < 1e-3f;
+				x = std::min(std::max(x, 0), maxFactor);
+				z = std::min(std::max(z, 0), maxFactor);
+				mesh.GridPoints[p * 2] = x;
+				mesh.GridPoints[p * 2 + 1] = z;
+				mesh.Positions[p * 3] = GridCoordinate(chunkX, x, maxFactor, desc.ChunksPerSide);
+				mesh.Positions[p * 3 + 1] = reference[(size_t)z * side + x];
+				mesh.Positions[p * 3 + 2] = GridCoordinate(chunkZ, z, maxFactor, desc.ChunksPerSide);
+			}
+
+			// Front faces are clockwise seen from above, which turns right on the x, z grid
+			int indexCount = pTessellator->GetIndexCount();
+			const int* pIndices = pTessellator->GetIndices();
+			indices.assign(pIndices, pIndices + indexCount);
+			for (int i = 0; i < indexCount; i += 3)
+			{
+				long long area = GridOrientation(&mesh.GridPoints[indices[i] * 2], &mesh.GridPoints[indices[i + 1] * 2],
+					&mesh.GridPoints[indices[i + 2] * 2]);
+				if (area > 0)
+					std::swap(indices[i + 1], indices[i + 2]);
+			}
+			mesh.TessellatedTriangles = indexCount / 3;
+
+			// The quadrics only bound a mean distance, so every collapse is also checked against
+			// the reference heights. No triangle may fold over seen from above either.
+			mesh.Indices.resize(indexCount);
+			float limit = desc.BaseError * (float)(1 << lod);
+			CollapseFilterFunction filter = [&](const int* pTriangles, int triangleCount) -> bool
+			{
+				for (int t = 0; t < triangleCount; t++)
+				{
+					const int* pTriangle = pTriangles + t * 3;
+					if (GridOrientation(&mesh.GridPoints[pTriangle[0] * 2], &mesh.GridPoints[pTriangle[1] * 2],
+						&mesh.GridPoints[pTriangle[2] * 2]) >= 0 ||
+						TriangleError(mesh, pTriangle, reference, maxFactor, NULL) > limit)
+						return false;
+				}
+				return true;
+			};
+			int simplifiedCount = SimplifyMesh(&mesh.Positions[0], pointCount, &indices[0], indexCount, 0, limit,
+				&mesh.Indices[0], NULL, filter);
+			mesh.Indices.resize(simplifiedCount);
+			mesh.SimplifiedTriangles = simplifiedCount / 3;
+
+			mesh.MinHeight = mesh.MaxHeight = mesh.Positions[1];
+			for (int i = 0; i < simplifiedCount; i++)
+			{
+				float height = mesh.Positions[mesh.Indices[i] * 3 + 1];
+				mesh.MinHeight = std::min(mesh.MinHeight, height);
+				mesh.MaxHeight = std::max(mesh.MaxHeight, height);
+			}
+			mesh.Valid = onGrid && MeasureError(mesh, reference, maxFactor, mesh.Error);
+		}
+	}
+	delete pTessellator;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Skirts and vertex order
+//--------------------------------------------------------------------------------------
+struct DirectedEdge
+{
+	unsigned long long Key;             // smaller and larger vertex
+	int From;
+	int To;
+
+	bool operator<(const DirectedEdge& other) const { return Key < other.Key; }
+};
+
+// Hangs a skirt from every border edge. Its triangles continue the surface downwards
+// with the same winding, so they face away from the chunk.
+static void AddSkirts(ChunkMesh& mesh, float depth)
+{
+	std::vector<DirectedEdge> edges;
+	edges.reserve(mesh.Indices.size());
+	for (size_t t = 0; t < mesh.Indices.size(); t += 3)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			DirectedEdge edge;
+			edge.From = mesh.Indices[t + c];
+			edge.To = mesh.Indices[t + (c + 1) % 3];
+			unsigned long long a = (unsigned int)std::min(edge.From, edge.To), b = (unsigned int)std::max(edge.From, edge.To);
+			edge.Key = (a << 32) | b;
+			edges.push_back(edge);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	int vertexCount = (int)mesh.Skirt.size();
+	std::vector<int> skirtVertices(vertexCount, -1);
+	int surfaceIndices = (int)mesh.Indices.size();
+	for (size_t e = 0; e < edges.size(); )
+	{
+		size_t next = e + 1;
+		while (next < edges.size() && edges[next].Key == edges[e].Key)
+			next++;
+		if (next - e == 1)
+		{
+			int ends[2] = { edges[e].From, edges[e].To };
+			for (int k = 0; k < 2; k++)
+			{
+				int v = ends[k];
+				if (skirtVertices[v] >= 0)
+					continue;
+				skirtVertices[v] = (int)mesh.Skirt.size();
+				mesh.Positions.push_back(mesh.Positions[v * 3]);
+				mesh.Positions.push_back(mesh.Positions[v * 3 + 1] - depth);
+				mesh.Positions.push_back(mesh.Positions[v * 3 + 2]);
+				mesh.GridPoints.push_back(mesh.GridPoints[v * 2]);
+				mesh.GridPoints.push_back(mesh.GridPoints[v * 2 + 1]);
+				mesh.Skirt.push_back(1);
+			}
+			int a = edges[e].From, b = edges[e].To;
+			int triangles[6] = { b, a, skirtVertices[a], b, skirtVertices[a], skirtVertices[b] };
+			mesh.Indices.insert(mesh.Indices.end(), triangles, triangles + 6);
+		}
+		e = next;
+	}
+	mesh.SkirtTriangles = ((int)mesh.Indices.size() - surfaceIndices) / 3;
+}
+
+// Orders the triangles for the vertex cache and the vertices by first use
+static void OptimizeChunk(ChunkMesh& mesh)
+{
+	int vertexCount = (int)mesh.Skirt.size();
+	int indexCount = (int)mesh.Indices.size();
+	VertexCacheStats stats;
+	AnalyzeVertexCache(&mesh.Indices[0], indexCount, vertexCount, stats);
+	mesh.MissesBefore = stats.Misses;
+
+	OptimizeVertexCache(&mesh.Indices[0], indexCount, vertexCount);
+	std::vector<int> remap(vertexCount);
+	int usedCount = OptimizeVertexFetch(&mesh.Indices[0], indexCount, vertexCount, &remap[0]);
+	std::vector<float> positions(usedCount * 3);
+	std::vector<int> gridPoints(usedCount * 2);
+	std::vector<char> skirt(usedCount);
+	for (int v = 0; v < vertexCount; v++)
+	{
+		int target = remap[v];
+		if (target < 0)
+			continue;
+		memcpy(&positions[target * 3], &mesh.Positions[v * 3], 3 * sizeof(float));
+		memcpy(&gridPoints[target * 2], &mesh.GridPoints[v * 2], 2 * sizeof(int));
+		skirt[target] = mesh.Skirt[v];
+	}
+	mesh.Positions.swap(positions);
+	mesh.GridPoints.swap(gridPoints);
+	mesh.Skirt.swap(skirt);
+
+	AnalyzeVertexCache(&mesh.Indices[0], indexCount, usedCount, stats);
+	mesh.MissesAfter = stats.Misses;
+}
+
+static void FinishChunks(const BakeContext& context, int chunkBegin, int chunkEnd)
+{
+	const TerrainBakeDesc& desc = *context.pDesc;
+	int chunkCount = desc.ChunksPerSide * desc.ChunksPerSide;
+	for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+	{
+		for (int lod = 0; lod < desc.LodCount; lod++)
+		{
+			ChunkMesh& mesh = context.pMeshes[lod * chunkCount + chunk];
+			AddSkirts(mesh, mesh.Error + context.SkirtDepth);
+			OptimizeChunk(mesh);
+		}
+	}
+}
+
+// Runs function over the chunks split into ranges, one per thread
+static void RunChunks(void (*function)(const BakeContext&, int, int), const BakeContext& context, int chunkCount, int threads)
+{
+	if (threads <= 1)
+	{
+		function(context, 0, chunkCount);
+		return;
+	}
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.push_back(std::thread(function, std::cref(context), chunkCount * t / threads, chunkCount * (t + 1) / threads));
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writing
+//--------------------------------------------------------------------------------------
+static unsigned long long AlignOffset(unsigned long long offset)
+{
+	return (offset + BAKED_TERRAIN_ALIGNMENT - 1) & ~(unsigned long long)(BAKED_TERRAIN_ALIGNMENT - 1);
+}
+
+static unsigned short QuantizeUnorm16(float value)
+{
+	value = std::min(std::max(value, 0.0f), 1.0f);
+	return (unsigned short)(value * 65535.0f + 0.5f);
+}
+
+static bool WriteBakedTerrain(const char* pFileName, const TerrainBakeDesc& desc, unsigned long long sourceHash,
+	const std::vector<ChunkMesh>& meshes, unsigned long long& fileSize)
+{
+	int chunkCount = desc.ChunksPerSide * desc.ChunksPerSide;
+	BakedTerrainHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = BAKED_TERRAIN_MAGIC;
+	header.Version = BAKED_TERRAIN_VERSION;
+	header.ChunksPerSide = desc.ChunksPerSide;
+	header.LodCount = desc.LodCount;
+	header.SourceHash = sourceHash;
+
+	float heightMin = meshes[0].Positions[1], heightMax = heightMin;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		for (size_t v = 0; v < meshes[m].Skirt.size(); v++)
+		{
+			heightMin = std::min(heightMin, meshes[m].Positions[v * 3 + 1]);
+			heightMax = std::max(heightMax, meshes[m].Positions[v * 3 + 1]);
+		}
+	}
+	header.HeightMin = heightMin;
+	header.HeightRange = std::max(heightMax - heightMin, 1e-6f);
+
+	// The table, then the LOD blocks from the coarsest to the finest
+	std::vector<BakedChunkLod> table((size_t)desc.LodCount * chunkCount);
+	memset(&table[0], 0, table.size() * sizeof(BakedChunkLod));
+	header.ChunkTableOffset = sizeof(BakedTerrainHeader);
+	unsigned long long offset = AlignOffset(header.ChunkTableOffset + table.size() * sizeof(BakedChunkLod));
+	for (int lod = desc.LodCount - 1; lod >= 0; lod--)
+	{
+		BakedLodBlock& block = header.Lods[lod];
+		block.Offset = offset;
+		block.Factor = desc.MaxFactor >> lod;
+		for (int chunk = 0; chunk < chunkCount; chunk++)
+		{
+			const ChunkMesh& mesh = meshes[lod * chunkCount + chunk];
+			BakedChunkLod& entry = table[lod * chunkCount + chunk];
+			entry.FirstVertex = block.VertexCount;
+			entry.VertexCount = (unsigned int)mesh.Skirt.size();
+			entry.FirstIndex = block.IndexCount;
+			entry.IndexCount = (unsigned int)mesh.Indices.size();
+			entry.Error = mesh.Error;
+			entry.MinHeight = mesh.MinHeight;
+			entry.MaxHeight = mesh.MaxHeight;
+			block.VertexCount += entry.VertexCount;
+			block.IndexCount += entry.IndexCount;
+			block.MaxError = std::max(block.MaxError, mesh.Error);
+		}
+		offset = AlignOffset(offset + (unsigned long long)block.VertexCount * sizeof(BakedVertex) +
+			(unsigned long long)block.IndexCount * sizeof(unsigned short));
+	}
+	header.FileSize = offset;
+
+	FILE* pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	std::vector<unsigned char> headerBlock((size_t)header.Lods[desc.LodCount - 1].Offset, 0);
+	memcpy(&headerBlock[0], &header, sizeof(header));
+	memcpy(&headerBlock[(size_t)header.ChunkTableOffset], &table[0], table.size() * sizeof(BakedChunkLod));
+	bool success = fwrite(&headerBlock[0], 1, headerBlock.size(), pFile) == headerBlock.size();
+
+	std::vector<unsigned char> block;
+	for (int lod = desc.LodCount - 1; lod >= 0 && success; lod--)
+	{
+		const BakedLodBlock& lodBlock = header.Lods[lod];
+		unsigned long long end = (lod > 0) ? header.Lods[lod - 1].Offset : header.FileSize;
+		block.assign((size_t)(end - lodBlock.Offset), 0);
+		BakedVertex* pVertices = (BakedVertex*)&block[0];
+		unsigned short* pIndices = (unsigned short*)(pVertices + lodBlock.VertexCount);
+		for (int chunk = 0; chunk < chunkCount; chunk++)
+		{
+			const ChunkMesh& mesh = meshes[lod * chunkCount + chunk];
+			const BakedChunkLod& entry = table[lod * chunkCount + chunk];
+			for (unsigned int v = 0; v < entry.VertexCount; v++)
+			{
+				BakedVertex& vertex = pVertices[entry.FirstVertex + v];
+				vertex.Position[0] = QuantizeUnorm16(mesh.Positions[v * 3] * 0.5f + 0.5f);
+				vertex.Position[1] = QuantizeUnorm16((mesh.Positions[v * 3 + 1] - header.HeightMin) / header.HeightRange);
+				vertex.Position[2] = QuantizeUnorm16(mesh.Positions[v * 3 + 2] * 0.5f + 0.5f);
+				vertex.Position[3] = mesh.Skirt[v] ? 65535 : 0;
+			}
+			for (unsigned int i = 0; i < entry.IndexCount; i++)
+				pIndices[entry.FirstIndex + i] = (unsigned short)mesh.Indices[i];
+		}
+		success = fwrite(&block[0], 1, block.size(), pFile) == block.size();
+	}
+	success = (fclose(pFile) == 0) && success;
+	if (!success)
+		remove(pFileName);
+	fileSize = header.FileSize;
+	return success;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Baking
+//--------------------------------------------------------------------------------------
+unsigned long long GetTerrainBakeHash(const HeightPyramid& pyramid)
+{
+	int size[2] = { pyramid.GetWidth(), pyramid.GetHeight() };
+	unsigned long long hash = HashBytes(size, sizeof(size));
+	return pyramid.IsValid() ? HashBytes(pyramid.GetLevelMin(0), (size_t)size[0] * size[1], hash) : hash;
+}
+
+bool BakeTerrain(const char* pFileName, const HeightPyramid& pyramid, const TerrainBakeDesc& desc, TerrainBakeStats* pStats)
+{
+	double start = GetTimeSeconds();
+	if (desc.ChunksPerSide < 1 || desc.ChunksPerSide > BAKED_TERRAIN_MAX_CHUNKS || desc.LodCount < 1 ||
+		desc.LodCount > BAKED_TERRAIN_MAX_LODS || desc.MaxFactor < 1 || desc.MaxFactor > TESS_MAX_FACTOR ||
+		(desc.MaxFactor & (desc.MaxFactor - 1)) != 0 || (desc.MaxFactor >> (desc.LodCount - 1)) < 1 || desc.BaseError < 0.0f)
+		return false;
+
+	// Object space: the quad spans [-1, 1] and a texel value v is v / 255 high
+	TerrainHeightField field;
+	float objectScale[3] = { 1.0f, 1.0f, 1.0f };
+	if (!field.Init(&pyramid, objectScale, 1.0f, 1.0f))
+		return false;
+
+	int chunkCount = desc.ChunksPerSide * desc.ChunksPerSide;
+	int threads = desc.Threads > 0 ? desc.Threads : std::max(1, (int)std::thread::hardware_concurrency());
+	threads = std::min(threads, chunkCount);
+	std::vector<ChunkMesh> meshes((size_t)desc.LodCount * chunkCount);
+	BakeContext context;
+	context.pField = &field;
+	context.pDesc = &desc;
+	context.pMeshes = &meshes[0];
+	context.SkirtDepth = 0.0f;
+	RunChunks(TessellateChunks, context, chunkCount, threads);
+
+	// A neighbour can be off by up to the largest error on the other side of the border
+	float largestError = 0.0f;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		if (!meshes[m].Valid)
+			return false;
+		largestError = std::max(largestError, meshes[m].Error);
+	}
+	context.SkirtDepth = largestError + desc.BaseError;
+	RunChunks(FinishChunks, context, chunkCount, threads);
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		if ((int)meshes[m].Skirt.size() > BAKED_TERRAIN_MAX_CHUNK_VERTICES)
+			return false;
+	}
+
+	unsigned long long fileSize = 0;
+	if (!WriteBakedTerrain(pFileName, desc, GetTerrainBakeHash(pyramid), meshes, fileSize))
+		return false;
+
+	if (pStats)
+	{
+		memset(pStats, 0, sizeof(TerrainBakeStats));
+		for (int lod = 0; lod < desc.LodCount; lod++)
+		{
+			long long missesBefore = 0, missesAfter = 0, triangles = 0;
+			for (int chunk = 0; chunk < chunkCount; chunk++)
+			{
+				const ChunkMesh& mesh = meshes[lod * chunkCount + chunk];
+				pStats->TessellatedTriangles[lod] += mesh.TessellatedTriangles;
+				pStats->SimplifiedTriangles[lod] += mesh.SimplifiedTriangles;
+				pStats->SkirtTriangles[lod] += mesh.SkirtTriangles;
+				pStats->MaxError[lod] = std::max(pStats->MaxError[lod], mesh.Error);
+				missesBefore += mesh.MissesBefore;
+				missesAfter += mesh.MissesAfter;
+				triangles += mesh.Indices.size() / 3;
+			}
+			pStats->AcmrBefore[lod] = triangles > 0 ? (float)missesBefore / triangles : 0.0f;
+			pStats->AcmrAfter[lod] = triangles > 0 ? (float)missesAfter / triangles : 0.0f;
+		}
+		pStats->FileSize = fileSize;
+		pStats->Seconds = GetTimeSeconds() - start;
+	}
+	return true;
+}
@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainBaker.h
+//
+// Bakes the static LOD meshes of BakedTerrain.h from a heightmap. Every chunk is
+// tessellated on the CPU like a quad patch of QuadDS with integer partitioning, at
+// MaxFactor for LOD 0 and half the factor of the LOD before for each coarser one, and
+// the domain points are displaced by the point-sampled texels like the domain shader
+// (see TerrainHeightField.h). The result is simplified with quadric error metrics
+// (MeshSimplify.h), keeping the chunk borders, and a collapse is only made if no new
+// triangle is further from the tessellation at MaxFactor than an error limit that
+// doubles per LOD. Coarser factors sample a subset of its points, so the largest
+// vertical distance is found at them, and the error of every mesh is stored. Skirts
+// are added along the borders once every error is known, deep enough for any
+// neighbouring LOD, and the triangles and vertices are reordered for the vertex cache
+// (VertexCache.h). Chunks are baked on several threads.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "BakedTerrain.h"
+
+class HeightPyramid;
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct TerrainBakeDesc
+{
+	int ChunksPerSide = 8;
+	int LodCount = 4;
+	int MaxFactor = 64;                 // tessellation factor of LOD 0, a power of two up to TESS_MAX_FACTOR
+	float BaseError = 1.0f / 255.0f;    // simplification limit of LOD 0 in displacement units, doubled per LOD
+	int Threads = 0;                    // 0 uses every hardware thread
+};
+
+struct TerrainBakeStats
+{
+	int TessellatedTriangles[BAKED_TERRAIN_MAX_LODS];
+	int SimplifiedTriangles[BAKED_TERRAIN_MAX_LODS];   // without the skirts
+	int SkirtTriangles[BAKED_TERRAIN_MAX_LODS];
+	float AcmrBefore[BAKED_TERRAIN_MAX_LODS];           // of the simplified triangles in tessellator order
+	float AcmrAfter[BAKED_TERRAIN_MAX_LODS];
+	float MaxError[BAKED_TERRAIN_MAX_LODS];
+	unsigned long long FileSize;
+	double Seconds;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Key of a heightmap in BakedTerrainHeader::SourceHash, from its level 0 texels
+unsigned long long GetTerrainBakeHash(const HeightPyramid& pyramid);
+
+// Bakes the terrain displaced by the level 0 texels of pyramid and writes it to
+// pFileName. false if the description is out of range, a chunk needs more than 16-bit
+// indices or writing fails.
+bool BakeTerrain(const char* pFileName, const HeightPyramid& pyramid, const TerrainBakeDesc& desc,
+	TerrainBakeStats* pStats = NULL);
@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainGrid.cpp
+//--------------------------------------------------------------------------------------
+#include "TerrainGrid.h"
+#include <math.h>
+
+
+//--------------------------------------------------------------------------------------
+// Geometry
+//--------------------------------------------------------------------------------------
+bool TerrainGrid::Build(int patchesX, int patchesZ)
+{
+	if (patchesX < 1 || patchesZ < 1)
+		return false;
+
+	m_PatchesX = patchesX;
+	m_PatchesZ = patchesZ;
+
+	int patchCount = GetPatchCount();
+	m_CenterX.assign(patchCount, 0.0f);
+	m_CenterY.assign(patchCount, 0.0f);
+	m_CenterZ.assign(patchCount, 0.0f);
+	m_ExtentX.assign(patchCount, 0.0f);
+	m_ExtentY.assign(patchCount, 0.0f);
+	m_ExtentZ.assign(patchCount, 0.0f);
+	m_MinHeight.assign(patchCount, 0.0f);
+	m_MaxHeight.assign(patchCount, 1.0f);
+
+	float unitScale[3] = { 1.0f, 1.0f, 1.0f };
+	UpdateBounds(unitScale, 0.0f);
+	return true;
+}
+
+void TerrainGrid::GetVertex(int vertex, float position[3], float texCoord[2]) const
+{
+	int x = vertex % (m_PatchesX + 1);
+	int z = vertex / (m_PatchesX + 1);
+	texCoord[0] = (float)x / m_PatchesX;
+	texCoord[1] = (float)z / m_PatchesZ;
+	position[0] = texCoord[0] * 2.0f - 1.0f;
+	position[1] = 0.0f;
+	position[2] = texCoord[1] * 2.0f - 1.0f;
+}
+
+void TerrainGrid::GetPatchIndices(int patch, unsigned int indices[TERRAIN_INDICES_PER_PATCH]) const
+{
+	int x = patch % m_PatchesX;
+	int z = patch / m_PatchesX;
+	unsigned int v0 = z * (m_PatchesX + 1) + x;     // (-x, -z) corner
+	unsigned int v1 = v0 + 1;                       // (+x, -z)
+	unsigned int v3 = v0 + m_PatchesX + 1;          // (-x, +z)
+	unsigned int v2 = v3 + 1;                       // (+x, +z)
+
+	indices[0] = v3; indices[1] = v2; indices[2] = v0;
+	indices[3] = v0; indices[4] = v2; indices[5] = v1;
+}
+
+void TerrainGrid::GetQuadPatchIndices(int patch, unsigned int indices[TERRAIN_QUAD_INDICES_PER_PATCH]) const
+{
+	int x = patch % m_PatchesX;
+	int z = patch / m_PatchesX;
+	indices[0] = z * (m_PatchesX + 1) + x;
+	indices[1] = indices[0] + 1;
+	indices[3] = indices[0] + m_PatchesX + 1;
+	indices[2] = indices[3] + 1;
+}
+
+template <class Index>
+static int WriteGridIndices(const TerrainGrid& grid, const int* pPatches, int count, bool quads, Index* pIndices)
+{
+	int indicesPerPatch = quads ? TERRAIN_QUAD_INDICES_PER_PATCH : TERRAIN_INDICES_PER_PATCH;
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+		if (quads)
+			grid.GetQuadPatchIndices(pPatches[i], indices);
+		else
+			grid.GetPatchIndices(pPatches[i], indices);
+		for (int j = 0; j < indicesPerPatch; j++)
+			*pIndices++ = (Index)indices[j];
+	}
+	return count * indicesPerPatch;
+}
+
+int TerrainGrid::WritePatchIndices(const int* pPatches, int count, unsigned short* pIndices) const
+{
+	return WriteGridIndices(*this, pPatches, count, false, pIndices);
+}
+
+int TerrainGrid::WritePatchIndices(const int* pPatches, int count, unsigned int* pIndices) const
+{
+	return WriteGridIndices(*this, pPatches, count, false, pIndices);
+}
+
+int TerrainGrid::WriteQuadPatchIndices(const int* pPatches, int count, unsigned short* pIndices) const
+{
+	return WriteGridIndices(*this, pPatches, count, true, pIndices);
+}
+
+int TerrainGrid::WriteQuadPatchIndices(const int* pPatches, int count, unsigned int* pIndices) const
+{
+	return WriteGridIndices(*this, pPatches, count, true, pIndices);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bounds
+//--------------------------------------------------------------------------------------
+void TerrainGrid::SetPatchHeightRanges(const float* pMinHeights, const float* pMaxHeights)
+{
+	m_MinHeight.assign(pMinHeights, pMinHeights + GetPatchCount());
+	m_MaxHeight.assign(pMaxHeights, pMaxHeights + GetPatchCount());
+}
+
+void TerrainGrid::UpdateBounds(const float worldScale[3], float displacementScale)
+{
+	float extentX = fabsf(worldScale[0]) / m_PatchesX;
+	float extentZ = fabsf(worldScale[2]) / m_PatchesZ;
+
+	for (int z = 0; z < m_PatchesZ; z++)
+	{
+		float centerZ = (((z + 0.5f) / m_PatchesZ) * 2.0f - 1.0f) * worldScale[2];
+		for (int x = 0; x < m_PatchesX; x++)
+		{
+			int patch = z * m_PatchesX + x;
+			float minHeight = m_MinHeight[patch] * displacementScale;
+			float maxHeight = m_MaxHeight[patch] * displacementScale;
+			m_CenterX[patch] = (((x + 0.5f) / m_PatchesX) * 2.0f - 1.0f) * worldScale[0];
+			m_CenterY[patch] = 0.5f * (minHeight + maxHeight);
+			m_CenterZ[patch] = centerZ;
+			m_ExtentX[patch] = extentX;
+			m_ExtentY[patch] = 0.5f * fabsf(maxHeight - minHeight);
+			m_ExtentZ[patch] = extentZ;
+		}
+	}
+}
+
+BoundsSoA TerrainGrid::GetBounds() const
+{
+	BoundsSoA bounds;
+	bounds.CenterX = m_CenterX.data();
+	bounds.CenterY = m_CenterY.data();
+	bounds.CenterZ = m_CenterZ.data();
+	bounds.ExtentX = m_ExtentX.data();
+	bounds.ExtentY = m_ExtentY.data();
+	bounds.ExtentZ = m_ExtentZ.data();
+	return bounds;
+}
+
+int TerrainGrid::Cull(const Frustum& frustum, int* pVisiblePatches) const
+{
+	return CullBoxes(frustum, GetBounds(), GetPatchCount(), pVisiblePatches);
+}
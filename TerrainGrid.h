@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainGrid.h
+//
+// Regular grid of terrain patches over the [-1, 1] x [-1, 1] object space plane. Each
+// cell is drawn as two tri patches sharing the grid vertices, or as one quad patch of
+// its four corners, and keeps a world space bounding box that includes the displacement
+// range for frustum culling.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "FrustumCulling.h"
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define TERRAIN_INDICES_PER_PATCH 6
+#define TERRAIN_QUAD_INDICES_PER_PATCH 4
+
+
+//--------------------------------------------------------------------------------------
+// TerrainGrid
+//--------------------------------------------------------------------------------------
+class TerrainGrid
+{
+public:
+	// Creates (patchesX + 1) * (patchesZ + 1) vertices, returns false on invalid sizes
+	bool Build(int patchesX, int patchesZ);
+
+	// Displacement range of every patch in [0, 1] units of the displacement texture.
+	// Defaults to the full [0, 1] range until set.
+	void SetPatchHeightRanges(const float* pMinHeights, const float* pMaxHeights);
+
+	// Bounds of every patch after scaling by worldScale (the World matrix of the demo is a
+	// pure scale). displacementScale converts the height ranges to world units along +Y.
+	void UpdateBounds(const float worldScale[3], float displacementScale);
+
+	int GetPatchesX() const { return m_PatchesX; }
+	int GetPatchesZ() const { return m_PatchesZ; }
+	int GetPatchCount() const { return m_PatchesX * m_PatchesZ; }
+	int GetVertexCount() const { return (m_PatchesX + 1) * (m_PatchesZ + 1); }
+
+	// Object space vertex data, y is 0 and the normal is +Y
+	void GetVertex(int vertex, float position[3], float texCoord[2]) const;
+
+	// Two tri patches of the cell, in the winding of the original quad
+	void GetPatchIndices(int patch, unsigned int indices[TERRAIN_INDICES_PER_PATCH]) const;
+
+	// Writes the indices of the listed patches and returns the number of indices written.
+	// 16-bit indices only reach the first 65536 vertices, see GetControlPointIndexSize.
+	int WritePatchIndices(const int* pPatches, int count, unsigned short* pIndices) const;
+	int WritePatchIndices(const int* pPatches, int count, unsigned int* pIndices) const;
+
+	// Quad patch of the cell: the (-x, -z), (+x, -z), (+x, +z) and (-x, +z) corners, in the
+	// winding of the tri patches
+	void GetQuadPatchIndices(int patch, unsigned int indices[TERRAIN_QUAD_INDICES_PER_PATCH]) const;
+	int WriteQuadPatchIndices(const int* pPatches, int count, unsigned short* pIndices) const;
+	int WriteQuadPatchIndices(const int* pPatches, int count, unsigned int* pIndices) const;
+
+	BoundsSoA GetBounds() const;
+
+	// Culls every patch, pVisiblePatches must hold GetPatchCount() entries
+	int Cull(const Frustum& frustum, int* pVisiblePatches) const;
+
+private:
+	int m_PatchesX = 0;
+	int m_PatchesZ = 0;
+	std::vector<float> m_MinHeight, m_MaxHeight;
+	std::vector<float> m_CenterX, m_CenterY, m_CenterZ;
+	std::vector<float> m_ExtentX, m_ExtentY, m_ExtentZ;
+};
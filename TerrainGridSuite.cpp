@@ -0,0 +1,391 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainGridSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TerrainGrid.h"
+#include "BenchmarkScript.h"
+#include "SceneUpdate.h"
+#include "TessDensity.h"
+#include "Tessellator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Quad patches. The terrain grid drawn as one quad patch per cell against two tri
+// patches per cell: triangle counts, and the domain points on the cell sides, which
+// have to match between neighbouring cells and between the two paths or cracks open.
+//--------------------------------------------------------------------------------------
+#define QUAD_PATCHES            9
+#define QUAD_SIDE_EPSILON       1e-4f
+
+// Control points and factors of every patch of the terrain, tri or quad patches
+struct TerrainPatches
+{
+	bool Quads;
+	int Count;
+	std::vector<float> X[4], Y[4], Z[4];
+	std::vector<float> Density[4];
+	std::vector<float> Edges[4];
+	std::vector<float> Inside[2];
+};
+
+// The control points VS writes and the factors ConstHS or ConstQuadHS computes, scaled
+// by the density map
+static void BuildTerrainPatches(const TerrainGrid& grid, const SceneFrame& scene, const AdaptiveTessParams& params,
+	const TessDensityMap& densityMap, bool quads, TerrainPatches& patches)
+{
+	// End points of the edges of ConstHS (opposite each control point) and ConstQuadHS
+	static const int s_TriEdges[3][2] = { { 1, 2 }, { 2, 0 }, { 0, 1 } };
+	static const int s_QuadEdges[4][2] = { { 0, 1 }, { 3, 0 }, { 3, 2 }, { 1, 2 } };
+	int controlPoints = quads ? 4 : 3;
+	patches.Quads = quads;
+	patches.Count = quads ? grid.GetPatchCount() : grid.GetPatchCount() * 2;
+	for (int p = 0; p < 4; p++)
+	{
+		patches.X[p].resize(patches.Count);
+		patches.Y[p].resize(patches.Count);
+		patches.Z[p].resize(patches.Count);
+		patches.Density[p].resize(patches.Count);
+		patches.Edges[p].resize(patches.Count);
+	}
+	patches.Inside[0].resize(patches.Count);
+	patches.Inside[1].resize(patches.Count);
+
+	for (int patch = 0; patch < patches.Count; patch++)
+	{
+		unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+		if (quads)
+			grid.GetQuadPatchIndices(patch, indices);
+		else
+			grid.GetPatchIndices(patch / 2, indices);
+		float texCoords[4][2];
+		for (int p = 0; p < controlPoints; p++)
+		{
+			float position[3];
+			grid.GetVertex(indices[quads ? p : (patch % 2) * 3 + p], position, texCoords[p]);
+			patches.X[p][patch] = position[0] * scene.WorldScale[0];
+			patches.Y[p][patch] = position[1] * scene.WorldScale[1];
+			patches.Z[p][patch] = position[2] * scene.WorldScale[2];
+		}
+		for (int e = 0; e < controlPoints; e++)
+		{
+			const float* pA = texCoords[quads ? s_QuadEdges[e][0] : s_TriEdges[e][0]];
+			const float* pB = texCoords[quads ? s_QuadEdges[e][1] : s_TriEdges[e][1]];
+			patches.Density[e][patch] = densityMap.SampleEdge(pA[0], pA[1], pB[0], pB[1]);
+		}
+	}
+
+	PatchPositionsSoA positions;
+	PatchFactorsSoA factors;
+	PatchDensitySoA density;
+	for (int p = 0; p < 4; p++)
+	{
+		positions.X[p] = &patches.X[p][0];
+		positions.Y[p] = &patches.Y[p][0];
+		positions.Z[p] = &patches.Z[p][0];
+		factors.Edges[p] = &patches.Edges[p][0];
+		density.Edges[p] = &patches.Density[p][0];
+	}
+	factors.Inside[0] = &patches.Inside[0][0];
+	factors.Inside[1] = &patches.Inside[1][0];
+	if (quads)
+		ComputeQuadPatchTessFactors(positions, patches.Count, params, factors, &density);
+	else
+		ComputeTriPatchTessFactors(positions, patches.Count, params, factors, &density);
+}
+
+// Tessellates a patch and returns the world space x and z of its domain points
+static void TessellateTerrainPatch(CpuTessellator& tessellator, const TerrainPatches& patches, int patch,
+	std::vector<float>& x, std::vector<float>& z)
+{
+	float controlPoints[4][3];
+	for (int p = 0; p < 4; p++)
+	{
+		controlPoints[p][0] = patches.X[p][patch];
+		controlPoints[p][1] = patches.Y[p][patch];
+		controlPoints[p][2] = patches.Z[p][patch];
+	}
+	if (patches.Quads)
+	{
+		tessellator.TessellateQuadDomain(patches.Edges[0][patch], patches.Edges[1][patch], patches.Edges[2][patch],
+			patches.Edges[3][patch], patches.Inside[0][patch], patches.Inside[1][patch]);
+	}
+	else
+	{
+		tessellator.TessellateTriDomain(patches.Edges[0][patch], patches.Edges[1][patch], patches.Edges[2][patch],
+			patches.Inside[0][patch]);
+	}
+
+	int count = tessellator.GetPointCount();
+	std::vector<float> y(count);
+	x.resize(count);
+	z.resize(count);
+	if (count == 0)
+		return;
+	if (patches.Quads)
+		TessEvaluateQuadDomain(tessellator.GetPointsU(), tessellator.GetPointsV(), count, controlPoints, &x[0], &y[0], &z[0]);
+	else
+		TessEvaluateTriDomain(tessellator.GetPointsU(), tessellator.GetPointsV(), count, controlPoints, &x[0], &y[0], &z[0]);
+}
+
+// Sorts the coordinates along a side and drops the ones found twice, the corners of two
+// tri patches
+static void SortSidePoints(std::vector<float>& points)
+{
+	std::sort(points.begin(), points.end());
+	size_t kept = 0;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		if (kept == 0 || points[i] - points[kept - 1] > QUAD_SIDE_EPSILON)
+			points[kept++] = points[i];
+	}
+	points.resize(kept);
+}
+
+static bool SidePointsMatch(const std::vector<float>& a, const std::vector<float>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (fabsf(a[i] - b[i]) > QUAD_SIDE_EPSILON)
+			return false;
+	}
+	return true;
+}
+
+// Tessellates every cell and collects the domain points on its -z, -x, +z and +x sides
+// (the edge order of ConstQuadHS) as coordinates along the side. Returns the triangles.
+static long long TessellateTerrainSides(const TerrainGrid& grid, const SceneFrame& scene, const TerrainPatches& patches,
+	std::vector<std::vector<float> >& sides, long long& domainPoints)
+{
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+	int cells = grid.GetPatchCount();
+	int patchesPerCell = patches.Quads ? 1 : 2;
+	sides.assign(cells * 4, std::vector<float>());
+	long long triangles = 0;
+	domainPoints = 0;
+	std::vector<float> x, z;
+	for (int patch = 0; patch < patches.Count; patch++)
+	{
+		TessellateTerrainPatch(*pTessellator, patches, patch, x, z);
+		triangles += pTessellator->GetIndexCount() / 3;
+		domainPoints += pTessellator->GetPointCount();
+
+		int cell = patch / patchesPerCell;
+		int cellX = cell % grid.GetPatchesX(), cellZ = cell / grid.GetPatchesX();
+		float x0 = ((float)cellX / grid.GetPatchesX() * 2.0f - 1.0f) * scene.WorldScale[0];
+		float x1 = ((float)(cellX + 1) / grid.GetPatchesX() * 2.0f - 1.0f) * scene.WorldScale[0];
+		float z0 = ((float)cellZ / grid.GetPatchesZ() * 2.0f - 1.0f) * scene.WorldScale[2];
+		float z1 = ((float)(cellZ + 1) / grid.GetPatchesZ() * 2.0f - 1.0f) * scene.WorldScale[2];
+		for (size_t i = 0; i < x.size(); i++)
+		{
+			if (fabsf(z[i] - z0) < QUAD_SIDE_EPSILON)
+				sides[cell * 4 + 0].push_back(x[i]);
+			if (fabsf(x[i] - x0) < QUAD_SIDE_EPSILON)
+				sides[cell * 4 + 1].push_back(z[i]);
+			if (fabsf(z[i] - z1) < QUAD_SIDE_EPSILON)
+				sides[cell * 4 + 2].push_back(x[i]);
+			if (fabsf(x[i] - x1) < QUAD_SIDE_EPSILON)
+				sides[cell * 4 + 3].push_back(z[i]);
+		}
+	}
+	for (size_t s = 0; s < sides.size(); s++)
+		SortSidePoints(sides[s]);
+	delete pTessellator;
+	return triangles;
+}
+
+static AdaptiveTessParams TerrainAdaptiveParams(const SceneCamera& camera, const SceneSettings& settings,
+	const SceneFrame& scene, const float projection[4][4])
+{
+	AdaptiveTessParams params;
+	for (int c = 0; c < 3; c++)
+		params.Eye[c] = camera.Eye[c];
+	params.ProjScale = projection[1][1];
+	params.ViewportHeight = SCRIPT_VIEWPORT_HEIGHT;
+	params.TargetTriangleSize = scene.Frame.TargetTriangleSize;
+	params.MaxTessFactor = settings.TessellationFactor;
+	return params;
+}
+
+int VerifyQuadPatches()
+{
+	SuiteCheck check("quads");
+	TerrainGrid grid;
+	grid.Build(QUAD_PATCHES, QUAD_PATCHES);
+	int cells = grid.GetPatchCount();
+
+	// The quad patch of a cell has the corners of its two tri patches
+	std::vector<int> patchList(cells);
+	std::vector<unsigned short> quadIndices(cells * TERRAIN_QUAD_INDICES_PER_PATCH);
+	for (int i = 0; i < cells; i++)
+		patchList[i] = i;
+	check.FailIf(grid.WriteQuadPatchIndices(&patchList[0], cells, &quadIndices[0]) != cells * TERRAIN_QUAD_INDICES_PER_PATCH,
+		"wrong number of quad patch indices");
+	for (int i = 0; i < cells; i++)
+	{
+		unsigned int tri[TERRAIN_INDICES_PER_PATCH];
+		grid.GetPatchIndices(i, tri);
+		const unsigned short* pQuad = &quadIndices[i * TERRAIN_QUAD_INDICES_PER_PATCH];
+		if (pQuad[0] != tri[2] || pQuad[1] != tri[5] || pQuad[2] != tri[1] || pQuad[3] != tri[0])
+		{
+			check.Fail("patch %d has corners %d %d %d %d", i, pQuad[0], pQuad[1], pQuad[2], pQuad[3]);
+			break;
+		}
+	}
+
+	// Adaptive factors scaled by the density map, close enough that they vary a lot
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, texels);
+	TessDensityMap densityMap;
+	densityMap.Build(&texels[0], DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, 1, TessDensityParams());
+	SceneCamera camera;
+	camera.Eye[0] = 0.5f;
+	camera.Eye[1] = 1.5f;
+	camera.Eye[2] = -3.5f;
+	SceneSettings settings;
+	settings.AdaptiveTessellation = true;
+	settings.ContentDensity = true;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	SceneFrame scene;
+	UpdateScene(camera, settings, projection, 0.0f, scene);
+	AdaptiveTessParams params = TerrainAdaptiveParams(camera, settings, scene, projection);
+
+	TerrainPatches triPatches, quadPatches;
+	BuildTerrainPatches(grid, scene, params, densityMap, false, triPatches);
+	BuildTerrainPatches(grid, scene, params, densityMap, true, quadPatches);
+
+	// Both paths give every side of a cell the same factor: -z, -x, +z and +x of the quad
+	// are edges of the second, first, first and second tri patch
+	static const int s_TriSides[4][2] = { { 1, 1 }, { 0, 1 }, { 0, 2 }, { 1, 0 } };
+	for (int cell = 0; cell < cells; cell++)
+	{
+		for (int side = 0; side < 4; side++)
+		{
+			float triFactor = triPatches.Edges[s_TriSides[side][1]][cell * 2 + s_TriSides[side][0]];
+			if (quadPatches.Edges[side][cell] != triFactor)
+			{
+				check.Fail("cell %d side %d has factor %g, the tri patch %g", cell, side, quadPatches.Edges[side][cell],
+					triFactor);
+				cell = cells;
+				break;
+			}
+		}
+	}
+
+	// The domain points on every side match the neighbouring cell and the tri patches
+	std::vector<std::vector<float> > triSides, quadSides;
+	long long triPoints, quadPoints;
+	long long triTriangles = TessellateTerrainSides(grid, scene, triPatches, triSides, triPoints);
+	long long quadTriangles = TessellateTerrainSides(grid, scene, quadPatches, quadSides, quadPoints);
+	int sideErrors = 0;
+	for (int cell = 0; cell < cells; cell++)
+	{
+		int cellX = cell % QUAD_PATCHES, cellZ = cell / QUAD_PATCHES;
+		for (int side = 0; side < 4; side++)
+		{
+			if (!SidePointsMatch(quadSides[cell * 4 + side], triSides[cell * 4 + side]) && sideErrors++ == 0)
+			{
+				check.Fail("cell %d side %d has %d domain points, the tri patches %d", cell, side,
+					(int)quadSides[cell * 4 + side].size(), (int)triSides[cell * 4 + side].size());
+			}
+		}
+		if (cellX + 1 < QUAD_PATCHES && !SidePointsMatch(quadSides[cell * 4 + 3], quadSides[(cell + 1) * 4 + 1]) &&
+			sideErrors++ == 0)
+		{
+			check.Fail("crack between cells %d and %d", cell, cell + 1);
+		}
+		if (cellZ + 1 < QUAD_PATCHES && !SidePointsMatch(quadSides[cell * 4 + 2], quadSides[(cell + QUAD_PATCHES) * 4 + 0]) &&
+			sideErrors++ == 0)
+		{
+			check.Fail("crack between cells %d and %d", cell, cell + QUAD_PATCHES);
+		}
+	}
+	// The triangle counter finds the tessellated triangles of both paths
+	TerrainTriangleCounter counter;
+	counter.SetDensityMap(&densityMap);
+	long long countedTri = counter.Count(grid, &patchList[0], cells, camera, settings, scene, projection[1][1],
+		SCRIPT_VIEWPORT_HEIGHT);
+	settings.QuadPatches = true;
+	long long countedQuad = counter.Count(grid, &patchList[0], cells, camera, settings, scene, projection[1][1],
+		SCRIPT_VIEWPORT_HEIGHT);
+	check.FailIf(countedTri != triTriangles || countedQuad != quadTriangles,
+		"the counter finds %lld and %lld triangles, tessellating gives %lld and %lld", countedTri, countedQuad,
+		triTriangles, quadTriangles);
+
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+	static const float s_Factors[] = { 1.0f, 2.5f, 7.0f, 64.0f };
+	for (int f = 0; f < (int)(sizeof(s_Factors) / sizeof(s_Factors[0])); f++)
+	{
+		float factor = s_Factors[f];
+		pTessellator->TessellateQuadDomain(factor, factor, factor, factor, factor, factor);
+		check.FailIf(CountUniformTerrainTriangles(cells, factor, true) != (long long)cells * (pTessellator->GetIndexCount() / 3),
+			"uniform factor %g counts the wrong number of triangles", factor);
+	}
+	delete pTessellator;
+
+	// Scripts select the path
+	BenchmarkScript script;
+	std::string error;
+	check.FailIf(!ParseBenchmarkScript((std::string("quads 1\n") + g_DefaultScript).c_str(), script, error) ||
+		!ScriptedBenchmark(script).GetStepSettings(0).QuadPatches || ParseBenchmarkScript("quads 2\n", script, error),
+		"the quads script keyword is not applied");
+
+	return check.Finish("%d cells, tri %lld triangles %lld points, quad %lld triangles %lld points", cells,
+		triTriangles, triPoints, quadTriangles, quadPoints);
+}
+
+void RunQuadPatchSuite()
+{
+	// Uniform factors: one quad patch against two tri patches per cell
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+	static const float s_Factors[] = { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 64.0f };
+	for (int f = 0; f < (int)(sizeof(s_Factors) / sizeof(s_Factors[0])); f++)
+	{
+		float factor = s_Factors[f];
+		pTessellator->TessellateTriDomain(factor, factor, factor, factor);
+		int triPoints = 2 * pTessellator->GetPointCount();
+		pTessellator->TessellateQuadDomain(factor, factor, factor, factor, factor, factor);
+		int quadPoints = pTessellator->GetPointCount();
+		printf("quads factor %4.0f  per cell: tri %6lld triangles %6d points  |  quad %6lld triangles %6d points\n",
+			factor, CountUniformTerrainTriangles(1, factor), triPoints, CountUniformTerrainTriangles(1, factor, true), quadPoints);
+	}
+	delete pTessellator;
+
+	// Adaptive factors with density over a larger grid, tessellated on the CPU
+	TerrainGrid grid;
+	grid.Build(32, 32);
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, texels);
+	TessDensityMap densityMap;
+	densityMap.Build(&texels[0], DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, 1, TessDensityParams());
+	SceneCamera camera;
+	SceneSettings settings;
+	settings.AdaptiveTessellation = true;
+	settings.ContentDensity = true;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	SceneFrame scene;
+	UpdateScene(camera, settings, projection, 0.0f, scene);
+	AdaptiveTessParams params = TerrainAdaptiveParams(camera, settings, scene, projection);
+	for (int quads = 0; quads < 2; quads++)
+	{
+		TerrainPatches patches;
+		BuildTerrainPatches(grid, scene, params, densityMap, quads != 0, patches);
+		std::vector<std::vector<float> > sides;
+		long long points;
+		double start = GetTimeSeconds();
+		long long triangles = TessellateTerrainSides(grid, scene, patches, sides, points);
+		double seconds = GetTimeSeconds() - start;
+		printf("quads adaptive %s  %5d patches  %9lld triangles  %9lld points  %10.3f ms\n", quads ? "quad" : "tri ",
+			patches.Count, triangles, points, seconds * 1000.0);
+	}
+}
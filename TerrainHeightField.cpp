@@ -0,0 +1,378 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHeightField.cpp
+//--------------------------------------------------------------------------------------
+#include "TerrainHeightField.h"
+#include "HeightPyramid.h"
+#include "SimdUtil.h"
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+// Texel index of a whole texel coordinate with wrap addressing, as a float
+static inline float WrapTexel(float texel, float size, float invSize)
+{
+	float wrapped = texel - size * floorf(texel * invSize);
+	if (wrapped >= size)
+		wrapped -= size;
+	if (wrapped < 0.0f)
+		wrapped += size;
+	return wrapped;
+}
+
+// Filters the heights of the 2x2 texels around a point with weights fx and fz and
+// writes the normal of the filtered surface, texelScale is in texels per world unit
+static inline float FilterHeights(float h00, float h10, float h01, float h11, float fx, float fz,
+	const float texelScale[2], float* pNormal)
+{
+	float bottom = h00 + (h10 - h00) * fx;
+	float top = h01 + (h11 - h01) * fx;
+	if (pNormal)
+	{
+		float dx = ((h10 - h00) + ((h11 - h01) - (h10 - h00)) * fz) * texelScale[0];
+		float dz = (top - bottom) * texelScale[1];
+		float invLength = 1.0f / sqrtf(dx * dx + dz * dz + 1.0f);
+		pNormal[0] = -dx * invLength;
+		pNormal[1] = invLength;
+		pNormal[2] = -dz * invLength;
+	}
+	return bottom + (top - bottom) * fz;
+}
+
+#if TESS_USE_SSE2
+// Rounds toward negative infinity, for |v| < 2^31
+static inline __m128 FloorPs(__m128 v)
+{
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+	return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.0f)));
+}
+
+// Four lanes of WrapTexel
+static inline __m128i WrapTexelPs(__m128 texel, __m128 size, __m128 invSize)
+{
+	__m128 wrapped = _mm_sub_ps(texel, _mm_mul_ps(size, FloorPs(_mm_mul_ps(texel, invSize))));
+	wrapped = _mm_sub_ps(wrapped, _mm_and_ps(_mm_cmpge_ps(wrapped, size), size));
+	wrapped = _mm_add_ps(wrapped, _mm_and_ps(_mm_cmplt_ps(wrapped, _mm_setzero_ps()), size));
+	return _mm_cvttps_epi32(wrapped);
+}
+#endif
+
+// Calls function(begin, end) on consecutive ranges of the queries, one per thread. The
+// calling thread takes the first range, batches too small to share stay on it.
+template<class Function>
+static void RunBatch(int count, int numThreads, int minPerThread, const Function& function)
+{
+	if (count <= 0)
+		return;
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	int threads = std::min(numThreads, std::max(1, count / minPerThread));
+	if (threads == 1)
+	{
+		function(0, count);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads; t++)
+		workers.push_back(std::thread(function, (int)((long long)count * t / threads), (int)((long long)count * (t + 1) / threads)));
+	function(0, count / threads);
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+// Narrows [t0, t1] to the part of the ray between begin and end along one axis
+static bool ClipSlab(float origin, float direction, float begin, float end, float& t0, float& t1)
+{
+	if (direction == 0.0f)
+		return origin >= begin && origin <= end;
+	float invDirection = 1.0f / direction;
+	float enter = (begin - origin) * invDirection;
+	float exit = (end - origin) * invDirection;
+	if (enter > exit)
+		std::swap(enter, exit);
+	t0 = std::max(t0, enter);
+	t1 = std::min(t1, exit);
+	return t0 <= t1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Setup
+//--------------------------------------------------------------------------------------
+bool TerrainHeightField::Init(const HeightPyramid* pPyramid, const float worldScale[3], float scaling,
+	float displacementLevel)
+{
+	m_pPyramid = NULL;
+	if (!pPyramid || !pPyramid->IsValid() || worldScale[0] == 0.0f || worldScale[2] == 0.0f)
+		return false;
+
+	m_pPyramid = pPyramid;
+	m_pTexels = pPyramid->GetLevelMin(0);
+	m_Width = pPyramid->GetWidth();
+	m_Height = pPyramid->GetHeight();
+
+	// The quad spans [-worldScale, worldScale], u = x / worldScale * 0.5 + 0.5
+	m_UScale[0] = 0.5f / worldScale[0];
+	m_UScale[1] = 0.5f / worldScale[2];
+	m_TexelScale[0] = m_UScale[0] * m_Width;
+	m_TexelScale[1] = m_UScale[1] * m_Height;
+
+	// texSample.r * Scaling * DisplacementLevel
+	for (int value = 0; value < 256; value++)
+		m_Heights[value] = value / 255.0f * scaling * displacementLevel;
+	return true;
+}
+
+bool TerrainHeightField::IsInside(float x, float z) const
+{
+	return fabsf(x * m_UScale[0]) <= 0.5f && fabsf(z * m_UScale[1]) <= 0.5f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Heights
+//--------------------------------------------------------------------------------------
+float TerrainHeightField::SampleHeight(float x, float z) const
+{
+	float width = (float)m_Width, height = (float)m_Height;
+	int column = (int)WrapTexel(floorf((x * m_UScale[0] + 0.5f) * width), width, 1.0f / width);
+	int row = (int)WrapTexel(floorf((z * m_UScale[1] + 0.5f) * height), height, 1.0f / height);
+	return m_Heights[m_pTexels[(size_t)row * m_Width + column]];
+}
+
+float TerrainHeightField::SampleBilinear(float x, float z, float normal[3]) const
+{
+	// Texel centers are at half texel coordinates
+	float width = (float)m_Width, height = (float)m_Height;
+	float s = (x * m_UScale[0] + 0.5f) * width - 0.5f;
+	float t = (z * m_UScale[1] + 0.5f) * height - 0.5f;
+	float s0 = floorf(s), t0 = floorf(t);
+	int x0 = (int)WrapTexel(s0, width, 1.0f / width);
+	int z0 = (int)WrapTexel(t0, height, 1.0f / height);
+	int x1 = (x0 + 1 == m_Width) ? 0 : x0 + 1;
+	int z1 = (z0 + 1 == m_Height) ? 0 : z0 + 1;
+
+	const unsigned char* pRow0 = m_pTexels + (size_t)z0 * m_Width;
+	const unsigned char* pRow1 = m_pTexels + (size_t)z1 * m_Width;
+	return FilterHeights(m_Heights[pRow0[x0]], m_Heights[pRow0[x1]], m_Heights[pRow1[x0]], m_Heights[pRow1[x1]],
+		s - s0, t - t0, m_TexelScale, normal);
+}
+
+void TerrainHeightField::SampleHeightRange(const float* pX, const float* pZ, int begin, int end, float* pHeights) const
+{
+	int i = begin;
+#if TESS_USE_SSE2
+	// The texel coordinates in lanes, the texel loads one by one
+	const __m128 vHalf = _mm_set1_ps(0.5f);
+	const __m128 vScaleX = _mm_set1_ps(m_UScale[0]), vScaleZ = _mm_set1_ps(m_UScale[1]);
+	const __m128 vWidth = _mm_set1_ps((float)m_Width), vHeight = _mm_set1_ps((float)m_Height);
+	const __m128 vInvWidth = _mm_set1_ps(1.0f / m_Width), vInvHeight = _mm_set1_ps(1.0f / m_Height);
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 s = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pX + i), vScaleX), vHalf), vWidth);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pZ + i), vScaleZ), vHalf), vHeight);
+		int columns[4], rows[4];
+		_mm_storeu_si128((__m128i*)columns, WrapTexelPs(FloorPs(s), vWidth, vInvWidth));
+		_mm_storeu_si128((__m128i*)rows, WrapTexelPs(FloorPs(t), vHeight, vInvHeight));
+		for (int lane = 0; lane < 4; lane++)
+			pHeights[i + lane] = m_Heights[m_pTexels[(size_t)rows[lane] * m_Width + columns[lane]]];
+	}
+#endif
+	for (; i < end; i++)
+		pHeights[i] = SampleHeight(pX[i], pZ[i]);
+}
+
+void TerrainHeightField::SampleBilinearRange(const float* pX, const float* pZ, int begin, int end, float* pHeights,
+	float* pNormals) const
+{
+	int i = begin;
+#if TESS_USE_SSE2
+	const __m128 vHalf = _mm_set1_ps(0.5f), vOne = _mm_set1_ps(1.0f);
+	const __m128 vScaleX = _mm_set1_ps(m_UScale[0]), vScaleZ = _mm_set1_ps(m_UScale[1]);
+	const __m128 vWidth = _mm_set1_ps((float)m_Width), vHeight = _mm_set1_ps((float)m_Height);
+	const __m128 vInvWidth = _mm_set1_ps(1.0f / m_Width), vInvHeight = _mm_set1_ps(1.0f / m_Height);
+	const __m128 vTexelScaleX = _mm_set1_ps(m_TexelScale[0]), vTexelScaleZ = _mm_set1_ps(m_TexelScale[1]);
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pX + i), vScaleX), vHalf), vWidth), vHalf);
+		__m128 t = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pZ + i), vScaleZ), vHalf), vHeight), vHalf);
+		__m128 s0 = FloorPs(s), t0 = FloorPs(t);
+		__m128 fx = _mm_sub_ps(s, s0), fz = _mm_sub_ps(t, t0);
+		int columns[4], rows[4];
+		_mm_storeu_si128((__m128i*)columns, WrapTexelPs(s0, vWidth, vInvWidth));
+		_mm_storeu_si128((__m128i*)rows, WrapTexelPs(t0, vHeight, vInvHeight));
+
+		float corners[4][4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int x0 = columns[lane], x1 = (x0 + 1 == m_Width) ? 0 : x0 + 1;
+			int z1 = (rows[lane] + 1 == m_Height) ? 0 : rows[lane] + 1;
+			const unsigned char* pRow0 = m_pTexels + (size_t)rows[lane] * m_Width;
+			const unsigned char* pRow1 = m_pTexels + (size_t)z1 * m_Width;
+			corners[0][lane] = m_Heights[pRow0[x0]];
+			corners[1][lane] = m_Heights[pRow0[x1]];
+			corners[2][lane] = m_Heights[pRow1[x0]];
+			corners[3][lane] = m_Heights[pRow1[x1]];
+		}
+
+		// FilterHeights in lanes
+		__m128 h00 = _mm_loadu_ps(corners[0]), h10 = _mm_loadu_ps(corners[1]);
+		__m128 h01 = _mm_loadu_ps(corners[2]), h11 = _mm_loadu_ps(corners[3]);
+		__m128 deltaBottom = _mm_sub_ps(h10, h00), deltaTop = _mm_sub_ps(h11, h01);
+		__m128 bottom = _mm_add_ps(h00, _mm_mul_ps(deltaBottom, fx));
+		__m128 top = _mm_add_ps(h01, _mm_mul_ps(deltaTop, fx));
+		_mm_storeu_ps(pHeights + i, _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), fz)));
+		if (!pNormals)
+			continue;
+
+		__m128 dx = _mm_mul_ps(_mm_add_ps(deltaBottom, _mm_mul_ps(_mm_sub_ps(deltaTop, deltaBottom), fz)), vTexelScaleX);
+		__m128 dz = _mm_mul_ps(_mm_sub_ps(top, bottom), vTexelScaleZ);
+		__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), vOne);
+		__m128 invLength = _mm_div_ps(vOne, _mm_sqrt_ps(lengthSquared));
+		float normals[3][4];
+		_mm_storeu_ps(normals[0], _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(dx, invLength)));
+		_mm_storeu_ps(normals[1], invLength);
+		_mm_storeu_ps(normals[2], _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(dz, invLength)));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			for (int c = 0; c < 3; c++)
+				pNormals[(size_t)(i + lane) * 3 + c] = normals[c][lane];
+		}
+	}
+#endif
+	for (; i < end; i++)
+		pHeights[i] = SampleBilinear(pX[i], pZ[i], pNormals ? pNormals + (size_t)i * 3 : NULL);
+}
+
+void TerrainHeightField::SampleHeights(const float* pX, const float* pZ, int count, float* pHeights, int numThreads) const
+{
+	const int minQueriesPerThread = 16384;
+	RunBatch(count, numThreads, minQueriesPerThread, [=](int begin, int end)
+	{
+		SampleHeightRange(pX, pZ, begin, end, pHeights);
+	});
+}
+
+void TerrainHeightField::SampleBilinearHeights(const float* pX, const float* pZ, int count, float* pHeights,
+	float* pNormals, int numThreads) const
+{
+	const int minQueriesPerThread = 8192;
+	RunBatch(count, numThreads, minQueriesPerThread, [=](int begin, int end)
+	{
+		SampleBilinearRange(pX, pZ, begin, end, pHeights, pNormals);
+	});
+}
+
+
+//--------------------------------------------------------------------------------------
+// Rays
+//--------------------------------------------------------------------------------------
+float TerrainHeightField::IntersectRay(const TerrainRay& ray) const
+{
+	// x and z in texels of level 0, the quad covers [0, width] x [0, height]
+	RayContext context;
+	context.Origin[0] = ray.Origin[0] * m_TexelScale[0] + m_Width * 0.5f;
+	context.Origin[1] = ray.Origin[1];
+	context.Origin[2] = ray.Origin[2] * m_TexelScale[1] + m_Height * 0.5f;
+	context.Direction[0] = ray.Direction[0] * m_TexelScale[0];
+	context.Direction[1] = ray.Direction[1];
+	context.Direction[2] = ray.Direction[2] * m_TexelScale[1];
+	context.InvDirection[0] = 1.0f / context.Direction[0];
+	context.InvDirection[2] = 1.0f / context.Direction[2];
+
+	float t0 = 0.0f, t1 = ray.MaxDistance;
+	if (!ClipSlab(context.Origin[0], context.Direction[0], 0.0f, (float)m_Width, t0, t1) ||
+		!ClipSlab(context.Origin[2], context.Direction[2], 0.0f, (float)m_Height, t0, t1))
+		return TERRAIN_RAY_MISS;
+	return IntersectNode(context, m_pPyramid->GetLevelCount() - 1, 0, 0, t0, t1);
+}
+
+// [t0, t1] is the part of the ray over the node
+float TerrainHeightField::IntersectNode(const RayContext& ray, int level, int nodeX, int nodeZ, float t0, float t1) const
+{
+	size_t texel = (size_t)nodeZ * m_pPyramid->GetLevelWidth(level) + nodeX;
+	float low = m_Heights[m_pPyramid->GetLevelMin(level)[texel]];
+	float high = m_Heights[m_pPyramid->GetLevelMax(level)[texel]];
+	if (low > high)
+		std::swap(low, high);   // negative displacement
+
+	float y0 = ray.Origin[1] + ray.Direction[1] * t0;
+	float y1 = ray.Origin[1] + ray.Direction[1] * t1;
+	if (y0 > high && y1 > high)
+		return TERRAIN_RAY_MISS;
+	if (y0 <= low)
+		return t0;
+	if (level == 0)
+	{
+		// The ray enters the column above its top and leaves under it
+		float t = (high - ray.Origin[1]) / ray.Direction[1];
+		return std::min(std::max(t, t0), t1);
+	}
+
+	// The ray crosses the middle of the node along x at tx and along z at tz, so it visits
+	// at most three children. A child is on the far side of a plane crossed by t0.
+	int childLevel = level - 1;
+	float childSize = (float)(1 << childLevel);
+	float tx = FLT_MAX, tz = FLT_MAX;
+	int childX, childZ;
+	if (ray.Direction[0] != 0.0f)
+	{
+		tx = ((2 * nodeX + 1) * childSize - ray.Origin[0]) * ray.InvDirection[0];
+		childX = ((tx <= t0) == (ray.Direction[0] > 0.0f)) ? 1 : 0;
+	}
+	else
+	{
+		childX = (ray.Origin[0] >= (2 * nodeX + 1) * childSize) ? 1 : 0;
+	}
+	if (ray.Direction[2] != 0.0f)
+	{
+		tz = ((2 * nodeZ + 1) * childSize - ray.Origin[2]) * ray.InvDirection[2];
+		childZ = ((tz <= t0) == (ray.Direction[2] > 0.0f)) ? 1 : 0;
+	}
+	else
+	{
+		childZ = (ray.Origin[2] >= (2 * nodeZ + 1) * childSize) ? 1 : 0;
+	}
+
+	float t = t0;
+	for (;;)
+	{
+		float end = t1;
+		if (tx > t && tx < end)
+			end = tx;
+		if (tz > t && tz < end)
+			end = tz;
+
+		int x = 2 * nodeX + childX, z = 2 * nodeZ + childZ;
+		if (x < m_pPyramid->GetLevelWidth(childLevel) && z < m_pPyramid->GetLevelHeight(childLevel))
+		{
+			float hit = IntersectNode(ray, childLevel, x, z, t, end);
+			if (hit != TERRAIN_RAY_MISS)
+				return hit;
+		}
+		if (end >= t1)
+			return TERRAIN_RAY_MISS;
+		if (end == tx)
+			childX ^= 1;
+		if (end == tz)
+			childZ ^= 1;
+		t = end;
+	}
+}
+
+void TerrainHeightField::IntersectRays(const TerrainRay* pRays, int count, float* pDistances, int numThreads) const
+{
+	const int minRaysPerThread = 256;
+	RunBatch(count, numThreads, minRaysPerThread, [=](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			pDistances[i] = IntersectRay(pRays[i]);
+	});
+}
@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHeightField.h
+//
+// Height queries against the displaced terrain on the CPU, for ground following,
+// gameplay and physics. DS and QuadtreeDS displace a domain point by the point-sampled
+// displacement texel at its texture coordinate times Scaling * DisplacementLevel, and
+// the World matrix scales the [-1, 1] quad, so the height of a point only depends on
+// its world x and z. SampleHeight returns that height: texel (floor(u * width),
+// floor(v * height)) with wrap addressing, scaled in the order the shader does it. The
+// drawn triangles interpolate between the heights of their domain points.
+//
+// The bilinear lookups filter the same texels like a linear sampler with wrap
+// addressing, but with float weights, and return the normal of the filtered surface,
+// which suits ground following. Rays are intersected with the point-sampled surface,
+// a field of flat-topped texel columns, by descending the levels of a HeightPyramid:
+// nodes whose maximum is below the ray are skipped whole and a ray that enters a node
+// under its minimum hits it there. Batches run the queries in SSE2 lanes where that
+// helps and split them across threads, as every query is independent.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <stddef.h>
+
+class HeightPyramid;
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define TERRAIN_RAY_MISS -1.0f
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct TerrainRay
+{
+	float Origin[3];
+	float Direction[3];         // need not be normalized, distances are in multiples of it
+	float MaxDistance;
+};
+
+
+//--------------------------------------------------------------------------------------
+// TerrainHeightField
+//--------------------------------------------------------------------------------------
+class TerrainHeightField
+{
+public:
+	TerrainHeightField() : m_pPyramid(NULL), m_pTexels(NULL), m_Width(0), m_Height(0) {}
+
+	// pPyramid is the pyramid of the bound displacement texture and has to outlive the
+	// field. worldScale is the diagonal of the World matrix, scaling and displacementLevel
+	// are DrawConstants::Scaling and DisplacementLevel. false if the pyramid is not built.
+	bool Init(const HeightPyramid* pPyramid, const float worldScale[3], float scaling, float displacementLevel);
+
+	bool IsValid() const { return m_pPyramid != NULL; }
+
+	// Whether (x, z) lies over the terrain quad
+	bool IsInside(float x, float z) const;
+
+	// World height DS displaces the point at (x, z) to. Outside the quad the texels wrap
+	// like the sampler's.
+	float SampleHeight(float x, float z) const;
+
+	// Bilinearly filtered height, and the unit normal of the filtered surface if normal
+	// is not NULL
+	float SampleBilinear(float x, float z, float normal[3] = NULL) const;
+
+	// Distance along the ray to its first point on or under the point-sampled surface,
+	// over the quad and within MaxDistance. TERRAIN_RAY_MISS if there is none, 0 if the
+	// ray starts under the surface.
+	float IntersectRay(const TerrainRay& ray) const;
+
+	// Batches of count queries split across numThreads threads, 0 uses every hardware
+	// thread. pNormals holds 3 floats per query and may be NULL.
+	void SampleHeights(const float* pX, const float* pZ, int count, float* pHeights, int numThreads = 1) const;
+	void SampleBilinearHeights(const float* pX, const float* pZ, int count, float* pHeights, float* pNormals,
+		int numThreads = 1) const;
+	void IntersectRays(const TerrainRay* pRays, int count, float* pDistances, int numThreads = 1) const;
+
+private:
+	struct RayContext
+	{
+		float Origin[3];            // x and z in texels
+		float Direction[3];
+		float InvDirection[3];      // x and z only
+	};
+
+	void SampleHeightRange(const float* pX, const float* pZ, int begin, int end, float* pHeights) const;
+	void SampleBilinearRange(const float* pX, const float* pZ, int begin, int end, float* pHeights,
+		float* pNormals) const;
+	float IntersectNode(const RayContext& ray, int level, int nodeX, int nodeZ, float t0, float t1) const;
+
+	const HeightPyramid* m_pPyramid;
+	const unsigned char* m_pTexels;
+	int m_Width;
+	int m_Height;
+	float m_UScale[2];          // texture coordinate per world unit along x and z
+	float m_TexelScale[2];      // texels per world unit
+	float m_Heights[256];       // world height of every texel value
+};
@@ -0,0 +1,365 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainHeightFieldSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TerrainHeightField.h"
+#include "HeightPyramid.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "Tessellator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Terrain height queries. The synthetic heightmap has odd sizes so that the pyramid has
+// partial nodes and the wrap addressing differs from a mask. Heights are checked
+// against domain points displaced like DS, rays against every texel column.
+//--------------------------------------------------------------------------------------
+#define HEIGHTS_MAP_WIDTH       300
+#define HEIGHTS_MAP_HEIGHT      200
+#define HEIGHTS_PATCHES         8
+#define HEIGHTS_FACTOR          9.0f
+#define HEIGHTS_RANDOM_POINTS   20000
+#define HEIGHTS_RAYS            2000
+#define HEIGHTS_TEXEL_EPSILON   1e-3f
+
+float RandomFloat(unsigned int& state, float low, float high)
+{
+	state = state * 1664525u + 1013904223u;
+	return low + (high - low) * (float)(state >> 8) / 16777216.0f;
+}
+
+// Distance of a texel coordinate from the nearest texel edge
+static float TexelEdgeDistance(float coordinate)
+{
+	return fabsf(coordinate - floorf(coordinate + 0.5f));
+}
+
+// Bilinear height and normal in double, wrapping like the linear sampler
+static double ReferenceBilinear(const std::vector<unsigned char>& texels, int width, int height, double u, double v,
+	double heightScale, const float worldScale[3], double normal[3])
+{
+	double s = u * width - 0.5, t = v * height - 0.5;
+	double s0 = floor(s), t0 = floor(t);
+	double fx = s - s0, fz = t - t0;
+	int x0 = (((int)s0 % width) + width) % width, x1 = (x0 + 1) % width;
+	int z0 = (((int)t0 % height) + height) % height, z1 = (z0 + 1) % height;
+	double h00 = texels[(size_t)z0 * width + x0] * heightScale, h10 = texels[(size_t)z0 * width + x1] * heightScale;
+	double h01 = texels[(size_t)z1 * width + x0] * heightScale, h11 = texels[(size_t)z1 * width + x1] * heightScale;
+	double bottom = h00 + (h10 - h00) * fx, top = h01 + (h11 - h01) * fx;
+	double dx = ((h10 - h00) * (1.0 - fz) + (h11 - h01) * fz) * width * 0.5 / worldScale[0];
+	double dz = (top - bottom) * height * 0.5 / worldScale[2];
+	double length = sqrt(dx * dx + dz * dz + 1.0);
+	normal[0] = -dx / length;
+	normal[1] = 1.0 / length;
+	normal[2] = -dz / length;
+	return bottom + (top - bottom) * fz;
+}
+
+// First hit of a ray with any texel column over the quad, in double
+static double ReferenceRayHit(const std::vector<unsigned char>& texels, int width, int height, double heightScale,
+	const float worldScale[3], const TerrainRay& ray)
+{
+	double best = -1.0;
+	for (int z = 0; z < height; z++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			double bounds[2][2] =
+			{
+				{ ((double)x / width * 2.0 - 1.0) * worldScale[0], ((double)(x + 1) / width * 2.0 - 1.0) * worldScale[0] },
+				{ ((double)z / height * 2.0 - 1.0) * worldScale[2], ((double)(z + 1) / height * 2.0 - 1.0) * worldScale[2] },
+			};
+			double t0 = 0.0, t1 = ray.MaxDistance;
+			for (int axis = 0; axis < 2; axis++)
+			{
+				double origin = ray.Origin[axis * 2], direction = ray.Direction[axis * 2];
+				if (direction == 0.0)
+				{
+					if (origin < bounds[axis][0] || origin > bounds[axis][1])
+						t0 = t1 + 1.0;
+					continue;
+				}
+				double enter = (bounds[axis][0] - origin) / direction, exit = (bounds[axis][1] - origin) / direction;
+				if (enter > exit)
+					std::swap(enter, exit);
+				t0 = std::max(t0, enter);
+				t1 = std::min(t1, exit);
+			}
+			if (t0 > t1)
+				continue;
+
+			double top = texels[(size_t)z * width + x] * heightScale;
+			double hit = -1.0;
+			if (ray.Origin[1] + ray.Direction[1] * t0 <= top)
+				hit = t0;
+			else if (ray.Origin[1] + ray.Direction[1] * t1 <= top)
+				hit = (top - ray.Origin[1]) / ray.Direction[1];
+			if (hit >= 0.0 && (best < 0.0 || hit < best))
+				best = hit;
+		}
+	}
+	return best;
+}
+
+int VerifyHeightField()
+{
+	SuiteCheck check("heights");
+	const int width = HEIGHTS_MAP_WIDTH, height = HEIGHTS_MAP_HEIGHT;
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(width, height, texels);
+	HeightPyramid pyramid, empty;
+	pyramid.Build(&texels[0], width, height, width, 1);
+
+	SceneCamera camera;
+	SceneSettings settings;
+	SceneFrame scene;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, 16.0f / 9.0f, 0.01f, 100.0f, projection);
+	UpdateScene(camera, settings, projection, 0.0f, scene);
+
+	TerrainHeightField field;
+	check.FailIf(field.Init(&empty, scene.WorldScale, scene.Draw.Scaling, scene.Draw.DisplacementLevel) ||
+		field.IsValid() || !field.Init(&pyramid, scene.WorldScale, scene.Draw.Scaling, scene.Draw.DisplacementLevel),
+		"Init accepts an empty pyramid or rejects a built one");
+
+	// Domain points of the tessellated grid displaced like DS: the interpolated texture
+	// coordinate selects the texel. Only points on a texel edge may round differently.
+	TerrainGrid grid;
+	grid.Build(HEIGHTS_PATCHES, HEIGHTS_PATCHES);
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(TESS_PARTITIONING_INTEGER);
+	pTessellator->TessellateTriDomain(HEIGHTS_FACTOR, HEIGHTS_FACTOR, HEIGHTS_FACTOR, HEIGHTS_FACTOR);
+	int pointCount = pTessellator->GetPointCount();
+	std::vector<float> x, z, u, v, y(pointCount), expected, heights, batch;
+	int domainErrors = 0, edgePoints = 0;
+	for (int patch = 0; patch < grid.GetPatchCount() * 2; patch++)
+	{
+		unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+		grid.GetPatchIndices(patch / 2, indices);
+		float positions[3][3], texCoords[3][3];
+		for (int p = 0; p < 3; p++)
+		{
+			float position[3];
+			grid.GetVertex(indices[(patch % 2) * 3 + p], position, texCoords[p]);
+			texCoords[p][2] = 0.0f;
+			for (int c = 0; c < 3; c++)
+				positions[p][c] = position[c] * scene.WorldScale[c];
+		}
+		size_t first = x.size();
+		x.resize(first + pointCount);
+		z.resize(first + pointCount);
+		u.resize(first + pointCount);
+		v.resize(first + pointCount);
+		TessEvaluateTriDomain(pTessellator->GetPointsU(), pTessellator->GetPointsV(), pointCount, positions,
+			&x[first], &y[0], &z[first]);
+		TessEvaluateTriDomain(pTessellator->GetPointsU(), pTessellator->GetPointsV(), pointCount, texCoords,
+			&u[first], &v[first], &y[0]);
+	}
+	delete pTessellator;
+
+	heights.resize(x.size());
+	for (size_t i = 0; i < x.size(); i++)
+	{
+		float displaced = SampleHeightPoint(texels, width, height, u[i], v[i]) * scene.Draw.Scaling * scene.Draw.DisplacementLevel;
+		heights[i] = field.SampleHeight(x[i], z[i]);
+		if (heights[i] == displaced)
+			continue;
+		if (TexelEdgeDistance(u[i] * width) < HEIGHTS_TEXEL_EPSILON || TexelEdgeDistance(v[i] * height) < HEIGHTS_TEXEL_EPSILON)
+			edgePoints++;
+		else
+			domainErrors++;
+	}
+	check.FailIf(domainErrors > 0, "%d of %d domain points differ from the displacement of DS", domainErrors,
+		(int)x.size());
+
+	// Random points around the quad wrap like the sampler, the batches in lanes and on
+	// threads return the same heights
+	unsigned int random = 12345;
+	x.resize(HEIGHTS_RANDOM_POINTS);
+	z.resize(HEIGHTS_RANDOM_POINTS);
+	expected.resize(HEIGHTS_RANDOM_POINTS);
+	heights.resize(HEIGHTS_RANDOM_POINTS);
+	batch.resize(HEIGHTS_RANDOM_POINTS);
+	for (int i = 0; i < HEIGHTS_RANDOM_POINTS; i++)
+	{
+		x[i] = RandomFloat(random, -1.5f, 1.5f) * scene.WorldScale[0];
+		z[i] = RandomFloat(random, -1.5f, 1.5f) * scene.WorldScale[2];
+		float pointU = x[i] * (0.5f / scene.WorldScale[0]) + 0.5f;
+		float pointV = z[i] * (0.5f / scene.WorldScale[2]) + 0.5f;
+		expected[i] = SampleHeightPoint(texels, width, height, pointU, pointV) * scene.Draw.Scaling * scene.Draw.DisplacementLevel;
+	}
+	int wrapErrors = 0, batchErrors = 0;
+	field.SampleHeights(&x[0], &z[0], HEIGHTS_RANDOM_POINTS, &heights[0]);
+	field.SampleHeights(&x[0], &z[0], HEIGHTS_RANDOM_POINTS, &batch[0], 4);
+	for (int i = 0; i < HEIGHTS_RANDOM_POINTS; i++)
+	{
+		wrapErrors += (heights[i] != expected[i]) ? 1 : 0;
+		batchErrors += (batch[i] != heights[i] || field.SampleHeight(x[i], z[i]) != heights[i]) ? 1 : 0;
+	}
+	check.FailIf(wrapErrors > 0 || batchErrors > 0, "%d wrapped point heights are wrong, %d batched ones differ",
+		wrapErrors, batchErrors);
+
+	// Bilinear heights and normals against double precision, lanes against single lookups
+	std::vector<float> normals(HEIGHTS_RANDOM_POINTS * 3), batchNormals(HEIGHTS_RANDOM_POINTS * 3);
+	field.SampleBilinearHeights(&x[0], &z[0], HEIGHTS_RANDOM_POINTS, &heights[0], &normals[0]);
+	field.SampleBilinearHeights(&x[0], &z[0], HEIGHTS_RANDOM_POINTS, &batch[0], &batchNormals[0], 4);
+	double heightScale = scene.Draw.Scaling * scene.Draw.DisplacementLevel / 255.0;
+	double maxHeightError = 0.0, maxNormalError = 0.0, maxBatchError = 0.0;
+	for (int i = 0; i < HEIGHTS_RANDOM_POINTS; i++)
+	{
+		double normal[3];
+		double reference = ReferenceBilinear(texels, width, height, x[i] * (0.5 / scene.WorldScale[0]) + 0.5,
+			z[i] * (0.5 / scene.WorldScale[2]) + 0.5, heightScale, scene.WorldScale, normal);
+		float single[3];
+		float singleHeight = field.SampleBilinear(x[i], z[i], single);
+		maxHeightError = std::max(maxHeightError, fabs(heights[i] - reference));
+		maxBatchError = std::max(maxBatchError, (double)fabsf(batch[i] - heights[i]));
+		maxBatchError = std::max(maxBatchError, (double)fabsf(singleHeight - heights[i]));
+		for (int c = 0; c < 3; c++)
+		{
+			maxNormalError = std::max(maxNormalError, fabs(normals[i * 3 + c] - normal[c]));
+			maxBatchError = std::max(maxBatchError, (double)fabsf(batchNormals[i * 3 + c] - normals[i * 3 + c]));
+			maxBatchError = std::max(maxBatchError, (double)fabsf(single[c] - normals[i * 3 + c]));
+		}
+	}
+	check.FailIf(maxHeightError > 1e-4 || maxNormalError > 1e-3 || maxBatchError > 1e-6,
+		"bilinear error %g, normal error %g, batch difference %g", maxHeightError, maxNormalError, maxBatchError);
+
+	// Rays from above, beside and under the terrain against every column
+	std::vector<TerrainRay> rays(HEIGHTS_RAYS);
+	for (int i = 0; i < HEIGHTS_RAYS; i++)
+	{
+		TerrainRay& ray = rays[i];
+		ray.Origin[0] = RandomFloat(random, -1.3f, 1.3f) * scene.WorldScale[0];
+		ray.Origin[1] = RandomFloat(random, -0.1f, 1.5f);
+		ray.Origin[2] = RandomFloat(random, -1.3f, 1.3f) * scene.WorldScale[2];
+		ray.Direction[0] = RandomFloat(random, -1.0f, 1.0f);
+		ray.Direction[1] = RandomFloat(random, -1.0f, 0.2f);
+		ray.Direction[2] = RandomFloat(random, -1.0f, 1.0f);
+		if (i % 16 == 0)
+			ray.Direction[0] = 0.0f;
+		if (i % 16 == 1)
+			ray.Direction[1] = 0.0f;
+		ray.MaxDistance = RandomFloat(random, 1.0f, 12.0f);
+	}
+	std::vector<float> distances(HEIGHTS_RAYS), batchDistances(HEIGHTS_RAYS);
+	field.IntersectRays(&rays[0], HEIGHTS_RAYS, &distances[0]);
+	field.IntersectRays(&rays[0], HEIGHTS_RAYS, &batchDistances[0], 4);
+	int rayErrors = 0, hits = 0, rayBatchErrors = 0;
+	for (int i = 0; i < HEIGHTS_RAYS; i++)
+	{
+		double reference = ReferenceRayHit(texels, width, height, heightScale, scene.WorldScale, rays[i]);
+		bool hit = distances[i] != TERRAIN_RAY_MISS;
+		hits += hit ? 1 : 0;
+		if (hit != (reference >= 0.0) || (hit && fabs(distances[i] - reference) > 1e-4 * (1.0 + reference)))
+			rayErrors++;
+		rayBatchErrors += (batchDistances[i] != distances[i]) ? 1 : 0;
+	}
+	check.FailIf(rayErrors > 0 || rayBatchErrors > 0 || hits == 0 || hits == HEIGHTS_RAYS,
+		"%d of %d rays differ from the column reference (%d hits), %d batched ones differ", rayErrors, HEIGHTS_RAYS,
+		hits, rayBatchErrors);
+	TerrainRay under = { { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, 1.0f };
+	TerrainRay outside = { { 2.0f * scene.WorldScale[0], 0.0f, 0.0f }, { 1.0f, -1.0f, 0.0f }, 100.0f };
+	check.FailIf(field.IntersectRay(under) != 0.0f || field.IntersectRay(outside) != TERRAIN_RAY_MISS,
+		"a ray under the terrain or leaving the quad returns %g and %g", field.IntersectRay(under),
+		field.IntersectRay(outside));
+
+	// Ground following raises an eye under the terrain, leaves one above it or beside the
+	// quad alone
+	SceneCamera low, high, beside;
+	low.Eye[0] = high.Eye[0] = 0.3f;
+	low.Eye[2] = high.Eye[2] = -0.7f;
+	low.Eye[1] = -1.0f;
+	high.Eye[1] = 5.0f;
+	beside.Eye[0] = 2.0f * scene.WorldScale[0];
+	beside.Eye[1] = -1.0f;
+	UpdateScene(low, settings, projection, 0.0f, scene, &pyramid);
+	UpdateScene(high, settings, projection, 0.0f, scene, &pyramid);
+	UpdateScene(beside, settings, projection, 0.0f, scene, &pyramid);
+	float ground = field.SampleBilinear(0.3f, -0.7f) + low.GroundClearance;
+	SceneSettings noFollow;
+	noFollow.GroundFollow = false;
+	SceneCamera free;
+	free.Eye[1] = -1.0f;
+	UpdateScene(free, noFollow, projection, 0.0f, scene, &pyramid);
+	check.FailIf(low.Eye[1] != ground || high.Eye[1] != 5.0f || beside.Eye[1] != -1.0f || free.Eye[1] != -1.0f,
+		"ground following moves the eyes to %g, %g, %g and %g (ground %g)", low.Eye[1], high.Eye[1], beside.Eye[1],
+		free.Eye[1], ground);
+
+	return check.Finish("%d domain points (%d on texel edges), %d random points, %d rays (%d hits)",
+		(int)(grid.GetPatchCount() * 2 * pointCount), edgePoints, HEIGHTS_RANDOM_POINTS, HEIGHTS_RAYS, hits);
+}
+
+void RunHeightFieldSuite()
+{
+	const int size = 4096;
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(size, size, texels);
+	HeightPyramid pyramid;
+	pyramid.Build(&texels[0], size, size, size, 1);
+
+	SceneCamera camera;
+	SceneSettings settings;
+	settings.QuadtreeLod = true;
+	SceneFrame scene;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, 16.0f / 9.0f, 0.01f, 100.0f, projection);
+	UpdateScene(camera, settings, projection, 0.0f, scene);
+	TerrainHeightField field;
+	field.Init(&pyramid, scene.WorldScale, scene.Draw.Scaling, scene.Draw.DisplacementLevel);
+
+	// Queries scattered over the terrain, rays cast down from above it at grazing to
+	// steep angles, like picking and line of sight
+	const int queries = 1 << 18, rayCount = 1 << 15;
+	unsigned int random = 777;
+	std::vector<float> x(queries), z(queries), heights(queries), normals(queries * 3);
+	for (int i = 0; i < queries; i++)
+	{
+		x[i] = RandomFloat(random, -1.0f, 1.0f) * scene.WorldScale[0];
+		z[i] = RandomFloat(random, -1.0f, 1.0f) * scene.WorldScale[2];
+	}
+	std::vector<TerrainRay> rays(rayCount);
+	std::vector<float> distances(rayCount);
+	for (int i = 0; i < rayCount; i++)
+	{
+		TerrainRay& ray = rays[i];
+		ray.Origin[0] = RandomFloat(random, -1.0f, 1.0f) * scene.WorldScale[0];
+		ray.Origin[1] = scene.Draw.Scaling * scene.Draw.DisplacementLevel * RandomFloat(random, 1.0f, 2.0f);
+		ray.Origin[2] = RandomFloat(random, -1.0f, 1.0f) * scene.WorldScale[2];
+		float angle = RandomFloat(random, 0.0f, 6.2831853f);
+		ray.Direction[0] = cosf(angle);
+		ray.Direction[1] = -RandomFloat(random, 0.02f, 1.0f);
+		ray.Direction[2] = sinf(angle);
+		ray.MaxDistance = 4.0f * scene.WorldScale[0];
+	}
+
+	int threadCounts[2] = { 1, 0 };
+	for (int t = 0; t < 2; t++)
+	{
+		int threads = threadCounts[t];
+		const int repeats = 8;
+		double start = GetTimeSeconds();
+		for (int r = 0; r < repeats; r++)
+			field.SampleHeights(&x[0], &z[0], queries, &heights[0], threads);
+		double pointSeconds = (GetTimeSeconds() - start) / repeats;
+		start = GetTimeSeconds();
+		for (int r = 0; r < repeats; r++)
+			field.SampleBilinearHeights(&x[0], &z[0], queries, &heights[0], &normals[0], threads);
+		double bilinearSeconds = (GetTimeSeconds() - start) / repeats;
+		start = GetTimeSeconds();
+		field.IntersectRays(&rays[0], rayCount, &distances[0], threads);
+		double raySeconds = GetTimeSeconds() - start;
+		int hits = 0;
+		for (int i = 0; i < rayCount; i++)
+			hits += (distances[i] != TERRAIN_RAY_MISS) ? 1 : 0;
+
+		printf("heights %dx%d  %s  point %6.1f M/s  bilinear+normal %6.1f M/s  rays %6.2f M/s (%d%% hit)  "
+			"20k bilinear + 10k rays %.3f ms\n", size, size, threads == 1 ? "1 thread  " : "all threads",
+			queries / pointSeconds * 1e-6, queries / bilinearSeconds * 1e-6, rayCount / raySeconds * 1e-6,
+			100 * hits / rayCount, (20000.0 * bilinearSeconds / queries + 10000.0 * raySeconds / rayCount) * 1e3);
+	}
+}
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainPatchJobs.cpp
+//--------------------------------------------------------------------------------------
+#include "TerrainPatchJobs.h"
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// TerrainPatchJobs
+//--------------------------------------------------------------------------------------
+int TerrainPatchJobs::Run(JobSystem& jobs, const TerrainGrid& grid, const SceneCamera& camera,
+	const SceneSettings& settings, const SceneFrame& frame, float projScale, float viewportHeight, int* pVisiblePatches,
+	long long* pTriangles)
+{
+	if (jobs.GetThreadCount() == 0)
+		jobs.Init();
+
+	m_pJobs = &jobs;
+	m_pGrid = &grid;
+	m_pCamera = &camera;
+	m_pSettings = &settings;
+	m_pFrame = &frame;
+	m_ProjScale = projScale;
+	m_ViewportHeight = viewportHeight;
+	m_pVisiblePatches = pVisiblePatches;
+	m_VisibleCount = 0;
+	m_Triangles = 0;
+
+	int ranges = (grid.GetPatchCount() + TERRAIN_JOB_RANGE_SIZE - 1) / TERRAIN_JOB_RANGE_SIZE;
+	m_RangePatches.resize(ranges);
+	m_RangeCounts.resize(ranges);
+	m_RangeOffsets.resize(ranges);
+	m_RangeTriangles.resize(ranges);
+	if ((int)m_Counters.size() < jobs.GetThreadCount())
+		m_Counters.resize(jobs.GetThreadCount());
+	for (size_t c = 0; c < m_Counters.size(); c++)
+		m_Counters[c].SetDensityMap(m_pDensityMap);
+
+	// The passes only read the members, so the graph is only built again for another
+	// number of ranges and the lambdas do not allocate per frame
+	if (m_Graph.GetPassCount() == 0 || m_GraphRanges != ranges)
+	{
+		m_Graph.Clear();
+		JobPassId cull = m_Graph.AddParallelPass("cull and count", ranges, 1,
+			[this](int begin, int end, int worker) { CullRanges(begin, end, worker); });
+		JobPassId sum = m_Graph.AddPass("offsets", [this](int) { SumRanges(); }, std::vector<JobPassId>(1, cull));
+		m_Graph.AddParallelPass("draw list", ranges, 1, [this](int begin, int end, int) { CopyRanges(begin, end); },
+			std::vector<JobPassId>(1, sum));
+		m_GraphRanges = ranges;
+	}
+	m_Graph.Execute(jobs);
+
+	if (pTriangles)
+		*pTriangles = m_Triangles;
+	return m_VisibleCount;
+}
+
+void TerrainPatchJobs::CullRanges(int begin, int end, int worker)
+{
+	BoundsSoA bounds = m_pGrid->GetBounds();
+	int patchCount = m_pGrid->GetPatchCount();
+	for (int range = begin; range < end; range++)
+	{
+		int first = range * TERRAIN_JOB_RANGE_SIZE;
+		int count = patchCount - first < TERRAIN_JOB_RANGE_SIZE ? patchCount - first : TERRAIN_JOB_RANGE_SIZE;
+		BoundsSoA rangeBounds = bounds;
+		rangeBounds.CenterX += first;
+		rangeBounds.CenterY += first;
+		rangeBounds.CenterZ += first;
+		rangeBounds.ExtentX += first;
+		rangeBounds.ExtentY += first;
+		rangeBounds.ExtentZ += first;
+
+		int* pPatches = m_pJobs->GetFrameArena(worker).AllocateArray<int>(count);
+		int visible = CullBoxes(m_pFrame->ViewFrustum, rangeBounds, count, pPatches);
+		for (int i = 0; i < visible; i++)
+			pPatches[i] += first;
+		m_RangePatches[range] = pPatches;
+		m_RangeCounts[range] = visible;
+		m_RangeTriangles[range] = m_Counters[worker].Count(*m_pGrid, pPatches, visible, *m_pCamera, *m_pSettings,
+			*m_pFrame, m_ProjScale, m_ViewportHeight);
+	}
+}
+
+void TerrainPatchJobs::SumRanges()
+{
+	int offset = 0;
+	long long triangles = 0;
+	for (size_t range = 0; range < m_RangeCounts.size(); range++)
+	{
+		m_RangeOffsets[range] = offset;
+		offset += m_RangeCounts[range];
+		triangles += m_RangeTriangles[range];
+	}
+	m_VisibleCount = offset;
+	m_Triangles = triangles;
+}
+
+void TerrainPatchJobs::CopyRanges(int begin, int end)
+{
+	for (int range = begin; range < end; range++)
+	{
+		if (m_RangeCounts[range] > 0)
+			memcpy(m_pVisiblePatches + m_RangeOffsets[range], m_RangePatches[range], m_RangeCounts[range] * sizeof(int));
+	}
+}
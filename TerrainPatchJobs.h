@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainPatchJobs.h
+//
+// The per-frame patch processing of the grid terrain as a JobGraph: the patches are
+// culled and the triangles of the visible ones counted from the factors of ConstHS or
+// ConstQuadHS in ranges of TERRAIN_JOB_RANGE_SIZE patches, then the visible patches of
+// every range are copied to the draw list at the offsets of a prefix sum. The ranges
+// are fixed, so the draw list and the count are the same on any number of threads and
+// match TerrainGrid::Cull and TerrainTriangleCounter::Count.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "JobSystem.h"
+#include "SceneUpdate.h"
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define TERRAIN_JOB_RANGE_SIZE 512
+
+
+//--------------------------------------------------------------------------------------
+// TerrainPatchJobs
+//--------------------------------------------------------------------------------------
+class TerrainPatchJobs
+{
+public:
+	TerrainPatchJobs() {}
+
+	// The map bound as texDensity, used while SceneSettings::ContentDensity is set
+	void SetDensityMap(const TessDensityMap* pDensityMap) { m_pDensityMap = pDensityMap; }
+
+	// Culls the patches of grid against the frame's frustum, writes the visible ones to
+	// pVisiblePatches in patch order and returns their count. pVisiblePatches must hold
+	// GetPatchCount() entries. The triangles the tessellator generates for them go to
+	// pTriangles. Scratch memory comes from the frame arenas of jobs. projScale is
+	// Projection._22.
+	int Run(JobSystem& jobs, const TerrainGrid& grid, const SceneCamera& camera, const SceneSettings& settings,
+		const SceneFrame& frame, float projScale, float viewportHeight, int* pVisiblePatches, long long* pTriangles);
+
+	// The passes of the last run with their timings
+	const JobGraph& GetGraph() const { return m_Graph; }
+
+private:
+	void CullRanges(int begin, int end, int worker);
+	void SumRanges();
+	void CopyRanges(int begin, int end);
+
+	const TessDensityMap* m_pDensityMap = NULL;
+	JobGraph m_Graph;                               // reads the members below
+	int m_GraphRanges = 0;
+	std::vector<TerrainTriangleCounter> m_Counters; // one per worker
+
+	// Inputs and outputs of the current run
+	JobSystem* m_pJobs = NULL;
+	const TerrainGrid* m_pGrid = NULL;
+	const SceneCamera* m_pCamera = NULL;
+	const SceneSettings* m_pSettings = NULL;
+	const SceneFrame* m_pFrame = NULL;
+	float m_ProjScale = 0.0f;
+	float m_ViewportHeight = 0.0f;
+	int* m_pVisiblePatches = NULL;
+	int m_VisibleCount = 0;
+	long long m_Triangles = 0;
+
+	// Per range
+	std::vector<int*> m_RangePatches;
+	std::vector<int> m_RangeCounts;
+	std::vector<int> m_RangeOffsets;
+	std::vector<long long> m_RangeTriangles;
+};
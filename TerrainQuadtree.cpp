@@ -0,0 +1,258 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainQuadtree.cpp
+//--------------------------------------------------------------------------------------
+#include "TerrainQuadtree.h"
+#include "HeightPyramid.h"
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+int GetQuadtreeSubdivisions(float tessellationFactor)
+{
+	int subdivisions = 4 * (int)floorf(tessellationFactor * 0.25f + 0.5f);
+	return std::min(std::max(subdivisions, 4), 64);
+}
+
+float ComputeQuadtreeLeafRange(float leafWorldSize, int subdivisions, float projScale, float viewportHeight,
+	float targetTriangleSize)
+{
+	// A segment of length s at distance d covers s * projScale / d of the half viewport
+	float segment = leafWorldSize / std::max(subdivisions, 1);
+	float range = segment * projScale * viewportHeight * 0.5f / std::max(targetTriangleSize, 1.0f);
+	return std::min(range, leafWorldSize * QUADTREE_MAX_LEAF_RANGE);
+}
+
+float ComputeQuadtreeMorph(const QuadtreeLodRanges& ranges, int level, float distance)
+{
+	float start = ranges.MorphStart[level];
+	float morph = (distance - start) / (ranges.Range[level] - start);
+	return std::min(std::max(morph, 0.0f), 1.0f);
+}
+
+int GetQuadtreePatchSegments(const QuadtreePatch& patch, int subdivisions)
+{
+	return subdivisions * patch.Size >> patch.Level;
+}
+
+long long CountQuadtreeTriangles(const QuadtreePatch* pPatches, int count, int subdivisions)
+{
+	long long triangles = 0;
+	for (int i = 0; i < count; i++)
+	{
+		long long segments = GetQuadtreePatchSegments(pPatches[i], subdivisions);
+		triangles += 2 * segments * segments;
+	}
+	return triangles;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Nodes
+//--------------------------------------------------------------------------------------
+bool TerrainQuadtree::Build(int levelCount)
+{
+	if (levelCount < 1 || levelCount > QUADTREE_MAX_LEVELS)
+		return false;
+
+	m_LevelCount = levelCount;
+	m_LeavesPerSide = 1 << (levelCount - 1);
+
+	// (4^levels - 1) / 3 nodes, the children of a node are appended when it is reached,
+	// so the array is breadth first and parents come before their children
+	size_t nodeCount = (((size_t)1 << (2 * levelCount)) - 1) / 3;
+	m_Nodes.clear();
+	m_Nodes.reserve(nodeCount);
+
+	QuadtreeNode root = { 0, 0, (unsigned short)m_LeavesPerSide, (unsigned short)(levelCount - 1), -1, 0.0f, 1.0f };
+	m_Nodes.push_back(root);
+	for (size_t i = 0; i < m_Nodes.size(); i++)
+	{
+		QuadtreeNode parent = m_Nodes[i];
+		if (parent.Level == 0)
+			continue;
+
+		m_Nodes[i].FirstChild = (int)m_Nodes.size();
+		unsigned short half = parent.Size / 2;
+		for (int c = 0; c < 4; c++)
+		{
+			QuadtreeNode child = { (unsigned short)(parent.X + (c & 1) * half), (unsigned short)(parent.Z + (c >> 1) * half),
+				half, (unsigned short)(parent.Level - 1), -1, 0.0f, 1.0f };
+			m_Nodes.push_back(child);
+		}
+	}
+	return true;
+}
+
+void TerrainQuadtree::SetHeightRanges(const HeightPyramid& pyramid)
+{
+	// Leaves query the pyramid, parents merge their children, so a parent's range always
+	// contains its children's
+	float scale = 1.0f / m_LeavesPerSide;
+	for (size_t i = m_Nodes.size(); i-- > 0;)
+	{
+		QuadtreeNode& node = m_Nodes[i];
+		if (node.FirstChild < 0)
+		{
+			pyramid.QueryUV(node.X * scale, node.Z * scale, (node.X + node.Size) * scale, (node.Z + node.Size) * scale,
+				node.MinHeight, node.MaxHeight);
+		}
+		else
+		{
+			node.MinHeight = m_Nodes[node.FirstChild].MinHeight;
+			node.MaxHeight = m_Nodes[node.FirstChild].MaxHeight;
+			for (int c = 1; c < 4; c++)
+			{
+				node.MinHeight = std::min(node.MinHeight, m_Nodes[node.FirstChild + c].MinHeight);
+				node.MaxHeight = std::max(node.MaxHeight, m_Nodes[node.FirstChild + c].MaxHeight);
+			}
+		}
+	}
+}
+
+template <class Index>
+static int WriteQuadtreeIndices(const QuadtreePatch* pPatches, int count, unsigned int stride, Index* pIndices)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const QuadtreePatch& patch = pPatches[i];
+		unsigned int v0 = patch.Z * stride + patch.X;   // (-x, -z) corner
+		unsigned int v3 = v0 + patch.Size * stride;     // (-x, +z)
+		*pIndices++ = (Index)v0;
+		*pIndices++ = (Index)(v0 + patch.Size);
+		*pIndices++ = (Index)(v3 + patch.Size);
+		*pIndices++ = (Index)v3;
+	}
+	return count * 4;
+}
+
+int TerrainQuadtree::WritePatchIndices(const QuadtreePatch* pPatches, int count, unsigned short* pIndices) const
+{
+	return WriteQuadtreeIndices(pPatches, count, m_LeavesPerSide + 1, pIndices);
+}
+
+int TerrainQuadtree::WritePatchIndices(const QuadtreePatch* pPatches, int count, unsigned int* pIndices) const
+{
+	return WriteQuadtreeIndices(pPatches, count, m_LeavesPerSide + 1, pIndices);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Selection
+//--------------------------------------------------------------------------------------
+void TerrainQuadtree::ComputeLodRanges(const QuadtreeSelectParams& params, QuadtreeLodRanges& ranges) const
+{
+	// The level below reaches at most one node diagonal beyond its range. The morph range
+	// of a level starts beyond that, so a patch next to a finer one is not morphing yet,
+	// and a finer patch next to a coarser one has fully morphed, as it is out of range.
+	ranges.LevelCount = m_LevelCount;
+	ranges.MorphHeight = GetMorphHeight(params);
+	float previous = 0.0f;
+	float cellX = 2.0f * fabsf(params.WorldScale[0]) / std::max(m_LeavesPerSide, 1);
+	float cellZ = 2.0f * fabsf(params.WorldScale[2]) / std::max(m_LeavesPerSide, 1);
+	for (int level = 0; level < m_LevelCount; level++)
+	{
+		float range;
+		if (level == 0)
+		{
+			range = std::max(params.LeafRange, 1e-3f);
+		}
+		else
+		{
+			float size = (float)(1 << (level - 1));
+			float diagonal = size * sqrtf(cellX * cellX + cellZ * cellZ);
+			range = std::max(2.0f * previous, previous + diagonal / (1.0f - QUADTREE_MORPH_FRACTION));
+		}
+		ranges.Range[level] = range;
+		ranges.MorphStart[level] = previous + (range - previous) * (1.0f - QUADTREE_MORPH_FRACTION);
+		previous = range;
+	}
+}
+
+void TerrainQuadtree::GetNodeBox(const QuadtreeNode& node, const QuadtreeSelectParams& params, float center[3],
+	float extent[3]) const
+{
+	float scale = 1.0f / m_LeavesPerSide;
+	float minHeight = node.MinHeight * params.DisplacementScale;
+	float maxHeight = node.MaxHeight * params.DisplacementScale;
+	center[0] = ((node.X + node.Size * 0.5f) * scale * 2.0f - 1.0f) * params.WorldScale[0];
+	center[1] = (minHeight + maxHeight) * 0.5f;
+	center[2] = ((node.Z + node.Size * 0.5f) * scale * 2.0f - 1.0f) * params.WorldScale[2];
+	extent[0] = fabsf(params.WorldScale[0]) * node.Size * scale;
+	extent[1] = fabsf(maxHeight - minHeight) * 0.5f;
+	extent[2] = fabsf(params.WorldScale[2]) * node.Size * scale;
+}
+
+float TerrainQuadtree::GetMorphHeight(const QuadtreeSelectParams& params) const
+{
+	if (m_Nodes.empty())
+		return 0.0f;
+	return (m_Nodes[0].MinHeight + m_Nodes[0].MaxHeight) * 0.5f * params.DisplacementScale;
+}
+
+static float BoxDistanceSquared(const float point[3], const float center[3], const float extent[3])
+{
+	float distanceSquared = 0.0f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float d = std::max(fabsf(point[axis] - center[axis]) - extent[axis], 0.0f);
+		distanceSquared += d * d;
+	}
+	return distanceSquared;
+}
+
+// Returns false when the node is out of the range of its level, so the parent draws
+// that quarter itself. pending is the number of patches the unvisited siblings of the
+// node and its ancestors still need at least, a node is only refined when its four
+// children fit besides them.
+bool TerrainQuadtree::SelectNode(int index, int pending, SelectContext& context) const
+{
+	const QuadtreeNode& node = m_Nodes[index];
+	const QuadtreeSelectParams& params = *context.pParams;
+	const QuadtreeLodRanges& ranges = *context.pRanges;
+
+	float center[3], extent[3];
+	GetNodeBox(node, params, center, extent);
+	float flatCenter[3] = { center[0], ranges.MorphHeight, center[2] };
+	float flatExtent[3] = { extent[0], 0.0f, extent[2] };
+	float distanceSquared = BoxDistanceSquared(params.Eye, flatCenter, flatExtent);
+	if (index != 0 && distanceSquared > ranges.Range[node.Level] * ranges.Range[node.Level])
+		return false;
+	if (params.pFrustum && !IsBoxVisible(*params.pFrustum, center, extent))
+		return true;
+
+	bool refine = node.FirstChild >= 0 &&
+		distanceSquared <= ranges.Range[node.Level - 1] * ranges.Range[node.Level - 1] &&
+		context.Count + pending + 4 <= context.MaxPatches;
+	if (!refine)
+	{
+		QuadtreePatch patch = { node.X, node.Z, node.Size, node.Level };
+		context.pPatches[context.Count++] = patch;
+		return true;
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		if (!SelectNode(node.FirstChild + c, pending + 3 - c, context))
+		{
+			const QuadtreeNode& child = m_Nodes[node.FirstChild + c];
+			QuadtreePatch patch = { child.X, child.Z, child.Size, node.Level };
+			context.pPatches[context.Count++] = patch;
+		}
+	}
+	return true;
+}
+
+int TerrainQuadtree::Select(const QuadtreeSelectParams& params, QuadtreePatch* pPatches, int maxPatches,
+	QuadtreeLodRanges& ranges) const
+{
+	ComputeLodRanges(params, ranges);
+	if (m_Nodes.empty() || maxPatches < 1)
+		return 0;
+
+	SelectContext context = { &params, &ranges, pPatches, maxPatches, 0 };
+	SelectNode(0, 0, context);
+	return context.Count;
+}
@@ -0,0 +1,167 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainQuadtree.h
+//
+// CDLOD-style quadtree LOD of a square terrain over the [-1, 1] x [-1, 1] object space
+// plane. The leaves are the cells of a TerrainGrid with 2^(levels - 1) cells per side,
+// every node is drawn as one quad patch through the vertices of that grid, so the
+// selection feeds the tessellation pipeline directly.
+//
+// Level l is used up to the distance Range[l] from the eye, so a node is refined where
+// its box is within the range of its children. Distances are measured to the terrain
+// at its mid height, so steep nodes do not stretch the ranges; culling uses the full
+// height range of every node. A node whose children are only partly in range is drawn
+// as quarters: the children in range at their level, the others at the node's level.
+// Every patch is tessellated into a regular grid of Subdivisions segments per 2^Level
+// leaf cells, and in the last QUADTREE_MORPH_FRACTION of its range the odd grid
+// vertices move onto the even ones, so a patch looks like its parent where it ends.
+// The ranges grow fast enough that neighbouring patches differ by at most one level
+// and meet with matching vertices, see ComputeLodRanges.
+//
+// Selection walks the flat node array recursively without allocating and returns at
+// most maxPatches patches, whatever the size of the terrain.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "FrustumCulling.h"
+#include <stddef.h>
+#include <vector>
+
+class HeightPyramid;
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+// Up to 2048 leaf cells per side. Keep in sync with QUADTREE_MAX_LEVELS in
+// DisplacedAndShaded.hlsl
+#define QUADTREE_MAX_LEVELS         12
+
+// Longest leaf range in leaf cells. At low subdivisions or small target triangle sizes
+// the triangles get larger than the target instead of the selection growing to
+// thousands of patches.
+#define QUADTREE_MAX_LEAF_RANGE     4.0f
+
+// Part of each level's range where its vertices morph towards the parent's grid
+#define QUADTREE_MORPH_FRACTION     0.3f
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+// Nodes are stored breadth first, the four children of a node are contiguous
+struct QuadtreeNode
+{
+	unsigned short X, Z;        // leaf cell of the (-x, -z) corner
+	unsigned short Size;        // leaf cells per side, 2^Level
+	unsigned short Level;       // 0 for the leaves
+	int FirstChild;             // -1 for the leaves
+	float MinHeight, MaxHeight; // displacement range in [0, 1]
+};
+
+// One patch of a selection. Size is 2^Level leaf cells, or half of it for a quarter of
+// a node drawn at the node's level.
+struct QuadtreePatch
+{
+	unsigned short X, Z;
+	unsigned short Size;
+	unsigned short Level;
+};
+
+struct QuadtreeSelectParams
+{
+	float Eye[3];
+	const Frustum* pFrustum = NULL;     // NULL selects without culling
+	float WorldScale[3];                // the World matrix is a pure scale
+	float DisplacementScale;            // world height of the full displacement range
+	float LeafRange;                    // distance up to which the leaves are used, see ComputeQuadtreeLeafRange
+};
+
+// What the domain shader needs to morph the patches of a selection
+struct QuadtreeLodRanges
+{
+	int LevelCount;
+	float MorphHeight;                  // world height the distances are measured at
+	float Range[QUADTREE_MAX_LEVELS];
+	float MorphStart[QUADTREE_MAX_LEVELS];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Grid segments of a full node patch: the tessellation factor rounded to a multiple of
+// 4 in [4, 64], so quarters have an even number of segments too
+int GetQuadtreeSubdivisions(float tessellationFactor);
+
+// Distance at which a triangle of a leaf patch is targetTriangleSize pixels tall, at
+// most QUADTREE_MAX_LEAF_RANGE leaf cells. projScale is Projection._22.
+float ComputeQuadtreeLeafRange(float leafWorldSize, int subdivisions, float projScale, float viewportHeight,
+	float targetTriangleSize);
+
+// Morph factor of a vertex of a level patch at a distance from the eye, measured to the
+// vertex at MorphHeight: 0 before the morph range, 1 at the end of the level's range.
+// Keep in sync with QuadtreeMorph in DisplacedAndShaded.hlsl.
+float ComputeQuadtreeMorph(const QuadtreeLodRanges& ranges, int level, float distance);
+
+// Grid segments per side of a patch, half of subdivisions for a quarter
+int GetQuadtreePatchSegments(const QuadtreePatch& patch, int subdivisions);
+
+// Triangles of the patches, each is an integer partitioned grid of 2 n^2 triangles
+long long CountQuadtreeTriangles(const QuadtreePatch* pPatches, int count, int subdivisions);
+
+
+//--------------------------------------------------------------------------------------
+// TerrainQuadtree
+//--------------------------------------------------------------------------------------
+class TerrainQuadtree
+{
+public:
+	TerrainQuadtree() : m_LevelCount(0), m_LeavesPerSide(0) {}
+
+	// Builds the nodes of 2^(levelCount - 1) leaf cells per side, returns false on invalid
+	// level counts
+	bool Build(int levelCount);
+
+	// Displacement range of every node from the min/max pyramid of the displacement map.
+	// Defaults to the full [0, 1] range until set.
+	void SetHeightRanges(const HeightPyramid& pyramid);
+
+	// Ranges of every level for a view. Level 0 ends at LeafRange, every level at least
+	// doubles the range of the one below, and the morph range of a level starts beyond
+	// where any patch of the level below can reach, so a patch never morphs next to a
+	// finer one.
+	void ComputeLodRanges(const QuadtreeSelectParams& params, QuadtreeLodRanges& ranges) const;
+
+	// Selects the patches of a view and returns their number. A node is only refined
+	// while the patches fit, the limit keeps the count bounded but can leave neighbours
+	// more than one level apart.
+	int Select(const QuadtreeSelectParams& params, QuadtreePatch* pPatches, int maxPatches, QuadtreeLodRanges& ranges) const;
+
+	// Four indices per patch into the vertices of TerrainGrid::Build(GetLeavesPerSide(),
+	// GetLeavesPerSide()), in the order of TerrainGrid::GetQuadPatchIndices. 16-bit
+	// indices reach up to 128 leaf cells per side, 32-bit ones any quadtree.
+	int WritePatchIndices(const QuadtreePatch* pPatches, int count, unsigned short* pIndices) const;
+	int WritePatchIndices(const QuadtreePatch* pPatches, int count, unsigned int* pIndices) const;
+
+	int GetLevelCount() const { return m_LevelCount; }
+	int GetLeavesPerSide() const { return m_LeavesPerSide; }
+	int GetNodeCount() const { return (int)m_Nodes.size(); }
+	const QuadtreeNode& GetNode(int node) const { return m_Nodes[node]; }
+
+private:
+	struct SelectContext
+	{
+		const QuadtreeSelectParams* pParams;
+		const QuadtreeLodRanges* pRanges;
+		QuadtreePatch* pPatches;
+		int MaxPatches;
+		int Count;
+	};
+
+	void GetNodeBox(const QuadtreeNode& node, const QuadtreeSelectParams& params, float center[3], float extent[3]) const;
+	float GetMorphHeight(const QuadtreeSelectParams& params) const;
+	bool SelectNode(int node, int pending, SelectContext& context) const;
+
+	int m_LevelCount;
+	int m_LeavesPerSide;
+	std::vector<QuadtreeNode> m_Nodes;
+};
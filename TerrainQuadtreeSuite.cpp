@@ -0,0 +1,400 @@
+//--------------------------------------------------------------------------------------
+// File: TerrainQuadtreeSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TerrainQuadtree.h"
+#include "HeightPyramid.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "Tessellator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Quadtree LOD. The selections of random views over a synthetic heightmap have to tile
+// the terrain with neighbours at most one level apart, and where the levels differ the
+// finer side has to be fully morphed and the coarser one not at all, or cracks open.
+//--------------------------------------------------------------------------------------
+#define QUADTREE_VERIFY_LEVELS  7
+#define QUADTREE_LARGE_LEVELS   11
+#define QUADTREE_VIEWS          32
+#define QUADTREE_MORPH_EPSILON  1e-3f
+
+float SampleHeightPoint(const std::vector<unsigned char>& texels, int width, int height, float u, float v)
+{
+	int x = ((int)floorf(u * width) % width + width) % width;
+	int y = ((int)floorf(v * height) % height + height) % height;
+	return texels[(size_t)y * width + x] / 255.0f;
+}
+
+// Distance from the eye of the point at leaf coordinates (x, z) at the morph height, as
+// QuadtreeDS measures it
+static float QuadtreePointDistance(const SceneCamera& camera, const SceneFrame& scene, int leaves, float x, float z)
+{
+	float u = x / leaves, v = z / leaves;
+	float point[3] =
+	{
+		(u * 2.0f - 1.0f) * scene.WorldScale[0],
+		scene.Frame.QuadtreeMorphHeight,
+		(v * 2.0f - 1.0f) * scene.WorldScale[2]
+	};
+	float d[3] = { point[0] - camera.Eye[0], point[1] - camera.Eye[1], point[2] - camera.Eye[2] };
+	return sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+// Checks that the patches cover every leaf once and, unless the selection was cut short
+// by its patch limit, that neighbours across every side differ by at most one level with
+// the morph factors of the domain shader matching. Fails the first problem found.
+static bool CheckQuadtreeSelection(const TerrainQuadtree& quadtree, const QuadtreePatch* pPatches, int count,
+	const SceneCamera& camera, const SceneFrame& scene, bool checkLevels, const char* pLabel, SuiteCheck& check)
+{
+	int leaves = quadtree.GetLeavesPerSide();
+	std::vector<int> leafLevels((size_t)leaves * leaves, -1);
+	for (int i = 0; i < count; i++)
+	{
+		const QuadtreePatch& patch = pPatches[i];
+		if (patch.Size != (1 << patch.Level) && patch.Size * 2 != (1 << patch.Level))
+		{
+			check.Fail("%s: patch %d has size %d at level %d", pLabel, i, patch.Size, patch.Level);
+			return false;
+		}
+		for (int z = patch.Z; z < patch.Z + patch.Size; z++)
+		{
+			for (int x = patch.X; x < patch.X + patch.Size; x++)
+			{
+				if (leafLevels[(size_t)z * leaves + x] >= 0)
+				{
+					check.Fail("%s: leaf %d %d is covered twice", pLabel, x, z);
+					return false;
+				}
+				leafLevels[(size_t)z * leaves + x] = patch.Level;
+			}
+		}
+	}
+	for (size_t leaf = 0; leaf < leafLevels.size(); leaf++)
+	{
+		if (leafLevels[leaf] < 0)
+		{
+			check.Fail("%s: leaf %d %d is not covered", pLabel, (int)(leaf % leaves), (int)(leaf / leaves));
+			return false;
+		}
+	}
+
+	QuadtreeLodRanges ranges;
+	ranges.LevelCount = quadtree.GetLevelCount();
+	for (int level = 0; level < ranges.LevelCount; level++)
+	{
+		ranges.MorphStart[level] = scene.Frame.QuadtreeMorphStart[level];
+		ranges.Range[level] = scene.Frame.QuadtreeRange[level];
+	}
+
+	if (!checkLevels)
+		return true;
+
+	// The inner grid points of every side against the one or two leaves across it, the
+	// corners are even points and never move
+	int subdivisions = (int)scene.Frame.QuadtreeSubdivisions;
+	for (int i = 0; i < count; i++)
+	{
+		const QuadtreePatch& patch = pPatches[i];
+		int segments = GetQuadtreePatchSegments(patch, subdivisions);
+		for (int side = 0; side < 4; side++)
+		{
+			// -z, -x, +z and +x: the side runs along x for -z and +z
+			bool alongX = (side & 1) == 0;
+			int across = (side == 0) ? patch.Z - 1 : (side == 1) ? patch.X - 1 : (side == 2) ? patch.Z + patch.Size : patch.X + patch.Size;
+			if (across < 0 || across >= leaves)
+				continue;
+			for (int p = 1; p < segments; p++)
+			{
+				float t = (float)patch.Size * p / segments;
+				float along = (alongX ? patch.X : patch.Z) + t;
+				float line = (side == 0) ? (float)patch.Z : (side == 1) ? (float)patch.X : (side == 2) ? (float)(patch.Z + patch.Size) :
+					(float)(patch.X + patch.Size);
+				int first = (int)floorf(along);
+				int last = (floorf(along) == along) ? first - 1 : first;
+				float morph = -1.0f;
+				for (int n = std::min(first, last); n <= std::max(first, last); n++)
+				{
+					int neighbourLevel = alongX ? leafLevels[(size_t)across * leaves + n] : leafLevels[(size_t)n * leaves + across];
+					if (abs(neighbourLevel - patch.Level) > 1)
+					{
+						check.Fail("%s: level %d patch next to level %d", pLabel, patch.Level, neighbourLevel);
+						return false;
+					}
+					if (neighbourLevel == patch.Level)
+						continue;
+					if (morph < 0.0f)
+					{
+						float distance = alongX ? QuadtreePointDistance(camera, scene, leaves, along, line) :
+							QuadtreePointDistance(camera, scene, leaves, line, along);
+						morph = ComputeQuadtreeMorph(ranges, patch.Level, distance);
+					}
+					if ((neighbourLevel > patch.Level && morph < 1.0f - QUADTREE_MORPH_EPSILON) ||
+						(neighbourLevel < patch.Level && morph > QUADTREE_MORPH_EPSILON))
+					{
+						check.Fail("%s: level %d patch next to level %d morphs by %g", pLabel, patch.Level,
+							neighbourLevel, morph);
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void RandomQuadtreeView(const SceneSettings& settings, SceneCamera& camera)
+{
+	float sizeX = settings.Scaling * QUADTREE_TERRAIN_SCALE * 1.5f;
+	float sizeZ = settings.Scaling * QUADTREE_TERRAIN_SCALE;
+	camera.Eye[0] = sizeX * (2.4f * rand() / RAND_MAX - 1.2f);
+	camera.Eye[1] = 0.5f + 20.0f * rand() / RAND_MAX * rand() / RAND_MAX;
+	camera.Eye[2] = sizeZ * (2.4f * rand() / RAND_MAX - 1.2f);
+	camera.At[0] = sizeX * (2.0f * rand() / RAND_MAX - 1.0f);
+	camera.At[1] = 0.0f;
+	camera.At[2] = sizeZ * (2.0f * rand() / RAND_MAX - 1.0f);
+}
+
+int VerifyQuadtree()
+{
+	SuiteCheck check("quadtree");
+	TerrainQuadtree quadtree;
+	check.FailIf(quadtree.Build(0) || quadtree.Build(QUADTREE_MAX_LEVELS + 1), "invalid level counts are accepted");
+
+	// Breadth first nodes, the children of a node tile it
+	quadtree.Build(QUADTREE_VERIFY_LEVELS);
+	int leaves = quadtree.GetLeavesPerSide();
+	check.FailIf(leaves != 1 << (QUADTREE_VERIFY_LEVELS - 1) ||
+		quadtree.GetNodeCount() != ((1 << (2 * QUADTREE_VERIFY_LEVELS)) - 1) / 3, "%d leaves per side and %d nodes",
+		leaves, quadtree.GetNodeCount());
+	for (int i = 0; i < quadtree.GetNodeCount(); i++)
+	{
+		const QuadtreeNode& node = quadtree.GetNode(i);
+		bool valid = node.Size == (1 << node.Level) && (node.FirstChild < 0) == (node.Level == 0);
+		for (int c = 0; valid && node.FirstChild >= 0 && c < 4; c++)
+		{
+			const QuadtreeNode& child = quadtree.GetNode(node.FirstChild + c);
+			valid = node.FirstChild > i && child.Level == node.Level - 1 && child.Size * 2 == node.Size &&
+				child.X == node.X + (c & 1) * child.Size && child.Z == node.Z + (c >> 1) * child.Size;
+		}
+		if (!valid)
+		{
+			check.Fail("node %d does not tile its children", i);
+			break;
+		}
+	}
+
+	// Height ranges contain the children and every height a leaf's grid points sample
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, texels);
+	HeightPyramid pyramid;
+	pyramid.Build(&texels[0], DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, 1);
+	quadtree.SetHeightRanges(pyramid);
+	int rangeErrors = 0;
+	for (int i = 0; i < quadtree.GetNodeCount(); i++)
+	{
+		const QuadtreeNode& node = quadtree.GetNode(i);
+		for (int c = 0; node.FirstChild >= 0 && c < 4; c++)
+		{
+			const QuadtreeNode& child = quadtree.GetNode(node.FirstChild + c);
+			if (child.MinHeight < node.MinHeight || child.MaxHeight > node.MaxHeight)
+				rangeErrors++;
+		}
+		if (node.Level != 0)
+			continue;
+		for (int z = 0; z <= 8; z++)
+		{
+			for (int x = 0; x <= 8; x++)
+			{
+				float h = SampleHeightPoint(texels, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, (node.X + x / 8.0f) / leaves,
+					(node.Z + z / 8.0f) / leaves);
+				if (h < node.MinHeight || h > node.MaxHeight)
+					rangeErrors++;
+			}
+		}
+	}
+	check.FailIf(rangeErrors > 0, "%d height ranges miss a child or a sampled height", rangeErrors);
+
+	// Patch corners are the vertices of the leaf grid at the patch's corners
+	TerrainGrid grid;
+	grid.Build(leaves, leaves);
+	QuadtreePatch cornerPatches[2] = { { 3, 5, 1, 0 }, { 16, 8, 8, 4 } };
+	unsigned short cornerIndices[2 * TERRAIN_QUAD_INDICES_PER_PATCH];
+	quadtree.WritePatchIndices(cornerPatches, 2, cornerIndices);
+	unsigned int leafIndices[TERRAIN_QUAD_INDICES_PER_PATCH];
+	grid.GetQuadPatchIndices(5 * leaves + 3, leafIndices);
+	bool cornersMatch = true;
+	for (int v = 0; v < TERRAIN_QUAD_INDICES_PER_PATCH; v++)
+	{
+		float position[3], texCoord[2];
+		grid.GetVertex(cornerIndices[TERRAIN_QUAD_INDICES_PER_PATCH + v], position, texCoord);
+		float expectedU = (16.0f + ((v == 1 || v == 2) ? 8.0f : 0.0f)) / leaves;
+		float expectedV = (8.0f + (v >= 2 ? 8.0f : 0.0f)) / leaves;
+		cornersMatch = cornersMatch && cornerIndices[v] == leafIndices[v] && texCoord[0] == expectedU && texCoord[1] == expectedV;
+	}
+	check.FailIf(!cornersMatch, "patch indices are not the corners of the patches");
+
+	// Random views, selected without culling so the patches have to tile the terrain
+	SceneSettings settings;
+	settings.QuadtreeLod = true;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	std::vector<QuadtreePatch> patches(QUADTREE_MAX_PATCHES);
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(TESS_PARTITIONING_INTEGER);
+	std::vector<long long> segmentTriangles(65, -1);
+	int totalPatches = 0, maxPatches = 0, mixedLevels = 0;
+	srand(17);
+	for (int view = 0; view < QUADTREE_VIEWS; view++)
+	{
+		SceneCamera camera;
+		RandomQuadtreeView(settings, camera);
+		settings.TessellationFactor = (view % 2) ? 64.0f : 4.0f + 60.0f * rand() / RAND_MAX;
+		settings.TargetTriangleSize = 2.0f + 14.0f * rand() / RAND_MAX;
+		SceneFrame scene;
+		UpdateScene(camera, settings, projection, 0.0f, scene);
+		for (int p = 0; p < 6; p++)
+		{
+			for (int c = 0; c < 4; c++)
+				scene.ViewFrustum.Planes[p][c] = (c == 3) ? 1.0f : 0.0f;
+		}
+
+		int count = SelectQuadtreePatches(quadtree, camera, settings, projection[1][1], SCRIPT_VIEWPORT_HEIGHT, scene,
+			&patches[0], QUADTREE_MAX_PATCHES);
+		char label[64];
+		sprintf(label, "view %d", view);
+		if (count >= QUADTREE_MAX_PATCHES - 3)
+		{
+			check.Fail("%s: the selection hit the patch limit", label);
+			continue;
+		}
+		int subdivisions = GetQuadtreeSubdivisions(settings.TessellationFactor);
+		check.FailIf((int)scene.Frame.QuadtreeSubdivisions != subdivisions || subdivisions % 4 != 0,
+			"%s: %g subdivisions for factor %g", label, scene.Frame.QuadtreeSubdivisions, settings.TessellationFactor);
+		CheckQuadtreeSelection(quadtree, &patches[0], count, camera, scene, true, label, check);
+
+		// The counted triangles are the ones the tessellator generates
+		long long tessellated = 0;
+		int minLevel = QUADTREE_MAX_LEVELS, maxLevel = 0;
+		for (int i = 0; i < count; i++)
+		{
+			int segments = GetQuadtreePatchSegments(patches[i], subdivisions);
+			if (segmentTriangles[segments] < 0)
+			{
+				float factor = (float)segments;
+				pTessellator->TessellateQuadDomain(factor, factor, factor, factor, factor, factor);
+				segmentTriangles[segments] = pTessellator->GetIndexCount() / 3;
+			}
+			tessellated += segmentTriangles[segments];
+			minLevel = std::min(minLevel, (int)patches[i].Level);
+			maxLevel = std::max(maxLevel, (int)patches[i].Level);
+		}
+		check.FailIf(CountQuadtreeTriangles(&patches[0], count, subdivisions) != tessellated,
+			"%s: %lld triangles counted, %lld tessellated", label,
+			CountQuadtreeTriangles(&patches[0], count, subdivisions), tessellated);
+		totalPatches += count;
+		maxPatches = std::max(maxPatches, count);
+		mixedLevels += (maxLevel > minLevel) ? 1 : 0;
+
+		// A small patch limit keeps the tiling, only coarser
+		int limited = SelectQuadtreePatches(quadtree, camera, settings, projection[1][1], SCRIPT_VIEWPORT_HEIGHT, scene,
+			&patches[0], 16);
+		check.FailIf(limited > 16, "%s: %d patches selected with a limit of 16", label, limited);
+		CheckQuadtreeSelection(quadtree, &patches[0], limited, camera, scene, false, "limited", check);
+	}
+	delete pTessellator;
+	check.FailIf(mixedLevels < QUADTREE_VIEWS / 2, "only %d views select more than one level", mixedLevels);
+
+	// The count stays bounded on a much larger terrain, and culling only drops patches
+	TerrainQuadtree large;
+	large.Build(QUADTREE_LARGE_LEVELS);
+	large.SetHeightRanges(pyramid);
+	int largeMax = 0;
+	for (int view = 0; view < QUADTREE_VIEWS; view++)
+	{
+		SceneCamera camera;
+		RandomQuadtreeView(settings, camera);
+		settings.TessellationFactor = 64.0f;
+		settings.TargetTriangleSize = 8.0f;
+		SceneFrame scene;
+		UpdateScene(camera, settings, projection, 0.0f, scene);
+		int culled = SelectQuadtreePatches(large, camera, settings, projection[1][1], SCRIPT_VIEWPORT_HEIGHT, scene,
+			&patches[0], QUADTREE_MAX_PATCHES);
+		for (int p = 0; p < 6; p++)
+		{
+			for (int c = 0; c < 4; c++)
+				scene.ViewFrustum.Planes[p][c] = (c == 3) ? 1.0f : 0.0f;
+		}
+		int count = SelectQuadtreePatches(large, camera, settings, projection[1][1], SCRIPT_VIEWPORT_HEIGHT, scene,
+			&patches[0], QUADTREE_MAX_PATCHES);
+		if (culled > count || count >= QUADTREE_MAX_PATCHES - 3)
+		{
+			check.Fail("large terrain view %d selects %d patches, %d culled", view, count, culled);
+			break;
+		}
+		CheckQuadtreeSelection(large, &patches[0], count, camera, scene, true, "large", check);
+		largeMax = std::max(largeMax, count);
+	}
+
+	return check.Finish("%d views, %.1f patches on average, at most %d, %d leaves per side at most %d", QUADTREE_VIEWS,
+		(double)totalPatches / QUADTREE_VIEWS, maxPatches, large.GetLeavesPerSide(), largeMax);
+}
+
+void RunQuadtreeSuite()
+{
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, texels);
+	HeightPyramid pyramid;
+	pyramid.Build(&texels[0], DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, 1);
+
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	std::vector<QuadtreePatch> patches(QUADTREE_MAX_PATCHES);
+	for (int levels = QUADTREE_VERIFY_LEVELS; levels <= QUADTREE_LARGE_LEVELS; levels += 2)
+	{
+		TerrainQuadtree quadtree;
+		double start = GetTimeSeconds();
+		quadtree.Build(levels);
+		double buildSeconds = GetTimeSeconds() - start;
+		start = GetTimeSeconds();
+		quadtree.SetHeightRanges(pyramid);
+		double rangeSeconds = GetTimeSeconds() - start;
+
+		// A flight from high above one corner down across the terrain
+		SceneSettings settings;
+		settings.QuadtreeLod = true;
+		const int frames = 2000;
+		long long totalPatches = 0, totalTriangles = 0;
+		int maxPatches = 0;
+		double selectSeconds = 0.0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			float t = (float)frame / frames;
+			SceneCamera camera;
+			camera.Eye[0] = -30.0f + 60.0f * t;
+			camera.Eye[1] = 1.0f + 30.0f * (1.0f - t) * (1.0f - t);
+			camera.Eye[2] = -20.0f + 30.0f * t;
+			camera.At[0] = camera.Eye[0] + 10.0f;
+			camera.At[1] = 0.0f;
+			camera.At[2] = camera.Eye[2] + 10.0f;
+			SceneFrame scene;
+			UpdateScene(camera, settings, projection, 0.0f, scene);
+			start = GetTimeSeconds();
+			int count = SelectQuadtreePatches(quadtree, camera, settings, projection[1][1], SCRIPT_VIEWPORT_HEIGHT, scene,
+				&patches[0], QUADTREE_MAX_PATCHES);
+			selectSeconds += GetTimeSeconds() - start;
+			totalPatches += count;
+			totalTriangles += CountQuadtreeTriangles(&patches[0], count, (int)scene.Frame.QuadtreeSubdivisions);
+			maxPatches = std::max(maxPatches, count);
+		}
+		printf("quadtree %5d leaves per side  %8d nodes  build %8.3f ms  ranges %8.3f ms  select %7.2f us  "
+			"%6.1f patches (max %4d)  %9.0f triangles\n", quadtree.GetLeavesPerSide(), quadtree.GetNodeCount(),
+			buildSeconds * 1000.0, rangeSeconds * 1000.0, selectSeconds / frames * 1e6, (double)totalPatches / frames,
+			maxPatches, (double)totalTriangles / frames);
+	}
+}
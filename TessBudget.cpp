@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// File: TessBudget.cpp
+//--------------------------------------------------------------------------------------
+#include "TessBudget.h"
+#include "Tessellator.h"
+#include <math.h>
+
+
+//--------------------------------------------------------------------------------------
+// Names
+//--------------------------------------------------------------------------------------
+static const char* s_TessBudgetModeNames[TESS_BUDGET_MODE_COUNT] =
+{
+	"off",
+	"frame time",
+	"triangles",
+};
+
+const char* GetTessBudgetModeName(TESS_BUDGET_MODE mode)
+{
+	return (mode >= 0 && mode < TESS_BUDGET_MODE_COUNT) ? s_TessBudgetModeNames[mode] : "unknown";
+}
+
+
+//--------------------------------------------------------------------------------------
+// TessBudgetController
+//--------------------------------------------------------------------------------------
+void TessBudgetController::SetParams(const TessBudgetParams& params)
+{
+	m_Params = params;
+	m_SmoothedFrameSeconds = -1.0;
+}
+
+bool TessBudgetController::Update(long long triangles, long long maxTriangles, double frameSeconds, SceneSettings& settings)
+{
+	if (m_Params.Mode == TESS_BUDGET_OFF)
+		return false;
+
+	// Single frame times are noisy, the average lags behind a few frames
+	if (frameSeconds > 0.0)
+	{
+		m_SmoothedFrameSeconds = (m_SmoothedFrameSeconds < 0.0) ? frameSeconds :
+			m_SmoothedFrameSeconds + (frameSeconds - m_SmoothedFrameSeconds) * m_Params.FrameTimeSmoothing;
+	}
+
+	// Wanted over current triangles. The frame time is taken to grow with the triangles,
+	// a fixed cost only slows the approach down. Nothing visible tells nothing.
+	double ratio;
+	if (m_Params.Mode == TESS_BUDGET_TRIANGLES)
+	{
+		if (triangles <= 0)
+			return false;
+		ratio = m_Params.TargetTriangles / (double)triangles;
+	}
+	else
+	{
+		if (m_SmoothedFrameSeconds <= 0.0 || triangles <= 0)
+			return false;
+		ratio = m_Params.TargetFrameSeconds / m_SmoothedFrameSeconds;
+	}
+	if (fabs(ratio - 1.0) <= m_Params.Tolerance)
+		return false;
+
+	// The triangles of a patch grow with the square of its factors. Taking a fraction of
+	// the step in log space lets the error decay by (1 - Damping) per frame.
+	double step = pow(ratio, 0.5 * m_Params.Damping);
+	if (step > m_Params.MaxStep)
+		step = m_Params.MaxStep;
+	if (step < 1.0 / m_Params.MaxStep)
+		step = 1.0 / m_Params.MaxStep;
+
+	// Once every adaptive factor is clamped to TessellationFactor a larger scale adds
+	// nothing, it would only have to be wound back before the triangles can drop again
+	if (settings.AdaptiveTessellation && step > 1.0 && triangles >= maxTriangles)
+		return false;
+
+	float& level = settings.AdaptiveTessellation ? settings.TessellationScale : settings.TessellationFactor;
+	float minLevel = settings.AdaptiveTessellation ? m_Params.MinScale : 1.0f;
+	float maxLevel = settings.AdaptiveTessellation ? m_Params.MaxScale : (float)TESS_MAX_FACTOR;
+	float next = (float)(level * step);
+	next = (next < minLevel) ? minLevel : (next > maxLevel ? maxLevel : next);
+	if (next == level)
+		return false;
+	level = next;
+	return true;
+}
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// File: TessBudget.h
+//
+// Automatic tessellation level. A damped controller adjusts the global tessellation
+// factor, or with adaptive tessellation a scale of the per-patch factors, so the frame
+// time or the number of generated triangles stays near a target while the camera moves
+// over terrain of varying cost. It is fed the measured frame times and the triangle
+// counts of TerrainTriangleCounter.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "SceneUpdate.h"
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum TESS_BUDGET_MODE
+{
+	TESS_BUDGET_OFF,            // the factors only change with the keys
+	TESS_BUDGET_FRAME_TIME,     // holds TargetFrameSeconds
+	TESS_BUDGET_TRIANGLES,      // holds TargetTriangles generated triangles per frame
+	TESS_BUDGET_MODE_COUNT,
+};
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct TessBudgetParams
+{
+	TESS_BUDGET_MODE Mode = TESS_BUDGET_OFF;
+	double TargetFrameSeconds = 1.0 / 60.0;
+	double TargetTriangles = 500000.0;
+	float Damping = 0.25f;              // fraction of the error removed per frame, in (0, 1]
+	float FrameTimeSmoothing = 0.25f;   // weight of a new frame time in the running average
+	float Tolerance = 0.05f;            // relative error left alone, keeps the level from hunting
+	float MaxStep = 1.25f;              // largest change of the factor or scale per frame
+	float MinScale = 1.0f / 16.0f;      // range of TessellationScale
+	float MaxScale = 16.0f;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+const char* GetTessBudgetModeName(TESS_BUDGET_MODE mode);
+
+
+//--------------------------------------------------------------------------------------
+// TessBudgetController
+//--------------------------------------------------------------------------------------
+class TessBudgetController
+{
+public:
+	TessBudgetController() : m_SmoothedFrameSeconds(-1.0) {}
+
+	// Changing the parameters restarts the frame time average
+	void SetParams(const TessBudgetParams& params);
+	const TessBudgetParams& GetParams() const { return m_Params; }
+
+	// Adjusts TessellationFactor, or TessellationScale with adaptive tessellation, for the
+	// next frame. triangles is the count of the frame built with settings, maxTriangles
+	// the count with every factor at TessellationFactor, frameSeconds the duration of the
+	// previous frame. Returns true if settings changed.
+	bool Update(long long triangles, long long maxTriangles, double frameSeconds, SceneSettings& settings);
+
+	// Running average of the frame times, negative before the first one
+	double GetSmoothedFrameSeconds() const { return m_SmoothedFrameSeconds; }
+
+private:
+	TessBudgetParams m_Params;
+	double m_SmoothedFrameSeconds;
+};
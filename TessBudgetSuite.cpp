@@ -0,0 +1,194 @@
+//--------------------------------------------------------------------------------------
+// File: TessBudgetSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TessBudget.h"
+#include "BenchmarkScript.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "Tessellator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Tessellation budget. Flies the demo terrain from a distant view down close to the
+// surface and models the frame time as a fixed cost plus a cost per generated triangle,
+// with a little deterministic noise.
+//--------------------------------------------------------------------------------------
+#define BUDGET_FRAMES               600
+#define BUDGET_SETTLE_FRAMES        40
+#define BUDGET_FIXED_SECONDS        0.001
+#define BUDGET_TRIANGLE_SECONDS     10e-9
+
+struct BudgetRun
+{
+	std::vector<long long> Triangles;
+	std::vector<double> FrameSeconds;
+	std::vector<bool> Saturated;    // every factor at TESS_MAX_FACTOR, more is unreachable
+	SceneSettings Settings;         // after the last frame
+};
+
+static void SimulateBudget(const TessBudgetParams& params, const SceneSettings& startSettings, BudgetRun& run)
+{
+	static const CameraKey s_Path[] =
+	{
+		{ 0.0f, { 0.0f, 12.0f, -24.0f }, { 1.5f, 0.0f, 0.0f } },
+		{ 4.0f, { 1.0f, 2.0f, -4.0f }, { 1.5f, 0.0f, 0.0f } },
+		{ 7.0f, { 3.0f, 0.8f, -1.0f }, { 4.0f, 0.0f, 2.0f } },
+		{ 10.0f, { -2.0f, 6.0f, -8.0f }, { 0.0f, 0.0f, 0.0f } },
+	};
+	std::vector<CameraKey> path(s_Path, s_Path + sizeof(s_Path) / sizeof(s_Path[0]));
+
+	TerrainGrid grid;
+	grid.Build(SCRIPT_PATCHES_X, SCRIPT_PATCHES_Z);
+	std::vector<int> visible(grid.GetPatchCount());
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	TerrainTriangleCounter counter;
+	TessBudgetController controller;
+	controller.SetParams(params);
+
+	run.Settings = startSettings;
+	run.Triangles.clear();
+	run.FrameSeconds.clear();
+	run.Saturated.clear();
+	unsigned int noise = 12345;
+	double previousSeconds = 0.0;
+	for (int frame = 0; frame < BUDGET_FRAMES; frame++)
+	{
+		SceneCamera camera;
+		SampleCameraPath(path, frame / 60.0f, camera.Eye, camera.At);
+		SceneFrame scene;
+		UpdateScene(camera, run.Settings, projection, 0.0f, scene);
+		grid.UpdateBounds(scene.WorldScale, run.Settings.Scaling * run.Settings.DisplacementLevel);
+		int visibleCount = grid.Cull(scene.ViewFrustum, &visible[0]);
+		long long triangles = counter.Count(grid, &visible[0], visibleCount, camera, run.Settings, scene, projection[1][1],
+			SCRIPT_VIEWPORT_HEIGHT);
+
+		// The frame time of this frame is measured at the start of the next one
+		controller.Update(triangles, CountUniformTerrainTriangles(visibleCount, run.Settings.TessellationFactor), previousSeconds,
+			run.Settings);
+		noise = noise * 1664525u + 1013904223u;
+		double seconds = (BUDGET_FIXED_SECONDS + triangles * BUDGET_TRIANGLE_SECONDS) * (0.97 + 0.06 * (noise >> 8) / 16777216.0);
+		run.Triangles.push_back(triangles);
+		run.FrameSeconds.push_back(seconds);
+		run.Saturated.push_back(triangles >= CountUniformTerrainTriangles(visibleCount, (float)TESS_MAX_FACTOR));
+		previousSeconds = seconds;
+	}
+}
+
+// Fraction of the frames after the settle time within tolerance of the target, frames
+// that stay below it with every factor at the maximum do not count
+static double BudgetHitRate(const BudgetRun& run, TESS_BUDGET_MODE mode, double target, double tolerance)
+{
+	int hits = 0, frames = 0;
+	for (int frame = BUDGET_SETTLE_FRAMES; frame < BUDGET_FRAMES; frame++)
+	{
+		double value = (mode == TESS_BUDGET_TRIANGLES) ? (double)run.Triangles[frame] : run.FrameSeconds[frame];
+		if (run.Saturated[frame] && value < target)
+			continue;
+		frames++;
+		if (fabs(value / target - 1.0) <= tolerance)
+			hits++;
+	}
+	return frames > 0 ? (double)hits / frames : 0.0;
+}
+
+int VerifyTessBudget()
+{
+	SuiteCheck check("budget");
+
+	// Off leaves the settings alone
+	TessBudgetParams params;
+	SceneSettings settings;
+	BudgetRun run;
+	SimulateBudget(params, settings, run);
+	check.FailIf(run.Settings.TessellationFactor != settings.TessellationFactor ||
+		run.Settings.TessellationScale != 1.0f, "the controller changed the settings while off");
+	double offRate = BudgetHitRate(run, TESS_BUDGET_FRAME_TIME, 0.004, 0.15);
+
+	// Each mode holds its target while the view changes, with uniform and adaptive factors
+	struct BudgetCase
+	{
+		TESS_BUDGET_MODE Mode;
+		bool Adaptive;
+		double Target;
+	};
+	static const BudgetCase s_Cases[] =
+	{
+		{ TESS_BUDGET_TRIANGLES, false, 150000.0 },
+		{ TESS_BUDGET_TRIANGLES, true, 150000.0 },
+		{ TESS_BUDGET_FRAME_TIME, false, 0.004 },
+		{ TESS_BUDGET_FRAME_TIME, true, 0.004 },
+	};
+	for (int i = 0; i < (int)(sizeof(s_Cases) / sizeof(s_Cases[0])); i++)
+	{
+		const BudgetCase& budgetCase = s_Cases[i];
+		params.Mode = budgetCase.Mode;
+		params.TargetTriangles = budgetCase.Target;
+		params.TargetFrameSeconds = budgetCase.Target;
+		settings.AdaptiveTessellation = budgetCase.Adaptive;
+		SimulateBudget(params, settings, run);
+		double rate = BudgetHitRate(run, budgetCase.Mode, budgetCase.Target, 0.15);
+		check.FailIf(rate < 0.9, "%s %s holds the target within 15%% in only %.0f%% of the frames",
+			GetTessBudgetModeName(budgetCase.Mode), budgetCase.Adaptive ? "adaptive" : "uniform", rate * 100.0);
+	}
+
+	// Unreachable targets end at the limits, or with every adaptive factor clamped
+	params.Mode = TESS_BUDGET_TRIANGLES;
+	params.TargetTriangles = 10.0;
+	settings.AdaptiveTessellation = false;
+	SimulateBudget(params, settings, run);
+	bool limitsOk = run.Settings.TessellationFactor == 1.0f;
+	settings.AdaptiveTessellation = true;
+	SimulateBudget(params, settings, run);
+	limitsOk = limitsOk && run.Settings.TessellationScale == params.MinScale;
+	params.TargetTriangles = 1e12;
+	settings.AdaptiveTessellation = false;
+	settings.TessellationFactor = 2.0f;
+	SimulateBudget(params, settings, run);
+	limitsOk = limitsOk && run.Settings.TessellationFactor == (float)TESS_MAX_FACTOR;
+	settings.AdaptiveTessellation = true;
+	settings.TessellationFactor = (float)TESS_MAX_FACTOR;
+	SimulateBudget(params, settings, run);
+	limitsOk = limitsOk && run.Saturated.back();
+	check.FailIf(!limitsOk, "unreachable targets do not end at the factor or scale limits");
+
+	return check.Finish("%.0f%% of the frames within 15%% of 4 ms without the controller", offRate * 100.0);
+}
+
+void RunTessBudgetSuite()
+{
+	static const TESS_BUDGET_MODE s_Modes[] = { TESS_BUDGET_OFF, TESS_BUDGET_FRAME_TIME, TESS_BUDGET_TRIANGLES };
+	for (int adaptive = 0; adaptive < 2; adaptive++)
+	{
+		for (int m = 0; m < 3; m++)
+		{
+			TessBudgetParams params;
+			params.Mode = s_Modes[m];
+			params.TargetFrameSeconds = 0.004;
+			params.TargetTriangles = 300000.0;
+			SceneSettings settings;
+			settings.AdaptiveTessellation = adaptive != 0;
+			BudgetRun run;
+			double start = GetTimeSeconds();
+			SimulateBudget(params, settings, run);
+			double seconds = GetTimeSeconds() - start;
+
+			std::vector<double> frameMs;
+			double triangles = 0.0;
+			for (int frame = BUDGET_SETTLE_FRAMES; frame < BUDGET_FRAMES; frame++)
+			{
+				frameMs.push_back(run.FrameSeconds[frame] * 1000.0);
+				triangles += (double)run.Triangles[frame];
+			}
+			std::sort(frameMs.begin(), frameMs.end());
+			printf("budget %-8s %-10s  frame ms min %6.2f  p50 %6.2f  max %6.2f  %9.0f triangles  %7.3f ms/frame update\n",
+				adaptive ? "adaptive" : "uniform", GetTessBudgetModeName(s_Modes[m]), frameMs.front(), frameMs[frameMs.size() / 2],
+				frameMs.back(), triangles / frameMs.size(), seconds * 1000.0 / BUDGET_FRAMES);
+		}
+	}
+}
@@ -0,0 +1,233 @@
+//--------------------------------------------------------------------------------------
+// File: TessDensity.cpp
+//--------------------------------------------------------------------------------------
+#include "TessDensity.h"
+#include "SimdUtil.h"
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Roughness
+//--------------------------------------------------------------------------------------
+// Widens row y to 16 bits with one texel added on both sides, so pRow[1 + x] is texel x.
+// The added texels continue the slope of the edge, the surface ends there and the
+// border gets no curvature across it.
+static void GatherRow(const unsigned char* pTexels, int width, int rowPitch, int texelStride, int y, short* pRow)
+{
+	const unsigned char* pSrc = pTexels + (size_t)y * rowPitch;
+	for (int x = 0; x < width; x++)
+		pRow[1 + x] = pSrc[x * texelStride];
+	pRow[0] = (short)(2 * pRow[1] - pRow[std::min(2, width)]);
+	pRow[width + 1] = (short)(2 * pRow[width] - pRow[std::max(width - 1, 1)]);
+}
+
+// Row beyond the top or bottom edge, continuing the slope from pInner to pEdge
+static void ExtrapolateRow(const short* pEdge, const short* pInner, int width, short* pRow)
+{
+	for (int x = 0; x < width + 2; x++)
+		pRow[x] = (short)(2 * pEdge[x] - pInner[x]);
+}
+
+// Squared |d2h/dx2| + |d2h/dy2| of every texel of a row, from the padded rows above,
+// at and below it. The largest value is 1020^2, so int is enough.
+static void SquaredCurvatureRow(const short* pUp, const short* pRow, const short* pDown, int width, int* pOut)
+{
+	int x = 0;
+#if TESS_USE_SSE2
+	// 8 texels per iteration, the square is put together from the low and high halves of
+	// the 16-bit products
+	const __m128i vZero = _mm_setzero_si128();
+	for (; x + 8 <= width; x += 8)
+	{
+		__m128i left = _mm_loadu_si128((const __m128i*)(pRow + x));
+		__m128i center = _mm_loadu_si128((const __m128i*)(pRow + x + 1));
+		__m128i right = _mm_loadu_si128((const __m128i*)(pRow + x + 2));
+		__m128i up = _mm_loadu_si128((const __m128i*)(pUp + x + 1));
+		__m128i down = _mm_loadu_si128((const __m128i*)(pDown + x + 1));
+
+		__m128i twice = _mm_add_epi16(center, center);
+		__m128i dxx = _mm_sub_epi16(_mm_add_epi16(left, right), twice);
+		__m128i dyy = _mm_sub_epi16(_mm_add_epi16(up, down), twice);
+		dxx = _mm_max_epi16(dxx, _mm_sub_epi16(vZero, dxx));
+		dyy = _mm_max_epi16(dyy, _mm_sub_epi16(vZero, dyy));
+		__m128i curvature = _mm_add_epi16(dxx, dyy);
+
+		__m128i low = _mm_mullo_epi16(curvature, curvature);
+		__m128i high = _mm_mulhi_epi16(curvature, curvature);
+		_mm_storeu_si128((__m128i*)(pOut + x), _mm_unpacklo_epi16(low, high));
+		_mm_storeu_si128((__m128i*)(pOut + x + 4), _mm_unpackhi_epi16(low, high));
+	}
+#endif
+	for (; x < width; x++)
+	{
+		int center = pRow[x + 1];
+		int curvature = abs(pRow[x] + pRow[x + 2] - 2 * center) + abs(pUp[x + 1] + pDown[x + 1] - 2 * center);
+		pOut[x] = curvature * curvature;
+	}
+}
+
+// RMS curvature of every cell in the cell rows [cellRowBegin, cellRowEnd)
+static void MeasureCellRows(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride,
+	int cellSize, int cellsX, int cellRowBegin, int cellRowEnd, float* pRoughness)
+{
+	std::vector<short> rows[3];
+	for (int r = 0; r < 3; r++)
+		rows[r].resize(width + 2);
+	std::vector<int> squares(width);
+	std::vector<unsigned long long> sums(cellsX);
+
+	int rowBegin = cellRowBegin * cellSize;
+	int rowEnd = std::min(cellRowEnd * cellSize, height);
+	short* pUp = &rows[0][0];
+	short* pRow = &rows[1][0];
+	short* pDown = &rows[2][0];
+	GatherRow(pTexels, width, rowPitch, texelStride, rowBegin, pRow);
+	if (rowBegin > 0)
+	{
+		GatherRow(pTexels, width, rowPitch, texelStride, rowBegin - 1, pUp);
+	}
+	else
+	{
+		GatherRow(pTexels, width, rowPitch, texelStride, std::min(1, height - 1), pDown);
+		ExtrapolateRow(pRow, pDown, width, pUp);
+	}
+
+	for (int y = rowBegin; y < rowEnd; y++)
+	{
+		if (y + 1 < height)
+			GatherRow(pTexels, width, rowPitch, texelStride, y + 1, pDown);
+		else
+			ExtrapolateRow(pRow, pUp, width, pDown);
+		SquaredCurvatureRow(pUp, pRow, pDown, width, &squares[0]);
+		for (int cx = 0; cx < cellsX; cx++)
+		{
+			int xEnd = std::min((cx + 1) * cellSize, width);
+			unsigned int sum = 0;
+			for (int x = cx * cellSize; x < xEnd; x++)
+				sum += squares[x];
+			sums[cx] += sum;
+		}
+
+		// Last row of a cell row or of the image
+		int cy = y / cellSize;
+		if (y + 1 == rowEnd || (y + 1) % cellSize == 0)
+		{
+			int cellHeight = y + 1 - cy * cellSize;
+			for (int cx = 0; cx < cellsX; cx++)
+			{
+				int cellWidth = std::min((cx + 1) * cellSize, width) - cx * cellSize;
+				pRoughness[(size_t)cy * cellsX + cx] = (float)sqrt((double)sums[cx] / ((double)cellWidth * cellHeight));
+				sums[cx] = 0;
+			}
+		}
+
+		short* pFree = pUp;
+		pUp = pRow;
+		pRow = pDown;
+		pDown = pFree;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// TessDensityMap
+//--------------------------------------------------------------------------------------
+bool TessDensityMap::Build(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride,
+	const TessDensityParams& params, int numThreads)
+{
+	if (!pTexels || width < 1 || height < 1 || texelStride < 1 || rowPitch < width * texelStride ||
+		params.CellSize < 1 || params.CellSize > 2048 || !(params.MinDensity > 0.0f && params.MinDensity <= 1.0f) ||
+		!(params.ReferencePercentile >= 0.0f && params.ReferencePercentile <= 1.0f) || params.DilateCells < 0)
+		return false;
+
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	int cellsX = (width + params.CellSize - 1) / params.CellSize;
+	int cellsY = (height + params.CellSize - 1) / params.CellSize;
+	size_t cellCount = (size_t)cellsX * cellsY;
+	m_Roughness.resize(cellCount);
+
+	// Bands of cell rows are independent, each thread reads one texel row above and
+	// below its band
+	const int minRowsPerThread = 64;
+	int threads = std::min(numThreads, std::min(cellsY, std::max(1, height / minRowsPerThread)));
+	if (threads == 1)
+	{
+		MeasureCellRows(pTexels, width, height, rowPitch, texelStride, params.CellSize, cellsX, 0, cellsY, &m_Roughness[0]);
+	}
+	else
+	{
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+		{
+			int cellRowBegin = cellsY * t / threads;
+			int cellRowEnd = cellsY * (t + 1) / threads;
+			workers.push_back(std::thread(MeasureCellRows, pTexels, width, height, rowPitch, texelStride,
+				params.CellSize, cellsX, cellRowBegin, cellRowEnd, &m_Roughness[0]));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+
+	// Relative to a percentile instead of the maximum, a few spikes would flatten the rest
+	std::vector<float> sorted(m_Roughness);
+	size_t referenceIndex = (size_t)(params.ReferencePercentile * (cellCount - 1));
+	std::nth_element(sorted.begin(), sorted.begin() + referenceIndex, sorted.end());
+	float reference = sorted[referenceIndex];
+
+	std::vector<unsigned char> density(cellCount);
+	int minValue = std::max(1, (int)(params.MinDensity * 255.0f + 0.5f));
+	for (size_t c = 0; c < cellCount; c++)
+	{
+		float value;
+		if (reference > 0.0f)
+			value = std::min(sqrtf(m_Roughness[c] / reference), 1.0f);
+		else
+			value = m_Roughness[c] > 0.0f ? 1.0f : 0.0f;
+		density[c] = (unsigned char)std::max(minValue, (int)(value * 255.0f + 0.5f));
+	}
+
+	// An edge takes the density under its midpoint, so detail right next to a cell border
+	// would be missed by edges of the flat neighbour. Separable max filter.
+	m_Density.resize(cellCount);
+	int radius = params.DilateCells;
+	for (int cy = 0; cy < cellsY; cy++)
+	{
+		for (int cx = 0; cx < cellsX; cx++)
+		{
+			unsigned char value = 0;
+			for (int x = std::max(cx - radius, 0); x <= std::min(cx + radius, cellsX - 1); x++)
+				value = std::max(value, density[(size_t)cy * cellsX + x]);
+			m_Density[(size_t)cy * cellsX + cx] = value;
+		}
+	}
+	for (int cx = 0; cx < cellsX; cx++)
+	{
+		for (int cy = 0; cy < cellsY; cy++)
+		{
+			unsigned char value = 0;
+			for (int y = std::max(cy - radius, 0); y <= std::min(cy + radius, cellsY - 1); y++)
+				value = std::max(value, m_Density[(size_t)y * cellsX + cx]);
+			density[(size_t)cy * cellsX + cx] = value;
+		}
+	}
+	m_Density.swap(density);
+
+	m_Width = cellsX;
+	m_Height = cellsY;
+	return true;
+}
+
+float TessDensityMap::Sample(float u, float v) const
+{
+	if (!IsValid())
+		return 1.0f;
+	// Like the int conversion of the Load coordinates in EdgeDensity
+	int x = std::min(std::max((int)(u * m_Width), 0), m_Width - 1);
+	int y = std::min(std::max((int)(v * m_Height), 0), m_Height - 1);
+	return m_Density[(size_t)y * m_Width + x] / 255.0f;
+}
@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// File: TessDensity.h
+//
+// Content-driven tessellation density. The heightmap is split into cells and each cell
+// gets the RMS of |d2h/dx2| + |d2h/dy2| over its texels. Linear interpolation between
+// tessellated vertices misses the height by about h^2 |f''| / 8 for a segment of length
+// h, so the same error needs a factor proportional to sqrt(|f''|). The density of a cell
+// is that square root relative to a high percentile of the cells, clamped to
+// [MinDensity, 1]: flat areas lose triangles, the roughest keep the factor they had.
+// The terrain ends at the border of the heightmap, so there is no curvature across it.
+//
+// ConstHS multiplies each edge factor by the density of the cell under the edge's
+// midpoint before clamping, so patches sharing an edge agree. SampleEdge returns the
+// same value on the CPU.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct TessDensityParams
+{
+	int CellSize = 32;                  // texels per cell side
+	float MinDensity = 1.0f / 16.0f;
+	float ReferencePercentile = 0.95f;  // cells at least this rough get density 1
+	int DilateCells = 1;                // each cell takes the largest density this many cells around it
+};
+
+
+//--------------------------------------------------------------------------------------
+// TessDensityMap
+//--------------------------------------------------------------------------------------
+class TessDensityMap
+{
+public:
+	TessDensityMap() : m_Width(0), m_Height(0) {}
+
+	// Builds from one 8-bit channel: texel (x, y) is pTexels[y * rowPitch + x * texelStride].
+	// numThreads 0 uses every hardware thread.
+	bool Build(const unsigned char* pTexels, int width, int height, int rowPitch, int texelStride,
+		const TessDensityParams& params, int numThreads = 0);
+
+	// Density of the cell containing (u, v), texture coordinates are clamped to [0, 1].
+	// 1 before the map is built.
+	float Sample(float u, float v) const;
+
+	// Density of the edge between two texture coordinates, sampled at its midpoint like
+	// EdgeDensity in DisplacedAndShaded.hlsl
+	float SampleEdge(float u0, float v0, float u1, float v1) const
+	{
+		return Sample(0.5f * (u0 + u1), 0.5f * (v0 + v1));
+	}
+
+	bool IsValid() const { return m_Width > 0; }
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+
+	// Densities as R8_UNORM texels, one per cell
+	const unsigned char* GetTexels() const { return m_Density.data(); }
+
+	// RMS second derivative of every cell in height units (0-255) per texel squared
+	const float* GetRoughness() const { return m_Roughness.data(); }
+
+private:
+	int m_Width;
+	int m_Height;
+	std::vector<unsigned char> m_Density;
+	std::vector<float> m_Roughness;
+};
@@ -0,0 +1,336 @@
+//--------------------------------------------------------------------------------------
+// File: TessDensitySuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "SceneUpdate.h"
+#include "TerrainGrid.h"
+#include "TessDensity.h"
+#include "Tessellator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+
+//--------------------------------------------------------------------------------------
+// Content density. The synthetic heightmap has long smooth waves on the left and short
+// ones on the right, blended over a band in the middle. The displaced surface is
+// tessellated on the CPU and its height error measured against the bilinear heightmap.
+//--------------------------------------------------------------------------------------
+#define DENSITY_PATCHES         16
+#define DENSITY_FACTOR          16.0f
+
+void BuildDensityHeightmap(int width, int height, std::vector<unsigned char>& texels)
+{
+	const float twoPi = 6.2831853f;
+	texels.resize((size_t)width * height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float blend = std::min(std::max((x - 0.4375f * width) / (0.125f * width), 0.0f), 1.0f);
+			blend = blend * blend * (3.0f - 2.0f * blend);
+			float value = 128.0f + 60.0f * sinf(twoPi * x / 400.0f) * cosf(twoPi * y / 400.0f) +
+				blend * 60.0f * sinf(twoPi * x / 16.0f) * sinf(twoPi * y / 16.0f);
+			texels[(size_t)y * width + x] = (unsigned char)std::min(std::max(value + 0.5f, 0.0f), 255.0f);
+		}
+	}
+}
+
+// RMS curvature of every cell the straightforward way
+static void ReferenceRoughness(const std::vector<unsigned char>& texels, int width, int height, int cellSize,
+	std::vector<float>& roughness)
+{
+	int cellsX = (width + cellSize - 1) / cellSize, cellsY = (height + cellSize - 1) / cellSize;
+	roughness.assign((size_t)cellsX * cellsY, 0.0f);
+	for (int cy = 0; cy < cellsY; cy++)
+	{
+		for (int cx = 0; cx < cellsX; cx++)
+		{
+			unsigned long long sum = 0;
+			int texelCount = 0;
+			for (int y = cy * cellSize; y < std::min((cy + 1) * cellSize, height); y++)
+			{
+				for (int x = cx * cellSize; x < std::min((cx + 1) * cellSize, width); x++)
+				{
+					// Nothing across the border of the image
+					int h = texels[(size_t)y * width + x];
+					int dxx = (x == 0 || x == width - 1) ? 0 : texels[(size_t)y * width + x - 1] + texels[(size_t)y * width + x + 1] - 2 * h;
+					int dyy = (y == 0 || y == height - 1) ? 0 : texels[(size_t)(y - 1) * width + x] + texels[(size_t)(y + 1) * width + x] - 2 * h;
+					int curvature = abs(dxx) + abs(dyy);
+					sum += (unsigned long long)(curvature * curvature);
+					texelCount++;
+				}
+			}
+			roughness[(size_t)cy * cellsX + cx] = (float)sqrt((double)sum / texelCount);
+		}
+	}
+}
+
+static float SampleHeightBilinear(const std::vector<unsigned char>& texels, int width, int height, float u, float v)
+{
+	float x = std::min(std::max(u * width - 0.5f, 0.0f), width - 1.0f);
+	float y = std::min(std::max(v * height - 0.5f, 0.0f), height - 1.0f);
+	int x0 = std::min((int)x, width - 2), y0 = std::min((int)y, height - 2);
+	float fx = x - x0, fy = y - y0;
+	const unsigned char* p = &texels[(size_t)y0 * width + x0];
+	float top = p[0] + (p[1] - p[0]) * fx;
+	float bottom = p[width] + (p[width + 1] - p[width]) * fx;
+	return top + (bottom - top) * fy;
+}
+
+struct DensityErrorResult
+{
+	double MaxError;        // in heightmap units (0-255)
+	double RmsError;
+	long long DomainPoints;
+	long long Triangles;
+};
+
+// Tessellates a grid of tri patches over the heightmap with a uniform factor, scaled by
+// the density map if one is given, and measures the height error of the flat triangles
+// at their centers and edge midpoints
+static void MeasureDensityError(const std::vector<unsigned char>& texels, int width, int height,
+	const TessDensityMap* pDensityMap, float factor, DensityErrorResult& result)
+{
+	memset(&result, 0, sizeof(result));
+	CpuTessellator tessellator;
+	tessellator.Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+	double sumSquares = 0.0;
+	long long samples = 0;
+	for (int row = 0; row < DENSITY_PATCHES; row++)
+	{
+		for (int col = 0; col < DENSITY_PATCHES; col++)
+		{
+			float u0 = (float)col / DENSITY_PATCHES, u1 = (float)(col + 1) / DENSITY_PATCHES;
+			float v0 = (float)row / DENSITY_PATCHES, v1 = (float)(row + 1) / DENSITY_PATCHES;
+			float corners[4][2] = { { u0, v0 }, { u1, v0 }, { u1, v1 }, { u0, v1 } };
+			static const int s_Indices[6] = { 3, 2, 0, 0, 2, 1 };
+			for (int t = 0; t < 2; t++)
+			{
+				const float* c[3] = { corners[s_Indices[t * 3]], corners[s_Indices[t * 3 + 1]], corners[s_Indices[t * 3 + 2]] };
+				float edges[3];
+				for (int e = 0; e < 3; e++)
+				{
+					const float* pA = c[(e + 1) % 3];
+					const float* pB = c[(e + 2) % 3];
+					float density = pDensityMap ? pDensityMap->SampleEdge(pA[0], pA[1], pB[0], pB[1]) : 1.0f;
+					ComputeUniformEdgeTessFactors(&density, 1, factor, &edges[e]);
+				}
+				tessellator.TessellateTriDomain(edges[0], edges[1], edges[2], (edges[0] + edges[1] + edges[2]) / 3.0f);
+
+				// Displaced domain points, SV_DomainLocation weights the control points
+				int pointCount = tessellator.GetPointCount();
+				std::vector<float> pointU(pointCount), pointV(pointCount), pointH(pointCount);
+				for (int i = 0; i < pointCount; i++)
+				{
+					float b0 = tessellator.GetPointsU()[i], b1 = tessellator.GetPointsV()[i], b2 = 1.0f - b0 - b1;
+					pointU[i] = b0 * c[0][0] + b1 * c[1][0] + b2 * c[2][0];
+					pointV[i] = b0 * c[0][1] + b1 * c[1][1] + b2 * c[2][1];
+					pointH[i] = SampleHeightBilinear(texels, width, height, pointU[i], pointV[i]);
+				}
+				result.DomainPoints += pointCount;
+				result.Triangles += tessellator.GetIndexCount() / 3;
+
+				const int* pIndices = tessellator.GetIndices();
+				for (int i = 0; i + 2 < tessellator.GetIndexCount(); i += 3)
+				{
+					static const float s_Weights[4][3] = { { 1.0f / 3, 1.0f / 3, 1.0f / 3 }, { 0.5f, 0.5f, 0.0f }, { 0.0f, 0.5f, 0.5f }, { 0.5f, 0.0f, 0.5f } };
+					for (int w = 0; w < 4; w++)
+					{
+						float u = 0.0f, v = 0.0f, h = 0.0f;
+						for (int k = 0; k < 3; k++)
+						{
+							int index = pIndices[i + k];
+							u += s_Weights[w][k] * pointU[index];
+							v += s_Weights[w][k] * pointV[index];
+							h += s_Weights[w][k] * pointH[index];
+						}
+						double error = fabs(h - SampleHeightBilinear(texels, width, height, u, v));
+						result.MaxError = std::max(result.MaxError, error);
+						sumSquares += error * error;
+						samples++;
+					}
+				}
+			}
+		}
+	}
+	result.RmsError = samples > 0 ? sqrt(sumSquares / samples) : 0.0;
+}
+
+int VerifyTessDensity()
+{
+	SuiteCheck check("density");
+	const int size = DENSITY_MAP_SIZE;
+	std::vector<unsigned char> texels;
+	BuildDensityHeightmap(size, size, texels);
+	TessDensityParams params;
+
+	// The SIMD kernel matches the straightforward roughness, on sizes that are no
+	// multiple of the cell size or the SIMD width too
+	static const int s_Sizes[][2] = { { size, size }, { 333, 517 }, { 7, 3 } };
+	for (int i = 0; i < (int)(sizeof(s_Sizes) / sizeof(s_Sizes[0])); i++)
+	{
+		int width = s_Sizes[i][0], height = s_Sizes[i][1];
+		std::vector<unsigned char> heights;
+		BuildNoiseHeightmap(width, height, i, heights);
+		if (i == 0)
+			heights = texels;
+		TessDensityMap map;
+		std::vector<float> reference;
+		ReferenceRoughness(heights, width, height, params.CellSize, reference);
+		if (!map.Build(&heights[0], width, height, width, 1, params, 1) || map.GetWidth() * map.GetHeight() != (int)reference.size() ||
+			memcmp(map.GetRoughness(), &reference[0], reference.size() * sizeof(float)) != 0)
+		{
+			check.Fail("%dx%d: roughness differs from the reference", width, height);
+			continue;
+		}
+
+		// Thread counts and interleaved channels give the same map
+		std::vector<unsigned char> rgba((size_t)(width * 4 + 12) * height, 0);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+				rgba[(size_t)y * (width * 4 + 12) + x * 4] = heights[(size_t)y * width + x];
+		}
+		TessDensityMap threaded, interleaved;
+		threaded.Build(&heights[0], width, height, width, 1, params, 4);
+		interleaved.Build(&rgba[0], width, height, width * 4 + 12, 4, params, 3);
+		size_t cells = reference.size();
+		check.FailIf(memcmp(map.GetTexels(), threaded.GetTexels(), cells) != 0 ||
+			memcmp(map.GetTexels(), interleaved.GetTexels(), cells) != 0,
+			"%dx%d: the map depends on the thread count or the texel layout", width, height);
+	}
+
+	// Densities are in [MinDensity, 1], the roughest cell gets 1, and dilation takes the
+	// largest density of the neighbours
+	TessDensityMap map, undilated;
+	params.DilateCells = 0;
+	undilated.Build(&texels[0], size, size, size, 1, params);
+	params.DilateCells = 1;
+	map.Build(&texels[0], size, size, size, 1, params);
+	int cellsX = map.GetWidth(), cellsY = map.GetHeight();
+	int roughest = (int)(std::max_element(map.GetRoughness(), map.GetRoughness() + cellsX * cellsY) - map.GetRoughness());
+	check.FailIf(undilated.GetTexels()[roughest] != 255, "the roughest cell has density %d/255",
+		undilated.GetTexels()[roughest]);
+	int minValue = (int)(params.MinDensity * 255.0f + 0.5f);
+	for (int cy = 0; cy < cellsY; cy++)
+	{
+		for (int cx = 0; cx < cellsX; cx++)
+		{
+			unsigned char expected = 0;
+			for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, cellsY - 1); y++)
+			{
+				for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, cellsX - 1); x++)
+					expected = std::max(expected, undilated.GetTexels()[y * cellsX + x]);
+			}
+			unsigned char value = map.GetTexels()[cy * cellsX + cx];
+			if (value != expected || undilated.GetTexels()[cy * cellsX + cx] < minValue)
+			{
+				check.Fail("cell %d,%d has density %d, expected %d", cx, cy, value, expected);
+				cy = cellsY;
+				break;
+			}
+		}
+	}
+
+	// The smooth side is sampled far below the rough side, at the midpoints of edges
+	float smooth = map.SampleEdge(0.0f, 0.25f, 0.125f, 0.25f);
+	float rough = map.SampleEdge(1.0f, 0.75f, 0.875f, 0.75f);
+	check.FailIf(!(smooth <= 0.5f && rough == 1.0f) || map.Sample(0.0625f, 0.25f) != smooth ||
+		map.Sample(-1.0f, 2.0f) != map.GetTexels()[(cellsY - 1) * cellsX] / 255.0f,
+		"samples %.3f on the smooth side and %.3f on the rough side", smooth, rough);
+
+	// Density scales the factors before the clamp, in the SIMD body and the scalar tail
+	TriPatchGrid grid;
+	BuildTriPatchGrid(5, 200.0f, grid);
+	AdaptiveTessParams adaptive = DefaultAdaptiveParams();
+	ComputeGridFactors(grid, adaptive);
+	std::vector<float> density(grid.Count), scaled(grid.Count), uniform(grid.Count);
+	for (int i = 0; i < grid.Count; i++)
+		density[i] = (i % 7 + 1) / 7.0f;
+	ComputeEdgeTessFactors(&grid.X[1][0], &grid.Y[1][0], &grid.Z[1][0], &grid.X[2][0], &grid.Y[2][0], &grid.Z[2][0], grid.Count,
+		adaptive, &scaled[0], &density[0]);
+	ComputeUniformEdgeTessFactors(&density[0], grid.Count, 20.0f, &uniform[0]);
+	std::vector<float> unscaled(grid.Count);
+	adaptive.MaxTessFactor = 1e6f;
+	ComputeEdgeTessFactors(&grid.X[1][0], &grid.Y[1][0], &grid.Z[1][0], &grid.X[2][0], &grid.Y[2][0], &grid.Z[2][0], grid.Count,
+		adaptive, &unscaled[0]);
+	adaptive.MaxTessFactor = 64.0f;
+	for (int i = 0; i < grid.Count; i++)
+	{
+		float expected = std::min(std::max(unscaled[i] * density[i], 1.0f), 64.0f);
+		float expectedUniform = std::min(std::max(20.0f * density[i], 1.0f), 20.0f);
+		if (fabsf(scaled[i] - expected) > expected * 1e-5f || uniform[i] != expectedUniform)
+		{
+			check.Fail("patch %d factor %.4f, expected %.4f", i, scaled[i], expected);
+			break;
+		}
+	}
+
+	// The triangle counter applies the density per edge like ConstHS
+	TerrainGrid terrain;
+	terrain.Build(DENSITY_PATCHES, DENSITY_PATCHES);
+	std::vector<int> patches(terrain.GetPatchCount());
+	for (int i = 0; i < terrain.GetPatchCount(); i++)
+		patches[i] = i;
+	SceneCamera camera;
+	SceneSettings settings;
+	settings.TessellationFactor = DENSITY_FACTOR;
+	settings.ContentDensity = true;
+	float projection[4][4];
+	BuildPerspectiveFovLH(3.14159265f / 4.0f, SCRIPT_VIEWPORT_WIDTH / SCRIPT_VIEWPORT_HEIGHT, 0.01f, 100.0f, projection);
+	SceneFrame scene;
+	UpdateScene(camera, settings, projection, 0.0f, scene);
+	TerrainTriangleCounter counter;
+	counter.SetDensityMap(&map);
+	long long counted = counter.Count(terrain, &patches[0], terrain.GetPatchCount(), camera, settings, scene, projection[1][1],
+		SCRIPT_VIEWPORT_HEIGHT);
+	DensityErrorResult withDensity, withoutDensity;
+	MeasureDensityError(texels, size, size, &map, DENSITY_FACTOR, withDensity);
+	MeasureDensityError(texels, size, size, NULL, DENSITY_FACTOR, withoutDensity);
+	check.FailIf(counted != withDensity.Triangles || scene.Frame.ContentDensity != 1.0f,
+		"the counter finds %lld triangles, tessellating gives %lld", counted, withDensity.Triangles);
+
+	// About the error of the uniform factor with far fewer domain points
+	double pointRatio = (double)withDensity.DomainPoints / withoutDensity.DomainPoints;
+	check.FailIf(withDensity.MaxError > withoutDensity.MaxError * 1.05 || pointRatio > 0.75,
+		"max error %.2f vs %.2f with %.0f%% of the domain points", withDensity.MaxError, withoutDensity.MaxError,
+		pointRatio * 100.0);
+
+	return check.Finish("max error %.2f vs %.2f, %.0f%% of the domain points", withDensity.MaxError,
+		withoutDensity.MaxError, pointRatio * 100.0);
+}
+
+void RunTessDensitySuite()
+{
+	const int size = 4096;
+	std::vector<unsigned char> texels;
+	BuildNoiseHeightmap(size, size, 11, texels);
+	TessDensityParams params;
+	TessDensityMap map;
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		double start = GetTimeSeconds();
+		map.Build(&texels[0], size, size, size, 1, params, threads);
+		double seconds = GetTimeSeconds() - start;
+		printf("density build %dx%d  %2d threads  %10.3f ms  %8.2f Mtexels/s\n",
+			size, size, threads, seconds * 1000.0, (double)size * size / seconds * 1e-6);
+	}
+
+	BuildDensityHeightmap(DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, texels);
+	map.Build(&texels[0], DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, 1, params);
+	static const float s_Factors[] = { 4.0f, 8.0f, 16.0f, 32.0f, 64.0f };
+	for (int f = 0; f < (int)(sizeof(s_Factors) / sizeof(s_Factors[0])); f++)
+	{
+		DensityErrorResult uniform, density;
+		MeasureDensityError(texels, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, NULL, s_Factors[f], uniform);
+		MeasureDensityError(texels, DENSITY_MAP_SIZE, DENSITY_MAP_SIZE, &map, s_Factors[f], density);
+		printf("density factor %4.0f  uniform %8lld points  max error %6.2f  rms %5.2f  |  density %8lld points  max error %6.2f  rms %5.2f\n",
+			s_Factors[f], uniform.DomainPoints, uniform.MaxError, uniform.RmsError, density.DomainPoints, density.MaxError,
+			density.RmsError);
+	}
+}
@@ -0,0 +1,171 @@
+//--------------------------------------------------------------------------------------
+// File: TessFactors.cpp
+//
+// Matches EdgeTessFactor, ConstHS and ConstQuadHS in DisplacedAndShaded.hlsl.
+//--------------------------------------------------------------------------------------
+#include "TessFactors.h"
+#include "SimdUtil.h"
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Edge factors
+//--------------------------------------------------------------------------------------
+static float EdgeTessFactor(float ax, float ay, float az, float bx, float by, float bz,
+	const AdaptiveTessParams& params, float pixelScale, float density)
+{
+	float cx = 0.5f * (ax + bx) - params.Eye[0];
+	float cy = 0.5f * (ay + by) - params.Eye[1];
+	float cz = 0.5f * (az + bz) - params.Eye[2];
+	float dx = bx - ax, dy = by - ay, dz = bz - az;
+	float diameter = sqrtf(dx * dx + dy * dy + dz * dz);
+	float dist = std::max(sqrtf(cx * cx + cy * cy + cz * cz), 0.0001f);
+	float factor = diameter * pixelScale / dist / params.TargetTriangleSize * density;
+	return std::min(std::max(factor, 1.0f), params.MaxTessFactor);
+}
+
+void ComputeEdgeTessFactors(const float* pAX, const float* pAY, const float* pAZ,
+	const float* pBX, const float* pBY, const float* pBZ, int count,
+	const AdaptiveTessParams& params, float* pOutFactors, const float* pDensity)
+{
+	// Projected pixels of a unit length edge at unit distance
+	float pixelScale = params.ProjScale * 0.5f * params.ViewportHeight;
+
+	int i = 0;
+#if TESS_USE_SSE2
+	const __m128 vHalf = _mm_set1_ps(0.5f);
+	const __m128 vEyeX = _mm_set1_ps(params.Eye[0]);
+	const __m128 vEyeY = _mm_set1_ps(params.Eye[1]);
+	const __m128 vEyeZ = _mm_set1_ps(params.Eye[2]);
+	const __m128 vPixelScale = _mm_set1_ps(pixelScale);
+	const __m128 vTarget = _mm_set1_ps(params.TargetTriangleSize);
+	const __m128 vMinDist = _mm_set1_ps(0.0001f);
+	const __m128 vOne = _mm_set1_ps(1.0f);
+	const __m128 vMaxFactor = _mm_set1_ps(params.MaxTessFactor);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 ax = _mm_loadu_ps(&pAX[i]), ay = _mm_loadu_ps(&pAY[i]), az = _mm_loadu_ps(&pAZ[i]);
+		__m128 bx = _mm_loadu_ps(&pBX[i]), by = _mm_loadu_ps(&pBY[i]), bz = _mm_loadu_ps(&pBZ[i]);
+
+		__m128 cx = _mm_sub_ps(_mm_mul_ps(vHalf, _mm_add_ps(ax, bx)), vEyeX);
+		__m128 cy = _mm_sub_ps(_mm_mul_ps(vHalf, _mm_add_ps(ay, by)), vEyeY);
+		__m128 cz = _mm_sub_ps(_mm_mul_ps(vHalf, _mm_add_ps(az, bz)), vEyeZ);
+		__m128 dx = _mm_sub_ps(bx, ax), dy = _mm_sub_ps(by, ay), dz = _mm_sub_ps(bz, az);
+
+		__m128 diameter = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+		dist = _mm_max_ps(dist, vMinDist);
+
+		__m128 factor = _mm_div_ps(_mm_div_ps(_mm_mul_ps(diameter, vPixelScale), dist), vTarget);
+		if (pDensity)
+			factor = _mm_mul_ps(factor, _mm_loadu_ps(&pDensity[i]));
+		factor = _mm_min_ps(_mm_max_ps(factor, vOne), vMaxFactor);
+		_mm_storeu_ps(&pOutFactors[i], factor);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		pOutFactors[i] = EdgeTessFactor(pAX[i], pAY[i], pAZ[i], pBX[i], pBY[i], pBZ[i], params, pixelScale,
+			pDensity ? pDensity[i] : 1.0f);
+	}
+}
+
+void ComputeUniformEdgeTessFactors(const float* pDensity, int count, float maxFactor, float* pOutFactors)
+{
+	int i = 0;
+#if TESS_USE_SSE2
+	const __m128 vOne = _mm_set1_ps(1.0f);
+	const __m128 vMaxFactor = _mm_set1_ps(maxFactor);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 factor = _mm_mul_ps(vMaxFactor, _mm_loadu_ps(&pDensity[i]));
+		_mm_storeu_ps(&pOutFactors[i], _mm_min_ps(_mm_max_ps(factor, vOne), vMaxFactor));
+	}
+#endif
+	for (; i < count; i++)
+		pOutFactors[i] = std::min(std::max(maxFactor * pDensity[i], 1.0f), maxFactor);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Patch factors
+//--------------------------------------------------------------------------------------
+// Inside factor is the average of the edges
+static void AverageInsideTessFactors(int count, PatchFactorsSoA& factors)
+{
+	int i = 0;
+#if TESS_USE_SSE2
+	const __m128 vThree = _mm_set1_ps(3.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&factors.Edges[0][i]), _mm_loadu_ps(&factors.Edges[1][i])),
+			_mm_loadu_ps(&factors.Edges[2][i]));
+		_mm_storeu_ps(&factors.Inside[0][i], _mm_div_ps(sum, vThree));
+	}
+#endif
+	for (; i < count; i++)
+		factors.Inside[0][i] = (factors.Edges[0][i] + factors.Edges[1][i] + factors.Edges[2][i]) / 3.0f;
+}
+
+// Inside factor of each axis is the average of the two edges along it, like ConstQuadHS
+static void AverageQuadInsideTessFactors(int count, PatchFactorsSoA& factors)
+{
+	for (int axis = 0; axis < 2; axis++)
+	{
+		const float* pA = factors.Edges[1 - axis];
+		const float* pB = factors.Edges[3 - axis];
+		float* pInside = factors.Inside[axis];
+		int i = 0;
+#if TESS_USE_SSE2
+		const __m128 vHalf = _mm_set1_ps(0.5f);
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(&pInside[i], _mm_mul_ps(vHalf, _mm_add_ps(_mm_loadu_ps(&pA[i]), _mm_loadu_ps(&pB[i]))));
+#endif
+		for (; i < count; i++)
+			pInside[i] = 0.5f * (pA[i] + pB[i]);
+	}
+}
+
+void ComputeTriPatchTessFactors(const PatchPositionsSoA& patches, int count,
+	const AdaptiveTessParams& params, PatchFactorsSoA& factors, const PatchDensitySoA* pDensity)
+{
+	// Edge i is the one opposite control point i
+	ComputeEdgeTessFactors(patches.X[1], patches.Y[1], patches.Z[1], patches.X[2], patches.Y[2], patches.Z[2],
+		count, params, factors.Edges[0], pDensity ? pDensity->Edges[0] : NULL);
+	ComputeEdgeTessFactors(patches.X[2], patches.Y[2], patches.Z[2], patches.X[0], patches.Y[0], patches.Z[0],
+		count, params, factors.Edges[1], pDensity ? pDensity->Edges[1] : NULL);
+	ComputeEdgeTessFactors(patches.X[0], patches.Y[0], patches.Z[0], patches.X[1], patches.Y[1], patches.Z[1],
+		count, params, factors.Edges[2], pDensity ? pDensity->Edges[2] : NULL);
+	AverageInsideTessFactors(count, factors);
+}
+
+void ComputeUniformTriPatchTessFactors(const PatchDensitySoA& density, int count, float maxFactor,
+	PatchFactorsSoA& factors)
+{
+	for (int e = 0; e < 3; e++)
+		ComputeUniformEdgeTessFactors(density.Edges[e], count, maxFactor, factors.Edges[e]);
+	AverageInsideTessFactors(count, factors);
+}
+
+void ComputeQuadPatchTessFactors(const PatchPositionsSoA& patches, int count,
+	const AdaptiveTessParams& params, PatchFactorsSoA& factors, const PatchDensitySoA* pDensity)
+{
+	// U == 0, V == 0, U == 1 and V == 1
+	static const int s_EdgePoints[4][2] = { { 0, 1 }, { 3, 0 }, { 3, 2 }, { 1, 2 } };
+	for (int e = 0; e < 4; e++)
+	{
+		int a = s_EdgePoints[e][0], b = s_EdgePoints[e][1];
+		ComputeEdgeTessFactors(patches.X[a], patches.Y[a], patches.Z[a], patches.X[b], patches.Y[b], patches.Z[b],
+			count, params, factors.Edges[e], pDensity ? pDensity->Edges[e] : NULL);
+	}
+	AverageQuadInsideTessFactors(count, factors);
+}
+
+void ComputeUniformQuadPatchTessFactors(const PatchDensitySoA& density, int count, float maxFactor,
+	PatchFactorsSoA& factors)
+{
+	for (int e = 0; e < 4; e++)
+		ComputeUniformEdgeTessFactors(density.Edges[e], count, maxFactor, factors.Edges[e]);
+	AverageQuadInsideTessFactors(count, factors);
+}
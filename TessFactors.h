@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// File: TessFactors.h
+//
+// CPU evaluation of the screen-space adaptive tessellation factors computed by ConstHS
+// and ConstQuadHS in DisplacedAndShaded.hlsl. Works on many patches per call in SoA
+// layout. Factors can be scaled by a content density per edge, see TessDensity.h.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <stddef.h>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct AdaptiveTessParams
+{
+	float Eye[3];
+	float ProjScale;            // Projection._22, cot(fovY / 2)
+	float ViewportHeight;       // in pixels
+	float TargetTriangleSize;   // in pixels
+	float MaxTessFactor;        // TessellationFactor of the constant buffer
+};
+
+// Control point positions of a batch of patches, one array per control point and axis
+struct PatchPositionsSoA
+{
+	const float* X[4];
+	const float* Y[4];
+	const float* Z[4];
+};
+
+// Density of every edge of a batch of patches, in the edge order of the patch factors
+struct PatchDensitySoA
+{
+	const float* Edges[4];
+};
+
+// Output factors of a batch of patches, one array per SV_TessFactor/SV_InsideTessFactor
+struct PatchFactorsSoA
+{
+	float* Edges[4];
+	float* Inside[2];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Factor of each edge (A[i], B[i]). Symmetric in A and B, so shared edges match exactly.
+// pDensity, if given, multiplies the factors before they are clamped.
+void ComputeEdgeTessFactors(const float* pAX, const float* pAY, const float* pAZ,
+	const float* pBX, const float* pBY, const float* pBZ, int count,
+	const AdaptiveTessParams& params, float* pOutFactors, const float* pDensity = NULL);
+
+// maxFactor scaled by the density of each edge, clamped to [1, maxFactor]
+void ComputeUniformEdgeTessFactors(const float* pDensity, int count, float maxFactor, float* pOutFactors);
+
+// Edge and inside factors of tri patches, with the edge order of ConstHS
+void ComputeTriPatchTessFactors(const PatchPositionsSoA& patches, int count,
+	const AdaptiveTessParams& params, PatchFactorsSoA& factors, const PatchDensitySoA* pDensity = NULL);
+
+// The factors ConstHS computes without adaptive tessellation but with content density
+void ComputeUniformTriPatchTessFactors(const PatchDensitySoA& density, int count, float maxFactor,
+	PatchFactorsSoA& factors);
+
+// Edge and inside factors of quad patches, with the edge order of ConstQuadHS: U == 0
+// (points 0-1), V == 0 (3-0), U == 1 (3-2) and V == 1 (1-2)
+void ComputeQuadPatchTessFactors(const PatchPositionsSoA& patches, int count,
+	const AdaptiveTessParams& params, PatchFactorsSoA& factors, const PatchDensitySoA* pDensity = NULL);
+
+// The factors ConstQuadHS computes without adaptive tessellation but with content density
+void ComputeUniformQuadPatchTessFactors(const PatchDensitySoA& density, int count, float maxFactor,
+	PatchFactorsSoA& factors);
@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// File: TessFactorsSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TessFactors.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Adaptive factors. Builds a grid of quads split into two tri patches each, with the
+// same index order as the demo's quad (3, 2, 0 / 0, 2, 1).
+//--------------------------------------------------------------------------------------
+void BuildTriPatchGrid(int quadsPerSide, float size, TriPatchGrid& grid)
+{
+	grid.Count = quadsPerSide * quadsPerSide * 2;
+	for (int c = 0; c < 3; c++)
+	{
+		grid.X[c].resize(grid.Count);
+		grid.Y[c].resize(grid.Count);
+		grid.Z[c].resize(grid.Count);
+		grid.Edges[c].resize(grid.Count);
+	}
+	grid.Inside.resize(grid.Count);
+
+	float step = size / quadsPerSide;
+	int patch = 0;
+	for (int row = 0; row < quadsPerSide; row++)
+	{
+		for (int col = 0; col < quadsPerSide; col++)
+		{
+			float x0 = -0.5f * size + col * step, x1 = x0 + step;
+			float z0 = -0.5f * size + row * step, z1 = z0 + step;
+			float corners[4][3] = { { x0, 0, z0 }, { x1, 0, z0 }, { x1, 0, z1 }, { x0, 0, z1 } };
+			static const int s_Indices[6] = { 3, 2, 0, 0, 2, 1 };
+			for (int t = 0; t < 2; t++, patch++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					const float* p = corners[s_Indices[t * 3 + c]];
+					grid.X[c][patch] = p[0];
+					grid.Y[c][patch] = p[1];
+					grid.Z[c][patch] = p[2];
+				}
+			}
+		}
+	}
+}
+
+void ComputeGridFactors(TriPatchGrid& grid, const AdaptiveTessParams& params)
+{
+	PatchPositionsSoA positions;
+	PatchFactorsSoA factors;
+	for (int c = 0; c < 3; c++)
+	{
+		positions.X[c] = &grid.X[c][0];
+		positions.Y[c] = &grid.Y[c][0];
+		positions.Z[c] = &grid.Z[c][0];
+		factors.Edges[c] = &grid.Edges[c][0];
+	}
+	factors.Inside[0] = &grid.Inside[0];
+	ComputeTriPatchTessFactors(positions, grid.Count, params, factors);
+}
+
+AdaptiveTessParams DefaultAdaptiveParams()
+{
+	AdaptiveTessParams params;
+	params.Eye[0] = 0.0f;
+	params.Eye[1] = 4.0f;
+	params.Eye[2] = -10.0f;
+	params.ProjScale = 1.0f / tanf(3.14159265f / 8.0f);
+	params.ViewportHeight = 900.0f;
+	params.TargetTriangleSize = 8.0f;
+	params.MaxTessFactor = 64.0f;
+	return params;
+}
+
+int VerifyFactors()
+{
+	// Odd patch count so the scalar tail and the SIMD body both produce shared edges
+	TriPatchGrid grid;
+	BuildTriPatchGrid(37, 200.0f, grid);
+	AdaptiveTessParams params = DefaultAdaptiveParams();
+	ComputeGridFactors(grid, params);
+
+	// Every shared edge has to get bit identical factors from both patches
+	SuiteCheck check("factors");
+	int mismatches = 0, outOfRange = 0;
+	for (int patch = 0; patch + 1 < grid.Count; patch += 2)
+	{
+		// Diagonal 2-0 is edge 0 of the first patch and edge 2 of the second one
+		if (grid.Edges[0][patch] != grid.Edges[2][patch + 1])
+			mismatches++;
+	}
+	for (int patch = 0; patch < grid.Count; patch++)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			if (!(grid.Edges[e][patch] >= 1.0f && grid.Edges[e][patch] <= params.MaxTessFactor))
+				outOfRange++;
+		}
+	}
+	check.FailIf(mismatches != 0, "%d shared edges got different factors", mismatches);
+	check.FailIf(outOfRange != 0, "%d edge factors out of [1, %g]", outOfRange, params.MaxTessFactor);
+	return check.Finish("%d patches", grid.Count);
+}
+
+void RunFactorThroughput(int numPatches)
+{
+	int quadsPerSide = std::max(1, (int)sqrtf((float)numPatches / 2.0f));
+	TriPatchGrid grid;
+	BuildTriPatchGrid(quadsPerSide, 2000.0f, grid);
+	AdaptiveTessParams params = DefaultAdaptiveParams();
+
+	const int iterations = 20;
+	double start = GetTimeSeconds();
+	for (int i = 0; i < iterations; i++)
+		ComputeGridFactors(grid, params);
+	double seconds = (GetTimeSeconds() - start) / iterations;
+
+	double average = 0.0;
+	for (int patch = 0; patch < grid.Count; patch++)
+		average += grid.Inside[patch];
+	printf("factors %8d tri patches  %10.3f ms  %8.2f Mpatches/s  (average inside factor %.2f)\n",
+		grid.Count, seconds * 1000.0, (double)grid.Count / seconds * 1e-6, average / grid.Count);
+}
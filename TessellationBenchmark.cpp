@@ -0,0 +1,214 @@
+//--------------------------------------------------------------------------------------
+// File: TessellationBenchmark.cpp
+//
+// Headless benchmark for the CPU side of the tessellation pipeline. Builds without
+// Win32 or D3D11 so it can run on machines without a GPU. The suites live next to the
+// modules they cover, see BenchmarkSuite.h.
+//
+// Usage: TessellationBenchmark [-suite <name>|all] [-verify] [-domain tri|quad]
+//                              [-partitioning integer|odd|even] [-factor <f>] [-patches <n>]
+//                              [-script <file>] [-report <file>] [-heightmap <samples>]
+//                              [-image <file>]
+//
+// Suites: tessellator, factors, culling, pyramid, textures, compression, shaders, tasks, state,
+//         ring, profiler, script, budget, density, normals, quads, quadtree, streaming, heights,
+//         baked, raster, jobs, retess, controlpoints, instances
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "Tessellator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+static bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* pArg = argv[i];
+		const char* pValue = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(pArg, "-suite") == 0 && pValue)
+		{
+			options.Suite = pValue;
+			i++;
+		}
+		else if (strcmp(pArg, "-verify") == 0)
+		{
+			options.Verify = true;
+		}
+		else if (strcmp(pArg, "-domain") == 0 && pValue)
+		{
+			options.Domain = (strcmp(pValue, "quad") == 0) ? TESS_DOMAIN_QUAD : TESS_DOMAIN_TRI;
+			i++;
+		}
+		else if (strcmp(pArg, "-partitioning") == 0 && pValue)
+		{
+			if (strcmp(pValue, "integer") == 0)
+				options.Partitioning = TESS_PARTITIONING_INTEGER;
+			else if (strcmp(pValue, "even") == 0)
+				options.Partitioning = TESS_PARTITIONING_FRACTIONAL_EVEN;
+			else
+				options.Partitioning = TESS_PARTITIONING_FRACTIONAL_ODD;
+			i++;
+		}
+		else if (strcmp(pArg, "-factor") == 0 && pValue)
+		{
+			options.Factor = (float)atof(pValue);
+			i++;
+		}
+		else if (strcmp(pArg, "-patches") == 0 && pValue)
+		{
+			options.Patches = atoi(pValue);
+			i++;
+		}
+		else if (strcmp(pArg, "-script") == 0 && pValue)
+		{
+			options.Script = pValue;
+			i++;
+		}
+		else if (strcmp(pArg, "-report") == 0 && pValue)
+		{
+			options.Report = pValue;
+			i++;
+		}
+		else if (strcmp(pArg, "-heightmap") == 0 && pValue)
+		{
+			options.HeightmapSize = (unsigned int)atoi(pValue);
+			i++;
+		}
+		else if (strcmp(pArg, "-image") == 0 && pValue)
+		{
+			options.Image = pValue;
+			i++;
+		}
+		else
+		{
+			printf("Unknown option %s\n", pArg);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool SuiteEnabled(const BenchmarkOptions& options, const char* pSuite)
+{
+	return strcmp(options.Suite, "all") == 0 || strcmp(options.Suite, pSuite) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	if (!ParseOptions(argc, argv, options))
+		return 2;
+
+	if (options.Verify)
+	{
+		int failures = 0;
+		if (SuiteEnabled(options, "tessellator"))
+			failures += VerifyTessellator();
+		if (SuiteEnabled(options, "factors"))
+			failures += VerifyFactors();
+		if (SuiteEnabled(options, "culling"))
+			failures += VerifyCulling();
+		if (SuiteEnabled(options, "pyramid"))
+			failures += VerifyPyramid();
+		if (SuiteEnabled(options, "textures"))
+			failures += VerifyTextures();
+		if (SuiteEnabled(options, "compression"))
+			failures += VerifyCompression();
+		if (SuiteEnabled(options, "shaders"))
+			failures += VerifyShaderCache();
+		if (SuiteEnabled(options, "tasks"))
+			failures += VerifyTaskGraph();
+		if (SuiteEnabled(options, "state"))
+			failures += VerifyStateTracker();
+		if (SuiteEnabled(options, "ring"))
+			failures += VerifyRingAllocator();
+		if (SuiteEnabled(options, "profiler"))
+			failures += VerifyFrameProfiler();
+		if (SuiteEnabled(options, "script"))
+			failures += VerifyBenchmarkScript();
+		if (SuiteEnabled(options, "budget"))
+			failures += VerifyTessBudget();
+		if (SuiteEnabled(options, "density"))
+			failures += VerifyTessDensity();
+		if (SuiteEnabled(options, "normals"))
+			failures += VerifyNormalMap();
+		if (SuiteEnabled(options, "quads"))
+			failures += VerifyQuadPatches();
+		if (SuiteEnabled(options, "quadtree"))
+			failures += VerifyQuadtree();
+		if (SuiteEnabled(options, "streaming"))
+			failures += VerifyStreaming();
+		if (SuiteEnabled(options, "heights"))
+			failures += VerifyHeightField();
+		if (SuiteEnabled(options, "baked"))
+			failures += VerifyBakedTerrain();
+		if (SuiteEnabled(options, "raster"))
+			failures += VerifySoftwareRenderer();
+		if (SuiteEnabled(options, "jobs"))
+			failures += VerifyJobSystem();
+		if (SuiteEnabled(options, "retess"))
+			failures += VerifyTessellationCache();
+		if (SuiteEnabled(options, "controlpoints"))
+			failures += VerifyControlPointFormat();
+		if (SuiteEnabled(options, "instances"))
+			failures += VerifyPatchInstances();
+		return failures == 0 ? 0 : 1;
+	}
+
+	if (SuiteEnabled(options, "tessellator"))
+		RunTessellatorSuite(options);
+	if (SuiteEnabled(options, "factors"))
+		RunFactorThroughput(options.Patches * 10);
+	if (SuiteEnabled(options, "culling"))
+		RunCullingThroughput(options.Patches * 10);
+	if (SuiteEnabled(options, "pyramid"))
+		RunPyramidThroughput();
+	if (SuiteEnabled(options, "textures"))
+		RunTextureThroughput();
+	if (SuiteEnabled(options, "compression"))
+		RunCompressionThroughput();
+	if (SuiteEnabled(options, "shaders"))
+		RunShaderCacheThroughput();
+	if (SuiteEnabled(options, "tasks"))
+		RunTaskGraphThroughput();
+	if (SuiteEnabled(options, "state"))
+		RunStateTrackerThroughput();
+	if (SuiteEnabled(options, "ring"))
+		RunRingAllocatorThroughput();
+	if (SuiteEnabled(options, "profiler"))
+		RunFrameProfilerThroughput();
+	if (SuiteEnabled(options, "script"))
+		RunScriptSuite(options);
+	if (SuiteEnabled(options, "budget"))
+		RunTessBudgetSuite();
+	if (SuiteEnabled(options, "density"))
+		RunTessDensitySuite();
+	if (SuiteEnabled(options, "normals"))
+		RunNormalMapSuite();
+	if (SuiteEnabled(options, "quads"))
+		RunQuadPatchSuite();
+	if (SuiteEnabled(options, "quadtree"))
+		RunQuadtreeSuite();
+	if (SuiteEnabled(options, "streaming"))
+		RunStreamingSuite(options);
+	if (SuiteEnabled(options, "heights"))
+		RunHeightFieldSuite();
+	if (SuiteEnabled(options, "baked"))
+		RunBakedTerrainSuite();
+	if (SuiteEnabled(options, "raster"))
+		RunSoftwareRendererSuite(options);
+	if (SuiteEnabled(options, "jobs"))
+		RunJobSystemSuite();
+	if (SuiteEnabled(options, "retess"))
+		RunTessellationCacheSuite(options);
+	if (SuiteEnabled(options, "controlpoints"))
+		RunControlPointFormatSuite();
+	if (SuiteEnabled(options, "instances"))
+		RunPatchInstancesSuite();
+	return 0;
+}
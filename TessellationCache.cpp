@@ -0,0 +1,165 @@
+//--------------------------------------------------------------------------------------
+// File: TessellationCache.cpp
+//--------------------------------------------------------------------------------------
+#include "TessellationCache.h"
+#include <math.h>
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define INSIDE_FACTOR_KEY       (1ull << 63)
+
+
+//--------------------------------------------------------------------------------------
+// TessFactorStabilizer
+//--------------------------------------------------------------------------------------
+void TessFactorStabilizer::Init(float hysteresis, float factorStep)
+{
+	m_Hysteresis = hysteresis;
+	m_FactorStep = factorStep;
+	m_Factors.clear();
+}
+
+unsigned long long TessFactorStabilizer::GetEdgeKey(unsigned int a, unsigned int b)
+{
+	return (a < b) ? ((unsigned long long)a << 32 | b) : ((unsigned long long)b << 32 | a);
+}
+
+// The last value while the factor stays within the hysteresis, otherwise the factor
+// rounded to the step. Both patches of an edge pass the same factor, so the second one
+// either keeps the value the first one kept or rounds to the value it stored.
+float TessFactorStabilizer::Stabilize(unsigned long long key, float factor)
+{
+	std::unordered_map<unsigned long long, float>::iterator it = m_Factors.find(key);
+	if (it != m_Factors.end() && fabsf(factor - it->second) <= m_Hysteresis * it->second)
+		return it->second;
+
+	float value = factor;
+	if (m_FactorStep > 0.0f)
+	{
+		value = floorf(factor / m_FactorStep + 0.5f) * m_FactorStep;
+		value = (value < m_FactorStep) ? m_FactorStep : value;
+	}
+	m_Factors[key] = value;
+	return value;
+}
+
+void TessFactorStabilizer::StabilizeFactors(unsigned int patch, const unsigned long long* pEdgeKeys, int numEdges,
+	float factors[6])
+{
+	for (int e = 0; e < numEdges; e++)
+		factors[e] = Stabilize(pEdgeKeys[e], factors[e]);
+	int insideFactors = (numEdges == 4) ? 2 : 1;
+	for (int i = 0; i < insideFactors; i++)
+		factors[4 + i] = Stabilize(INSIDE_FACTOR_KEY | ((unsigned long long)patch << 1) | i, factors[4 + i]);
+}
+
+
+//--------------------------------------------------------------------------------------
+// TessellationCache
+//--------------------------------------------------------------------------------------
+void TessellationCache::Init(const TessellationCacheDesc& desc)
+{
+	Clear();
+	m_Desc = desc;
+	m_Stabilizer.Init(desc.Hysteresis, desc.FactorStep);
+	m_Stats = TessellationCacheStats();
+}
+
+void TessellationCache::Clear()
+{
+	for (std::unordered_map<unsigned int, TessCacheEntry*>::iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+		delete it->second;
+	m_Entries.clear();
+	m_Lru.clear();
+	m_Filled.clear();
+	m_Stabilizer.Clear();
+	m_Stats.Entries = 0;
+	m_Stats.Bytes = 0;
+}
+
+void TessellationCache::SetContentKey(unsigned long long key)
+{
+	if (key == m_ContentKey)
+		return;
+	Clear();
+	m_ContentKey = key;
+}
+
+TessCacheEntry* TessellationCache::Acquire(unsigned int patch, const float factors[6], bool& hit)
+{
+	hit = false;
+	TessCacheEntry* pEntry;
+	std::unordered_map<unsigned int, TessCacheEntry*>::iterator it = m_Entries.find(patch);
+	if (it != m_Entries.end())
+	{
+		pEntry = it->second;
+		if (pEntry->DrawIndex == m_DrawIndex)
+			return NULL;
+		m_Lru.splice(m_Lru.begin(), m_Lru, pEntry->LruPosition);
+		hit = pEntry->Valid && memcmp(pEntry->Factors, factors, sizeof(pEntry->Factors)) == 0;
+	}
+	else
+	{
+		pEntry = new TessCacheEntry();
+		pEntry->Patch = patch;
+		m_Lru.push_front(patch);
+		pEntry->LruPosition = m_Lru.begin();
+		m_Entries[patch] = pEntry;
+		m_Stats.Entries++;
+	}
+	pEntry->DrawIndex = m_DrawIndex;
+
+	if (hit)
+	{
+		m_Stats.Hits++;
+		return pEntry;
+	}
+	m_Stats.Misses++;
+	memcpy(pEntry->Factors, factors, sizeof(pEntry->Factors));
+	pEntry->Valid = false;
+	pEntry->Vertices.clear();
+	pEntry->Indices.clear();
+	m_Filled.push_back(pEntry);
+	return pEntry;
+}
+
+void TessellationCache::Trim()
+{
+	// The capacities count, cleared vectors keep theirs for the next fill
+	for (size_t i = 0; i < m_Filled.size(); i++)
+	{
+		TessCacheEntry& entry = *m_Filled[i];
+		unsigned long long bytes = entry.Vertices.capacity() * sizeof(TessCacheVertex) +
+			entry.Indices.capacity() * sizeof(unsigned short);
+		m_Stats.Bytes += bytes - entry.Bytes;
+		entry.Bytes = bytes;
+	}
+	m_Filled.clear();
+
+	while (m_Stats.Bytes > m_Desc.BudgetBytes && !m_Lru.empty())
+	{
+		std::unordered_map<unsigned int, TessCacheEntry*>::iterator it = m_Entries.find(m_Lru.back());
+		m_Stats.Bytes -= it->second->Bytes;
+		m_Stats.Entries--;
+		m_Stats.Evictions++;
+		delete it->second;
+		m_Entries.erase(it);
+		m_Lru.pop_back();
+	}
+}
+
+const TessCacheEntry* TessellationCache::Find(unsigned int patch) const
+{
+	std::unordered_map<unsigned int, TessCacheEntry*>::const_iterator it = m_Entries.find(patch);
+	return (it != m_Entries.end()) ? it->second : NULL;
+}
+
+void TessellationCache::ResetCounters()
+{
+	m_Stats.Hits = 0;
+	m_Stats.Misses = 0;
+	m_Stats.Evictions = 0;
+}
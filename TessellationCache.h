@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// File: TessellationCache.h
+//
+// Keeps the tessellated and displaced output of terrain patches across frames, so a
+// slowly moving camera only pays the tessellator and DS for the patches whose factors
+// changed. An entry holds the world positions, texture coordinates and triangles of one
+// patch at one set of factors and is reused while the patch is drawn with them again.
+// This cache serves the software renderer; the D3D11 path keeps its entries in a
+// stream-out buffer, see GpuTessellationCache.h.
+//
+// The factors of a moving camera change a little in every frame, so they are stabilized
+// before the lookup: a factor keeps its last value until the new one differs from it by
+// more than the hysteresis, relative, and is then rounded to a multiple of the factor
+// step. Edge factors are kept per edge, not per patch, so the two patches of an edge
+// always get the same value and the terrain stays watertight. After each draw the
+// entries beyond the memory budget are evicted, least recently used first.
+//
+// The positions also depend on the grid, the world scale and the displacement; callers
+// pass a key of those to SetContentKey, and a new key drops every entry.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct TessellationCacheDesc
+{
+	unsigned long long BudgetBytes = 64ull << 20;   // vertex and index bytes of all entries
+	float Hysteresis = 0.1f;            // relative change of a factor that regenerates its patches
+	float FactorStep = 0.25f;           // stabilized factors are rounded to multiples of it, 0 keeps them
+};
+
+struct TessellationCacheStats
+{
+	long long Hits = 0;                 // patches drawn from an entry
+	long long Misses = 0;               // patches tessellated again
+	long long Evictions = 0;
+	int Entries = 0;
+	unsigned long long Bytes = 0;
+};
+
+// A domain point after DS, before the projection
+struct TessCacheVertex
+{
+	float Position[3];                  // world space, displaced
+	float TexCoord[2];
+};
+
+struct TessCacheEntry
+{
+	std::vector<TessCacheVertex> Vertices;
+	std::vector<unsigned short> Indices;    // triangle list, TESS_MAX_POINTS fits 16 bits
+	bool Valid = false;                 // false until the caller of Acquire filled it
+
+	// Used by the cache
+	unsigned int Patch = 0;
+	float Factors[6];
+	unsigned long long Bytes = 0;
+	unsigned int DrawIndex = 0;         // of the last Acquire
+	std::list<unsigned int>::iterator LruPosition;
+};
+
+
+//--------------------------------------------------------------------------------------
+// TessFactorStabilizer
+//
+// The factor stabilization of the cache on its own, shared with GpuTessellationCache
+//--------------------------------------------------------------------------------------
+class TessFactorStabilizer
+{
+public:
+	TessFactorStabilizer() : m_Hysteresis(0.1f), m_FactorStep(0.25f) {}
+
+	// Forgets every stabilized factor
+	void Init(float hysteresis, float factorStep);
+	void Clear() { m_Factors.clear(); }
+
+	// Key of the edge between two control points, the same for both orders. The indices
+	// have to be below 2^31.
+	static unsigned long long GetEdgeKey(unsigned int a, unsigned int b);
+
+	// Stabilizes the factors of a patch in place, in the order of TessFactors.h: numEdges
+	// edge factors with their keys, then one inside factor for 3 edges or two for 4
+	void StabilizeFactors(unsigned int patch, const unsigned long long* pEdgeKeys, int numEdges, float factors[6]);
+
+private:
+	float Stabilize(unsigned long long key, float factor);
+
+	float m_Hysteresis;
+	float m_FactorStep;
+	std::unordered_map<unsigned long long, float> m_Factors;    // by edge key, inside factors have bit 63 set
+};
+
+
+//--------------------------------------------------------------------------------------
+// TessellationCache
+//--------------------------------------------------------------------------------------
+class TessellationCache
+{
+public:
+	TessellationCache() {}
+	~TessellationCache() { Clear(); }
+
+	// Drops every entry and starts over with desc
+	void Init(const TessellationCacheDesc& desc);
+	void Clear();
+
+	// Drops every entry and stabilized factor if key differs from the last one
+	void SetContentKey(unsigned long long key);
+
+	// See TessFactorStabilizer
+	static unsigned long long GetEdgeKey(unsigned int a, unsigned int b) { return TessFactorStabilizer::GetEdgeKey(a, b); }
+	void StabilizeFactors(unsigned int patch, const unsigned long long* pEdgeKeys, int numEdges, float factors[6])
+	{
+		m_Stabilizer.StabilizeFactors(patch, pEdgeKeys, numEdges, factors);
+	}
+
+	// Starts a draw, Acquire hands out every entry once per draw
+	void BeginDraw() { m_DrawIndex++; }
+
+	// The entry of a patch at stabilized factors. hit tells if it already holds their
+	// output; otherwise the caller fills Vertices and Indices and sets Valid before Trim.
+	// Returns NULL if the patch was already acquired in this draw.
+	TessCacheEntry* Acquire(unsigned int patch, const float factors[6], bool& hit);
+
+	// Accounts the entries filled since the last Trim and evicts down to the budget
+	void Trim();
+
+	// The entry of a patch or NULL, without touching it
+	const TessCacheEntry* Find(unsigned int patch) const;
+
+	const TessellationCacheStats& GetStats() const { return m_Stats; }
+	void ResetCounters();
+
+private:
+	TessellationCacheDesc m_Desc;
+	unsigned long long m_ContentKey = 0;
+	unsigned int m_DrawIndex = 0;
+	TessFactorStabilizer m_Stabilizer;
+	std::unordered_map<unsigned int, TessCacheEntry*> m_Entries;
+	std::list<unsigned int> m_Lru;                              // most recently used first
+	std::vector<TessCacheEntry*> m_Filled;                      // acquired as misses since the last Trim
+	TessellationCacheStats m_Stats;
+};
@@ -0,0 +1,544 @@
+//--------------------------------------------------------------------------------------
+// File: TessellationCacheSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TessellationCache.h"
+#include "GpuTessellationCache.h"
+#include "HeightPyramid.h"
+#include "SoftwareRenderer.h"
+#include "TerrainGrid.h"
+#include "Tessellator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+
+
+//--------------------------------------------------------------------------------------
+// Retessellation cache. Stabilized factors have to follow the hysteresis and agree on
+// shared edges, cached frames have to match the frames of a renderer without the cache,
+// the entries of neighbouring patches have to agree on their edges and the cache has to
+// stay within its budget. The plans of the GPU cache have to give every drawn patch a
+// slot of the vertices the tessellator generates, replayed exactly once.
+//--------------------------------------------------------------------------------------
+#define RETESS_GRID_SIZE        16
+#define RETESS_EDGES            64
+#define RETESS_STEPS            2000
+#define RETESS_FRAMES           24
+#define RETESS_SLOW_SPEED       0.03f   // camera angle per frame, radians
+#define RETESS_GPU_FACTOR       16.0f
+#define RETESS_GPU_BUDGET       (16ull << 20)
+
+static void RetessSceneFrame(float t, const SceneSettings& settings, float width, float height, SceneCamera& camera,
+	SceneFrame& scene, StaticConstants& constants)
+{
+	float projection[4][4];
+	JobsSceneFrame(t, settings, camera, scene, projection);
+	BuildStaticConstants(projection, width, height, constants);
+}
+
+static bool SameSoftwareFrame(const SoftwareRenderer& a, const SoftwareRenderer& b)
+{
+	if (a.GetColor().Texels != b.GetColor().Texels)
+		return false;
+	for (int y = 0; y < a.GetHeight(); y++)
+	{
+		for (int x = 0; x < a.GetWidth(); x++)
+		{
+			if (a.GetDepth(x, y) != b.GetDepth(x, y))
+				return false;
+		}
+	}
+	return true;
+}
+
+// Edges between drawn grid patches whose entries have different factors on them. The
+// tessellator puts the same points on edges with the same factor, see the quads suite.
+static int CountCachedEdgeMismatches(const TessellationCache& cache, const TerrainGrid& grid, bool quads,
+	const std::vector<char>& drawn, int* pCheckedEdges)
+{
+	static const int s_QuadEdgePoints[4][2] = { { 0, 1 }, { 3, 0 }, { 3, 2 }, { 1, 2 } };
+	int controlPoints = quads ? 4 : 3;
+	std::map<unsigned long long, std::vector<std::pair<unsigned int, int> > > edgeSides;
+	for (int p = 0; p < grid.GetPatchCount(); p++)
+	{
+		if (!drawn[p])
+			continue;
+		unsigned int indices[TERRAIN_INDICES_PER_PATCH];
+		if (quads)
+			grid.GetQuadPatchIndices(p, indices);
+		else
+			grid.GetPatchIndices(p, indices);
+		for (int half = 0; half < (quads ? 1 : 2); half++)
+		{
+			const unsigned int* pIndices = indices + half * controlPoints;
+			for (int e = 0; e < controlPoints; e++)
+			{
+				unsigned long long key = quads ?
+					TessellationCache::GetEdgeKey(pIndices[s_QuadEdgePoints[e][0]], pIndices[s_QuadEdgePoints[e][1]]) :
+					TessellationCache::GetEdgeKey(pIndices[(e + 1) % 3], pIndices[(e + 2) % 3]);
+				edgeSides[key].push_back(std::make_pair(quads ? p : p * 2 + half, e));
+			}
+		}
+	}
+
+	int mismatches = 0, checked = 0;
+	for (std::map<unsigned long long, std::vector<std::pair<unsigned int, int> > >::const_iterator it = edgeSides.begin();
+		it != edgeSides.end(); ++it)
+	{
+		if (it->second.size() != 2)
+			continue;
+		const TessCacheEntry* pA = cache.Find(it->second[0].first);
+		const TessCacheEntry* pB = cache.Find(it->second[1].first);
+		if (!pA || !pB || !pA->Valid || !pB->Valid)
+			continue;
+		checked++;
+		mismatches += (pA->Factors[it->second[0].second] != pB->Factors[it->second[1].second]) ? 1 : 0;
+	}
+	*pCheckedEdges = checked;
+	return mismatches;
+}
+
+// The visible patches of a grid frame as the demo plans them for the GPU cache
+static int PlanGpuCacheFrame(GpuTessellationCache& cache, TerrainTriangleCounter& counter, TerrainGrid& grid, float t,
+	const SceneSettings& settings, std::vector<int>& visible, std::vector<GpuTessCachePatch>& patches)
+{
+	SceneCamera camera;
+	SceneFrame scene;
+	float projection[4][4];
+	JobsSceneFrame(t, settings, camera, scene, projection);
+	grid.UpdateBounds(scene.WorldScale, settings.Scaling * settings.DisplacementLevel);
+	int count = grid.Cull(scene.ViewFrustum, &visible[0]);
+	counter.ComputeFactors(grid, &visible[0], count, camera, settings, scene, projection[1][1], SCRIPT_VIEWPORT_HEIGHT);
+	int cachePatches = count * (settings.QuadPatches ? 1 : 2);
+	patches.resize(cachePatches);
+	if (cachePatches > 0)
+		BuildGridCachePatches(grid, &visible[0], count, settings.QuadPatches, counter, &patches[0]);
+	cache.Update(patches.empty() ? NULL : &patches[0], cachePatches, settings.QuadPatches ? 4 : 3);
+	return cachePatches;
+}
+
+// Errors of the last plan of the cache. The fills write the Id of their patch into
+// slotTags, a stand-in for the stream-out buffer, and have to be sized like the
+// tessellator's output. Every cached patch has to find its own Id in its slot, and the
+// replay draws have to cover exactly the slots of the cached patches.
+static int CheckGpuCachePlan(const GpuTessellationCache& cache, const std::vector<GpuTessCachePatch>& patches, int numEdges,
+	CpuTessellator& tessellator, std::vector<int>& slotTags, std::vector<char>& covered)
+{
+	int errors = 0;
+	unsigned int capacity = cache.GetCapacity();
+	const std::vector<GpuTessCacheFill>& fills = cache.GetFills();
+	for (size_t i = 0; i < fills.size(); i++)
+	{
+		const GpuTessCacheFill& fill = fills[i];
+		const float* pFactors = patches[fill.Patch].Factors;
+		if (numEdges == 4)
+			tessellator.TessellateQuadDomain(pFactors[0], pFactors[1], pFactors[2], pFactors[3], pFactors[4], pFactors[5]);
+		else
+			tessellator.TessellateTriDomain(pFactors[0], pFactors[1], pFactors[2], pFactors[4]);
+		errors += (fill.VertexCount != (unsigned int)tessellator.GetIndexCount()) ? 1 : 0;
+		if (fill.FirstVertex + fill.VertexCount > capacity || (i > 0 && fills[i - 1].FirstVertex >= fill.FirstVertex))
+		{
+			errors++;
+			continue;
+		}
+		std::fill(slotTags.begin() + fill.FirstVertex, slotTags.begin() + fill.FirstVertex + fill.VertexCount,
+			(int)patches[fill.Patch].Id);
+	}
+
+	std::fill(covered.begin(), covered.end(), 0);
+	const std::vector<GpuTessCacheDraw>& draws = cache.GetDraws();
+	unsigned long long drawnVertices = 0;
+	for (size_t d = 0; d < draws.size(); d++)
+	{
+		const GpuTessCacheDraw& draw = draws[d];
+		if (draw.FirstVertex + draw.VertexCount > capacity ||
+			(d > 0 && draws[d - 1].FirstVertex + draws[d - 1].VertexCount >= draw.FirstVertex))
+		{
+			errors++;
+			continue;
+		}
+		std::fill(covered.begin() + draw.FirstVertex, covered.begin() + draw.FirstVertex + draw.VertexCount, 1);
+		drawnVertices += draw.VertexCount;
+	}
+
+	const std::vector<int>& uncached = cache.GetUncached();
+	std::vector<char> isUncached(patches.size(), 0);
+	for (size_t i = 0; i < uncached.size(); i++)
+		isUncached[uncached[i]] = 1;
+	unsigned long long slotVertices = 0;
+	for (size_t p = 0; p < patches.size(); p++)
+	{
+		unsigned int first, count;
+		bool found = cache.FindSlot(patches[p].Id, first, count);
+		if (isUncached[p] || !found)
+		{
+			errors += (isUncached[p] && found) || (!isUncached[p] && !found) ? 1 : 0;
+			continue;
+		}
+		slotVertices += count;
+		for (unsigned int v = first; v < first + count && v < capacity; v++)
+		{
+			if (slotTags[v] != (int)patches[p].Id || !covered[v])
+			{
+				errors++;
+				break;
+			}
+		}
+	}
+	errors += (slotVertices != drawnVertices) ? 1 : 0;
+	return errors;
+}
+
+int VerifyTessellationCache()
+{
+	SuiteCheck check("retess");
+
+	// Random walks of edge factors shared by neighbouring patches: patch p has the edges
+	// p, p + 1 and p + 2, stabilized in a different order every step
+	TessellationCacheDesc desc;
+	TessellationCache cache;
+	cache.Init(desc);
+	check.FailIf(TessellationCache::GetEdgeKey(3, 7) != TessellationCache::GetEdgeKey(7, 3) ||
+		TessellationCache::GetEdgeKey(3, 7) == TessellationCache::GetEdgeKey(3, 8),
+		"edge keys depend on the order of the vertices or collide");
+	unsigned int state = 12345;
+	std::vector<float> raw(RETESS_EDGES + 2), last(RETESS_EDGES + 2, 0.0f);
+	for (size_t e = 0; e < raw.size(); e++)
+		raw[e] = RandomFloat(state, 1.0f, 64.0f);
+	int ruleErrors = 0, sharedErrors = 0, changes = 0;
+	for (int step = 0; step < RETESS_STEPS; step++)
+	{
+		for (size_t e = 0; e < raw.size(); e++)
+			raw[e] = std::min(std::max(raw[e] * RandomFloat(state, 0.97f, 1.03f), 1.0f), 64.0f);
+		std::vector<float> stabilized(raw.size(), -1.0f);
+		for (int i = 0; i < RETESS_EDGES; i++)
+		{
+			unsigned int patch = (step & 1) ? i : RETESS_EDGES - 1 - i;
+			unsigned long long keys[3];
+			float factors[6] = { raw[patch], raw[patch + 1], raw[patch + 2], 8.0f, 0.0f, 0.0f };
+			for (int e = 0; e < 3; e++)
+				keys[e] = TessellationCache::GetEdgeKey(patch + e, patch + e + 1);
+			cache.StabilizeFactors(patch, keys, 3, factors);
+			for (int e = 0; e < 3; e++)
+			{
+				float& value = stabilized[patch + e];
+				sharedErrors += (value >= 0.0f && value != factors[e]) ? 1 : 0;
+				value = factors[e];
+			}
+		}
+		for (size_t e = 0; e < raw.size(); e++)
+		{
+			float value = stabilized[e], previous = last[e];
+			bool kept = previous > 0.0f && fabsf(raw[e] - previous) <= desc.Hysteresis * previous;
+			float rounded = std::max(floorf(raw[e] / desc.FactorStep + 0.5f) * desc.FactorStep, desc.FactorStep);
+			ruleErrors += (value != (kept ? previous : rounded)) ? 1 : 0;
+			changes += (value != previous) ? 1 : 0;
+			last[e] = value;
+		}
+	}
+	check.FailIf(ruleErrors > 0 || sharedErrors > 0 || changes >= RETESS_STEPS * (int)raw.size() / 2,
+		"%d factors break the hysteresis, %d shared edges differ, %d changes in %d steps", ruleErrors, sharedErrors,
+		changes, RETESS_STEPS);
+
+	// Without hysteresis and rounding the cached frames match the frames drawn without the
+	// cache, for both patch types, uniform and adaptive, while the camera moves
+	std::vector<Image> diffuseMips, normalMips;
+	HeightPyramid pyramid;
+	BuildRasterTextures(RASTER_TEXTURE_SIZE, diffuseMips, normalMips, pyramid);
+	SoftwareTextures textures;
+	textures.pDiffuseMips = &diffuseMips;
+	textures.pNormalMips = &normalMips;
+	textures.pDisplacement = &pyramid;
+	static const float s_ClearColor[4] = { 0.0f, 0.125f, 0.3f, 1.0f };
+	SoftwareRenderer reference, cached;
+	reference.Init(RASTER_WIDTH, RASTER_HEIGHT, 1);
+	cached.Init(RASTER_WIDTH, RASTER_HEIGHT, 3);
+	reference.SetTextures(textures);
+	cached.SetTextures(textures);
+	TessellationCacheDesc exactDesc;
+	exactDesc.Hysteresis = 0.0f;
+	exactDesc.FactorStep = 0.0f;
+	cache.Init(exactDesc);
+	cached.SetTessellationCache(&cache);
+	TerrainGrid grid;
+	grid.Build(RETESS_GRID_SIZE, RETESS_GRID_SIZE);
+	std::vector<int> patchList(grid.GetPatchCount());
+	for (int i = 0; i < grid.GetPatchCount(); i++)
+		patchList[i] = i;
+	auto drawBoth = [&](const SceneSettings& settings, const SceneFrame& scene, const StaticConstants& constants) -> bool
+	{
+		SoftwareRenderer* pRenderers[2] = { &reference, &cached };
+		for (int r = 0; r < 2; r++)
+		{
+			pRenderers[r]->BeginFrame(constants, s_ClearColor);
+			pRenderers[r]->DrawTerrain(grid, &patchList[0], (int)patchList.size(), settings, scene);
+			pRenderers[r]->EndFrame();
+		}
+		return SameSoftwareFrame(reference, cached);
+	};
+	for (int mode = 0; mode < 4; mode++)
+	{
+		SceneSettings settings;
+		settings.TessellationFactor = 16.0f;
+		settings.QuadPatches = (mode & 1) != 0;
+		settings.AdaptiveTessellation = (mode & 2) != 0;
+		int differences = 0;
+		long long cachedPatches = 0, patches = 0;
+		for (int frame = 0; frame < 3; frame++)
+		{
+			SceneCamera camera;
+			SceneFrame scene;
+			StaticConstants constants;
+			RetessSceneFrame(frame * 0.01f, settings, RASTER_WIDTH, RASTER_HEIGHT, camera, scene, constants);
+			differences += drawBoth(settings, scene, constants) ? 0 : 1;
+			if (frame > 0)
+			{
+				cachedPatches += cached.GetStats().CachedPatches;
+				patches += cached.GetStats().Patches;
+			}
+		}
+		check.FailIf(differences > 0 || (!settings.AdaptiveTessellation && cachedPatches != patches),
+			"%s %s terrain, %d of 3 cached frames differ, %lld of %lld later patches cached",
+			settings.QuadPatches ? "quad" : "tri", settings.AdaptiveTessellation ? "adaptive" : "uniform", differences,
+			cachedPatches, patches);
+	}
+
+	// A budget of a third of the entries evicts, keeps the bytes below it and still draws
+	// the same frame, and other displacement drops the entries
+	SceneSettings uniform;
+	uniform.TessellationFactor = 16.0f;
+	SceneCamera camera;
+	SceneFrame scene;
+	StaticConstants constants;
+	RetessSceneFrame(0.0f, uniform, RASTER_WIDTH, RASTER_HEIGHT, camera, scene, constants);
+	drawBoth(uniform, scene, constants);
+	TessellationCacheDesc smallDesc = exactDesc;
+	smallDesc.BudgetBytes = cache.GetStats().Bytes / 3;
+	cache.Init(smallDesc);
+	int budgetErrors = 0;
+	for (int frame = 0; frame < 3; frame++)
+	{
+		budgetErrors += drawBoth(uniform, scene, constants) ? 0 : 1;
+		budgetErrors += (cache.GetStats().Bytes > smallDesc.BudgetBytes) ? 1 : 0;
+	}
+	long long evictions = cache.GetStats().Evictions;
+	uniform.DisplacementLevel = 0.2f;
+	RetessSceneFrame(0.0f, uniform, RASTER_WIDTH, RASTER_HEIGHT, camera, scene, constants);
+	bool displacedSame = drawBoth(uniform, scene, constants);
+	check.FailIf(budgetErrors > 0 || evictions == 0 || !displacedSame || cached.GetStats().CachedPatches != 0,
+		"%d frames differ or exceed the budget of %llu bytes, %lld evictions, other displacement %s with %lld cached patches",
+		budgetErrors, smallDesc.BudgetBytes, evictions, displacedSame ? "matches" : "differs", cached.GetStats().CachedPatches);
+
+	// With the default hysteresis a slowly moving camera reuses most patches, and the
+	// drawn patches of an edge have the same factor on it, also when one of them was
+	// culled in the frames before
+	cache.Init(desc);
+	std::vector<int> visible(grid.GetPatchCount());
+	std::vector<char> drawn(grid.GetPatchCount());
+	int mismatches = 0, checkedEdges = 0;
+	double hitRate = 1.0;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		SceneSettings settings;
+		settings.QuadPatches = mode == 1;
+		settings.AdaptiveTessellation = true;
+		long long cachedPatches = 0, patches = 0;
+		for (int frame = 0; frame < RETESS_FRAMES; frame++)
+		{
+			RetessSceneFrame(frame * RETESS_SLOW_SPEED, settings, RASTER_WIDTH, RASTER_HEIGHT, camera, scene, constants);
+			grid.UpdateBounds(scene.WorldScale, settings.Scaling * settings.DisplacementLevel);
+			int count = grid.Cull(scene.ViewFrustum, &visible[0]);
+			std::fill(drawn.begin(), drawn.end(), 0);
+			for (int i = 0; i < count; i++)
+				drawn[visible[i]] = 1;
+			cached.BeginFrame(constants, s_ClearColor);
+			cached.DrawTerrain(grid, &visible[0], count, settings, scene);
+			int checked;
+			mismatches += CountCachedEdgeMismatches(cache, grid, settings.QuadPatches, drawn, &checked);
+			checkedEdges += checked;
+			if (frame > 0)
+			{
+				cachedPatches += cached.GetStats().CachedPatches;
+				patches += cached.GetStats().Patches;
+			}
+		}
+		hitRate = std::min(hitRate, (double)cachedPatches / patches);
+	}
+	check.FailIf(mismatches > 0 || checkedEdges == 0 || hitRate < 0.5,
+		"%d of %d shared edges differ, %.0f%% of the patches of a slow camera cached", mismatches, checkedEdges,
+		hitRate * 100.0);
+
+	// The GPU cache of the demo's grid path on the same slow camera, for both patch types
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+	TerrainTriangleCounter counter;
+	GpuTessellationCache gpuCache;
+	TessellationCacheDesc gpuDesc;
+	gpuDesc.BudgetBytes = RETESS_GPU_BUDGET;
+	std::vector<GpuTessCachePatch> cachePatches;
+	std::vector<int> slotTags;
+	std::vector<char> covered;
+	double gpuHitRate = 1.0;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		SceneSettings settings;
+		settings.TessellationFactor = RETESS_GPU_FACTOR;
+		settings.QuadPatches = mode == 1;
+		settings.AdaptiveTessellation = true;
+		int numEdges = settings.QuadPatches ? 4 : 3;
+		gpuCache.Init(gpuDesc);
+		slotTags.assign(gpuCache.GetCapacity(), -1);
+		covered.assign(gpuCache.GetCapacity(), 0);
+		int planErrors = 0, fullyDrawn = 0;
+		for (int frame = 0; frame < RETESS_FRAMES; frame++)
+		{
+			int count = PlanGpuCacheFrame(gpuCache, counter, grid, frame * RETESS_SLOW_SPEED, settings, visible, cachePatches);
+			planErrors += CheckGpuCachePlan(gpuCache, cachePatches, numEdges, *pTessellator, slotTags, covered);
+			fullyDrawn += (count > 0 && gpuCache.GetUncached().empty()) ? 1 : 0;
+			if (frame == 0)
+				gpuCache.ResetCounters();
+		}
+		const TessellationCacheStats& stats = gpuCache.GetStats();
+		double rate = (double)stats.Hits / std::max(stats.Hits + stats.Misses, 1LL);
+		gpuHitRate = std::min(gpuHitRate, rate);
+
+		// The frame again fills nothing, and a new content key drops every slot
+		int count = PlanGpuCacheFrame(gpuCache, counter, grid, (RETESS_FRAMES - 1) * RETESS_SLOW_SPEED, settings, visible,
+			cachePatches);
+		planErrors += CheckGpuCachePlan(gpuCache, cachePatches, numEdges, *pTessellator, slotTags, covered);
+		size_t staticFills = gpuCache.GetFills().size();
+		gpuCache.SetContentKey(1);
+		int entriesAfterKey = gpuCache.GetStats().Entries;
+		PlanGpuCacheFrame(gpuCache, counter, grid, (RETESS_FRAMES - 1) * RETESS_SLOW_SPEED, settings, visible, cachePatches);
+		planErrors += CheckGpuCachePlan(gpuCache, cachePatches, numEdges, *pTessellator, slotTags, covered);
+		bool refilled = (int)gpuCache.GetFills().size() == count;
+		check.FailIf(planErrors > 0 || fullyDrawn != RETESS_FRAMES || rate < 0.5 || staticFills != 0 ||
+			entriesAfterKey != 0 || !refilled,
+			"GPU cache, %s patches: %d plan errors, %d of %d frames fully cached, %.0f%% hits, %d fills of a static frame, "
+			"%d slots after a new content key, %s", settings.QuadPatches ? "quad" : "tri", planErrors, fullyDrawn,
+			RETESS_FRAMES, rate * 100.0, (int)staticFills, entriesAfterKey, refilled ? "refilled" : "not refilled");
+	}
+
+	// A budget of a third of a frame's slots evicts the slots of the patches the frame
+	// does not draw only, draws the rest without the cache and stays within the budget
+	{
+		SceneSettings settings;
+		settings.TessellationFactor = RETESS_GPU_FACTOR;
+		settings.AdaptiveTessellation = true;
+		gpuCache.Init(gpuDesc);
+		PlanGpuCacheFrame(gpuCache, counter, grid, 0.0f, settings, visible, cachePatches);
+		TessellationCacheDesc smallDesc = gpuDesc;
+		smallDesc.BudgetBytes = gpuCache.GetStats().Bytes / 3;
+		gpuCache.Init(smallDesc);
+		slotTags.assign(gpuCache.GetCapacity(), -1);
+		covered.assign(gpuCache.GetCapacity(), 0);
+		int planErrors = 0, overBudget = 0;
+		long long uncachedPatches = 0;
+		for (int frame = 0; frame < RETESS_FRAMES; frame++)
+		{
+			PlanGpuCacheFrame(gpuCache, counter, grid, frame * RETESS_SLOW_SPEED * 4.0f, settings, visible, cachePatches);
+			planErrors += CheckGpuCachePlan(gpuCache, cachePatches, 3, *pTessellator, slotTags, covered);
+			overBudget += (gpuCache.GetStats().Bytes > smallDesc.BudgetBytes) ? 1 : 0;
+			uncachedPatches += (long long)gpuCache.GetUncached().size();
+		}
+		check.FailIf(planErrors > 0 || overBudget > 0 || gpuCache.GetStats().Evictions == 0 || uncachedPatches == 0,
+			"GPU cache with a budget of %llu bytes: %d plan errors, %d frames over it, %lld evictions, %lld uncached patches",
+			smallDesc.BudgetBytes, planErrors, overBudget, gpuCache.GetStats().Evictions, uncachedPatches);
+	}
+	delete pTessellator;
+
+	return check.Finish("%d factor steps, %d shared edges, %.0f%% cached on a slow camera, %.0f%% on the GPU", RETESS_STEPS,
+		checkedEdges, hitRate * 100.0, gpuHitRate * 100.0);
+}
+
+// Geometry only: the tessellator, DS and binning of the draws, without EndFrame
+void RunTessellationCacheSuite(const BenchmarkOptions& options)
+{
+	const int width = 1600, height = 900, frames = 30;
+	static const float s_ClearColor[4] = { 0.0f, 0.125f, 0.3f, 1.0f };
+	static const float s_Speeds[] = { 0.0f, 0.002f, 0.01f, 0.05f };
+	std::vector<Image> diffuseMips, normalMips;
+	HeightPyramid pyramid;
+	BuildRasterTextures(1024, diffuseMips, normalMips, pyramid);
+	SoftwareTextures textures;
+	textures.pDiffuseMips = &diffuseMips;
+	textures.pNormalMips = &normalMips;
+	textures.pDisplacement = &pyramid;
+	SoftwareRenderer renderer;
+	renderer.Init(width, height);
+	renderer.SetTextures(textures);
+	TerrainGrid grid;
+	grid.Build(RETESS_GRID_SIZE, RETESS_GRID_SIZE);
+	std::vector<int> patchList(grid.GetPatchCount());
+	for (int i = 0; i < grid.GetPatchCount(); i++)
+		patchList[i] = i;
+
+	SceneSettings settings;
+	settings.TessellationFactor = options.Factor > 0.0f ? options.Factor : 64.0f;
+	settings.AdaptiveTessellation = true;
+	for (int s = 0; s < (int)(sizeof(s_Speeds) / sizeof(s_Speeds[0])); s++)
+	{
+		for (int useCache = 0; useCache < 2; useCache++)
+		{
+			TessellationCache cache;
+			cache.Init(TessellationCacheDesc());
+			renderer.SetTessellationCache(useCache ? &cache : NULL);
+			double seconds = 0.0;
+			long long cachedPatches = 0, patches = 0;
+			for (int frame = 0; frame < frames; frame++)
+			{
+				SceneCamera camera;
+				SceneFrame scene;
+				StaticConstants constants;
+				RetessSceneFrame(frame * s_Speeds[s], settings, (float)width, (float)height, camera, scene, constants);
+				renderer.BeginFrame(constants, s_ClearColor);
+				renderer.DrawTerrain(grid, &patchList[0], (int)patchList.size(), settings, scene);
+				if (frame == 0)
+					continue;
+				seconds += renderer.GetStats().GeometrySeconds;
+				cachedPatches += renderer.GetStats().CachedPatches;
+				patches += renderer.GetStats().Patches;
+			}
+			printf("retess %dx%d tri adaptive  %.3f rad/frame  %-8s geometry %8.2f ms  %5.1f%% cached  %7.1f MB\n",
+				RETESS_GRID_SIZE, RETESS_GRID_SIZE, s_Speeds[s], useCache ? "cache" : "no cache",
+				seconds / (frames - 1) * 1000.0, 100.0 * cachedPatches / patches, cache.GetStats().Bytes / (1024.0 * 1024.0));
+		}
+	}
+	renderer.SetTessellationCache(NULL);
+
+	// The plan of the GPU cache per frame: factors, stabilization and slot allocation
+	std::vector<int> visible(grid.GetPatchCount());
+	std::vector<GpuTessCachePatch> cachePatches;
+	TerrainTriangleCounter counter;
+	for (int quads = 0; quads < 2; quads++)
+	{
+		settings.QuadPatches = quads != 0;
+		for (int s = 0; s < (int)(sizeof(s_Speeds) / sizeof(s_Speeds[0])); s++)
+		{
+			GpuTessellationCache gpuCache;
+			gpuCache.Init(TessellationCacheDesc());
+			double seconds = 0.0;
+			long long fills = 0;
+			for (int frame = 0; frame < frames; frame++)
+			{
+				double start = GetTimeSeconds();
+				PlanGpuCacheFrame(gpuCache, counter, grid, frame * s_Speeds[s], settings, visible, cachePatches);
+				if (frame == 0)
+				{
+					gpuCache.ResetCounters();
+					continue;
+				}
+				seconds += GetTimeSeconds() - start;
+				fills += (long long)gpuCache.GetFills().size();
+			}
+			const TessellationCacheStats& stats = gpuCache.GetStats();
+			printf("retess %dx%d %s adaptive  %.3f rad/frame  gpu plan %8.3f ms  %5.1f%% hits  %6.1f fills/frame  %7.1f MB\n",
+				RETESS_GRID_SIZE, RETESS_GRID_SIZE, quads ? "quad" : "tri ", s_Speeds[s], seconds / (frames - 1) * 1000.0,
+				100.0 * stats.Hits / std::max(stats.Hits + stats.Misses, 1LL), (double)fills / (frames - 1),
+				stats.Bytes / (1024.0 * 1024.0));
+		}
+	}
+}
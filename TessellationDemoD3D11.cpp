@@ -11,53 +11,134 @@
 #include <d3dcompiler.h>
 #include <xnamath.h>
 #include "resource.h"
+#include "TerrainGrid.h"
+#include "ControlPointFormat.h"
+#include "TerrainQuadtree.h"
+#include "BakedTerrain.h"
+#include "TerrainBaker.h"
+#include "SceneUpdate.h"
+#include "BenchmarkScript.h"
+#include "TessBudget.h"
+#include "HeightPyramid.h"
+#include "TessDensity.h"
+#include "NormalMap.h"
+#include "Hash.h"
+#include "TextureContainer.h"
+#include "ShaderCache.h"
+#include "D3DShaderCompiler.h"
+#include "DemoShaders.h"
+#include "D3DPatchBackend.h"
+#include "D3DStateBackend.h"
+#include "D3DGpuProfiler.h"
+#include "RingAllocator.h"
+#include "TaskGraph.h"
+#include "JobSystem.h"
+#include "TerrainPatchJobs.h"
+#include "GpuTessellationCache.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 //--------------------------------------------------------------------------------------
 // Structures
 //--------------------------------------------------------------------------------------
-struct SimpleVertex
+// Constant buffer with a copy of its last upload, unchanged constants are not uploaded
+struct TrackedConstantBuffer
 {
-	XMFLOAT3 Pos;
-	XMFLOAT2 TexCoord;
-	XMFLOAT3 Normal;
-	//Binormal;
-	//XMFLOAT3 Tangent;
+	ID3D11Buffer* pBuffer = NULL;
+	bool Dynamic = false;
+	std::vector<unsigned char> Uploaded;
 };
 
-struct Camera
+// Level 0 of a displacement map as HeightPyramid and TessDensityMap build from it: the
+// mapped container texels, the decoded blocks of a BC4 entry or the red channel of the
+// decoded image file
+struct DisplacementTexels
 {
-	XMVECTOR Eye;
-	XMVECTOR At;
-	XMVECTOR Up;
-
-	float Speed = 10.0f;
-
-	bool isMovingForward = false;
-	bool isMovingBackward = false;
-	bool isMovingLeft = false;
-	bool isMovingRight = false;
-	bool isMovingUp = false;
-	bool isMovingDown = false;
-
+	const unsigned char* pTexels = NULL;
+	int Width = 0;
+	int Height = 0;
+	int RowPitch = 0;
+	int TexelStride = 0;
+	Image Decoded;
 };
 
+// A baked terrain and the buffers of all its LOD blocks, drawn without tessellation
+struct BakedTerrainBuffers
+{
+	BakedTerrain Terrain;
+	ID3D11Buffer* pVertexBuffer = NULL;
+	ID3D11Buffer* pIndexBuffer = NULL;
+	UINT FirstVertex[BAKED_TERRAIN_MAX_LODS];   // of each LOD block in the buffers
+	UINT FirstIndex[BAKED_TERRAIN_MAX_LODS];
+};
 
-struct ConstantBuffer
+// The factors of a patch filled into or drawn around the retessellation cache,
+// "EDGEFACTORS" and "INSIDEFACTORS" of one instance. Keep in sync with VS_CACHE_INPUT in
+// DisplacedAndShaded.hlsl.
+struct TessCacheFactors
 {
-	XMMATRIX mWorld;
-	XMMATRIX mView;
-	XMMATRIX mProjection;
-	XMFLOAT4 vPos;
-	XMFLOAT4 LightPos;
-	XMFLOAT4 LightColor;
-	XMFLOAT4 Eye;
-	float TessellationFactor;
-	float Scaling;
-	float DisplacementLevel;
+	float Edges[4];                     // the Factors of a GpuTessCachePatch
+	float Inside[2];
 };
 
 
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define TERRAIN_PATCHES_X 8
+#define TERRAIN_PATCHES_Z 8
+
+// Levels of the quadtree terrain, 128 leaf cells per side
+#define QUADTREE_LEVELS 8
+
+// Most patches a quadtree selection draws
+#define QUADTREE_MAX_PATCHES 1024
+
+// Frames of visible patch indices the index ring holds before it is discarded
+#define INDEX_RING_FRAMES 4
+
+// Longest camera step in seconds, so a stall does not move the camera across the terrain
+#define MAX_CAMERA_STEP 0.1
+
+// Frames kept for the statistics, the older half is dropped when twice as many arrived
+#define FRAME_HISTORY_FRAMES 4096
+
+// Written by the P key
+#define FRAME_STATS_CSV_FILE "FrameStats.csv"
+#define FRAME_STATS_JSON_FILE "FrameStats.json"
+
+// Change of the tessellation budget target per up/down key press
+#define TESS_BUDGET_FRAME_TIME_STEP 0.0005
+#define TESS_BUDGET_TRIANGLES_STEP 1.25
+
+// Written by -benchmark unless -report names another file
+#define BENCHMARK_REPORT_FILE "BenchmarkReport.json"
+
+// Written by AssetCooker, the JPEG files are loaded when it is missing
+#define TEXTURE_CONTAINER_FILE "Textures/Textures.pack"
+
+// Displacement map of the grid and heightmap of the quadtree terrain, and the sidecar
+// caches of their min/max pyramids. A sidecar is keyed by the container entry or, without
+// the container, by the content of the image file.
+#define DISPLACEMENT_TEXTURE_FILE "Textures/Displacement/rock_displacement.jpg"
+#define DISPLACEMENT_PYRAMID_FILE "Textures/Displacement/rock_displacement.jpg.minmax"
+#define TERRAIN_DISPLACEMENT_TEXTURE_FILE "Textures/Displacement/mountaindispmap.png"
+#define TERRAIN_PYRAMID_FILE "Textures/Displacement/mountaindispmap.png.minmax"
+
+// Static LOD meshes of the grid and the quadtree terrain written by AssetCooker bake. On
+// feature level 10_x a missing or outdated one is baked at startup with the same chunks.
+#define BAKED_TERRAIN_FILE "Textures/Terrain.blod"
+#define QUADTREE_BAKED_TERRAIN_FILE "Textures/QuadtreeTerrain.blod"
+#define BAKED_TERRAIN_CHUNKS 8
+#define QUADTREE_BAKED_TERRAIN_CHUNKS 16
+
+// Stream-out buffer of the retessellation cache, its budget
+#define TESS_CACHE_BUFFER_BYTES (64 << 20)
+
+
 //--------------------------------------------------------------------------------------
 // Global Variables
 //--------------------------------------------------------------------------------------
@@ -74,37 +155,159 @@ ID3D11DepthStencilView*             g_pDepthStencilView = NULL;
 ID3D11VertexShader*                 g_pVertexShader = NULL;
 ID3D11HullShader*                   g_pHullShader = NULL;
 ID3D11DomainShader*                 g_pDomainShader = NULL;
+ID3D11HullShader*                   g_pQuadHullShader = NULL;
+ID3D11DomainShader*                 g_pQuadDomainShader = NULL;
+ID3D11VertexShader*                 g_pQuadtreeVertexShader = NULL;
+ID3D11HullShader*                   g_pQuadtreeHullShader = NULL;
+ID3D11DomainShader*                 g_pQuadtreeDomainShader = NULL;
+ID3D11VertexShader*                 g_pBakedVertexShader = NULL;
+ID3D11VertexShader*                 g_pCacheVertexShader = NULL;
+ID3D11HullShader*                   g_pCacheHullShader = NULL;
+ID3D11HullShader*                   g_pCacheQuadHullShader = NULL;
+ID3D11DomainShader*                 g_pCacheDomainShader = NULL;
+ID3D11DomainShader*                 g_pCacheQuadDomainShader = NULL;
+ID3D11GeometryShader*               g_pCacheGeometryShader = NULL;
+ID3D11VertexShader*                 g_pCachedVertexShader = NULL;
 ID3D11PixelShader*                  g_pPixelShader = NULL;
 ID3D11PixelShader*                  g_pSolidPixelShader = NULL;
 ID3D11InputLayout*                  g_pVertexLayout = NULL;
+ID3D11InputLayout*                  g_pQuadtreeVertexLayout = NULL;
+ID3D11InputLayout*                  g_pBakedVertexLayout = NULL;
+ID3D11InputLayout*                  g_pCacheVertexLayout = NULL;
+ID3D11InputLayout*                  g_pCachedVertexLayout = NULL;
 ID3D11Buffer*                       g_pVertexBuffer = NULL;
 ID3D11Buffer*                       g_pIndexBuffer = NULL;
-ID3D11Buffer*                       g_pConstantBuffer = NULL;
+ID3D11Buffer*                       g_pPatchVertexBuffer = NULL;
+ID3D11Buffer*                       g_pPatchIndexBuffer = NULL;
+ID3D11Buffer*                       g_pPatchInstanceBuffer = NULL;
+ID3D11Buffer*                       g_pStreamOutBuffer = NULL;
+ID3D11Buffer*                       g_pCacheFactorBuffer = NULL;
+ID3D11Buffer*                       g_pStaticConstants = NULL;
+TrackedConstantBuffer               g_FrameConstants;
+TrackedConstantBuffer               g_DrawConstants;
+RingAllocator                       g_IndexRing;
+UINT                                g_IndexSize = sizeof(WORD);     // of the ring, 32 bits for grids beyond 65536 vertices
+DXGI_FORMAT                         g_IndexFormat = DXGI_FORMAT_R16_UINT;
 ID3D11ShaderResourceView*           g_pDiffuseTextureRV = NULL;
 ID3D11ShaderResourceView*           g_pDispTextureRV = NULL;
 ID3D11ShaderResourceView*           g_pNormTextureRV = NULL;
+ID3D11ShaderResourceView*           g_pDensityTextureRV = NULL;
+ID3D11ShaderResourceView*           g_pTerrainDispTextureRV = NULL;
+ID3D11ShaderResourceView*           g_pTerrainNormTextureRV = NULL;
 ID3D11SamplerState*                 g_pSamplerPoint = NULL;
 ID3D11SamplerState*                 g_pSamplerLinear = NULL;
 ID3D11RasterizerState*              g_pWireFrameRasterizerState = NULL;
 ID3D11RasterizerState*              g_pDefaultRasterizerState = NULL;
-XMMATRIX                            g_World;
-XMMATRIX                            g_View;
-XMMATRIX                            g_Projection;
-Camera                              g_Camera;
+float                               g_Projection[4][4];
+SceneCamera                         g_Camera;
+SceneSettings                       g_Settings;
 bool                                g_IsWireFrame = false;
-float                               g_TessellationFactor = 64.0f;
-float                               g_Scaling = 3.0f;
-float                               g_DisplacementLevel = 0.1f;
+XMFLOAT2                            g_ViewportSize;
+TerrainGrid                         g_TerrainGrid;
+int*                                g_pVisiblePatches = NULL;
+int                                 g_VisiblePatchCount = 0;
+D3D11_PRIMITIVE_TOPOLOGY            g_PatchTopology = D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST;
+ID3D11Buffer*                       g_pBoundVertexBuffer = NULL;
+ID3D11Buffer*                       g_pBoundIndexBuffer = NULL;
+ID3D11InputLayout*                  g_pBoundVertexLayout = NULL;
+bool                                g_TessellationSupported = true;
+BakedTerrainBuffers                 g_BakedGrid;
+BakedTerrainBuffers                 g_BakedQuadtree;
+BakedDraw*                          g_pBakedDraws = NULL;
+int                                 g_BakedDrawCount = 0;
+TerrainQuadtree                     g_TerrainQuadtree;
+HeightPyramid                       g_TerrainPyramid;
+QuadtreePatch*                      g_pQuadtreePatches = NULL;
+PatchInstanceStreams                g_PatchInstanceStreams;
+D3DPatchBackend                     g_PatchBackend;
+HeightPyramid                       g_DisplacementPyramid;
+TessDensityMap                      g_DensityMap;
+D3DStateBackend                     g_StateBackend;
+StateTracker                        g_StateTracker(&g_StateBackend);
+FrameClock                          g_FrameClock;
+FrameRecordRing                     g_FrameRecords;
+FrameProfiler                       g_FrameProfiler(&g_FrameRecords);
+D3DGpuProfiler                      g_GpuProfiler;
+std::vector<FrameRecord>            g_FrameHistory;
+ScriptedBenchmark*                  g_pBenchmark = NULL;
+std::string                         g_BenchmarkScriptFile;
+std::string                         g_BenchmarkReportFile = BENCHMARK_REPORT_FILE;
+int                                 g_BenchmarkFirstFrame = -1;
+JobSystem                           g_Jobs;
+TerrainPatchJobs                    g_TerrainPatchJobs;
+TessBudgetController                g_TessBudget;
+GpuTessellationCache                g_GpuTessCache;
+TerrainTriangleCounter              g_CacheFactorCounter;       // the factors of the cached grid patches
+std::vector<GpuTessCachePatch>      g_CachePatches;
+
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+enum DEMO_TEXTURE
+{
+	DEMO_TEXTURE_DIFFUSE,
+	DEMO_TEXTURE_DISPLACEMENT,
+	DEMO_TEXTURE_NORMAL,
+	DEMO_TEXTURE_TERRAIN_DISPLACEMENT,
+	DEMO_TEXTURE_TERRAIN_NORMAL,
+	DEMO_TEXTURE_COUNT,
+};
+
+// Name in the texture container, source file without the container (NULL for normal
+// maps, which are derived from the displacement map Source) and the view created
+struct DemoTextureDesc
+{
+	const char* Name;
+	const char* FileName;
+	DEMO_TEXTURE Source;
+	ID3D11ShaderResourceView** ppTextureRV;
+};
+
+static const DemoTextureDesc s_DemoTextures[DEMO_TEXTURE_COUNT] =
+{
+	{ "diffuse", "Textures/Diffuse/rock_diffuse.jpg", DEMO_TEXTURE_DIFFUSE, &g_pDiffuseTextureRV },
+	{ "displacement", DISPLACEMENT_TEXTURE_FILE, DEMO_TEXTURE_DISPLACEMENT, &g_pDispTextureRV },
+	{ "normal", NULL, DEMO_TEXTURE_DISPLACEMENT, &g_pNormTextureRV },
+	{ "terrain_displacement", TERRAIN_DISPLACEMENT_TEXTURE_FILE, DEMO_TEXTURE_TERRAIN_DISPLACEMENT, &g_pTerrainDispTextureRV },
+	{ "terrain_normal", NULL, DEMO_TEXTURE_TERRAIN_DISPLACEMENT, &g_pTerrainNormTextureRV },
+};
 
 
 //--------------------------------------------------------------------------------------
 // Forward declarations
 //--------------------------------------------------------------------------------------
 HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow);
+bool ParseCommandLine();
 HRESULT InitDevice();
+HRESULT LoadShader(ShaderCache& shaderCache, DEMO_SHADER shader, std::vector<unsigned char>& bytecode);
+HRESULT CreateTextureFromContainer(const TextureContainerReader& container, const char* pName, ID3D11ShaderResourceView** ppTextureRV);
+bool LoadTextureMips(const char* pFileName, std::vector<Image>& mips);
+HRESULT CreateTextureFromImages(const std::vector<Image>& mips, ID3D11ShaderResourceView** ppTextureRV);
+bool GetDisplacementSourceHash(const TextureContainerReader* pContainer, const TextureContainerEntry* pEntry, const char* pFileName,
+	unsigned long long& sourceHash);
+bool GetDisplacementTexels(const TextureContainerReader* pContainer, const TextureContainerEntry* pEntry, const Image* pImage,
+	DisplacementTexels& texels);
+HRESULT BuildHeightPyramid(const DisplacementTexels& texels, const char* pFileName, unsigned long long sourceHash, HeightPyramid& pyramid);
+HRESULT BuildDisplacementMaps(const TextureContainerReader* pContainer, const Image* pDisplacement);
+HRESULT BuildTerrainPyramid(const TextureContainerReader* pContainer, const Image* pDisplacement);
+HRESULT LoadBakedTerrain(const char* pFileName, const HeightPyramid& pyramid, int chunksPerSide, BakedTerrain& terrain);
+HRESULT CreateTessellationShaders(const std::vector<unsigned char>* pShaderBytecode);
+HRESULT CreateBakedTerrainBuffers(BakedTerrainBuffers& baked);
+void InitDisplacementBounds();
+HRESULT CreateGridVertexBuffer(const TerrainGrid& grid, ID3D11Buffer** ppVertexBuffer);
+HRESULT CreatePatchInstanceBuffers();
+HRESULT CreateTessellationCacheBuffers();
+HRESULT CreateDensityTexture();
+HRESULT CreateConstantBuffer(UINT size, bool dynamic, TrackedConstantBuffer& buffer);
+void UpdateConstantBuffer(TrackedConstantBuffer& buffer, const void* pConstants);
 void CleanupDevice();
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 void Render();
+void PlanCachedGridPatches(const SceneFrame& scene);
+bool DrawCachedGridPatches(UINT firstIndex);
+void UpdateBenchmark();
+void ChangeTessBudget(int modeStep, int targetStep);
 
 
 //--------------------------------------------------------------------------------------
@@ -116,6 +319,9 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	UNREFERENCED_PARAMETER(hPrevInstance);
 	UNREFERENCED_PARAMETER(lpCmdLine);
 
+	if (!ParseCommandLine())
+		return 0;
+
 	if (FAILED(InitWindow(hInstance, nCmdShow)))
 		return 0;
 
@@ -141,11 +347,52 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	}
 
 	CleanupDevice();
+	delete g_pBenchmark;
 
 	return (int)msg.wParam;
 }
 
 
+//--------------------------------------------------------------------------------------
+// Reads -benchmark <script> and -report <file>. A benchmark script replaces the keys:
+// it drives the camera and the settings on a fixed time step and quits after writing
+// the report.
+//--------------------------------------------------------------------------------------
+bool ParseCommandLine()
+{
+	for (int i = 1; i < __argc; i++)
+	{
+		char arg[MAX_PATH], value[MAX_PATH] = "";
+		WideCharToMultiByte(CP_ACP, 0, __wargv[i], -1, arg, MAX_PATH, NULL, NULL);
+		if (i + 1 < __argc)
+			WideCharToMultiByte(CP_ACP, 0, __wargv[i + 1], -1, value, MAX_PATH, NULL, NULL);
+		if (strcmp(arg, "-benchmark") == 0 && value[0])
+		{
+			g_BenchmarkScriptFile = value;
+			i++;
+		}
+		else if (strcmp(arg, "-report") == 0 && value[0])
+		{
+			g_BenchmarkReportFile = value;
+			i++;
+		}
+	}
+	if (g_BenchmarkScriptFile.empty())
+		return true;
+
+	BenchmarkScript script;
+	std::string error;
+	if (!LoadBenchmarkScript(g_BenchmarkScriptFile.c_str(), script, error))
+	{
+		error = g_BenchmarkScriptFile + ": " + error;
+		MessageBoxA(NULL, error.c_str(), "Benchmark script error", MB_OK);
+		return false;
+	}
+	g_pBenchmark = new ScriptedBenchmark(script);
+	return true;
+}
+
+
 //--------------------------------------------------------------------------------------
 // Register class and create window
 //--------------------------------------------------------------------------------------
@@ -185,34 +432,28 @@ HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow)
 
 
 //--------------------------------------------------------------------------------------
-// Helper for compiling shaders with D3DX11
+// Helper for loading shader bytecode from the shader cache, compiling it on a miss
 //--------------------------------------------------------------------------------------
-HRESULT CompileShaderFromFile(WCHAR* szFileName, D3D10_SHADER_MACRO* pDefines, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
+HRESULT LoadShader(ShaderCache& shaderCache, DEMO_SHADER shader, std::vector<unsigned char>& bytecode)
 {
-	HRESULT hr = S_OK;
-
-	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+	ShaderCompileRequest request;
+	request.FileName = g_DemoShaders[shader].FileName;
+	request.EntryPoint = g_DemoShaders[shader].EntryPoint;
+	request.Profile = g_DemoShaders[shader].Profile;
 #if defined( DEBUG ) || defined( _DEBUG )
-	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-	// Setting this flag improves the shader debugging experience, but still allows 
-	// the shaders to be optimized and to run exactly the way they will run in 
-	// the release configuration of this program.
-	dwShaderFlags |= D3DCOMPILE_DEBUG;
+	// Embed debug information in the shaders. This improves the shader debugging
+	// experience, but still allows the shaders to be optimized and to run exactly the
+	// way they will run in the release configuration of this program.
+	request.Flags = D3DShaderCompiler::GetFlags(true);
+#else
+	request.Flags = D3DShaderCompiler::GetFlags(false);
 #endif
 
-	ID3DBlob* pErrorBlob;
-	hr = D3DX11CompileFromFile(szFileName, pDefines, NULL, szEntryPoint, szShaderModel,
-		dwShaderFlags, 0, NULL, ppBlobOut, &pErrorBlob, NULL);
-	if (FAILED(hr))
-	{
-		if (pErrorBlob != NULL)
-			OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-		if (pErrorBlob) pErrorBlob->Release();
-		return hr;
-	}
-	if (pErrorBlob) pErrorBlob->Release();
-
-	return S_OK;
+	std::string errors;
+	bool success = shaderCache.GetShader(request, bytecode, &errors);
+	if (!errors.empty())
+		OutputDebugStringA(errors.c_str());
+	return success ? S_OK : E_FAIL;
 }
 
 
@@ -273,6 +514,7 @@ HRESULT InitDevice()
 	}
 	if (FAILED(hr))
 		return hr;
+	g_StateBackend.SetContext(g_pImmediateContext);
 
 	// Create a render target view
 	ID3D11Texture2D* pBackBuffer = NULL;
@@ -331,193 +573,233 @@ HRESULT InitDevice()
 	vp.TopLeftX = 0;
 	vp.TopLeftY = 0;
 	g_pImmediateContext->RSSetViewports(1, &vp);
-
-	// Compile the vertex shader
-	ID3DBlob* pVSBlob = NULL;
-	hr = CompileShaderFromFile(L"Shaders/DisplacedAndShaded.hlsl", NULL, "VS", "vs_5_0", &pVSBlob);
-	if (FAILED(hr))
+	g_ViewportSize = XMFLOAT2(vp.Width, vp.Height);
+
+	// Shader bytecode, texture texels and the displacement maps do not need the device,
+	// so they are loaded concurrently and the device objects are created after the join.
+	// Unchanged shaders come from the shader cache, the textures from the precooked
+	// container when it has been built with AssetCooker and from the JPEG files otherwise.
+	D3DShaderCompiler shaderCompiler;
+	ShaderCache shaderCache(&shaderCompiler, SHADER_CACHE_DIRECTORY);
+	std::vector<unsigned char> shaderBytecode[DEMO_SHADER_COUNT];
+	TextureContainerReader textureContainer;
+	bool useContainer = false;
+	std::vector<Image> textureMips[DEMO_TEXTURE_COUNT];
+
+	TaskGraph startupTasks;
+	// The container is only mapped, opening it first lets the texture tasks start early.
+	// A container cooked before a texture was added is ignored.
+	TaskId containerTask = startupTasks.AddTask(TEXTURE_CONTAINER_FILE, [&]()
 	{
-		MessageBox(NULL,
-			L"The vertex shader cannot be compiled.", L"Error", MB_OK);
-		return hr;
+		useContainer = textureContainer.Open(TEXTURE_CONTAINER_FILE);
+		for (int texture = 0; useContainer && texture < DEMO_TEXTURE_COUNT; texture++)
+			useContainer = textureContainer.FindTexture(s_DemoTextures[texture].Name) != NULL;
+		return true;
+	});
+
+	TaskId shaderTasks[DEMO_SHADER_COUNT];
+	for (int shader = 0; shader < DEMO_SHADER_COUNT; shader++)
+	{
+		shaderTasks[shader] = startupTasks.AddTask(g_DemoShaders[shader].EntryPoint, [&, shader]()
+		{
+			return SUCCEEDED(LoadShader(shaderCache, (DEMO_SHADER)shader, shaderBytecode[shader]));
+		});
 	}
 
-	// Create the vertex shader
-	hr = g_pd3dDevice->CreateVertexShader(pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), NULL, &g_pVertexShader);
-	if (FAILED(hr))
+	TaskId textureTasks[DEMO_TEXTURE_COUNT];
+	for (int texture = 0; texture < DEMO_TEXTURE_COUNT; texture++)
 	{
-		pVSBlob->Release();
-		return hr;
+		if (!s_DemoTextures[texture].FileName)
+			continue;
+		textureTasks[texture] = startupTasks.AddTask(s_DemoTextures[texture].FileName, [&, texture]()
+		{
+			return useContainer || LoadTextureMips(s_DemoTextures[texture].FileName, textureMips[texture]);
+		}, { containerTask });
 	}
 
-	// Define the input layout
-	/*D3D11_INPUT_ELEMENT_DESC layout[] =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "BINORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 44, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	};*/
-	D3D11_INPUT_ELEMENT_DESC layout[] =
+	// Without the container the normal maps are derived from the decoded displacement maps,
+	// so the lighting follows the displaced surface
+	for (int texture = 0; texture < DEMO_TEXTURE_COUNT; texture++)
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	};
+		if (s_DemoTextures[texture].FileName)
+			continue;
+		DEMO_TEXTURE source = s_DemoTextures[texture].Source;
+		textureTasks[texture] = startupTasks.AddTask(s_DemoTextures[texture].Name, [&, texture, source]()
+		{
+			return useContainer || DeriveNormalMapMips(textureMips[source][0], NORMAL_MAP_SLOPE_SCALE, textureMips[texture]);
+		}, { containerTask, textureTasks[source] });
+	}
 
-	UINT numElements = ARRAYSIZE(layout);
+	TaskId displacementPyramidTask = startupTasks.AddTask(DISPLACEMENT_PYRAMID_FILE, [&]()
+	{
+		const Image* pDisplacement = useContainer ? NULL : &textureMips[DEMO_TEXTURE_DISPLACEMENT][0];
+		return SUCCEEDED(BuildDisplacementMaps(useContainer ? &textureContainer : NULL, pDisplacement));
+	}, { containerTask, textureTasks[DEMO_TEXTURE_DISPLACEMENT] });
 
-	// Create the input layout
-	hr = g_pd3dDevice->CreateInputLayout(layout, numElements, pVSBlob->GetBufferPointer(),
-		pVSBlob->GetBufferSize(), &g_pVertexLayout);
-	pVSBlob->Release();
-	if (FAILED(hr))
-		return hr;
+	TaskId terrainPyramidTask = startupTasks.AddTask(TERRAIN_DISPLACEMENT_TEXTURE_FILE, [&]()
+	{
+		const Image* pDisplacement = useContainer ? NULL : &textureMips[DEMO_TEXTURE_TERRAIN_DISPLACEMENT][0];
+		return SUCCEEDED(BuildTerrainPyramid(useContainer ? &textureContainer : NULL, pDisplacement));
+	}, { containerTask, textureTasks[DEMO_TEXTURE_TERRAIN_DISPLACEMENT] });
 
-	// Set the input layout
-	g_pImmediateContext->IASetInputLayout(g_pVertexLayout);
+	// The baked terrains are keyed by the texels the pyramids bound
+	startupTasks.AddTask(BAKED_TERRAIN_FILE, [&]()
+	{
+		return SUCCEEDED(LoadBakedTerrain(BAKED_TERRAIN_FILE, g_DisplacementPyramid, BAKED_TERRAIN_CHUNKS, g_BakedGrid.Terrain));
+	}, { displacementPyramidTask });
 
-	// Compile the hull shader
-	ID3DBlob* pHSBlob = NULL;
-	hr = CompileShaderFromFile(L"Shaders/DisplacedAndShaded.hlsl", NULL, "HS", "hs_5_0", &pHSBlob);
-	if (FAILED(hr))
+	startupTasks.AddTask(QUADTREE_BAKED_TERRAIN_FILE, [&]()
 	{
-		MessageBox(NULL,
-			L"The hull shader cannot be compiled.", L"Error", MB_OK);
-		return hr;
+		return SUCCEEDED(LoadBakedTerrain(QUADTREE_BAKED_TERRAIN_FILE, g_TerrainPyramid, QUADTREE_BAKED_TERRAIN_CHUNKS,
+			g_BakedQuadtree.Terrain));
+	}, { terrainPyramidTask });
+
+	bool startupSucceeded = startupTasks.Run();
+	ShaderCacheStats shaderStats = shaderCache.GetStats();
+	char message[256];
+	sprintf_s(message, "Startup tasks, %d shaders cached, %d compiled, textures from %s:\n", shaderStats.Hits, shaderStats.Misses,
+		useContainer ? TEXTURE_CONTAINER_FILE : "JPEG files");
+	OutputDebugStringA(message);
+	OutputDebugStringA(startupTasks.FormatReport().c_str());
+
+	if (!startupSucceeded)
+	{
+		for (int shader = 0; shader < DEMO_SHADER_COUNT; shader++)
+		{
+			if (startupTasks.GetStatus(shaderTasks[shader]) != TASK_STATUS_SUCCEEDED)
+			{
+				sprintf_s(message, "The shader %s cannot be compiled.", g_DemoShaders[shader].EntryPoint);
+				MessageBoxA(NULL, message, "Error", MB_OK);
+				return E_FAIL;
+			}
+		}
+		return E_FAIL;
 	}
 
-	// Create the hull shader
-	hr = g_pd3dDevice->CreateHullShader(pHSBlob->GetBufferPointer(), pHSBlob->GetBufferSize(), NULL, &g_pHullShader);
-	pHSBlob->Release();
-	if (FAILED(hr))
-		return hr;
-
-	// Compile the domain shader
-	ID3DBlob* pDSBlob = NULL;
-	hr = CompileShaderFromFile(L"Shaders/DisplacedAndShaded.hlsl", NULL, "DS", "ds_5_0", &pDSBlob);
-	if (FAILED(hr))
+	// Feature level 10_x has no hull and domain shaders and only draws the baked terrains
+	g_TessellationSupported = g_featureLevel >= D3D_FEATURE_LEVEL_11_0;
+	if (g_TessellationSupported)
 	{
-		MessageBox(NULL,
-			L"The domain shader cannot be compiled.", L"Error", MB_OK);
-		return hr;
+		hr = CreateTessellationShaders(shaderBytecode);
+		if (FAILED(hr))
+			return hr;
 	}
 
-	// Create the domain shader
-	hr = g_pd3dDevice->CreateDomainShader(pDSBlob->GetBufferPointer(), pDSBlob->GetBufferSize(), NULL, &g_pDomainShader);
-	pDSBlob->Release();
+	// Create the vertex shader and the input layout of the baked terrains
+	hr = g_pd3dDevice->CreateVertexShader(shaderBytecode[DEMO_SHADER_BAKED_VS].data(), shaderBytecode[DEMO_SHADER_BAKED_VS].size(), NULL, &g_pBakedVertexShader);
 	if (FAILED(hr))
 		return hr;
 
-	// Compile the pixel shader
-	ID3DBlob* pPSBlob = NULL;
-	hr = CompileShaderFromFile(L"Shaders/DisplacedAndShaded.hlsl", NULL, "PS", "ps_5_0", &pPSBlob);
-	if (FAILED(hr))
+	D3D11_INPUT_ELEMENT_DESC bakedLayout[] =
 	{
-		MessageBox(NULL,
-			L"The pixel shader cannot be compiled.", L"Error", MB_OK);
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	hr = g_pd3dDevice->CreateInputLayout(bakedLayout, ARRAYSIZE(bakedLayout), shaderBytecode[DEMO_SHADER_BAKED_VS].data(),
+		shaderBytecode[DEMO_SHADER_BAKED_VS].size(), &g_pBakedVertexLayout);
+	if (FAILED(hr))
 		return hr;
-	}
 
 	// Create the pixel shader
-	hr = g_pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), NULL, &g_pPixelShader);
-	pPSBlob->Release();
+	hr = g_pd3dDevice->CreatePixelShader(shaderBytecode[DEMO_SHADER_PS].data(), shaderBytecode[DEMO_SHADER_PS].size(), NULL, &g_pPixelShader);
 	if (FAILED(hr))
 		return hr;
 
-	// Compile the solid color pixel shader
-	ID3DBlob* pSolidPSBlob = NULL;
-	hr = CompileShaderFromFile(L"Shaders/DisplacedAndShaded.hlsl", NULL, "SolidPS", "ps_5_0", &pSolidPSBlob);
+	// Create the pixel shader
+	hr = g_pd3dDevice->CreatePixelShader(shaderBytecode[DEMO_SHADER_SOLID_PS].data(), shaderBytecode[DEMO_SHADER_SOLID_PS].size(), NULL, &g_pSolidPixelShader);
 	if (FAILED(hr))
-	{
-		MessageBox(NULL,
-			L"The solid pixel shader cannot be compiled.", L"Error", MB_OK);
 		return hr;
-	}
 
-	// Create the pixel shader
-	hr = g_pd3dDevice->CreatePixelShader(pSolidPSBlob->GetBufferPointer(), pSolidPSBlob->GetBufferSize(), NULL, &g_pSolidPixelShader);
-	pSolidPSBlob->Release();
+	// Create vertex buffer of the terrain grid
+	if (!g_TerrainGrid.Build(TERRAIN_PATCHES_X, TERRAIN_PATCHES_Z))
+		return E_INVALIDARG;
+	hr = CreateGridVertexBuffer(g_TerrainGrid, &g_pVertexBuffer);
 	if (FAILED(hr))
 		return hr;
 
-	// Create vertex buffer
-	XMFLOAT3 planeBinormal = XMFLOAT3(1.0f, 0.0f, 0.0f);
-	XMFLOAT3 planeTangent = XMFLOAT3(0.0f, 0.0f, 1.0f);
-	SimpleVertex vertices[] =
-	{
-		{ XMFLOAT3(-1.0f, 0.0f, -1.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f)/*, planeBinormal, planeTangent */},
-		{ XMFLOAT3( 1.0f, 0.0f, -1.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f)/*, planeBinormal, planeTangent */},
-		{ XMFLOAT3( 1.0f, 0.0f,  1.0f), XMFLOAT2(1.0f, 1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f)/*, planeBinormal, planeTangent */},
-		{ XMFLOAT3(-1.0f, 0.0f,  1.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f)/*, planeBinormal, planeTangent */}
-	};
-
-	D3D11_BUFFER_DESC bd;
-	ZeroMemory(&bd, sizeof(bd));
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SimpleVertex)* ARRAYSIZE(vertices);
-	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bd.CPUAccessFlags = 0;
-	D3D11_SUBRESOURCE_DATA InitData;
-	ZeroMemory(&InitData, sizeof(InitData));
-	InitData.pSysMem = vertices;
-	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pVertexBuffer);
+	// The quadtree terrain draws its patches as instances of one shared patch
+	if (!g_TerrainQuadtree.Build(QUADTREE_LEVELS))
+		return E_INVALIDARG;
+	g_TerrainQuadtree.SetHeightRanges(g_TerrainPyramid);
+	hr = CreatePatchInstanceBuffers();
 	if (FAILED(hr))
 		return hr;
 
-	// Set vertex buffer
-	UINT stride = sizeof(SimpleVertex);
+	// Set vertex buffer, Render switches it with SceneSettings::QuadtreeLod
+	UINT stride = sizeof(GridControlPoint);
 	UINT offset = 0;
 	g_pImmediateContext->IASetVertexBuffers(0, 1, &g_pVertexBuffer, &stride, &offset);
-
-	// Create index buffer
-	WORD indices[] =
-	{
-		3, 2, 0,
-		0, 2, 1
-	};
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(WORD)* ARRAYSIZE(indices);
+	g_pBoundVertexBuffer = g_pVertexBuffer;
+
+	// Create index buffer, the visible patches of every frame are appended to it as a ring
+	g_pVisiblePatches = new int[g_TerrainGrid.GetPatchCount()];
+	g_pQuadtreePatches = new QuadtreePatch[QUADTREE_MAX_PATCHES];
+	int frameIndices = g_TerrainGrid.GetPatchCount() * TERRAIN_INDICES_PER_PATCH;
+	g_IndexSize = GetControlPointIndexSize(g_TerrainGrid.GetVertexCount());
+	g_IndexFormat = (g_IndexSize == sizeof(WORD)) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = g_IndexSize * frameIndices * INDEX_RING_FRAMES;
 	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bd.CPUAccessFlags = 0;
-	InitData.pSysMem = indices;
-	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pIndexBuffer);
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pIndexBuffer);
 	if (FAILED(hr))
 		return hr;
+	g_IndexRing.Reset(bd.ByteWidth);
 
-	// Set index buffer
-	g_pImmediateContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	// Create the stream-out buffer of the retessellation cache, which needs the hull and
+	// domain shaders
+	if (g_TessellationSupported)
+	{
+		hr = CreateTessellationCacheBuffers();
+		if (FAILED(hr))
+			return hr;
+	}
 
-	// Set primitive topology
-	g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+	// Set index buffer, Render switches it with SceneSettings::BakedLod
+	g_pImmediateContext->IASetIndexBuffer(g_pIndexBuffer, g_IndexFormat, 0);
+	g_pBoundIndexBuffer = g_pIndexBuffer;
 
-	// Create the constant buffer
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(ConstantBuffer);
-	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	bd.CPUAccessFlags = 0;
-	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pConstantBuffer);
+	// Create the buffers of the baked terrains, a selection draws at most every chunk
+	hr = CreateBakedTerrainBuffers(g_BakedGrid);
+	if (FAILED(hr))
+		return hr;
+	hr = CreateBakedTerrainBuffers(g_BakedQuadtree);
 	if (FAILED(hr))
 		return hr;
+	g_pBakedDraws = new BakedDraw[BAKED_TERRAIN_MAX_CHUNKS * BAKED_TERRAIN_MAX_CHUNKS];
+
+	// Set primitive topology, Render switches it with SceneSettings::QuadPatches
+	g_pImmediateContext->IASetPrimitiveTopology(g_PatchTopology);
 
-	// Load the Diffuse texture
-	hr = D3DX11CreateShaderResourceViewFromFile(g_pd3dDevice,
-		L"Textures/Diffuse/rock_diffuse.jpg", NULL, NULL, &g_pDiffuseTextureRV, NULL);
+	// Create the per-frame and per-draw constant buffers
+	hr = CreateConstantBuffer(sizeof(FrameConstants), false, g_FrameConstants);
 	if (FAILED(hr))
 		return hr;
 
-	// Load the Displacement texture
-	hr = D3DX11CreateShaderResourceViewFromFile(g_pd3dDevice,
-		L"Textures/Displacement/rock_displacement.jpg", NULL, NULL, &g_pDispTextureRV, NULL);
+	hr = CreateConstantBuffer(sizeof(DrawConstants), true, g_DrawConstants);
 	if (FAILED(hr))
 		return hr;
 
-	// Load the Normal texture
-	hr = D3DX11CreateShaderResourceViewFromFile(g_pd3dDevice,
-		L"Textures/Normal/rock_normal.jpg", NULL, NULL, &g_pNormTextureRV, NULL);
+	// Create the textures from the container mapping or the decoded mips
+	for (int texture = 0; texture < DEMO_TEXTURE_COUNT; texture++)
+	{
+		if (useContainer)
+			hr = CreateTextureFromContainer(textureContainer, s_DemoTextures[texture].Name, s_DemoTextures[texture].ppTextureRV);
+		else
+			hr = CreateTextureFromImages(textureMips[texture], s_DemoTextures[texture].ppTextureRV);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	InitDisplacementBounds();
+
+	hr = CreateDensityTexture();
 	if (FAILED(hr))
 		return hr;
+	g_TerrainPatchJobs.SetDensityMap(&g_DensityMap);
+	g_CacheFactorCounter.SetDensityMap(&g_DensityMap);
+	g_Jobs.Init();
 
 	// Create the point sampler state
 	D3D11_SAMPLER_DESC sampDesc;
@@ -546,171 +828,996 @@ HRESULT InitDevice()
 	if (FAILED(hr))
 		return hr;
 
-	// Initialize the world matrices
-	g_World = XMMatrixIdentity();
-
-	// Initialize the view matrix
-	g_Camera.Eye = XMVectorSet(0.0f, 4.0f, -10.0f, 0.0f);
-	g_Camera.At = XMVectorSet(1.5f, 0.0f, 0.0f, 0.0f);
-	g_Camera.Up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	g_View = XMMatrixLookAtLH(g_Camera.Eye, g_Camera.At, g_Camera.Up);
-
-	// Initialize the projection matrix
-	g_Projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, width / (FLOAT)height, 0.01f, 100.0f);
+	// The GPU timings are optional, without the queries the frame records just miss them
+	if (FAILED(g_GpuProfiler.Create(g_pd3dDevice)))
+		OutputDebugStringA("GPU timestamp and pipeline statistics queries are not available\n");
+
+	// Initialize the projection matrix, the camera starts at its default position
+	BuildPerspectiveFovLH(XM_PIDIV4, width / (FLOAT)height, 0.01f, 100.0f, g_Projection);
+
+	// Create the static constants now that the projection is known
+	StaticConstants staticConstants;
+	BuildStaticConstants(g_Projection, g_ViewportSize.x, g_ViewportSize.y, staticConstants);
+
+	D3D11_BUFFER_DESC staticDesc;
+	ZeroMemory(&staticDesc, sizeof(staticDesc));
+	staticDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	staticDesc.ByteWidth = sizeof(StaticConstants);
+	staticDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	D3D11_SUBRESOURCE_DATA staticData;
+	ZeroMemory(&staticData, sizeof(staticData));
+	staticData.pSysMem = &staticConstants;
+	hr = g_pd3dDevice->CreateBuffer(&staticDesc, &staticData, &g_pStaticConstants);
+	if (FAILED(hr))
+		return hr;
 
 	return S_OK;
 }
 
 
 //--------------------------------------------------------------------------------------
-// Clean up the objects we've created
+// Create the shaders and the input layout of the tessellated terrains, which need
+// feature level 11_0
 //--------------------------------------------------------------------------------------
-void CleanupDevice()
+HRESULT CreateTessellationShaders(const std::vector<unsigned char>* pShaderBytecode)
 {
-	if (g_pImmediateContext) g_pImmediateContext->ClearState();
+	// Create the vertex shader
+	HRESULT hr = g_pd3dDevice->CreateVertexShader(pShaderBytecode[DEMO_SHADER_VS].data(), pShaderBytecode[DEMO_SHADER_VS].size(), NULL, &g_pVertexShader);
+	if (FAILED(hr))
+		return hr;
 
-	if (g_pConstantBuffer) g_pConstantBuffer->Release();
-	if (g_pVertexBuffer) g_pVertexBuffer->Release();
-	if (g_pIndexBuffer) g_pIndexBuffer->Release();
-	if (g_pVertexLayout) g_pVertexLayout->Release();
-	if (g_pVertexShader) g_pVertexShader->Release();
-	if (g_pHullShader) g_pHullShader->Release();
-	if (g_pDomainShader) g_pDomainShader->Release();
-	if (g_pPixelShader) g_pPixelShader->Release();
-	if (g_pSolidPixelShader) g_pSolidPixelShader->Release();
-	if (g_pDepthStencil) g_pDepthStencil->Release();
-	if (g_pDepthStencilView) g_pDepthStencilView->Release();
-	if (g_pRenderTargetView) g_pRenderTargetView->Release();
-	if (g_pSwapChain) g_pSwapChain->Release();
-	if (g_pImmediateContext) g_pImmediateContext->Release();
-	if (g_pd3dDevice) g_pd3dDevice->Release();
-	if (g_pDiffuseTextureRV) g_pDiffuseTextureRV->Release();
-	if (g_pDispTextureRV) g_pDispTextureRV->Release();
-	if (g_pNormTextureRV) g_pNormTextureRV->Release();
-	if (g_pSamplerPoint) g_pSamplerPoint->Release();
-	if (g_pSamplerLinear) g_pSamplerLinear->Release();
-	if (g_pWireFrameRasterizerState) g_pWireFrameRasterizerState->Release();
-	if (g_pDefaultRasterizerState) g_pDefaultRasterizerState->Release();
-}
+	// Define the input layout of GridControlPoint, VS derives the position and the
+	// texture coordinate from SV_VertexID
+	D3D11_INPUT_ELEMENT_DESC layout[] =
+	{
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
 
+	UINT numElements = ARRAYSIZE(layout);
 
-//--------------------------------------------------------------------------------------
-// Called every time the application receives a message
-//--------------------------------------------------------------------------------------
-LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
-{
-	PAINTSTRUCT ps;
-	HDC hdc;
+	// Create the input layout
+	hr = g_pd3dDevice->CreateInputLayout(layout, numElements, pShaderBytecode[DEMO_SHADER_VS].data(), pShaderBytecode[DEMO_SHADER_VS].size(),
+		&g_pVertexLayout);
+	if (FAILED(hr))
+		return hr;
 
-	switch (message)
-	{
-	case WM_KEYDOWN:
-		if (wParam == 'W')
-			g_Camera.isMovingForward = true;
-		if (wParam == 'S')
-			g_Camera.isMovingBackward = true;
-		if (wParam == 'A')
-			g_Camera.isMovingLeft = true;
-		if (wParam == 'D')
-			g_Camera.isMovingRight = true;
-		if (wParam == VK_SPACE)
-			g_Camera.isMovingUp = true;
-		if (wParam == VK_CONTROL)
-			g_Camera.isMovingDown = true;
-		if (wParam == 'R')
-		{
-			g_pImmediateContext->RSGetState(&g_pDefaultRasterizerState);
-			if (!g_pDefaultRasterizerState)
-			{
-				g_IsWireFrame = true;
-				g_pImmediateContext->RSSetState(g_pWireFrameRasterizerState);
-			}
-			else
-			{
-				g_IsWireFrame = false;
-				g_pImmediateContext->RSSetState(NULL);
-			}
-		}
-		if (wParam == VK_UP && g_TessellationFactor <= 64.0f)
-			g_TessellationFactor += 0.5f;
-		if (wParam == VK_DOWN && g_TessellationFactor >= 1.0f)
-			g_TessellationFactor -= 0.5f;
-		if (wParam == VK_ESCAPE)
-			PostQuitMessage(0);
-		break;
-	case WM_KEYUP:
-		if (wParam == 'W')
-			g_Camera.isMovingForward = false;
-		if (wParam == 'S')
-			g_Camera.isMovingBackward = false;
-		if (wParam == 'A')
-			g_Camera.isMovingLeft = false;
-		if (wParam == 'D')
-			g_Camera.isMovingRight = false;
-		if (wParam == VK_SPACE)
-			g_Camera.isMovingUp = false;
-		if (wParam == VK_CONTROL)
-			g_Camera.isMovingDown = false;
-		break;
-	case WM_PAINT:
-		hdc = BeginPaint(hWnd, &ps);
-		EndPaint(hWnd, &ps);
-		break;
+	// Set the input layout, Render switches it with SceneSettings::BakedLod
+	g_pImmediateContext->IASetInputLayout(g_pVertexLayout);
+	g_pBoundVertexLayout = g_pVertexLayout;
 
-	case WM_DESTROY:
-		PostQuitMessage(0);
-		break;
+	// Create the hull shader
+	hr = g_pd3dDevice->CreateHullShader(pShaderBytecode[DEMO_SHADER_HS].data(), pShaderBytecode[DEMO_SHADER_HS].size(), NULL, &g_pHullShader);
+	if (FAILED(hr))
+		return hr;
 
-	default:
-		return DefWindowProc(hWnd, message, wParam, lParam);
-	}
+	// Create the domain shader
+	hr = g_pd3dDevice->CreateDomainShader(pShaderBytecode[DEMO_SHADER_DS].data(), pShaderBytecode[DEMO_SHADER_DS].size(), NULL, &g_pDomainShader);
+	if (FAILED(hr))
+		return hr;
 
-	return 0;
-}
+	// Create the hull and domain shaders of the quad patch path
+	hr = g_pd3dDevice->CreateHullShader(pShaderBytecode[DEMO_SHADER_QUAD_HS].data(), pShaderBytecode[DEMO_SHADER_QUAD_HS].size(), NULL, &g_pQuadHullShader);
+	if (FAILED(hr))
+		return hr;
 
+	hr = g_pd3dDevice->CreateDomainShader(pShaderBytecode[DEMO_SHADER_QUAD_DS].data(), pShaderBytecode[DEMO_SHADER_QUAD_DS].size(), NULL, &g_pQuadDomainShader);
+	if (FAILED(hr))
+		return hr;
 
-//--------------------------------------------------------------------------------------
-// Render a frame
-//--------------------------------------------------------------------------------------
-void Render()
+	// Create the shaders of the quadtree terrain and the input layout of its shared patch
+	// and instances, see PatchInstance
+	hr = g_pd3dDevice->CreateVertexShader(pShaderBytecode[DEMO_SHADER_QUADTREE_VS].data(), pShaderBytecode[DEMO_SHADER_QUADTREE_VS].size(), NULL, &g_pQuadtreeVertexShader);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_INPUT_ELEMENT_DESC quadtreeLayout[] =
+	{
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "PATCH", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "EDGEFACTORS", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+	hr = g_pd3dDevice->CreateInputLayout(quadtreeLayout, ARRAYSIZE(quadtreeLayout), pShaderBytecode[DEMO_SHADER_QUADTREE_VS].data(),
+		pShaderBytecode[DEMO_SHADER_QUADTREE_VS].size(), &g_pQuadtreeVertexLayout);
+	if (FAILED(hr))
+		return hr;
+
+	hr = g_pd3dDevice->CreateHullShader(pShaderBytecode[DEMO_SHADER_QUADTREE_HS].data(), pShaderBytecode[DEMO_SHADER_QUADTREE_HS].size(), NULL, &g_pQuadtreeHullShader);
+	if (FAILED(hr))
+		return hr;
+
+	hr = g_pd3dDevice->CreateDomainShader(pShaderBytecode[DEMO_SHADER_QUADTREE_DS].data(), pShaderBytecode[DEMO_SHADER_QUADTREE_DS].size(), NULL, &g_pQuadtreeDomainShader);
+	if (FAILED(hr))
+		return hr;
+
+	// Create the shaders of the retessellation cache and the input layout of the grid
+	// with the factors of every patch as an instance, see GpuTessellationCache.h
+	hr = g_pd3dDevice->CreateVertexShader(pShaderBytecode[DEMO_SHADER_CACHE_VS].data(), pShaderBytecode[DEMO_SHADER_CACHE_VS].size(), NULL, &g_pCacheVertexShader);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_INPUT_ELEMENT_DESC cacheLayout[] =
+	{
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "EDGEFACTORS", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSIDEFACTORS", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+	hr = g_pd3dDevice->CreateInputLayout(cacheLayout, ARRAYSIZE(cacheLayout), pShaderBytecode[DEMO_SHADER_CACHE_VS].data(),
+		pShaderBytecode[DEMO_SHADER_CACHE_VS].size(), &g_pCacheVertexLayout);
+	if (FAILED(hr))
+		return hr;
+
+	hr = g_pd3dDevice->CreateHullShader(pShaderBytecode[DEMO_SHADER_CACHE_HS].data(), pShaderBytecode[DEMO_SHADER_CACHE_HS].size(), NULL, &g_pCacheHullShader);
+	if (FAILED(hr))
+		return hr;
+
+	hr = g_pd3dDevice->CreateHullShader(pShaderBytecode[DEMO_SHADER_CACHE_QUAD_HS].data(), pShaderBytecode[DEMO_SHADER_CACHE_QUAD_HS].size(), NULL, &g_pCacheQuadHullShader);
+	if (FAILED(hr))
+		return hr;
+
+	hr = g_pd3dDevice->CreateDomainShader(pShaderBytecode[DEMO_SHADER_CACHE_DS].data(), pShaderBytecode[DEMO_SHADER_CACHE_DS].size(), NULL, &g_pCacheDomainShader);
+	if (FAILED(hr))
+		return hr;
+
+	hr = g_pd3dDevice->CreateDomainShader(pShaderBytecode[DEMO_SHADER_CACHE_QUAD_DS].data(), pShaderBytecode[DEMO_SHADER_CACHE_QUAD_DS].size(), NULL, &g_pCacheQuadDomainShader);
+	if (FAILED(hr))
+		return hr;
+
+	// The geometry shader streams GpuTessCacheVertex out without rasterizing it
+	D3D11_SO_DECLARATION_ENTRY streamOutDecl[] =
+	{
+		{ 0, "POSITION", 0, 0, 3, 0 },
+		{ 0, "TEXCOORD", 0, 0, 2, 0 },
+	};
+	UINT streamOutStride = sizeof(GpuTessCacheVertex);
+	hr = g_pd3dDevice->CreateGeometryShaderWithStreamOutput(pShaderBytecode[DEMO_SHADER_CACHE_GS].data(), pShaderBytecode[DEMO_SHADER_CACHE_GS].size(),
+		streamOutDecl, ARRAYSIZE(streamOutDecl), &streamOutStride, 1, D3D11_SO_NO_RASTERIZED_STREAM, NULL, &g_pCacheGeometryShader);
+	if (FAILED(hr))
+		return hr;
+
+	// Replay of the stream-out buffer as a plain vertex buffer
+	hr = g_pd3dDevice->CreateVertexShader(pShaderBytecode[DEMO_SHADER_CACHED_VS].data(), pShaderBytecode[DEMO_SHADER_CACHED_VS].size(), NULL, &g_pCachedVertexShader);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_INPUT_ELEMENT_DESC cachedLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	hr = g_pd3dDevice->CreateInputLayout(cachedLayout, ARRAYSIZE(cachedLayout), pShaderBytecode[DEMO_SHADER_CACHED_VS].data(),
+		pShaderBytecode[DEMO_SHADER_CACHED_VS].size(), &g_pCachedVertexLayout);
+	if (FAILED(hr))
+		return hr;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the stream-out buffer of the retessellation cache and the instance buffer of
+// the factors of the patches it fills or draws around it, at most two tri patches per
+// grid patch
+//--------------------------------------------------------------------------------------
+HRESULT CreateTessellationCacheBuffers()
+{
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = TESS_CACHE_BUFFER_BYTES;
+	bd.BindFlags = D3D11_BIND_STREAM_OUTPUT | D3D11_BIND_VERTEX_BUFFER;
+	HRESULT hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pStreamOutBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = sizeof(TessCacheFactors) * g_TerrainGrid.GetPatchCount() * 2;
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pCacheFactorBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	TessellationCacheDesc desc;
+	desc.BudgetBytes = TESS_CACHE_BUFFER_BYTES;
+	g_GpuTessCache.Init(desc);
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create a constant buffer updated through UpdateConstantBuffer. Dynamic buffers are
+// mapped with discard, the others updated with UpdateSubresource.
+//--------------------------------------------------------------------------------------
+HRESULT CreateConstantBuffer(UINT size, bool dynamic, TrackedConstantBuffer& buffer)
+{
+	D3D11_BUFFER_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Usage = dynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	desc.ByteWidth = size;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+	buffer.Dynamic = dynamic;
+	buffer.Uploaded.clear();
+	return g_pd3dDevice->CreateBuffer(&desc, NULL, &buffer.pBuffer);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Upload the constants unless they equal the last upload. The structures are zeroed
+// before they are filled, so their padding compares equal too.
+//--------------------------------------------------------------------------------------
+void UpdateConstantBuffer(TrackedConstantBuffer& buffer, const void* pConstants)
+{
+	D3D11_BUFFER_DESC desc;
+	buffer.pBuffer->GetDesc(&desc);
+	if (buffer.Uploaded.size() == desc.ByteWidth && memcmp(buffer.Uploaded.data(), pConstants, desc.ByteWidth) == 0)
+		return;
+
+	if (buffer.Dynamic)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (FAILED(g_pImmediateContext->Map(buffer.pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			return;
+		memcpy(mapped.pData, pConstants, desc.ByteWidth);
+		g_pImmediateContext->Unmap(buffer.pBuffer, 0);
+	}
+	else
+	{
+		g_pImmediateContext->UpdateSubresource(buffer.pBuffer, 0, NULL, pConstants, 0, 0);
+	}
+	const unsigned char* pBytes = (const unsigned char*)pConstants;
+	buffer.Uploaded.assign(pBytes, pBytes + desc.ByteWidth);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create an immutable texture from the memory-mapped mips of the texture container
+//--------------------------------------------------------------------------------------
+HRESULT CreateTextureFromContainer(const TextureContainerReader& container, const char* pName, ID3D11ShaderResourceView** ppTextureRV)
+{
+	const TextureContainerEntry* pEntry = container.FindTexture(pName);
+	if (!pEntry)
+		return E_FAIL;
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = pEntry->Width;
+	desc.Height = pEntry->Height;
+	desc.MipLevels = pEntry->MipCount;
+	desc.ArraySize = 1;
+	switch (pEntry->Format)
+	{
+	case TEXTURE_FORMAT_R8_UNORM: desc.Format = DXGI_FORMAT_R8_UNORM; break;
+	case TEXTURE_FORMAT_BC1_UNORM: desc.Format = DXGI_FORMAT_BC1_UNORM; break;
+	case TEXTURE_FORMAT_BC4_UNORM: desc.Format = DXGI_FORMAT_BC4_UNORM; break;
+	case TEXTURE_FORMAT_BC5_UNORM: desc.Format = DXGI_FORMAT_BC5_UNORM; break;
+	case TEXTURE_FORMAT_R8G8_UNORM: desc.Format = DXGI_FORMAT_R8G8_UNORM; break;
+	default: desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; break;
+	}
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA initData[TEXTURE_CONTAINER_MAX_MIPS];
+	for (UINT mip = 0; mip < pEntry->MipCount; mip++)
+	{
+		initData[mip].pSysMem = container.GetMipData(*pEntry, mip);
+		initData[mip].SysMemPitch = pEntry->Mips[mip].RowPitch;
+		initData[mip].SysMemSlicePitch = pEntry->Mips[mip].Size;
+	}
+
+	ID3D11Texture2D* pTexture = NULL;
+	HRESULT hr = g_pd3dDevice->CreateTexture2D(&desc, initData, &pTexture);
+	if (FAILED(hr))
+		return hr;
+	hr = g_pd3dDevice->CreateShaderResourceView(pTexture, NULL, ppTextureRV);
+	pTexture->Release();
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Decode an image file and build its mip chain down to 1x1, runs on a startup task
+//--------------------------------------------------------------------------------------
+bool LoadTextureMips(const char* pFileName, std::vector<Image>& mips)
+{
+	mips.resize(1);
+	if (!LoadImageFile(pFileName, mips[0]))
+		return false;
+	while (mips.back().Width > 1 || mips.back().Height > 1)
+	{
+		mips.push_back(Image());
+		DownsampleImage(mips[mips.size() - 2], mips.back());
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create an immutable texture from decoded mips
+//--------------------------------------------------------------------------------------
+HRESULT CreateTextureFromImages(const std::vector<Image>& mips, ID3D11ShaderResourceView** ppTextureRV)
+{
+	if (mips.empty() || mips.size() > TEXTURE_CONTAINER_MAX_MIPS)
+		return E_INVALIDARG;
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = mips[0].Width;
+	desc.Height = mips[0].Height;
+	desc.MipLevels = (UINT)mips.size();
+	desc.ArraySize = 1;
+	switch (mips[0].Channels)
+	{
+	case 1: desc.Format = DXGI_FORMAT_R8_UNORM; break;
+	case 2: desc.Format = DXGI_FORMAT_R8G8_UNORM; break;
+	default: desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; break;
+	}
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA initData[TEXTURE_CONTAINER_MAX_MIPS];
+	for (size_t mip = 0; mip < mips.size(); mip++)
+	{
+		initData[mip].pSysMem = mips[mip].Texels.data();
+		initData[mip].SysMemPitch = mips[mip].Width * mips[mip].Channels;
+		initData[mip].SysMemSlicePitch = (UINT)mips[mip].Texels.size();
+	}
+
+	ID3D11Texture2D* pTexture = NULL;
+	HRESULT hr = g_pd3dDevice->CreateTexture2D(&desc, initData, &pTexture);
+	if (FAILED(hr))
+		return hr;
+	hr = g_pd3dDevice->CreateShaderResourceView(pTexture, NULL, ppTextureRV);
+	pTexture->Release();
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Key of the sidecar file of a displacement map: the hash of the container entry pEntry
+// or, without the container, of the content of the image file
+//--------------------------------------------------------------------------------------
+bool GetDisplacementSourceHash(const TextureContainerReader* pContainer, const TextureContainerEntry* pEntry, const char* pFileName,
+	unsigned long long& sourceHash)
+{
+	if (pEntry)
+	{
+		sourceHash = pContainer->HashTexture(*pEntry);
+		return true;
+	}
+	return HashFile(pFileName, sourceHash);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Level 0 of a displacement map from the container entry pEntry or the decoded image
+// pImage. BC4 blocks are decoded, so the pyramid bounds what the domain shader samples.
+//--------------------------------------------------------------------------------------
+bool GetDisplacementTexels(const TextureContainerReader* pContainer, const TextureContainerEntry* pEntry, const Image* pImage,
+	DisplacementTexels& texels)
+{
+	if (pEntry && pEntry->Format == TEXTURE_FORMAT_BC4_UNORM)
+	{
+		DecompressImage((const unsigned char*)pContainer->GetMipData(*pEntry, 0), BC_FORMAT_BC4, pEntry->Width, pEntry->Height,
+			texels.Decoded);
+		texels.pTexels = texels.Decoded.Texels.data();
+		texels.Width = texels.Decoded.Width;
+		texels.Height = texels.Decoded.Height;
+		texels.RowPitch = texels.Decoded.Width;
+		texels.TexelStride = 1;
+	}
+	else if (pEntry)
+	{
+		texels.pTexels = (const unsigned char*)pContainer->GetMipData(*pEntry, 0);
+		texels.Width = pEntry->Width;
+		texels.Height = pEntry->Height;
+		texels.RowPitch = pEntry->Mips[0].RowPitch;
+		texels.TexelStride = (pEntry->Format == TEXTURE_FORMAT_R8_UNORM) ? 1 : 4;
+	}
+	else if (pImage)
+	{
+		// The domain shader displaces by the red channel
+		texels.pTexels = pImage->Texels.data();
+		texels.Width = pImage->Width;
+		texels.Height = pImage->Height;
+		texels.RowPitch = pImage->Width * pImage->Channels;
+		texels.TexelStride = pImage->Channels;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Build the min/max pyramid of a displacement map and save it to its sidecar file
+//--------------------------------------------------------------------------------------
+HRESULT BuildHeightPyramid(const DisplacementTexels& texels, const char* pFileName, unsigned long long sourceHash, HeightPyramid& pyramid)
+{
+	if (!pyramid.Build(texels.pTexels, texels.Width, texels.Height, texels.RowPitch, texels.TexelStride))
+		return E_FAIL;
+
+	// Without the cache the next startup only rebuilds it
+	pyramid.Save(pFileName, sourceHash);
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Build the tessellation density map of the displacement map and load its min/max
+// pyramid from the sidecar file, or build it if the sidecar is missing or was built from
+// other texels. Runs on a startup task, pDisplacement is the decoded JPEG without the
+// texture container.
+//--------------------------------------------------------------------------------------
+HRESULT BuildDisplacementMaps(const TextureContainerReader* pContainer, const Image* pDisplacement)
+{
+	const TextureContainerEntry* pEntry = pContainer ? pContainer->FindTexture("displacement") : NULL;
+	unsigned long long sourceHash = 0;
+	DisplacementTexels texels;
+	if (!GetDisplacementSourceHash(pContainer, pEntry, DISPLACEMENT_TEXTURE_FILE, sourceHash) ||
+		!GetDisplacementTexels(pContainer, pEntry, pDisplacement, texels))
+		return E_FAIL;
+
+	TessDensityParams densityParams;
+	if (!g_DensityMap.Build(texels.pTexels, texels.Width, texels.Height, texels.RowPitch, texels.TexelStride, densityParams))
+		return E_FAIL;
+
+	if (g_DisplacementPyramid.Load(DISPLACEMENT_PYRAMID_FILE, sourceHash))
+		return S_OK;
+	return BuildHeightPyramid(texels, DISPLACEMENT_PYRAMID_FILE, sourceHash, g_DisplacementPyramid);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Load the min/max pyramid of the quadtree terrain's heightmap from its sidecar file, or
+// build it from the container entry or the decoded image pDisplacement if the sidecar is
+// missing or stale. Runs on a startup task.
+//--------------------------------------------------------------------------------------
+HRESULT BuildTerrainPyramid(const TextureContainerReader* pContainer, const Image* pDisplacement)
+{
+	const TextureContainerEntry* pEntry = pContainer ? pContainer->FindTexture("terrain_displacement") : NULL;
+	unsigned long long sourceHash = 0;
+	if (!GetDisplacementSourceHash(pContainer, pEntry, TERRAIN_DISPLACEMENT_TEXTURE_FILE, sourceHash))
+		return E_FAIL;
+	if (g_TerrainPyramid.Load(TERRAIN_PYRAMID_FILE, sourceHash))
+		return S_OK;
+
+	DisplacementTexels texels;
+	if (!GetDisplacementTexels(pContainer, pEntry, pDisplacement, texels))
+		return E_FAIL;
+	return BuildHeightPyramid(texels, TERRAIN_PYRAMID_FILE, sourceHash, g_TerrainPyramid);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Open the baked terrain of a heightmap, runs on a startup task after its pyramid is
+// built. Without tessellation a missing or outdated file is baked from the pyramid and
+// saved for the next startup; with it the baked terrain is optional.
+//--------------------------------------------------------------------------------------
+HRESULT LoadBakedTerrain(const char* pFileName, const HeightPyramid& pyramid, int chunksPerSide, BakedTerrain& terrain)
+{
+	unsigned long long sourceHash = GetTerrainBakeHash(pyramid);
+	if (terrain.Open(pFileName) && terrain.GetHeader().SourceHash == sourceHash)
+		return S_OK;
+	terrain.Close();
+	if (g_featureLevel >= D3D_FEATURE_LEVEL_11_0)
+		return S_OK;
+
+	TerrainBakeDesc desc;
+	desc.ChunksPerSide = chunksPerSide;
+	TerrainBakeStats stats;
+	if (!BakeTerrain(pFileName, pyramid, desc, &stats) || !terrain.Open(pFileName))
+		return E_FAIL;
+
+	char message[256];
+	sprintf_s(message, "Baked %s in %.1f s, %.1f MB\n", pFileName, stats.Seconds, stats.FileSize / (1024.0 * 1024.0));
+	OutputDebugStringA(message);
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the immutable vertex and index buffers of a baked terrain with the blocks of
+// all its LODs after each other. Draws add the start of their LOD block to the first
+// index and the base vertex of their chunk.
+//--------------------------------------------------------------------------------------
+HRESULT CreateBakedTerrainBuffers(BakedTerrainBuffers& baked)
+{
+	const BakedTerrain& terrain = baked.Terrain;
+	if (!terrain.IsOpen())
+		return S_OK;
+
+	std::vector<BakedVertex> vertices;
+	std::vector<unsigned short> indices;
+	for (int lod = 0; lod < terrain.GetLodCount(); lod++)
+	{
+		const BakedLodBlock& block = terrain.GetHeader().Lods[lod];
+		baked.FirstVertex[lod] = (UINT)vertices.size();
+		baked.FirstIndex[lod] = (UINT)indices.size();
+		vertices.insert(vertices.end(), terrain.GetLodVertices(lod), terrain.GetLodVertices(lod) + block.VertexCount);
+		indices.insert(indices.end(), terrain.GetLodIndices(lod), terrain.GetLodIndices(lod) + block.IndexCount);
+	}
+	if (vertices.empty() || indices.empty())
+		return E_INVALIDARG;
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(BakedVertex) * vertices.size());
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	initData.pSysMem = vertices.data();
+	HRESULT hr = g_pd3dDevice->CreateBuffer(&bd, &initData, &baked.pVertexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = (UINT)(sizeof(unsigned short) * indices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	initData.pSysMem = indices.data();
+	return g_pd3dDevice->CreateBuffer(&bd, &initData, &baked.pIndexBuffer);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bound the displacement of every terrain patch with the min/max pyramid of the
+// displacement map
+//--------------------------------------------------------------------------------------
+void InitDisplacementBounds()
+{
+	int patchCount = g_TerrainGrid.GetPatchCount();
+	float* pMinHeights = new float[patchCount];
+	float* pMaxHeights = new float[patchCount];
+	for (int patch = 0; patch < patchCount; patch++)
+	{
+		int x = patch % g_TerrainGrid.GetPatchesX();
+		int z = patch / g_TerrainGrid.GetPatchesX();
+		float u0 = (float)x / g_TerrainGrid.GetPatchesX(), u1 = (float)(x + 1) / g_TerrainGrid.GetPatchesX();
+		float v0 = (float)z / g_TerrainGrid.GetPatchesZ(), v1 = (float)(z + 1) / g_TerrainGrid.GetPatchesZ();
+		g_DisplacementPyramid.QueryUV(u0, v0, u1, v1, pMinHeights[patch], pMaxHeights[patch]);
+	}
+	g_TerrainGrid.SetPatchHeightRanges(pMinHeights, pMaxHeights);
+	delete[] pMinHeights;
+	delete[] pMaxHeights;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the vertex buffer of a terrain grid, the normals of its compact control points
+//--------------------------------------------------------------------------------------
+HRESULT CreateGridVertexBuffer(const TerrainGrid& grid, ID3D11Buffer** ppVertexBuffer)
+{
+	int vertexCount = grid.GetVertexCount();
+	static const float s_Up[3] = { 0.0f, 1.0f, 0.0f };
+	GridControlPoint* vertices = new GridControlPoint[vertexCount];
+	for (int i = 0; i < vertexCount; i++)
+		EncodeOctahedralNormal(s_Up, vertices[i].Normal);
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(GridControlPoint)* vertexCount;
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = 0;
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = vertices;
+	HRESULT hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, ppVertexBuffer);
+	delete[] vertices;
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the shared patch of the quadtree terrain, its 4 control points and indices, and
+// the instance buffer mapped with discard every frame the quadtree terrain is drawn
+//--------------------------------------------------------------------------------------
+HRESULT CreatePatchInstanceBuffers()
+{
+	static const float s_Up[3] = { 0.0f, 1.0f, 0.0f };
+	GridControlPoint controlPoints[PATCH_INSTANCE_CONTROL_POINTS];
+	WORD indices[PATCH_INSTANCE_CONTROL_POINTS];
+	for (int i = 0; i < PATCH_INSTANCE_CONTROL_POINTS; i++)
+	{
+		EncodeOctahedralNormal(s_Up, controlPoints[i].Normal);
+		indices[i] = (WORD)i;
+	}
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = sizeof(controlPoints);
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	initData.pSysMem = controlPoints;
+	HRESULT hr = g_pd3dDevice->CreateBuffer(&bd, &initData, &g_pPatchVertexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = sizeof(indices);
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	initData.pSysMem = indices;
+	hr = g_pd3dDevice->CreateBuffer(&bd, &initData, &g_pPatchIndexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = sizeof(PatchInstance) * QUADTREE_MAX_PATCHES;
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	hr = g_pd3dDevice->CreateBuffer(&bd, NULL, &g_pPatchInstanceBuffer);
+	if (FAILED(hr))
+		return hr;
+	g_PatchBackend.SetContext(g_pImmediateContext);
+	g_PatchBackend.SetInstanceBuffer(g_pPatchInstanceBuffer, bd.ByteWidth);
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the density texture read by ConstHS, one R8_UNORM texel per density map cell
+//--------------------------------------------------------------------------------------
+HRESULT CreateDensityTexture()
+{
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = g_DensityMap.GetWidth();
+	desc.Height = g_DensityMap.GetHeight();
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA initData;
+	initData.pSysMem = g_DensityMap.GetTexels();
+	initData.SysMemPitch = g_DensityMap.GetWidth();
+	initData.SysMemSlicePitch = g_DensityMap.GetWidth() * g_DensityMap.GetHeight();
+
+	ID3D11Texture2D* pTexture = NULL;
+	HRESULT hr = g_pd3dDevice->CreateTexture2D(&desc, &initData, &pTexture);
+	if (FAILED(hr))
+		return hr;
+	hr = g_pd3dDevice->CreateShaderResourceView(pTexture, NULL, &g_pDensityTextureRV);
+	pTexture->Release();
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Clean up the objects we've created
+//--------------------------------------------------------------------------------------
+void CleanupDevice()
+{
+	if (g_pImmediateContext) g_pImmediateContext->ClearState();
+	g_StateTracker.Invalidate();
+	g_GpuProfiler.Release();
+
+	if (g_pStaticConstants) g_pStaticConstants->Release();
+	if (g_FrameConstants.pBuffer) g_FrameConstants.pBuffer->Release();
+	if (g_DrawConstants.pBuffer) g_DrawConstants.pBuffer->Release();
+	if (g_pVertexBuffer) g_pVertexBuffer->Release();
+	if (g_pIndexBuffer) g_pIndexBuffer->Release();
+	if (g_pPatchVertexBuffer) g_pPatchVertexBuffer->Release();
+	if (g_pPatchIndexBuffer) g_pPatchIndexBuffer->Release();
+	if (g_pPatchInstanceBuffer) g_pPatchInstanceBuffer->Release();
+	if (g_BakedGrid.pVertexBuffer) g_BakedGrid.pVertexBuffer->Release();
+	if (g_BakedGrid.pIndexBuffer) g_BakedGrid.pIndexBuffer->Release();
+	if (g_BakedQuadtree.pVertexBuffer) g_BakedQuadtree.pVertexBuffer->Release();
+	if (g_BakedQuadtree.pIndexBuffer) g_BakedQuadtree.pIndexBuffer->Release();
+	g_BakedGrid.Terrain.Close();
+	g_BakedQuadtree.Terrain.Close();
+	g_Jobs.Shutdown();
+	delete[] g_pVisiblePatches;
+	g_pVisiblePatches = NULL;
+	delete[] g_pQuadtreePatches;
+	g_pQuadtreePatches = NULL;
+	delete[] g_pBakedDraws;
+	g_pBakedDraws = NULL;
+	if (g_pVertexLayout) g_pVertexLayout->Release();
+	if (g_pQuadtreeVertexLayout) g_pQuadtreeVertexLayout->Release();
+	if (g_pBakedVertexLayout) g_pBakedVertexLayout->Release();
+	if (g_pCacheVertexLayout) g_pCacheVertexLayout->Release();
+	if (g_pCachedVertexLayout) g_pCachedVertexLayout->Release();
+	if (g_pStreamOutBuffer) g_pStreamOutBuffer->Release();
+	if (g_pCacheFactorBuffer) g_pCacheFactorBuffer->Release();
+	if (g_pVertexShader) g_pVertexShader->Release();
+	if (g_pQuadtreeVertexShader) g_pQuadtreeVertexShader->Release();
+	if (g_pBakedVertexShader) g_pBakedVertexShader->Release();
+	if (g_pHullShader) g_pHullShader->Release();
+	if (g_pDomainShader) g_pDomainShader->Release();
+	if (g_pQuadHullShader) g_pQuadHullShader->Release();
+	if (g_pQuadDomainShader) g_pQuadDomainShader->Release();
+	if (g_pQuadtreeHullShader) g_pQuadtreeHullShader->Release();
+	if (g_pQuadtreeDomainShader) g_pQuadtreeDomainShader->Release();
+	if (g_pCacheVertexShader) g_pCacheVertexShader->Release();
+	if (g_pCacheHullShader) g_pCacheHullShader->Release();
+	if (g_pCacheQuadHullShader) g_pCacheQuadHullShader->Release();
+	if (g_pCacheDomainShader) g_pCacheDomainShader->Release();
+	if (g_pCacheQuadDomainShader) g_pCacheQuadDomainShader->Release();
+	if (g_pCacheGeometryShader) g_pCacheGeometryShader->Release();
+	if (g_pCachedVertexShader) g_pCachedVertexShader->Release();
+	if (g_pPixelShader) g_pPixelShader->Release();
+	if (g_pSolidPixelShader) g_pSolidPixelShader->Release();
+	if (g_pDepthStencil) g_pDepthStencil->Release();
+	if (g_pDepthStencilView) g_pDepthStencilView->Release();
+	if (g_pRenderTargetView) g_pRenderTargetView->Release();
+	if (g_pSwapChain) g_pSwapChain->Release();
+	if (g_pImmediateContext) g_pImmediateContext->Release();
+	if (g_pd3dDevice) g_pd3dDevice->Release();
+	if (g_pDiffuseTextureRV) g_pDiffuseTextureRV->Release();
+	if (g_pDispTextureRV) g_pDispTextureRV->Release();
+	if (g_pNormTextureRV) g_pNormTextureRV->Release();
+	if (g_pDensityTextureRV) g_pDensityTextureRV->Release();
+	if (g_pTerrainDispTextureRV) g_pTerrainDispTextureRV->Release();
+	if (g_pTerrainNormTextureRV) g_pTerrainNormTextureRV->Release();
+	if (g_pSamplerPoint) g_pSamplerPoint->Release();
+	if (g_pSamplerLinear) g_pSamplerLinear->Release();
+	if (g_pWireFrameRasterizerState) g_pWireFrameRasterizerState->Release();
+	if (g_pDefaultRasterizerState) g_pDefaultRasterizerState->Release();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Called every time the application receives a message
+//--------------------------------------------------------------------------------------
+LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+	PAINTSTRUCT ps;
+	HDC hdc;
+
+	switch (message)
+	{
+	case WM_KEYDOWN:
+		if (wParam == 'W')
+			g_Camera.isMovingForward = true;
+		if (wParam == 'S')
+			g_Camera.isMovingBackward = true;
+		if (wParam == 'A')
+			g_Camera.isMovingLeft = true;
+		if (wParam == 'D')
+			g_Camera.isMovingRight = true;
+		if (wParam == VK_SPACE)
+			g_Camera.isMovingUp = true;
+		if (wParam == VK_CONTROL)
+			g_Camera.isMovingDown = true;
+		if (wParam == 'R')
+		{
+			g_pImmediateContext->RSGetState(&g_pDefaultRasterizerState);
+			if (!g_pDefaultRasterizerState)
+			{
+				g_IsWireFrame = true;
+				g_pImmediateContext->RSSetState(g_pWireFrameRasterizerState);
+			}
+			else
+			{
+				g_IsWireFrame = false;
+				g_pImmediateContext->RSSetState(NULL);
+			}
+		}
+		// With a tessellation budget the arrows change its target instead of the factor
+		if (g_TessBudget.GetParams().Mode != TESS_BUDGET_OFF && (wParam == VK_UP || wParam == VK_DOWN))
+			ChangeTessBudget(0, wParam == VK_UP ? 1 : -1);
+		else if (wParam == VK_UP && g_Settings.TessellationFactor <= 64.0f)
+			g_Settings.TessellationFactor += 0.5f;
+		else if (wParam == VK_DOWN && g_Settings.TessellationFactor >= 1.0f)
+			g_Settings.TessellationFactor -= 0.5f;
+		if (wParam == 'G')
+			ChangeTessBudget(1, 0);
+		if (wParam == 'T')
+			g_Settings.AdaptiveTessellation = !g_Settings.AdaptiveTessellation;
+		if (wParam == 'C')
+			g_Settings.ContentDensity = !g_Settings.ContentDensity;
+		if (wParam == 'Q')
+			g_Settings.QuadPatches = !g_Settings.QuadPatches;
+		if (wParam == 'L')
+			g_Settings.QuadtreeLod = !g_Settings.QuadtreeLod;
+		if (wParam == 'F')
+			g_Settings.GroundFollow = !g_Settings.GroundFollow;
+		if (wParam == 'M')
+			g_Settings.BakedLod = !g_Settings.BakedLod;
+		if (wParam == 'K')
+		{
+			g_Settings.RetessellationCache = !g_Settings.RetessellationCache;
+			const TessellationCacheStats& stats = g_GpuTessCache.GetStats();
+			char message[256];
+			sprintf_s(message, "Retessellation cache: %s, %lld hits, %lld misses, %lld evictions, %d slots of %.1f MB\n",
+				g_Settings.RetessellationCache ? "on" : "off", stats.Hits, stats.Misses, stats.Evictions, stats.Entries,
+				stats.Bytes / (1024.0 * 1024.0));
+			OutputDebugStringA(message);
+			g_GpuTessCache.ResetCounters();
+		}
+		if (wParam == VK_PRIOR && g_Settings.TargetTriangleSize < 64.0f)
+			g_Settings.TargetTriangleSize += 1.0f;
+		if (wParam == VK_NEXT && g_Settings.TargetTriangleSize > 1.0f)
+			g_Settings.TargetTriangleSize -= 1.0f;
+		if (wParam == 'B')
+		{
+			const StateBindCounters& counters = g_StateTracker.GetLastFrameCounters();
+			char message[256];
+			sprintf_s(message, "Binds issued/filtered last frame: shaders %d/%d, constant buffers %d/%d, resources %d/%d, samplers %d/%d\n",
+				counters.Issued[STATE_BIND_SHADER], counters.Filtered[STATE_BIND_SHADER],
+				counters.Issued[STATE_BIND_CONSTANT_BUFFERS], counters.Filtered[STATE_BIND_CONSTANT_BUFFERS],
+				counters.Issued[STATE_BIND_SHADER_RESOURCES], counters.Filtered[STATE_BIND_SHADER_RESOURCES],
+				counters.Issued[STATE_BIND_SAMPLERS], counters.Filtered[STATE_BIND_SAMPLERS]);
+			OutputDebugStringA(message);
+		}
+		if (wParam == 'P')
+		{
+			bool written = WriteFrameRecordsCsv(FRAME_STATS_CSV_FILE, g_FrameHistory) &&
+				WriteFrameSummaryJson(FRAME_STATS_JSON_FILE, g_FrameHistory);
+			char message[256];
+			sprintf_s(message, "Statistics of the last %d frames (times in ms)%s:\n", (int)g_FrameHistory.size(),
+				written ? ", written to " FRAME_STATS_CSV_FILE " and " FRAME_STATS_JSON_FILE : ", writing the files failed");
+			OutputDebugStringA(message);
+			OutputDebugStringA(FormatFrameSummary(g_FrameHistory).c_str());
+		}
+		if (wParam == VK_ESCAPE)
+			PostQuitMessage(0);
+		break;
+	case WM_KEYUP:
+		if (wParam == 'W')
+			g_Camera.isMovingForward = false;
+		if (wParam == 'S')
+			g_Camera.isMovingBackward = false;
+		if (wParam == 'A')
+			g_Camera.isMovingLeft = false;
+		if (wParam == 'D')
+			g_Camera.isMovingRight = false;
+		if (wParam == VK_SPACE)
+			g_Camera.isMovingUp = false;
+		if (wParam == VK_CONTROL)
+			g_Camera.isMovingDown = false;
+		break;
+	case WM_PAINT:
+		hdc = BeginPaint(hWnd, &ps);
+		EndPaint(hWnd, &ps);
+		break;
+
+	case WM_DESTROY:
+		PostQuitMessage(0);
+		break;
+
+	default:
+		return DefWindowProc(hWnd, message, wParam, lParam);
+	}
+
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Render a frame
+//--------------------------------------------------------------------------------------
+void Render()
 {
-	// Update our time
-	static float t = 0.0f;
-	static float oldt = 0.0f;
-	static float dt = 0.0f;
-	if (g_driverType == D3D_DRIVER_TYPE_REFERENCE)
+	// Update our time, a benchmark script sets the camera and the settings of the frame
+	// and steps on its fixed time step
+	double frameSeconds = g_FrameClock.Tick();
+	float dt = (float)(frameSeconds < MAX_CAMERA_STEP ? frameSeconds : MAX_CAMERA_STEP);
+	g_FrameProfiler.BeginFrame(frameSeconds);
+	g_GpuProfiler.BeginFrame(g_pImmediateContext, g_FrameProfiler.GetCurrentFrame());
+	if (g_pBenchmark)
+	{
+		if (g_BenchmarkFirstFrame < 0)
+			g_BenchmarkFirstFrame = g_FrameProfiler.GetCurrentFrame();
+		g_pBenchmark->GetFrame(g_FrameProfiler.GetCurrentFrame() - g_BenchmarkFirstFrame, g_Camera, g_Settings);
+		dt = 0.0f;
+	}
+
+	// Update camera, matrices and constants. The camera follows the ground of the drawn
+	// terrain, except in benchmark scripts, which play the same frames headless.
+	SceneFrame scene;
+	{
+		ScopedCpuTimer timer(g_FrameProfiler, FRAME_STAGE_CAMERA);
+		const HeightPyramid* pGroundHeights = g_Settings.QuadtreeLod ? &g_TerrainPyramid : &g_DisplacementPyramid;
+		UpdateScene(g_Camera, g_Settings, g_Projection, dt, scene, g_pBenchmark ? NULL : pGroundHeights);
+	}
+
+	// Cull the terrain patches, the bounds cover the displacement range of each patch, and
+	// append the indices of the drawn patches to the index ring, or select the patches of
+	// the quadtree terrain as instances. Grid patches are culled and counted in ranges on
+	// the job system. Baked terrains select their chunks and the LOD of each, without
+	// tessellation they are the only terrains drawn.
+	UINT indexCount = 0;
+	UINT indexOffset = 0;
+	bool quadtree = g_Settings.QuadtreeLod;
+	bool quads = g_Settings.QuadPatches;
+	BakedTerrainBuffers& baked = quadtree ? g_BakedQuadtree : g_BakedGrid;
+	bool bakedLod = (g_Settings.BakedLod || !g_TessellationSupported) && baked.Terrain.IsOpen();
+	bool instanced = quadtree && !bakedLod;
+	bool cached = !quadtree && !bakedLod && g_Settings.RetessellationCache && g_pStreamOutBuffer;
+	long long gridTriangles = 0;
+	g_BakedDrawCount = 0;
+	g_Jobs.BeginFrame();
+	{
+		ScopedCpuTimer timer(g_FrameProfiler, FRAME_STAGE_CULL);
+		if (bakedLod)
+		{
+			g_BakedDrawCount = SelectBakedTerrainChunks(baked.Terrain, g_Camera, g_Settings, g_Projection[1][1],
+				g_ViewportSize.y, scene, g_pBakedDraws, baked.Terrain.GetChunkCount());
+			scene.Draw.BakedHeightMin = baked.Terrain.GetHeader().HeightMin;
+			scene.Draw.BakedHeightRange = baked.Terrain.GetHeader().HeightRange;
+		}
+		else if (quadtree)
+		{
+			g_VisiblePatchCount = SelectQuadtreePatches(g_TerrainQuadtree, g_Camera, g_Settings, g_Projection[1][1],
+				g_ViewportSize.y, scene, g_pQuadtreePatches, QUADTREE_MAX_PATCHES);
+			g_PatchInstanceStreams.SetQuadtreePatches(g_pQuadtreePatches, g_VisiblePatchCount,
+				g_TerrainQuadtree.GetLeavesPerSide(), (int)scene.Frame.QuadtreeSubdivisions);
+		}
+		else
+		{
+			g_TerrainGrid.UpdateBounds(scene.WorldScale, g_Settings.Scaling * g_Settings.DisplacementLevel);
+			g_VisiblePatchCount = g_TerrainPatchJobs.Run(g_Jobs, g_TerrainGrid, g_Camera, g_Settings, scene,
+				g_Projection[1][1], g_ViewportSize.y, g_pVisiblePatches, &gridTriangles);
+			indexCount = g_VisiblePatchCount * (quads ? TERRAIN_QUAD_INDICES_PER_PATCH : TERRAIN_INDICES_PER_PATCH);
+		}
+
+		RING_MAP ringMap;
+		D3D11_MAPPED_SUBRESOURCE mappedIndices;
+		if (!instanced && indexCount > 0 && g_IndexRing.Allocate(indexCount * g_IndexSize, g_IndexSize, indexOffset, ringMap) &&
+			SUCCEEDED(g_pImmediateContext->Map(g_pIndexBuffer, 0,
+			ringMap == RING_MAP_DISCARD ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mappedIndices)))
+		{
+			BYTE* pIndices = (BYTE*)mappedIndices.pData + indexOffset;
+			if (g_IndexSize == sizeof(WORD))
+			{
+				if (quads)
+					g_TerrainGrid.WriteQuadPatchIndices(g_pVisiblePatches, g_VisiblePatchCount, (WORD*)pIndices);
+				else
+					g_TerrainGrid.WritePatchIndices(g_pVisiblePatches, g_VisiblePatchCount, (WORD*)pIndices);
+			}
+			else
+			{
+				if (quads)
+					g_TerrainGrid.WriteQuadPatchIndices(g_pVisiblePatches, g_VisiblePatchCount, (UINT*)pIndices);
+				else
+					g_TerrainGrid.WritePatchIndices(g_pVisiblePatches, g_VisiblePatchCount, (UINT*)pIndices);
+			}
+			g_pImmediateContext->Unmap(g_pIndexBuffer, 0);
+		}
+		else if (!instanced)
+		{
+			g_VisiblePatchCount = 0;
+		}
+
+		if (cached && g_VisiblePatchCount > 0)
+			PlanCachedGridPatches(scene);
+	}
+
+	// Count the triangles the tessellator will generate, for the frame records and the
+	// tessellation budget. The budget changes the settings of the next frame, benchmark
+	// scripts set their own. Grid patches were counted while they were culled. Quadtree
+	// patches are uniform grids, so their count is exact and already at the tessellation
+	// factor. Baked chunks are not tessellated and leave the budget alone.
+	long long triangles = 0;
+	long long maxTriangles = 0;
+	if (bakedLod)
+	{
+		triangles = baked.Terrain.CountTriangles(g_pBakedDraws, g_BakedDrawCount);
+		maxTriangles = triangles;
+	}
+	else if (quadtree)
 	{
-		t += (float)XM_PI * 0.0125f;
+		triangles = CountQuadtreeTriangles(g_pQuadtreePatches, g_VisiblePatchCount, (int)scene.Frame.QuadtreeSubdivisions);
+		maxTriangles = triangles;
 	}
 	else
 	{
-		static DWORD dwTimeStart = 0;
-		DWORD dwTimeCur = GetTickCount();
-		if (dwTimeStart == 0)
-			dwTimeStart = dwTimeCur;
-		oldt = t;
-		t = (dwTimeCur - dwTimeStart) / 1000.0f;
-		dt = t - oldt;
-	}
-
-	// Update camera and view matrix
-	if (g_Camera.isMovingForward)
-		g_Camera.Eye = XMVectorAdd(g_Camera.Eye, XMVector4Normalize(XMVectorSubtract(g_Camera.At, g_Camera.Eye)) * g_Camera.Speed * dt);
-	if (g_Camera.isMovingBackward)
-		g_Camera.Eye = XMVectorAdd(g_Camera.Eye, XMVector4Normalize(XMVectorSubtract(g_Camera.At, g_Camera.Eye)) * g_Camera.Speed * dt * -1.0f);
-	if (g_Camera.isMovingLeft)
-		g_Camera.Eye = XMVectorAdd(g_Camera.Eye, XMVector4Normalize(XMVector3Cross(g_Camera.Up, XMVectorSubtract(g_Camera.At, g_Camera.Eye))) * g_Camera.Speed * dt * -1.0f);
-	if (g_Camera.isMovingRight)
-		g_Camera.Eye = XMVectorAdd(g_Camera.Eye, XMVector4Normalize(XMVector3Cross(g_Camera.Up, XMVectorSubtract(g_Camera.At, g_Camera.Eye))) * g_Camera.Speed * dt);
-	if (g_Camera.isMovingUp)
-		g_Camera.Eye = XMVectorAdd(g_Camera.Eye, XMVector4Normalize(g_Camera.Up) * g_Camera.Speed * dt);
-	if (g_Camera.isMovingDown)
-		g_Camera.Eye = XMVectorAdd(g_Camera.Eye, XMVector4Normalize(g_Camera.Up) * g_Camera.Speed * dt * -1.0f);
-	g_View = XMMatrixLookAtLH(g_Camera.Eye, g_Camera.At, g_Camera.Up);
-
-	// Setup our lighting parameters
-	XMFLOAT4 LightPos = XMFLOAT4(-10, 10, 10, 1.0f);
-	XMFLOAT4 LightColor = XMFLOAT4(1, 1, 1, 1);
+		triangles = g_VisiblePatchCount > 0 ? gridTriangles : 0;
+		maxTriangles = CountUniformTerrainTriangles(g_VisiblePatchCount, g_Settings.TessellationFactor, quads);
+	}
+	g_FrameProfiler.SetTriangleCount(triangles);
+	if (!g_pBenchmark && !bakedLod)
+		g_TessBudget.Update(triangles, maxTriangles, frameSeconds, g_Settings);
 
 	//
 	// Clear the back buffer
@@ -724,54 +1831,301 @@ void Render()
 	g_pImmediateContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
 	//
-	// Update matrix variables and lighting variables
+	// Update the per-frame and per-draw constants, each is only uploaded when it changed
 	//
-	ConstantBuffer cb1;
-	cb1.mWorld = XMMatrixTranspose(g_World) * XMMatrixScaling(g_Scaling * 1.5f, g_Scaling, g_Scaling);
-	cb1.mView = XMMatrixTranspose(g_View);
-	cb1.mProjection = XMMatrixTranspose(g_Projection);
-	cb1.vPos = XMFLOAT4(0, 0, 0, 1);
-	cb1.LightPos = LightPos;
-	cb1.LightColor = LightColor;
-	XMStoreFloat4(&cb1.Eye, g_Camera.Eye);
-	cb1.TessellationFactor = g_TessellationFactor;
-	cb1.Scaling = g_Scaling;
-	cb1.DisplacementLevel = g_DisplacementLevel;
-	g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, NULL, &cb1, 0, 0);
+	{
+		ScopedCpuTimer timer(g_FrameProfiler, FRAME_STAGE_CONSTANTS);
+		scene.Draw.GridPatches[0] = (float)g_TerrainGrid.GetPatchesX();
+		scene.Draw.GridPatches[1] = (float)g_TerrainGrid.GetPatchesZ();
+		UpdateConstantBuffer(g_FrameConstants, &scene.Frame);
+		UpdateConstantBuffer(g_DrawConstants, &scene.Draw);
+	}
 
 	//
-	// Render the quad
+	// Render the visible terrain patches, binds that did not change since the last
+	// frame are dropped by the state tracker
 	//
-	g_pImmediateContext->VSSetShader(g_pVertexShader, NULL, 0);
-	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+	{
+		ScopedCpuTimer timer(g_FrameProfiler, FRAME_STAGE_BIND);
+		void* constantBuffers[3] = { g_pStaticConstants, g_FrameConstants.pBuffer, g_DrawConstants.pBuffer };
+		g_StateTracker.BeginFrame();
+		void* pVertexShader = bakedLod ? (void*)g_pBakedVertexShader : quadtree ? (void*)g_pQuadtreeVertexShader : (void*)g_pVertexShader;
+		g_StateTracker.SetShader(SHADER_STAGE_VERTEX, pVertexShader);
+		g_StateTracker.SetConstantBuffers(SHADER_STAGE_VERTEX, 0, 3, constantBuffers);
+
+		// Each grid cell is two tri patches or one quad patch, the quadtree terrain draws
+		// instances of one shared quad patch from the second vertex buffer. Baked terrains
+		// are triangle lists with their own vertices and indices.
+		ID3D11InputLayout* pVertexLayout = bakedLod ? g_pBakedVertexLayout : quadtree ? g_pQuadtreeVertexLayout : g_pVertexLayout;
+		if (pVertexLayout != g_pBoundVertexLayout)
+		{
+			g_pImmediateContext->IASetInputLayout(pVertexLayout);
+			g_pBoundVertexLayout = pVertexLayout;
+		}
+		ID3D11Buffer* pVertexBuffer = bakedLod ? baked.pVertexBuffer : quadtree ? g_pPatchVertexBuffer : g_pVertexBuffer;
+		if (pVertexBuffer != g_pBoundVertexBuffer)
+		{
+			ID3D11Buffer* vertexBuffers[2] = { pVertexBuffer, g_pPatchInstanceBuffer };
+			UINT strides[2] = { bakedLod ? (UINT)sizeof(BakedVertex) : (UINT)sizeof(GridControlPoint), sizeof(PatchInstance) };
+			UINT offsets[2] = { 0, 0 };
+			g_pImmediateContext->IASetVertexBuffers(0, instanced ? 2 : 1, vertexBuffers, strides, offsets);
+			g_pBoundVertexBuffer = pVertexBuffer;
+		}
+		ID3D11Buffer* pIndexBuffer = bakedLod ? baked.pIndexBuffer : quadtree ? g_pPatchIndexBuffer : g_pIndexBuffer;
+		if (pIndexBuffer != g_pBoundIndexBuffer)
+		{
+			g_pImmediateContext->IASetIndexBuffer(pIndexBuffer, (bakedLod || quadtree) ? DXGI_FORMAT_R16_UINT : g_IndexFormat, 0);
+			g_pBoundIndexBuffer = pIndexBuffer;
+		}
+		D3D11_PRIMITIVE_TOPOLOGY topology = bakedLod ? D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST : (quads || quadtree) ?
+			D3D11_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST : D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST;
+		if (topology != g_PatchTopology)
+		{
+			g_pImmediateContext->IASetPrimitiveTopology(topology);
+			g_PatchTopology = topology;
+		}
 
-	g_pImmediateContext->HSSetShader(g_pHullShader, NULL, 0);
-	g_pImmediateContext->HSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+		if (bakedLod)
+		{
+			g_StateTracker.SetShader(SHADER_STAGE_HULL, NULL);
+			g_StateTracker.SetShader(SHADER_STAGE_DOMAIN, NULL);
+		}
+		else
+		{
+			void* pHullShader = quadtree ? (void*)g_pQuadtreeHullShader : quads ? (void*)g_pQuadHullShader : (void*)g_pHullShader;
+			g_StateTracker.SetShader(SHADER_STAGE_HULL, pHullShader);
+			g_StateTracker.SetConstantBuffers(SHADER_STAGE_HULL, 0, 3, constantBuffers);
+			g_StateTracker.SetShaderResource(SHADER_STAGE_HULL, 3, g_pDensityTextureRV);
+
+			void* pDomainShader = quadtree ? (void*)g_pQuadtreeDomainShader : quads ? (void*)g_pQuadDomainShader : (void*)g_pDomainShader;
+			g_StateTracker.SetShader(SHADER_STAGE_DOMAIN, pDomainShader);
+			g_StateTracker.SetConstantBuffers(SHADER_STAGE_DOMAIN, 0, 3, constantBuffers);
+			g_StateTracker.SetShaderResource(SHADER_STAGE_DOMAIN, 1, quadtree ? g_pTerrainDispTextureRV : g_pDispTextureRV);
+			g_StateTracker.SetSampler(SHADER_STAGE_DOMAIN, 0, g_pSamplerPoint);
+		}
 
-	g_pImmediateContext->DSSetShader(g_pDomainShader, NULL, 0);
-	g_pImmediateContext->DSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-	g_pImmediateContext->DSSetShaderResources(1, 1, &g_pDispTextureRV);
-	g_pImmediateContext->DSSetSamplers(0, 1, &g_pSamplerPoint);
+		if (!g_IsWireFrame)
+		{
+			g_StateTracker.SetShader(SHADER_STAGE_PIXEL, g_pPixelShader);
+			g_StateTracker.SetConstantBuffers(SHADER_STAGE_PIXEL, 0, 3, constantBuffers);
+			g_StateTracker.SetShaderResource(SHADER_STAGE_PIXEL, 0, g_pDiffuseTextureRV);
+			g_StateTracker.SetShaderResource(SHADER_STAGE_PIXEL, 2, quadtree ? g_pTerrainNormTextureRV : g_pNormTextureRV);
+			g_StateTracker.SetSampler(SHADER_STAGE_PIXEL, 1, g_pSamplerLinear);
+		}
+		else if (g_IsWireFrame)
+		{
+			g_StateTracker.SetShader(SHADER_STAGE_PIXEL, g_pSolidPixelShader);
+		}
+	}
 
-	if (!g_IsWireFrame)
 	{
-		g_pImmediateContext->PSSetShader(g_pPixelShader, NULL, 0);
-		g_pImmediateContext->PSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-		g_pImmediateContext->PSSetShaderResources(0, 1, &g_pDiffuseTextureRV);
-		g_pImmediateContext->PSSetShaderResources(2, 1, &g_pNormTextureRV);
-		g_pImmediateContext->PSSetSamplers(1, 1, &g_pSamplerLinear);
+		ScopedCpuTimer timer(g_FrameProfiler, FRAME_STAGE_DRAW);
+		g_GpuProfiler.BeginDraw(g_pImmediateContext);
+		for (int i = 0; i < g_BakedDrawCount; i++)
+		{
+			const BakedDraw& draw = g_pBakedDraws[i];
+			const BakedChunkLod& chunkLod = baked.Terrain.GetChunkLod(draw.Chunk, draw.Lod);
+			g_pImmediateContext->DrawIndexed(chunkLod.IndexCount, baked.FirstIndex[draw.Lod] + chunkLod.FirstIndex,
+				baked.FirstVertex[draw.Lod] + chunkLod.FirstVertex);
+		}
+		// The quadtree patches are packed into the instance buffer and drawn with one call,
+		// the grid draws from the retessellation cache unless its factors cannot be uploaded
+		if (g_VisiblePatchCount > 0 && instanced)
+			SubmitPatchInstances(g_PatchBackend, g_PatchInstanceStreams.GetSoA(), g_PatchInstanceStreams.GetCount(),
+				QUADTREE_MAX_PATCHES);
+		else if (g_VisiblePatchCount > 0 && !(cached && DrawCachedGridPatches(indexOffset / g_IndexSize)))
+			g_pImmediateContext->DrawIndexed(indexCount, indexOffset / g_IndexSize, 0);
+		g_GpuProfiler.EndDraw(g_pImmediateContext);
 	}
-	else if (g_IsWireFrame)
+
+	//
+	// Present our back buffer to our front buffer
+	//
+	g_GpuProfiler.EndFrame(g_pImmediateContext);
 	{
-		g_pImmediateContext->PSSetShader(g_pSolidPixelShader, NULL, 0);
+		ScopedCpuTimer timer(g_FrameProfiler, FRAME_STAGE_PRESENT);
+		g_pSwapChain->Present(0, 0);
 	}
 
-	g_pImmediateContext->DrawIndexed(6, 0, 0);
-
 	//
-	// Present our back buffer to our front buffer
+	// Record the frame and collect the records of the frames whose GPU results arrived
 	//
-	g_pSwapChain->Present(0, 0);
+	g_FrameProfiler.EndFrame();
+	g_GpuProfiler.CollectResults(g_pImmediateContext, g_FrameProfiler);
+	FrameRecord record;
+	while (g_FrameRecords.Pop(record))
+	{
+		g_FrameHistory.push_back(record);
+		if (g_pBenchmark)
+			g_pBenchmark->AddRecord(record.Frame - g_BenchmarkFirstFrame, record);
+	}
+	if (g_FrameHistory.size() >= 2 * FRAME_HISTORY_FRAMES)
+		g_FrameHistory.erase(g_FrameHistory.begin(), g_FrameHistory.end() - FRAME_HISTORY_FRAMES);
+	if (g_pBenchmark)
+		UpdateBenchmark();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Plan the draw of the visible grid patches with the retessellation cache: their factors
+// as TerrainPatchJobs counts them, stabilized by the cache
+//--------------------------------------------------------------------------------------
+void PlanCachedGridPatches(const SceneFrame& scene)
+{
+	// The cached positions depend on the patch layout, the world scale and the displacement
+	bool quads = g_Settings.QuadPatches;
+	int gridPatches[2] = { g_TerrainGrid.GetPatchesX(), g_TerrainGrid.GetPatchesZ() };
+	unsigned long long key = HashBytes(&quads, sizeof(quads));
+	key = HashBytes(gridPatches, sizeof(gridPatches), key);
+	key = HashBytes(scene.WorldScale, sizeof(scene.WorldScale), key);
+	key = HashBytes(&g_Settings.Scaling, sizeof(g_Settings.Scaling), key);
+	key = HashBytes(&g_Settings.DisplacementLevel, sizeof(g_Settings.DisplacementLevel), key);
+	key = HashBytes(&g_pDispTextureRV, sizeof(g_pDispTextureRV), key);
+	g_GpuTessCache.SetContentKey(key);
+
+	g_CacheFactorCounter.ComputeFactors(g_TerrainGrid, g_pVisiblePatches, g_VisiblePatchCount, g_Camera, g_Settings, scene,
+		g_Projection[1][1], g_ViewportSize.y);
+	int count = g_VisiblePatchCount * (quads ? 1 : 2);
+	g_CachePatches.resize(count);
+	BuildGridCachePatches(g_TerrainGrid, g_pVisiblePatches, g_VisiblePatchCount, quads, g_CacheFactorCounter, g_CachePatches.data());
+	g_GpuTessCache.Update(g_CachePatches.data(), count, quads ? 4 : 3);
 }
 
 
+//--------------------------------------------------------------------------------------
+// Draw the visible grid patches as planned by PlanCachedGridPatches. The patches of
+// firstIndex in the index ring are drawn one by one with their factors as the instance:
+// the fills with their DS output streamed into their slots, the uncached ones with the
+// regular domain shader. Then the drawn slots are replayed without the hull and domain
+// shaders. Returns false if the factors cannot be uploaded, nothing is drawn then.
+//--------------------------------------------------------------------------------------
+bool DrawCachedGridPatches(UINT firstIndex)
+{
+	bool quads = g_Settings.QuadPatches;
+	UINT controlPoints = quads ? 4 : 3;
+	const std::vector<GpuTessCacheFill>& fills = g_GpuTessCache.GetFills();
+	const std::vector<int>& uncached = g_GpuTessCache.GetUncached();
+	const std::vector<GpuTessCacheDraw>& draws = g_GpuTessCache.GetDraws();
+
+	// The factors of the fills and then of the uncached patches, one instance each. The
+	// slots of the fills would never be written, so the cache starts over.
+	if (!fills.empty() || !uncached.empty())
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (FAILED(g_pImmediateContext->Map(g_pCacheFactorBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			g_GpuTessCache.Clear();
+			return false;
+		}
+		TessCacheFactors* pFactors = (TessCacheFactors*)mapped.pData;
+		for (size_t i = 0; i < fills.size() + uncached.size(); i++)
+		{
+			int patch = (i < fills.size()) ? fills[i].Patch : uncached[i - fills.size()];
+			memcpy(&pFactors[i], g_CachePatches[patch].Factors, sizeof(TessCacheFactors));
+		}
+		g_pImmediateContext->Unmap(g_pCacheFactorBuffer, 0);
+
+		ID3D11Buffer* vertexBuffers[2] = { g_pVertexBuffer, g_pCacheFactorBuffer };
+		UINT strides[2] = { sizeof(GridControlPoint), sizeof(TessCacheFactors) };
+		UINT offsets[2] = { 0, 0 };
+		g_pImmediateContext->IASetVertexBuffers(0, 2, vertexBuffers, strides, offsets);
+		g_pImmediateContext->IASetInputLayout(g_pCacheVertexLayout);
+		g_pBoundVertexBuffer = NULL;
+		g_pBoundVertexLayout = g_pCacheVertexLayout;
+		g_StateTracker.SetShader(SHADER_STAGE_VERTEX, g_pCacheVertexShader);
+		g_StateTracker.SetShader(SHADER_STAGE_HULL, quads ? g_pCacheQuadHullShader : g_pCacheHullShader);
+	}
+
+	// Every fill streams out to the start of its slot, the GPU tessellates exactly the
+	// triangles the slot was sized for
+	if (!fills.empty())
+	{
+		g_StateTracker.SetShader(SHADER_STAGE_DOMAIN, quads ? g_pCacheQuadDomainShader : g_pCacheDomainShader);
+		g_pImmediateContext->GSSetShader(g_pCacheGeometryShader, NULL, 0);
+		for (size_t i = 0; i < fills.size(); i++)
+		{
+			UINT offset = fills[i].FirstVertex * sizeof(GpuTessCacheVertex);
+			g_pImmediateContext->SOSetTargets(1, &g_pStreamOutBuffer, &offset);
+			g_pImmediateContext->DrawIndexedInstanced(controlPoints, 1, firstIndex + fills[i].Patch * controlPoints, 0, (UINT)i);
+		}
+		g_pImmediateContext->SOSetTargets(0, NULL, NULL);
+		g_pImmediateContext->GSSetShader(NULL, NULL, 0);
+	}
+
+	if (!uncached.empty())
+	{
+		g_StateTracker.SetShader(SHADER_STAGE_DOMAIN, quads ? g_pQuadDomainShader : g_pDomainShader);
+		for (size_t i = 0; i < uncached.size(); i++)
+			g_pImmediateContext->DrawIndexedInstanced(controlPoints, 1, firstIndex + uncached[i] * controlPoints, 0,
+				(UINT)(fills.size() + i));
+	}
+
+	if (!draws.empty())
+	{
+		g_StateTracker.SetShader(SHADER_STAGE_VERTEX, g_pCachedVertexShader);
+		g_StateTracker.SetShader(SHADER_STAGE_HULL, NULL);
+		g_StateTracker.SetShader(SHADER_STAGE_DOMAIN, NULL);
+		UINT stride = sizeof(GpuTessCacheVertex);
+		UINT offset = 0;
+		g_pImmediateContext->IASetVertexBuffers(0, 1, &g_pStreamOutBuffer, &stride, &offset);
+		g_pImmediateContext->IASetInputLayout(g_pCachedVertexLayout);
+		g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		g_pBoundVertexBuffer = g_pStreamOutBuffer;
+		g_pBoundVertexLayout = g_pCachedVertexLayout;
+		g_PatchTopology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		for (size_t i = 0; i < draws.size(); i++)
+			g_pImmediateContext->Draw(draws[i].VertexCount, draws[i].FirstVertex);
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes the benchmark report and quits once every measured frame has its record
+//--------------------------------------------------------------------------------------
+void UpdateBenchmark()
+{
+	if (!g_pBenchmark->IsComplete())
+		return;
+
+	char message[512];
+	if (g_pBenchmark->WriteReport(g_BenchmarkReportFile.c_str(), g_BenchmarkScriptFile.c_str()))
+		sprintf_s(message, "Benchmark of %d steps written to %s\n", g_pBenchmark->GetStepCount(), g_BenchmarkReportFile.c_str());
+	else
+		sprintf_s(message, "Writing the benchmark report to %s failed\n", g_BenchmarkReportFile.c_str());
+	OutputDebugStringA(message);
+
+	delete g_pBenchmark;
+	g_pBenchmark = NULL;
+	PostQuitMessage(0);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Steps to the next tessellation budget mode or moves the target of the current one
+//--------------------------------------------------------------------------------------
+void ChangeTessBudget(int modeStep, int targetStep)
+{
+	TessBudgetParams params = g_TessBudget.GetParams();
+	params.Mode = (TESS_BUDGET_MODE)((params.Mode + modeStep) % TESS_BUDGET_MODE_COUNT);
+	if (targetStep != 0 && params.Mode == TESS_BUDGET_FRAME_TIME)
+	{
+		params.TargetFrameSeconds += targetStep * TESS_BUDGET_FRAME_TIME_STEP;
+		if (params.TargetFrameSeconds < TESS_BUDGET_FRAME_TIME_STEP)
+			params.TargetFrameSeconds = TESS_BUDGET_FRAME_TIME_STEP;
+	}
+	if (targetStep != 0 && params.Mode == TESS_BUDGET_TRIANGLES)
+		params.TargetTriangles *= (targetStep > 0) ? TESS_BUDGET_TRIANGLES_STEP : 1.0 / TESS_BUDGET_TRIANGLES_STEP;
+	if (params.Mode == TESS_BUDGET_OFF)
+		g_Settings.TessellationScale = 1.0f;
+	g_TessBudget.SetParams(params);
+
+	char message[256];
+	if (params.Mode == TESS_BUDGET_FRAME_TIME)
+		sprintf_s(message, "Tessellation budget: frame time %.1f ms\n", params.TargetFrameSeconds * 1000.0);
+	else if (params.Mode == TESS_BUDGET_TRIANGLES)
+		sprintf_s(message, "Tessellation budget: %.0f triangles\n", params.TargetTriangles);
+	else
+		sprintf_s(message, "Tessellation budget: off, factor %.1f\n", g_Settings.TessellationFactor);
+	OutputDebugStringA(message);
+}
@@ -0,0 +1,1358 @@
+//--------------------------------------------------------------------------------------
+// File: Tessellator.cpp
+//
+// CPU reference of the D3D11 fixed-function tessellator. Points are placed with the
+// same 16.16 fixed point math and ruler-function split order as the D3D11 reference
+// rasterizer, rings are stitched with the same diagonal rules, and triangles are
+// emitted in the same order, so indices can be compared one to one with the GPU.
+//--------------------------------------------------------------------------------------
+#include "Tessellator.h"
+#include "SimdUtil.h"
+#include <math.h>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Fixed point helpers
+//--------------------------------------------------------------------------------------
+#define FXP_FRACTION_BITS       16
+#define FXP_FRACTION_MASK       0x0000ffff
+#define FXP_INTEGER_MASK        0x7fff0000
+#define FXP_ONE                 (1 << FXP_FRACTION_BITS)
+#define FXP_ONE_THIRD           0x00005555
+#define FXP_TWO_THIRDS          0x0000aaaa
+#define FXP_ONE_HALF            0x00008000
+
+#define TESS_MIN_ODD_FACTOR     1.0f
+#define TESS_MAX_ODD_FACTOR     63.0f
+#define TESS_MIN_EVEN_FACTOR    2.0f
+#define TESS_MAX_EVEN_FACTOR    64.0f
+
+// 2^-16, the smallest positive fixed point fraction
+#define TESS_EPSILON            0.0000152587890625f
+#define MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON (TESS_MIN_ODD_FACTOR + TESS_EPSILON / 2)
+
+static int FloatToFixed(float input)
+{
+	return (int)(input * FXP_ONE + 0.5f);
+}
+
+static int FixedCeil(int input)
+{
+	if (input & FXP_FRACTION_MASK)
+		return (input & FXP_INTEGER_MASK) + FXP_ONE;
+	return input;
+}
+
+static int FixedFloor(int input)
+{
+	return input & FXP_INTEGER_MASK;
+}
+
+static int FixedReciprocal(int numSegments)
+{
+	if (numSegments <= 0)
+		return 0;
+	return (FXP_ONE + numSegments / 2) / numSegments;
+}
+
+static bool IsEven(float input)
+{
+	return (((int)input) & 1) ? false : true;
+}
+
+// Clears the most significant set bit. Used to derive the ruler-function split point.
+static int RemoveMSB(int val)
+{
+	unsigned int check;
+	if (val <= 0x0000ffff)
+		check = (val <= 0x000000ff) ? 0x00000080 : 0x00008000;
+	else
+		check = (val <= 0x00ffffff) ? 0x00800000 : 0x80000000;
+	for (int i = 0; i < 8; i++, check >>= 1)
+	{
+		if ((unsigned int)val & check)
+			return (int)((unsigned int)val & ~check);
+	}
+	return 0;
+}
+
+// NaN maps to the lower bound, like the hardware clamp
+static float ClampFactor(float value, float lowerBound, float upperBound)
+{
+	return std::min(upperBound, (value > lowerBound) ? value : lowerBound);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction
+//--------------------------------------------------------------------------------------
+CpuTessellator::CpuTessellator()
+{
+	Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+}
+
+void CpuTessellator::Init(TESS_PARTITIONING partitioning, TESS_OUTPUT_TOPOLOGY outputTopology)
+{
+	m_Partitioning = partitioning;
+	m_OutputTopology = outputTopology;
+	m_OriginalParity = (partitioning == TESS_PARTITIONING_FRACTIONAL_EVEN) ? TESS_PARITY_EVEN : TESS_PARITY_ODD;
+	m_Parity = m_OriginalParity;
+	m_NumPoints = 0;
+	m_NumIndices = 0;
+	m_bUsingPatchedIndices = false;
+	m_bUsingPatchedIndices2 = false;
+}
+
+void CpuTessellator::ClampTessFactorBounds(float& lowerBound, float& upperBound) const
+{
+	switch (m_Partitioning)
+	{
+	case TESS_PARTITIONING_INTEGER:
+		lowerBound = TESS_MIN_ODD_FACTOR;
+		upperBound = TESS_MAX_EVEN_FACTOR;
+		break;
+	case TESS_PARTITIONING_FRACTIONAL_EVEN:
+		lowerBound = TESS_MIN_EVEN_FACTOR;
+		upperBound = TESS_MAX_EVEN_FACTOR;
+		break;
+	case TESS_PARTITIONING_FRACTIONAL_ODD:
+	default:
+		lowerBound = TESS_MIN_ODD_FACTOR;
+		upperBound = TESS_MAX_ODD_FACTOR;
+		break;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Tri domain
+//--------------------------------------------------------------------------------------
+void CpuTessellator::TessellateTriDomain(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Weq0,
+	float insideTessFactor)
+{
+	ProcessedTriFactors processed;
+	TriProcessTessFactors(tessFactor_Ueq0, tessFactor_Veq0, tessFactor_Weq0, insideTessFactor, processed);
+
+	if (processed.bPatchCulled)
+	{
+		m_NumPoints = 0;
+		m_NumIndices = 0;
+		return;
+	}
+	else if (processed.bJustDoMinimumTessFactor)
+	{
+		DefinePoint(0, FXP_ONE, 0);
+		DefinePoint(0, 0, 1);
+		DefinePoint(FXP_ONE, 0, 2);
+		m_NumPoints = 3;
+		DefineClockwiseTriangle(0, 1, 2, 0);
+		m_NumIndices = 3;
+		ConvertPointsToFloat();
+		return;
+	}
+
+	TriGeneratePoints(processed);
+	TriGenerateConnectivity(processed);
+	ConvertPointsToFloat();
+}
+
+void CpuTessellator::TriProcessTessFactors(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Weq0,
+	float insideTessFactor, ProcessedTriFactors& processed)
+{
+	// Is the patch culled? (NaN culls too)
+	if (!(tessFactor_Ueq0 > 0) || !(tessFactor_Veq0 > 0) || !(tessFactor_Weq0 > 0))
+	{
+		processed.bPatchCulled = true;
+		return;
+	}
+	processed.bPatchCulled = false;
+
+	// Clamp edge factors
+	float lowerBound = 0.0f, upperBound = 0.0f;
+	ClampTessFactorBounds(lowerBound, upperBound);
+
+	float outsideTessFactor[3] =
+	{
+		ClampFactor(tessFactor_Ueq0, lowerBound, upperBound),
+		ClampFactor(tessFactor_Veq0, lowerBound, upperBound),
+		ClampFactor(tessFactor_Weq0, lowerBound, upperBound),
+	};
+	if (IntegerPartitioning())
+	{
+		for (int edge = 0; edge < 3; edge++)
+			outsideTessFactor[edge] = ceilf(outsideTessFactor[edge]);
+	}
+
+	// Clamp inside factor. For fractional_odd a factor that ends up above 1 after the
+	// fixed point conversion forces a picture frame.
+	if (m_Partitioning == TESS_PARTITIONING_FRACTIONAL_ODD)
+	{
+		if (outsideTessFactor[0] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+			outsideTessFactor[1] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+			outsideTessFactor[2] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON)
+		{
+			lowerBound = TESS_MIN_ODD_FACTOR + TESS_EPSILON;
+		}
+	}
+	insideTessFactor = ClampFactor(insideTessFactor, lowerBound, upperBound);
+	if (IntegerPartitioning())
+		insideTessFactor = ceilf(insideTessFactor);
+
+	m_NumPoints = 0;
+	m_NumIndices = 0;
+
+	// Parity: integer partitioning picks odd or even per factor
+	int edge;
+	if (IntegerPartitioning())
+	{
+		for (edge = 0; edge < 3; edge++)
+			processed.outsideTessFactorParity[edge] = IsEven(outsideTessFactor[edge]) ? TESS_PARITY_EVEN : TESS_PARITY_ODD;
+		processed.insideTessFactorParity = (IsEven(insideTessFactor) || insideTessFactor == 1.0f) ? TESS_PARITY_EVEN : TESS_PARITY_ODD;
+	}
+	else
+	{
+		for (edge = 0; edge < 3; edge++)
+			processed.outsideTessFactorParity[edge] = m_OriginalParity;
+		processed.insideTessFactorParity = m_OriginalParity;
+	}
+
+	// Save fixed point factors
+	for (edge = 0; edge < 3; edge++)
+		processed.outsideTessFactor[edge] = FloatToFixed(outsideTessFactor[edge]);
+	processed.insideTessFactor = FloatToFixed(insideTessFactor);
+
+	if (IntegerPartitioning() || m_OriginalParity == TESS_PARITY_ODD)
+	{
+		// Special case if all factors are 1
+		if (processed.insideTessFactor == FXP_ONE &&
+			processed.outsideTessFactor[0] == FXP_ONE &&
+			processed.outsideTessFactor[1] == FXP_ONE &&
+			processed.outsideTessFactor[2] == FXP_ONE)
+		{
+			processed.bJustDoMinimumTessFactor = true;
+			return;
+		}
+	}
+	processed.bJustDoMinimumTessFactor = false;
+
+	// Per factor metadata
+	for (edge = 0; edge < 3; edge++)
+	{
+		SetTessellationParity(processed.outsideTessFactorParity[edge]);
+		ComputeTessFactorContext(processed.outsideTessFactor[edge], processed.outsideTessFactorCtx[edge]);
+	}
+	SetTessellationParity(processed.insideTessFactorParity);
+	ComputeTessFactorContext(processed.insideTessFactor, processed.insideTessFactorCtx);
+
+	// Outside edge point counts
+	for (edge = 0; edge < 3; edge++)
+	{
+		SetTessellationParity(processed.outsideTessFactorParity[edge]);
+		processed.numPointsForOutsideEdge[edge] = NumPointsForTessFactor(processed.outsideTessFactor[edge]);
+		m_NumPoints += processed.numPointsForOutsideEdge[edge];
+	}
+	m_NumPoints -= 3;
+
+	// Inside point count. max() allows degenerate transition regions when the inside factor is 1.
+	SetTessellationParity(processed.insideTessFactorParity);
+	processed.numPointsForInsideTessFactor = NumPointsForTessFactor(processed.insideTessFactor);
+	int pointCountMin = Odd() ? 4 : 3;
+	processed.numPointsForInsideTessFactor = std::max(pointCountMin, processed.numPointsForInsideTessFactor);
+
+	processed.insideEdgePointBaseOffset = m_NumPoints;
+
+	int numInteriorRings = (processed.numPointsForInsideTessFactor >> 1) - 1;
+	int numInteriorPoints;
+	if (Odd())
+		numInteriorPoints = 3 * (numInteriorRings * (numInteriorRings + 1) - numInteriorRings);
+	else
+		numInteriorPoints = 3 * (numInteriorRings * (numInteriorRings + 1)) + 1;
+	m_NumPoints += numInteriorPoints;
+}
+
+void CpuTessellator::TriGeneratePoints(const ProcessedTriFactors& processed)
+{
+	// Exterior ring, clockwise starting from point V (VW, the U == 0 edge)
+	int pointOffset = 0;
+	int edge;
+	for (edge = 0; edge < 3; edge++)
+	{
+		int parity = edge & 0x1;
+		int endPoint = processed.numPointsForOutsideEdge[edge] - 1;
+		SetTessellationParity(processed.outsideTessFactorParity[edge]);
+		// Don't include the end point, the next edge starts with it
+		for (int p = 0; p < endPoint; p++, pointOffset++)
+		{
+			// Edge 0 (VW) has V decreasing, edge 1 (WU) has U increasing, edge 2 (UV) has U decreasing
+			int q = parity ? p : endPoint - p;
+			int fxpParam;
+			PlacePointIn1D(processed.outsideTessFactorCtx[edge], q, fxpParam);
+			if (edge == 0)
+				DefinePoint(0, fxpParam, pointOffset);
+			else
+				DefinePoint(fxpParam, (edge == 2) ? FXP_ONE - fxpParam : 0, pointOffset);
+		}
+	}
+
+	// Interior rings, clockwise spiralling in
+	SetTessellationParity(processed.insideTessFactorParity);
+	int numRings = processed.numPointsForInsideTessFactor >> 1;
+	for (int ring = 1; ring < numRings; ring++)
+	{
+		int startPoint = ring;
+		int endPoint = processed.numPointsForInsideTessFactor - 1 - startPoint;
+
+		for (edge = 0; edge < 3; edge++)
+		{
+			int parity = edge & 0x1;
+			int fxpPerpParam;
+			PlacePointIn1D(processed.insideTessFactorCtx, startPoint, fxpPerpParam);
+			// Map the location to the right size in barycentric space
+			fxpPerpParam = (int)(((unsigned int)fxpPerpParam * FXP_TWO_THIRDS + FXP_ONE_HALF) >> FXP_FRACTION_BITS);
+			int fxpHalfPerp = (fxpPerpParam + 1) / 2;
+
+			for (int p = startPoint; p < endPoint; p++, pointOffset++)
+			{
+				int q = parity ? p : endPoint - (p - startPoint);
+				int fxpParam;
+				PlacePointIn1D(processed.insideTessFactorCtx, q, fxpParam);
+				// Interior edges run clockwise: the first one is perpendicular to the U axis,
+				// the second and third are perpendicular to the V and W axes
+				if (edge == 0)
+					DefinePoint(fxpPerpParam, fxpParam - fxpHalfPerp, pointOffset);
+				else if (edge == 1)
+					DefinePoint(fxpParam - fxpHalfPerp, fxpPerpParam, pointOffset);
+				else
+					DefinePoint(fxpParam - fxpHalfPerp, FXP_ONE - fxpParam - fxpHalfPerp, pointOffset);
+			}
+		}
+	}
+
+	// Even tessellation puts the last point at the center
+	if (!Odd())
+		DefinePoint(FXP_ONE_THIRD, FXP_ONE_THIRD, pointOffset);
+}
+
+void CpuTessellator::TriGenerateConnectivity(const ProcessedTriFactors& processed)
+{
+	// Stitch the concentric rings, one side at a time. +1 so even tessellation includes the center point.
+	int numRings = (processed.numPointsForInsideTessFactor + 1) >> 1;
+	int numPointsForOutsideEdge[3] =
+	{
+		processed.numPointsForOutsideEdge[0],
+		processed.numPointsForOutsideEdge[1],
+		processed.numPointsForOutsideEdge[2],
+	};
+
+	int insideEdgePointBaseOffset = processed.insideEdgePointBaseOffset;
+	int outsideEdgePointBaseOffset = 0;
+	for (int ring = 1; ring < numRings; ring++)
+	{
+		int numPointsForInsideEdge = processed.numPointsForInsideTessFactor - 2 * ring;
+		int edge0InsidePointBaseOffset = insideEdgePointBaseOffset;
+		int edge0OutsidePointBaseOffset = outsideEdgePointBaseOffset;
+
+		for (int edge = 0; edge < 3; edge++)
+		{
+			int numTriangles = numPointsForInsideEdge + numPointsForOutsideEdge[edge] - 2;
+			int insideBaseOffset;
+			int outsideBaseOffset;
+			if (edge == 2)
+			{
+				// The last edge wraps around to the first point of both rings. Patch the indices
+				// so the stitcher sees two sequentially increasing rows of points.
+				m_IndexPatchContext.insidePointIndexDeltaToRealValue = insideEdgePointBaseOffset;
+				m_IndexPatchContext.insidePointIndexBadValue = numPointsForInsideEdge - 1;
+				m_IndexPatchContext.insidePointIndexReplacementValue = edge0InsidePointBaseOffset;
+				m_IndexPatchContext.outsidePointIndexPatchBase = m_IndexPatchContext.insidePointIndexBadValue + 1;
+				m_IndexPatchContext.outsidePointIndexDeltaToRealValue = outsideEdgePointBaseOffset - m_IndexPatchContext.outsidePointIndexPatchBase;
+				m_IndexPatchContext.outsidePointIndexBadValue = m_IndexPatchContext.outsidePointIndexPatchBase + numPointsForOutsideEdge[edge] - 1;
+				m_IndexPatchContext.outsidePointIndexReplacementValue = edge0OutsidePointBaseOffset;
+				m_bUsingPatchedIndices = true;
+				insideBaseOffset = 0;
+				outsideBaseOffset = m_IndexPatchContext.outsidePointIndexPatchBase;
+			}
+			else
+			{
+				insideBaseOffset = insideEdgePointBaseOffset;
+				outsideBaseOffset = outsideEdgePointBaseOffset;
+			}
+
+			if (ring == 1)
+			{
+				StitchTransition(m_NumIndices,
+					insideBaseOffset, processed.insideTessFactorCtx.numHalfTessFactorPoints, processed.insideTessFactorParity,
+					outsideBaseOffset, processed.outsideTessFactorCtx[edge].numHalfTessFactorPoints, processed.outsideTessFactorParity[edge]);
+			}
+			else
+			{
+				StitchRegular(true, DIAGONALS_MIRRORED, m_NumIndices, numPointsForInsideEdge,
+					insideBaseOffset, outsideBaseOffset);
+			}
+			m_bUsingPatchedIndices = false;
+
+			m_NumIndices += numTriangles * 3;
+			outsideEdgePointBaseOffset += numPointsForOutsideEdge[edge] - 1;
+			insideEdgePointBaseOffset += numPointsForInsideEdge - 1;
+			numPointsForOutsideEdge[edge] = numPointsForInsideEdge;
+		}
+	}
+
+	// Odd tessellation leaves a single triangle in the center
+	SetTessellationParity(processed.insideTessFactorParity);
+	if (Odd())
+	{
+		DefineClockwiseTriangle(outsideEdgePointBaseOffset, outsideEdgePointBaseOffset + 1,
+			outsideEdgePointBaseOffset + 2, m_NumIndices);
+		m_NumIndices += 3;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Quad domain
+//--------------------------------------------------------------------------------------
+void CpuTessellator::TessellateQuadDomain(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Ueq1, float tessFactor_Veq1,
+	float insideTessFactor_U, float insideTessFactor_V)
+{
+	ProcessedQuadFactors processed;
+	QuadProcessTessFactors(tessFactor_Ueq0, tessFactor_Veq0, tessFactor_Ueq1, tessFactor_Veq1,
+		insideTessFactor_U, insideTessFactor_V, processed);
+
+	if (processed.bPatchCulled)
+	{
+		m_NumPoints = 0;
+		m_NumIndices = 0;
+		return;
+	}
+	else if (processed.bJustDoMinimumTessFactor)
+	{
+		DefinePoint(0, 0, 0);
+		DefinePoint(FXP_ONE, 0, 1);
+		DefinePoint(FXP_ONE, FXP_ONE, 2);
+		DefinePoint(0, FXP_ONE, 3);
+		m_NumPoints = 4;
+		DefineClockwiseTriangle(0, 1, 3, 0);
+		DefineClockwiseTriangle(1, 2, 3, 3);
+		m_NumIndices = 6;
+		ConvertPointsToFloat();
+		return;
+	}
+
+	QuadGeneratePoints(processed);
+	QuadGenerateConnectivity(processed);
+	ConvertPointsToFloat();
+}
+
+void CpuTessellator::QuadProcessTessFactors(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Ueq1, float tessFactor_Veq1,
+	float insideTessFactor_U, float insideTessFactor_V, ProcessedQuadFactors& processed)
+{
+	// Is the patch culled? (NaN culls too)
+	if (!(tessFactor_Ueq0 > 0) || !(tessFactor_Veq0 > 0) || !(tessFactor_Ueq1 > 0) || !(tessFactor_Veq1 > 0))
+	{
+		processed.bPatchCulled = true;
+		return;
+	}
+	processed.bPatchCulled = false;
+
+	// Clamp edge factors
+	float lowerBound = 0.0f, upperBound = 0.0f;
+	ClampTessFactorBounds(lowerBound, upperBound);
+
+	float outsideTessFactor[4] =
+	{
+		ClampFactor(tessFactor_Ueq0, lowerBound, upperBound),
+		ClampFactor(tessFactor_Veq0, lowerBound, upperBound),
+		ClampFactor(tessFactor_Ueq1, lowerBound, upperBound),
+		ClampFactor(tessFactor_Veq1, lowerBound, upperBound),
+	};
+	int edge, axis;
+	if (IntegerPartitioning())
+	{
+		for (edge = 0; edge < 4; edge++)
+			outsideTessFactor[edge] = ceilf(outsideTessFactor[edge]);
+	}
+
+	// Clamp inside factors, forcing a picture frame for fractional_odd if any factor is above 1
+	if (m_Partitioning == TESS_PARTITIONING_FRACTIONAL_ODD)
+	{
+		if (outsideTessFactor[0] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+			outsideTessFactor[1] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+			outsideTessFactor[2] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+			outsideTessFactor[3] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+			insideTessFactor_U > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+			insideTessFactor_V > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON)
+		{
+			lowerBound = TESS_MIN_ODD_FACTOR + TESS_EPSILON;
+		}
+	}
+	float insideTessFactor[2] =
+	{
+		ClampFactor(insideTessFactor_U, lowerBound, upperBound),
+		ClampFactor(insideTessFactor_V, lowerBound, upperBound),
+	};
+	if (IntegerPartitioning())
+	{
+		for (axis = 0; axis < 2; axis++)
+			insideTessFactor[axis] = ceilf(insideTessFactor[axis]);
+	}
+
+	m_NumPoints = 0;
+	m_NumIndices = 0;
+
+	if (IntegerPartitioning())
+	{
+		for (edge = 0; edge < 4; edge++)
+			processed.outsideTessFactorParity[edge] = IsEven(outsideTessFactor[edge]) ? TESS_PARITY_EVEN : TESS_PARITY_ODD;
+		for (axis = 0; axis < 2; axis++)
+		{
+			processed.insideTessFactorParity[axis] = (IsEven(insideTessFactor[axis]) || insideTessFactor[axis] == 1.0f)
+				? TESS_PARITY_EVEN : TESS_PARITY_ODD;
+		}
+	}
+	else
+	{
+		for (edge = 0; edge < 4; edge++)
+			processed.outsideTessFactorParity[edge] = m_OriginalParity;
+		processed.insideTessFactorParity[0] = processed.insideTessFactorParity[1] = m_OriginalParity;
+	}
+
+	// Save fixed point factors
+	for (edge = 0; edge < 4; edge++)
+		processed.outsideTessFactor[edge] = FloatToFixed(outsideTessFactor[edge]);
+	for (axis = 0; axis < 2; axis++)
+		processed.insideTessFactor[axis] = FloatToFixed(insideTessFactor[axis]);
+
+	if (IntegerPartitioning() || m_OriginalParity == TESS_PARITY_ODD)
+	{
+		// Special case if all factors are 1
+		if (processed.insideTessFactor[0] == FXP_ONE && processed.insideTessFactor[1] == FXP_ONE &&
+			processed.outsideTessFactor[0] == FXP_ONE && processed.outsideTessFactor[1] == FXP_ONE &&
+			processed.outsideTessFactor[2] == FXP_ONE && processed.outsideTessFactor[3] == FXP_ONE)
+		{
+			processed.bJustDoMinimumTessFactor = true;
+			return;
+		}
+	}
+	processed.bJustDoMinimumTessFactor = false;
+
+	// Per factor metadata
+	for (edge = 0; edge < 4; edge++)
+	{
+		SetTessellationParity(processed.outsideTessFactorParity[edge]);
+		ComputeTessFactorContext(processed.outsideTessFactor[edge], processed.outsideTessFactorCtx[edge]);
+	}
+	for (axis = 0; axis < 2; axis++)
+	{
+		SetTessellationParity(processed.insideTessFactorParity[axis]);
+		ComputeTessFactorContext(processed.insideTessFactor[axis], processed.insideTessFactorCtx[axis]);
+	}
+
+	// Outside edge point counts
+	for (edge = 0; edge < 4; edge++)
+	{
+		SetTessellationParity(processed.outsideTessFactorParity[edge]);
+		processed.numPointsForOutsideEdge[edge] = NumPointsForTessFactor(processed.outsideTessFactor[edge]);
+		m_NumPoints += processed.numPointsForOutsideEdge[edge];
+	}
+	m_NumPoints -= 4;
+
+	// Inside point counts. max() allows degenerate transition regions when an inside factor is 1.
+	for (axis = 0; axis < 2; axis++)
+	{
+		SetTessellationParity(processed.insideTessFactorParity[axis]);
+		processed.numPointsForInsideTessFactor[axis] = NumPointsForTessFactor(processed.insideTessFactor[axis]);
+		int pointCountMin = (processed.insideTessFactorParity[axis] == TESS_PARITY_ODD) ? 4 : 3;
+		processed.numPointsForInsideTessFactor[axis] = std::max(pointCountMin, processed.numPointsForInsideTessFactor[axis]);
+	}
+
+	processed.insideEdgePointBaseOffset = m_NumPoints;
+	m_NumPoints += (processed.numPointsForInsideTessFactor[0] - 2) * (processed.numPointsForInsideTessFactor[1] - 2);
+}
+
+void CpuTessellator::QuadGeneratePoints(const ProcessedQuadFactors& processed)
+{
+	// Exterior ring, clockwise from (U == 0, V == 1)
+	int pointOffset = 0;
+	int edge;
+	for (edge = 0; edge < 4; edge++)
+	{
+		int parity = edge & 0x1;
+		int endPoint = processed.numPointsForOutsideEdge[edge] - 1;
+		SetTessellationParity(processed.outsideTessFactorParity[edge]);
+		// Don't include the end point, the next edge starts with it
+		for (int p = 0; p < endPoint; p++, pointOffset++)
+		{
+			int q = (edge == 1 || edge == 2) ? p : endPoint - p;
+			int fxpParam;
+			PlacePointIn1D(processed.outsideTessFactorCtx[edge], q, fxpParam);
+			if (parity)
+				DefinePoint(fxpParam, (edge == 3) ? FXP_ONE : 0, pointOffset);
+			else
+				DefinePoint((edge == 2) ? FXP_ONE : 0, fxpParam, pointOffset);
+		}
+	}
+
+	// Interior rings, clockwise spiralling toward the center
+	int numPointsU = processed.numPointsForInsideTessFactor[0];
+	int numPointsV = processed.numPointsForInsideTessFactor[1];
+	int numRings = std::min(numPointsU, numPointsV) >> 1; // even tessellation doesn't count the center here
+	for (int ring = 1; ring < numRings; ring++)
+	{
+		int startPoint = ring;
+		int endPoint[2] = { numPointsU - 1 - startPoint, numPointsV - 1 - startPoint };
+
+		for (edge = 0; edge < 4; edge++)
+		{
+			int parity[2] = { edge & 0x1, (edge + 1) & 0x1 };
+			int perpendicularAxisPoint = (edge < 2) ? startPoint : endPoint[parity[0]];
+			int fxpPerpParam;
+			SetTessellationParity(processed.insideTessFactorParity[parity[0]]);
+			PlacePointIn1D(processed.insideTessFactorCtx[parity[0]], perpendicularAxisPoint, fxpPerpParam);
+			SetTessellationParity(processed.insideTessFactorParity[parity[1]]);
+			for (int p = startPoint; p < endPoint[parity[1]]; p++, pointOffset++)
+			{
+				int q = (edge == 1 || edge == 2) ? p : endPoint[parity[1]] - (p - startPoint);
+				int fxpParam;
+				PlacePointIn1D(processed.insideTessFactorCtx[parity[1]], q, fxpParam);
+				if (parity[1])
+					DefinePoint(fxpPerpParam, fxpParam, pointOffset);
+				else
+					DefinePoint(fxpParam, fxpPerpParam, pointOffset);
+			}
+		}
+	}
+
+	// For even tessellation the innermost "ring" is a degenerate row of points
+	if (numPointsU > numPointsV && processed.insideTessFactorParity[1] == TESS_PARITY_EVEN)
+	{
+		int startPoint = numRings;
+		int endPoint = numPointsU - 1 - startPoint;
+		SetTessellationParity(processed.insideTessFactorParity[0]);
+		for (int p = startPoint; p <= endPoint; p++, pointOffset++)
+		{
+			int fxpParam;
+			PlacePointIn1D(processed.insideTessFactorCtx[0], p, fxpParam);
+			DefinePoint(fxpParam, FXP_ONE_HALF, pointOffset);
+		}
+	}
+	else if (numPointsV >= numPointsU && processed.insideTessFactorParity[0] == TESS_PARITY_EVEN)
+	{
+		int startPoint = numRings;
+		int endPoint = numPointsV - 1 - startPoint;
+		SetTessellationParity(processed.insideTessFactorParity[1]);
+		for (int p = endPoint; p >= startPoint; p--, pointOffset++)
+		{
+			int fxpParam;
+			PlacePointIn1D(processed.insideTessFactorCtx[1], p, fxpParam);
+			DefinePoint(FXP_ONE_HALF, fxpParam, pointOffset);
+		}
+	}
+}
+
+void CpuTessellator::QuadGenerateConnectivity(const ProcessedQuadFactors& processed)
+{
+	int numPointsU = processed.numPointsForInsideTessFactor[0];
+	int numPointsV = processed.numPointsForInsideTessFactor[1];
+
+	// +1 so even tessellation includes the center point
+	int numPointRowsToCenter[2] = { (numPointsU + 1) >> 1, (numPointsV + 1) >> 1 };
+	int numRings = std::min(numPointRowsToCenter[0], numPointRowsToCenter[1]);
+
+	// Even partitioning causes a degenerate row of points, which breaks the point ordering
+	// conventions when travelling around the rings
+	int degeneratePointRing[2] =
+	{
+		(processed.insideTessFactorParity[1] == TESS_PARITY_EVEN) ? numPointRowsToCenter[1] - 1 : -1,
+		(processed.insideTessFactorParity[0] == TESS_PARITY_EVEN) ? numPointRowsToCenter[0] - 1 : -1,
+	};
+
+	int numPointsForOutsideEdge[4] =
+	{
+		processed.numPointsForOutsideEdge[0],
+		processed.numPointsForOutsideEdge[1],
+		processed.numPointsForOutsideEdge[2],
+		processed.numPointsForOutsideEdge[3],
+	};
+
+	int insideEdgePointBaseOffset = processed.insideEdgePointBaseOffset;
+	int outsideEdgePointBaseOffset = 0;
+	for (int ring = 1; ring < numRings; ring++)
+	{
+		int numPointsForInsideEdge[2] = { numPointsU - 2 * ring, numPointsV - 2 * ring };
+		int edge0InsidePointBaseOffset = insideEdgePointBaseOffset;
+		int edge0OutsidePointBaseOffset = outsideEdgePointBaseOffset;
+
+		for (int edge = 0; edge < 4; edge++)
+		{
+			int parity = (edge + 1) & 0x1;
+			int numTriangles = numPointsForInsideEdge[parity] + numPointsForOutsideEdge[edge] - 2;
+			int insideBaseOffset;
+			int outsideBaseOffset;
+			if (edge == 3)
+			{
+				// Patch the indexing so the stitcher sees two sequentially increasing rows of
+				// points, even though we wrapped around to the first point of each ring
+				if (ring == degeneratePointRing[parity])
+				{
+					m_IndexPatchContext2.baseIndexToInvert = insideEdgePointBaseOffset + 1;
+					m_IndexPatchContext2.cornerCaseBadValue = outsideEdgePointBaseOffset + numPointsForOutsideEdge[edge] - 1;
+					m_IndexPatchContext2.cornerCaseReplacementValue = edge0OutsidePointBaseOffset;
+					m_IndexPatchContext2.indexInversionEndPoint = (m_IndexPatchContext2.baseIndexToInvert << 1) - 1;
+					insideBaseOffset = m_IndexPatchContext2.baseIndexToInvert;
+					outsideBaseOffset = outsideEdgePointBaseOffset;
+					m_bUsingPatchedIndices2 = true;
+				}
+				else
+				{
+					m_IndexPatchContext.insidePointIndexDeltaToRealValue = insideEdgePointBaseOffset;
+					m_IndexPatchContext.insidePointIndexBadValue = numPointsForInsideEdge[parity] - 1;
+					m_IndexPatchContext.insidePointIndexReplacementValue = edge0InsidePointBaseOffset;
+					m_IndexPatchContext.outsidePointIndexPatchBase = m_IndexPatchContext.insidePointIndexBadValue + 1;
+					m_IndexPatchContext.outsidePointIndexDeltaToRealValue = outsideEdgePointBaseOffset - m_IndexPatchContext.outsidePointIndexPatchBase;
+					m_IndexPatchContext.outsidePointIndexBadValue = m_IndexPatchContext.outsidePointIndexPatchBase + numPointsForOutsideEdge[edge] - 1;
+					m_IndexPatchContext.outsidePointIndexReplacementValue = edge0OutsidePointBaseOffset;
+					insideBaseOffset = 0;
+					outsideBaseOffset = m_IndexPatchContext.outsidePointIndexPatchBase;
+					m_bUsingPatchedIndices = true;
+				}
+			}
+			else if (edge == 2 && ring == degeneratePointRing[parity])
+			{
+				m_IndexPatchContext2.baseIndexToInvert = insideEdgePointBaseOffset;
+				m_IndexPatchContext2.cornerCaseBadValue = -1;
+				m_IndexPatchContext2.cornerCaseReplacementValue = -1;
+				m_IndexPatchContext2.indexInversionEndPoint = m_IndexPatchContext2.baseIndexToInvert << 1;
+				insideBaseOffset = m_IndexPatchContext2.baseIndexToInvert;
+				outsideBaseOffset = outsideEdgePointBaseOffset;
+				m_bUsingPatchedIndices2 = true;
+			}
+			else
+			{
+				insideBaseOffset = insideEdgePointBaseOffset;
+				outsideBaseOffset = outsideEdgePointBaseOffset;
+			}
+
+			if (ring == 1)
+			{
+				StitchTransition(m_NumIndices,
+					insideBaseOffset, processed.insideTessFactorCtx[parity].numHalfTessFactorPoints, processed.insideTessFactorParity[parity],
+					outsideBaseOffset, processed.outsideTessFactorCtx[edge].numHalfTessFactorPoints, processed.outsideTessFactorParity[edge]);
+			}
+			else
+			{
+				StitchRegular(true, DIAGONALS_MIRRORED, m_NumIndices, numPointsForInsideEdge[parity],
+					insideBaseOffset, outsideBaseOffset);
+			}
+			m_bUsingPatchedIndices = false;
+			m_bUsingPatchedIndices2 = false;
+
+			m_NumIndices += numTriangles * 3;
+			outsideEdgePointBaseOffset += numPointsForOutsideEdge[edge] - 1;
+			if (edge == 2 && ring == degeneratePointRing[parity])
+				insideEdgePointBaseOffset -= numPointsForInsideEdge[parity] - 1;
+			else
+				insideEdgePointBaseOffset += numPointsForInsideEdge[parity] - 1;
+			numPointsForOutsideEdge[edge] = numPointsForInsideEdge[parity];
+		}
+	}
+
+	// Triangulate the center, a row of quads if odd
+	if (numPointsU > numPointsV && processed.insideTessFactorParity[1] == TESS_PARITY_ODD)
+	{
+		m_bUsingPatchedIndices2 = true;
+		int stripNumQuads = (((numPointsU >> 1) - (numPointsV >> 1)) << 1) +
+			((processed.insideTessFactorParity[0] == TESS_PARITY_EVEN) ? 2 : 1);
+		m_IndexPatchContext2.baseIndexToInvert = outsideEdgePointBaseOffset + stripNumQuads + 2;
+		m_IndexPatchContext2.cornerCaseBadValue = m_IndexPatchContext2.baseIndexToInvert;
+		m_IndexPatchContext2.cornerCaseReplacementValue = outsideEdgePointBaseOffset;
+		m_IndexPatchContext2.indexInversionEndPoint = m_IndexPatchContext2.baseIndexToInvert +
+			m_IndexPatchContext2.baseIndexToInvert + stripNumQuads;
+		StitchRegular(false, DIAGONALS_INSIDE_TO_OUTSIDE, m_NumIndices, stripNumQuads + 1,
+			m_IndexPatchContext2.baseIndexToInvert, outsideEdgePointBaseOffset + 1);
+		m_bUsingPatchedIndices2 = false;
+		m_NumIndices += stripNumQuads * 6;
+	}
+	else if (numPointsV >= numPointsU && processed.insideTessFactorParity[0] == TESS_PARITY_ODD)
+	{
+		m_bUsingPatchedIndices2 = true;
+		int stripNumQuads = (((numPointsV >> 1) - (numPointsU >> 1)) << 1) +
+			((processed.insideTessFactorParity[1] == TESS_PARITY_EVEN) ? 2 : 1);
+		m_IndexPatchContext2.baseIndexToInvert = outsideEdgePointBaseOffset + stripNumQuads + 1;
+		m_IndexPatchContext2.cornerCaseBadValue = -1;
+		m_IndexPatchContext2.cornerCaseReplacementValue = -1;
+		m_IndexPatchContext2.indexInversionEndPoint = m_IndexPatchContext2.baseIndexToInvert +
+			m_IndexPatchContext2.baseIndexToInvert + stripNumQuads;
+		DIAGONALS diag = (processed.insideTessFactorParity[1] == TESS_PARITY_EVEN) ?
+			DIAGONALS_INSIDE_TO_OUTSIDE : DIAGONALS_INSIDE_TO_OUTSIDE_EXCEPT_MIDDLE;
+		StitchRegular(false, diag, m_NumIndices, stripNumQuads + 1,
+			m_IndexPatchContext2.baseIndexToInvert, outsideEdgePointBaseOffset);
+		m_bUsingPatchedIndices2 = false;
+		m_NumIndices += stripNumQuads * 6;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// 1D point placement
+//--------------------------------------------------------------------------------------
+void CpuTessellator::ComputeTessFactorContext(int fxpTessFactor, TessFactorContext& ctx) const
+{
+	int fxpHalfTessFactor = (fxpTessFactor + 1) / 2;
+	// fxpHalfTessFactor is 1/2 if the factor is 1, but we pretend we are even
+	if (Odd() || fxpHalfTessFactor == FXP_ONE_HALF)
+		fxpHalfTessFactor += FXP_ONE_HALF;
+
+	int fxpFloorHalfTessFactor = FixedFloor(fxpHalfTessFactor);
+	int fxpCeilHalfTessFactor = FixedCeil(fxpHalfTessFactor);
+	ctx.fxpHalfTessFactorFraction = fxpHalfTessFactor - fxpFloorHalfTessFactor;
+	// For even factors this doesn't include the point fixed at the midpoint
+	ctx.numHalfTessFactorPoints = fxpCeilHalfTessFactor >> FXP_FRACTION_BITS;
+	if (fxpCeilHalfTessFactor == fxpFloorHalfTessFactor)
+	{
+		// Pick a value that causes the split point to be ignored
+		ctx.splitPointOnFloorHalfTessFactor = ctx.numHalfTessFactorPoints + 1;
+	}
+	else if (Odd())
+	{
+		if (fxpFloorHalfTessFactor == FXP_ONE)
+			ctx.splitPointOnFloorHalfTessFactor = 0;
+		else
+			ctx.splitPointOnFloorHalfTessFactor = (RemoveMSB((fxpFloorHalfTessFactor >> FXP_FRACTION_BITS) - 1) << 1) + 1;
+	}
+	else
+	{
+		ctx.splitPointOnFloorHalfTessFactor = (RemoveMSB(fxpFloorHalfTessFactor >> FXP_FRACTION_BITS) << 1) + 1;
+	}
+
+	int numFloorSegments = (fxpFloorHalfTessFactor * 2) >> FXP_FRACTION_BITS;
+	int numCeilSegments = (fxpCeilHalfTessFactor * 2) >> FXP_FRACTION_BITS;
+	if (Odd())
+	{
+		numFloorSegments -= 1;
+		numCeilSegments -= 1;
+	}
+	ctx.fxpInvNumSegmentsOnFloorTessFactor = FixedReciprocal(numFloorSegments);
+	ctx.fxpInvNumSegmentsOnCeilTessFactor = FixedReciprocal(numCeilSegments);
+}
+
+int CpuTessellator::NumPointsForTessFactor(int fxpTessFactor) const
+{
+	if (Odd())
+		return (FixedCeil(FXP_ONE_HALF + (fxpTessFactor + 1) / 2) * 2) >> FXP_FRACTION_BITS;
+	return ((FixedCeil((fxpTessFactor + 1) / 2) * 2) >> FXP_FRACTION_BITS) + 1;
+}
+
+void CpuTessellator::PlacePointIn1D(const TessFactorContext& ctx, int point, int& fxpLocation) const
+{
+	bool bFlip;
+	if (point >= ctx.numHalfTessFactorPoints)
+	{
+		point = (ctx.numHalfTessFactorPoints << 1) - point;
+		if (Odd())
+			point -= 1;
+		bFlip = true;
+	}
+	else
+	{
+		bFlip = false;
+	}
+
+	// Special case the middle, the 16 bit math below can't reproduce 0.5 exactly
+	if (point == ctx.numHalfTessFactorPoints)
+	{
+		fxpLocation = FXP_ONE_HALF;
+		return;
+	}
+
+	unsigned int indexOnCeilHalfTessFactor = point;
+	unsigned int indexOnFloorHalfTessFactor = indexOnCeilHalfTessFactor;
+	if (point > ctx.splitPointOnFloorHalfTessFactor)
+		indexOnFloorHalfTessFactor -= 1;
+
+	// Both locations are <= 0.5 and the lerp below stays within 32 bits unsigned
+	unsigned int fxpLocationOnFloorHalfTessFactor = indexOnFloorHalfTessFactor * ctx.fxpInvNumSegmentsOnFloorTessFactor;
+	unsigned int fxpLocationOnCeilHalfTessFactor = indexOnCeilHalfTessFactor * ctx.fxpInvNumSegmentsOnCeilTessFactor;
+	unsigned int location = fxpLocationOnFloorHalfTessFactor * (unsigned int)(FXP_ONE - ctx.fxpHalfTessFactorFraction) +
+		fxpLocationOnCeilHalfTessFactor * (unsigned int)ctx.fxpHalfTessFactorFraction;
+	fxpLocation = (int)((location + FXP_ONE_HALF) >> FXP_FRACTION_BITS);
+
+	if (bFlip)
+		fxpLocation = FXP_ONE - fxpLocation;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Stitching
+//--------------------------------------------------------------------------------------
+void CpuTessellator::StitchRegular(bool bTrapezoid, DIAGONALS diagonals, int baseIndexOffset, int numInsideEdgePoints,
+	int insideEdgePointBaseOffset, int outsideEdgePointBaseOffset)
+{
+	int insidePoint = insideEdgePointBaseOffset;
+	int outsidePoint = outsideEdgePointBaseOffset;
+	if (bTrapezoid)
+	{
+		DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+		baseIndexOffset += 3; outsidePoint++;
+	}
+
+	int p;
+	switch (diagonals)
+	{
+	case DIAGONALS_INSIDE_TO_OUTSIDE:
+		// Diagonals pointing from the inside edge forward towards the outside edge
+		for (p = 0; p < numInsideEdgePoints - 1; p++)
+		{
+			DefineClockwiseTriangle(insidePoint, outsidePoint, outsidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			DefineClockwiseTriangle(insidePoint, outsidePoint + 1, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			insidePoint++; outsidePoint++;
+		}
+		break;
+
+	case DIAGONALS_INSIDE_TO_OUTSIDE_EXCEPT_MIDDLE:
+		// Assumes odd tessellation. First half points from outside forward towards inside.
+		for (p = 0; p < numInsideEdgePoints / 2 - 1; p++)
+		{
+			DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+			baseIndexOffset += 3;
+			DefineClockwiseTriangle(insidePoint, outsidePoint + 1, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			insidePoint++; outsidePoint++;
+		}
+
+		// Middle
+		DefineClockwiseTriangle(outsidePoint, insidePoint + 1, insidePoint, baseIndexOffset);
+		baseIndexOffset += 3;
+		DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint + 1, baseIndexOffset);
+		baseIndexOffset += 3;
+		insidePoint++; outsidePoint++; p += 2;
+
+		// Second half
+		for (; p < numInsideEdgePoints; p++)
+		{
+			DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+			baseIndexOffset += 3;
+			DefineClockwiseTriangle(insidePoint, outsidePoint + 1, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			insidePoint++; outsidePoint++;
+		}
+		break;
+
+	case DIAGONALS_MIRRORED:
+		// First half, diagonals pointing from the outside of the outside edge to the inside of the inside edge
+		for (p = 0; p < numInsideEdgePoints / 2; p++)
+		{
+			DefineClockwiseTriangle(outsidePoint, insidePoint + 1, insidePoint, baseIndexOffset);
+			baseIndexOffset += 3;
+			DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			insidePoint++; outsidePoint++;
+		}
+		// Second half, diagonals pointing from the inside of the inside edge to the outside of the outside edge
+		for (; p < numInsideEdgePoints - 1; p++)
+		{
+			DefineClockwiseTriangle(insidePoint, outsidePoint, outsidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			DefineClockwiseTriangle(insidePoint, outsidePoint + 1, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			insidePoint++; outsidePoint++;
+		}
+		break;
+	}
+
+	if (bTrapezoid)
+	{
+		DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+		baseIndexOffset += 3;
+	}
+}
+
+void CpuTessellator::StitchTransition(int baseIndexOffset,
+	int insideEdgePointBaseOffset, int insideNumHalfTessFactorPoints, TESS_PARITY insideEdgeTessFactorParity,
+	int outsideEdgePointBaseOffset, int outsideNumHalfTessFactorPoints, TESS_PARITY outsideTessFactorParity)
+{
+	// Stitches two rows of points with arbitrary factors in ruler-function split order.
+	// finalPointPositionTable[i] is where vertex i ends up on the half edge at the maximum
+	// factor; the other half of the edge is mirrored. Supports odd factors up to 65 and even
+	// factors up to 64.
+	static const int finalPointPositionTable[33] =
+	{
+		0, 32, 16, 8, 17, 4, 18, 9, 19, 2, 20, 10, 21, 5, 22, 11, 23,
+		1, 24, 12, 25, 6, 26, 13, 27, 3, 28, 14, 29, 7, 30, 15, 31
+	};
+
+	// First and last entry in finalPointPositionTable below a given half factor. Entries 0
+	// and 1 are set up to skip the loop.
+	static const int loopStart[33] =
+	{
+		1, 1, 17, 9, 9, 5, 5, 5, 5, 3, 3, 3, 3, 3, 3, 3, 3,
+		2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2
+	};
+	static const int loopEnd[33] =
+	{
+		0, 0, 17, 17, 25, 25, 25, 25, 29, 29, 29, 29, 29, 29, 29, 29, 31,
+		31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 31, 32
+	};
+
+	if (insideEdgeTessFactorParity == TESS_PARITY_ODD)
+		insideNumHalfTessFactorPoints -= 1;
+	if (outsideTessFactorParity == TESS_PARITY_ODD)
+		outsideNumHalfTessFactorPoints -= 1;
+
+	// Walk the first half
+	int outsidePoint = outsideEdgePointBaseOffset;
+	int insidePoint = insideEdgePointBaseOffset;
+
+	int iStart = std::min(loopStart[insideNumHalfTessFactorPoints], loopStart[outsideNumHalfTessFactorPoints]);
+	int iEnd = std::max(loopEnd[insideNumHalfTessFactorPoints], loopEnd[outsideNumHalfTessFactorPoints]);
+
+	// The loop doesn't start at 0, so special case the first point
+	if (finalPointPositionTable[0] < outsideNumHalfTessFactorPoints)
+	{
+		DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+		baseIndexOffset += 3; outsidePoint++;
+	}
+
+	for (int i = iStart; i <= iEnd; i++)
+	{
+		if (finalPointPositionTable[i] < insideNumHalfTessFactorPoints)
+		{
+			// Advance inside
+			DefineClockwiseTriangle(insidePoint, outsidePoint, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3; insidePoint++;
+		}
+		if (finalPointPositionTable[i] < outsideNumHalfTessFactorPoints)
+		{
+			// Advance outside
+			DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+			baseIndexOffset += 3; outsidePoint++;
+		}
+	}
+
+	if (insideEdgeTessFactorParity != outsideTessFactorParity || insideEdgeTessFactorParity == TESS_PARITY_ODD)
+	{
+		if (insideEdgeTessFactorParity == outsideTessFactorParity)
+		{
+			// Quad in the middle
+			DefineClockwiseTriangle(insidePoint, outsidePoint, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			DefineClockwiseTriangle(insidePoint + 1, outsidePoint, outsidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			insidePoint++;
+			outsidePoint++;
+		}
+		else if (insideEdgeTessFactorParity == TESS_PARITY_EVEN)
+		{
+			// Triangle pointing inside
+			DefineClockwiseTriangle(insidePoint, outsidePoint, outsidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			outsidePoint++;
+		}
+		else
+		{
+			// Triangle pointing outside
+			DefineClockwiseTriangle(insidePoint, outsidePoint, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3;
+			insidePoint++;
+		}
+	}
+
+	// Walk the second half
+	for (int i = iEnd; i >= iStart; i--)
+	{
+		if (finalPointPositionTable[i] < outsideNumHalfTessFactorPoints)
+		{
+			// Advance outside
+			DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+			baseIndexOffset += 3; outsidePoint++;
+		}
+		if (finalPointPositionTable[i] < insideNumHalfTessFactorPoints)
+		{
+			// Advance inside
+			DefineClockwiseTriangle(insidePoint, outsidePoint, insidePoint + 1, baseIndexOffset);
+			baseIndexOffset += 3; insidePoint++;
+		}
+	}
+
+	// Mirror of the special case above
+	if (finalPointPositionTable[0] < outsideNumHalfTessFactorPoints)
+	{
+		DefineClockwiseTriangle(outsidePoint, outsidePoint + 1, insidePoint, baseIndexOffset);
+		baseIndexOffset += 3; outsidePoint++;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Output storage
+//--------------------------------------------------------------------------------------
+void CpuTessellator::DefinePoint(int fxpU, int fxpV, int pointStorageOffset)
+{
+	m_PointFxpU[pointStorageOffset] = fxpU;
+	m_PointFxpV[pointStorageOffset] = fxpV;
+}
+
+void CpuTessellator::DefineIndex(int index, int indexStorageOffset)
+{
+	m_Index[indexStorageOffset] = PatchIndexValue(index);
+}
+
+void CpuTessellator::DefineClockwiseTriangle(int index0, int index1, int index2, int indexStorageBaseOffset)
+{
+	// Takes a clockwise triangle and stores it CW or CCW depending on the output topology
+	DefineIndex(index0, indexStorageBaseOffset);
+	if (m_OutputTopology == TESS_OUTPUT_TRIANGLE_CW)
+	{
+		DefineIndex(index1, indexStorageBaseOffset + 1);
+		DefineIndex(index2, indexStorageBaseOffset + 2);
+	}
+	else
+	{
+		DefineIndex(index2, indexStorageBaseOffset + 1);
+		DefineIndex(index1, indexStorageBaseOffset + 2);
+	}
+}
+
+int CpuTessellator::PatchIndexValue(int index) const
+{
+	if (m_bUsingPatchedIndices)
+	{
+		// Remapped outside indices are assumed to be above the remapped inside ones
+		if (index >= m_IndexPatchContext.outsidePointIndexPatchBase)
+		{
+			if (index == m_IndexPatchContext.outsidePointIndexBadValue)
+				index = m_IndexPatchContext.outsidePointIndexReplacementValue;
+			else
+				index += m_IndexPatchContext.outsidePointIndexDeltaToRealValue;
+		}
+		else
+		{
+			if (index == m_IndexPatchContext.insidePointIndexBadValue)
+				index = m_IndexPatchContext.insidePointIndexReplacementValue;
+			else
+				index += m_IndexPatchContext.insidePointIndexDeltaToRealValue;
+		}
+	}
+	else if (m_bUsingPatchedIndices2)
+	{
+		if (index >= m_IndexPatchContext2.baseIndexToInvert)
+		{
+			if (index == m_IndexPatchContext2.cornerCaseBadValue)
+				index = m_IndexPatchContext2.cornerCaseReplacementValue;
+			else
+				index = m_IndexPatchContext2.indexInversionEndPoint - index;
+		}
+		else if (index == m_IndexPatchContext2.cornerCaseBadValue)
+		{
+			index = m_IndexPatchContext2.cornerCaseReplacementValue;
+		}
+	}
+	return index;
+}
+
+void CpuTessellator::ConvertPointsToFloat()
+{
+	// Points are < 2^24 so the int -> float conversion is exact, and scaling by a power of
+	// two keeps it exact, matching the per-point reference conversion bit for bit
+	const float scale = 1.0f / FXP_ONE;
+	int i = 0;
+#if TESS_USE_SSE2
+	const __m128 vScale = _mm_set1_ps(scale);
+	for (; i + 4 <= m_NumPoints; i += 4)
+	{
+		__m128i u = _mm_loadu_si128((const __m128i*)&m_PointFxpU[i]);
+		__m128i v = _mm_loadu_si128((const __m128i*)&m_PointFxpV[i]);
+		_mm_storeu_ps(&m_PointU[i], _mm_mul_ps(_mm_cvtepi32_ps(u), vScale));
+		_mm_storeu_ps(&m_PointV[i], _mm_mul_ps(_mm_cvtepi32_ps(v), vScale));
+	}
+#endif
+	for (; i < m_NumPoints; i++)
+	{
+		m_PointU[i] = (float)m_PointFxpU[i] * scale;
+		m_PointV[i] = (float)m_PointFxpV[i] * scale;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Triangle counts
+//--------------------------------------------------------------------------------------
+// NumPointsForTessFactor with odd parity
+static int NumOddPointsForTessFactor(int fxpTessFactor)
+{
+	return (FixedCeil(FXP_ONE_HALF + (fxpTessFactor + 1) / 2) * 2) >> FXP_FRACTION_BITS;
+}
+
+int CountFractionalOddTriTriangles(float edge0, float edge1, float edge2, float inside)
+{
+	if (!(edge0 > 0) || !(edge1 > 0) || !(edge2 > 0))
+		return 0;
+
+	// Same clamping and fixed point conversion as TriProcessTessFactors
+	float edges[3] =
+	{
+		ClampFactor(edge0, TESS_MIN_ODD_FACTOR, TESS_MAX_ODD_FACTOR),
+		ClampFactor(edge1, TESS_MIN_ODD_FACTOR, TESS_MAX_ODD_FACTOR),
+		ClampFactor(edge2, TESS_MIN_ODD_FACTOR, TESS_MAX_ODD_FACTOR),
+	};
+	float insideLowerBound = TESS_MIN_ODD_FACTOR;
+	if (edges[0] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON || edges[1] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+		edges[2] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON)
+	{
+		insideLowerBound = TESS_MIN_ODD_FACTOR + TESS_EPSILON;
+	}
+	int fxpInside = FloatToFixed(ClampFactor(inside, insideLowerBound, TESS_MAX_ODD_FACTOR));
+
+	bool minimum = fxpInside == FXP_ONE;
+	int outsidePoints = 0;
+	for (int edge = 0; edge < 3; edge++)
+	{
+		int fxpEdge = FloatToFixed(edges[edge]);
+		minimum = minimum && fxpEdge == FXP_ONE;
+		outsidePoints += NumOddPointsForTessFactor(fxpEdge);
+	}
+	if (minimum)
+		return 1;
+
+	// A strip stitched between rows of a and b points has a + b - 2 triangles. The
+	// outermost ring joins the edges to rows of N - 2 inside points, ring r > 1 joins rows
+	// of N - 2r + 2 and N - 2r points, and one triangle is left in the center. With
+	// N = 2R the inner rings sum to 6 (R - 1) (R - 2).
+	int insidePoints = std::max(4, NumOddPointsForTessFactor(fxpInside));
+	int rings = insidePoints / 2;
+	return outsidePoints + 3 * insidePoints - 12 + 6 * (rings - 1) * (rings - 2) + 1;
+}
+
+int CountFractionalOddQuadTriangles(float edge0, float edge1, float edge2, float edge3, float insideU, float insideV)
+{
+	if (!(edge0 > 0) || !(edge1 > 0) || !(edge2 > 0) || !(edge3 > 0))
+		return 0;
+
+	// Same clamping and fixed point conversion as QuadProcessTessFactors
+	float edges[4] =
+	{
+		ClampFactor(edge0, TESS_MIN_ODD_FACTOR, TESS_MAX_ODD_FACTOR),
+		ClampFactor(edge1, TESS_MIN_ODD_FACTOR, TESS_MAX_ODD_FACTOR),
+		ClampFactor(edge2, TESS_MIN_ODD_FACTOR, TESS_MAX_ODD_FACTOR),
+		ClampFactor(edge3, TESS_MIN_ODD_FACTOR, TESS_MAX_ODD_FACTOR),
+	};
+	float insideLowerBound = TESS_MIN_ODD_FACTOR;
+	if (edges[0] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON || edges[1] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+		edges[2] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON || edges[3] > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON ||
+		insideU > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON || insideV > MIN_ODD_TESSFACTOR_PLUS_HALF_EPSILON)
+	{
+		insideLowerBound = TESS_MIN_ODD_FACTOR + TESS_EPSILON;
+	}
+	int fxpInside[2] =
+	{
+		FloatToFixed(ClampFactor(insideU, insideLowerBound, TESS_MAX_ODD_FACTOR)),
+		FloatToFixed(ClampFactor(insideV, insideLowerBound, TESS_MAX_ODD_FACTOR)),
+	};
+
+	bool minimum = fxpInside[0] == FXP_ONE && fxpInside[1] == FXP_ONE;
+	int outsidePoints[4];
+	for (int edge = 0; edge < 4; edge++)
+	{
+		int fxpEdge = FloatToFixed(edges[edge]);
+		minimum = minimum && fxpEdge == FXP_ONE;
+		outsidePoints[edge] = NumOddPointsForTessFactor(fxpEdge);
+	}
+	if (minimum)
+		return 2;
+
+	// Ring r joins every edge to a row of N - 2r inside points along the edge's axis, from
+	// the outside edge on the first ring and from the row of the previous ring after it.
+	// The rings stop at the shorter axis and a strip of quads is left in the center.
+	int insidePoints[2] =
+	{
+		std::max(4, NumOddPointsForTessFactor(fxpInside[0])),
+		std::max(4, NumOddPointsForTessFactor(fxpInside[1])),
+	};
+	int rings = std::min(insidePoints[0], insidePoints[1]) / 2;
+	int triangles = 0;
+	for (int ring = 1; ring < rings; ring++)
+	{
+		for (int edge = 0; edge < 4; edge++)
+		{
+			int axis = (edge + 1) & 0x1;
+			int inner = insidePoints[axis] - 2 * ring;
+			int outer = (ring == 1) ? outsidePoints[edge] : inner + 2;
+			triangles += inner + outer - 2;
+		}
+	}
+	int stripQuads = std::max(insidePoints[0], insidePoints[1]) - std::min(insidePoints[0], insidePoints[1]) + 1;
+	return triangles + 2 * stripQuads;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Domain evaluation
+//--------------------------------------------------------------------------------------
+void TessEvaluateTriDomain(const float* pU, const float* pV, int count, const float controlPoints[3][3],
+	float* pOutX, float* pOutY, float* pOutZ)
+{
+	// P = u * P0 + v * P1 + w * P2 = P2 + u * (P0 - P2) + v * (P1 - P2)
+	float e0[3], e1[3];
+	for (int c = 0; c < 3; c++)
+	{
+		e0[c] = controlPoints[0][c] - controlPoints[2][c];
+		e1[c] = controlPoints[1][c] - controlPoints[2][c];
+	}
+	float* pOut[3] = { pOutX, pOutY, pOutZ };
+
+	int i = 0;
+#if TESS_USE_SSE2
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 u = _mm_loadu_ps(&pU[i]);
+		__m128 v = _mm_loadu_ps(&pV[i]);
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 r = _mm_add_ps(_mm_set1_ps(controlPoints[2][c]), _mm_mul_ps(u, _mm_set1_ps(e0[c])));
+			r = _mm_add_ps(r, _mm_mul_ps(v, _mm_set1_ps(e1[c])));
+			_mm_storeu_ps(&pOut[c][i], r);
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			pOut[c][i] = controlPoints[2][c] + pU[i] * e0[c] + pV[i] * e1[c];
+	}
+}
+
+void TessEvaluateQuadDomain(const float* pU, const float* pV, int count, const float controlPoints[4][3],
+	float* pOutX, float* pOutY, float* pOutZ)
+{
+	// zPos1 = lerp(P0, P1, v), zPos2 = lerp(P3, P2, v), P = lerp(zPos1, zPos2, u)
+	float* pOut[3] = { pOutX, pOutY, pOutZ };
+
+	int i = 0;
+#if TESS_USE_SSE2
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 u = _mm_loadu_ps(&pU[i]);
+		__m128 v = _mm_loadu_ps(&pV[i]);
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 p0 = _mm_set1_ps(controlPoints[0][c]);
+			__m128 p3 = _mm_set1_ps(controlPoints[3][c]);
+			__m128 z1 = _mm_add_ps(p0, _mm_mul_ps(v, _mm_set1_ps(controlPoints[1][c] - controlPoints[0][c])));
+			__m128 z2 = _mm_add_ps(p3, _mm_mul_ps(v, _mm_set1_ps(controlPoints[2][c] - controlPoints[3][c])));
+			_mm_storeu_ps(&pOut[c][i], _mm_add_ps(z1, _mm_mul_ps(u, _mm_sub_ps(z2, z1))));
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float z1 = controlPoints[0][c] + pV[i] * (controlPoints[1][c] - controlPoints[0][c]);
+			float z2 = controlPoints[3][c] + pV[i] * (controlPoints[2][c] - controlPoints[3][c]);
+			pOut[c][i] = z1 + pU[i] * (z2 - z1);
+		}
+	}
+}
@@ -0,0 +1,218 @@
+//--------------------------------------------------------------------------------------
+// File: Tessellator.h
+//
+// Portable CPU implementation of the D3D11 fixed-function tessellator stage for the
+// tri and quad domains. It produces the same domain points (SV_DomainLocation) and the
+// same triangle connectivity the GPU feeds to the domain shader, so tessellation can be
+// profiled and regression-tested without Win32 or D3D11.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define TESS_MAX_FACTOR         64
+#define TESS_MAX_POINTS         ((TESS_MAX_FACTOR + 1) * (TESS_MAX_FACTOR + 1))
+#define TESS_MAX_INDICES        (TESS_MAX_FACTOR * TESS_MAX_FACTOR * 2 * 3)
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+// Matches the [partitioning(...)] attribute of the hull shader
+enum TESS_PARTITIONING
+{
+	TESS_PARTITIONING_INTEGER,
+	TESS_PARTITIONING_FRACTIONAL_ODD,
+	TESS_PARTITIONING_FRACTIONAL_EVEN,
+};
+
+// Matches the [outputtopology(...)] attribute of the hull shader
+enum TESS_OUTPUT_TOPOLOGY
+{
+	TESS_OUTPUT_TRIANGLE_CW,
+	TESS_OUTPUT_TRIANGLE_CCW,
+};
+
+enum TESS_DOMAIN
+{
+	TESS_DOMAIN_TRI,
+	TESS_DOMAIN_QUAD,
+};
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct TessFactorContext
+{
+	int fxpInvNumSegmentsOnFloorTessFactor;
+	int fxpInvNumSegmentsOnCeilTessFactor;
+	int fxpHalfTessFactorFraction;
+	int numHalfTessFactorPoints;
+	int splitPointOnFloorHalfTessFactor;
+};
+
+struct IndexPatchContext
+{
+	int insidePointIndexDeltaToRealValue;
+	int insidePointIndexBadValue;
+	int insidePointIndexReplacementValue;
+	int outsidePointIndexPatchBase;
+	int outsidePointIndexDeltaToRealValue;
+	int outsidePointIndexBadValue;
+	int outsidePointIndexReplacementValue;
+};
+
+struct IndexPatchContext2
+{
+	int baseIndexToInvert;
+	int indexInversionEndPoint;
+	int cornerCaseBadValue;
+	int cornerCaseReplacementValue;
+};
+
+
+//--------------------------------------------------------------------------------------
+// CpuTessellator
+//
+// Domain points are returned in SoA layout. For the tri domain U and V are the first two
+// barycentric coordinates (SV_DomainLocation.xy, z = 1 - U - V), for the quad domain they
+// are SV_DomainLocation directly. Indices form a triangle list.
+//--------------------------------------------------------------------------------------
+class CpuTessellator
+{
+public:
+	CpuTessellator();
+
+	void Init(TESS_PARTITIONING partitioning, TESS_OUTPUT_TOPOLOGY outputTopology = TESS_OUTPUT_TRIANGLE_CW);
+
+	void TessellateTriDomain(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Weq0,
+		float insideTessFactor);
+	void TessellateQuadDomain(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Ueq1, float tessFactor_Veq1,
+		float insideTessFactor_U, float insideTessFactor_V);
+
+	int GetPointCount() const { return m_NumPoints; }
+	int GetIndexCount() const { return m_NumIndices; }
+	const float* GetPointsU() const { return m_PointU; }
+	const float* GetPointsV() const { return m_PointV; }
+	const int* GetIndices() const { return m_Index; }
+
+private:
+	enum TESS_PARITY
+	{
+		TESS_PARITY_EVEN,
+		TESS_PARITY_ODD,
+	};
+
+	struct ProcessedTriFactors
+	{
+		int outsideTessFactor[3];
+		int insideTessFactor;
+		TESS_PARITY outsideTessFactorParity[3];
+		TESS_PARITY insideTessFactorParity;
+		TessFactorContext outsideTessFactorCtx[3];
+		TessFactorContext insideTessFactorCtx;
+		int numPointsForOutsideEdge[3];
+		int numPointsForInsideTessFactor;
+		int insideEdgePointBaseOffset;
+		bool bPatchCulled;
+		bool bJustDoMinimumTessFactor;
+	};
+
+	struct ProcessedQuadFactors
+	{
+		int outsideTessFactor[4];
+		int insideTessFactor[2];
+		TESS_PARITY outsideTessFactorParity[4];
+		TESS_PARITY insideTessFactorParity[2];
+		TessFactorContext outsideTessFactorCtx[4];
+		TessFactorContext insideTessFactorCtx[2];
+		int numPointsForOutsideEdge[4];
+		int numPointsForInsideTessFactor[2];
+		int insideEdgePointBaseOffset;
+		bool bPatchCulled;
+		bool bJustDoMinimumTessFactor;
+	};
+
+	enum DIAGONALS
+	{
+		DIAGONALS_INSIDE_TO_OUTSIDE,
+		DIAGONALS_INSIDE_TO_OUTSIDE_EXCEPT_MIDDLE,
+		DIAGONALS_MIRRORED,
+	};
+
+	bool Odd() const { return m_Parity == TESS_PARITY_ODD; }
+	bool IntegerPartitioning() const { return m_Partitioning == TESS_PARTITIONING_INTEGER; }
+	void SetTessellationParity(TESS_PARITY parity) { m_Parity = parity; }
+	void ClampTessFactorBounds(float& lowerBound, float& upperBound) const;
+
+	void TriProcessTessFactors(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Weq0,
+		float insideTessFactor, ProcessedTriFactors& processed);
+	void TriGeneratePoints(const ProcessedTriFactors& processed);
+	void TriGenerateConnectivity(const ProcessedTriFactors& processed);
+
+	void QuadProcessTessFactors(float tessFactor_Ueq0, float tessFactor_Veq0, float tessFactor_Ueq1, float tessFactor_Veq1,
+		float insideTessFactor_U, float insideTessFactor_V, ProcessedQuadFactors& processed);
+	void QuadGeneratePoints(const ProcessedQuadFactors& processed);
+	void QuadGenerateConnectivity(const ProcessedQuadFactors& processed);
+
+	void ComputeTessFactorContext(int fxpTessFactor, TessFactorContext& ctx) const;
+	int NumPointsForTessFactor(int fxpTessFactor) const;
+	void PlacePointIn1D(const TessFactorContext& ctx, int point, int& fxpLocation) const;
+
+	void StitchRegular(bool bTrapezoid, DIAGONALS diagonals, int baseIndexOffset, int numInsideEdgePoints,
+		int insideEdgePointBaseOffset, int outsideEdgePointBaseOffset);
+	void StitchTransition(int baseIndexOffset,
+		int insideEdgePointBaseOffset, int insideNumHalfTessFactorPoints, TESS_PARITY insideEdgeTessFactorParity,
+		int outsideEdgePointBaseOffset, int outsideNumHalfTessFactorPoints, TESS_PARITY outsideTessFactorParity);
+
+	void DefinePoint(int fxpU, int fxpV, int pointStorageOffset);
+	void DefineIndex(int index, int indexStorageOffset);
+	void DefineClockwiseTriangle(int index0, int index1, int index2, int indexStorageBaseOffset);
+	int PatchIndexValue(int index) const;
+	void ConvertPointsToFloat();
+
+	TESS_PARTITIONING m_Partitioning;
+	TESS_OUTPUT_TOPOLOGY m_OutputTopology;
+	TESS_PARITY m_OriginalParity;
+	TESS_PARITY m_Parity;
+	int m_NumPoints;
+	int m_NumIndices;
+	bool m_bUsingPatchedIndices;
+	bool m_bUsingPatchedIndices2;
+	IndexPatchContext m_IndexPatchContext;
+	IndexPatchContext2 m_IndexPatchContext2;
+
+	// Points are generated in 16.16 fixed point and converted to float in one SIMD pass
+	int m_PointFxpU[TESS_MAX_POINTS];
+	int m_PointFxpV[TESS_MAX_POINTS];
+	float m_PointU[TESS_MAX_POINTS];
+	float m_PointV[TESS_MAX_POINTS];
+	int m_Index[TESS_MAX_INDICES];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Triangle counts
+//--------------------------------------------------------------------------------------
+// Number of triangles TessellateTriDomain generates with fractional_odd partitioning,
+// computed from the point counts of the rings without generating them
+int CountFractionalOddTriTriangles(float edge0, float edge1, float edge2, float inside);
+
+// Number of triangles TessellateQuadDomain generates with fractional_odd partitioning,
+// edges in the order of its arguments
+int CountFractionalOddQuadTriangles(float edge0, float edge1, float edge2, float edge3, float insideU, float insideV);
+
+
+//--------------------------------------------------------------------------------------
+// Domain evaluation (what DS does with SV_DomainLocation before displacement)
+//--------------------------------------------------------------------------------------
+// Barycentric interpolation of a 3 control point patch, as in DisplacedAndShaded.hlsl
+void TessEvaluateTriDomain(const float* pU, const float* pV, int count, const float controlPoints[3][3],
+	float* pOutX, float* pOutY, float* pOutZ);
+
+// Bilinear interpolation of a 4 control point patch, as in Tessellated.hlsl
+void TessEvaluateQuadDomain(const float* pU, const float* pV, int count, const float controlPoints[4][3],
+	float* pOutX, float* pOutY, float* pOutZ);
@@ -0,0 +1,261 @@
+//--------------------------------------------------------------------------------------
+// File: TessellatorSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "Tessellator.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+static const char* s_DomainNames[] = { "tri", "quad" };
+static const char* s_PartitioningNames[] = { "integer", "odd", "even" };
+
+
+//--------------------------------------------------------------------------------------
+// Validation of one tessellated patch. Checks index range, winding and that the
+// triangles exactly cover the domain (area 1/2 for tri, 1 for quad in UV space), and
+// fails the first problem found.
+//--------------------------------------------------------------------------------------
+static bool ValidatePatch(const CpuTessellator& tessellator, TESS_DOMAIN domain, const char* pLabel, SuiteCheck& check)
+{
+	int numPoints = tessellator.GetPointCount();
+	int numIndices = tessellator.GetIndexCount();
+	const float* pU = tessellator.GetPointsU();
+	const float* pV = tessellator.GetPointsV();
+	const int* pIndices = tessellator.GetIndices();
+
+	if (numIndices % 3 != 0)
+	{
+		check.Fail("%s: index count %d is not a triangle list", pLabel, numIndices);
+		return false;
+	}
+
+	std::vector<int> referenced(numPoints, 0);
+	double area = 0.0;
+	for (int i = 0; i < numIndices; i += 3)
+	{
+		int i0 = pIndices[i], i1 = pIndices[i + 1], i2 = pIndices[i + 2];
+		if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= numPoints || i1 >= numPoints || i2 >= numPoints)
+		{
+			check.Fail("%s: triangle %d references point out of range", pLabel, i / 3);
+			return false;
+		}
+		referenced[i0] = referenced[i1] = referenced[i2] = 1;
+
+		// Clockwise in the tessellator's convention is a positive signed area in UV
+		double a = 0.5 * ((double)(pU[i1] - pU[i0]) * (pV[i2] - pV[i0]) - (double)(pV[i1] - pV[i0]) * (pU[i2] - pU[i0]));
+		if (a < -1e-9)
+		{
+			check.Fail("%s: triangle %d has the wrong winding", pLabel, i / 3);
+			return false;
+		}
+		area += a;
+	}
+
+	for (int i = 0; i < numPoints; i++)
+	{
+		float w = (domain == TESS_DOMAIN_TRI) ? 1.0f - pU[i] - pV[i] : 0.0f;
+		if (pU[i] < 0.0f || pU[i] > 1.0f || pV[i] < 0.0f || pV[i] > 1.0f || w < -1e-6f)
+		{
+			check.Fail("%s: point %d lies outside the domain", pLabel, i);
+			return false;
+		}
+		if (!referenced[i])
+		{
+			check.Fail("%s: point %d is not referenced by any triangle", pLabel, i);
+			return false;
+		}
+	}
+
+	double expectedArea = (domain == TESS_DOMAIN_TRI) ? 0.5 : 1.0;
+	if (fabs(area - expectedArea) > 1e-4)
+	{
+		check.Fail("%s: triangles cover %f of the domain, expected %f", pLabel, area, expectedArea);
+		return false;
+	}
+	return true;
+}
+
+int VerifyTessellator()
+{
+	// Uniform and mixed factors over the whole range, in 0.25 steps plus odd fractions
+	std::vector<float> factors;
+	for (float f = 1.0f; f <= 64.0f; f += 0.25f)
+		factors.push_back(f);
+	factors.push_back(1.0001f);
+	factors.push_back(2.7f);
+	factors.push_back(13.3f);
+
+	CpuTessellator* pTessellator = new CpuTessellator();
+	SuiteCheck check("tessellator");
+	int patches = 0;
+	char label[256];
+	for (int partitioning = 0; partitioning < 3; partitioning++)
+	{
+		pTessellator->Init((TESS_PARTITIONING)partitioning);
+		for (size_t i = 0; i < factors.size(); i++)
+		{
+			// Neighbouring factors from the list exercise transitions between different edge and inside factors
+			float f0 = factors[i];
+			float f1 = factors[(i * 7 + 3) % factors.size()];
+			float f2 = factors[(i * 13 + 5) % factors.size()];
+			float f3 = factors[(i * 29 + 11) % factors.size()];
+
+			sprintf(label, "tri/%s %g %g %g | %g", s_PartitioningNames[partitioning], f0, f1, f2, f0);
+			pTessellator->TessellateTriDomain(f0, f1, f2, f0);
+			ValidatePatch(*pTessellator, TESS_DOMAIN_TRI, label, check);
+
+			sprintf(label, "tri/%s uniform %g", s_PartitioningNames[partitioning], f0);
+			pTessellator->TessellateTriDomain(f0, f0, f0, f0);
+			ValidatePatch(*pTessellator, TESS_DOMAIN_TRI, label, check);
+
+			sprintf(label, "quad/%s %g %g %g %g | %g %g", s_PartitioningNames[partitioning], f0, f1, f2, f3, f0, f3);
+			pTessellator->TessellateQuadDomain(f0, f1, f2, f3, f0, f3);
+			ValidatePatch(*pTessellator, TESS_DOMAIN_QUAD, label, check);
+
+			sprintf(label, "quad/%s %g %g %g %g | %g %g", s_PartitioningNames[partitioning], f0, f1, f2, f3, f3, f0);
+			pTessellator->TessellateQuadDomain(f0, f1, f2, f3, f3, f0);
+			ValidatePatch(*pTessellator, TESS_DOMAIN_QUAD, label, check);
+
+			sprintf(label, "quad/%s uniform %g", s_PartitioningNames[partitioning], f0);
+			pTessellator->TessellateQuadDomain(f0, f0, f0, f0, f0, f0);
+			ValidatePatch(*pTessellator, TESS_DOMAIN_QUAD, label, check);
+			patches += 5;
+		}
+	}
+
+	// Zero and NaN factors cull the patch
+	pTessellator->Init(TESS_PARTITIONING_FRACTIONAL_ODD);
+	pTessellator->TessellateTriDomain(0.0f, 4.0f, 4.0f, 4.0f);
+	check.FailIf(pTessellator->GetIndexCount() != 0, "tri: a zero edge factor must cull the patch");
+
+	// The analytic fractional_odd tri counts match the generated triangles, for random
+	// edge and inside factors including out of range, culling and near 1 ones. Only the
+	// first difference fails.
+	static const float s_SpecialFactors[] = { 0.0f, -1.0f, 0.5f, 1.0f, 1.00001f, 1.0001f, 3.0f, 62.9f, 63.0f, 80.0f };
+	srand(3);
+	int countErrors = 0;
+	for (int i = 0; i < 20000; i++)
+	{
+		float f[4];
+		for (int e = 0; e < 4; e++)
+		{
+			int pick = rand() % 16;
+			f[e] = (pick < 10) ? s_SpecialFactors[pick] : 1.0f + 63.0f * rand() / RAND_MAX;
+		}
+		pTessellator->TessellateTriDomain(f[0], f[1], f[2], f[3]);
+		if (CountFractionalOddTriTriangles(f[0], f[1], f[2], f[3]) != pTessellator->GetIndexCount() / 3 && countErrors++ == 0)
+			check.Fail("tri/odd %g %g %g | %g: analytic triangle count differs", f[0], f[1], f[2], f[3]);
+	}
+	for (size_t i = 0; i < factors.size(); i++)
+	{
+		pTessellator->TessellateTriDomain(factors[i], factors[i], factors[i], factors[i]);
+		if (CountFractionalOddTriTriangles(factors[i], factors[i], factors[i], factors[i]) != pTessellator->GetIndexCount() / 3 &&
+			countErrors++ == 0)
+		{
+			check.Fail("tri/odd uniform %g: analytic triangle count differs", factors[i]);
+		}
+	}
+
+	// And the quad counts, the inside factors picked from the same values
+	for (int i = 0; i < 20000; i++)
+	{
+		float f[6];
+		for (int e = 0; e < 6; e++)
+		{
+			int pick = rand() % 16;
+			f[e] = (pick < 10) ? s_SpecialFactors[pick] : 1.0f + 63.0f * rand() / RAND_MAX;
+		}
+		pTessellator->TessellateQuadDomain(f[0], f[1], f[2], f[3], f[4], f[5]);
+		if (CountFractionalOddQuadTriangles(f[0], f[1], f[2], f[3], f[4], f[5]) != pTessellator->GetIndexCount() / 3 &&
+			countErrors++ == 0)
+		{
+			check.Fail("quad/odd %g %g %g %g | %g %g: analytic triangle count differs", f[0], f[1], f[2], f[3], f[4], f[5]);
+		}
+	}
+	for (size_t i = 0; i < factors.size(); i++)
+	{
+		float f = factors[i];
+		pTessellator->TessellateQuadDomain(f, f, f, f, f, f);
+		if (CountFractionalOddQuadTriangles(f, f, f, f, f, f) != pTessellator->GetIndexCount() / 3 && countErrors++ == 0)
+			check.Fail("quad/odd uniform %g: analytic triangle count differs", f);
+	}
+	patches += 2 * (20000 + (int)factors.size());
+	delete pTessellator;
+
+	return check.Finish("%d patches", patches);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Throughput measurement. Tessellates and evaluates the domain of many patches with
+// slightly varying factors, like a terrain with per-patch factors would.
+//--------------------------------------------------------------------------------------
+static void RunThroughput(TESS_DOMAIN domain, TESS_PARTITIONING partitioning, float factor, int numPatches)
+{
+	static const float s_TriPatch[3][3] = { { -1, 0, 1 }, { 1, 0, 1 }, { -1, 0, -1 } };
+	static const float s_QuadPatch[4][3] = { { -1, 0, -1 }, { -1, 0, 1 }, { 1, 0, 1 }, { 1, 0, -1 } };
+
+	CpuTessellator* pTessellator = new CpuTessellator();
+	pTessellator->Init(partitioning);
+	std::vector<float> x(TESS_MAX_POINTS), y(TESS_MAX_POINTS), z(TESS_MAX_POINTS);
+
+	long long totalPoints = 0;
+	long long totalTriangles = 0;
+	double checksum = 0.0;
+	double start = GetTimeSeconds();
+	for (int patch = 0; patch < numPatches; patch++)
+	{
+		// Jitter the factor a little so edges of neighbouring patches differ
+		float f = factor * (1.0f - 0.05f * (float)(patch & 7) / 7.0f);
+		if (domain == TESS_DOMAIN_TRI)
+		{
+			pTessellator->TessellateTriDomain(f, factor, f, factor);
+			TessEvaluateTriDomain(pTessellator->GetPointsU(), pTessellator->GetPointsV(), pTessellator->GetPointCount(),
+				s_TriPatch, &x[0], &y[0], &z[0]);
+		}
+		else
+		{
+			pTessellator->TessellateQuadDomain(f, factor, f, factor, factor, factor);
+			TessEvaluateQuadDomain(pTessellator->GetPointsU(), pTessellator->GetPointsV(), pTessellator->GetPointCount(),
+				s_QuadPatch, &x[0], &y[0], &z[0]);
+		}
+		totalPoints += pTessellator->GetPointCount();
+		totalTriangles += pTessellator->GetIndexCount() / 3;
+		checksum += x[patch % pTessellator->GetPointCount()];
+	}
+	double seconds = GetTimeSeconds() - start;
+	delete pTessellator;
+
+	printf("%-5s %-8s factor %6.2f  %8d patches  %10.3f ms  %8.2f Mpoints/s  %8.2f Mtris/s  (checksum %.3f)\n",
+		s_DomainNames[domain], s_PartitioningNames[partitioning], factor, numPatches, seconds * 1000.0,
+		(double)totalPoints / seconds * 1e-6, (double)totalTriangles / seconds * 1e-6, checksum);
+}
+
+void RunTessellatorSuite(const BenchmarkOptions& options)
+{
+	static const float s_Factors[] = { 1.0f, 4.5f, 16.0f, 33.3f, 63.0f };
+	for (int domain = 0; domain < 2; domain++)
+	{
+		if (options.Domain >= 0 && options.Domain != domain)
+			continue;
+		for (int partitioning = 0; partitioning < 3; partitioning++)
+		{
+			if (options.Partitioning >= 0 && options.Partitioning != partitioning)
+				continue;
+			if (options.Factor > 0.0f)
+			{
+				RunThroughput((TESS_DOMAIN)domain, (TESS_PARTITIONING)partitioning, options.Factor, options.Patches);
+				continue;
+			}
+			for (int f = 0; f < (int)(sizeof(s_Factors) / sizeof(s_Factors[0])); f++)
+				RunThroughput((TESS_DOMAIN)domain, (TESS_PARTITIONING)partitioning, s_Factors[f], options.Patches);
+		}
+	}
+}
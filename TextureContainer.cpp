@@ -0,0 +1,301 @@
+//--------------------------------------------------------------------------------------
+// File: TextureContainer.cpp
+//--------------------------------------------------------------------------------------
+#include "TextureContainer.h"
+#include "Hash.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+
+//--------------------------------------------------------------------------------------
+// Cooking
+//--------------------------------------------------------------------------------------
+int GetTextureFormatSize(TEXTURE_FORMAT format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_R8_UNORM: return 1;
+	case TEXTURE_FORMAT_R8G8B8A8_UNORM: return 4;
+	case TEXTURE_FORMAT_BC1_UNORM: return 8;
+	case TEXTURE_FORMAT_BC4_UNORM: return 8;
+	case TEXTURE_FORMAT_BC5_UNORM: return 16;
+	case TEXTURE_FORMAT_R8G8_UNORM: return 2;
+	}
+	return 0;
+}
+
+bool IsBlockCompressed(TEXTURE_FORMAT format)
+{
+	return format == TEXTURE_FORMAT_BC1_UNORM || format == TEXTURE_FORMAT_BC4_UNORM || format == TEXTURE_FORMAT_BC5_UNORM;
+}
+
+int GetTextureFormatChannels(TEXTURE_FORMAT format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_R8_UNORM: return 1;
+	case TEXTURE_FORMAT_R8G8B8A8_UNORM: return 4;
+	case TEXTURE_FORMAT_BC1_UNORM: return 3;
+	case TEXTURE_FORMAT_BC4_UNORM: return 1;
+	case TEXTURE_FORMAT_BC5_UNORM: return 2;
+	case TEXTURE_FORMAT_R8G8_UNORM: return 2;
+	}
+	return 0;
+}
+
+void GetTextureMipLayout(TEXTURE_FORMAT format, unsigned int width, unsigned int height, unsigned int& rowPitch, unsigned long long& size)
+{
+	unsigned int formatSize = GetTextureFormatSize(format);
+	if (IsBlockCompressed(format))
+	{
+		rowPitch = (width + BC_BLOCK_DIMENSION - 1) / BC_BLOCK_DIMENSION * formatSize;
+		size = (unsigned long long)rowPitch * ((height + BC_BLOCK_DIMENSION - 1) / BC_BLOCK_DIMENSION);
+	}
+	else
+	{
+		rowPitch = width * formatSize;
+		size = (unsigned long long)rowPitch * height;
+	}
+}
+
+static BC_FORMAT GetBCFormat(TEXTURE_FORMAT format)
+{
+	return (format == TEXTURE_FORMAT_BC1_UNORM) ? BC_FORMAT_BC1 : (format == TEXTURE_FORMAT_BC4_UNORM) ? BC_FORMAT_BC4 : BC_FORMAT_BC5;
+}
+
+void DownsampleImage(const Image& source, Image& destination)
+{
+	destination.Width = std::max(source.Width / 2, 1);
+	destination.Height = std::max(source.Height / 2, 1);
+	destination.Channels = source.Channels;
+	destination.Texels.resize((size_t)destination.Width * destination.Height * destination.Channels);
+
+	int channels = source.Channels;
+	for (int y = 0; y < destination.Height; y++)
+	{
+		int y0 = std::min(2 * y, source.Height - 1), y1 = std::min(2 * y + 1, source.Height - 1);
+		for (int x = 0; x < destination.Width; x++)
+		{
+			int x0 = std::min(2 * x, source.Width - 1), x1 = std::min(2 * x + 1, source.Width - 1);
+			const unsigned char* p00 = &source.Texels[((size_t)y0 * source.Width + x0) * channels];
+			const unsigned char* p01 = &source.Texels[((size_t)y0 * source.Width + x1) * channels];
+			const unsigned char* p10 = &source.Texels[((size_t)y1 * source.Width + x0) * channels];
+			const unsigned char* p11 = &source.Texels[((size_t)y1 * source.Width + x1) * channels];
+			unsigned char* pOut = &destination.Texels[((size_t)y * destination.Width + x) * channels];
+			for (int c = 0; c < channels; c++)
+				pOut[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+		}
+	}
+}
+
+static unsigned long long AlignOffset(unsigned long long offset)
+{
+	return (offset + TEXTURE_CONTAINER_ALIGNMENT - 1) & ~(unsigned long long)(TEXTURE_CONTAINER_ALIGNMENT - 1);
+}
+
+bool WriteTextureContainer(const char* pFileName, const std::vector<TextureSource>& textures, std::vector<TextureCookStats>* pStats)
+{
+	// Build and encode every mip chain first so the table can be written up front
+	std::vector<TextureContainerEntry> entries(textures.size());
+	std::vector<std::vector<std::vector<unsigned char> > > mipData(textures.size());
+	if (pStats)
+		pStats->resize(textures.size());
+	unsigned long long offset = sizeof(TextureContainerHeader) + sizeof(TextureContainerEntry) * textures.size();
+	for (size_t t = 0; t < textures.size(); t++)
+	{
+		const TextureSource& source = textures[t];
+		bool blockCompressed = IsBlockCompressed(source.Format);
+		if (GetTextureFormatSize(source.Format) == 0 || source.Name.size() >= TEXTURE_CONTAINER_NAME_LENGTH ||
+			source.Texels.Width < 1 || source.Texels.Height < 1 ||
+			(blockCompressed && (source.Texels.Width % BC_BLOCK_DIMENSION != 0 || source.Texels.Height % BC_BLOCK_DIMENSION != 0)))
+			return false;
+
+		TextureContainerEntry& entry = entries[t];
+		memset(&entry, 0, sizeof(entry));
+		strcpy(entry.Name, source.Name.c_str());
+		entry.Format = source.Format;
+		entry.Width = source.Texels.Width;
+		entry.Height = source.Texels.Height;
+
+		// The BC encoders take RGBA or gray, the uncompressed formats are stored as is
+		int mipChannels = blockCompressed ? GetBCSourceChannels(GetBCFormat(source.Format)) : GetTextureFormatSize(source.Format);
+		std::vector<Image> mips(1);
+		ConvertImage(source.Texels, mipChannels, mips[0]);
+		while (mips.back().Width > 1 || mips.back().Height > 1)
+		{
+			if (mips.size() == TEXTURE_CONTAINER_MAX_MIPS)
+				return false;
+			mips.resize(mips.size() + 1);
+			if (source.Mips.empty())
+			{
+				DownsampleImage(mips[mips.size() - 2], mips.back());
+				continue;
+			}
+
+			// Given levels have to form the same chain
+			const Image* pLevel = (mips.size() - 2 < source.Mips.size()) ? &source.Mips[mips.size() - 2] : NULL;
+			if (!pLevel || pLevel->Width != std::max(mips[mips.size() - 2].Width / 2, 1) ||
+				pLevel->Height != std::max(mips[mips.size() - 2].Height / 2, 1))
+				return false;
+			ConvertImage(*pLevel, mipChannels, mips.back());
+		}
+		if (!source.Mips.empty() && source.Mips.size() != mips.size() - 1)
+			return false;
+
+		TextureCookStats stats;
+		stats.Psnr = std::numeric_limits<double>::infinity();
+		stats.Size = 0;
+		stats.UncompressedSize = 0;
+		mipData[t].resize(mips.size());
+		for (size_t m = 0; m < mips.size(); m++)
+		{
+			if (!blockCompressed)
+			{
+				mipData[t][m].swap(mips[m].Texels);
+			}
+			else if (!CompressImage(mips[m], GetBCFormat(source.Format), mipData[t][m]))
+			{
+				return false;
+			}
+			stats.Size += mipData[t][m].size();
+			stats.UncompressedSize += (unsigned long long)mips[m].Width * mips[m].Height * 4;
+		}
+		if (pStats && blockCompressed)
+		{
+			Image decoded;
+			DecompressImage(mipData[t][0].data(), GetBCFormat(source.Format), mips[0].Width, mips[0].Height, decoded);
+			stats.Psnr = ComputePsnr(mips[0], decoded, GetTextureFormatChannels(source.Format));
+		}
+		if (pStats)
+			(*pStats)[t] = stats;
+
+		entry.MipCount = (unsigned int)mips.size();
+		for (size_t m = 0; m < mips.size(); m++)
+		{
+			unsigned int rowPitch;
+			unsigned long long size;
+			GetTextureMipLayout(source.Format, mips[m].Width, mips[m].Height, rowPitch, size);
+			if (size > 0xffffffffull)
+				return false;
+			offset = AlignOffset(offset);
+			entry.Mips[m].Offset = offset;
+			entry.Mips[m].Width = mips[m].Width;
+			entry.Mips[m].Height = mips[m].Height;
+			entry.Mips[m].RowPitch = rowPitch;
+			entry.Mips[m].Size = (unsigned int)size;
+			offset += size;
+		}
+	}
+
+	TextureContainerHeader header;
+	header.Magic = TEXTURE_CONTAINER_MAGIC;
+	header.Version = TEXTURE_CONTAINER_VERSION;
+	header.TextureCount = (unsigned int)textures.size();
+	header.Reserved = 0;
+	header.FileSize = offset;
+
+	FILE* pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	bool success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+	if (success && !entries.empty())
+		success = fwrite(entries.data(), sizeof(TextureContainerEntry), entries.size(), pFile) == entries.size();
+
+	static const unsigned char s_Padding[TEXTURE_CONTAINER_ALIGNMENT] = { 0 };
+	unsigned long long position = sizeof(TextureContainerHeader) + sizeof(TextureContainerEntry) * textures.size();
+	for (size_t t = 0; t < textures.size() && success; t++)
+	{
+		for (size_t m = 0; m < mipData[t].size() && success; m++)
+		{
+			const TextureContainerMip& mip = entries[t].Mips[m];
+			size_t padding = (size_t)(mip.Offset - position);
+			success = fwrite(s_Padding, 1, padding, pFile) == padding &&
+				fwrite(mipData[t][m].data(), 1, mip.Size, pFile) == mip.Size;
+			position = mip.Offset + mip.Size;
+		}
+	}
+	success = (fclose(pFile) == 0) && success;
+	if (!success)
+		remove(pFileName);
+	return success;
+}
+
+
+//--------------------------------------------------------------------------------------
+// TextureContainerReader
+//--------------------------------------------------------------------------------------
+bool TextureContainerReader::Open(const char* pFileName)
+{
+	Close();
+	if (!m_File.Open(pFileName))
+		return false;
+
+	size_t size = m_File.GetSize();
+	const TextureContainerHeader* pHeader = (const TextureContainerHeader*)m_File.GetData();
+	if (size < sizeof(TextureContainerHeader) || pHeader->Magic != TEXTURE_CONTAINER_MAGIC ||
+		pHeader->Version != TEXTURE_CONTAINER_VERSION || pHeader->FileSize != size ||
+		pHeader->TextureCount > (size - sizeof(TextureContainerHeader)) / sizeof(TextureContainerEntry))
+	{
+		Close();
+		return false;
+	}
+
+	const TextureContainerEntry* pEntries = (const TextureContainerEntry*)(m_File.GetData() + sizeof(TextureContainerHeader));
+	for (unsigned int t = 0; t < pHeader->TextureCount; t++)
+	{
+		const TextureContainerEntry& entry = pEntries[t];
+		TEXTURE_FORMAT format = (TEXTURE_FORMAT)entry.Format;
+		bool valid = GetTextureFormatSize(format) > 0 && entry.MipCount >= 1 && entry.MipCount <= TEXTURE_CONTAINER_MAX_MIPS &&
+			memchr(entry.Name, 0, TEXTURE_CONTAINER_NAME_LENGTH) != NULL &&
+			(entry.Width >> TEXTURE_CONTAINER_MAX_MIPS) == 0 && (entry.Height >> TEXTURE_CONTAINER_MAX_MIPS) == 0 &&
+			(!IsBlockCompressed(format) || (entry.Width % BC_BLOCK_DIMENSION == 0 && entry.Height % BC_BLOCK_DIMENSION == 0));
+		for (unsigned int m = 0; m < entry.MipCount && valid; m++)
+		{
+			const TextureContainerMip& mip = entry.Mips[m];
+			unsigned int width = std::max(entry.Width >> m, 1u), height = std::max(entry.Height >> m, 1u);
+			unsigned int rowPitch;
+			unsigned long long mipSize;
+			GetTextureMipLayout(format, width, height, rowPitch, mipSize);
+			valid = mip.Offset % TEXTURE_CONTAINER_ALIGNMENT == 0 && mip.Offset <= size && mip.Size <= size - mip.Offset &&
+				mip.Width == width && mip.Height == height && mip.RowPitch == rowPitch && mip.Size == mipSize;
+		}
+		if (!valid)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	m_pHeader = pHeader;
+	m_pEntries = pEntries;
+	return true;
+}
+
+void TextureContainerReader::Close()
+{
+	m_File.Close();
+	m_pHeader = NULL;
+	m_pEntries = NULL;
+}
+
+const TextureContainerEntry* TextureContainerReader::FindTexture(const char* pName) const
+{
+	for (int t = 0; t < GetTextureCount(); t++)
+	{
+		if (strcmp(m_pEntries[t].Name, pName) == 0)
+			return &m_pEntries[t];
+	}
+	return NULL;
+}
+
+unsigned long long TextureContainerReader::HashTexture(const TextureContainerEntry& entry) const
+{
+	unsigned long long hash = HashBytes(entry.Name, strlen(entry.Name));
+	hash = HashBytes(&entry.Format, sizeof(entry.Format), hash);
+	hash = HashBytes(&entry.Width, sizeof(entry.Width), hash);
+	hash = HashBytes(&entry.Height, sizeof(entry.Height), hash);
+	return HashBytes(GetMipData(entry, 0), entry.Mips[0].Size, hash);
+}
@@ -0,0 +1,136 @@
+//--------------------------------------------------------------------------------------
+// File: TextureContainer.h
+//
+// Binary container of precooked textures with full mip chains. Every mip starts at an
+// aligned offset with tightly packed rows (of 4x4 blocks for the BC formats), so a
+// memory-mapped container can be passed to CreateTexture2D as initial data without
+// decoding or copying.
+//
+// Layout: TextureContainerHeader, TextureCount TextureContainerEntry records, texel data.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "ImageIO.h"
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include <string>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define TEXTURE_CONTAINER_MAGIC         0x4b505854      // "TXPK"
+#define TEXTURE_CONTAINER_VERSION       1
+#define TEXTURE_CONTAINER_MAX_MIPS      16
+#define TEXTURE_CONTAINER_NAME_LENGTH   32
+#define TEXTURE_CONTAINER_ALIGNMENT     256
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum TEXTURE_FORMAT
+{
+	TEXTURE_FORMAT_R8_UNORM = 1,        // DXGI_FORMAT_R8_UNORM
+	TEXTURE_FORMAT_R8G8B8A8_UNORM = 2,  // DXGI_FORMAT_R8G8B8A8_UNORM
+	TEXTURE_FORMAT_BC1_UNORM = 3,       // DXGI_FORMAT_BC1_UNORM
+	TEXTURE_FORMAT_BC4_UNORM = 4,       // DXGI_FORMAT_BC4_UNORM
+	TEXTURE_FORMAT_BC5_UNORM = 5,       // DXGI_FORMAT_BC5_UNORM
+	TEXTURE_FORMAT_R8G8_UNORM = 6,      // DXGI_FORMAT_R8G8_UNORM
+};
+
+
+//--------------------------------------------------------------------------------------
+// File structures
+//--------------------------------------------------------------------------------------
+struct TextureContainerHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int TextureCount;
+	unsigned int Reserved;
+	unsigned long long FileSize;
+};
+
+struct TextureContainerMip
+{
+	unsigned long long Offset;      // from the start of the file
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int RowPitch;
+	unsigned int Size;
+};
+
+struct TextureContainerEntry
+{
+	char Name[TEXTURE_CONTAINER_NAME_LENGTH];
+	unsigned int Format;
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int MipCount;
+	TextureContainerMip Mips[TEXTURE_CONTAINER_MAX_MIPS];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Cooking
+//--------------------------------------------------------------------------------------
+struct TextureSource
+{
+	std::string Name;
+	TEXTURE_FORMAT Format;
+	Image Texels;               // any channel count, converted to Format
+	std::vector<Image> Mips;    // optional levels below Texels, box filtered from it when empty
+};
+
+// Per-texture result of cooking. Sizes cover the whole mip chain, UncompressedSize is
+// what the chain takes as RGBA8. Psnr compares mip 0 with the source over the channels
+// the format keeps and is infinite for lossless formats.
+struct TextureCookStats
+{
+	double Psnr;
+	unsigned long long Size;
+	unsigned long long UncompressedSize;
+};
+
+// Bytes per texel, or per 4x4 block for the BC formats. 0 for unknown formats.
+int GetTextureFormatSize(TEXTURE_FORMAT format);
+bool IsBlockCompressed(TEXTURE_FORMAT format);
+
+// Channels of the source image that end up in the texture
+int GetTextureFormatChannels(TEXTURE_FORMAT format);
+
+void GetTextureMipLayout(TEXTURE_FORMAT format, unsigned int width, unsigned int height, unsigned int& rowPitch, unsigned long long& size);
+
+// Next level of a box filtered mip chain, (max(w / 2, 1), max(h / 2, 1)) like D3D11
+void DownsampleImage(const Image& source, Image& destination);
+
+// Builds and encodes the mip chains and writes the container, returns false on I/O or
+// invalid input. BC formats need a top level with dimensions divisible by 4 like D3D11.
+bool WriteTextureContainer(const char* pFileName, const std::vector<TextureSource>& textures,
+	std::vector<TextureCookStats>* pStats = NULL);
+
+
+//--------------------------------------------------------------------------------------
+// TextureContainerReader
+//--------------------------------------------------------------------------------------
+class TextureContainerReader
+{
+public:
+	// Maps the file and validates every entry against its size
+	bool Open(const char* pFileName);
+	void Close();
+
+	int GetTextureCount() const { return m_pHeader ? (int)m_pHeader->TextureCount : 0; }
+	const TextureContainerEntry* GetTexture(int index) const { return &m_pEntries[index]; }
+	const TextureContainerEntry* FindTexture(const char* pName) const;
+	const void* GetMipData(const TextureContainerEntry& entry, int mip) const { return m_File.GetData() + entry.Mips[mip].Offset; }
+
+	// Hash of the name, format, size and top level texels of an entry, keys the sidecar
+	// files of data derived from it. Does not depend on where the entry is in the file.
+	unsigned long long HashTexture(const TextureContainerEntry& entry) const;
+
+private:
+	MappedFile m_File;
+	const TextureContainerHeader* m_pHeader = NULL;
+	const TextureContainerEntry* m_pEntries = NULL;
+};
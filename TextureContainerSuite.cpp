@@ -0,0 +1,227 @@
+//--------------------------------------------------------------------------------------
+// File: TextureContainerSuite.cpp
+//--------------------------------------------------------------------------------------
+#include "BenchmarkSuite.h"
+#include "TextureContainer.h"
+#include "ImageIO.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// Texture container. The cooked container is compared against the source images and
+// against a straightforward reference of the mip chain.
+//--------------------------------------------------------------------------------------
+void BuildNoiseImage(int width, int height, int channels, unsigned int seed, Image& image)
+{
+	std::vector<unsigned char> heights;
+	BuildNoiseHeightmap(width, height, seed, heights);
+	image.Width = width;
+	image.Height = height;
+	image.Channels = channels;
+	image.Texels.resize((size_t)width * height * channels);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		for (int c = 0; c < channels; c++)
+			image.Texels[i * channels + c] = (unsigned char)(heights[i] + c * 40 + (int)(i % 7));
+	}
+}
+
+int VerifyTextures()
+{
+	const char* pContainerFile = "TextureBenchmark.pack";
+	const char* pImageFile = "TextureBenchmark.ppm";
+	SuiteCheck check("textures");
+
+	// Netpbm round trip, RGB drops alpha and gray stays one channel
+	for (int channels = 1; channels <= 4; channels += 3)
+	{
+		Image image, loaded;
+		BuildNoiseImage(37, 23, channels, channels, image);
+		if (channels == 4)
+		{
+			for (size_t i = 3; i < image.Texels.size(); i += 4)
+				image.Texels[i] = 255;
+		}
+		check.FailIf(!SaveImageFile(pImageFile, image) || !LoadImageFile(pImageFile, loaded) ||
+			loaded.Width != image.Width || loaded.Height != image.Height || loaded.Channels != channels ||
+			loaded.Texels != image.Texels, "%d channel Netpbm round trip", channels);
+	}
+	remove(pImageFile);
+
+	std::vector<TextureSource> sources(3);
+	sources[0].Name = "diffuse";
+	sources[0].Format = TEXTURE_FORMAT_R8G8B8A8_UNORM;
+	BuildNoiseImage(150, 100, 4, 1, sources[0].Texels);
+	sources[1].Name = "displacement";
+	sources[1].Format = TEXTURE_FORMAT_R8_UNORM;
+	BuildNoiseImage(97, 33, 4, 2, sources[1].Texels);
+	sources[2].Name = "single";
+	sources[2].Format = TEXTURE_FORMAT_R8G8B8A8_UNORM;
+	BuildNoiseImage(1, 1, 1, 3, sources[2].Texels);
+
+	TextureContainerReader reader;
+	if (!WriteTextureContainer(pContainerFile, sources) || !reader.Open(pContainerFile) || reader.GetTextureCount() != 3)
+	{
+		check.Fail("container round trip failed");
+		remove(pContainerFile);
+		return check.Finish();
+	}
+
+	for (size_t t = 0; t < sources.size(); t++)
+	{
+		const TextureContainerEntry* pEntry = reader.FindTexture(sources[t].Name.c_str());
+		if (!pEntry || pEntry->Format != (unsigned int)sources[t].Format)
+		{
+			check.Fail("%s is missing", sources[t].Name.c_str());
+			continue;
+		}
+
+		// Full chain down to 1x1, every level aligned and matching the reference
+		int formatSize = GetTextureFormatSize(sources[t].Format);
+		int expectedMips = 1;
+		while ((pEntry->Width >> expectedMips) > 0 || (pEntry->Height >> expectedMips) > 0)
+			expectedMips++;
+		check.FailIf((int)pEntry->MipCount != expectedMips, "%s has %u mips, expected %d", sources[t].Name.c_str(),
+			pEntry->MipCount, expectedMips);
+
+		Image level;
+		ConvertImage(sources[t].Texels, formatSize, level);
+		for (unsigned int m = 0; m < pEntry->MipCount; m++)
+		{
+			const unsigned char* pData = (const unsigned char*)reader.GetMipData(*pEntry, m);
+			if ((size_t)pData % TEXTURE_CONTAINER_ALIGNMENT != 0 || (int)pEntry->Mips[m].Width != level.Width ||
+				(int)pEntry->Mips[m].Height != level.Height || memcmp(pData, level.Texels.data(), level.Texels.size()) != 0)
+			{
+				check.Fail("%s mip %u differs from the reference", sources[t].Name.c_str(), m);
+				break;
+			}
+			Image next;
+			DownsampleImage(level, next);
+			level = next;
+		}
+	}
+
+	// Spot check of the box filter against the source
+	const TextureContainerEntry* pDiffuse = reader.FindTexture("diffuse");
+	int filterErrors = 0;
+	if (pDiffuse)
+	{
+		const unsigned char* pMip1 = (const unsigned char*)reader.GetMipData(*pDiffuse, 1);
+		const Image& source = sources[0].Texels;
+		for (int y = 0; y < (int)pDiffuse->Mips[1].Height; y += 7)
+		{
+			for (int x = 0; x < (int)pDiffuse->Mips[1].Width; x += 5)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					int sum = 0;
+					for (int dy = 0; dy < 2; dy++)
+						for (int dx = 0; dx < 2; dx++)
+							sum += source.Texels[((size_t)(2 * y + dy) * source.Width + 2 * x + dx) * 4 + c];
+					if (pMip1[((size_t)y * pDiffuse->Mips[1].Width + x) * 4 + c] != (sum + 2) / 4)
+						filterErrors++;
+				}
+			}
+		}
+	}
+	check.FailIf(filterErrors != 0, "%d diffuse mip 1 texels are not the average of their source texels", filterErrors);
+
+	// The texture hash follows the texels of the entry, not where it is in the file
+	const TextureContainerEntry* pDisplacement = reader.FindTexture("displacement");
+	unsigned long long displacementHash = pDisplacement ? reader.HashTexture(*pDisplacement) : 0;
+	reader.Close();
+	std::vector<TextureSource> reordered(sources.rbegin(), sources.rend());
+	bool moved = WriteTextureContainer(pContainerFile, reordered) && reader.Open(pContainerFile) &&
+		(pDisplacement = reader.FindTexture("displacement")) != NULL && reader.HashTexture(*pDisplacement) == displacementHash;
+	reader.Close();
+	reordered[1].Texels.Texels[0] ^= 1;
+	bool changed = WriteTextureContainer(pContainerFile, reordered) && reader.Open(pContainerFile) &&
+		(pDisplacement = reader.FindTexture("displacement")) != NULL && reader.HashTexture(*pDisplacement) != displacementHash;
+	reader.Close();
+	check.FailIf(!moved || !changed, "the texture hash %s when the entry moves and %s when a texel changes",
+		moved ? "holds" : "changes", changed ? "changes" : "holds");
+
+	// Truncated and foreign files are rejected
+	FILE* pFile = fopen(pContainerFile, "r+b");
+	if (pFile)
+	{
+		TextureContainerHeader header;
+		if (fread(&header, sizeof(header), 1, pFile) == 1)
+		{
+			header.FileSize += 1;
+			fseek(pFile, 0, SEEK_SET);
+			fwrite(&header, sizeof(header), 1, pFile);
+		}
+		fclose(pFile);
+	}
+	check.FailIf(reader.Open(pContainerFile), "container with a wrong size was accepted");
+	remove(pContainerFile);
+
+	return check.Finish("%d textures", (int)sources.size());
+}
+
+void RunTextureThroughput()
+{
+	// Same sizes as the demo's diffuse, displacement and normal maps
+	const char* pContainerFile = "TextureBenchmark.pack";
+	static const char* s_ImageFiles[] = { "TextureBenchmark0.ppm", "TextureBenchmark1.pgm", "TextureBenchmark2.ppm" };
+	std::vector<TextureSource> sources(3);
+	for (int t = 0; t < 3; t++)
+	{
+		sources[t].Name = (t == 0) ? "diffuse" : (t == 1) ? "displacement" : "normal";
+		sources[t].Format = (t == 1) ? TEXTURE_FORMAT_R8_UNORM : TEXTURE_FORMAT_R8G8B8A8_UNORM;
+		BuildNoiseImage(1500, 1000, (t == 1) ? 1 : 4, t, sources[t].Texels);
+		SaveImageFile(s_ImageFiles[t], sources[t].Texels);
+	}
+
+	double start = GetTimeSeconds();
+	WriteTextureContainer(pContainerFile, sources);
+	double cookSeconds = GetTimeSeconds() - start;
+
+	// Without the container: decode every image and build its mip chain at startup
+	start = GetTimeSeconds();
+	size_t decodedBytes = 0;
+	for (int t = 0; t < 3; t++)
+	{
+		Image level;
+		LoadImageFile(s_ImageFiles[t], level);
+		while (level.Width > 1 || level.Height > 1)
+		{
+			decodedBytes += level.Texels.size();
+			Image next;
+			DownsampleImage(level, next);
+			level = next;
+		}
+	}
+	double decodeSeconds = GetTimeSeconds() - start;
+
+	// With the container: map it and touch every page the upload would read
+	start = GetTimeSeconds();
+	TextureContainerReader reader;
+	reader.Open(pContainerFile);
+	unsigned int checksum = 0;
+	size_t mappedBytes = 0;
+	for (int t = 0; t < reader.GetTextureCount(); t++)
+	{
+		const TextureContainerEntry* pEntry = reader.GetTexture(t);
+		for (unsigned int m = 0; m < pEntry->MipCount; m++)
+		{
+			const unsigned char* pData = (const unsigned char*)reader.GetMipData(*pEntry, m);
+			for (unsigned int i = 0; i < pEntry->Mips[m].Size; i += 4096)
+				checksum += pData[i];
+			mappedBytes += pEntry->Mips[m].Size;
+		}
+	}
+	double mapSeconds = GetTimeSeconds() - start;
+	reader.Close();
+
+	for (int t = 0; t < 3; t++)
+		remove(s_ImageFiles[t]);
+	remove(pContainerFile);
+
+	printf("textures cook %10.3f ms\n", cookSeconds * 1000.0);
+	printf("textures decode + mips %10.3f ms  %8.2f MB\n", decodeSeconds * 1000.0, decodedBytes / 1048576.0);
+	printf("textures map container %10.3f ms  %8.2f MB  (checksum %u)\n", mapSeconds * 1000.0, mappedBytes / 1048576.0, checksum);
+}
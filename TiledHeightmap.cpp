@@ -0,0 +1,195 @@
+//--------------------------------------------------------------------------------------
+// File: TiledHeightmap.cpp
+//--------------------------------------------------------------------------------------
+#include "TiledHeightmap.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Layout
+//--------------------------------------------------------------------------------------
+int GetHeightFormatSize(HEIGHT_FORMAT format)
+{
+	switch (format)
+	{
+	case HEIGHT_FORMAT_R16_UNORM: return 2;
+	case HEIGHT_FORMAT_R32_FLOAT: return 4;
+	}
+	return 0;
+}
+
+void GetHeightTileMipLayout(const TiledHeightmapHeader& header, int mip, unsigned int& offset, unsigned int& size)
+{
+	unsigned int sampleSize = GetHeightFormatSize((HEIGHT_FORMAT)header.Format);
+	offset = 0;
+	for (int m = 0; m < mip; m++)
+	{
+		unsigned int side = header.TileSize >> m;
+		offset += side * side * sampleSize;
+	}
+	unsigned int side = header.TileSize >> mip;
+	size = side * side * sampleSize;
+}
+
+float ReadHeightSample(HEIGHT_FORMAT format, const unsigned char* pMip, unsigned int index)
+{
+	if (format == HEIGHT_FORMAT_R16_UNORM)
+	{
+		unsigned short sample;
+		memcpy(&sample, pMip + (size_t)index * 2, 2);
+		return sample / 65535.0f;
+	}
+	float sample;
+	memcpy(&sample, pMip + (size_t)index * 4, 4);
+	return sample;
+}
+
+static unsigned long long AlignOffset(unsigned long long offset)
+{
+	return (offset + TILED_HEIGHTMAP_ALIGNMENT - 1) & ~(unsigned long long)(TILED_HEIGHTMAP_ALIGNMENT - 1);
+}
+
+static int GetTileMipCount(unsigned int tileSize)
+{
+	int mipCount = 1;
+	while ((tileSize >> (mipCount - 1)) > 1)
+		mipCount++;
+	return mipCount;
+}
+
+static bool IsValidTileSize(unsigned int tileSize)
+{
+	return tileSize >= TILED_HEIGHTMAP_MIN_TILE_SIZE && tileSize <= TILED_HEIGHTMAP_MAX_TILE_SIZE &&
+		(tileSize & (tileSize - 1)) == 0;
+}
+
+static void InitHeader(unsigned int width, unsigned int height, HEIGHT_FORMAT format, unsigned int tileSize,
+	TiledHeightmapHeader& header)
+{
+	memset(&header, 0, sizeof(header));
+	header.Magic = TILED_HEIGHTMAP_MAGIC;
+	header.Version = TILED_HEIGHTMAP_VERSION;
+	header.Format = format;
+	header.TileSize = tileSize;
+	header.Width = width;
+	header.Height = height;
+	header.TilesX = (width + tileSize - 1) / tileSize;
+	header.TilesY = (height + tileSize - 1) / tileSize;
+	header.MipCount = GetTileMipCount(tileSize);
+
+	unsigned int offset, size;
+	GetHeightTileMipLayout(header, header.MipCount - 1, offset, size);
+	header.TileStride = AlignOffset(offset + size);
+	header.DataOffset = AlignOffset(sizeof(TiledHeightmapHeader));
+	header.FileSize = header.DataOffset + (unsigned long long)header.TilesX * header.TilesY * header.TileStride;
+}
+
+bool ValidateTiledHeightmapHeader(const TiledHeightmapHeader& header, unsigned long long fileSize)
+{
+	if (header.Magic != TILED_HEIGHTMAP_MAGIC || header.Version != TILED_HEIGHTMAP_VERSION ||
+		GetHeightFormatSize((HEIGHT_FORMAT)header.Format) == 0 || !IsValidTileSize(header.TileSize) ||
+		header.Width == 0 || header.Height == 0)
+		return false;
+
+	TiledHeightmapHeader expected;
+	InitHeader(header.Width, header.Height, (HEIGHT_FORMAT)header.Format, header.TileSize, expected);
+	return memcmp(&header, &expected, sizeof(header)) == 0 && header.FileSize == fileSize;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writing
+//--------------------------------------------------------------------------------------
+static void EncodeSamples(HEIGHT_FORMAT format, const float* pSamples, size_t count, unsigned char* pOut)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (format == HEIGHT_FORMAT_R16_UNORM)
+		{
+			float value = std::min(std::max(pSamples[i], 0.0f), 1.0f);
+			unsigned short sample = (unsigned short)(value * 65535.0f + 0.5f);
+			memcpy(pOut + i * 2, &sample, 2);
+		}
+		else
+		{
+			memcpy(pOut + i * 4, &pSamples[i], 4);
+		}
+	}
+}
+
+bool WriteTiledHeightmap(const char* pFileName, unsigned int width, unsigned int height, HEIGHT_FORMAT format,
+	unsigned int tileSize, const HeightRowFunction& rowFunction)
+{
+	if (width == 0 || height == 0 || GetHeightFormatSize(format) == 0 || !IsValidTileSize(tileSize))
+		return false;
+
+	TiledHeightmapHeader header;
+	InitHeader(width, height, format, tileSize, header);
+
+	FILE* pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	std::vector<unsigned char> headerBlock((size_t)header.DataOffset, 0);
+	memcpy(&headerBlock[0], &header, sizeof(header));
+	bool success = fwrite(&headerBlock[0], 1, headerBlock.size(), pFile) == headerBlock.size();
+
+	// One row of tiles, padded to whole tiles by repeating the last column and row
+	size_t bandWidth = (size_t)header.TilesX * tileSize;
+	std::vector<float> band(bandWidth * tileSize);
+	std::vector<float> tile((size_t)tileSize * tileSize), mip((size_t)tileSize * tileSize / 4);
+	std::vector<unsigned char> record((size_t)header.TileStride);
+	for (unsigned int tileY = 0; tileY < header.TilesY && success; tileY++)
+	{
+		for (unsigned int row = 0; row < tileSize; row++)
+		{
+			float* pRow = &band[row * bandWidth];
+			unsigned int y = tileY * tileSize + row;
+			if (y < height)
+			{
+				rowFunction(y, pRow);
+				std::fill(pRow + width, pRow + bandWidth, pRow[width - 1]);
+			}
+			else
+			{
+				memcpy(pRow, pRow - bandWidth, bandWidth * sizeof(float));
+			}
+		}
+
+		for (unsigned int tileX = 0; tileX < header.TilesX && success; tileX++)
+		{
+			for (unsigned int row = 0; row < tileSize; row++)
+				memcpy(&tile[row * tileSize], &band[row * bandWidth + tileX * tileSize], tileSize * sizeof(float));
+
+			// Every mip is the 2x2 box filter of the one before, in float for both formats
+			unsigned int offset = 0;
+			for (unsigned int m = 0; m < header.MipCount; m++)
+			{
+				unsigned int side = tileSize >> m;
+				EncodeSamples(format, &tile[0], (size_t)side * side, &record[offset]);
+				offset += side * side * GetHeightFormatSize(format);
+				if (side == 1)
+					break;
+
+				unsigned int half = side / 2;
+				for (unsigned int y = 0; y < half; y++)
+				{
+					for (unsigned int x = 0; x < half; x++)
+					{
+						const float* p = &tile[(2 * y) * side + 2 * x];
+						mip[y * half + x] = (p[0] + p[1] + p[side] + p[side + 1]) * 0.25f;
+					}
+				}
+				std::copy(mip.begin(), mip.begin() + half * half, tile.begin());
+			}
+			success = fwrite(&record[0], 1, record.size(), pFile) == record.size();
+		}
+	}
+	success = (fclose(pFile) == 0) && success;
+	if (!success)
+		remove(pFileName);
+	return success;
+}
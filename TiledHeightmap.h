@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// File: TiledHeightmap.h
+//
+// On-disk heightmap split into square tiles of 16-bit or float samples. Every tile
+// record holds the tile's own mip chain down to 1x1 and starts on a page, so a tile can
+// be memory-mapped at any mip without touching the rest of the file (see
+// HeightStreamer.h). The writer holds one row of tiles at a time, so heightmaps far
+// larger than memory can be cooked.
+//
+// Layout: TiledHeightmapHeader, then TilesX * TilesY records of TileStride bytes in
+// row-major order, each with mip 0, 1, ... of the tile tightly packed.
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <functional>
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define TILED_HEIGHTMAP_MAGIC           0x4c495448      // "HTIL"
+#define TILED_HEIGHTMAP_VERSION         1
+#define TILED_HEIGHTMAP_ALIGNMENT       4096
+#define TILED_HEIGHTMAP_MIN_TILE_SIZE   16
+#define TILED_HEIGHTMAP_MAX_TILE_SIZE   1024
+#define TILED_HEIGHTMAP_MAX_MIPS        11              // of a 1024 sample tile
+
+
+//--------------------------------------------------------------------------------------
+// Enums
+//--------------------------------------------------------------------------------------
+enum HEIGHT_FORMAT
+{
+	HEIGHT_FORMAT_R16_UNORM = 1,        // [0, 1] in 65535 steps
+	HEIGHT_FORMAT_R32_FLOAT = 2,
+};
+
+
+//--------------------------------------------------------------------------------------
+// File structures
+//--------------------------------------------------------------------------------------
+struct TiledHeightmapHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int Format;
+	unsigned int TileSize;              // samples per tile side, a power of two
+	unsigned int Width;                 // samples of the whole heightmap
+	unsigned int Height;
+	unsigned int TilesX;
+	unsigned int TilesY;
+	unsigned int MipCount;              // of every tile, down to 1x1
+	unsigned int Reserved;
+	unsigned long long TileStride;      // bytes per tile record, a multiple of the alignment
+	unsigned long long DataOffset;      // of the first tile record
+	unsigned long long FileSize;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Bytes per sample, 0 for unknown formats
+int GetHeightFormatSize(HEIGHT_FORMAT format);
+
+// Byte range of a mip inside a tile record
+void GetHeightTileMipLayout(const TiledHeightmapHeader& header, int mip, unsigned int& offset, unsigned int& size);
+
+inline unsigned long long GetHeightTileOffset(const TiledHeightmapHeader& header, unsigned int tileX, unsigned int tileY)
+{
+	return header.DataOffset + ((unsigned long long)tileY * header.TilesX + tileX) * header.TileStride;
+}
+
+// Sample i of a mapped mip, R16_UNORM is returned in [0, 1]
+float ReadHeightSample(HEIGHT_FORMAT format, const unsigned char* pMip, unsigned int index);
+
+// Checks the header of a file of fileSize bytes, the layout has to match exactly what
+// WriteTiledHeightmap writes
+bool ValidateTiledHeightmapHeader(const TiledHeightmapHeader& header, unsigned long long fileSize);
+
+// Fills row y of the heightmap with width samples. R16_UNORM clamps them to [0, 1].
+typedef std::function<void(unsigned int y, float* pRow)> HeightRowFunction;
+
+// Writes the heightmap row by row from rowFunction, which is called once per row in
+// order. Tiles past the edge of the heightmap repeat its last row and column, mips are
+// box filtered within the tile. Returns false on I/O errors or a tile size that is not
+// a power of two in [TILED_HEIGHTMAP_MIN_TILE_SIZE, TILED_HEIGHTMAP_MAX_TILE_SIZE].
+bool WriteTiledHeightmap(const char* pFileName, unsigned int width, unsigned int height, HEIGHT_FORMAT format,
+	unsigned int tileSize, const HeightRowFunction& rowFunction);
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: Timer.h
+//
+// Monotonic high resolution clock. Uses QueryPerformanceCounter on Windows and
+// CLOCK_MONOTONIC elsewhere, so the same timing code runs in the demo and in the
+// headless tools.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX            // keeps std::min and std::max usable in the files including this
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Returns the current time in seconds from an arbitrary fixed origin
+//--------------------------------------------------------------------------------------
+inline double GetTimeSeconds()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+// Frame clock, Tick returns the seconds since the previous tick (0 for the first one)
+//--------------------------------------------------------------------------------------
+class FrameClock
+{
+public:
+	FrameClock() : m_LastTick(-1.0) {}
+
+	double Tick()
+	{
+		double now = GetTimeSeconds();
+		double delta = (m_LastTick < 0.0) ? 0.0 : now - m_LastTick;
+		m_LastTick = now;
+		return delta;
+	}
+
+private:
+	double m_LastTick;
+};
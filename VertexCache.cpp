@@ -0,0 +1,222 @@
+//--------------------------------------------------------------------------------------
+// File: VertexCache.cpp
+//--------------------------------------------------------------------------------------
+#include "VertexCache.h"
+#include <math.h>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Scores, with the constants of Forsyth's paper
+//--------------------------------------------------------------------------------------
+#define CACHE_DECAY_POWER       1.5f
+#define LAST_TRIANGLE_SCORE     0.75f
+#define VALENCE_BOOST_SCALE     2.0f
+#define VALENCE_BOOST_POWER     0.5f
+#define MAX_SCORED_VALENCE      32      // remaining triangle counts above share the last boost
+
+struct VertexScoreTable
+{
+	float Cache[VERTEX_CACHE_SCORE_SIZE];
+	float Valence[MAX_SCORED_VALENCE + 1];
+
+	VertexScoreTable()
+	{
+		// The vertices of the last triangle get a fixed score, so it does not matter in
+		// which order they were added
+		for (int position = 0; position < VERTEX_CACHE_SCORE_SIZE; position++)
+		{
+			if (position < 3)
+				Cache[position] = LAST_TRIANGLE_SCORE;
+			else
+				Cache[position] = powf(1.0f - (position - 3) / (float)(VERTEX_CACHE_SCORE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+		Valence[0] = 0.0f;
+		for (int remaining = 1; remaining <= MAX_SCORED_VALENCE; remaining++)
+			Valence[remaining] = VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+	}
+};
+
+static float VertexScore(const VertexScoreTable& table, int cachePosition, int remaining)
+{
+	// Vertices without triangles left are never looked at again
+	if (remaining == 0)
+		return -1.0f;
+	float score = (cachePosition >= 0) ? table.Cache[cachePosition] : 0.0f;
+	return score + table.Valence[remaining < MAX_SCORED_VALENCE ? remaining : MAX_SCORED_VALENCE];
+}
+
+// Built before main, the optimizer runs on several threads at once
+static const VertexScoreTable s_Scores;
+
+
+//--------------------------------------------------------------------------------------
+// Optimization
+//--------------------------------------------------------------------------------------
+void OptimizeVertexCache(int* pIndices, int indexCount, int vertexCount)
+{
+	int triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount <= 0)
+		return;
+
+	// Triangles of every vertex, the first remaining[v] entries of its range are the ones
+	// not emitted yet
+	std::vector<int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+	for (int i = 0; i < triangleCount * 3; i++)
+		remaining[pIndices[i]]++;
+	for (int v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<int> adjacency(triangleCount * 3), filled(offsets.begin(), offsets.end() - 1);
+	for (int i = 0; i < triangleCount * 3; i++)
+		adjacency[filled[pIndices[i]]++] = i / 3;
+
+	std::vector<float> vertexScores(vertexCount);
+	for (int v = 0; v < vertexCount; v++)
+		vertexScores[v] = VertexScore(s_Scores, -1, remaining[v]);
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<int> output(triangleCount * 3);
+	int cache[VERTEX_CACHE_SCORE_SIZE + 3], newCache[VERTEX_CACHE_SCORE_SIZE + 3];
+	int cacheCount = 0;
+	int scanCursor = 0;
+
+	// The first triangle is the one with the best valence scores
+	int best = 0;
+	float bestScore = -1.0f;
+	for (int t = 0; t < triangleCount; t++)
+	{
+		const int* pTriangle = pIndices + t * 3;
+		float score = vertexScores[pTriangle[0]] + vertexScores[pTriangle[1]] + vertexScores[pTriangle[2]];
+		if (score > bestScore)
+		{
+			bestScore = score;
+			best = t;
+		}
+	}
+
+	for (int written = 0; written < triangleCount; written++)
+	{
+		// Without a candidate around the cache the next triangle in input order continues,
+		// which only happens when a connected piece is finished
+		if (best < 0)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			best = scanCursor;
+		}
+
+		const int* pTriangle = pIndices + best * 3;
+		emitted[best] = 1;
+		for (int c = 0; c < 3; c++)
+		{
+			int v = pTriangle[c];
+			output[written * 3 + c] = v;
+
+			// Move the triangle behind the remaining ones of the vertex
+			int* pBegin = &adjacency[offsets[v]];
+			int* pEnd = pBegin + remaining[v];
+			for (int* p = pBegin; p < pEnd; p++)
+			{
+				if (*p == best)
+				{
+					*p = pEnd[-1];
+					pEnd[-1] = best;
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// The triangle's vertices move to the front, the rest keep their order
+		int newCount = 0;
+		for (int c = 0; c < 3; c++)
+			newCache[newCount++] = pTriangle[c];
+		for (int i = 0; i < cacheCount; i++)
+		{
+			int v = cache[i];
+			if (v != pTriangle[0] && v != pTriangle[1] && v != pTriangle[2])
+				newCache[newCount++] = v;
+		}
+		for (int i = VERTEX_CACHE_SCORE_SIZE; i < newCount; i++)
+		{
+			int v = newCache[i];
+			vertexScores[v] = VertexScore(s_Scores, -1, remaining[v]);
+		}
+		cacheCount = newCount < VERTEX_CACHE_SCORE_SIZE ? newCount : VERTEX_CACHE_SCORE_SIZE;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			int v = newCache[i];
+			cache[i] = v;
+			vertexScores[v] = VertexScore(s_Scores, i, remaining[v]);
+		}
+
+		// Rescore the triangles around the cache and take the best of them
+		best = -1;
+		bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			int v = cache[i];
+			for (int a = offsets[v]; a < offsets[v] + remaining[v]; a++)
+			{
+				int t = adjacency[a];
+				const int* pOther = pIndices + t * 3;
+				float score = vertexScores[pOther[0]] + vertexScores[pOther[1]] + vertexScores[pOther[2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < triangleCount * 3; i++)
+		pIndices[i] = output[i];
+}
+
+int OptimizeVertexFetch(int* pIndices, int indexCount, int vertexCount, int* pRemap)
+{
+	for (int v = 0; v < vertexCount; v++)
+		pRemap[v] = -1;
+	int used = 0;
+	for (int i = 0; i < indexCount; i++)
+	{
+		int& remapped = pRemap[pIndices[i]];
+		if (remapped < 0)
+			remapped = used++;
+		pIndices[i] = remapped;
+	}
+	return used;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Analysis
+//--------------------------------------------------------------------------------------
+void AnalyzeVertexCache(const int* pIndices, int indexCount, int vertexCount, VertexCacheStats& stats, int cacheSize)
+{
+	// Every vertex remembers when it entered the FIFO, it is still inside while fewer
+	// than cacheSize misses happened since
+	std::vector<int> entered(vertexCount, -1);
+	std::vector<char> referenced(vertexCount, 0);
+	int misses = 0, referencedCount = 0;
+	for (int i = 0; i < indexCount; i++)
+	{
+		int v = pIndices[i];
+		if (entered[v] < 0 || misses - entered[v] >= cacheSize)
+		{
+			entered[v] = misses;
+			misses++;
+		}
+		if (!referenced[v])
+		{
+			referenced[v] = 1;
+			referencedCount++;
+		}
+	}
+
+	int triangleCount = indexCount / 3;
+	stats.Misses = misses;
+	stats.Acmr = triangleCount > 0 ? (float)misses / triangleCount : 0.0f;
+	stats.Atvr = referencedCount > 0 ? (float)misses / referencedCount : 0.0f;
+}
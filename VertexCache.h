@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// File: VertexCache.h
+//
+// Index and vertex order of static triangle lists for the post-transform vertex cache
+// and the vertex fetch. OptimizeVertexCache reorders the triangles with Tom Forsyth's
+// linear-speed algorithm: every vertex is scored by its position in a simulated LRU
+// cache and by how many triangles still use it, which favours finishing off vertices,
+// and the triangle with the best score among those touching the cache is emitted next.
+// OptimizeVertexFetch then numbers the vertices in the order they are first used, so
+// the fetches walk the vertex buffer forward.
+//
+// AnalyzeVertexCache measures an order on a FIFO cache, the replacement most hardware
+// uses, and returns the average cache miss ratio per triangle (ACMR, 0.5 is the limit
+// for large regular grids, 3 means no reuse) and per vertex (ATVR, 1 is ideal).
+//--------------------------------------------------------------------------------------
+#pragma once
+
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+#define VERTEX_CACHE_SCORE_SIZE     32      // LRU entries the optimizer scores with
+#define VERTEX_CACHE_FIFO_SIZE      16      // entries AnalyzeVertexCache simulates by default
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct VertexCacheStats
+{
+	int Misses = 0;
+	float Acmr = 0.0f;                  // misses per triangle
+	float Atvr = 0.0f;                  // misses per referenced vertex
+};
+
+
+//--------------------------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------------------------
+// Reorders the triangles of a triangle list in place. Indices have to be below
+// vertexCount.
+void OptimizeVertexCache(int* pIndices, int indexCount, int vertexCount);
+
+// Renumbers the vertices in the order of their first use and rewrites the indices.
+// pRemap receives the new index of every old vertex, -1 for vertices no triangle uses.
+// Returns the number of used vertices, the new indices are below it.
+int OptimizeVertexFetch(int* pIndices, int indexCount, int vertexCount, int* pRemap);
+
+// Simulates a FIFO post-transform cache of cacheSize entries over the triangle list
+void AnalyzeVertexCache(const int* pIndices, int indexCount, int vertexCount, VertexCacheStats& stats,
+	int cacheSize = VERTEX_CACHE_FIFO_SIZE);